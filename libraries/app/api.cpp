@@ -21,24 +21,32 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <algorithm>
 #include <cctype>
+#include <fstream>
+#include <limits>
 
 #include <graphene/app/api.hpp>
 #include <graphene/app/api_access.hpp>
+#include <graphene/app/api_stats.hpp>
 #include <graphene/app/application.hpp>
+#include <graphene/app/confirmation_registry.hpp>
 #include <graphene/app/impacted.hpp>
+#include <graphene/account_history/account_history_plugin.hpp>
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/get_config.hpp>
 #include <graphene/utilities/key_conversion.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <graphene/chain/confidential_object.hpp>
 #include <graphene/chain/market_object.hpp>
-#include <graphene/chain/transaction_object.hpp>
 #include <graphene/chain/withdraw_permission_object.hpp>
 #include <graphene/chain/worker_object.hpp>
 
 #include <fc/crypto/hex.hpp>
 #include <fc/smart_ref_impl.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <boost/filesystem.hpp>
 
 namespace graphene { namespace app {
 
@@ -75,9 +83,13 @@ namespace graphene { namespace app {
 
     void login_api::enable_api( const std::string& api_name )
     {
+       // a node following a shared state has no peers and must not push blocks or transactions
+       if( _app.follows_shared_state() &&
+           ( api_name == "network_broadcast_api" || api_name == "network_node_api" || api_name == "replication_api" ) )
+          return;
        if( api_name == "database_api" )
        {
-          _database_api = std::make_shared< database_api >( std::ref( *_app.chain_database() ) );
+          _database_api = std::make_shared< database_api >( std::ref( *_app.chain_database() ), _app.get_state_replica() );
        }
        else if( api_name == "network_broadcast_api" )
        {
@@ -95,6 +107,18 @@ namespace graphene { namespace app {
        {
           _crypto_api = std::make_shared< crypto_api >();
        }
+       else if( api_name == "call_stats_api" )
+       {
+          _call_stats_api = std::make_shared< call_stats_api >();
+       }
+       else if( api_name == "packed_api" )
+       {
+          _packed_api = std::make_shared< packed_api >( std::ref( _app ) );
+       }
+       else if( api_name == "replication_api" )
+       {
+          _replication_api = std::make_shared< replication_api >( std::ref( _app ) );
+       }
        else if( api_name == "debug_api" )
        {
           // can only enable this API if the plugin was loaded
@@ -104,53 +128,101 @@ namespace graphene { namespace app {
        return;
     }
 
-    network_broadcast_api::network_broadcast_api(application& a):_app(a)
+    vector<api_method_stats> call_stats_api::get_call_stats()const
     {
-       _applied_block_connection = _app.chain_database()->applied_block.connect([this](const signed_block& b){ on_applied_block(b); });
+       return api_call_stats::instance().get();
     }
 
-    void network_broadcast_api::on_applied_block( const signed_block& b )
+    void call_stats_api::reset_call_stats()
+    {
+       api_call_stats::instance().reset();
+    }
+
+    network_broadcast_api::network_broadcast_api(application& a):_app(a)
     {
-       if( _callbacks.size() )
-       {
-          /// we need to ensure the database_api is not deleted for the life of the async operation
-          auto capture_this = shared_from_this();
-          for( uint32_t trx_num = 0; trx_num < b.transactions.size(); ++trx_num )
-          {
-             const auto& trx = b.transactions[trx_num];
-             auto id = trx.id();
-             auto itr = _callbacks.find(id);
-             if( itr != _callbacks.end() )
-             {
-                auto block_num = b.block_num();
-                auto& callback = _callbacks.find(id)->second;
-                fc::async( [capture_this,this,id,block_num,trx_num,trx,callback](){ callback( fc::variant(transaction_confirmation{ id, block_num, trx_num, trx}) ); } );
-             }
-          }
-       }
     }
 
     void network_broadcast_api::broadcast_transaction(const signed_transaction& trx)
     {
-       trx.validate();
-       _app.chain_database()->push_transaction(trx);
+       api_call_timer timer( "network_broadcast_api", "broadcast_transaction" );
+       trx.seal( _app.chain_database()->get_chain_id() );
+       _app.push_transaction(trx);
        _app.p2p_node()->broadcast_transaction(trx);
     }
 
+    vector<network_broadcast_api::transaction_broadcast_result> network_broadcast_api::broadcast_transactions(
+       const vector<signed_transaction>& trxs )
+    {
+       api_call_timer timer( "network_broadcast_api", "broadcast_transactions" );
+       const auto& chain_id = _app.chain_database()->get_chain_id();
+       for( const auto& trx : trxs )
+          trx.seal( chain_id );
+       auto pushed = _app.chain_database()->push_transactions( trxs );
+
+       vector<transaction_broadcast_result> results( trxs.size() );
+       for( size_t i = 0; i < trxs.size(); ++i )
+       {
+          results[i].id = trxs[i].id();
+          if( pushed[i].trx.valid() )
+          {
+             results[i].accepted = true;
+             _app.p2p_node()->broadcast_transaction( trxs[i] );
+          }
+          else
+             results[i].error = pushed[i].error->to_string();
+       }
+       return results;
+    }
+
     void network_broadcast_api::broadcast_block( const signed_block& b )
     {
+       api_call_timer timer( "network_broadcast_api", "broadcast_block" );
+       for( const auto& trx : b.transactions )
+          trx.seal( _app.chain_database()->get_chain_id() );
        _app.chain_database()->push_block(b);
        _app.p2p_node()->broadcast( net::block_message( b ));
     }
 
     void network_broadcast_api::broadcast_transaction_with_callback(confirmation_callback cb, const signed_transaction& trx)
     {
+       api_call_timer timer( "network_broadcast_api", "broadcast_transaction_with_callback" );
+       broadcast_with_confirmation( cb, trx, false );
+    }
+
+    void network_broadcast_api::broadcast_transaction_with_irreversible_callback( confirmation_callback cb,
+                                                                                  const signed_transaction& trx )
+    {
+       api_call_timer timer( "network_broadcast_api", "broadcast_transaction_with_irreversible_callback" );
+       broadcast_with_confirmation( cb, trx, true );
+    }
+
+    void network_broadcast_api::broadcast_with_confirmation( confirmation_callback cb, const signed_transaction& trx,
+                                                             bool irreversible )
+    {
+       trx.seal( _app.chain_database()->get_chain_id() );
        trx.validate();
-       _callbacks[trx.id()] = cb;
-       _app.chain_database()->push_transaction(trx);
+       _app.get_confirmation_registry()->add( trx, shared_from_this(),
+          [cb]( const transaction_id_type& id, uint32_t block_num, uint32_t trx_num, const processed_transaction& t ) {
+             transaction_confirmation conf{ id, block_num, trx_num, t };
+             fc::async( [cb,conf](){ cb( fc::variant( conf ) ); } );
+          }, irreversible );
+       _app.push_transaction(trx);
        _app.p2p_node()->broadcast_transaction(trx);
     }
 
+    void network_broadcast_api::watch_irreversible_operations( std::function<void(variant)> cb,
+                                                               const vector<account_id_type>& accounts )
+    {
+       api_call_timer timer( "network_broadcast_api", "watch_irreversible_operations" );
+       FC_ASSERT( !accounts.empty(), "no accounts to watch" );
+       _app.get_confirmation_registry()->watch_accounts( flat_set<account_id_type>( accounts.begin(), accounts.end() ),
+                                                         shared_from_this(),
+          [cb]( const operation_history_object& op ) {
+             fc::variant v( op );
+             fc::async( [cb,v](){ cb( v ); } );
+          } );
+    }
+
     network_node_api::network_node_api( application& a ) : _app( a )
     {
     }
@@ -187,6 +259,43 @@ namespace graphene { namespace app {
        return _app.p2p_node()->set_advanced_node_parameters(params);
     }
 
+    net::message_propagation_data network_node_api::get_block_propagation_data(const block_id_type& block_id) const
+    {
+       return _app.p2p_node()->get_block_propagation_data(block_id);
+    }
+
+    fc::variant_object network_node_api::get_call_statistics() const
+    {
+       return _app.p2p_node()->get_call_statistics();
+    }
+
+    net::traffic_statistics network_node_api::get_traffic_statistics() const
+    {
+       return _app.p2p_node()->get_traffic_statistics();
+    }
+
+    vector<block_trace> network_node_api::get_block_traces(uint32_t limit) const
+    {
+       std::shared_ptr<block_tracer> tracer = _app.get_block_tracer();
+       if( !tracer )
+          return vector<block_trace>();
+       return tracer->get( limit );
+    }
+
+    graphene::db::object_database_memory_usage network_node_api::get_memory_usage() const
+    {
+       std::shared_ptr<graphene::chain::database> db = _app.chain_database();
+       auto lock = db->lock_state_for_reading();
+       return db->get_memory_usage();
+    }
+
+    optional<graphene::chain::block_state_digest> network_node_api::get_state_digest(uint32_t block_num) const
+    {
+       std::shared_ptr<graphene::chain::database> db = _app.chain_database();
+       auto lock = db->lock_state_for_reading();
+       return db->get_state_digest( block_num );
+    }
+
     fc::api<network_broadcast_api> login_api::network_broadcast()const
     {
        FC_ASSERT(_network_broadcast_api);
@@ -223,6 +332,125 @@ namespace graphene { namespace app {
        return *_debug_api;
     }
 
+    fc::api<packed_api> login_api::packed() const
+    {
+       FC_ASSERT(_packed_api);
+       return *_packed_api;
+    }
+
+    fc::api<call_stats_api> login_api::call_stats() const
+    {
+       FC_ASSERT(_call_stats_api);
+       return *_call_stats_api;
+    }
+
+    fc::api<replication_api> login_api::replication() const
+    {
+       FC_ASSERT(_replication_api);
+       return *_replication_api;
+    }
+
+    replication_api::replication_api( application& a ) : _app( a )
+    {
+       _applied_block_connection = _app.chain_database()->applied_block.connect( [this]( const signed_block& b ) {
+          on_applied_block( b );
+       } );
+    }
+
+    void replication_api::set_block_callback( block_callback cb )
+    {
+       api_call_timer timer( "replication_api", "set_block_callback" );
+       _callback = cb;
+    }
+
+    void replication_api::cancel_block_callback()
+    {
+       api_call_timer timer( "replication_api", "cancel_block_callback" );
+       _callback = block_callback();
+    }
+
+    void replication_api::on_applied_block( const signed_block& b )
+    {
+       if( !_callback )
+          return;
+       /// we need to ensure the replication_api is not deleted for the life of the async operation
+       auto capture_this = shared_from_this();
+       auto callback = _callback;
+       auto packed = fc::raw::pack( b );
+       fc::async( [capture_this,callback,packed]() { callback( fc::variant( packed ) ); } );
+    }
+
+    fc::path replication_api::checkpoint_dir( uint32_t block_num )const
+    {
+       return _app.chain_database()->get_state_checkpoint_dir() / fc::to_string( block_num );
+    }
+
+    /** the files below dir, by their paths relative to it */
+    static vector<state_checkpoint_file> list_checkpoint_files( const fc::path& dir )
+    {
+       vector<state_checkpoint_file> result;
+       const string prefix = dir.generic_string() + "/";
+       for( boost::filesystem::recursive_directory_iterator itr( dir.string() );
+            itr != boost::filesystem::recursive_directory_iterator(); ++itr )
+       {
+          if( !boost::filesystem::is_regular_file( itr->status() ) )
+             continue;
+          const fc::path file( itr->path() );
+          state_checkpoint_file f;
+          f.path = file.generic_string().substr( prefix.size() );
+          f.size = fc::file_size( file );
+          result.push_back( f );
+       }
+       std::sort( result.begin(), result.end(),
+                  []( const state_checkpoint_file& a, const state_checkpoint_file& b ) { return a.path < b.path; } );
+       return result;
+    }
+
+    optional<state_checkpoint_info> replication_api::get_state_checkpoint()const
+    {
+       api_call_timer timer( "replication_api", "get_state_checkpoint" );
+       const auto& db = *_app.chain_database();
+       optional<state_checkpoint_info> result;
+       if( db.get_state_checkpoint_interval() == 0 )
+          return result;
+       fc::optional<fc::path> dir = chain::database::find_state_checkpoint( db.get_state_checkpoint_dir() );
+       if( !dir.valid() )
+          return result;
+       result = state_checkpoint_info();
+       result->block_num = std::stoul( dir->filename().string() );
+       database_api::run_on_read_thread( db, [&]() {
+          result->block_id = db.get_block_id_for_num( result->block_num );
+       } );
+       result->files = list_checkpoint_files( *dir );
+       return result;
+    }
+
+    vector<char> replication_api::read_state_checkpoint( uint32_t block_num, const string& path, uint64_t offset,
+                                                         uint32_t size )const
+    { try {
+       api_call_timer timer( "replication_api", "read_state_checkpoint" );
+       FC_ASSERT( size <= max_read_size );
+       const fc::path dir = checkpoint_dir( block_num );
+       FC_ASSERT( fc::exists( dir / "snapshot.json" ), "No complete checkpoint at block ${n}, it may have been "
+                  "replaced by a newer one", ("n",block_num) );
+       // only the files of the checkpoint, whatever path was asked for
+       const auto files = list_checkpoint_files( dir );
+       auto itr = std::find_if( files.begin(), files.end(),
+                                [&path]( const state_checkpoint_file& f ) { return f.path == path; } );
+       FC_ASSERT( itr != files.end(), "No such checkpoint file" );
+
+       vector<char> result;
+       if( offset >= itr->size )
+          return result;
+       result.resize( std::min<uint64_t>( size, itr->size - offset ) );
+       std::ifstream in( ( dir / path ).generic_string(), std::ios::in | std::ios::binary );
+       in.seekg( offset );
+       in.read( result.data(), result.size() );
+       FC_ASSERT( in, "Error reading the checkpoint" );
+       timer.set_response_size( result.size() );
+       return result;
+    } FC_CAPTURE_AND_RETHROW( (block_num)(path)(offset)(size) ) }
+
     vector<account_id_type> get_relevant_accounts( const object* obj )
     {
        vector<account_id_type> result;
@@ -331,15 +559,9 @@ namespace graphene { namespace app {
                   assert( aobj != nullptr );
                   result.push_back( aobj->owner );
                   break;
-               } case impl_transaction_object_type:{
-                  const auto& aobj = dynamic_cast<const transaction_object*>(obj);
-                  assert( aobj != nullptr );
-                  flat_set<account_id_type> impacted;
-                  transaction_get_impacted_accounts( aobj->trx, impacted );
-                  result.reserve( impacted.size() );
-                  for( auto& item : impacted ) result.emplace_back(item);
+               } case impl_transaction_object_type:
                   break;
-               } case impl_blinded_balance_object_type:{
+                 case impl_blinded_balance_object_type:{
                   const auto& aobj = dynamic_cast<const blinded_balance_object*>(obj);
                   assert( aobj != nullptr );
                   result.reserve( aobj->owner.account_auths.size() );
@@ -369,27 +591,10 @@ namespace graphene { namespace app {
 
     vector<order_history_object> history_api::get_fill_order_history( asset_id_type a, asset_id_type b, uint32_t limit  )const
     {
-       FC_ASSERT(_app.chain_database());
-       const auto& db = *_app.chain_database();
-       if( a > b ) std::swap(a,b);
-       const auto& history_idx = db.get_index_type<graphene::market_history::history_index>().indices().get<by_key>();
-       history_key hkey;
-       hkey.base = a;
-       hkey.quote = b;
-       hkey.sequence = std::numeric_limits<int64_t>::min();
-
-       uint32_t count = 0;
-       auto itr = history_idx.lower_bound( hkey );
-       vector<order_history_object> result;
-       while( itr != history_idx.end() && count < limit)
-       {
-          if( itr->key.base != a || itr->key.quote != b ) break;
-          result.push_back( *itr );
-          ++itr;
-          ++count;
-       }
-
-       return result;
+       api_call_timer timer( "history_api", "get_fill_order_history" );
+       auto hist = _app.get_plugin<market_history_plugin>( "market_history" );
+       FC_ASSERT( hist );
+       return hist->fill_history().get_fills( a, b, limit );
     }
 
     vector<operation_history_object> history_api::get_account_history( account_id_type account, 
@@ -397,25 +602,35 @@ namespace graphene { namespace app {
                                                                        unsigned limit, 
                                                                        operation_history_id_type start ) const
     {
+       api_call_timer timer( "history_api", "get_account_history" );
        FC_ASSERT( _app.chain_database() );
        const auto& db = *_app.chain_database();       
+       db.wait_for_deferred_indexes();
        FC_ASSERT( limit <= 100 );
+       auto account_history = std::dynamic_pointer_cast<account_history::account_history_plugin>( _app.get_plugin( "account_history" ) );
        vector<operation_history_object> result;
-       const auto& stats = account(db).statistics(db);
-       if( stats.most_recent_op == account_transaction_history_id_type() ) return result;
-       const account_transaction_history_object* node = &stats.most_recent_op(db);
-       if( start == operation_history_id_type() )
-          start = node->operation_id;
-          
-       while(node && node->operation_id.instance.value > stop.instance.value && result.size() < limit)
-       {
-          if( node->operation_id.instance.value <= start.instance.value )
-             result.push_back( node->operation_id(db) );
-          if( node->next == account_transaction_history_id_type() )
-             node = nullptr;
-          else node = &node->next(db);
-       }
-       
+       database_api::run_on_read_thread( db, [&]() {
+          if( account_history && account_history->history_on_disk() )
+          {
+             result = account_history->get_account_history( account, stop, limit, start );
+             return;
+          }
+          const auto& by_op_idx = db.get_index_type<account_transaction_history_index>().indices().get<by_op>();
+          if( start == operation_history_id_type() )
+             start = operation_history_id_type( std::numeric_limits<uint64_t>::max() >> 16 );
+
+          // walk back from the newest entry at or before start
+          auto itr = by_op_idx.upper_bound( boost::make_tuple( account, start ) );
+          const auto begin = by_op_idx.lower_bound( boost::make_tuple( account, stop + 1 ) );
+          while( itr != begin && result.size() < limit )
+          {
+             --itr;
+             if( account_history && account_history->history_packed() )
+                result.push_back( account_history->get_operation( itr->operation_id ) );
+             else
+                result.push_back( itr->operation_id(db) );
+          }
+       } );
        return result;
     }
     
@@ -424,41 +639,69 @@ namespace graphene { namespace app {
                                                                                 unsigned limit, 
                                                                                 uint32_t start) const
     {
+       api_call_timer timer( "history_api", "get_relative_account_history" );
        FC_ASSERT( _app.chain_database() );
        const auto& db = *_app.chain_database();
+       db.wait_for_deferred_indexes();
        FC_ASSERT(limit <= 100);
+       auto account_history = std::dynamic_pointer_cast<account_history::account_history_plugin>( _app.get_plugin( "account_history" ) );
        vector<operation_history_object> result;
-       if( start == 0 )
-         start = account(db).statistics(db).total_ops;
-       else start = min( account(db).statistics(db).total_ops, start );
-       const auto& hist_idx = db.get_index_type<account_transaction_history_index>();
-       const auto& by_seq_idx = hist_idx.indices().get<by_seq>();
-       
-       auto itr = by_seq_idx.upper_bound( boost::make_tuple( account, start ) );
-       auto itr_stop = by_seq_idx.lower_bound( boost::make_tuple( account, stop ) );
-       --itr;
-       
-       while ( itr != itr_stop && result.size() < limit )
-       {
-          result.push_back( itr->operation_id(db) );
-          --itr;
-       }
-       
+       database_api::run_on_read_thread( db, [&]() {
+          if( account_history && account_history->history_on_disk() )
+          {
+             result = account_history->get_relative_account_history( account, stop, limit, start );
+             return;
+          }
+          if( start == 0 )
+             start = account(db).statistics(db).total_ops;
+          const auto& by_seq_idx = db.get_index_type<account_transaction_history_index>().indices().get<by_seq>();
+
+          auto itr = by_seq_idx.upper_bound( boost::make_tuple( account, start ) );
+          const auto begin = by_seq_idx.upper_bound( boost::make_tuple( account, stop ) );
+          while( itr != begin && result.size() < limit )
+          {
+             --itr;
+             if( account_history && account_history->history_packed() )
+                result.push_back( account_history->get_operation( itr->operation_id ) );
+             else
+                result.push_back( itr->operation_id(db) );
+          }
+       } );
        return result;
     }
 
     flat_set<uint32_t> history_api::get_market_history_buckets()const
     {
+       api_call_timer timer( "history_api", "get_market_history_buckets" );
        auto hist = _app.get_plugin<market_history_plugin>( "market_history" );
        FC_ASSERT( hist );
        return hist->tracked_buckets();
     }
 
+    void history_api::subscribe_to_account_operations( std::function<void(variant)> cb,
+                                                       const vector<account_id_type>& accounts )
+    {
+       api_call_timer timer( "history_api", "subscribe_to_account_operations" );
+       FC_ASSERT( !accounts.empty(), "no accounts to subscribe to" );
+       auto account_history = std::dynamic_pointer_cast<account_history::account_history_plugin>( _app.get_plugin( "account_history" ) );
+       FC_ASSERT( account_history, "The account_history plugin is not enabled" );
+       // the history kept on disk may add the operations on a thread of its own, the session is served on this one
+       fc::thread* api_thread = &fc::thread::current();
+       account_history->subscribe_to_operations( flat_set<account_id_type>( accounts.begin(), accounts.end() ),
+                                                 shared_from_this(),
+          [cb,api_thread]( const operation_history_object& op ) {
+             fc::variant v( op );
+             api_thread->async( [cb,v](){ cb( v ); } );
+          } );
+    }
+
     vector<bucket_object> history_api::get_market_history( asset_id_type a, asset_id_type b,
                                                            uint32_t bucket_seconds, fc::time_point_sec start, fc::time_point_sec end )const
     { try {
+       api_call_timer timer( "history_api", "get_market_history" );
        FC_ASSERT(_app.chain_database());
        const auto& db = *_app.chain_database();
+       db.wait_for_deferred_indexes();
        vector<bucket_object> result;
        result.reserve(200);
 
@@ -479,6 +722,73 @@ namespace graphene { namespace app {
        }
        return result;
     } FC_CAPTURE_AND_RETHROW( (a)(b)(bucket_seconds)(start)(end) ) }
+
+    vector<bucket_object> history_api::get_aggregated_market_history( asset_id_type a, asset_id_type b,
+                                                                      uint32_t bucket_seconds,
+                                                                      fc::time_point_sec start, fc::time_point_sec end,
+                                                                      uint32_t limit )const
+    { try {
+       api_call_timer timer( "history_api", "get_aggregated_market_history" );
+       FC_ASSERT(_app.chain_database());
+       FC_ASSERT( limit <= 200 );
+       FC_ASSERT( bucket_seconds > 0 );
+       auto hist = _app.get_plugin<market_history_plugin>( "market_history" );
+       FC_ASSERT( hist );
+       const auto& db = *_app.chain_database();
+       db.wait_for_deferred_indexes();
+
+       // the tracked sizes are sorted, so this finds the largest one that fits
+       uint32_t source_seconds = 0;
+       for( uint32_t s : hist->tracked_buckets() )
+          if( s != 0 && bucket_seconds % s == 0 )
+             source_seconds = s;
+       FC_ASSERT( source_seconds != 0, "${s} seconds is not a multiple of any tracked bucket size", ("s",bucket_seconds) );
+
+       if( a > b ) std::swap(a,b);
+       auto bucket_open = [bucket_seconds]( fc::time_point_sec t ) {
+          return fc::time_point_sec( ( t.sec_since_epoch() / bucket_seconds ) * bucket_seconds );
+       };
+
+       vector<bucket_object> result;
+       result.reserve( limit );
+
+       const auto& by_key_idx = db.get_index_type<bucket_index>().indices().get<by_key>();
+       auto itr = by_key_idx.lower_bound( bucket_key( a, b, source_seconds, bucket_open( start ) ) );
+       for( ; itr != by_key_idx.end() && itr->key.open <= end; ++itr )
+       {
+          if( !(itr->key.base == a && itr->key.quote == b && itr->key.seconds == source_seconds) )
+             break;
+
+          const fc::time_point_sec open = bucket_open( itr->key.open );
+          if( result.empty() || result.back().key.open != open )
+          {
+             if( result.size() == limit )
+                break;
+             result.push_back( *itr );
+             result.back().id = object_id_type();
+             result.back().key.seconds = bucket_seconds;
+             result.back().key.open = open;
+             continue;
+          }
+
+          bucket_object& merged = result.back();
+          merged.base_volume += itr->base_volume;
+          merged.quote_volume += itr->quote_volume;
+          merged.close_base = itr->close_base;
+          merged.close_quote = itr->close_quote;
+          if( merged.high() < itr->high() )
+          {
+             merged.high_base = itr->high_base;
+             merged.high_quote = itr->high_quote;
+          }
+          if( merged.low() > itr->low() )
+          {
+             merged.low_base = itr->low_base;
+             merged.low_quote = itr->low_quote;
+          }
+       }
+       return result;
+    } FC_CAPTURE_AND_RETHROW( (a)(b)(bucket_seconds)(start)(end)(limit) ) }
     
     crypto_api::crypto_api(){};
     
@@ -550,4 +860,199 @@ namespace graphene { namespace app {
        return fc::ecc::range_get_info( proof );
     }
 
+    namespace detail {
+       /**
+        * Packed results of the packed_api calls that only change with the head block, by method and packed
+        * parameters.  One cache is shared by the connections to a database, and emptied whenever they find that
+        * the head block changed, which also covers popped blocks.
+        */
+       class packed_response_cache
+       {
+          public:
+             static std::shared_ptr<packed_response_cache> of( const graphene::chain::database& db )
+             {
+                static std::map< const graphene::chain::database*, std::weak_ptr<packed_response_cache> > caches;
+                auto& cache = caches[&db];
+                auto result = cache.lock();
+                if( !result )
+                {
+                   result = std::make_shared<packed_response_cache>( db );
+                   cache = result;
+                }
+                return result;
+             }
+
+             explicit packed_response_cache( const graphene::chain::database& db ) : _db( db ) {}
+
+             template<typename Producer>
+             vector<char> get( const string& method, const vector<char>& params, Producer&& produce )
+             {
+                if( _db.head_block_id() != _head_block_id )
+                {
+                   _responses.clear();
+                   _head_block_id = _db.head_block_id();
+                }
+                auto key = std::make_pair( method, params );
+                auto itr = _responses.find( key );
+                if( itr == _responses.end() )
+                {
+                   // mostly blocks requested by number, a full cache is simply started over
+                   if( _responses.size() >= max_responses )
+                      _responses.clear();
+                   itr = _responses.emplace( std::move( key ), produce() ).first;
+                }
+                return itr->second;
+             }
+
+          private:
+             static const size_t max_responses = 1000;
+
+             const graphene::chain::database&                            _db;
+             block_id_type                                               _head_block_id;
+             std::map< std::pair<string, vector<char>>, vector<char> > _responses;
+       };
+    }
+
+    packed_api::packed_api( application& app )
+    : _app( app ), _database_api( std::ref( *app.chain_database() ), app.get_state_replica() ), _history_api( app ),
+      _cache( detail::packed_response_cache::of( *app.chain_database() ) )
+    {
+    }
+
+    vector<char> packed_api::get_block( uint32_t block_num )const
+    {
+       api_call_timer timer( "packed_api", "get_block" );
+       auto result = _cache->get( "get_block", fc::raw::pack( block_num ), [&]() { return pack_block( block_num ); } );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
+    vector<char> packed_api::get_chain_properties()const
+    {
+       api_call_timer timer( "packed_api", "get_chain_properties" );
+       auto result = _cache->get( "get_chain_properties", vector<char>(),
+                                  [&]() { return fc::raw::pack( _database_api.get_chain_properties() ); } );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
+    vector<char> packed_api::get_global_properties()const
+    {
+       api_call_timer timer( "packed_api", "get_global_properties" );
+       auto result = _cache->get( "get_global_properties", vector<char>(),
+                                  [&]() { return fc::raw::pack( _database_api.get_global_properties() ); } );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
+    vector<char> packed_api::get_config()const
+    {
+       api_call_timer timer( "packed_api", "get_config" );
+       auto result = _cache->get( "get_config", vector<char>(), [&]() { return fc::raw::pack( _database_api.get_config() ); } );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
+    vector<char> packed_api::get_dynamic_global_properties()const
+    {
+       api_call_timer timer( "packed_api", "get_dynamic_global_properties" );
+       auto result = _cache->get( "get_dynamic_global_properties", vector<char>(),
+                                  [&]() { return fc::raw::pack( _database_api.get_dynamic_global_properties() ); } );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
+    vector<char> packed_api::get_blocks( uint32_t start, uint32_t count )const
+    {
+       api_call_timer timer( "packed_api", "get_blocks" );
+       FC_ASSERT( count <= 1000 );
+       vector< std::shared_ptr<const vector<char>> > blocks;
+       uint64_t total_bytes = 0;
+       for( uint32_t n = start; blocks.size() < count && total_bytes < max_blocks_bytes; ++n )
+       {
+          auto stored = fetch_packed_block( n );
+          if( !stored )
+             break;
+          total_bytes += stored->size();
+          blocks.push_back( std::move( stored ) );
+       }
+
+       // a packed vector is its size followed by the packed elements
+       vector<char> result = fc::raw::pack( fc::unsigned_int( blocks.size() ) );
+       result.reserve( result.size() + total_bytes );
+       for( const auto& b : blocks )
+          result.insert( result.end(), b->begin(), b->end() );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
+    vector<char> packed_api::get_block_headers( uint32_t start, uint32_t count )const
+    {
+       api_call_timer timer( "packed_api", "get_block_headers" );
+       FC_ASSERT( count <= 1000 );
+       // a packed signed_block starts with its packed signed_block_header, which is all that is sent of it
+       vector< std::pair<std::shared_ptr<const vector<char>>, size_t> > headers;
+       uint64_t total_bytes = 0;
+       for( uint32_t n = start; headers.size() < count; ++n )
+       {
+          auto stored = fetch_packed_block( n );
+          if( !stored )
+             break;
+          fc::datastream<const char*> ds( stored->data(), stored->size() );
+          signed_block_header header;
+          fc::raw::unpack( ds, header );
+          const size_t header_bytes = stored->size() - ds.remaining();
+          total_bytes += header_bytes;
+          headers.emplace_back( std::move( stored ), header_bytes );
+       }
+
+       vector<char> result = fc::raw::pack( fc::unsigned_int( headers.size() ) );
+       result.reserve( result.size() + total_bytes );
+       for( const auto& h : headers )
+          result.insert( result.end(), h.first->begin(), h.first->begin() + h.second );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
+    std::shared_ptr<const vector<char>> packed_api::fetch_packed_block( uint32_t block_num )const
+    {
+       const auto& db = *_app.chain_database();
+       if( block_num == 0 || block_num > db.head_block_num() || block_num < db.earliest_available_block_num() )
+          return std::shared_ptr<const vector<char>>();
+       return db.fetch_packed_block_by_id( db.get_block_id_for_num( block_num ) );
+    }
+
+    vector<char> packed_api::pack_block( uint32_t block_num )const
+    {
+       auto stored = fetch_packed_block( block_num );
+       if( !stored )
+          return fc::raw::pack( optional<signed_block>() );
+
+       // the packed optional is its validity flag followed by the packed block
+       vector<char> result;
+       result.reserve( stored->size() + 1 );
+       result.push_back( 1 );
+       result.insert( result.end(), stored->begin(), stored->end() );
+       return result;
+    }
+
+    vector<char> packed_api::get_full_accounts( const vector<string>& names_or_ids )const
+    {
+       api_call_timer timer( "packed_api", "get_full_accounts" );
+       auto result = fc::raw::pack( _database_api.get_full_accounts( names_or_ids, false ) );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
+    vector<char> packed_api::get_account_history( account_id_type account,
+                                                  operation_history_id_type stop,
+                                                  unsigned limit,
+                                                  operation_history_id_type start )const
+    {
+       api_call_timer timer( "packed_api", "get_account_history" );
+       auto result = fc::raw::pack( _history_api.get_account_history( account, stop, limit, start ) );
+       timer.set_response_size( result.size() );
+       return result;
+    }
+
 } } // graphene::app
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/api_stats.hpp>
+
+#include <algorithm>
+#include <exception>
+
+namespace graphene { namespace app {
+
+api_call_stats& api_call_stats::instance()
+{
+   static api_call_stats stats;
+   return stats;
+}
+
+void api_call_stats::record( const char* api, const char* method, uint64_t duration_us, bool failed,
+                             uint64_t response_bytes )
+{
+   uint32_t bucket = 0;
+   while( bucket < 63 && ( uint64_t(1) << bucket ) <= duration_us )
+      ++bucket;
+
+   std::lock_guard<std::mutex> lock( _mutex );
+   method_data& m = _methods[ std::make_pair( api, method ) ];
+   ++m.calls;
+   if( failed )
+      ++m.errors;
+   m.total_us += duration_us;
+   m.max_us = std::max( m.max_us, duration_us );
+   m.response_bytes += response_bytes;
+   ++m.histogram[bucket];
+}
+
+std::vector<api_method_stats> api_call_stats::get()const
+{
+   std::vector<api_method_stats> result;
+   std::lock_guard<std::mutex> lock( _mutex );
+   result.reserve( _methods.size() );
+   for( const auto& item : _methods )
+   {
+      const method_data& m = item.second;
+      api_method_stats s;
+      s.api = item.first.first;
+      s.method = item.first.second;
+      s.calls = m.calls;
+      s.errors = m.errors;
+      s.total_us = m.total_us;
+      s.max_us = m.max_us;
+      s.response_bytes = m.response_bytes;
+
+      // the upper bound of the bucket holding the call at the given rank
+      auto percentile = [&m]( uint64_t per_cent ) -> uint64_t {
+         const uint64_t rank = ( m.calls * per_cent + 99 ) / 100;
+         uint64_t seen = 0;
+         for( uint32_t i = 0; i < m.histogram.size(); ++i )
+         {
+            seen += m.histogram[i];
+            if( seen >= rank )
+               return std::min( uint64_t(1) << i, m.max_us );
+         }
+         return m.max_us;
+      };
+      s.p50_us = percentile( 50 );
+      s.p99_us = percentile( 99 );
+      result.push_back( std::move( s ) );
+   }
+   return result;
+}
+
+void api_call_stats::reset()
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _methods.clear();
+}
+
+api_call_timer::~api_call_timer()
+{
+   const uint64_t duration = std::max<int64_t>( ( fc::time_point::now() - _start ).count(), 0 );
+   api_call_stats::instance().record( _api, _method, duration, std::uncaught_exception(), _response_bytes );
+}
+
+} } // graphene::app
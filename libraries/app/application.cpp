@@ -25,6 +25,13 @@
 #include <graphene/app/api_access.hpp>
 #include <graphene/app/application.hpp>
 #include <graphene/app/plugin.hpp>
+#include <graphene/app/rate_limit.hpp>
+#include <graphene/app/light_client.hpp>
+#include <graphene/app/replication_client.hpp>
+#include <graphene/app/block_trace.hpp>
+#include <graphene/app/confirmation_registry.hpp>
+#include <graphene/app/shared_state.hpp>
+#include <graphene/app/state_replica.hpp>
 
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <graphene/chain/protocol/types.hpp>
@@ -43,15 +50,27 @@
 #include <fc/smart_ref_impl.hpp>
 
 #include <fc/io/fstream.hpp>
+#include <fc/io/json.hpp>
+#include <fc/network/http/server.hpp>
 #include <fc/rpc/api_connection.hpp>
+#include <fc/rpc/http_api.hpp>
 #include <fc/rpc/websocket_api.hpp>
+#include <fc/thread/thread.hpp>
 #include <fc/network/resolve.hpp>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/signals2.hpp>
 #include <boost/range/algorithm/reverse.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
 
 #include <fc/log/file_appender.hpp>
 #include <fc/log/logger.hpp>
@@ -77,6 +96,110 @@ namespace bpo = boost::program_options;
 
 namespace detail {
 
+   /** parses object types given as space.type, e.g. 1.2 for accounts */
+   static flat_set< std::pair<uint8_t,uint8_t> > parse_object_types( const vector<string>& names )
+   {
+      flat_set< std::pair<uint8_t,uint8_t> > types;
+      for( const string& t : names )
+      {
+         auto dot = t.find( '.' );
+         FC_ASSERT( dot != string::npos, "object types are given as space.type, e.g. 1.2 for accounts, not ${t}",
+                    ("t",t) );
+         types.emplace( uint8_t( std::stoul( t.substr( 0, dot ) ) ), uint8_t( std::stoul( t.substr( dot + 1 ) ) ) );
+      }
+      return types;
+   }
+
+   /**
+    * A websocket API connection whose calls are checked against the rate limits before they are dispatched, so an
+    * over budget call is answered with an error before anything is looked up for it.  This covers both the
+    * websocket messages and the plain HTTP requests the websocket server accepts on the same port.
+    */
+   class rate_limited_api_connection : public fc::rpc::websocket_api_connection
+   {
+      public:
+         rate_limited_api_connection( fc::http::websocket_connection& c, std::shared_ptr<api_rate_limits> limits,
+                                      const string& address )
+            : fc::rpc::websocket_api_connection( c ), _ws( c ), _limits( limits ),
+              _bucket( limits->connection_bucket() ), _address( address )
+         {
+            // replaces the handlers the base class installed, which are called from here once the call is allowed
+            c.on_message_handler( [this]( const std::string& msg ) { handle_message( msg, true ); } );
+            c.on_http_handler( [this]( const std::string& msg ) { return handle_message( msg, false ); } );
+         }
+
+      private:
+         /** answers like the base class: the reply is returned, and also sent over the websocket if send_message */
+         std::string handle_message( const std::string& msg, bool send_message )
+         {
+            fc::variant id;
+            string method;
+            try
+            {
+               const fc::variant_object request = fc::json::from_string( msg ).get_object();
+               if( request.contains( "id" ) )
+                  id = request["id"];
+               method = request["method"].as_string();
+               // calls go through "call" with the api and the method as the first parameters
+               if( method == "call" && request.contains( "params" ) && request["params"].get_array().size() >= 2 )
+                  method = request["params"].get_array()[1].as_string();
+            }
+            catch( const fc::exception& )
+            {
+               // left to the base class to answer, at the default cost
+            }
+            if( !_limits->take( _bucket, _address, _limits->cost_of( method ), fc::time_point::now() ) )
+            {
+               const std::string reply = fc::json::to_string( fc::mutable_variant_object()
+                  ( "id", id )( "jsonrpc", "2.0" )
+                  ( "error", fc::mutable_variant_object()( "code", 429 )( "message", "rate limit exceeded" ) ) );
+               if( send_message )
+                  _ws.send_message( reply );
+               return reply;
+            }
+            return on_message( msg, send_message );
+         }
+
+         fc::http::websocket_connection&   _ws;
+         std::shared_ptr<api_rate_limits>  _limits;
+         token_bucket                      _bucket;
+         const string                      _address;
+   };
+
+   /** the JSON-RPC error reply to the call with the given id */
+   fc::variant rpc_error( const fc::variant& id, int64_t code, const string& message,
+                          const fc::variant& data = fc::variant() )
+   {
+      fc::mutable_variant_object error;
+      error( "code", code )( "message", message );
+      if( !data.is_null() )
+         error( "data", data );
+      return fc::mutable_variant_object()( "id", id )( "jsonrpc", "2.0" )( "error", error );
+   }
+
+   void write_http_reply( const fc::http::server::response& resp, fc::http::reply::status_code status,
+                          const string& body, const string& content_type = "application/json" )
+   {
+      resp.add_header( "Content-Type", content_type );
+      resp.set_status( status );
+      resp.set_length( body.size() );
+      resp.write( body.c_str(), body.size() );
+   }
+
+   /** the HELP and TYPE lines that start a metric family in the Prometheus text format */
+   void write_metric_family( std::ostream& out, const string& name, const char* type, const char* help )
+   {
+      out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+   }
+
+   /** one sample of a metric family for each message type */
+   void write_traffic_samples( std::ostream& out, const string& name, const net::traffic_by_message_type& traffic,
+                               uint64_t net::traffic_counter::* field )
+   {
+      for( const auto& t : traffic )
+         out << name << "{type=\"" << t.first << "\"} " << t.second.*field << "\n";
+   }
+
    genesis_state_type create_example_genesis() {
       auto nathan_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("nathan")));
       dlog("Allocating all stake to ${key}", ("key", utilities::key_to_wif(nathan_key)));
@@ -106,6 +229,71 @@ namespace detail {
       return initial_state;
    }
 
+   /** what a benchmark-replay reports */
+   struct replay_benchmark
+   {
+      graphene::chain::replay_statistics                    replay;
+      double                                                blocks_per_second = 0;
+      double                                                transactions_per_second = 0;
+      double                                                operations_per_second = 0;
+      /** 0 where the platform doesn't tell */
+      uint64_t                                              peak_resident_bytes = 0;
+      vector<string>                                        skipped_checks;
+      vector<string>                                        plugins;
+      /** microseconds spent in each phase of applying the blocks, over all of them */
+      graphene::chain::block_apply_profile                  phases;
+      /** the operations replayed, by name */
+      std::map<string, graphene::chain::operation_profile>  operations;
+   };
+
+   /** the checks replay-skip-checks may name */
+   static const std::map<string, uint32_t>& replay_checks()
+   {
+      typedef graphene::chain::database db;
+      static const std::map<string, uint32_t> checks = {
+         { "witness_signature",      db::skip_witness_signature },
+         { "transaction_signatures", db::skip_transaction_signatures },
+         { "transaction_dupe_check", db::skip_transaction_dupe_check },
+         { "tapos_check",            db::skip_tapos_check },
+         { "authority_check",        db::skip_authority_check },
+         { "merkle_check",           db::skip_merkle_check },
+         { "assert_evaluation",      db::skip_assert_evaluation },
+         { "witness_schedule_check", db::skip_witness_schedule_check },
+         { "validate",               db::skip_validate },
+         { "operation_history",      db::skip_operation_history }
+      };
+      return checks;
+   }
+
+   /** names the operations of the replay profile */
+   struct operation_name_visitor
+   {
+      typedef string result_type;
+      template<typename Operation>
+      string operator()( const Operation& )const
+      {
+         const string name = fc::get_typename<Operation>::name();
+         return name.substr( name.rfind( ':' ) + 1 );
+      }
+   };
+
+   /** @return the peak resident set size of the process in bytes, 0 where it is not known */
+   static uint64_t peak_resident_bytes()
+   {
+#ifdef WIN32
+      return 0;
+#else
+      struct rusage usage;
+      if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+         return 0;
+#ifdef __APPLE__
+      return usage.ru_maxrss;
+#else
+      return uint64_t( usage.ru_maxrss ) * 1024;
+#endif
+#endif
+   }
+
    class application_impl : public net::node_delegate
    {
    public:
@@ -113,6 +301,15 @@ namespace detail {
       bool _is_block_producer = false;
       bool _force_validate = false;
 
+      /** a sync block with the checks from database::precompute_block() */
+      struct verified_sync_block
+      {
+         std::shared_ptr<const signed_block> block;
+         graphene::chain::precomputed_block  checks;
+      };
+      static const size_t max_verified_sync_blocks = 10000;
+      static const uint32_t sync_report_interval = 10000;
+
       void reset_p2p_node(const fc::path& data_dir)
       { try {
          _p2p_network = std::make_shared<net::node>("Graphene Reference Implementation");
@@ -120,6 +317,28 @@ namespace detail {
          _p2p_network->load_configuration(data_dir / "p2p");
          _p2p_network->set_node_delegate(this);
 
+         if( _options->count("p2p-relay-mode") )
+         {
+            const string relay_mode = _options->at("p2p-relay-mode").as<string>();
+            FC_ASSERT( relay_mode == "inventory" || relay_mode == "push", "Unknown p2p relay mode ${m}", ("m",relay_mode) );
+            _p2p_network->set_advanced_node_parameters( fc::mutable_variant_object( "push_items", relay_mode == "push" ) );
+         }
+         if( _options->count("p2p-accept-pushed-items") )
+            _p2p_network->set_advanced_node_parameters( fc::mutable_variant_object( "accept_pushed_items",
+                                                                                    _options->at("p2p-accept-pushed-items").as<bool>() ) );
+         if( _options->count("p2p-pushed-items-per-second") )
+            _p2p_network->set_advanced_node_parameters( fc::mutable_variant_object( "pushed_items_per_second",
+                                                                                    _options->at("p2p-pushed-items-per-second").as<uint32_t>() ) );
+         if( _options->count("p2p-relay-batch-window") )
+            _p2p_network->set_advanced_node_parameters( fc::mutable_variant_object( "relay_batch_window_ms",
+                                                                                    _options->at("p2p-relay-batch-window").as<uint32_t>() ) );
+         if( _options->count("p2p-decode-threads") )
+            _p2p_network->set_advanced_node_parameters( fc::mutable_variant_object( "message_decode_threads",
+                                                                                    _options->at("p2p-decode-threads").as<uint32_t>() ) );
+         if( _options->count("p2p-adaptive-connections") )
+            _p2p_network->set_advanced_node_parameters( fc::mutable_variant_object( "adaptive_connections",
+                                                                                    _options->at("p2p-adaptive-connections").as<bool>() ) );
+
          if( _options->count("seed-node") )
          {
             auto seeds = _options->at("seed-node").as<vector<string>>();
@@ -175,6 +394,290 @@ namespace detail {
          FC_CAPTURE_AND_RETHROW((endpoint_string))
       }
 
+      void new_api_connection( const fc::http::websocket_connection_ptr& c )
+      {
+         std::shared_ptr<fc::rpc::websocket_api_connection> wsc;
+         if( _rate_limits && _rate_limits->enabled() )
+         {
+            // the address without the port, so all connections from one host share its budget
+            string address = c->get_remote_endpoint_string();
+            const auto colon = address.rfind( ':' );
+            if( colon != string::npos )
+               address.resize( colon );
+            wsc = std::make_shared<rate_limited_api_connection>( *c, _rate_limits, address );
+         }
+         else
+            wsc = std::make_shared<fc::rpc::websocket_api_connection>(*c);
+         auto login = std::make_shared<graphene::app::login_api>( std::ref(*_self) );
+         auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()), _state_replica );
+         wsc->register_api(fc::api<graphene::app::database_api>(db_api));
+         wsc->register_api(fc::api<graphene::app::login_api>(login));
+         c->set_session_data( wsc );
+      }
+
+      void reset_rate_limits()
+      {
+         api_rate_limits::limits l;
+         l.connection_rate = _options->at("api-rate-limit").as<uint32_t>();
+         l.connection_burst = std::max( _options->at("api-rate-burst").as<uint32_t>(), l.connection_rate );
+         l.address_rate = _options->at("api-address-rate-limit").as<uint32_t>();
+         l.address_burst = std::max( _options->at("api-address-rate-burst").as<uint32_t>(), l.address_rate );
+         if( _options->count("api-method-cost") )
+            for( const string& c : _options->at("api-method-cost").as<vector<string>>() )
+               l.method_costs.insert( api_rate_limits::parse_method_cost( c ) );
+         _rate_limits = std::make_shared<api_rate_limits>( l );
+      }
+
+      /** the id of a JSON-RPC call of an HTTP request, null if it has none or the call is malformed */
+      static fc::variant http_call_id( const fc::variant& call )
+      {
+         if( call.is_object() && call.get_object().contains( "id" ) )
+            return call.get_object()["id"];
+         return fc::variant();
+      }
+
+      /** the method a JSON-RPC call of an HTTP request is charged for, empty if the call is malformed */
+      static string http_call_method( const fc::variant& call )
+      {
+         try
+         {
+            const fc::variant_object& request = call.get_object();
+            string method = request["method"].as_string();
+            if( method == "call" && request.contains( "params" ) && request["params"].get_array().size() >= 2 )
+               method = request["params"].get_array()[1].as_string();
+            return method;
+         }
+         catch( const fc::exception& )
+         {
+            return string();
+         }
+      }
+
+      /**
+       * Takes the cost of all the calls of an HTTP request at once, so a batch is either answered in full or refused
+       * in full.  Every request is a connection of its own, so only its address has a budget.
+       */
+      bool take_http_calls( const fc::variants& calls, const string& address )
+      {
+         if( !_rate_limits || !_rate_limits->enabled() )
+            return true;
+         uint64_t cost = 0;
+         for( const fc::variant& call : calls )
+            cost += _rate_limits->cost_of( http_call_method( call ) );
+         token_bucket request_bucket;
+         return _rate_limits->take( request_bucket, address,
+                                    uint32_t( std::min<uint64_t>( cost, std::numeric_limits<uint32_t>::max() ) ),
+                                    fc::time_point::now() );
+      }
+
+      /**
+       * Answers one JSON-RPC call of an HTTP request, given either as {"method":"call","params":[api,method,args]}
+       * or directly by method name for the database API.  Any exception is answered as an error of the call.
+       */
+      fc::variant http_call( const fc::rpc::http_api_connection& conn, const fc::variant& call )
+      {
+         const fc::variant id = http_call_id( call );
+         try
+         {
+            const fc::variant_object& request = call.get_object();
+            string method = request["method"].as_string();
+            fc::variants params = request.contains( "params" ) ? request["params"].get_array() : fc::variants();
+            uint32_t api_id = 0;
+            if( method == "call" )
+            {
+               FC_ASSERT( params.size() >= 2, "call takes the api, the method and its parameters" );
+               api_id = params[0].as_uint64();
+               method = params[1].as_string();
+               params = params.size() > 2 ? params[2].get_array() : fc::variants();
+            }
+            return fc::mutable_variant_object()( "id", id )( "jsonrpc", "2.0" )
+                                               ( "result", conn.receive_call( api_id, method, params ) );
+         }
+         catch( const fc::exception& e )
+         {
+            return rpc_error( id, 1, e.to_string(), e.to_detail_string() );
+         }
+         catch( const std::exception& e )
+         {
+            return rpc_error( id, 1, e.what() );
+         }
+         catch( ... )
+         {
+            return rpc_error( id, 1, "unknown error" );
+         }
+      }
+
+      /**
+       * The p2p traffic by message type, the bandwidth used, and the timings of the last block relayed from the
+       * network, in the Prometheus text format.  Nothing is labelled by peer, so the peers aren't given away and the
+       * number of series stays the same as peers come and go.
+       */
+      string get_metrics()const
+      {
+         std::ostringstream out;
+         if( _p2p_network )
+         {
+            const net::traffic_statistics traffic = _p2p_network->get_traffic_statistics();
+            const struct { const char* direction; const net::traffic_by_message_type* total; } directions[] =
+               { { "received", &traffic.received }, { "sent", &traffic.sent } };
+            for( const auto& d : directions )
+            {
+               const string messages = string( "graphene_p2p_" ) + d.direction + "_messages_total";
+               const string bytes = string( "graphene_p2p_" ) + d.direction + "_bytes_total";
+               write_metric_family( out, messages, "counter", "p2p messages by type since the node started" );
+               write_traffic_samples( out, messages, *d.total, &net::traffic_counter::messages );
+               write_metric_family( out, bytes, "counter", "p2p bytes by message type since the node started" );
+               write_traffic_samples( out, bytes, *d.total, &net::traffic_counter::bytes );
+            }
+            write_metric_family( out, "graphene_p2p_peers", "gauge", "connected p2p peers" );
+            out << "graphene_p2p_peers " << traffic.peers.size() << "\n";
+
+            const struct { const char* window; const vector<uint32_t>* read; const vector<uint32_t>* written; } windows[] =
+               { { "second", &traffic.read_by_second, &traffic.written_by_second },
+                 { "minute", &traffic.read_by_minute, &traffic.written_by_minute },
+                 { "hour", &traffic.read_by_hour, &traffic.written_by_hour } };
+            write_metric_family( out, "graphene_p2p_read_bytes_per_second", "gauge",
+                                 "p2p bytes read per second, averaged over the last second, minute and hour" );
+            for( const auto& w : windows )
+               if( !w.read->empty() )
+                  out << "graphene_p2p_read_bytes_per_second{window=\"" << w.window << "\"} " << w.read->back() << "\n";
+            write_metric_family( out, "graphene_p2p_written_bytes_per_second", "gauge",
+                                 "p2p bytes written per second, averaged over the last second, minute and hour" );
+            for( const auto& w : windows )
+               if( !w.written->empty() )
+                  out << "graphene_p2p_written_bytes_per_second{window=\"" << w.window << "\"} " << w.written->back() << "\n";
+         }
+
+         if( _block_tracer )
+            for( const block_trace& trace : _block_tracer->get( 16 ) )
+            {
+               if( trace.sync_mode || trace.broadcast_start == fc::time_point() )
+                  continue;
+               write_metric_family( out, "graphene_block_num", "gauge", "the last block relayed from the network" );
+               out << "graphene_block_num " << trace.block_num << "\n";
+               write_metric_family( out, "graphene_block_push_microseconds", "gauge",
+                                    "how long pushing the last block relayed from the network took" );
+               out << "graphene_block_push_microseconds " << trace.push_time << "\n";
+               write_metric_family( out, "graphene_block_relay_delay_microseconds", "gauge",
+                                    "from receiving the last block relayed from the network to starting to rebroadcast it" );
+               out << "graphene_block_relay_delay_microseconds " << ( trace.broadcast_start - trace.received ).count() << "\n";
+               break;
+            }
+         return out.str();
+      }
+
+      void handle_http_request( const fc::http::request& req, const fc::http::server::response& resp )
+      {
+         if( _http_metrics && req.method == "GET" && req.path == "/metrics" )
+         {
+            write_http_reply( resp, fc::http::reply::OK, get_metrics(), "text/plain; version=0.0.4" );
+            return;
+         }
+
+         // the same APIs a websocket connection starts with, but logging in can't enable more for later requests
+         auto conn = std::make_shared<fc::rpc::http_api_connection>();
+         auto login = std::make_shared<graphene::app::login_api>( std::ref(*_self) );
+         auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()), _state_replica );
+         conn->register_api(fc::api<graphene::app::database_api>(db_api));
+         conn->register_api(fc::api<graphene::app::login_api>(login));
+
+         string address = req.remote_endpoint;
+         const auto colon = address.rfind( ':' );
+         if( colon != string::npos )
+            address.resize( colon );
+
+         fc::variant body;
+         try
+         {
+            body = fc::json::from_string( string( req.body.begin(), req.body.end() ) );
+         }
+         catch( const fc::exception& e )
+         {
+            write_http_reply( resp, fc::http::reply::BadRequest,
+                              fc::json::to_string( rpc_error( fc::variant(), -32700, "parse error", e.to_string() ) ) );
+            return;
+         }
+
+         if( !body.is_array() )
+         {
+            const fc::variant reply = take_http_calls( fc::variants{ body }, address )
+                                      ? http_call( *conn, body )
+                                      : rpc_error( http_call_id( body ), 429, "rate limit exceeded" );
+            write_http_reply( resp, fc::http::reply::OK, fc::json::to_string( reply ) );
+            return;
+         }
+
+         const fc::variants& calls = body.get_array();
+         if( _http_max_batch_size > 0 && calls.size() > _http_max_batch_size )
+         {
+            write_http_reply( resp, fc::http::reply::BadRequest,
+                              fc::json::to_string( rpc_error( fc::variant(), -32600, "batch too large",
+                                 fc::mutable_variant_object()( "calls", calls.size() )( "max", _http_max_batch_size ) ) ) );
+            return;
+         }
+         fc::variants replies;
+         replies.reserve( calls.size() );
+         if( !take_http_calls( calls, address ) )
+         {
+            for( const fc::variant& call : calls )
+               replies.push_back( rpc_error( http_call_id( call ), 429, "rate limit exceeded" ) );
+            write_http_reply( resp, fc::http::reply::OK, fc::json::to_string( replies ) );
+            return;
+         }
+         // the calls of a batch run as tasks of their own, so those waiting for the read threads wait together, but
+         // only so many at a time
+         const size_t concurrency = std::max<size_t>( _http_batch_concurrency, 1 );
+         vector< fc::future<fc::variant> > pending;
+         pending.reserve( std::min( calls.size(), concurrency ) );
+         for( size_t i = 0; i < calls.size(); i += concurrency )
+         {
+            pending.clear();
+            for( size_t j = i; j < calls.size() && j < i + concurrency; ++j )
+            {
+               const fc::variant& call = calls[j];
+               pending.push_back( fc::async( [this,conn,call]() { return http_call( *conn, call ); }, "http rpc call" ) );
+            }
+            for( auto& p : pending )
+               replies.push_back( p.wait() );
+         }
+         write_http_reply( resp, fc::http::reply::OK, fc::json::to_string( replies ) );
+      }
+
+      void reset_http_server()
+      { try {
+         if( !_options->count("rpc-http-endpoint") )
+            return;
+
+         _http_metrics = _options->at("rpc-http-metrics").as<bool>();
+         _http_max_batch_size = _options->at("rpc-http-max-batch-size").as<uint32_t>();
+         _http_batch_concurrency = _options->at("rpc-http-batch-concurrency").as<uint32_t>();
+         _http_server = std::make_shared<fc::http::server>();
+         ilog("Configured HTTP rpc to listen on ${ip}", ("ip",_options->at("rpc-http-endpoint").as<string>()));
+         _http_server->listen( fc::ip::endpoint::from_string(_options->at("rpc-http-endpoint").as<string>()) );
+         // on_request() must come after listen()
+         _http_server->on_request( [this]( const fc::http::request& req, const fc::http::server::response& resp ) {
+            try
+            {
+               handle_http_request( req, resp );
+            }
+            catch( const fc::exception& e )
+            {
+               write_http_reply( resp, fc::http::reply::InternalServerError,
+                                 fc::json::to_string( rpc_error( fc::variant(), -32603, "internal error", e.to_string() ) ) );
+            }
+            catch( const std::exception& e )
+            {
+               write_http_reply( resp, fc::http::reply::InternalServerError,
+                                 fc::json::to_string( rpc_error( fc::variant(), -32603, "internal error", string( e.what() ) ) ) );
+            }
+            catch( ... )
+            {
+               write_http_reply( resp, fc::http::reply::InternalServerError,
+                                 fc::json::to_string( rpc_error( fc::variant(), -32603, "internal error" ) ) );
+            }
+         } );
+      } FC_CAPTURE_AND_RETHROW() }
+
       void reset_websocket_server()
       { try {
          if( !_options->count("rpc-endpoint") )
@@ -185,12 +688,7 @@ namespace detail {
          _websocket_server = std::make_shared<fc::http::websocket_server>(enable_deflate_compression);
 
          _websocket_server->on_connection([&]( const fc::http::websocket_connection_ptr& c ){
-            auto wsc = std::make_shared<fc::rpc::websocket_api_connection>(*c);
-            auto login = std::make_shared<graphene::app::login_api>( std::ref(*_self) );
-            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()) );
-            wsc->register_api(fc::api<graphene::app::database_api>(db_api));
-            wsc->register_api(fc::api<graphene::app::login_api>(login));
-            c->set_session_data( wsc );
+            new_api_connection( c );
          });
          ilog("Configured websocket rpc to listen on ${ip}", ("ip",_options->at("rpc-endpoint").as<string>()));
          _websocket_server->listen( fc::ip::endpoint::from_string(_options->at("rpc-endpoint").as<string>()) );
@@ -213,12 +711,7 @@ namespace detail {
          _websocket_tls_server = std::make_shared<fc::http::websocket_tls_server>( _options->at("server-pem").as<string>(), password, enable_deflate_compression );
 
          _websocket_tls_server->on_connection([&]( const fc::http::websocket_connection_ptr& c ){
-            auto wsc = std::make_shared<fc::rpc::websocket_api_connection>(*c);
-            auto login = std::make_shared<graphene::app::login_api>( std::ref(*_self) );
-            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()) );
-            wsc->register_api(fc::api<graphene::app::database_api>(db_api));
-            wsc->register_api(fc::api<graphene::app::login_api>(login));
-            c->set_session_data( wsc );
+            new_api_connection( c );
          });
          ilog("Configured websocket TLS rpc to listen on ${ip}", ("ip",_options->at("rpc-tls-endpoint").as<string>()));
          _websocket_tls_server->listen( fc::ip::endpoint::from_string(_options->at("rpc-tls-endpoint").as<string>()) );
@@ -247,6 +740,19 @@ namespace detail {
 
       void startup()
       { try {
+         if( _options->count("light-sync-from") )
+         {
+            // a monitoring node only checks the block headers of another node, it keeps no chain state and has
+            // no peers or API servers
+            light_client::config light;
+            light.server   = _options->at("light-sync-from").as<string>();
+            light.user     = _options->at("light-sync-user").as<string>();
+            light.password = _options->at("light-sync-password").as<string>();
+            _light_client.reset( new light_client( light ) );
+            _light_client->start();
+            return;
+         }
+
          bool clean = !fc::exists(_data_dir / "blockchain/dblock");
          fc::create_directories(_data_dir / "blockchain/dblock");
 
@@ -285,11 +791,17 @@ namespace detail {
             }
             else
             {
+               genesis_state_type genesis;
+               if( graphene::egenesis::compute_egenesis_state( genesis ) )
+               {
+                  genesis.initial_chain_id = graphene::egenesis::get_egenesis_json_hash();
+                  return genesis;
+               }
                std::string egenesis_json;
                graphene::egenesis::compute_egenesis_json( egenesis_json );
                FC_ASSERT( egenesis_json != "" );
                FC_ASSERT( graphene::egenesis::get_egenesis_json_hash() == fc::sha256::hash( egenesis_json ) );
-               auto genesis = fc::json::from_string( egenesis_json ).as<genesis_state_type>();
+               genesis = fc::json::from_string( egenesis_json ).as<genesis_state_type>();
                genesis.initial_chain_id = fc::sha256::hash( egenesis_json );
                return genesis;
             }
@@ -298,6 +810,88 @@ namespace detail {
          if( _options->count("resync-blockchain") )
             _chain_db->wipe(_data_dir / "blockchain", true);
 
+         if( _options->count("object-database-threads") )
+            _chain_db->set_io_threads( _options->at("object-database-threads").as<uint32_t>() );
+
+         if( _options->count("replay-prefetch-threads") )
+            _chain_db->set_replay_prefetch( _options->at("replay-prefetch-threads").as<uint32_t>() );
+
+         if( _options->count("replay-skip-checks") )
+         {
+            uint32_t skip = 0;
+            for( const string& name : _options->at("replay-skip-checks").as<vector<string>>() )
+            {
+               if( name == "none" )
+                  continue;
+               auto check = replay_checks().find( name );
+               FC_ASSERT( check != replay_checks().end(), "Unknown check ${c} in replay-skip-checks", ("c",name) );
+               skip |= check->second;
+            }
+            _chain_db->set_replay_skip_flags( skip );
+         }
+
+         const bool benchmark = _options->count("benchmark-replay") > 0;
+         if( benchmark )
+         {
+            if( _options->count("benchmark-last-block") )
+               _chain_db->set_replay_last_block( _options->at("benchmark-last-block").as<uint32_t>() );
+            _chain_db->set_apply_profiling( true );
+         }
+
+         {
+            graphene::chain::pending_transaction_pool::limits limits;
+            if( _options->count("pending-transactions-max-bytes") )
+               limits.max_bytes = _options->at("pending-transactions-max-bytes").as<uint64_t>();
+            if( _options->count("pending-transactions-per-account") )
+               limits.max_per_account = _options->at("pending-transactions-per-account").as<uint32_t>();
+            _chain_db->set_pending_transaction_limits( limits );
+         }
+
+         if( _options->count("signature-cache-size") )
+            graphene::chain::set_signature_cache_size( _options->at("signature-cache-size").as<uint32_t>() );
+
+         if( _options->count("validation-cache-size") )
+            graphene::chain::set_validation_cache_size( _options->at("validation-cache-size").as<uint32_t>() );
+
+         if( _options->count("key-cache-size") )
+            graphene::chain::set_key_cache_size( _options->at("key-cache-size").as<uint32_t>() );
+
+         if( _options->count("signature-threads") )
+            _chain_db->set_signature_threads( _options->at("signature-threads").as<uint32_t>() );
+
+         if( _options->count("api-read-threads") )
+            database_api::set_read_threads( _options->at("api-read-threads").as<uint32_t>() );
+
+         if( _options->count("api-max-queued-notifications") )
+            database_api::set_max_queued_notifications( _options->at("api-max-queued-notifications").as<uint32_t>() );
+
+         if( _options->count("api-notification-threads") )
+            database_api::set_notification_threads( _options->at("api-notification-threads").as<uint32_t>() );
+
+         if( _options->count("block-log-retain-blocks") )
+            _chain_db->set_block_log_retain_blocks( _options->at("block-log-retain-blocks").as<uint32_t>() );
+
+         if( _options->count("block-log-segment-size") || _options->count("block-log-compression") )
+         {
+            auto compression = graphene::chain::block_database::no_compression;
+            if( _options->count("block-log-compression") )
+               compression = fc::variant( _options->at("block-log-compression").as<string>() )
+                                .as<graphene::chain::block_database::compression_type>();
+            _chain_db->set_block_log_format( _options->at("block-log-segment-size").as<uint32_t>(), compression );
+         }
+
+         {
+            graphene::chain::block_database::flush_policy policy;
+            if( _options->count("block-log-flush-blocks") )
+               policy.max_pending_blocks = _options->at("block-log-flush-blocks").as<uint32_t>();
+            if( _options->count("block-log-flush-ms") )
+               policy.max_pending_time = fc::milliseconds( _options->at("block-log-flush-ms").as<uint32_t>() );
+            policy.sync = _options->count("block-log-fsync") && _options->at("block-log-fsync").as<bool>();
+            policy.flush_on_irreversible = _options->count("block-log-flush-on-irreversible") &&
+                                           _options->at("block-log-flush-on-irreversible").as<bool>();
+            _chain_db->set_block_log_flush_policy( policy );
+         }
+
          flat_map<uint32_t,block_id_type> loaded_checkpoints;
          if( _options->count("checkpoint") )
          {
@@ -311,7 +905,108 @@ namespace detail {
          }
          _chain_db->add_checkpoints( loaded_checkpoints );
 
-         if( _options->count("replay-blockchain") )
+         if( _options->count("snapshot-at-block") )
+         {
+            fc::path snapshot_dir = _data_dir / "snapshot";
+            if( _options->count("snapshot-dir") )
+               snapshot_dir = _options->at("snapshot-dir").as<boost::filesystem::path>();
+            if( snapshot_dir.is_relative() )
+               snapshot_dir = _data_dir / snapshot_dir;
+            _chain_db->set_snapshot_at_block( _options->at("snapshot-at-block").as<uint32_t>(), snapshot_dir );
+         }
+
+         fc::path checkpoint_dir = _options->at("state-checkpoint-dir").as<boost::filesystem::path>();
+         if( checkpoint_dir.is_relative() )
+            checkpoint_dir = _data_dir / checkpoint_dir;
+         const uint32_t checkpoint_interval = _options->at("state-checkpoint-interval").as<uint32_t>();
+         _chain_db->set_state_checkpoints( checkpoint_interval, checkpoint_dir );
+         _chain_db->set_flush_interval( _options->at("flush-interval").as<uint32_t>() );
+         _chain_db->set_state_digest_blocks( _options->at("state-digest-blocks").as<uint32_t>() );
+         _chain_db->set_supply_checks( _options->at("check-supply").as<bool>() );
+         _chain_db->set_fork_diff_replay( _options->at("fork-diff-replay").as<bool>() );
+         _chain_db->set_fork_prevalidation( _options->at("fork-prevalidation").as<bool>() );
+         _chain_db->set_undo_squash_depth( _options->at("undo-squash-depth").as<uint32_t>() );
+
+         // after a crash, the state of the last background flush or the newest state checkpoint spares replaying
+         // the blocks before it
+         auto reindex_from_checkpoint = [&]() -> bool
+         {
+            if( chain::database::has_flushed_state( _data_dir / "blockchain" ) )
+            {
+               try
+               {
+                  ilog("Replaying blockchain from the last flushed state");
+                  _chain_db->reindex_from_flushed_state(_data_dir / "blockchain");
+                  return true;
+               }
+               catch( const fc::exception& e )
+               {
+                  wlog( "Could not replay from the flushed state: ${e}", ("e", e.to_detail_string()) );
+               }
+            }
+            if( checkpoint_interval == 0 )
+               return false;
+            fc::optional<fc::path> checkpoint = chain::database::find_state_checkpoint( checkpoint_dir );
+            if( !checkpoint.valid() )
+               return false;
+            try
+            {
+               ilog("Replaying blockchain from state checkpoint ${d}", ("d", *checkpoint));
+               _chain_db->reindex_from_snapshot(_data_dir / "blockchain", *checkpoint);
+               return true;
+            }
+            catch( const fc::exception& e )
+            {
+               wlog( "Could not replay from state checkpoint ${d}: ${e}", ("d", *checkpoint)("e", e.to_detail_string()) );
+               return false;
+            }
+         };
+
+         // a standby without any state of its own starts from the newest state checkpoint of its primary
+         bool replicated_state = false;
+         if( _options->count("replicate-from") )
+         {
+            replication_client::config replication;
+            replication.server   = _options->at("replicate-from").as<string>();
+            replication.user     = _options->at("replicate-user").as<string>();
+            replication.password = _options->at("replicate-password").as<string>();
+            replication.trusted  = _options->at("replicate-trusted").as<bool>();
+            _replication_client.reset( new replication_client( *_chain_db, replication ) );
+            if( !fc::exists( _data_dir / "blockchain" / "object_database" ) )
+            {
+               try
+               {
+                  fc::path checkpoint = _replication_client->fetch_state_checkpoint(
+                        _data_dir / "replica_checkpoint", _data_dir / "blockchain" / "database" / "block_num_to_block" );
+                  _chain_db->reindex_from_snapshot( _data_dir / "blockchain", checkpoint );
+                  replicated_state = true;
+               }
+               catch( const fc::exception& e )
+               {
+                  wlog( "Could not start from the primary's state checkpoint: ${e}", ("e", e.to_detail_string()) );
+               }
+            }
+         }
+
+         if( replicated_state )
+            ilog("Started from the state checkpoint of the primary");
+         else if( _options->count("shared-state-follow") )
+         {
+            // an API process serving the state a validating node on this host shares, it applies no blocks
+            fc::path file = _options->at("shared-state-follow").as<boost::filesystem::path>();
+            if( file.is_relative() )
+               file = _data_dir / file;
+            _shared_state_follower.reset( new shared_state_follower( *_chain_db, file ) );
+            _shared_state_follower->start( fc::milliseconds( _options->at("shared-state-poll-ms").as<uint32_t>() ) );
+         }
+         else if( _options->count("replay-from-snapshot") )
+         {
+            fc::path snapshot_dir = _options->at("replay-from-snapshot").as<boost::filesystem::path>();
+            if( snapshot_dir.is_relative() )
+               snapshot_dir = _data_dir / snapshot_dir;
+            ilog("Replaying blockchain from snapshot ${d} on user request.", ("d", snapshot_dir));
+            _chain_db->reindex_from_snapshot(_data_dir/"blockchain", snapshot_dir);
+         } else if( _options->count("replay-blockchain") || benchmark )
          {
             ilog("Replaying blockchain on user request.");
             _chain_db->reindex(_data_dir/"blockchain", initial_state());
@@ -335,7 +1030,8 @@ namespace detail {
                return (version_str != GRAPHENE_CURRENT_DB_VERSION);
             };
 
-            bool need_reindex = (!is_new() && is_outdated());
+            const bool outdated = (!is_new() && is_outdated());
+            bool need_reindex = outdated;
             std::string reindex_reason = "version upgrade";
 
             if( !need_reindex )
@@ -357,7 +1053,9 @@ namespace detail {
                ilog("Replaying blockchain due to ${reason}", ("reason", reindex_reason) );
 
                fc::remove_all( _data_dir / "db_version" );
-               _chain_db->reindex(_data_dir / "blockchain", initial_state());
+               // checkpoints of an outdated state are as outdated
+               if( outdated || !reindex_from_checkpoint() )
+                  _chain_db->reindex(_data_dir / "blockchain", initial_state());
 
                // doing this down here helps ensure that DB will be wiped
                // if any of the above steps were interrupted on a previous run
@@ -373,10 +1071,11 @@ namespace detail {
             }
          } else {
             wlog("Detected unclean shutdown. Replaying blockchain...");
-            _chain_db->reindex(_data_dir / "blockchain", initial_state());
+            if( !reindex_from_checkpoint() )
+               _chain_db->reindex(_data_dir / "blockchain", initial_state());
          }
 
-         if (!_options->count("genesis-json") &&
+         if (!_shared_state_follower && !_options->count("genesis-json") &&
              _chain_db->get_chain_id() != graphene::egenesis::get_egenesis_chain_id()) {
             elog("Detected old database. Nuking and starting over.");
             _chain_db->wipe(_data_dir / "blockchain", true);
@@ -386,12 +1085,66 @@ namespace detail {
             _chain_db->open(_data_dir / "blockchain", initial_state);
          }
 
+         if( benchmark )
+         {
+            report_replay_benchmark();
+            _exit_after_startup = true;
+            return;
+         }
+
+         if( _options->count("api-replica-types") )
+            _state_replica = std::make_shared<state_replica>( std::ref( *_chain_db ),
+                  parse_object_types( _options->at("api-replica-types").as<vector<string>>() ) );
+
+         if( _options->count("shared-state-file") && !_shared_state_follower )
+         {
+            fc::path file = _options->at("shared-state-file").as<boost::filesystem::path>();
+            if( file.is_relative() )
+               file = _data_dir / file;
+            flat_set<shared_state_writer::object_type> types;
+            if( _options->count("shared-state-types") )
+               types = parse_object_types( _options->at("shared-state-types").as<vector<string>>() );
+            _shared_state_writer.reset( new shared_state_writer( *_chain_db, file,
+                  uint64_t( _options->at("shared-state-ring-size").as<uint32_t>() ) * 1024 * 1024, types ) );
+         }
+
+         _confirmations = std::make_shared<confirmation_registry>( std::ref( *_chain_db ) );
+
+         if( _options->count("block-trace-size") && _options->at("block-trace-size").as<uint32_t>() > 0 )
+         {
+            fc::path trace_file;
+            if( _options->count("block-trace-file") )
+            {
+               trace_file = _options->at("block-trace-file").as<boost::filesystem::path>();
+               if( trace_file.is_relative() )
+                  trace_file = _data_dir / trace_file;
+            }
+            _block_tracer = std::make_shared<block_tracer>( _options->at("block-trace-size").as<uint32_t>(),
+                                                            trace_file );
+            // the phases of applying each block come from the chain's profile
+            _chain_db->set_apply_profiling( true );
+         }
+
          if( _options->count("force-validate") )
          {
             ilog( "All transaction signatures will be validated" );
             _force_validate = true;
          }
 
+         if( _options->count("transaction-check-threads") )
+         {
+            uint32_t count = _options->at("transaction-check-threads").as<uint32_t>();
+            for( uint32_t i = 0; i < count; ++i )
+               _check_threads.emplace_back( new fc::thread( "transaction checker " + fc::to_string(i) ) );
+         }
+
+         if( _options->count("sync-verify-threads") )
+         {
+            uint32_t count = _options->at("sync-verify-threads").as<uint32_t>();
+            for( uint32_t i = 0; i < count; ++i )
+               _verify_threads.emplace_back( new fc::thread( "sync block verifier " + fc::to_string(i) ) );
+         }
+
          graphene::time::now();
 
          if( _options->count("api-access") )
@@ -409,14 +1162,56 @@ namespace detail {
             wild_access.allowed_apis.push_back( "network_broadcast_api" );
             wild_access.allowed_apis.push_back( "history_api" );
             wild_access.allowed_apis.push_back( "crypto_api" );
+            wild_access.allowed_apis.push_back( "packed_api" );
             _apiaccess.permission_map["*"] = wild_access;
          }
 
-         reset_p2p_node(_data_dir);
+         if( !_shared_state_follower )
+            reset_p2p_node(_data_dir);
+         reset_rate_limits();
          reset_websocket_server();
          reset_websocket_tls_server();
+         reset_http_server();
+
+         if( _replication_client )
+            _replication_client->start();
       } FC_LOG_AND_RETHROW() }
 
+      /** prints what the replay did as JSON, and writes it to benchmark-output if given */
+      void report_replay_benchmark()
+      {
+         const graphene::chain::apply_profile profile = _chain_db->get_apply_profile();
+         replay_benchmark result;
+         result.replay = _chain_db->get_replay_statistics();
+         const double seconds = std::max( result.replay.elapsed_time / 1000000.0, 0.000001 );
+         result.blocks_per_second = result.replay.blocks / seconds;
+         result.transactions_per_second = result.replay.transactions / seconds;
+         result.operations_per_second = result.replay.operations / seconds;
+         result.peak_resident_bytes = peak_resident_bytes();
+         const uint32_t skip = _chain_db->get_replay_skip_flags();
+         for( const auto& check : replay_checks() )
+            if( skip & check.second )
+               result.skipped_checks.push_back( check.first );
+         for( const auto& plugin : _plugins )
+            result.plugins.push_back( plugin.first );
+         result.phases = profile.block_totals;
+         for( size_t tag = 0; tag < profile.operations.size(); ++tag )
+         {
+            if( profile.operations[tag].count == 0 )
+               continue;
+            graphene::chain::operation op;
+            op.set_which( tag );
+            result.operations[ op.visit( operation_name_visitor() ) ] = profile.operations[tag];
+         }
+
+         ilog( "Replayed ${n} blocks in ${s} s: ${bps} blocks/s, ${tps} transactions/s, ${ops} operations/s",
+               ("n",result.replay.blocks)("s",seconds)("bps",uint64_t(result.blocks_per_second))
+               ("tps",uint64_t(result.transactions_per_second))("ops",uint64_t(result.operations_per_second)) );
+         std::cout << fc::json::to_pretty_string( result ) << "\n";
+         if( _options->count("benchmark-output") )
+            fc::json::save_to_file( result, _options->at("benchmark-output").as<boost::filesystem::path>() );
+      }
+
       optional< api_access_info > get_api_access_info(const string& username)const
       {
          optional< api_access_info > result;
@@ -481,7 +1276,39 @@ namespace detail {
             // you can help the network code out by throwing a block_older_than_undo_history exception.
             // when the net code sees that, it will stop trying to push blocks from that chain, but
             // leave that peer connected so that they can get sync blocks from us
-            bool result = _chain_db->push_block(blk_msg.block, (_is_block_producer | _force_validate) ? database::skip_nothing : database::skip_transaction_signatures);
+            uint32_t skip = (_is_block_producer | _force_validate) ? database::skip_nothing : database::skip_transaction_signatures;
+            // the checkpoint pins the ids of the blocks up to it, so they are applied without checking them, but
+            // they still go through the fork database in case a peer sends a block that isn't on our chain
+            const bool trusted = _chain_db->is_trusted_block( blk_msg.block.block_num() );
+            if( trusted )
+               skip = _chain_db->trusted_skip_flags() & ~database::skip_fork_db;
+            fc::optional<verified_sync_block> verified;
+            if( sync_mode )
+               verified = take_verified_sync_block( blk_msg.block_id );
+            if( !verified.valid() && !trusted )
+               for( const auto& trx : blk_msg.block.transactions )
+                  trx.seal( _chain_db->get_chain_id() );
+            // push the copy the checks were computed on, it is the block with this id even if blk_msg is not
+            if( _block_tracer )
+               _block_tracer->start( blk_msg.block.block_num(), blk_msg.block_id, sync_mode );
+            bool result;
+            try
+            {
+               result = verified.valid() ? _chain_db->push_block( *verified->block, skip, verified->checks )
+                                         : _chain_db->push_block( blk_msg.block, skip );
+            }
+            catch( ... )
+            {
+               if( _block_tracer )
+                  _block_tracer->finish( fc::optional<chain::block_apply_profile>() );
+               throw;
+            }
+            if( _block_tracer )
+               _block_tracer->finish( _chain_db->get_last_block_profile() );
+            if( sync_mode )
+               note_sync_block( blk_msg.block.block_num(), trusted );
+            else
+               _sync_report_start = fc::time_point();
 
             // the block was accepted, so we now know all of the transactions contained in the block
             if (!sync_mode)
@@ -515,6 +1342,87 @@ namespace detail {
          }
       } FC_CAPTURE_AND_RETHROW( (blk_msg)(sync_mode) ) }
 
+      virtual void block_broadcast( const graphene::net::block_message& blk_msg, fc::time_point received,
+                                    fc::time_point broadcast_start ) override
+      {
+         if( _block_tracer )
+            _block_tracer->note_broadcast( blk_msg.block_id, received, broadcast_start, fc::time_point::now() );
+      }
+
+      /**
+       * Starts computing the checks of a sync block that don't depend on the chain state on one of the
+       * _verify_threads, so handle_block() finds them done when the block's turn comes.
+       */
+      virtual void sync_block_received( const graphene::net::block_message& blk_msg ) override
+      {
+         if( _verify_threads.empty() )
+            return;
+         auto block = std::make_shared<const signed_block>( blk_msg.block );
+         fc::thread& thread = *_verify_threads[ _next_verify_thread++ % _verify_threads.size() ];
+         auto chain_id = _chain_db->get_chain_id();
+         // the signatures of blocks up to the last checkpoint aren't checked, so only their ids are worth computing
+         const bool trusted = _chain_db->is_trusted_block( block->block_num() );
+         auto done = thread.async( [block,chain_id,trusted]() {
+            if( !trusted )
+               for( const auto& trx : block->transactions )
+                  trx.seal( chain_id );
+            return verified_sync_block{ block, database::precompute_block( *block, trusted ) };
+         }, "precompute sync block" );
+
+         std::lock_guard<std::mutex> guard( _verified_mutex );
+         // blocks that are never pushed, e.g. because they are on a fork we don't switch to, are dropped
+         // lowest block number first once too many have piled up
+         if( _verified_sync_blocks.size() >= max_verified_sync_blocks )
+            _verified_sync_blocks.erase( _verified_sync_blocks.begin() );
+         _verified_sync_blocks[ blk_msg.block_id ] = done;
+      }
+
+      /** logs the rate sync blocks are pushed at every sync_report_interval blocks */
+      void note_sync_block( uint32_t block_num, bool trusted )
+      {
+         const fc::time_point now = fc::time_point::now();
+         if( _sync_report_start == fc::time_point() )
+         {
+            _sync_report_start = now;
+            _sync_report_blocks = _sync_report_trusted = 0;
+         }
+         ++_sync_report_blocks;
+         if( trusted )
+            ++_sync_report_trusted;
+         if( _sync_report_blocks < sync_report_interval )
+            return;
+         const int64_t elapsed_us = std::max<int64_t>( ( now - _sync_report_start ).count(), 1 );
+         ilog( "Synced ${n} blocks up to #${b} at ${r} blocks/s, ${t} of them trusted below the last checkpoint",
+               ("n",_sync_report_blocks)("b",block_num)
+               ("r",uint64_t(_sync_report_blocks) * 1000000 / uint64_t(elapsed_us))("t",_sync_report_trusted) );
+         _sync_report_start = now;
+         _sync_report_blocks = _sync_report_trusted = 0;
+      }
+
+      fc::optional<verified_sync_block> take_verified_sync_block( const block_id_type& id )
+      {
+         fc::future<verified_sync_block> done;
+         {
+            std::lock_guard<std::mutex> guard( _verified_mutex );
+            auto itr = _verified_sync_blocks.find( id );
+            if( itr == _verified_sync_blocks.end() )
+               return fc::optional<verified_sync_block>();
+            done = itr->second;
+            _verified_sync_blocks.erase( itr );
+         }
+         try
+         {
+            verified_sync_block result = done.wait();
+            if( result.checks.id == id )
+               return result;
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Unable to precompute the checks of block ${id}: ${e}", ("id",id)("e",e.to_detail_string()) );
+         }
+         return fc::optional<verified_sync_block>();
+      }
+
       virtual void handle_transaction(const graphene::net::trx_message& transaction_message) override
       { try {
          static fc::time_point last_call;
@@ -527,9 +1435,36 @@ namespace detail {
             trx_count = 0;
          }
 
-         _chain_db->push_transaction( transaction_message.trx );
+         transaction_message.trx.seal( _chain_db->get_chain_id() );
+         push_transaction( transaction_message.trx );
       } FC_CAPTURE_AND_RETHROW( (transaction_message) ) }
 
+      /**
+       * Refuses trx if it is too large, known, expired or off our chain, all cheap to find out, then runs the checks
+       * that don't depend on the chain state on one of the transaction check threads, so a bad signature is found
+       * before it costs any time on this thread, then pushes trx to the chain database.
+       */
+      void push_transaction( const signed_transaction& trx )
+      {
+         const chain_id_type chain_id = _chain_db->get_chain_id();
+         const uint32_t max_size = _chain_db->get_global_properties().parameters.maximum_transaction_size;
+         auto size = fc::raw::pack_size( trx );
+         FC_ASSERT( size <= max_size, "transaction is too large", ("size",size)("max",max_size) );
+         _chain_db->precheck_transaction( trx );
+         auto check = [&trx,chain_id]() {
+            trx.validate();
+            return trx.get_signature_keys( chain_id );
+         };
+         if( _check_threads.empty() )
+         {
+            _chain_db->push_checked_transaction( trx, check() );
+            return;
+         }
+         fc::thread& thread = *_check_threads[ _next_check_thread++ % _check_threads.size() ];
+         auto keys = thread.async( check, "check transaction" ).wait();
+         _chain_db->push_checked_transaction( trx, keys );
+      }
+
       virtual void handle_message(const message& message_to_process) override
       {
          // not a transaction, not a block
@@ -539,6 +1474,8 @@ namespace detail {
       bool is_included_block(const block_id_type& block_id)
       {
         uint32_t block_num = block_header::num_from_id(block_id);
+        if( block_num < _chain_db->earliest_available_block_num() )
+          return false; // pruned from our block log
         block_id_type block_id_in_preferred_chain = _chain_db->get_block_id_for_num(block_num);
         return block_id == block_id_in_preferred_chain;
       }
@@ -587,6 +1524,12 @@ namespace detail {
            if (!found_a_block_in_synopsis)
              FC_THROW_EXCEPTION(graphene::net::peer_is_on_an_unreachable_fork, "Unable to provide a list of blocks starting at any of the blocks in peer's synopsis");
          }
+         // don't offer blocks we have already pruned, the peer has to sync them from an archive node
+         if( block_header::num_from_id(last_known_block_id) + 1 < _chain_db->earliest_available_block_num() )
+           FC_THROW_EXCEPTION(graphene::net::peer_is_on_an_unreachable_fork,
+                              "Unable to provide blocks after ${n}, our block log starts at ${first}",
+                              ("n", block_header::num_from_id(last_known_block_id))
+                              ("first", _chain_db->earliest_available_block_num()));
          for( uint32_t num = block_header::num_from_id(last_known_block_id);
               num <= _chain_db->head_block_num() && result.size() < limit;
               ++num )
@@ -607,13 +1550,21 @@ namespace detail {
         // ilog("Request for item ${id}", ("id", id));
          if( id.item_type == graphene::net::block_message_type )
          {
-            auto opt_block = _chain_db->fetch_block_by_id(id.item_hash);
-            if( !opt_block )
+            auto packed_block = _chain_db->fetch_packed_block_by_id(id.item_hash);
+            if( !packed_block )
                elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
                     ("id", id.item_hash)("id2", _chain_db->get_block_id_for_num(block_header::num_from_id(id.item_hash))));
-            FC_ASSERT( opt_block.valid() );
-            // ilog("Serving up block #${num}", ("num", opt_block->block_num()));
-            return block_message(std::move(*opt_block));
+            FC_ASSERT( packed_block );
+            // a packed block_message is the packed block followed by its id, so build it from the stored bytes
+            // rather than unpacking and re-packing the block
+            message msg;
+            msg.msg_type = graphene::net::block_message_type;
+            auto packed_id = fc::raw::pack( block_id_type( id.item_hash ) );
+            msg.data.reserve( packed_block->size() + packed_id.size() );
+            msg.data.insert( msg.data.end(), packed_block->begin(), packed_block->end() );
+            msg.data.insert( msg.data.end(), packed_id.begin(), packed_id.end() );
+            msg.size = (uint32_t)msg.data.size();
+            return msg;
          }
          return trx_message( _chain_db->get_recent_transaction( id.item_hash ) );
       } FC_CAPTURE_AND_RETHROW( (id) ) }
@@ -688,7 +1639,8 @@ namespace detail {
           synopsis.reserve(30);
           uint32_t high_block_num;
           uint32_t non_fork_high_block_num;
-          uint32_t low_block_num = _chain_db->last_non_undoable_block_num();
+          uint32_t low_block_num = std::max( _chain_db->last_non_undoable_block_num(),
+                                             _chain_db->earliest_available_block_num() );
           std::vector<block_id_type> fork_history;
 
           if (reference_point != item_hash_t())
@@ -866,13 +1818,38 @@ namespace detail {
       api_access _apiaccess;
 
       std::shared_ptr<graphene::chain::database>            _chain_db;
+      std::shared_ptr<state_replica>                        _state_replica;
+      std::shared_ptr<block_tracer>                         _block_tracer;
+      std::shared_ptr<confirmation_registry>                _confirmations;
+      std::unique_ptr<replication_client>                   _replication_client;
+      std::unique_ptr<light_client>                         _light_client;
+      std::unique_ptr<shared_state_writer>                  _shared_state_writer;
+      std::unique_ptr<shared_state_follower>                _shared_state_follower;
       std::shared_ptr<graphene::net::node>                  _p2p_network;
       std::shared_ptr<fc::http::websocket_server>      _websocket_server;
+      std::shared_ptr<api_rate_limits>                 _rate_limits;
+      std::shared_ptr<fc::http::server>                _http_server;
+      bool                                             _http_metrics = false;
+      uint32_t                                         _http_max_batch_size = 100;
+      uint32_t                                         _http_batch_concurrency = 8;
       std::shared_ptr<fc::http::websocket_tls_server>  _websocket_tls_server;
 
       std::map<string, std::shared_ptr<abstract_plugin>> _plugins;
 
       bool _is_finished_syncing = false;
+      bool _exit_after_startup = false;
+
+      vector< unique_ptr<fc::thread> >                            _check_threads;
+      uint32_t                                                    _next_check_thread = 0;
+      vector< unique_ptr<fc::thread> >                            _verify_threads;
+      uint32_t                                                    _next_verify_thread = 0;
+      std::mutex                                                  _verified_mutex;
+      /** checks of sync blocks that have been received but not pushed yet, by block id */
+      std::map< block_id_type, fc::future<verified_sync_block> >  _verified_sync_blocks;
+      /** sync blocks pushed since the last sync speed report, see note_sync_block() */
+      fc::time_point                                              _sync_report_start;
+      uint32_t                                                    _sync_report_blocks = 0;
+      uint32_t                                                    _sync_report_trusted = 0;
    };
 
 }
@@ -883,12 +1860,19 @@ application::application()
 
 application::~application()
 {
+   my->_replication_client.reset();
+   my->_shared_state_writer.reset();
    if( my->_p2p_network )
    {
       my->_p2p_network->close();
       my->_p2p_network.reset();
    }
-   if( my->_chain_db )
+   // a follower's database was never opened, it has nothing to save, nor has a light node's
+   if( my->_shared_state_follower )
+      my->_shared_state_follower.reset();
+   else if( my->_light_client )
+      my->_light_client.reset();
+   else if( my->_chain_db )
    {
       my->_chain_db->close();
    }
@@ -900,9 +1884,34 @@ void application::set_program_options(boost::program_options::options_descriptio
    configuration_file_options.add_options()
          ("p2p-endpoint", bpo::value<string>(), "Endpoint for P2P node to listen on")
          ("seed-node,s", bpo::value<vector<string>>()->composing(), "P2P nodes to connect to on startup (may specify multiple times)")
+         ("p2p-relay-mode", bpo::value<string>()->default_value("inventory"),
+          "How new blocks and transactions are relayed to peers: \"inventory\" advertises them for peers to fetch, "
+          "\"push\" sends them right away to the peers that accept pushed items")
+         ("p2p-accept-pushed-items", bpo::value<bool>()->default_value(false),
+          "Accept blocks and transactions that peers push without advertising them first; "
+          "otherwise a peer that sends an item we didn't ask for is disconnected")
+         ("p2p-pushed-items-per-second", bpo::value<uint32_t>()->default_value(GRAPHENE_NET_PUSHED_ITEMS_PER_SECOND),
+          "How many pushed items a single peer may send each second before it is disconnected")
+         ("p2p-relay-batch-window", bpo::value<uint32_t>()->default_value(0),
+          "Milliseconds new blocks and transactions wait before being relayed, so that each peer gets them in fewer, "
+          "bigger messages")
+         ("p2p-decode-threads", bpo::value<uint32_t>()->default_value(2),
+          "Number of threads unpacking the blocks and transactions received from peers, 0 to unpack them on the p2p thread")
+         ("p2p-adaptive-connections", bpo::value<bool>()->default_value(false),
+          "Lower the number of inbound p2p connections accepted while the node is overloaded, and raise it back when "
+          "the load goes down; peers are not shed while the node is syncing")
          ("checkpoint,c", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
          ("rpc-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8090"), "Endpoint for websocket RPC to listen on")
          ("rpc-tls-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8089"), "Endpoint for TLS websocket RPC to listen on")
+         ("rpc-http-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8091"),
+          "Endpoint for HTTP POST JSON-RPC to listen on, which takes batches of calls as arrays and serves the database API")
+         ("rpc-http-metrics", bpo::value<bool>()->default_value(false),
+          "Serve p2p traffic and block relay metrics in the Prometheus text format on GET /metrics of rpc-http-endpoint, "
+          "to anyone who can reach it, so only enable it on an endpoint that isn't public")
+         ("rpc-http-max-batch-size", bpo::value<uint32_t>()->default_value(100),
+          "Number of calls an HTTP JSON-RPC batch may have, larger batches are refused, 0 for no limit")
+         ("rpc-http-batch-concurrency", bpo::value<uint32_t>()->default_value(8),
+          "Number of the calls of an HTTP JSON-RPC batch that run at the same time")
          ("enable-permessage-deflate", "Enable support for per-message deflate compression in the websocket servers "
                                        "(--rpc-endpoint and --rpc-tls-endpoint), disabled by default")
          ("server-pem,p", bpo::value<string>()->implicit_value("server.pem"), "The TLS certificate file for this server")
@@ -910,6 +1919,123 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("genesis-json", bpo::value<boost::filesystem::path>(), "File to read Genesis State from")
          ("dbg-init-key", bpo::value<string>(), "Block signing key to use for init witnesses, overrides genesis file")
          ("api-access", bpo::value<boost::filesystem::path>(), "JSON file specifying API permissions")
+         ("object-database-threads", bpo::value<uint32_t>()->default_value(1),
+          "Number of threads used to load and save the object database indexes on startup and shutdown")
+         ("replay-prefetch-threads", bpo::value<uint32_t>()->default_value(1),
+          "Number of threads reading and unpacking blocks ahead of evaluation while replaying the blockchain")
+         ("replay-skip-checks", bpo::value<vector<string>>()->composing()->multitoken(),
+          "Checks to skip while replaying the blockchain, of witness_signature, transaction_signatures, "
+          "transaction_dupe_check, tapos_check, authority_check, merkle_check, assert_evaluation, "
+          "witness_schedule_check, validate and operation_history, or none (default: the signature, dupe, tapos, "
+          "authority and witness schedule checks)")
+         ("disable-plugin", bpo::value<vector<string>>()->composing()->multitoken(),
+          "Plugins not to initialize or start, e.g. to benchmark a replay without them (may specify multiple times)")
+         ("pending-transactions-max-bytes", bpo::value<uint64_t>()->default_value(64*1024*1024),
+          "Total size of the pending transactions kept, the lowest paying are evicted or refused beyond it, 0 for no limit")
+         ("pending-transactions-per-account", bpo::value<uint32_t>()->default_value(0),
+          "Number of pending transactions whose fee one account may pay, 0 for no limit")
+         ("signature-cache-size", bpo::value<uint32_t>()->default_value(100000),
+          "Number of recovered transaction signature keys to remember, so they are not recovered again when the transaction is seen in a block or reapplied")
+         ("validation-cache-size", bpo::value<uint32_t>()->default_value(10000),
+          "Number of transactions with confidential transfers whose validation to remember, so their commitments are not verified again when the transaction is seen in a block or reapplied")
+         ("key-cache-size", bpo::value<uint32_t>()->default_value(10000),
+          "Number of public keys whose addresses and base58 strings to remember, so address authorities and API key lookups don't derive them again")
+         ("signature-threads", bpo::value<uint32_t>()->default_value(2),
+          "Number of threads recovering the transaction signature keys of each block before it is applied, 0 to recover them as each transaction is applied")
+         ("api-read-threads", bpo::value<uint32_t>()->default_value(0),
+          "Number of threads that account history queries and large batch API reads, such as get_full_accounts of many accounts, run on, 0 to read on the main thread")
+         ("api-max-queued-notifications", bpo::value<uint32_t>()->default_value(1000),
+          "Number of batches of object changes that may wait to be sent to one API connection before its subscriptions are dropped, 0 for no limit")
+         ("api-rate-limit", bpo::value<uint32_t>()->default_value(0),
+          "Cost units each API connection may spend per second, each call costing 1 unless api-method-cost says otherwise, 0 for no limit")
+         ("api-rate-burst", bpo::value<uint32_t>()->default_value(0),
+          "Cost units an API connection may spend at once after having been idle, at least api-rate-limit")
+         ("api-address-rate-limit", bpo::value<uint32_t>()->default_value(0),
+          "Cost units all API connections from one address together may spend per second, 0 for no limit")
+         ("api-address-rate-burst", bpo::value<uint32_t>()->default_value(0),
+          "Cost units the API connections from one address may spend at once after having been idle, at least api-address-rate-limit")
+         ("api-method-cost", bpo::value<vector<string>>()->composing(),
+          "Cost of an API method as method=cost, e.g. get_account_history=10 (may specify multiple times)")
+         ("api-notification-threads", bpo::value<uint32_t>()->default_value(0),
+          "Number of threads that serialize and send the notifications of API subscriptions, each serving a share of the connections, 0 to send them from the main thread")
+         ("api-replica-types", bpo::value<vector<string>>()->composing(),
+          "Object types, such as 1.2 for accounts, that get_objects reads from a copy of the state published after each block instead of the live state (may specify multiple times)")
+         ("shared-state-file", bpo::value<boost::filesystem::path>(),
+          "File, relative to data-dir, the state of shared-state-types is shared in with API processes on this host "
+          "started with shared-state-follow, e.g. below /dev/shm")
+         ("shared-state-types", bpo::value<vector<string>>()->composing(),
+          "Object types, such as 1.2 for accounts, shared in shared-state-file besides the chain properties, which "
+          "are always shared (may specify multiple times)")
+         ("shared-state-ring-size", bpo::value<uint32_t>()->default_value(64),
+          "Megabytes of changes shared-state-file holds before the whole shared state is written again")
+         ("shared-state-follow", bpo::value<boost::filesystem::path>(),
+          "Serve the state another node shares in this file, relative to data-dir, instead of applying blocks.  The "
+          "node has no peers and doesn't offer the network or replication APIs")
+         ("shared-state-poll-ms", bpo::value<uint32_t>()->default_value(100),
+          "Milliseconds between looking for changes in the shared-state-follow file")
+         ("transaction-check-threads", bpo::value<uint32_t>()->default_value(2),
+          "Number of threads validating and recovering the signature keys of transactions received from the network or the API before they are pushed, 0 to do it on the main thread")
+         ("sync-verify-threads", bpo::value<uint32_t>()->default_value(2),
+          "Number of threads computing block ids, merkle roots and witness signatures of blocks received while syncing, 0 to compute them when each block is pushed")
+         ("block-log-segment-size", bpo::value<uint32_t>()->default_value(100000),
+          "Number of blocks stored in each block log segment created from now on")
+         ("block-log-compression", bpo::value<string>()->default_value("no_compression"),
+          "Compression of block log segments created from now on: no_compression or zlib_compression")
+         ("block-trace-size", bpo::value<uint32_t>()->default_value(0),
+          "Number of blocks from the network whose push, apply phase, plugin and rebroadcast timings to keep for get_block_traces, 0 to not trace blocks")
+         ("block-trace-file", bpo::value<boost::filesystem::path>(),
+          "File, relative to data-dir, the block traces are appended to in the Chrome trace format when block-trace-size is set")
+         ("snapshot-at-block", bpo::value<uint32_t>(), "Export a state snapshot right after this block is applied")
+         ("snapshot-dir", bpo::value<boost::filesystem::path>(),
+          "Directory the snapshot is exported to, relative to data-dir (default: snapshot)")
+         ("state-checkpoint-interval", bpo::value<uint32_t>()->default_value(0),
+          "Checkpoint the chain state every this many blocks, in the background, so that a restart after a crash "
+          "replays only the blocks after the newest irreversible checkpoint.  0 disables checkpoints")
+         ("replicate-from", bpo::value<string>(),
+          "Websocket endpoint of a primary node to follow as its hot standby, through its replication_api")
+         ("replicate-user", bpo::value<string>()->default_value(""), "User to log in to the primary with")
+         ("replicate-password", bpo::value<string>()->default_value(""), "Password to log in to the primary with")
+         ("replicate-trusted", bpo::value<bool>()->default_value(false),
+          "Push the primary's blocks without checking their signatures, authorities and merkle roots again, only "
+          "for a primary under the same control as this node")
+         ("light-sync-from", bpo::value<string>(),
+          "Websocket endpoint of a node whose block headers to follow and check, instead of applying blocks.  The "
+          "node keeps no chain state, has no peers or API servers, and plugins reading the chain state don't work")
+         ("light-sync-user", bpo::value<string>()->default_value(""), "User to log in to light-sync-from with")
+         ("light-sync-password", bpo::value<string>()->default_value(""), "Password to log in to light-sync-from with")
+         ("defer-plugin-indexes", bpo::value<bool>()->default_value(false),
+          "Load the indexes of plugins in the background at startup, so that the node gets going sooner.  Blocks "
+          "and plugin APIs wait until they are loaded")
+         ("flush-interval", bpo::value<uint32_t>()->default_value(0),
+          "Flush the object database every this many blocks in the background, so that a restart after a crash "
+          "replays only the blocks after the last irreversible flush.  0 only flushes on shutdown")
+         ("state-digest-blocks", bpo::value<uint32_t>()->default_value(0),
+          "Keep the digest of every index up to date and record it for this many of the last blocks, so that nodes "
+          "can compare their state through get_state_digest.  0 hashes the whole state on each request instead")
+         ("check-supply", bpo::value<bool>()->default_value(false),
+          "Check after every block that the supply of each asset is what the balances, orders and funds hold, from "
+          "totals kept as they change, and log the blocks after which it doesn't")
+         ("fork-diff-replay", bpo::value<bool>()->default_value(false),
+          "Keep the changes of the blocks popped by a fork switch, so that switching back replays them instead of "
+          "applying the blocks again.  Plugins are notified of the replayed blocks, and find what they keep in the "
+          "object database restored with the rest")
+         ("undo-squash-depth", bpo::value<uint32_t>()->default_value(0),
+          "Squash the undo states of the blocks more than this many below the head into one, which caps their "
+          "memory while blocks don't become irreversible.  Forks deeper than this are refused.  0 never squashes")
+         ("fork-prevalidation", bpo::value<bool>()->default_value(false),
+          "Check the blocks of competing branches in the background, so that switching to one is faster and one "
+          "with an invalid block is dropped without popping any blocks")
+         ("state-checkpoint-dir", bpo::value<boost::filesystem::path>()->default_value("checkpoints"),
+          "Directory the state checkpoints are kept in, relative to data-dir")
+         ("block-log-retain-blocks", bpo::value<uint32_t>()->default_value(0),
+          "Drop block log segments older than this many blocks below the last irreversible block, 0 keeps all blocks")
+         ("block-log-flush-blocks", bpo::value<uint32_t>()->default_value(1),
+          "Write stored blocks to the block log once this many are buffered, 0 for no limit")
+         ("block-log-flush-ms", bpo::value<uint32_t>()->default_value(0),
+          "Write stored blocks to the block log once the oldest buffered one is this many milliseconds old, 0 for no limit")
+         ("block-log-fsync", bpo::value<bool>()->default_value(false), "Sync the block log to disk after every write")
+         ("block-log-flush-on-irreversible", bpo::value<bool>()->default_value(false),
+          "Write the block log whenever the last irreversible block advances")
          ;
    command_line_options.add(configuration_file_options);
    command_line_options.add_options()
@@ -918,6 +2044,13 @@ void application::set_program_options(boost::program_options::options_descriptio
           "missing fields in a Genesis State will be added, and any unknown fields will be removed. If no file or an "
           "invalid file is found, it will be replaced with an example Genesis State.")
          ("replay-blockchain", "Rebuild object graph by replaying all blocks")
+         ("replay-from-snapshot", bpo::value<boost::filesystem::path>(),
+          "Rebuild object graph from a snapshot written by snapshot-at-block, replaying only the blocks after it")
+         ("benchmark-replay", "Replay the blockchain as replay-blockchain does, or from replay-from-snapshot, print how "
+          "fast it went and where the time went as JSON, and exit.  The next start replays again")
+         ("benchmark-last-block", bpo::value<uint32_t>()->default_value(0),
+          "Block to stop the benchmark replay after, 0 to replay the whole block log")
+         ("benchmark-output", bpo::value<boost::filesystem::path>(), "File to write the benchmark results to as well")
          ("resync-blockchain", "Delete all blocks and re-sync with network from scratch")
          ("force-validate", "Force validation of all transactions")
          ("genesis-timestamp", bpo::value<uint32_t>(), "Replace timestamp from genesis.json with current time plus this many seconds (experts only!)")
@@ -985,6 +2118,31 @@ std::shared_ptr<chain::database> application::chain_database() const
    return my->_chain_db;
 }
 
+std::shared_ptr<const state_replica> application::get_state_replica() const
+{
+   return my->_state_replica;
+}
+
+bool application::follows_shared_state() const
+{
+   return my->_shared_state_follower != nullptr;
+}
+
+light_client* application::get_light_client() const
+{
+   return my->_light_client.get();
+}
+
+std::shared_ptr<block_tracer> application::get_block_tracer() const
+{
+   return my->_block_tracer;
+}
+
+std::shared_ptr<confirmation_registry> application::get_confirmation_registry() const
+{
+   return my->_confirmations;
+}
+
 void application::set_block_production(bool producing_blocks)
 {
    my->_is_block_producer = producing_blocks;
@@ -1000,11 +2158,21 @@ void application::set_api_access_info(const string& username, api_access_info&&
    my->set_api_access_info(username, std::move(permissions));
 }
 
+void application::push_transaction( const graphene::chain::signed_transaction& trx )
+{
+   my->push_transaction( trx );
+}
+
 bool application::is_finished_syncing() const
 {
    return my->_is_finished_syncing;
 }
 
+bool application::exit_after_startup() const
+{
+   return my->_exit_after_startup;
+}
+
 void graphene::app::application::add_plugin(const string& name, std::shared_ptr<graphene::app::abstract_plugin> p)
 {
    my->_plugins[name] = p;
@@ -1020,14 +2188,25 @@ void application::shutdown()
 {
    if( my->_p2p_network )
       my->_p2p_network->close();
-   if( my->_chain_db )
+   if( my->_chain_db && !my->_light_client )
       my->_chain_db->close();
 }
 
 void application::initialize_plugins( const boost::program_options::variables_map& options )
 {
+   if( options.count("disable-plugin") )
+      for( const string& name : options.at("disable-plugin").as<vector<string>>() )
+      {
+         FC_ASSERT( my->_plugins.count( name ), "Unknown plugin ${p} in disable-plugin", ("p",name) );
+         ilog( "Plugin ${p} is disabled", ("p",name) );
+         my->_plugins.erase( name );
+      }
+   // the chain never reads the indexes of plugins, so they may load while the node starts
+   my->_chain_db->defer_opening_new_indexes( options.count("defer-plugin-indexes") &&
+                                             options.at("defer-plugin-indexes").as<bool>() );
    for( auto& entry : my->_plugins )
       entry.second->plugin_initialize( options );
+   my->_chain_db->defer_opening_new_indexes( false );
    return;
 }
 
@@ -1040,3 +2219,7 @@ void application::startup_plugins()
 
 // namespace detail
 } }
+
+FC_REFLECT( graphene::app::detail::replay_benchmark,
+            (replay)(blocks_per_second)(transactions_per_second)(operations_per_second)(peak_resident_bytes)
+            (skipped_checks)(plugins)(phases)(operations) )
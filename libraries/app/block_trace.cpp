@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/block_trace.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/variant_object.hpp>
+
+namespace graphene { namespace app {
+
+namespace {
+   /** the threads of the trace file */
+   const uint32_t chain_thread = 1;
+   const uint32_t p2p_thread = 2;
+}
+
+block_tracer::block_tracer( uint32_t capacity, const fc::path& trace_file )
+   : _capacity( std::max<uint32_t>( capacity, 1 ) )
+{
+   if( trace_file == fc::path() )
+      return;
+   const bool is_new = !fc::exists( trace_file ) || fc::file_size( trace_file ) == 0;
+   _file.open( trace_file.generic_string(), std::ios::out | std::ios::app );
+   FC_ASSERT( _file, "Cannot open block trace file ${f}", ("f",trace_file) );
+   if( is_new )
+      _file << "[\n";
+}
+
+void block_tracer::start( uint32_t block_num, const chain::block_id_type& id, bool sync_mode )
+{
+   _current = block_trace();
+   _current.block_num = block_num;
+   _current.block_id = id;
+   _current.sync_mode = sync_mode;
+   _current.received = _current.push_start = fc::time_point::now();
+   _tracing = true;
+}
+
+void block_tracer::add_plugin_time( const std::string& plugin, uint64_t time )
+{
+   if( !_tracing )
+      return;
+   // a plugin with several handlers is reported once, where its first handler ran
+   for( auto& p : _current.plugin_times )
+      if( p.plugin == plugin )
+      {
+         p.time += time;
+         return;
+      }
+   _current.plugin_times.push_back( plugin_time{ plugin, time } );
+}
+
+void block_tracer::finish( const fc::optional<chain::block_apply_profile>& apply )
+{
+   if( !_tracing )
+      return;
+   _tracing = false;
+   _current.push_time = ( fc::time_point::now() - _current.push_start ).count();
+   if( apply.valid() && apply->block_num == _current.block_num )
+      _current.apply = apply;
+
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( _file.is_open() )
+   {
+      const uint32_t n = _current.block_num;
+      write_event( "push_block", n, chain_thread, _current.push_start, _current.push_time );
+      if( _current.apply.valid() )
+      {
+         // the phases are laid end to end, ending with the push
+         const chain::block_apply_profile& a = *_current.apply;
+         fc::time_point t = _current.push_start
+                           + fc::microseconds( _current.push_time - std::min( a.total_time, _current.push_time ) );
+         auto phase = [&]( const char* name, uint64_t time ) {
+            write_event( name, n, chain_thread, t, time );
+            t += fc::microseconds( time );
+         };
+         phase( "header", a.header_time );
+         phase( "signatures", a.signature_time );
+         phase( "transactions", a.transaction_time );
+         phase( "dynamic_data", a.dynamic_data_time );
+         phase( "maintenance", a.maintenance_time );
+         phase( "expiration", a.expiration_time );
+         phase( "schedule", a.schedule_time );
+         fc::time_point plugin_start = t;
+         phase( "applied_block", a.applied_block_time );
+         for( const auto& p : _current.plugin_times )
+         {
+            write_event( p.plugin.c_str(), n, chain_thread, plugin_start, p.time );
+            plugin_start += fc::microseconds( p.time );
+         }
+         phase( "changed_objects", a.changed_objects_time );
+      }
+      _file.flush();
+   }
+
+   _traces.push_back( std::move( _current ) );
+   while( _traces.size() > _capacity )
+      _traces.pop_front();
+}
+
+void block_tracer::note_broadcast( const chain::block_id_type& id, fc::time_point received,
+                                   fc::time_point broadcast_start, fc::time_point broadcast_end )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   for( auto itr = _traces.rbegin(); itr != _traces.rend(); ++itr )
+      if( itr->block_id == id )
+      {
+         itr->received = received;
+         itr->broadcast_start = broadcast_start;
+         itr->broadcast_time = ( broadcast_end - broadcast_start ).count();
+         if( _file.is_open() )
+         {
+            write_event( "receive", itr->block_num, p2p_thread, received, ( itr->push_start - received ).count() );
+            write_event( "broadcast", itr->block_num, p2p_thread, broadcast_start, itr->broadcast_time );
+            _file.flush();
+         }
+         return;
+      }
+}
+
+std::vector<block_trace> block_tracer::get( uint32_t limit )const
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   std::vector<block_trace> result;
+   result.reserve( std::min<size_t>( limit, _traces.size() ) );
+   for( auto itr = _traces.rbegin(); itr != _traces.rend() && result.size() < limit; ++itr )
+      result.push_back( *itr );
+   return result;
+}
+
+void block_tracer::write_event( const char* name, uint32_t block_num, uint32_t thread, fc::time_point start,
+                                uint64_t duration )
+{
+   fc::mutable_variant_object event;
+   event( "name", name )( "cat", "block" )( "ph", "X" )( "pid", 1 )( "tid", thread )
+        ( "ts", start.time_since_epoch().count() )( "dur", duration )
+        ( "args", fc::mutable_variant_object( "block_num", block_num ) );
+   _file << fc::json::to_string( event ) << ",\n";
+}
+
+} } // graphene::app
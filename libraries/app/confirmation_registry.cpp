@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/confirmation_registry.hpp>
+#include <graphene/app/impacted.hpp>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+namespace graphene { namespace app {
+
+const size_t confirmation_registry::max_watches_per_owner;
+const size_t confirmation_registry::max_watched_accounts;
+
+confirmation_registry::confirmation_registry( chain::database& db ) : _db( db )
+{
+   _applied_block_connection = _db.applied_block.connect( [this]( const chain::signed_block& b ) {
+      on_applied_block( b );
+   } );
+}
+
+void confirmation_registry::add( const chain::signed_transaction& trx, std::weak_ptr<void> owner, callback cb,
+                                 bool irreversible )
+{
+   waiting w;
+   w.owner = std::move( owner );
+   w.cb = std::move( cb );
+   w.expiration = trx.expiration;
+   w.irreversible = irreversible;
+   const auto id = trx.id();
+
+   std::lock_guard<std::mutex> lock( _mutex );
+   _waiting.emplace( id, std::move( w ) );
+   _by_expiration.emplace( trx.expiration, id );
+}
+
+void confirmation_registry::watch_accounts( const fc::flat_set<chain::account_id_type>& accounts,
+                                            std::weak_ptr<void> owner, operation_callback cb )
+{
+   FC_ASSERT( accounts.size() <= max_watched_accounts, "Can watch at most ${n} accounts at once",
+              ("n",max_watched_accounts) );
+   auto watch = std::make_shared<account_watch>();
+   watch->owner = std::move( owner );
+   watch->accounts = accounts;
+   watch->cb = std::move( cb );
+   // the operations of trusted blocks are only recorded for those who ask
+   _db.require_applied_operations();
+
+   std::lock_guard<std::mutex> lock( _mutex );
+   const size_t owned = std::count_if( _watches.begin(), _watches.end(),
+      [&watch]( const std::shared_ptr<account_watch>& w ) {
+         return !w->owner.owner_before( watch->owner ) && !watch->owner.owner_before( w->owner );
+      } );
+   FC_ASSERT( owned < max_watches_per_owner, "Can have at most ${n} account watches at once",
+              ("n",max_watches_per_owner) );
+   _watches.push_back( std::move( watch ) );
+}
+
+size_t confirmation_registry::size()const
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   return _waiting.size() + _included.size();
+}
+
+fc::flat_set<chain::account_id_type> confirmation_registry::get_accounts( const chain::operation_history_object& op )const
+{
+   // the same accounts the account history lists the operation for
+   fc::flat_set<chain::account_id_type> impacted;
+   std::vector<chain::authority> other;
+   chain::operation_get_required_authorities( op.op, impacted, impacted, other );
+   if( op.op.which() == chain::operation::tag< chain::account_create_operation >::value )
+      impacted.insert( op.result.get<chain::object_id_type>() );
+   else
+      operation_get_impacted_accounts( op.op, impacted );
+   for( const auto& a : other )
+      for( const auto& item : a.account_auths )
+         impacted.insert( item.first );
+   return impacted;
+}
+
+void confirmation_registry::on_applied_block( const chain::signed_block& b )
+{
+   typedef std::tuple< waiting, chain::transaction_id_type, uint32_t, uint32_t, chain::processed_transaction >
+           ready_callback;
+   std::vector< ready_callback > ready;
+   std::vector< watched_operation > ready_operations;
+   const uint32_t block_num = b.block_num();
+   const uint32_t last_irreversible = _db.get_dynamic_global_properties().last_irreversible_block_num;
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+
+      // what was found in blocks that have been popped since is not in the chain any more
+      for( auto itr = _included.lower_bound( block_num ); itr != _included.end(); ++itr )
+      {
+         _by_expiration.emplace( itr->second.w.expiration, itr->second.id );
+         _waiting.emplace( itr->second.id, std::move( itr->second.w ) );
+      }
+      _included.erase( _included.lower_bound( block_num ), _included.end() );
+      _watched_operations.erase( _watched_operations.lower_bound( block_num ), _watched_operations.end() );
+
+      if( !_waiting.empty() )
+      {
+         for( uint32_t trx_num = 0; trx_num < b.transactions.size(); ++trx_num )
+         {
+            const auto id = b.transactions[trx_num].id();
+            auto range = _waiting.equal_range( id );
+            for( auto itr = range.first; itr != range.second; ++itr )
+            {
+               if( itr->second.irreversible )
+               {
+                  included inc;
+                  inc.w = std::move( itr->second );
+                  inc.id = id;
+                  inc.trx_num = trx_num;
+                  inc.trx = b.transactions[trx_num];
+                  _included.emplace( block_num, std::move( inc ) );
+               }
+               else
+                  ready.emplace_back( std::move( itr->second ), id, block_num, trx_num, b.transactions[trx_num] );
+            }
+            _waiting.erase( range.first, range.second );
+         }
+      }
+
+      // the id covers the expiration, so all callbacks for an id expire together; confirmed ids find nothing here
+      auto end = _by_expiration.lower_bound( b.timestamp );
+      for( auto itr = _by_expiration.begin(); itr != end; ++itr )
+         _waiting.erase( itr->second );
+      _by_expiration.erase( _by_expiration.begin(), end );
+
+      _watches.erase( std::remove_if( _watches.begin(), _watches.end(),
+                                      []( const std::shared_ptr<account_watch>& w ) { return w->owner.expired(); } ),
+                      _watches.end() );
+      if( !_watches.empty() )
+      {
+         for( const auto& op : _db.get_applied_operations() )
+         {
+            if( !op.valid() )
+               continue;
+            const auto accounts = get_accounts( *op );
+            for( const auto& w : _watches )
+               for( const auto& a : accounts )
+                  if( w->accounts.find( a ) != w->accounts.end() )
+                  {
+                     _watched_operations.emplace( block_num, watched_operation( w, *op ) );
+                     break;
+                  }
+         }
+      }
+
+      // update_last_irreversible_block() has already moved the irreversible block for this one
+      auto irreversible_end = _included.upper_bound( last_irreversible );
+      for( auto itr = _included.begin(); itr != irreversible_end; ++itr )
+         ready.emplace_back( std::move( itr->second.w ), itr->second.id, itr->first, itr->second.trx_num,
+                             std::move( itr->second.trx ) );
+      _included.erase( _included.begin(), irreversible_end );
+
+      auto operations_end = _watched_operations.upper_bound( last_irreversible );
+      for( auto itr = _watched_operations.begin(); itr != operations_end; ++itr )
+         ready_operations.push_back( std::move( itr->second ) );
+      _watched_operations.erase( _watched_operations.begin(), operations_end );
+   }
+
+   // outside the lock, so that callbacks can wait for more transactions
+   for( const auto& r : ready )
+   {
+      const waiting& w = std::get<0>( r );
+      // keep the session alive while its callback runs
+      auto owner = w.owner.lock();
+      if( !owner )
+         continue;
+      try
+      {
+         w.cb( std::get<1>( r ), std::get<2>( r ), std::get<3>( r ), std::get<4>( r ) );
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "Transaction confirmation callback failed: ${e}", ("e", e.to_detail_string()) );
+      }
+   }
+   for( const auto& o : ready_operations )
+   {
+      auto owner = o.first->owner.lock();
+      if( !owner )
+         continue;
+      try
+      {
+         o.first->cb( o.second );
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "Account operation callback failed: ${e}", ("e", e.to_detail_string()) );
+      }
+   }
+}
+
+} } // graphene::app
@@ -22,11 +22,12 @@
  * THE SOFTWARE.
  */
 
+#include <graphene/app/api_stats.hpp>
 #include <graphene/app/database_api.hpp>
 #include <graphene/chain/get_config.hpp>
 
-#include <fc/bloom_filter.hpp>
 #include <fc/smart_ref_impl.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <fc/crypto/hex.hpp>
 
@@ -36,8 +37,10 @@
 
 #include <cctype>
 
+#include <atomic>
 #include <cfenv>
 #include <iostream>
+#include <mutex>
 
 #define GET_REQUIRED_FEES_MAX_RECURSION 4
 
@@ -49,11 +52,13 @@ class database_api_impl;
 class database_api_impl : public std::enable_shared_from_this<database_api_impl>
 {
    public:
-      database_api_impl( graphene::chain::database& db );
+      database_api_impl( graphene::chain::database& db, std::shared_ptr<const state_replica> replica );
       ~database_api_impl();
 
       // Objects
       fc::variants get_objects(const vector<object_id_type>& ids)const;
+      vector<versioned_object> get_versioned_objects( const vector<object_id_type>& ids,
+                                                      const vector<uint64_t>& known_versions )const;
 
       // Subscriptions
       void set_subscribe_callback( std::function<void(const variant&)> cb, bool clear_filter );
@@ -79,10 +84,13 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       // Accounts
       vector<optional<account_object>> get_accounts(const vector<account_id_type>& account_ids)const;
       std::map<string,full_account> get_full_accounts( const vector<string>& names_or_ids, bool subscribe );
+      /** only reads the database, so it may run on the read threads */
+      optional<full_account> get_full_account( const string& name_or_id )const;
       optional<account_object> get_account_by_name( string name )const;
       vector<account_id_type> get_account_references( account_id_type account_id )const;
       vector<optional<account_object>> lookup_account_names(const vector<string>& account_names)const;
       map<string,account_id_type> lookup_accounts(const string& lower_bound_name, uint32_t limit)const;
+      map<string,account_id_type> lookup_accounts_by_prefix(const string& prefix, uint32_t limit)const;
       uint64_t get_account_count()const;
 
       // Balances
@@ -91,10 +99,12 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       vector<balance_object> get_balance_objects( const vector<address>& addrs )const;
       vector<asset> get_vested_balances( const vector<balance_id_type>& objs )const;
       vector<vesting_balance_object> get_vesting_balances( account_id_type account_id )const;
+      vector<asset> get_allowed_vesting_withdraws( const vector<vesting_balance_id_type>& ids )const;
 
       // Assets
       vector<optional<asset_object>> get_assets(const vector<asset_id_type>& asset_ids)const;
       vector<asset_object>           list_assets(const string& lower_bound_symbol, uint32_t limit)const;
+      vector<asset_object>           list_assets_by_prefix(const string& prefix, uint32_t limit)const;
       vector<optional<asset_object>> lookup_asset_symbols(const vector<string>& symbols_or_ids)const;
 
       // Markets / feeds
@@ -104,8 +114,17 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       vector<call_order_object>          get_margin_positions( const account_id_type& id )const;
       void subscribe_to_market(std::function<void(const variant&)> callback, asset_id_type a, asset_id_type b);
       void unsubscribe_from_market(asset_id_type a, asset_id_type b);
+      market_data_update subscribe_to_market_data( std::function<void(const variant&)> callback, asset_id_type a, asset_id_type b );
+      void unsubscribe_from_market_data( asset_id_type a, asset_id_type b );
       market_ticker                      get_ticker( const string& base, const string& quote )const;
       market_volume                      get_24_volume( const string& base, const string& quote )const;
+      optional<market_stats_object>      get_market_stats( asset_id_type a, asset_id_type b )const;
+      vector<optional<asset_market_stats_object>> get_asset_market_stats( const vector<asset_id_type>& asset_ids )const;
+      const market_ticker_object*        find_ticker( asset_id_type a, asset_id_type b )const;
+      static double ticker_amount_to_real( const market_ticker_object& ticker, share_type ticker_base, share_type ticker_quote,
+                                           bool in_base, const asset_object& base, const asset_object& quote );
+      static double ticker_price_to_real( const market_ticker_object& ticker, share_type ticker_base, share_type ticker_quote,
+                                          const asset_object& base, const asset_object& quote );
       order_book                         get_order_book( const string& base, const string& quote, unsigned limit = 50 )const;
       vector<market_trade>               get_trade_history( const string& base, const string& quote, fc::time_point_sec start, fc::time_point_sec stop, unsigned limit = 100 )const;
 
@@ -140,38 +159,57 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       vector<blinded_balance_object> get_blinded_balances( const flat_set<commitment_type>& commitments )const;
 
    //private:
+      /** Subscribes to changes of the object, and of the objects owned by it if it is an account. */
       template<typename T>
-      void subscribe_to_item( const T& i )const
+      void subscribe_to_item( const T& i )const { subscribe_to_object( i ); }
+      void subscribe_to_item( const vector<account_id_type>& accounts )const
       {
-         auto vec = fc::raw::pack(i);
-         if( !_subscribe_callback )
-            return;
-
-         if( !is_subscribed_to_item(i) )
-         {
-            idump((i));
-            _subscribe_filter.insert( vec.data(), vec.size() );//(vecconst char*)&i, sizeof(i) );
-         }
+         for( const auto& a : accounts )
+            subscribe_to_object( a );
       }
+      /** Subscribes to changes of the accounts which have the key in their owner or active authority or as memo key */
+      void subscribe_to_item( const public_key_type& key )const;
 
-      template<typename T>
-      bool is_subscribed_to_item( const T& i )const
-      {
-         if( !_subscribe_callback )
-            return false;
-         return true;
-         return _subscribe_filter.contains( i );
-      }
+      void subscribe_to_object( object_id_type id )const;
+      void unsubscribe_from_objects();
 
-      void broadcast_updates( const vector<variant>& updates );
+      /** sends the queued object updates as one notification, once the current block or transaction is done */
+      void queue_updates( std::shared_ptr< const vector<variant> > updates );
+      /** runs task, which serializes and sends notifications, on this connection's notification thread */
+      void notify( std::function<void()> task );
+      /** the notification thread of the next connection, null if there are none */
+      static fc::thread* next_notification_thread();
 
       /** called every time a block is applied to report the objects that were changed */
       void on_objects_changed(const vector<object_id_type>& ids);
       void on_objects_removed(const vector<const object*>& objs);
       void on_applied_block();
 
-      mutable fc::bloom_filter                               _subscribe_filter;
+      struct market_data_subscription
+      {
+         std::function<void(const variant&)>  callback;
+         uint64_t                             sequence = 0;
+         uint64_t                             book_revision = 0;
+         /** the book as last sent */
+         limit_order_book_index::level_map    levels;
+      };
+      const limit_order_book_index& get_order_book_index()const;
+      /** copies the levels of the market (a,b), a < b, in both directions */
+      limit_order_book_index::level_map get_market_levels( asset_id_type a, asset_id_type b )const;
+      void publish_market_data();
+
       std::function<void(const fc::variant&)> _subscribe_callback;
+      /** what this connection is subscribed to, see @ref subscription_router */
+      mutable flat_set<object_id_type>        _subscribed_ids;
+      mutable flat_set<public_key_type>       _subscribed_keys;
+      /** serialized changes not sent yet, shared with the other connections */
+      vector< std::shared_ptr< const vector<variant> > > _queued_updates;
+      bool                                    _sending_updates = false;
+      bool                                    _dropping_subscriptions = false;
+      /** guards the queued updates and the writes of _subscribe_callback, which the notification thread reads */
+      std::mutex                              _updates_mutex;
+      /** sends all notifications of this connection, in order; null to send them from the application thread */
+      fc::thread*                             _notification_thread = nullptr;
       std::function<void(const fc::variant&)> _pending_trx_callback;
       std::function<void(const fc::variant&)> _block_applied_callback;
 
@@ -180,7 +218,9 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       boost::signals2::scoped_connection                                                                                           _applied_block_connection;
       boost::signals2::scoped_connection                                                                                           _pending_trx_connection;
       map< pair<asset_id_type,asset_id_type>, std::function<void(const variant&)> >      _market_subscriptions;
+      map< pair<asset_id_type,asset_id_type>, market_data_subscription >                 _market_data_subscriptions;
       graphene::chain::database&                                                                                                            _db;
+      std::shared_ptr<const state_replica>                                               _replica;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -189,12 +229,13 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
 //                                                                  //
 //////////////////////////////////////////////////////////////////////
 
-database_api::database_api( graphene::chain::database& db )
-   : my( new database_api_impl( db ) ) {}
+database_api::database_api( graphene::chain::database& db, std::shared_ptr<const state_replica> replica )
+   : my( new database_api_impl( db, replica ) ) {}
 
 database_api::~database_api() {}
 
-database_api_impl::database_api_impl( graphene::chain::database& db ):_db(db)
+database_api_impl::database_api_impl( graphene::chain::database& db, std::shared_ptr<const state_replica> replica )
+   :_db(db), _replica(replica), _notification_thread( next_notification_thread() )
 {
    wlog("creating database api ${x}", ("x",int64_t(this)) );
    _change_connection = _db.changed_objects.connect([this](const vector<object_id_type>& ids) {
@@ -206,13 +247,18 @@ database_api_impl::database_api_impl( graphene::chain::database& db ):_db(db)
    _applied_block_connection = _db.applied_block.connect([this](const signed_block&){ on_applied_block(); });
 
    _pending_trx_connection = _db.on_pending_transaction.connect([this](const signed_transaction& trx ){
-                         if( _pending_trx_callback ) _pending_trx_callback( fc::variant(trx) );
+                         if( !_pending_trx_callback )
+                            return;
+                         auto capture_this = shared_from_this();
+                         auto callback = _pending_trx_callback;
+                         notify( [capture_this,callback,trx](){ callback( fc::variant(trx) ); } );
                       });
 }
 
 database_api_impl::~database_api_impl()
 {
    elog("freeing database api ${x}", ("x",int64_t(this)) );
+   unsubscribe_from_objects();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -223,6 +269,7 @@ database_api_impl::~database_api_impl()
 
 fc::variants database_api::get_objects(const vector<object_id_type>& ids)const
 {
+   api_call_timer timer( "database_api", "get_objects" );
    return my->get_objects( ids );
 }
 
@@ -245,9 +292,15 @@ fc::variants database_api_impl::get_objects(const vector<object_id_type>& ids)co
    fc::variants result;
    result.reserve(ids.size());
 
+   // the version stays valid while it is held, whatever blocks are applied meanwhile
+   std::shared_ptr<const state_replica::version> replicated;
+   if( _replica )
+      replicated = _replica->current();
+
    std::transform(ids.begin(), ids.end(), std::back_inserter(result),
-                  [this](object_id_type id) -> fc::variant {
-      if(auto obj = _db.find_object(id))
+                  [&](object_id_type id) -> fc::variant {
+      const object* obj = replicated && _replica->replicates( id ) ? replicated->find( id ) : _db.find_object( id );
+      if( obj )
          return obj->to_variant();
       return {};
    });
@@ -255,6 +308,37 @@ fc::variants database_api_impl::get_objects(const vector<object_id_type>& ids)co
    return result;
 }
 
+vector<versioned_object> database_api::get_versioned_objects( const vector<object_id_type>& ids,
+                                                              const vector<uint64_t>& known_versions )const
+{
+   api_call_timer timer( "database_api", "get_versioned_objects" );
+   return my->get_versioned_objects( ids, known_versions );
+}
+
+vector<versioned_object> database_api_impl::get_versioned_objects( const vector<object_id_type>& ids,
+                                                                   const vector<uint64_t>& known_versions )const
+{
+   FC_ASSERT( known_versions.empty() || known_versions.size() == ids.size(),
+              "Expected no known versions or one for each object" );
+
+   std::shared_ptr<const state_replica::version> replicated;
+   if( _replica )
+      replicated = _replica->current();
+
+   vector<versioned_object> result( ids.size() );
+   for( size_t i = 0; i < ids.size(); ++i )
+   {
+      const object_id_type id = ids[i];
+      const object* obj = replicated && _replica->replicates( id ) ? replicated->find( id ) : _db.find_object( id );
+      if( obj == nullptr )
+         continue;
+      result[i].version = obj->version;
+      if( known_versions.empty() || known_versions[i] != obj->version )
+         result[i].value = obj->to_variant();
+   }
+   return result;
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Subscriptions                                                    //
@@ -263,26 +347,24 @@ fc::variants database_api_impl::get_objects(const vector<object_id_type>& ids)co
 
 void database_api::set_subscribe_callback( std::function<void(const variant&)> cb, bool clear_filter )
 {
+   api_call_timer timer( "database_api", "set_subscribe_callback" );
    my->set_subscribe_callback( cb, clear_filter );
 }
 
 void database_api_impl::set_subscribe_callback( std::function<void(const variant&)> cb, bool clear_filter )
 {
    edump((clear_filter));
-   _subscribe_callback = cb;
-   if( clear_filter || !cb )
    {
-      static fc::bloom_parameters param;
-      param.projected_element_count    = 10000;
-      param.false_positive_probability = 1.0/10000;
-      param.maximum_size = 1024*8*8*2;
-      param.compute_optimal_parameters();
-      _subscribe_filter = fc::bloom_filter(param);
+      std::lock_guard<std::mutex> guard( _updates_mutex );
+      _subscribe_callback = cb;
    }
+   if( clear_filter || !cb )
+      unsubscribe_from_objects();
 }
 
 void database_api::set_pending_transaction_callback( std::function<void(const variant&)> cb )
 {
+   api_call_timer timer( "database_api", "set_pending_transaction_callback" );
    my->set_pending_transaction_callback( cb );
 }
 
@@ -293,6 +375,7 @@ void database_api_impl::set_pending_transaction_callback( std::function<void(con
 
 void database_api::set_block_applied_callback( std::function<void(const variant& block_id)> cb )
 {
+   api_call_timer timer( "database_api", "set_block_applied_callback" );
    my->set_block_applied_callback( cb );
 }
 
@@ -303,6 +386,7 @@ void database_api_impl::set_block_applied_callback( std::function<void(const var
 
 void database_api::cancel_all_subscriptions()
 {
+   api_call_timer timer( "database_api", "cancel_all_subscriptions" );
    my->cancel_all_subscriptions();
 }
 
@@ -310,6 +394,7 @@ void database_api_impl::cancel_all_subscriptions()
 {
    set_subscribe_callback( std::function<void(const fc::variant&)>(), true);
    _market_subscriptions.clear();
+   _market_data_subscriptions.clear();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -320,6 +405,7 @@ void database_api_impl::cancel_all_subscriptions()
 
 optional<block_header> database_api::get_block_header(uint32_t block_num)const
 {
+   api_call_timer timer( "database_api", "get_block_header" );
    return my->get_block_header( block_num );
 }
 
@@ -333,6 +419,7 @@ optional<block_header> database_api_impl::get_block_header(uint32_t block_num) c
 
 optional<signed_block> database_api::get_block(uint32_t block_num)const
 {
+   api_call_timer timer( "database_api", "get_block" );
    return my->get_block( block_num );
 }
 
@@ -343,11 +430,13 @@ optional<signed_block> database_api_impl::get_block(uint32_t block_num)const
 
 processed_transaction database_api::get_transaction( uint32_t block_num, uint32_t trx_in_block )const
 {
+   api_call_timer timer( "database_api", "get_transaction" );
    return my->get_transaction( block_num, trx_in_block );
 }
 
 optional<signed_transaction> database_api::get_recent_transaction_by_id( const transaction_id_type& id )const
 {
+   api_call_timer timer( "database_api", "get_recent_transaction_by_id" );
    try {
       return my->_db.get_recent_transaction( id );
    } catch ( ... ) {
@@ -371,6 +460,7 @@ processed_transaction database_api_impl::get_transaction(uint32_t block_num, uin
 
 chain_property_object database_api::get_chain_properties()const
 {
+   api_call_timer timer( "database_api", "get_chain_properties" );
    return my->get_chain_properties();
 }
 
@@ -381,6 +471,7 @@ chain_property_object database_api_impl::get_chain_properties()const
 
 global_property_object database_api::get_global_properties()const
 {
+   api_call_timer timer( "database_api", "get_global_properties" );
    return my->get_global_properties();
 }
 
@@ -391,6 +482,7 @@ global_property_object database_api_impl::get_global_properties()const
 
 fc::variant_object database_api::get_config()const
 {
+   api_call_timer timer( "database_api", "get_config" );
    return my->get_config();
 }
 
@@ -401,6 +493,7 @@ fc::variant_object database_api_impl::get_config()const
 
 chain_id_type database_api::get_chain_id()const
 {
+   api_call_timer timer( "database_api", "get_chain_id" );
    return my->get_chain_id();
 }
 
@@ -411,6 +504,7 @@ chain_id_type database_api_impl::get_chain_id()const
 
 dynamic_global_property_object database_api::get_dynamic_global_properties()const
 {
+   api_call_timer timer( "database_api", "get_dynamic_global_properties" );
    return my->get_dynamic_global_properties();
 }
 
@@ -427,6 +521,7 @@ dynamic_global_property_object database_api_impl::get_dynamic_global_properties(
 
 vector<vector<account_id_type>> database_api::get_key_references( vector<public_key_type> key )const
 {
+   api_call_timer timer( "database_api", "get_key_references" );
    return my->get_key_references( key );
 }
 
@@ -439,40 +534,30 @@ vector<vector<account_id_type>> database_api_impl::get_key_references( vector<pu
    vector< vector<account_id_type> > final_result;
    final_result.reserve(keys.size());
 
+   const auto& idx = _db.get_index_type<account_index>();
+   const auto& aidx = dynamic_cast<const primary_index<account_index>&>(idx);
+   const auto& refs = aidx.get_secondary_index<graphene::chain::account_member_index>();
+
    for( auto& key : keys )
    {
-
-      address a1( pts_address(key, false, 56) );
-      address a2( pts_address(key, true, 56) );
-      address a3( pts_address(key, false, 0)  );
-      address a4( pts_address(key, true, 0)  );
-      address a5( key );
-
       subscribe_to_item( key );
-      subscribe_to_item( a1 );
-      subscribe_to_item( a2 );
-      subscribe_to_item( a3 );
-      subscribe_to_item( a4 );
-      subscribe_to_item( a5 );
-
-      const auto& idx = _db.get_index_type<account_index>();
-      const auto& aidx = dynamic_cast<const primary_index<account_index>&>(idx);
-      const auto& refs = aidx.get_secondary_index<graphene::chain::account_member_index>();
+
       auto itr = refs.account_to_key_memberships.find(key);
       vector<account_id_type> result;
 
-      for( auto& a : {a1,a2,a3,a4,a5} )
+      // address authorities only come from the genesis block, most chains have none and skip hashing the addresses
+      if( !refs.account_to_address_memberships.empty() )
       {
-          auto itr = refs.account_to_address_memberships.find(a);
-          if( itr != refs.account_to_address_memberships.end() )
-          {
-             result.reserve( itr->second.size() );
-             for( auto item : itr->second )
+         for( const auto& a : key_addresses( key ) )
+         {
+             auto itr = refs.account_to_address_memberships.find(a);
+             if( itr != refs.account_to_address_memberships.end() )
              {
-                wdump((a)(item)(item(_db).name));
-                result.push_back(item);
+                result.reserve( itr->second.size() );
+                for( auto item : itr->second )
+                   result.push_back(item);
              }
-          }
+         }
       }
 
       if( itr != refs.account_to_key_memberships.end() )
@@ -497,6 +582,7 @@ vector<vector<account_id_type>> database_api_impl::get_key_references( vector<pu
 
 vector<optional<account_object>> database_api::get_accounts(const vector<account_id_type>& account_ids)const
 {
+   api_call_timer timer( "database_api", "get_accounts" );
    return my->get_accounts( account_ids );
 }
 
@@ -517,114 +603,217 @@ vector<optional<account_object>> database_api_impl::get_accounts(const vector<ac
 
 std::map<string,full_account> database_api::get_full_accounts( const vector<string>& names_or_ids, bool subscribe )
 {
+   api_call_timer timer( "database_api", "get_full_accounts" );
    return my->get_full_accounts( names_or_ids, subscribe );
 }
 
+namespace {
+   vector< std::unique_ptr<fc::thread> >& read_threads()
+   {
+      static vector< std::unique_ptr<fc::thread> > threads;
+      return threads;
+   }
+
+   uint32_t& max_queued_notifications()
+   {
+      static uint32_t batches = 0;
+      return batches;
+   }
+
+   vector< std::unique_ptr<fc::thread> >& notification_threads()
+   {
+      static vector< std::unique_ptr<fc::thread> > threads;
+      return threads;
+   }
+}
+
+void database_api::set_notification_threads( uint32_t thread_count )
+{
+   notification_threads().clear();
+   for( uint32_t i = 0; i < thread_count; ++i )
+      notification_threads().emplace_back( new fc::thread( "database api notify " + fc::to_string( i ) ) );
+}
+
+fc::thread* database_api_impl::next_notification_thread()
+{
+   const auto& threads = notification_threads();
+   if( threads.empty() )
+      return nullptr;
+   static std::atomic<uint32_t> next_thread( 0 );
+   return threads[ next_thread++ % threads.size() ].get();
+}
+
+void database_api_impl::notify( std::function<void()> task )
+{
+   if( _notification_thread != nullptr )
+      _notification_thread->async( task, "api notification" );
+   else
+      fc::async( task );
+}
+
+void database_api::set_read_threads( uint32_t thread_count )
+{
+   read_threads().clear();
+   for( uint32_t i = 0; i < thread_count; ++i )
+      read_threads().emplace_back( new fc::thread( "database api read " + fc::to_string( i ) ) );
+}
+
+void database_api::run_on_read_thread( const graphene::chain::database& db, const std::function<void()>& read )
+{
+   const auto& threads = read_threads();
+   if( threads.empty() )
+   {
+      read();
+      return;
+   }
+   static std::atomic<uint32_t> next_thread( 0 );
+   threads[ next_thread++ % threads.size() ]->async( [&]() {
+      auto lock = db.lock_state_for_reading();
+      read();
+   }, "api read" ).wait();
+}
+
 std::map<std::string, full_account> database_api_impl::get_full_accounts( const vector<std::string>& names_or_ids, bool subscribe)
 {
    idump((names_or_ids));
-   std::map<std::string, full_account> results;
+   vector< optional<full_account> > accounts( names_or_ids.size() );
 
-   for (const std::string& account_name_or_id : names_or_ids)
+   // a few accounts are not worth the hand over to the read threads
+   const auto& threads = read_threads();
+   const size_t workers = std::min( threads.size(), names_or_ids.size() / 4 );
+   if( workers < 2 )
    {
-      const account_object* account = nullptr;
-      if (std::isdigit(account_name_or_id[0]))
-         account = _db.find(fc::variant(account_name_or_id).as<account_id_type>());
-      else
-      {
-         const auto& idx = _db.get_index_type<account_index>().indices().get<by_name>();
-         auto itr = idx.find(account_name_or_id);
-         if (itr != idx.end())
-            account = &*itr;
-      }
-      if (account == nullptr)
-         continue;
+      for( size_t i = 0; i < names_or_ids.size(); ++i )
+         accounts[i] = get_full_account( names_or_ids[i] );
+   }
+   else
+   {
+      vector< optional<fc::exception> > errors( workers );
+      vector< fc::future<void> > done;
+      done.reserve( workers );
+      for( size_t w = 0; w < workers; ++w )
+         done.push_back( threads[w]->async( [&,w]() {
+            try
+            {
+               auto lock = _db.lock_state_for_reading();
+               for( size_t i = w; i < names_or_ids.size(); i += workers )
+                  accounts[i] = get_full_account( names_or_ids[i] );
+            }
+            catch( const fc::exception& e )
+            {
+               errors[w] = e;
+            }
+         }, "get_full_accounts" ) );
+      for( auto& d : done )
+         d.wait();
+      for( const auto& e : errors )
+         if( e.valid() )
+            throw *e;
+   }
 
+   std::map<std::string, full_account> results;
+   for( size_t i = 0; i < names_or_ids.size(); ++i )
+   {
+      if( !accounts[i].valid() )
+         continue;
       if( subscribe )
       {
-         ilog( "subscribe to ${id}", ("id",account->name) );
-         subscribe_to_item( account->id );
-      }
-
-      // fc::mutable_variant_object full_account;
-      full_account acnt;
-      acnt.account = *account;
-      acnt.statistics = account->statistics(_db);
-      acnt.registrar_name = account->registrar(_db).name;
-      acnt.referrer_name = account->referrer(_db).name;
-      acnt.lifetime_referrer_name = account->lifetime_referrer(_db).name;
-      acnt.votes = lookup_vote_ids( vector<vote_id_type>(account->options.votes.begin(),account->options.votes.end()) );
-
-      // Add the account itself, its statistics object, cashback balance, and referral account names
-      /*
-      full_account("account", *account)("statistics", account->statistics(_db))
-            ("registrar_name", account->registrar(_db).name)("referrer_name", account->referrer(_db).name)
-            ("lifetime_referrer_name", account->lifetime_referrer(_db).name);
-            */
-      if (account->cashback_vb)
-      {
-         acnt.cashback_balance = account->cashback_balance(_db);
+         ilog( "subscribe to ${id}", ("id",accounts[i]->account.name) );
+         subscribe_to_item( accounts[i]->account.id );
       }
-      // Add the account's proposals
-      const auto& proposal_idx = _db.get_index_type<proposal_index>();
-      const auto& pidx = dynamic_cast<const primary_index<proposal_index>&>(proposal_idx);
-      const auto& proposals_by_account = pidx.get_secondary_index<graphene::chain::required_approval_index>();
-      auto  required_approvals_itr = proposals_by_account._account_to_proposals.find( account->id );
-      if( required_approvals_itr != proposals_by_account._account_to_proposals.end() )
-      {
-         acnt.proposals.reserve( required_approvals_itr->second.size() );
-         for( auto proposal_id : required_approvals_itr->second )
-            acnt.proposals.push_back( proposal_id(_db) );
-      }
-
+      results[names_or_ids[i]] = std::move( *accounts[i] );
+   }
+   return results;
+}
 
-      // Add the account's balances
-      auto balance_range = _db.get_index_type<account_balance_index>().indices().get<by_account_asset>().equal_range(boost::make_tuple(account->id));
-      //vector<account_balance_object> balances;
-      std::for_each(balance_range.first, balance_range.second,
-                    [&acnt](const account_balance_object& balance) {
-                       acnt.balances.emplace_back(balance);
-                    });
+optional<full_account> database_api_impl::get_full_account( const string& account_name_or_id )const
+{
+   const account_object* account = nullptr;
+   if (std::isdigit(account_name_or_id[0]))
+      account = _db.find(fc::variant(account_name_or_id).as<account_id_type>());
+   else
+      account = _db.account_names().find(account_name_or_id);
+   if (account == nullptr)
+      return optional<full_account>();
+
+   // fc::mutable_variant_object full_account;
+   full_account acnt;
+   acnt.account = *account;
+   acnt.statistics = account->statistics(_db);
+   acnt.registrar_name = account->registrar(_db).name;
+   acnt.referrer_name = account->referrer(_db).name;
+   acnt.lifetime_referrer_name = account->lifetime_referrer(_db).name;
+   acnt.votes = lookup_vote_ids( vector<vote_id_type>(account->options.votes.begin(),account->options.votes.end()) );
+
+   // Add the account itself, its statistics object, cashback balance, and referral account names
+   /*
+   full_account("account", *account)("statistics", account->statistics(_db))
+         ("registrar_name", account->registrar(_db).name)("referrer_name", account->referrer(_db).name)
+         ("lifetime_referrer_name", account->lifetime_referrer(_db).name);
+         */
+   if (account->cashback_vb)
+   {
+      acnt.cashback_balance = account->cashback_balance(_db);
+   }
+   // Add the account's proposals
+   const auto& proposal_idx = _db.get_index_type<proposal_index>();
+   const auto& pidx = dynamic_cast<const primary_index<proposal_index>&>(proposal_idx);
+   const auto& proposals_by_account = pidx.get_secondary_index<graphene::chain::required_approval_index>();
+   auto  required_approvals_itr = proposals_by_account._account_to_proposals.find( account->id );
+   if( required_approvals_itr != proposals_by_account._account_to_proposals.end() )
+   {
+      acnt.proposals.reserve( required_approvals_itr->second.size() );
+      for( auto proposal_id : required_approvals_itr->second )
+         acnt.proposals.push_back( proposal_id(_db) );
+   }
 
-      // Add the account's vesting balances
-      auto vesting_range = _db.get_index_type<vesting_balance_index>().indices().get<by_account>().equal_range(account->id);
-      std::for_each(vesting_range.first, vesting_range.second,
-                    [&acnt](const vesting_balance_object& balance) {
-                       acnt.vesting_balances.emplace_back(balance);
-                    });
 
-      // Add the account's orders
-      auto order_range = _db.get_index_type<limit_order_index>().indices().get<by_account>().equal_range(account->id);
-      std::for_each(order_range.first, order_range.second,
-                    [&acnt] (const limit_order_object& order) {
-                       acnt.limit_orders.emplace_back(order);
-                    });
-      auto call_range = _db.get_index_type<call_order_index>().indices().get<by_account>().equal_range(account->id);
-      std::for_each(call_range.first, call_range.second,
-                    [&acnt] (const call_order_object& call) {
-                       acnt.call_orders.emplace_back(call);
-                    });
-      results[account_name_or_id] = acnt;
-   }
-   return results;
+   // Add the account's balances
+   auto balance_range = _db.get_index_type<account_balance_index>().indices().get<by_account_asset>().equal_range(boost::make_tuple(account->id));
+   //vector<account_balance_object> balances;
+   std::for_each(balance_range.first, balance_range.second,
+                 [&acnt](const account_balance_object& balance) {
+                    acnt.balances.emplace_back(balance);
+                 });
+
+   // Add the account's vesting balances
+   auto vesting_range = _db.get_index_type<vesting_balance_index>().indices().get<by_account>().equal_range(account->id);
+   std::for_each(vesting_range.first, vesting_range.second,
+                 [&acnt](const vesting_balance_object& balance) {
+                    acnt.vesting_balances.emplace_back(balance);
+                 });
+
+   // Add the account's orders
+   auto order_range = _db.get_index_type<limit_order_index>().indices().get<by_account>().equal_range(account->id);
+   std::for_each(order_range.first, order_range.second,
+                 [&acnt] (const limit_order_object& order) {
+                    acnt.limit_orders.emplace_back(order);
+                 });
+   auto call_range = _db.get_index_type<call_order_index>().indices().get<by_account>().equal_range(account->id);
+   std::for_each(call_range.first, call_range.second,
+                 [&acnt] (const call_order_object& call) {
+                    acnt.call_orders.emplace_back(call);
+                 });
+   return acnt;
 }
 
 optional<account_object> database_api::get_account_by_name( string name )const
 {
+   api_call_timer timer( "database_api", "get_account_by_name" );
    return my->get_account_by_name( name );
 }
 
 optional<account_object> database_api_impl::get_account_by_name( string name )const
 {
-   const auto& idx = _db.get_index_type<account_index>().indices().get<by_name>();
-   auto itr = idx.find(name);
-   if (itr != idx.end())
-      return *itr;
+   const account_object* account = _db.account_names().find(name);
+   if (account != nullptr)
+      return *account;
    return optional<account_object>();
 }
 
 vector<account_id_type> database_api::get_account_references( account_id_type account_id )const
 {
+   api_call_timer timer( "database_api", "get_account_references" );
    return my->get_account_references( account_id );
 }
 
@@ -646,24 +835,26 @@ vector<account_id_type> database_api_impl::get_account_references( account_id_ty
 
 vector<optional<account_object>> database_api::lookup_account_names(const vector<string>& account_names)const
 {
+   api_call_timer timer( "database_api", "lookup_account_names" );
    return my->lookup_account_names( account_names );
 }
 
 vector<optional<account_object>> database_api_impl::lookup_account_names(const vector<string>& account_names)const
 {
-   const auto& accounts_by_name = _db.get_index_type<account_index>().indices().get<by_name>();
+   const auto& accounts_by_name = _db.account_names();
    vector<optional<account_object> > result;
    result.reserve(account_names.size());
    std::transform(account_names.begin(), account_names.end(), std::back_inserter(result),
                   [&accounts_by_name](const string& name) -> optional<account_object> {
-      auto itr = accounts_by_name.find(name);
-      return itr == accounts_by_name.end()? optional<account_object>() : *itr;
+      const account_object* account = accounts_by_name.find(name);
+      return account == nullptr? optional<account_object>() : *account;
    });
    return result;
 }
 
 map<string,account_id_type> database_api::lookup_accounts(const string& lower_bound_name, uint32_t limit)const
 {
+   api_call_timer timer( "database_api", "lookup_accounts" );
    return my->lookup_accounts( lower_bound_name, limit );
 }
 
@@ -685,8 +876,30 @@ map<string,account_id_type> database_api_impl::lookup_accounts(const string& low
    return result;
 }
 
+map<string,account_id_type> database_api::lookup_accounts_by_prefix(const string& prefix, uint32_t limit)const
+{
+   api_call_timer timer( "database_api", "lookup_accounts_by_prefix" );
+   return my->lookup_accounts_by_prefix( prefix, limit );
+}
+
+map<string,account_id_type> database_api_impl::lookup_accounts_by_prefix(const string& prefix, uint32_t limit)const
+{
+   FC_ASSERT( limit <= 1000 );
+   const auto& accounts_by_name = _db.get_index_type<account_index>().indices().get<by_name>();
+   map<string,account_id_type> result;
+
+   // names with the prefix are contiguous in the index, so this stops at the first one without it
+   for( auto itr = accounts_by_name.lower_bound( prefix );
+        result.size() < limit && itr != accounts_by_name.end() && itr->name.compare( 0, prefix.size(), prefix ) == 0;
+        ++itr )
+      result.emplace_hint( result.end(), itr->name, itr->get_id() );
+
+   return result;
+}
+
 uint64_t database_api::get_account_count()const
 {
+   api_call_timer timer( "database_api", "get_account_count" );
    return my->get_account_count();
 }
 
@@ -703,6 +916,7 @@ uint64_t database_api_impl::get_account_count()const
 
 vector<asset> database_api::get_account_balances(account_id_type id, const flat_set<asset_id_type>& assets)const
 {
+   api_call_timer timer( "database_api", "get_account_balances" );
    return my->get_account_balances( id, assets );
 }
 
@@ -730,19 +944,20 @@ vector<asset> database_api_impl::get_account_balances(account_id_type acnt, cons
 
 vector<asset> database_api::get_named_account_balances(const std::string& name, const flat_set<asset_id_type>& assets)const
 {
+   api_call_timer timer( "database_api", "get_named_account_balances" );
    return my->get_named_account_balances( name, assets );
 }
 
 vector<asset> database_api_impl::get_named_account_balances(const std::string& name, const flat_set<asset_id_type>& assets) const
 {
-   const auto& accounts_by_name = _db.get_index_type<account_index>().indices().get<by_name>();
-   auto itr = accounts_by_name.find(name);
-   FC_ASSERT( itr != accounts_by_name.end() );
-   return get_account_balances(itr->get_id(), assets);
+   const account_object* account = _db.account_names().find(name);
+   FC_ASSERT( account != nullptr );
+   return get_account_balances(account->get_id(), assets);
 }
 
 vector<balance_object> database_api::get_balance_objects( const vector<address>& addrs )const
 {
+   api_call_timer timer( "database_api", "get_balance_objects" );
    return my->get_balance_objects( addrs );
 }
 
@@ -757,10 +972,11 @@ vector<balance_object> database_api_impl::get_balance_objects( const vector<addr
 
       for( const auto& owner : addrs )
       {
-         subscribe_to_item( owner );
+         // balance objects are only created by the genesis block, so the ones found are all there will ever be
          auto itr = by_owner_idx.lower_bound( boost::make_tuple( owner, asset_id_type(0) ) );
          while( itr != by_owner_idx.end() && itr->owner == owner )
          {
+            subscribe_to_item( itr->id );
             result.push_back( *itr );
             ++itr;
          }
@@ -772,6 +988,7 @@ vector<balance_object> database_api_impl::get_balance_objects( const vector<addr
 
 vector<asset> database_api::get_vested_balances( const vector<balance_id_type>& objs )const
 {
+   api_call_timer timer( "database_api", "get_vested_balances" );
    return my->get_vested_balances( objs );
 }
 
@@ -790,6 +1007,7 @@ vector<asset> database_api_impl::get_vested_balances( const vector<balance_id_ty
 
 vector<vesting_balance_object> database_api::get_vesting_balances( account_id_type account_id )const
 {
+   api_call_timer timer( "database_api", "get_vesting_balances" );
    return my->get_vesting_balances( account_id );
 }
 
@@ -808,6 +1026,24 @@ vector<vesting_balance_object> database_api_impl::get_vesting_balances( account_
    FC_CAPTURE_AND_RETHROW( (account_id) );
 }
 
+vector<asset> database_api::get_allowed_vesting_withdraws( const vector<vesting_balance_id_type>& ids )const
+{
+   api_call_timer timer( "database_api", "get_allowed_vesting_withdraws" );
+   return my->get_allowed_vesting_withdraws( ids );
+}
+
+vector<asset> database_api_impl::get_allowed_vesting_withdraws( const vector<vesting_balance_id_type>& ids )const
+{
+   try
+   {
+      vector<const vesting_balance_object*> balances;
+      balances.reserve( ids.size() );
+      for( auto id : ids )
+         balances.push_back( &id(_db) );
+      return get_allowed_withdraws( balances, _db.head_block_time() );
+   } FC_CAPTURE_AND_RETHROW( (ids) )
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Assets                                                           //
@@ -816,6 +1052,7 @@ vector<vesting_balance_object> database_api_impl::get_vesting_balances( account_
 
 vector<optional<asset_object>> database_api::get_assets(const vector<asset_id_type>& asset_ids)const
 {
+   api_call_timer timer( "database_api", "get_assets" );
    return my->get_assets( asset_ids );
 }
 
@@ -836,6 +1073,7 @@ vector<optional<asset_object>> database_api_impl::get_assets(const vector<asset_
 
 vector<asset_object> database_api::list_assets(const string& lower_bound_symbol, uint32_t limit)const
 {
+   api_call_timer timer( "database_api", "list_assets" );
    return my->list_assets( lower_bound_symbol, limit );
 }
 
@@ -857,14 +1095,35 @@ vector<asset_object> database_api_impl::list_assets(const string& lower_bound_sy
    return result;
 }
 
+vector<asset_object> database_api::list_assets_by_prefix(const string& prefix, uint32_t limit)const
+{
+   api_call_timer timer( "database_api", "list_assets_by_prefix" );
+   return my->list_assets_by_prefix( prefix, limit );
+}
+
+vector<asset_object> database_api_impl::list_assets_by_prefix(const string& prefix, uint32_t limit)const
+{
+   FC_ASSERT( limit <= 100 );
+   const auto& assets_by_symbol = _db.get_index_type<asset_index>().indices().get<by_symbol>();
+   vector<asset_object> result;
+
+   for( auto itr = assets_by_symbol.lower_bound( prefix );
+        result.size() < limit && itr != assets_by_symbol.end() && itr->symbol.compare( 0, prefix.size(), prefix ) == 0;
+        ++itr )
+      result.emplace_back( *itr );
+
+   return result;
+}
+
 vector<optional<asset_object>> database_api::lookup_asset_symbols(const vector<string>& symbols_or_ids)const
 {
+   api_call_timer timer( "database_api", "lookup_asset_symbols" );
    return my->lookup_asset_symbols( symbols_or_ids );
 }
 
 vector<optional<asset_object>> database_api_impl::lookup_asset_symbols(const vector<string>& symbols_or_ids)const
 {
-   const auto& assets_by_symbol = _db.get_index_type<asset_index>().indices().get<by_symbol>();
+   const auto& assets_by_symbol = _db.asset_symbols();
    vector<optional<asset_object> > result;
    result.reserve(symbols_or_ids.size());
    std::transform(symbols_or_ids.begin(), symbols_or_ids.end(), std::back_inserter(result),
@@ -872,10 +1131,16 @@ vector<optional<asset_object>> database_api_impl::lookup_asset_symbols(const vec
       if( !symbol_or_id.empty() && std::isdigit(symbol_or_id[0]) )
       {
          auto ptr = _db.find(variant(symbol_or_id).as<asset_id_type>());
-         return ptr == nullptr? optional<asset_object>() : *ptr;
+         if( ptr == nullptr )
+            return optional<asset_object>();
+         subscribe_to_item( ptr->id );
+         return *ptr;
       }
-      auto itr = assets_by_symbol.find(symbol_or_id);
-      return itr == assets_by_symbol.end()? optional<asset_object>() : *itr;
+      const asset_object* asset_obj = assets_by_symbol.find(symbol_or_id);
+      if( asset_obj == nullptr )
+         return optional<asset_object>();
+      subscribe_to_item( asset_obj->id );
+      return *asset_obj;
    });
    return result;
 }
@@ -888,6 +1153,7 @@ vector<optional<asset_object>> database_api_impl::lookup_asset_symbols(const vec
 
 vector<limit_order_object> database_api::get_limit_orders(asset_id_type a, asset_id_type b, uint32_t limit)const
 {
+   api_call_timer timer( "database_api", "get_limit_orders" );
    return my->get_limit_orders( a, b, limit );
 }
 
@@ -896,35 +1162,30 @@ vector<limit_order_object> database_api::get_limit_orders(asset_id_type a, asset
  */
 vector<limit_order_object> database_api_impl::get_limit_orders(asset_id_type a, asset_id_type b, uint32_t limit)const
 {
-   const auto& limit_order_idx = _db.get_index_type<limit_order_index>();
-   const auto& limit_price_idx = limit_order_idx.indices().get<by_price>();
+   const auto& books = _db.limit_order_books();
 
    vector<limit_order_object> result;
 
-   uint32_t count = 0;
-   auto limit_itr = limit_price_idx.lower_bound(price::max(a,b));
-   auto limit_end = limit_price_idx.upper_bound(price::min(a,b));
-   while(limit_itr != limit_end && count < limit)
+   // each side of the book from the best price on
+   auto add_side = [&]( asset_id_type sell, asset_id_type receive )
    {
-      result.push_back(*limit_itr);
-      ++limit_itr;
-      ++count;
-   }
-   count = 0;
-   limit_itr = limit_price_idx.lower_bound(price::max(b,a));
-   limit_end = limit_price_idx.upper_bound(price::min(b,a));
-   while(limit_itr != limit_end && count < limit)
-   {
-      result.push_back(*limit_itr);
-      ++limit_itr;
-      ++count;
-   }
+      const limit_order_match_index::side* levels = books.find_side( sell, receive );
+      if( levels == nullptr )
+         return;
+      uint32_t count = 0;
+      for( auto level = levels->rbegin(); level != levels->rend() && count < limit; ++level )
+         for( auto itr = level->orders.begin(); itr != level->orders.end() && count < limit; ++itr, ++count )
+            result.push_back( **itr );
+   };
+   add_side( a, b );
+   add_side( b, a );
 
    return result;
 }
 
 vector<call_order_object> database_api::get_call_orders(asset_id_type a, uint32_t limit)const
 {
+   api_call_timer timer( "database_api", "get_call_orders" );
    return my->get_call_orders( a, limit );
 }
 
@@ -940,6 +1201,7 @@ vector<call_order_object> database_api_impl::get_call_orders(asset_id_type a, ui
 
 vector<force_settlement_object> database_api::get_settle_orders(asset_id_type a, uint32_t limit)const
 {
+   api_call_timer timer( "database_api", "get_settle_orders" );
    return my->get_settle_orders( a, limit );
 }
 
@@ -953,6 +1215,7 @@ vector<force_settlement_object> database_api_impl::get_settle_orders(asset_id_ty
 
 vector<call_order_object> database_api::get_margin_positions( const account_id_type& id )const
 {
+   api_call_timer timer( "database_api", "get_margin_positions" );
    return my->get_margin_positions( id );
 }
 
@@ -976,6 +1239,7 @@ vector<call_order_object> database_api_impl::get_margin_positions( const account
 
 void database_api::subscribe_to_market(std::function<void(const variant&)> callback, asset_id_type a, asset_id_type b)
 {
+   api_call_timer timer( "database_api", "subscribe_to_market" );
    my->subscribe_to_market( callback, a, b );
 }
 
@@ -983,11 +1247,14 @@ void database_api_impl::subscribe_to_market(std::function<void(const variant&)>
 {
    if(a > b) std::swap(a,b);
    FC_ASSERT(a != b);
+   // the fills are taken from the applied operations, which trusted blocks only record for those who ask
+   _db.require_applied_operations();
    _market_subscriptions[ std::make_pair(a,b) ] = callback;
 }
 
 void database_api::unsubscribe_from_market(asset_id_type a, asset_id_type b)
 {
+   api_call_timer timer( "database_api", "unsubscribe_from_market" );
    my->unsubscribe_from_market( a, b );
 }
 
@@ -998,8 +1265,70 @@ void database_api_impl::unsubscribe_from_market(asset_id_type a, asset_id_type b
    _market_subscriptions.erase(std::make_pair(a,b));
 }
 
+market_data_update database_api::subscribe_to_market_data( std::function<void(const variant&)> callback,
+                                                          asset_id_type a, asset_id_type b )
+{
+   api_call_timer timer( "database_api", "subscribe_to_market_data" );
+   return my->subscribe_to_market_data( callback, a, b );
+}
+
+market_data_update database_api_impl::subscribe_to_market_data( std::function<void(const variant&)> callback,
+                                                               asset_id_type a, asset_id_type b )
+{
+   if( a > b ) std::swap( a, b );
+   FC_ASSERT( a != b );
+   // see subscribe_to_market()
+   _db.require_applied_operations();
+
+   market_data_subscription& sub = _market_data_subscriptions[ std::make_pair( a, b ) ];
+   sub.callback = callback;
+   sub.sequence = 0;
+   sub.book_revision = get_order_book_index().market_revision( std::make_pair( a, b ) );
+   sub.levels = get_market_levels( a, b );
+
+   market_data_update result;
+   result.base = a;
+   result.quote = b;
+   result.block_num = _db.head_block_num();
+   result.time = _db.head_block_time();
+   result.levels.reserve( sub.levels.size() );
+   for( const auto& level : sub.levels )
+      result.levels.push_back( level.second );
+   return result;
+}
+
+void database_api::unsubscribe_from_market_data( asset_id_type a, asset_id_type b )
+{
+   api_call_timer timer( "database_api", "unsubscribe_from_market_data" );
+   my->unsubscribe_from_market_data( a, b );
+}
+
+void database_api_impl::unsubscribe_from_market_data( asset_id_type a, asset_id_type b )
+{
+   if( a > b ) std::swap( a, b );
+   FC_ASSERT( a != b );
+   _market_data_subscriptions.erase( std::make_pair( a, b ) );
+}
+
+const limit_order_book_index& database_api_impl::get_order_book_index()const
+{
+   const auto& idx = _db.get_index_type<limit_order_index>();
+   const auto& pidx = dynamic_cast<const primary_index<limit_order_index>&>(idx);
+   return pidx.get_secondary_index<graphene::chain::limit_order_book_index>();
+}
+
+limit_order_book_index::level_map database_api_impl::get_market_levels( asset_id_type a, asset_id_type b )const
+{
+   const auto& levels = get_order_book_index().levels();
+   limit_order_book_index::level_map result;
+   result.insert( levels.lower_bound( price::max( a, b ) ), levels.upper_bound( price::min( a, b ) ) );
+   result.insert( levels.lower_bound( price::max( b, a ) ), levels.upper_bound( price::min( b, a ) ) );
+   return result;
+}
+
 market_ticker database_api::get_ticker( const string& base, const string& quote )const
 {
+   api_call_timer timer( "database_api", "get_ticker" );
    return my->get_ticker( base, quote );
 }
 
@@ -1009,56 +1338,44 @@ market_ticker database_api_impl::get_ticker( const string& base, const string& q
    FC_ASSERT( assets[0], "Invalid base asset symbol: ${s}", ("s",base) );
    FC_ASSERT( assets[1], "Invalid quote asset symbol: ${s}", ("s",quote) );
 
-   auto base_id = assets[0]->id;
-   auto quote_id = assets[1]->id;
-
    market_ticker result;
 
    result.base = base;
    result.quote = quote;
+   result.latest = 0;
    result.base_volume = 0;
    result.quote_volume = 0;
    result.percent_change = 0;
    result.lowest_ask = 0;
    result.highest_bid = 0;
 
-   auto price_to_real = [&]( const share_type a, int p ) { return double( a.value ) / pow( 10, p ); };
-
    try {
-      if( base_id > quote_id ) std::swap(base_id, quote_id);
-
-      uint32_t day = 86400;
-      auto now = fc::time_point_sec( fc::time_point::now() );
-      auto orders = get_order_book( base, quote, 1 );
-      auto trades = get_trade_history( base, quote, now, fc::time_point_sec( now.sec_since_epoch() - day ), 100 );
-
-      result.latest = trades[0].price;
-
-      for ( market_trade t: trades )
-      {
-         result.base_volume += t.value;
-         result.quote_volume += t.amount;
-      }
-
-      while (trades.size() == 100)
+      const market_ticker_object* ticker = find_ticker( assets[0]->id, assets[1]->id );
+      if( ticker != nullptr )
       {
-         trades = get_trade_history( base, quote, trades[99].date, fc::time_point_sec( now.sec_since_epoch() - day ), 100 );
-
-         for ( market_trade t: trades )
+         result.base_volume = ticker_amount_to_real( *ticker, ticker->base_volume, ticker->quote_volume, true, *assets[0], *assets[1] );
+         result.quote_volume = ticker_amount_to_real( *ticker, ticker->base_volume, ticker->quote_volume, false, *assets[0], *assets[1] );
+         if( ticker->latest_base != 0 )
+            result.latest = ticker_price_to_real( *ticker, ticker->latest_base, ticker->latest_quote, *assets[0], *assets[1] );
+
+         // compare with the last trade before the window, or failing that the first one in it
+         share_type reference_base = ticker->previous_base;
+         share_type reference_quote = ticker->previous_quote;
+         if( reference_base == 0 && !ticker->slots.empty() )
          {
-            result.base_volume += t.value;
-            result.quote_volume += t.amount;
+            reference_base = ticker->slots.front().close_base;
+            reference_quote = ticker->slots.front().close_quote;
          }
+         if( reference_base != 0 && result.latest != 0 )
+            result.percent_change =
+               ( result.latest / ticker_price_to_real( *ticker, reference_base, reference_quote, *assets[0], *assets[1] ) - 1 ) * 100;
       }
 
-      trades = get_trade_history( base, quote, trades.back().date, fc::time_point_sec(), 1 );
-      result.percent_change = trades.size() > 0 ? ( ( result.latest / trades.back().price ) - 1 ) * 100 : 0;
-
-      //if (assets[0]->id == base_id)
-      {
+      auto orders = get_order_book( base, quote, 1 );
+      if( !orders.asks.empty() )
          result.lowest_ask = orders.asks[0].price;
+      if( !orders.bids.empty() )
          result.highest_bid = orders.bids[0].price;
-      }
 
       return result;
    } FC_CAPTURE_AND_RETHROW( (base)(quote) )
@@ -1075,9 +1392,6 @@ market_volume database_api_impl::get_24_volume( const string& base, const string
    FC_ASSERT( assets[0], "Invalid base asset symbol: ${s}", ("s",base) );
    FC_ASSERT( assets[1], "Invalid quote asset symbol: ${s}", ("s",quote) );
 
-   auto base_id = assets[0]->id;
-   auto quote_id = assets[1]->id;
-
    market_volume result;
    result.base = base;
    result.quote = quote;
@@ -1085,36 +1399,83 @@ market_volume database_api_impl::get_24_volume( const string& base, const string
    result.quote_volume = 0;
 
    try {
-      if( base_id > quote_id ) std::swap(base_id, quote_id);
+      const market_ticker_object* ticker = find_ticker( assets[0]->id, assets[1]->id );
+      if( ticker != nullptr )
+      {
+         result.base_volume = ticker_amount_to_real( *ticker, ticker->base_volume, ticker->quote_volume, true, *assets[0], *assets[1] );
+         result.quote_volume = ticker_amount_to_real( *ticker, ticker->base_volume, ticker->quote_volume, false, *assets[0], *assets[1] );
+      }
+      return result;
+   } FC_CAPTURE_AND_RETHROW( (base)(quote) )
+}
 
-      uint32_t bucket_size = 86400;
-      auto now = fc::time_point_sec( fc::time_point::now() );
+optional<market_stats_object> database_api::get_market_stats( asset_id_type a, asset_id_type b )const
+{
+   api_call_timer timer( "database_api", "get_market_stats" );
+   return my->get_market_stats( a, b );
+}
 
-      auto trades = get_trade_history( base, quote, now, fc::time_point_sec( now.sec_since_epoch() - bucket_size ), 100 );
+optional<market_stats_object> database_api_impl::get_market_stats( asset_id_type a, asset_id_type b )const
+{
+   if( a > b ) std::swap( a, b );
+   const auto& idx = _db.get_index_type<graphene::market_history::market_stats_index>().indices()
+      .get<graphene::market_history::by_market>();
+   auto itr = idx.find( std::make_tuple( a, b ) );
+   if( itr == idx.end() )
+      return optional<market_stats_object>();
+   return *itr;
+}
 
-      for ( market_trade t: trades )
-      {
-         result.base_volume += t.value;
-         result.quote_volume += t.amount;
-      }
+vector<optional<asset_market_stats_object>> database_api::get_asset_market_stats( const vector<asset_id_type>& asset_ids )const
+{
+   api_call_timer timer( "database_api", "get_asset_market_stats" );
+   return my->get_asset_market_stats( asset_ids );
+}
 
-      while (trades.size() == 100)
-      {
-         trades = get_trade_history( base, quote, trades[99].date, fc::time_point_sec( now.sec_since_epoch() - bucket_size ), 100 );
+vector<optional<asset_market_stats_object>> database_api_impl::get_asset_market_stats( const vector<asset_id_type>& asset_ids )const
+{
+   const auto& idx = _db.get_index_type<graphene::market_history::asset_market_stats_index>().indices()
+      .get<graphene::market_history::by_asset>();
+   vector<optional<asset_market_stats_object>> result;
+   result.reserve( asset_ids.size() );
+   for( asset_id_type id : asset_ids )
+   {
+      auto itr = idx.find( id );
+      if( itr == idx.end() )
+         result.emplace_back();
+      else
+         result.emplace_back( *itr );
+   }
+   return result;
+}
 
-         for ( market_trade t: trades )
-         {
-            result.base_volume += t.value;
-            result.quote_volume += t.amount;
-         }
-      }
+const market_ticker_object* database_api_impl::find_ticker( asset_id_type a, asset_id_type b )const
+{
+   if( a > b ) std::swap( a, b );
+   const auto& idx = _db.get_index_type<market_ticker_index>().indices().get<graphene::market_history::by_market>();
+   auto itr = idx.find( std::make_tuple( a, b ) );
+   return itr == idx.end() ? nullptr : &*itr;
+}
 
-      return result;
-   } FC_CAPTURE_AND_RETHROW( (base)(quote) )
+double database_api_impl::ticker_amount_to_real( const market_ticker_object& ticker, share_type ticker_base, share_type ticker_quote,
+                                                 bool in_base, const asset_object& base, const asset_object& quote )
+{
+   // the ticker is kept for the market with the lower asset id as its base
+   const asset_object& a = in_base ? base : quote;
+   share_type amount = ( ticker.base == a.id ) ? ticker_base : ticker_quote;
+   return double( amount.value ) / pow( 10, a.precision );
+}
+
+double database_api_impl::ticker_price_to_real( const market_ticker_object& ticker, share_type ticker_base, share_type ticker_quote,
+                                                const asset_object& base, const asset_object& quote )
+{
+   return ticker_amount_to_real( ticker, ticker_base, ticker_quote, true, base, quote )
+        / ticker_amount_to_real( ticker, ticker_base, ticker_quote, false, base, quote );
 }
 
 order_book database_api::get_order_book( const string& base, const string& quote, unsigned limit )const
 {
+   api_call_timer timer( "database_api", "get_order_book" );
    return my->get_order_book( base, quote, limit);
 }
 
@@ -1133,8 +1494,8 @@ order_book database_api_impl::get_order_book( const string& base, const string&
 
    auto base_id = assets[0]->id;
    auto quote_id = assets[1]->id;
-   auto orders = get_limit_orders( base_id, quote_id, limit );
 
+   const auto& levels = get_order_book_index().levels();
 
    auto asset_to_real = [&]( const asset& a, int p ) { return double(a.amount.value)/pow( 10, p ); };
    auto price_to_real = [&]( const price& p )
@@ -1145,25 +1506,33 @@ order_book database_api_impl::get_order_book( const string& base, const string&
          return asset_to_real( p.quote, assets[0]->precision ) / asset_to_real( p.base, assets[1]->precision );
    };
 
-   for( const auto& o : orders )
+   // levels selling base are bids, levels selling quote are asks, both best first
+   auto add_levels = [&]( asset_id_type sell, asset_id_type receive, vector<order>& side )
    {
-      if( o.sell_price.base.asset_id == base_id )
+      auto itr = levels.lower_bound( price::max( sell, receive ) );
+      auto end = levels.upper_bound( price::min( sell, receive ) );
+      for( ; itr != end && side.size() < limit; ++itr )
       {
+         const order_book_level& level = itr->second;
+         const price& p = level.sell_price;
+         const share_type to_receive = share_type( ( uint128_t( level.for_sale.value ) * p.quote.amount.value ) / p.base.amount.value );
          order ord;
-         ord.price = price_to_real( o.sell_price );
-         ord.quote = asset_to_real( share_type( ( uint128_t( o.for_sale.value ) * o.sell_price.quote.amount.value ) / o.sell_price.base.amount.value ), assets[1]->precision );
-         ord.base = asset_to_real( o.for_sale, assets[0]->precision );
-         result.bids.push_back( ord );
-      }
-      else
-      {
-         order ord;
-         ord.price = price_to_real( o.sell_price );
-         ord.quote = asset_to_real( o.for_sale, assets[1]->precision );
-         ord.base = asset_to_real( share_type( ( uint64_t( o.for_sale.value ) * o.sell_price.quote.amount.value ) / o.sell_price.base.amount.value ), assets[0]->precision );
-         result.asks.push_back( ord );
+         ord.price = price_to_real( p );
+         if( sell == base_id )
+         {
+            ord.base = asset_to_real( asset( level.for_sale, sell ), assets[0]->precision );
+            ord.quote = asset_to_real( asset( to_receive, receive ), assets[1]->precision );
+         }
+         else
+         {
+            ord.quote = asset_to_real( asset( level.for_sale, sell ), assets[1]->precision );
+            ord.base = asset_to_real( asset( to_receive, receive ), assets[0]->precision );
+         }
+         side.push_back( ord );
       }
-   }
+   };
+   add_levels( base_id, quote_id, result.bids );
+   add_levels( quote_id, base_id, result.asks );
 
    return result;
 }
@@ -1174,6 +1543,7 @@ vector<market_trade> database_api::get_trade_history( const string& base,
                                                       fc::time_point_sec stop,
                                                       unsigned limit )const
 {
+   api_call_timer timer( "database_api", "get_trade_history" );
    return my->get_trade_history( base, quote, start, stop, limit );
 }
 
@@ -1192,12 +1562,10 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
    auto base_id = assets[0]->id;
    auto quote_id = assets[1]->id;
 
-   if( base_id > quote_id ) std::swap( base_id, quote_id );
-   const auto& history_idx = _db.get_index_type<graphene::market_history::history_index>().indices().get<by_key>();
-   history_key hkey;
-   hkey.base = base_id;
-   hkey.quote = quote_id;
-   hkey.sequence = std::numeric_limits<int64_t>::min();
+   const auto& history_idx = dynamic_cast<const primary_index<graphene::market_history::history_index>&>(
+      _db.get_index_type<graphene::market_history::history_index>() );
+   const auto fills = history_idx.get_secondary_index<graphene::market_history::market_fill_history>()
+      .get_fills( base_id, quote_id, graphene::market_history::market_fill_history::fills_per_market );
 
    auto price_to_real = [&]( const share_type a, int p ) { return double( a.value ) / pow( 10, p ); };
 
@@ -1205,10 +1573,10 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
       start = fc::time_point_sec( fc::time_point::now() );
 
    uint32_t count = 0;
-   auto itr = history_idx.lower_bound( hkey );
+   auto itr = fills.begin();
    vector<market_trade> result;
 
-   while( itr != history_idx.end() && count < limit && !( itr->key.base != base_id || itr->key.quote != quote_id || itr->time < stop ) )
+   while( itr != fills.end() && count < limit && itr->time >= stop )
    {
       if( itr->time < start )
       {
@@ -1234,7 +1602,8 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
 
       // Trades are tracked in each direction.
       ++itr;
-      ++itr;
+      if( itr != fills.end() )
+         ++itr;
    }
 
    return result;
@@ -1248,11 +1617,13 @@ vector<market_trade> database_api_impl::get_trade_history( const string& base,
 
 vector<optional<witness_object>> database_api::get_witnesses(const vector<witness_id_type>& witness_ids)const
 {
+   api_call_timer timer( "database_api", "get_witnesses" );
    return my->get_witnesses( witness_ids );
 }
 
 vector<worker_object> database_api::get_workers_by_account(account_id_type account)const
 {
+   api_call_timer timer( "database_api", "get_workers_by_account" );
     const auto& idx = my->_db.get_index_type<worker_index>().indices().get<by_account>();
     auto itr = idx.find(account);
     vector<worker_object> result;
@@ -1281,6 +1652,7 @@ vector<optional<witness_object>> database_api_impl::get_witnesses(const vector<w
 
 fc::optional<witness_object> database_api::get_witness_by_account(account_id_type account)const
 {
+   api_call_timer timer( "database_api", "get_witness_by_account" );
    return my->get_witness_by_account( account );
 }
 
@@ -1295,6 +1667,7 @@ fc::optional<witness_object> database_api_impl::get_witness_by_account(account_i
 
 map<string, witness_id_type> database_api::lookup_witness_accounts(const string& lower_bound_name, uint32_t limit)const
 {
+   api_call_timer timer( "database_api", "lookup_witness_accounts" );
    return my->lookup_witness_accounts( lower_bound_name, limit );
 }
 
@@ -1323,6 +1696,7 @@ map<string, witness_id_type> database_api_impl::lookup_witness_accounts(const st
 
 uint64_t database_api::get_witness_count()const
 {
+   api_call_timer timer( "database_api", "get_witness_count" );
    return my->get_witness_count();
 }
 
@@ -1339,6 +1713,7 @@ uint64_t database_api_impl::get_witness_count()const
 
 vector<optional<committee_member_object>> database_api::get_committee_members(const vector<committee_member_id_type>& committee_member_ids)const
 {
+   api_call_timer timer( "database_api", "get_committee_members" );
    return my->get_committee_members( committee_member_ids );
 }
 
@@ -1356,6 +1731,7 @@ vector<optional<committee_member_object>> database_api_impl::get_committee_membe
 
 fc::optional<committee_member_object> database_api::get_committee_member_by_account(account_id_type account)const
 {
+   api_call_timer timer( "database_api", "get_committee_member_by_account" );
    return my->get_committee_member_by_account( account );
 }
 
@@ -1370,6 +1746,7 @@ fc::optional<committee_member_object> database_api_impl::get_committee_member_by
 
 map<string, committee_member_id_type> database_api::lookup_committee_member_accounts(const string& lower_bound_name, uint32_t limit)const
 {
+   api_call_timer timer( "database_api", "lookup_committee_member_accounts" );
    return my->lookup_committee_member_accounts( lower_bound_name, limit );
 }
 
@@ -1404,6 +1781,7 @@ map<string, committee_member_id_type> database_api_impl::lookup_committee_member
 
 vector<variant> database_api::lookup_vote_ids( const vector<vote_id_type>& votes )const
 {
+   api_call_timer timer( "database_api", "lookup_vote_ids" );
    return my->lookup_vote_ids( votes );
 }
 
@@ -1471,6 +1849,7 @@ vector<variant> database_api_impl::lookup_vote_ids( const vector<vote_id_type>&
 
 std::string database_api::get_transaction_hex(const signed_transaction& trx)const
 {
+   api_call_timer timer( "database_api", "get_transaction_hex" );
    return my->get_transaction_hex( trx );
 }
 
@@ -1481,7 +1860,10 @@ std::string database_api_impl::get_transaction_hex(const signed_transaction& trx
 
 set<public_key_type> database_api::get_required_signatures( const signed_transaction& trx, const flat_set<public_key_type>& available_keys )const
 {
-   return my->get_required_signatures( trx, available_keys );
+   api_call_timer timer( "database_api", "get_required_signatures" );
+   set<public_key_type> result;
+   run_on_read_thread( my->_db, [&]() { result = my->get_required_signatures( trx, available_keys ); } );
+   return result;
 }
 
 set<public_key_type> database_api_impl::get_required_signatures( const signed_transaction& trx, const flat_set<public_key_type>& available_keys )const
@@ -1498,11 +1880,17 @@ set<public_key_type> database_api_impl::get_required_signatures( const signed_tr
 
 set<public_key_type> database_api::get_potential_signatures( const signed_transaction& trx )const
 {
-   return my->get_potential_signatures( trx );
+   api_call_timer timer( "database_api", "get_potential_signatures" );
+   set<public_key_type> result;
+   run_on_read_thread( my->_db, [&]() { result = my->get_potential_signatures( trx ); } );
+   return result;
 }
 set<address> database_api::get_potential_address_signatures( const signed_transaction& trx )const
 {
-   return my->get_potential_address_signatures( trx );
+   api_call_timer timer( "database_api", "get_potential_address_signatures" );
+   set<address> result;
+   run_on_read_thread( my->_db, [&]() { result = my->get_potential_address_signatures( trx ); } );
+   return result;
 }
 
 set<public_key_type> database_api_impl::get_potential_signatures( const signed_transaction& trx )const
@@ -1560,7 +1948,10 @@ set<address> database_api_impl::get_potential_address_signatures( const signed_t
 
 bool database_api::verify_authority( const signed_transaction& trx )const
 {
-   return my->verify_authority( trx );
+   api_call_timer timer( "database_api", "verify_authority" );
+   bool result;
+   run_on_read_thread( my->_db, [&]() { result = my->verify_authority( trx ); } );
+   return result;
 }
 
 bool database_api_impl::verify_authority( const signed_transaction& trx )const
@@ -1574,7 +1965,10 @@ bool database_api_impl::verify_authority( const signed_transaction& trx )const
 
 bool database_api::verify_account_authority( const string& name_or_id, const flat_set<public_key_type>& signers )const
 {
-   return my->verify_account_authority( name_or_id, signers );
+   api_call_timer timer( "database_api", "verify_account_authority" );
+   bool result;
+   run_on_read_thread( my->_db, [&]() { result = my->verify_account_authority( name_or_id, signers ); } );
+   return result;
 }
 
 bool database_api_impl::verify_account_authority( const string& name_or_id, const flat_set<public_key_type>& keys )const
@@ -1584,12 +1978,7 @@ bool database_api_impl::verify_account_authority( const string& name_or_id, cons
    if (std::isdigit(name_or_id[0]))
       account = _db.find(fc::variant(name_or_id).as<account_id_type>());
    else
-   {
-      const auto& idx = _db.get_index_type<account_index>().indices().get<by_name>();
-      auto itr = idx.find(name_or_id);
-      if (itr != idx.end())
-         account = &*itr;
-   }
+      account = _db.account_names().find(name_or_id);
    FC_ASSERT( account, "no such account" );
 
 
@@ -1604,6 +1993,7 @@ bool database_api_impl::verify_account_authority( const string& name_or_id, cons
 
 processed_transaction database_api::validate_transaction( const signed_transaction& trx )const
 {
+   api_call_timer timer( "database_api", "validate_transaction" );
    return my->validate_transaction( trx );
 }
 
@@ -1614,6 +2004,7 @@ processed_transaction database_api_impl::validate_transaction( const signed_tran
 
 vector< fc::variant > database_api::get_required_fees( const vector<operation>& ops, asset_id_type id )const
 {
+   api_call_timer timer( "database_api", "get_required_fees" );
    return my->get_required_fees( ops, id );
 }
 
@@ -1703,24 +2094,23 @@ vector< fc::variant > database_api_impl::get_required_fees( const vector<operati
 
 vector<proposal_object> database_api::get_proposed_transactions( account_id_type id )const
 {
+   api_call_timer timer( "database_api", "get_proposed_transactions" );
    return my->get_proposed_transactions( id );
 }
 
-/** TODO: add secondary index that will accelerate this process */
 vector<proposal_object> database_api_impl::get_proposed_transactions( account_id_type id )const
 {
-   const auto& idx = _db.get_index_type<proposal_index>();
+   const auto& pidx = dynamic_cast<const primary_index<proposal_index>&>( _db.get_index_type<proposal_index>() );
+   const auto& proposals_by_account = pidx.get_secondary_index<graphene::chain::required_approval_index>();
    vector<proposal_object> result;
 
-   idx.inspect_all_objects( [&](const object& obj){
-           const proposal_object& p = static_cast<const proposal_object&>(obj);
-           if( p.required_active_approvals.find( id ) != p.required_active_approvals.end() )
-              result.push_back(p);
-           else if ( p.required_owner_approvals.find( id ) != p.required_owner_approvals.end() )
-              result.push_back(p);
-           else if ( p.available_active_approvals.find( id ) != p.available_active_approvals.end() )
-              result.push_back(p);
-   });
+   auto itr = proposals_by_account._account_to_proposals.find( id );
+   if( itr != proposals_by_account._account_to_proposals.end() )
+   {
+      result.reserve( itr->second.size() );
+      for( auto proposal_id : itr->second )
+         result.push_back( proposal_id(_db) );
+   }
    return result;
 }
 
@@ -1732,6 +2122,7 @@ vector<proposal_object> database_api_impl::get_proposed_transactions( account_id
 
 vector<blinded_balance_object> database_api::get_blinded_balances( const flat_set<commitment_type>& commitments )const
 {
+   api_call_timer timer( "database_api", "get_blinded_balances" );
    return my->get_blinded_balances( commitments );
 }
 
@@ -1755,29 +2146,9 @@ vector<blinded_balance_object> database_api_impl::get_blinded_balances( const fl
 //                                                                  //
 //////////////////////////////////////////////////////////////////////
 
-void database_api_impl::broadcast_updates( const vector<variant>& updates )
-{
-   if( updates.size() ) {
-      auto capture_this = shared_from_this();
-      fc::async([capture_this,updates](){
-          capture_this->_subscribe_callback( fc::variant(updates) );
-      });
-   }
-}
-
 void database_api_impl::on_objects_removed( const vector<const object*>& objs )
 {
-   /// we need to ensure the database_api is not deleted for the life of the async operation
-   if( _subscribe_callback )
-   {
-      vector<variant>    updates;
-      updates.reserve(objs.size());
-
-      for( auto obj : objs )
-         updates.emplace_back( obj->id );
-      broadcast_updates( updates );
-   }
-
+   // the subscribers of removed objects are told by the subscription_router, along with the other changes
    if( _market_subscriptions.size() )
    {
       map< pair<asset_id_type, asset_id_type>, vector<variant> > broadcast_queue;
@@ -1793,71 +2164,314 @@ void database_api_impl::on_objects_removed( const vector<const object*>& objs )
       }
       if( broadcast_queue.size() )
       {
+         // the callbacks are taken along, the subscriptions are only touched on the application thread
+         vector< pair< std::function<void(const variant&)>, vector<variant> > > updates;
+         for( auto& item : broadcast_queue )
+            updates.emplace_back( _market_subscriptions[item.first], std::move( item.second ) );
          auto capture_this = shared_from_this();
-         fc::async([capture_this,this,broadcast_queue](){
-             for( const auto& item : broadcast_queue )
-             {
-               auto sub = _market_subscriptions.find(item.first);
-               if( sub != _market_subscriptions.end() )
-                   sub->second( fc::variant(item.second ) );
-             }
+         notify([capture_this,updates](){
+             for( const auto& item : updates )
+                item.first( fc::variant( item.second ) );
          });
       }
    }
 }
 
-void database_api_impl::on_objects_changed(const vector<object_id_type>& ids)
-{
-   vector<variant>    updates;
-   map< pair<asset_id_type, asset_id_type>,  vector<variant> > market_broadcast_queue;
-
-   for(auto id : ids)
+namespace {
+   /**
+    * Routes the changes of a database to the connections subscribed to them.  There is one router per database,
+    * connected to its notifications while any connection is subscribed, and it keeps for each object id and each
+    * key the connections subscribed to it.  A changed object is serialized once, and only if anyone is subscribed to
+    * it, to the account that owns it or, for an account, to one of its keys, and each connection gets the changes for
+    * it in one batch.
+    *
+    * Notifications and API calls are only handled on the application thread.
+    */
+   class subscription_router
    {
-      const object* obj = nullptr;
-      if( _subscribe_callback )
-      {
-         obj = _db.find_object( id );
-         if( obj )
+      public:
+         static subscription_router& get( const graphene::chain::database& db );
+
+         void subscribe( object_id_type id, database_api_impl* session )
          {
-            updates.emplace_back( obj->to_variant() );
+            _subscribers[id].insert( session );
          }
-         else
+         void unsubscribe( object_id_type id, database_api_impl* session )
          {
-            updates.emplace_back(id); // send just the id to indicate removal
+            unsubscribe( _subscribers, id, session );
+         }
+         void subscribe( const public_key_type& key, database_api_impl* session )
+         {
+            _key_subscribers[key].insert( session );
+         }
+         void unsubscribe( const public_key_type& key, database_api_impl* session )
+         {
+            unsubscribe( _key_subscribers, key, session );
          }
-      }
 
-      if( _market_subscriptions.size() )
-      {
-         if( !_subscribe_callback )
-            obj = _db.find_object( id );
-         if( obj )
+      private:
+         typedef std::map< const graphene::chain::database*, std::unique_ptr<subscription_router> > router_map;
+         static router_map& routers()
          {
-            const limit_order_object* order = dynamic_cast<const limit_order_object*>(obj);
-            if( order )
+            static router_map r;
+            return r;
+         }
+
+         template<typename Map>
+         void unsubscribe( Map& subscribers, const typename Map::key_type& key, database_api_impl* session )
+         {
+            auto itr = subscribers.find( key );
+            if( itr == subscribers.end() )
+               return;
+            itr->second.erase( session );
+            if( itr->second.empty() )
+               subscribers.erase( itr );
+            if( _subscribers.empty() && _key_subscribers.empty() )
+               routers().erase( &_db ); // destroys this
+         }
+
+         explicit subscription_router( const graphene::chain::database& db ) : _db( db )
+         {
+            auto& mutable_db = const_cast<graphene::chain::database&>( db );
+            _removed_connection = mutable_db.removed_objects.connect( [this]( const vector<const object*>& objs ) {
+               for( const object* obj : objs )
+               {
+                  optional<account_id_type> owner = owner_of( *obj );
+                  if( owner )
+                     _removed_owners[ obj->id ] = *owner;
+               }
+            } );
+            _change_connection = mutable_db.changed_objects.connect( [this]( const vector<object_id_type>& ids ) {
+               route( ids );
+            } );
+         }
+
+         /** the account whose subscribers are told about changes of obj, if any */
+         static optional<account_id_type> owner_of( const object& obj )
+         {
+            if( obj.id.space() == protocol_ids && obj.id.type() == account_object_type )
+               return account_id_type( obj.id );
+            if( auto b = dynamic_cast<const account_balance_object*>( &obj ) )
+               return b->owner;
+            if( auto st = dynamic_cast<const account_statistics_object*>( &obj ) )
+               return st->owner;
+            if( auto o = dynamic_cast<const limit_order_object*>( &obj ) )
+               return o->seller;
+            if( auto c = dynamic_cast<const call_order_object*>( &obj ) )
+               return c->borrower;
+            if( auto f = dynamic_cast<const force_settlement_object*>( &obj ) )
+               return f->owner;
+            if( auto v = dynamic_cast<const vesting_balance_object*>( &obj ) )
+               return v->owner;
+            return optional<account_id_type>();
+         }
+
+         /** the keys an account can be found by, as in get_key_references */
+         static flat_set<public_key_type> keys_of( const account_object& account )
+         {
+            flat_set<public_key_type> keys;
+            for( const authority* a : { &account.owner, &account.active } )
+               for( const auto& item : a->key_auths )
+                  keys.insert( item.first );
+            keys.insert( account.options.memo_key );
+            return keys;
+         }
+
+         const flat_set<database_api_impl*>* subscribers_of( object_id_type id )const
+         {
+            auto itr = _subscribers.find( id );
+            return itr == _subscribers.end() ? nullptr : &itr->second;
+         }
+
+         void route( const vector<object_id_type>& ids )
+         {
+            std::map< database_api_impl*, std::shared_ptr< vector<variant> > > batches;
+            for( const object_id_type& id : ids )
             {
-               auto sub = _market_subscriptions.find( order->get_market() );
-               if( sub != _market_subscriptions.end() )
-                  market_broadcast_queue[order->get_market()].emplace_back( order->id );
+               const object* obj = _db.find_object( id );
+               optional<account_id_type> owner;
+               if( obj != nullptr )
+                  owner = owner_of( *obj );
+               else
+               {
+                  auto removed = _removed_owners.find( id );
+                  if( removed != _removed_owners.end() )
+                     owner = removed->second;
+               }
+
+               flat_set<database_api_impl*> recipients;
+               auto add_recipients = [&recipients]( const flat_set<database_api_impl*>* sessions ) {
+                  if( sessions != nullptr )
+                     recipients.insert( sessions->begin(), sessions->end() );
+               };
+               add_recipients( subscribers_of( id ) );
+               if( owner && object_id_type( *owner ) != id )
+                  add_recipients( subscribers_of( *owner ) );
+               if( !_key_subscribers.empty() && obj != nullptr )
+                  if( auto account = dynamic_cast<const account_object*>( obj ) )
+                     for( const public_key_type& key : keys_of( *account ) )
+                     {
+                        auto itr = _key_subscribers.find( key );
+                        if( itr != _key_subscribers.end() )
+                           add_recipients( &itr->second );
+                     }
+               if( recipients.empty() )
+                  continue;
+
+               // send just the id to indicate removal, and only once to a session subscribed in several ways
+               const variant update = obj != nullptr ? obj->to_variant() : variant( id );
+               for( database_api_impl* session : recipients )
+               {
+                  auto& batch = batches[session];
+                  if( !batch )
+                     batch = std::make_shared< vector<variant> >();
+                  batch->push_back( update );
+               }
             }
+            _removed_owners.clear();
+            for( auto& item : batches )
+               item.first->queue_updates( std::move( item.second ) );
          }
-      }
+
+         const graphene::chain::database&                           _db;
+         std::map< object_id_type, flat_set<database_api_impl*> >  _subscribers;
+         std::map< public_key_type, flat_set<database_api_impl*> > _key_subscribers;
+         /** owners of the objects of the last removed_objects notification, which come before its changed_objects */
+         std::map< object_id_type, account_id_type >                _removed_owners;
+         boost::signals2::scoped_connection                         _removed_connection;
+         boost::signals2::scoped_connection                         _change_connection;
+   };
+
+   subscription_router& subscription_router::get( const graphene::chain::database& db )
+   {
+      auto& router = routers()[ &db ];
+      if( !router )
+         router.reset( new subscription_router( db ) );
+      return *router;
    }
+}
+
+void database_api_impl::subscribe_to_object( object_id_type id )const
+{
+   if( !_subscribe_callback )
+      return;
+   if( _subscribed_ids.insert( id ).second )
+      subscription_router::get( _db ).subscribe( id, const_cast<database_api_impl*>( this ) );
+}
+
+void database_api_impl::subscribe_to_item( const public_key_type& key )const
+{
+   if( !_subscribe_callback )
+      return;
+   if( _subscribed_keys.insert( key ).second )
+      subscription_router::get( _db ).subscribe( key, const_cast<database_api_impl*>( this ) );
+}
+
+void database_api_impl::unsubscribe_from_objects()
+{
+   if( _subscribed_ids.empty() && _subscribed_keys.empty() )
+      return;
+   auto& router = subscription_router::get( _db );
+   auto ids = std::move( _subscribed_ids );
+   _subscribed_ids.clear();
+   auto keys = std::move( _subscribed_keys );
+   _subscribed_keys.clear();
+   // the router goes away with the last subscription of all, which can only be the last one of these
+   for( const object_id_type& id : ids )
+      router.unsubscribe( id, this );
+   for( const public_key_type& key : keys )
+      router.unsubscribe( key, this );
+}
+
+void database_api::set_max_queued_notifications( uint32_t batches )
+{
+   max_queued_notifications() = batches;
+}
+
+void database_api_impl::queue_updates( std::shared_ptr< const vector<variant> > updates )
+{
+   std::unique_lock<std::mutex> guard( _updates_mutex );
+   if( updates->empty() || _dropping_subscriptions )
+      return;
+   _queued_updates.push_back( std::move( updates ) );
 
    auto capture_this = shared_from_this();
+   const uint32_t max_queued = max_queued_notifications();
+   if( max_queued != 0 && _queued_updates.size() > max_queued )
+   {
+      // not from here, this is called while the subscription_router walks its subscribers
+      wlog( "dropping the subscriptions of database api ${x}, ${n} batches of changes were not sent yet",
+            ("x",int64_t(this))("n",_queued_updates.size()) );
+      _dropping_subscriptions = true;
+      _queued_updates.clear();
+      guard.unlock();
+      fc::async( [capture_this,this](){
+         unsubscribe_from_objects();
+         _market_subscriptions.clear();
+         std::lock_guard<std::mutex> guard( _updates_mutex );
+         _subscribe_callback = std::function<void(const fc::variant&)>();
+         _dropping_subscriptions = false;
+      } );
+      return;
+   }
+   if( _sending_updates )
+      return; // the sending task picks these up once the previous send completes
+
+   _sending_updates = true;
+   guard.unlock();
+   notify([capture_this,this](){
+      // one send at a time, so a slow connection lets its queue grow rather than piling up tasks
+      std::unique_lock<std::mutex> guard( _updates_mutex );
+      while( !_queued_updates.empty() && _subscribe_callback )
+      {
+         auto queued = std::move( _queued_updates );
+         _queued_updates.clear();
+         auto callback = _subscribe_callback;
+         // serializing and sending take long, the chain thread queues more meanwhile
+         guard.unlock();
+         if( queued.size() == 1 )
+            callback( fc::variant( *queued.front() ) );
+         else
+         {
+            vector<variant> updates;
+            for( const auto& q : queued )
+               updates.insert( updates.end(), q->begin(), q->end() );
+            callback( fc::variant( updates ) );
+         }
+         guard.lock();
+      }
+      _queued_updates.clear();
+      _sending_updates = false;
+   });
+}
 
-   /// pushing the future back / popping the prior future if it is complete.
-   /// if a connection hangs then this could get backed up and result in
-   /// a failure to exit cleanly.
-   fc::async([capture_this,this,updates,market_broadcast_queue](){
-      if( _subscribe_callback ) _subscribe_callback( updates );
+void database_api_impl::on_objects_changed(const vector<object_id_type>& ids)
+{
+   // object subscriptions are handled by the subscription_router
+   if( _market_subscriptions.empty() )
+      return;
 
-      for( const auto& item : market_broadcast_queue )
+   map< pair<asset_id_type, asset_id_type>,  vector<variant> > market_broadcast_queue;
+   for(auto id : ids)
+   {
+      const limit_order_object* order = dynamic_cast<const limit_order_object*>( _db.find_object( id ) );
+      if( order )
       {
-        auto sub = _market_subscriptions.find(item.first);
-        if( sub != _market_subscriptions.end() )
-            sub->second( fc::variant(item.second ) );
+         auto sub = _market_subscriptions.find( order->get_market() );
+         if( sub != _market_subscriptions.end() )
+            market_broadcast_queue[order->get_market()].emplace_back( order->id );
       }
+   }
+   if( market_broadcast_queue.empty() )
+      return;
+
+   vector< pair< std::function<void(const variant&)>, vector<variant> > > updates;
+   for( auto& item : market_broadcast_queue )
+      updates.emplace_back( _market_subscriptions[item.first], std::move( item.second ) );
+   auto capture_this = shared_from_this();
+   notify([capture_this,updates](){
+      for( const auto& item : updates )
+         item.first( fc::variant( item.second ) );
    });
 }
 
@@ -1869,12 +2483,16 @@ void database_api_impl::on_applied_block()
    if (_block_applied_callback)
    {
       auto capture_this = shared_from_this();
+      auto callback = _block_applied_callback;
       block_id_type block_id = _db.head_block_id();
-      fc::async([this,capture_this,block_id](){
-         _block_applied_callback(fc::variant(block_id));
+      notify([capture_this,callback,block_id](){
+         callback(fc::variant(block_id));
       });
    }
 
+   if( _market_data_subscriptions.size() )
+      publish_market_data();
+
    if(_market_subscriptions.size() == 0)
       return;
 
@@ -1905,16 +2523,94 @@ void database_api_impl::on_applied_block()
       if(_market_subscriptions.count(market))
          subscribed_markets_ops[market].push_back(std::make_pair(op.op, op.result));
    }
+   vector< pair< std::function<void(const variant&)>, vector<pair<operation, operation_result>> > > updates;
+   for( auto& item : subscribed_markets_ops )
+      updates.emplace_back( _market_subscriptions[item.first], std::move( item.second ) );
    /// we need to ensure the database_api is not deleted for the life of the async operation
    auto capture_this = shared_from_this();
-   fc::async([this,capture_this,subscribed_markets_ops](){
-      for(auto item : subscribed_markets_ops)
+   notify([capture_this,updates](){
+      for( const auto& item : updates )
+         item.first( fc::variant( item.second ) );
+   });
+}
+
+void database_api_impl::publish_market_data()
+{
+   map< pair<asset_id_type,asset_id_type>, vector<fill_order_operation> > fills;
+   for( const optional< operation_history_object >& o_op : _db.get_applied_operations() )
+   {
+      if( !o_op.valid() || o_op->op.which() != operation::tag<fill_order_operation>::value )
+         continue;
+      const fill_order_operation& fill = o_op->op.get<fill_order_operation>();
+      // every match fills both sides, only report the one paying in base
+      if( fill.pays.asset_id < fill.receives.asset_id && _market_data_subscriptions.count( fill.get_market() ) )
+         fills[ fill.get_market() ].push_back( fill );
+   }
+
+   const auto& book = get_order_book_index();
+   vector< pair< std::function<void(const variant&)>, market_data_update > > updates;
+   for( auto& item : _market_data_subscriptions )
+   {
+      market_data_subscription& sub = item.second;
+      const uint64_t revision = book.market_revision( item.first );
+      auto market_fills = fills.find( item.first );
+      if( revision == sub.book_revision && market_fills == fills.end() )
+         continue;
+
+      market_data_update update;
+      update.base = item.first.first;
+      update.quote = item.first.second;
+      update.sequence = ++sub.sequence;
+      update.block_num = _db.head_block_num();
+      update.time = _db.head_block_time();
+      if( market_fills != fills.end() )
+         update.fills = std::move( market_fills->second );
+
+      if( revision != sub.book_revision )
       {
-         auto itr = _market_subscriptions.find(item.first);
-         if(itr != _market_subscriptions.end())
-            itr->second(fc::variant(item.second));
+         // both maps are sorted the same way, so one pass finds every added, changed and removed level
+         auto levels = get_market_levels( item.first.first, item.first.second );
+         const auto less = levels.key_comp();
+         auto old_itr = sub.levels.begin();
+         auto new_itr = levels.begin();
+         while( old_itr != sub.levels.end() || new_itr != levels.end() )
+         {
+            if( new_itr == levels.end() || ( old_itr != sub.levels.end() && less( old_itr->first, new_itr->first ) ) )
+            {
+               order_book_level removed = old_itr->second;
+               removed.for_sale = 0;
+               removed.order_count = 0;
+               update.levels.push_back( removed );
+               ++old_itr;
+            }
+            else if( old_itr == sub.levels.end() || less( new_itr->first, old_itr->first ) )
+            {
+               update.levels.push_back( new_itr->second );
+               ++new_itr;
+            }
+            else
+            {
+               if( old_itr->second.for_sale != new_itr->second.for_sale ||
+                   old_itr->second.order_count != new_itr->second.order_count )
+                  update.levels.push_back( new_itr->second );
+               ++old_itr;
+               ++new_itr;
+            }
+         }
+         sub.levels = std::move( levels );
+         sub.book_revision = revision;
       }
-   });
+      updates.emplace_back( sub.callback, std::move( update ) );
+   }
+
+   if( updates.size() )
+   {
+      auto capture_this = shared_from_this();
+      notify([capture_this,updates](){
+         for( const auto& item : updates )
+            item.first( fc::variant( item.second ) );
+      });
+   }
 }
 
 } } // graphene::app
@@ -23,6 +23,8 @@
  */
 #pragma once
 
+#include <graphene/app/api_stats.hpp>
+#include <graphene/app/block_trace.hpp>
 #include <graphene/app/database_api.hpp>
 
 #include <graphene/chain/protocol/types.hpp>
@@ -53,6 +55,7 @@ namespace graphene { namespace app {
    using namespace std;
 
    class application;
+   namespace detail { class packed_response_cache; }
 
    struct verify_range_result
    {
@@ -76,7 +79,7 @@ namespace graphene { namespace app {
     *
     * This API contains methods to access account histories
     */
-   class history_api
+   class history_api : public std::enable_shared_from_this<history_api>
    {
       public:
          history_api(application& app):_app(app){}
@@ -113,11 +116,103 @@ namespace graphene { namespace app {
          vector<order_history_object> get_fill_order_history( asset_id_type a, asset_id_type b, uint32_t limit )const;
          vector<bucket_object> get_market_history( asset_id_type a, asset_id_type b, uint32_t bucket_seconds,
                                                    fc::time_point_sec start, fc::time_point_sec end )const;
+         /**
+          * @brief Get the market history in buckets of any multiple of a tracked bucket size
+          * @param a One asset of the market
+          * @param b The other asset of the market
+          * @param bucket_seconds Size of the returned buckets, must be a multiple of a tracked bucket size
+          * @param start Open of the first bucket, rounded down to a multiple of bucket_seconds
+          * @param end Open of the last bucket
+          * @param limit Maximum number of buckets to return (must not exceed 200)
+          * @return Buckets merged from the largest tracked size that divides bucket_seconds, oldest first.  Buckets
+          * without trades are left out; to get the next page, call again with start set to the open of the last
+          * bucket returned plus bucket_seconds.
+          */
+         vector<bucket_object> get_aggregated_market_history( asset_id_type a, asset_id_type b, uint32_t bucket_seconds,
+                                                              fc::time_point_sec start, fc::time_point_sec end,
+                                                              uint32_t limit = 200 )const;
          flat_set<uint32_t> get_market_history_buckets()const;
+
+         /**
+          * @brief Calls back with the operations added to the history of any of the accounts from now on
+          * @param cb called with each operation_history_object once, as the account history adds it
+          * @param accounts the accounts to subscribe to
+          *
+          * The history kept on disk adds operations once they are irreversible, the one kept as objects as they are
+          * applied.  The subscription lasts as long as this API.
+          */
+         void subscribe_to_account_operations( std::function<void(variant/*operation_history_object*/)> cb,
+                                               const vector<account_id_type>& accounts );
       private:
            application& _app;
    };
 
+   /**
+    * @brief The packed_api class returns the results of the largest read calls packed with fc::raw
+    *
+    * Each call returns the same result as its database_api or history_api counterpart, packed as that type, so
+    * native clients unpack it directly instead of parsing it field by field from JSON.  Over a JSON connection the
+    * bytes travel as a single hex string.
+    *
+    * The results of the calls which only change with the head block are packed once for every connection and kept
+    * until the head block changes.
+    */
+   class packed_api
+   {
+      public:
+         packed_api(application& app);
+
+         /**
+          * @return the packed optional<signed_block>, see database_api::get_block.  Blocks are sent as they are
+          * stored, without being unpacked first.
+          */
+         vector<char> get_block( uint32_t block_num )const;
+         /**
+          * @brief Get consecutive blocks, as they are stored
+          * @param start Number of the first block
+          * @param count Maximum number of blocks to return (must not exceed 1000)
+          * @return the packed vector<signed_block> of the blocks from start on.  It stops early at the head block, at
+          * a block which is not available, or once the blocks returned take max_blocks_bytes; the next call
+          * continues from start plus the number of blocks returned.
+          */
+         vector<char> get_blocks( uint32_t start, uint32_t count )const;
+         /**
+          * @brief Get the signed headers of consecutive blocks, for nodes which only follow the headers
+          * @param start Number of the first block
+          * @param count Maximum number of headers to return (must not exceed 1000)
+          * @return the packed vector<signed_block_header> of the blocks from start on.  It stops early at the head
+          * block or at a block which is not available.  The headers are cut from the stored blocks, which are not
+          * unpacked.
+          */
+         vector<char> get_block_headers( uint32_t start, uint32_t count )const;
+         /** @return the packed chain_property_object, see database_api::get_chain_properties */
+         vector<char> get_chain_properties()const;
+         /** @return the packed global_property_object, see database_api::get_global_properties */
+         vector<char> get_global_properties()const;
+         /** @return the packed configuration variant_object, see database_api::get_config */
+         vector<char> get_config()const;
+         /** @return the packed dynamic_global_property_object, see database_api::get_dynamic_global_properties */
+         vector<char> get_dynamic_global_properties()const;
+         /** @return the packed std::map<string,full_account>, see database_api::get_full_accounts; nothing is subscribed to */
+         vector<char> get_full_accounts( const vector<string>& names_or_ids )const;
+         /** @return the packed vector<operation_history_object>, see history_api::get_account_history */
+         vector<char> get_account_history( account_id_type account,
+                                           operation_history_id_type stop = operation_history_id_type(),
+                                           unsigned limit = 100,
+                                           operation_history_id_type start = operation_history_id_type() )const;
+
+      private:
+         static const uint32_t max_blocks_bytes = 8 * 1024 * 1024;
+
+         vector<char> pack_block( uint32_t block_num )const;
+         std::shared_ptr<const vector<char>> fetch_packed_block( uint32_t block_num )const;
+
+         application&                                    _app;
+         mutable database_api                            _database_api;
+         history_api                                     _history_api;
+         std::shared_ptr<detail::packed_response_cache>  _cache;
+   };
+
    /**
     * @brief The network_broadcast_api class allows broadcasting of transactions.
     */
@@ -134,6 +229,13 @@ namespace graphene { namespace app {
             processed_transaction trx;
          };
 
+         struct transaction_broadcast_result
+         {
+            transaction_id_type   id;
+            bool                  accepted = false;
+            string                error;     ///< why the transaction was not accepted
+         };
+
          typedef std::function<void(variant/*transaction_confirmation*/)> confirmation_callback;
 
          /**
@@ -145,26 +247,39 @@ namespace graphene { namespace app {
           */
          void broadcast_transaction(const signed_transaction& trx);
 
+         /**
+          * @brief Broadcast a batch of transactions to the network
+          * @param trxs The transactions to broadcast, in the order they are to be applied
+          * @return one result per transaction
+          *
+          * Each transaction is checked for validity in the local database like broadcast_transaction() does, but a
+          * transaction that fails doesn't stop the others; only the accepted ones are broadcast.
+          */
+         vector<transaction_broadcast_result> broadcast_transactions( const vector<signed_transaction>& trxs );
+
          /** this version of broadcast transaction registers a callback method that will be called when the transaction is
           * included into a block.  The callback method includes the transaction id, block number, and transaction number in the
-          * block.
+          * block.  It is not called if the transaction expires first, or once this API is gone.
           */
          void broadcast_transaction_with_callback( confirmation_callback cb, const signed_transaction& trx);
 
-         void broadcast_block( const signed_block& block );
+         /** like broadcast_transaction_with_callback(), but calls back once the block including trx is irreversible */
+         void broadcast_transaction_with_irreversible_callback( confirmation_callback cb, const signed_transaction& trx );
 
          /**
-          * @brief Not reflected, thus not accessible to API clients.
+          * @brief Calls back with every operation impacting any of the accounts once its block is irreversible
+          * @param cb called with the operation_history_object of each operation, in the order they were applied
+          * @param accounts the accounts to watch
           *
-          * This function is registered to receive the applied_block
-          * signal from the chain database when a block is received.
-          * It then dispatches callbacks to clients who have requested
-          * to be notified when a particular txid is included in a block.
+          * The watch lasts as long as this API.
           */
-         void on_applied_block( const signed_block& b );
+         void watch_irreversible_operations( std::function<void(variant/*operation_history_object*/)> cb,
+                                             const vector<account_id_type>& accounts );
+
+         void broadcast_block( const signed_block& block );
       private:
-         boost::signals2::scoped_connection             _applied_block_connection;
-         map<transaction_id_type,confirmation_callback> _callbacks;
+         void broadcast_with_confirmation( confirmation_callback cb, const signed_transaction& trx, bool irreversible );
+
          application&                                   _app;
    };
 
@@ -210,10 +325,129 @@ namespace graphene { namespace app {
           */
          std::vector<net::potential_peer_record> get_potential_peers() const;
 
+         /**
+          * @brief Get when a recent block was received and validated, and which peer sent it
+          * @param block_id the block, which must still be in the node's message cache
+          */
+         net::message_propagation_data get_block_propagation_data(const block_id_type& block_id) const;
+
+         /**
+          * @brief Get how long the node's calls to the blockchain took, with histograms of the time
+          *        spent waiting for the blockchain thread, executing, and waiting for the p2p thread
+          */
+         fc::variant_object get_call_statistics() const;
+
+         /**
+          * @brief Get the messages and bytes exchanged with the peers by message type, in total and for each
+          *        connected peer, and the bytes per second read and written over the last seconds, minutes and hours
+          */
+         net::traffic_statistics get_traffic_statistics() const;
+
+         /**
+          * @brief Get the timings of the last blocks received from the network, from receiving them through
+          *        applying them and the plugins' handlers to rebroadcasting them
+          * @param limit the number of blocks, newest first
+          *
+          * The node only traces blocks if started with block-trace-size, otherwise this returns nothing.
+          */
+         vector<block_trace> get_block_traces(uint32_t limit = 100) const;
+
+         /**
+          * @brief Get the approximate memory held by each index of the object database and by each undo state
+          *
+          * The sizes are estimated from the object counts and the sizes of the types involved, memory the
+          * objects allocate themselves is not included.
+          */
+         graphene::db::object_database_memory_usage get_memory_usage() const;
+
+         /**
+          * @brief Get the digest of each index of the object database right after a block was applied
+          * @param block_num the block, 0 for the current state including the pending transactions
+          *
+          * Nodes running the same plugins which agree on the state have the same digests.  Past blocks are only
+          * available if the node was started with state-digest-blocks, the current state is hashed in full
+          * otherwise.
+          */
+         optional<graphene::chain::block_state_digest> get_state_digest(uint32_t block_num = 0) const;
+
       private:
          application& _app;
    };
    
+   /** a file of a state checkpoint, by its path relative to the checkpoint directory */
+   struct state_checkpoint_file
+   {
+      string   path;
+      uint64_t size = 0;
+   };
+
+   struct state_checkpoint_info
+   {
+      uint32_t                        block_num = 0;
+      block_id_type                   block_id;
+      vector<state_checkpoint_file>   files;
+   };
+
+   /**
+    * @brief The replication_api class ships the blocks a node applies and its state checkpoints to standby nodes
+    *
+    * A standby started with replicate-from follows its primary through this API: it fetches the blocks it is
+    * missing with packed_api::get_blocks, is sent every block the primary applies from then on, and a standby
+    * without any state starts from a copy of the primary's newest state checkpoint rather than replaying the chain.
+    */
+   class replication_api : public std::enable_shared_from_this<replication_api>
+   {
+      public:
+         replication_api( application& a );
+
+         typedef std::function<void(variant/*packed signed_block*/)> block_callback;
+
+         /** calls cb with every block the node applies from now on, fc::raw packed, in the order they are applied */
+         void set_block_callback( block_callback cb );
+         void cancel_block_callback();
+
+         /** @return the newest complete state checkpoint, if the node is started with state-checkpoint-interval */
+         optional<state_checkpoint_info> get_state_checkpoint()const;
+         /**
+          * @brief Read part of a file of a state checkpoint
+          * @param block_num the block of the checkpoint, which is deleted once a newer one is complete
+          * @param path the file, one of those get_state_checkpoint() listed
+          * @param offset where to start reading
+          * @param size how much to read, at most max_read_size
+          */
+         vector<char> read_state_checkpoint( uint32_t block_num, const string& path, uint64_t offset,
+                                             uint32_t size )const;
+
+         /**
+          * @brief Not reflected, thus not accessible to API clients.
+          *
+          * Registered for the applied_block signal of the chain database, sends the block to the callback.
+          */
+         void on_applied_block( const signed_block& b );
+
+      private:
+         static const uint32_t max_read_size = 4 * 1024 * 1024;
+
+         fc::path checkpoint_dir( uint32_t block_num )const;
+
+         application&                        _app;
+         block_callback                      _callback;
+         boost::signals2::scoped_connection  _applied_block_connection;
+   };
+
+   /**
+    * @brief The call_stats_api class reports how often the API methods are called and how long they take
+    *
+    * The statistics cover every connection since the node started or they were last reset.
+    */
+   class call_stats_api
+   {
+      public:
+         /** @return the statistics of every method called at least once */
+         vector<api_method_stats> get_call_stats()const;
+         void                     reset_call_stats();
+   };
+
    class crypto_api
    {
       public:
@@ -285,6 +519,12 @@ namespace graphene { namespace app {
          fc::api<crypto_api> crypto()const;
          /// @brief Retrieve the debug API (if available)
          fc::api<graphene::debug_witness::debug_api> debug()const;
+         /// @brief Retrieve the packed API, which returns results fc::raw packed
+         fc::api<packed_api> packed()const;
+         /// @brief Retrieve the API call statistics
+         fc::api<call_stats_api> call_stats()const;
+         /// @brief Retrieve the replication API, which standby nodes follow
+         fc::api<replication_api> replication()const;
 
       private:
          /// @brief Called to enable an API, not reflected.
@@ -297,12 +537,19 @@ namespace graphene { namespace app {
          optional< fc::api<history_api> >  _history_api;
          optional< fc::api<crypto_api> > _crypto_api;
          optional< fc::api<graphene::debug_witness::debug_api> > _debug_api;
+         optional< fc::api<packed_api> > _packed_api;
+         optional< fc::api<call_stats_api> > _call_stats_api;
+         optional< fc::api<replication_api> > _replication_api;
    };
 
 }}  // graphene::app
 
 FC_REFLECT( graphene::app::network_broadcast_api::transaction_confirmation,
         (id)(block_num)(trx_num)(trx) )
+FC_REFLECT( graphene::app::network_broadcast_api::transaction_broadcast_result,
+        (id)(accepted)(error) )
+FC_REFLECT( graphene::app::state_checkpoint_file, (path)(size) )
+FC_REFLECT( graphene::app::state_checkpoint_info, (block_num)(block_id)(files) )
 FC_REFLECT( graphene::app::verify_range_result,
         (success)(min_val)(max_val) )
 FC_REFLECT( graphene::app::verify_range_proof_rewind_result,
@@ -315,11 +562,16 @@ FC_API(graphene::app::history_api,
        (get_relative_account_history)
        (get_fill_order_history)
        (get_market_history)
+       (get_aggregated_market_history)
        (get_market_history_buckets)
+       (subscribe_to_account_operations)
      )
 FC_API(graphene::app::network_broadcast_api,
        (broadcast_transaction)
+       (broadcast_transactions)
        (broadcast_transaction_with_callback)
+       (broadcast_transaction_with_irreversible_callback)
+       (watch_irreversible_operations)
        (broadcast_block)
      )
 FC_API(graphene::app::network_node_api,
@@ -329,6 +581,12 @@ FC_API(graphene::app::network_node_api,
        (get_potential_peers)
        (get_advanced_node_parameters)
        (set_advanced_node_parameters)
+       (get_block_propagation_data)
+       (get_call_statistics)
+       (get_traffic_statistics)
+       (get_block_traces)
+       (get_memory_usage)
+       (get_state_digest)
      )
 FC_API(graphene::app::crypto_api,
        (blind_sign)
@@ -341,6 +599,27 @@ FC_API(graphene::app::crypto_api,
        (verify_range_proof_rewind)
        (range_get_info)
      )
+FC_API(graphene::app::call_stats_api,
+       (get_call_stats)
+       (reset_call_stats)
+     )
+FC_API(graphene::app::packed_api,
+       (get_block)
+       (get_blocks)
+       (get_block_headers)
+       (get_chain_properties)
+       (get_global_properties)
+       (get_config)
+       (get_dynamic_global_properties)
+       (get_full_accounts)
+       (get_account_history)
+     )
+FC_API(graphene::app::replication_api,
+       (set_block_callback)
+       (cancel_block_callback)
+       (get_state_checkpoint)
+       (read_state_checkpoint)
+     )
 FC_API(graphene::app::login_api,
        (login)
        (network_broadcast)
@@ -349,4 +628,7 @@ FC_API(graphene::app::login_api,
        (network_node)
        (crypto)
        (debug)
+       (packed)
+       (call_stats)
+       (replication)
      )
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <fc/reflect/reflect.hpp>
+#include <fc/time.hpp>
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace graphene { namespace app {
+
+   /** what api_call_stats::get() reports about the calls of one API method */
+   struct api_method_stats
+   {
+      std::string api;
+      std::string method;
+      uint64_t    calls = 0;
+      uint64_t    errors = 0;           ///< calls which threw
+      uint64_t    total_us = 0;
+      uint64_t    p50_us = 0;           ///< rounded up to a power of two, at most max_us
+      uint64_t    p99_us = 0;           ///< rounded up to a power of two, at most max_us
+      uint64_t    max_us = 0;
+      uint64_t    response_bytes = 0;   ///< total size of the responses, for the methods which know it
+   };
+
+   /**
+    * @brief Counts and times the calls of the API methods
+    *
+    * Every API method has an api_call_timer in scope while it runs.  The durations are kept in a histogram of
+    * power of two buckets of microseconds, so recording a call takes constant time and memory whatever the number
+    * of calls, and percentiles are known to within a factor of two.
+    */
+   class api_call_stats
+   {
+      public:
+         /** the statistics of every API of the process */
+         static api_call_stats& instance();
+
+         /** api and method must be string literals, they are told apart by address */
+         void record( const char* api, const char* method, uint64_t duration_us, bool failed, uint64_t response_bytes );
+
+         std::vector<api_method_stats> get()const;
+         void                          reset();
+
+      private:
+         struct method_data
+         {
+            uint64_t                   calls = 0;
+            uint64_t                   errors = 0;
+            uint64_t                   total_us = 0;
+            uint64_t                   max_us = 0;
+            uint64_t                   response_bytes = 0;
+            std::array<uint64_t, 64>   histogram{}; ///< bucket i counts calls of less than 2^i microseconds
+         };
+
+         mutable std::mutex                                                     _mutex;
+         std::map< std::pair<const char*, const char*>, method_data >           _methods;
+   };
+
+   /** records the call of an API method when it goes out of scope, as failed if it is left by an exception */
+   class api_call_timer
+   {
+      public:
+         api_call_timer( const char* api, const char* method )
+            : _api( api ), _method( method ), _start( fc::time_point::now() ) {}
+         ~api_call_timer();
+
+         void set_response_size( uint64_t bytes ) { _response_bytes = bytes; }
+
+      private:
+         const char*    _api;
+         const char*    _method;
+         fc::time_point _start;
+         uint64_t       _response_bytes = 0;
+   };
+
+} } // graphene::app
+
+FC_REFLECT( graphene::app::api_method_stats,
+            (api)(method)(calls)(errors)(total_us)(p50_us)(p99_us)(max_us)(response_bytes) )
@@ -34,6 +34,10 @@ namespace graphene { namespace app {
    using std::string;
 
    class abstract_plugin;
+   class block_tracer;
+   class confirmation_registry;
+   class light_client;
+   class state_replica;
 
    class application
    {
@@ -79,11 +83,27 @@ namespace graphene { namespace app {
 
          net::node_ptr                    p2p_node();
          std::shared_ptr<chain::database> chain_database()const;
+         /** @return the copy of the state get_objects reads, null unless api-replica-types was set */
+         std::shared_ptr<const state_replica> get_state_replica()const;
+         /** true if the state is followed from another node through shared-state-follow rather than maintained */
+         bool follows_shared_state()const;
+         /** @return the client following the block headers of another node, null unless light-sync-from was set */
+         light_client* get_light_client()const;
+         /** @return the timings of the last blocks from the network, null unless block-trace-size was set */
+         std::shared_ptr<block_tracer> get_block_tracer()const;
+         /** @return the callbacks waiting for transactions to be included in a block, null before startup() */
+         std::shared_ptr<confirmation_registry> get_confirmation_registry()const;
 
          void set_block_production(bool producing_blocks);
          fc::optional< api_access_info > get_api_access_info( const string& username )const;
          void set_api_access_info(const string& username, api_access_info&& permissions);
 
+         /** checks trx on the transaction check threads, then pushes it to the chain database */
+         void push_transaction( const graphene::chain::signed_transaction& trx );
+
+         /** true when startup() did all the node was asked to, like a benchmark-replay, and it should shut down */
+         bool exit_after_startup()const;
+
          bool is_finished_syncing()const;
          /// Emitted when syncing finishes (is_finished_syncing will return true)
          boost::signals2::signal<void()> syncing_finished;
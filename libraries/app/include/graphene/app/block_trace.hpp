@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/apply_profile.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/time.hpp>
+
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace graphene { namespace app {
+
+   /** how long the applied_block handlers of one plugin took, in microseconds */
+   struct plugin_time
+   {
+      std::string plugin;
+      uint64_t    time = 0;
+   };
+
+   /** the timings of one block the p2p node handed to the chain, see block_tracer; durations in microseconds */
+   struct block_trace
+   {
+      uint32_t                               block_num = 0;
+      chain::block_id_type                   block_id;
+      bool                                   sync_mode = false;
+      /** when the p2p node received the block, for sync blocks when it was handed to the chain */
+      fc::time_point                         received;
+      /** when the chain thread started pushing it */
+      fc::time_point                         push_start;
+      uint64_t                               push_time = 0;
+      /** the phases of applying it, missing if it was not applied, e.g. because it is on a fork */
+      fc::optional<chain::block_apply_profile> apply;
+      /** the applied_block handlers of the plugins, in the order they ran */
+      std::vector<plugin_time>               plugin_times;
+      /** when the p2p node started rebroadcasting it and how long that took, unset for sync blocks */
+      fc::time_point                         broadcast_start;
+      uint64_t                               broadcast_time = 0;
+   };
+
+   /**
+    * @brief Keeps the timings of the last blocks the p2p node handed to the chain
+    *
+    * The application starts a trace when it pushes a block from the network, the plugins' applied_block handlers
+    * add their times to it while it is pushed, and the p2p node reports rebroadcasting the block afterwards from
+    * its own thread.  If a trace file is given, every block is also appended to it as events in the Chrome trace
+    * format, which chrome://tracing and Perfetto open although the closing bracket is never written.
+    */
+   class block_tracer
+   {
+      public:
+         block_tracer( uint32_t capacity, const fc::path& trace_file = fc::path() );
+
+         /** @{ only to be called on the chain thread */
+         void start( uint32_t block_num, const chain::block_id_type& id, bool sync_mode );
+         /** true between start() and finish() */
+         bool tracing()const { return _tracing; }
+         void add_plugin_time( const std::string& plugin, uint64_t time );
+         /** apply is the profile of the block if it was the last one applied */
+         void finish( const fc::optional<chain::block_apply_profile>& apply );
+         /** @} */
+
+         void note_broadcast( const chain::block_id_type& id, fc::time_point received, fc::time_point broadcast_start,
+                              fc::time_point broadcast_end );
+
+         /** @return the last limit traces, newest first */
+         std::vector<block_trace> get( uint32_t limit )const;
+
+      private:
+         void write_event( const char* name, uint32_t block_num, uint32_t thread, fc::time_point start,
+                           uint64_t duration );
+
+         const uint32_t            _capacity;
+         /** the trace being pushed, only touched on the chain thread */
+         block_trace               _current;
+         bool                      _tracing = false;
+
+         mutable std::mutex        _mutex;
+         std::deque<block_trace>   _traces;
+         std::ofstream             _file;
+   };
+
+} } // graphene::app
+
+FC_REFLECT( graphene::app::plugin_time, (plugin)(time) )
+FC_REFLECT( graphene::app::block_trace,
+            (block_num)(block_id)(sync_mode)(received)(push_start)(push_time)(apply)(plugin_times)
+            (broadcast_start)(broadcast_time) )
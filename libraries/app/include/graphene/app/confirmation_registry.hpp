@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/operation_history_object.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace graphene { namespace app {
+
+   /**
+    * @brief Tells the API sessions waiting for transactions when a block includes them or makes them irreversible
+    *
+    * One registry watches the applied blocks for all sessions, so the ids of a block's transactions are found once
+    * however many sessions are connected.  A callback runs on the chain thread for the first block that includes its
+    * transaction, or once that block is irreversible if it was asked to wait for that, and is forgotten then, when
+    * the session that added it is gone, or once a block is applied past the transaction's expiration, after which no
+    * block can include it.  A transaction that was included in a block that is popped is waited for again.
+    *
+    * Sessions can also watch accounts, to be told about each operation impacting them once its block is
+    * irreversible.
+    */
+   class confirmation_registry
+   {
+      public:
+         typedef std::function< void( const chain::transaction_id_type& id, uint32_t block_num, uint32_t trx_num,
+                                      const chain::processed_transaction& trx ) > callback;
+         typedef std::function< void( const chain::operation_history_object& op ) > operation_callback;
+
+         /** the most watches one owner may have, and the most accounts one watch may name */
+         static const size_t max_watches_per_owner = 10;
+         static const size_t max_watched_accounts  = 100;
+
+         confirmation_registry( chain::database& db );
+
+         /**
+          * owner is the session waiting, its callbacks are dropped rather than run once it is destroyed; with
+          * irreversible set the callback waits until the block including trx is irreversible
+          */
+         void add( const chain::signed_transaction& trx, std::weak_ptr<void> owner, callback cb,
+                   bool irreversible = false );
+
+         /**
+          * calls cb with the operations impacting any of accounts, in order, once their block is irreversible; throws
+          * if accounts names more than max_watched_accounts or owner already has max_watches_per_owner watches
+          */
+         void watch_accounts( const fc::flat_set<chain::account_id_type>& accounts, std::weak_ptr<void> owner,
+                              operation_callback cb );
+
+         /** @return the number of callbacks waiting for a transaction, included or not */
+         size_t size()const;
+
+      private:
+         struct waiting
+         {
+            std::weak_ptr<void>  owner;
+            callback             cb;
+            fc::time_point_sec   expiration;
+            bool                 irreversible = false;
+         };
+         /** a transaction waiting for its block to be irreversible */
+         struct included
+         {
+            waiting                        w;
+            chain::transaction_id_type     id;
+            uint32_t                       trx_num = 0;
+            chain::processed_transaction   trx;
+         };
+         struct account_watch
+         {
+            std::weak_ptr<void>                 owner;
+            fc::flat_set<chain::account_id_type>    accounts;
+            operation_callback                  cb;
+         };
+         typedef std::pair< std::shared_ptr<account_watch>, chain::operation_history_object > watched_operation;
+
+         void on_applied_block( const chain::signed_block& b );
+         fc::flat_set<chain::account_id_type> get_accounts( const chain::operation_history_object& op )const;
+
+         chain::database&                                                  _db;
+         mutable std::mutex                                                _mutex;
+         std::multimap< chain::transaction_id_type, waiting >              _waiting;
+         std::multimap< fc::time_point_sec, chain::transaction_id_type >   _by_expiration;
+         /** by the number of the block that includes them */
+         std::multimap< uint32_t, included >                               _included;
+         std::vector< std::shared_ptr<account_watch> >                     _watches;
+         /** by block number, and in the order they were applied */
+         std::multimap< uint32_t, watched_operation >                      _watched_operations;
+         boost::signals2::scoped_connection                                _applied_block_connection;
+   };
+
+} } // graphene::app
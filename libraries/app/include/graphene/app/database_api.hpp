@@ -24,6 +24,7 @@
 #pragma once
 
 #include <graphene/app/full_account.hpp>
+#include <graphene/app/state_replica.hpp>
 
 #include <graphene/chain/protocol/types.hpp>
 
@@ -107,6 +108,33 @@ struct market_trade
    double                     value;
 };
 
+/**
+ * One message of a market data feed, see @ref database_api::subscribe_to_market_data.  The first message of a
+ * subscription has sequence 0 and holds every level of the book; each later one holds the levels that changed in
+ * one block, with a removed level reported with an order_count of 0, and the trades of that block.
+ */
+struct market_data_update
+{
+   asset_id_type                  base;       ///< the asset with the lower id
+   asset_id_type                  quote;
+   uint64_t                       sequence = 0;
+   uint32_t                       block_num = 0;
+   fc::time_point_sec             time;
+   vector<order_book_level>       levels;
+   /** one per match, the fill of the side that paid in base */
+   vector<fill_order_operation>   fills;
+};
+
+/**
+ * An object as @ref database_api::get_versioned_objects returns it.  Version 0 means there is no such object.
+ */
+struct versioned_object
+{
+   uint64_t                 version = 0;
+   /** the object, left out when the caller already had this version of it */
+   optional<fc::variant>    value;
+};
+
 /**
  * @brief The database_api class implements the RPC API for the chain database.
  *
@@ -117,9 +145,41 @@ struct market_trade
 class database_api
 {
    public:
-      database_api(graphene::chain::database& db);
+      /**
+       * @param replica if given, get_objects of the types it replicates reads its latest version rather than db,
+       *    off the thread applying blocks and without the pending transactions
+       */
+      database_api(graphene::chain::database& db, std::shared_ptr<const state_replica> replica = nullptr);
       ~database_api();
 
+      /**
+       * Sets the number of threads, shared by every connection, that large batch reads such as get_full_accounts of
+       * many accounts are spread over, and that run_on_read_thread() uses.  They read under
+       * database::lock_state_for_reading(), 0 reads on the calling thread.
+       */
+      static void set_read_threads( uint32_t thread_count );
+
+      /**
+       * Runs read on one of the read threads under database::lock_state_for_reading() and waits for it.  The
+       * waiting task yields, so the calling thread keeps handling blocks and other connections meanwhile.  Without
+       * read threads, read simply runs on the calling thread.
+       */
+      static void run_on_read_thread( const graphene::chain::database& db, const std::function<void()>& read );
+
+      /**
+       * Sets how many batches of object changes may wait to be sent to one connection.  A connection falling further
+       * behind loses its subscriptions, so it cannot hold up the node or grow its queue without bound.  0 for no
+       * limit.
+       */
+      static void set_max_queued_notifications( uint32_t batches );
+
+      /**
+       * Sets the number of threads that serialize and send the notifications of the subscriptions.  Each connection
+       * is given one of them when it is created, so its notifications stay in order while the connections are spread
+       * over the threads.  0 sends them from the application thread.
+       */
+      static void set_notification_threads( uint32_t thread_count );
+
       /////////////
       // Objects //
       /////////////
@@ -133,6 +193,18 @@ class database_api
        */
       fc::variants get_objects(const vector<object_id_type>& ids)const;
 
+      /**
+       * @brief Get the objects that changed since the caller last read them
+       * @param ids IDs of the objects to retrieve
+       * @param known_versions the version of each object the caller has, or empty to get all of them
+       * @return The version of each object, in the order of ids, with its value only if that isn't the known one
+       *
+       * Every change to an object, undoing one included, gives it a new version, so pollers can skip reading and
+       * sending objects that did not change.
+       */
+      vector<versioned_object> get_versioned_objects( const vector<object_id_type>& ids,
+                                                      const vector<uint64_t>& known_versions )const;
+
       ///////////////////
       // Subscriptions //
       ///////////////////
@@ -262,6 +334,14 @@ class database_api
        */
       map<string,account_id_type> lookup_accounts(const string& lower_bound_name, uint32_t limit)const;
 
+      /**
+       * @brief Get names and IDs of the registered accounts whose names start with a prefix
+       * @param prefix Start of the names to return
+       * @param limit Maximum number of results to return -- must not exceed 1000
+       * @return Map of account names to corresponding IDs, stopping at the last name with the prefix
+       */
+      map<string,account_id_type> lookup_accounts_by_prefix(const string& prefix, uint32_t limit)const;
+
       //////////////
       // Balances //
       //////////////
@@ -284,6 +364,13 @@ class database_api
 
       vector<vesting_balance_object> get_vesting_balances( account_id_type account_id )const;
 
+      /**
+       * @brief Get how much may be withdrawn from vesting balances now
+       * @param ids IDs of the vesting balances
+       * @return The allowed withdrawal of each of the vesting balances, in the order given
+       */
+      vector<asset> get_allowed_vesting_withdraws( const vector<vesting_balance_id_type>& ids )const;
+
       /**
        * @brief Get the total number of accounts registered with the blockchain
        */
@@ -310,6 +397,14 @@ class database_api
        */
       vector<asset_object> list_assets(const string& lower_bound_symbol, uint32_t limit)const;
 
+      /**
+       * @brief Get the assets whose symbols start with a prefix, alphabetically
+       * @param prefix Start of the symbols to retrieve
+       * @param limit Maximum number of assets to fetch (must not exceed 100)
+       * @return The assets found, stopping at the last symbol with the prefix
+       */
+      vector<asset_object> list_assets_by_prefix(const string& prefix, uint32_t limit)const;
+
       /**
        * @brief Get a list of assets by symbol
        * @param asset_symbols Symbols or stringified IDs of the assets to retrieve
@@ -372,6 +467,28 @@ class database_api
        */
       void unsubscribe_from_market( asset_id_type a, asset_id_type b );
 
+      /**
+       * @brief Request the order book of the market between two assets, and then its changes block by block
+       * @param callback Callback method which is passed each later update
+       * @param a First asset ID
+       * @param b Second asset ID
+       * @return the current book, with sequence 0
+       *
+       * After each block that changed the book or traded in the market, callback is passed a market_data_update
+       * whose sequence is one more than that of the previous update, so a client can keep a copy of the book by
+       * applying the updates in turn, and subscribe again if it sees a gap.  Popped blocks are reported as changes
+       * like any others, since updates compare the book with the one last sent.
+       */
+      market_data_update subscribe_to_market_data( std::function<void(const variant&)> callback,
+                                                   asset_id_type a, asset_id_type b );
+
+      /**
+       * @brief Stop the market data feed of a given market
+       * @param a First asset ID
+       * @param b Second asset ID
+       */
+      void unsubscribe_from_market_data( asset_id_type a, asset_id_type b );
+
       /**
        * @brief Returns the ticker for the market assetA:assetB
        * @param a String name of the first asset
@@ -388,11 +505,28 @@ class database_api
        */
       market_volume get_24_volume( const string& base, const string& quote )const;
 
+      /**
+       * @brief Returns the lifetime trading totals of the market a:b, as of the last irreversible block
+       * @param a ID of one asset of the market
+       * @param b ID of the other asset
+       * @return The totals, null if the market never traded
+       */
+      optional<market_stats_object> get_market_stats( asset_id_type a, asset_id_type b )const;
+
+      /**
+       * @brief Returns the lifetime trading volume and market fees of assets over all their markets, as of the last
+       * irreversible block
+       * @param asset_ids IDs of the assets
+       * @return The totals of each asset, null for assets that never traded
+       */
+      vector<optional<asset_market_stats_object>> get_asset_market_stats( const vector<asset_id_type>& asset_ids )const;
+
       /**
        * @brief Returns the order book for the market base:quote
        * @param base String name of the first asset
        * @param quote String name of the second asset
-       * @param depth of the order book. Up to depth of each asks and bids, capped at 50. Prioritizes most moderate of each
+       * @param limit number of price levels of each of asks and bids, capped at 50. Prioritizes most moderate of each.
+       * Each entry aggregates all orders at its price
        * @return Order book of the market
        */
       order_book get_order_book( const string& base, const string& quote, unsigned limit = 50 )const;
@@ -566,10 +700,13 @@ FC_REFLECT( graphene::app::order_book, (base)(quote)(bids)(asks) );
 FC_REFLECT( graphene::app::market_ticker, (base)(quote)(latest)(lowest_ask)(highest_bid)(percent_change)(base_volume)(quote_volume) );
 FC_REFLECT( graphene::app::market_volume, (base)(quote)(base_volume)(quote_volume) );
 FC_REFLECT( graphene::app::market_trade, (date)(price)(amount)(value) );
+FC_REFLECT( graphene::app::versioned_object, (version)(value) );
+FC_REFLECT( graphene::app::market_data_update, (base)(quote)(sequence)(block_num)(time)(levels)(fills) );
 
 FC_API(graphene::app::database_api,
    // Objects
    (get_objects)
+   (get_versioned_objects)
 
    // Subscriptions
    (set_subscribe_callback)
@@ -600,6 +737,7 @@ FC_API(graphene::app::database_api,
    (get_account_references)
    (lookup_account_names)
    (lookup_accounts)
+   (lookup_accounts_by_prefix)
    (get_account_count)
 
    // Balances
@@ -608,10 +746,12 @@ FC_API(graphene::app::database_api,
    (get_balance_objects)
    (get_vested_balances)
    (get_vesting_balances)
+   (get_allowed_vesting_withdraws)
 
    // Assets
    (get_assets)
    (list_assets)
+   (list_assets_by_prefix)
    (lookup_asset_symbols)
 
    // Markets / feeds
@@ -622,8 +762,12 @@ FC_API(graphene::app::database_api,
    (get_margin_positions)
    (subscribe_to_market)
    (unsubscribe_from_market)
+   (subscribe_to_market_data)
+   (unsubscribe_from_market_data)
    (get_ticker)
    (get_24_volume)
+   (get_market_stats)
+   (get_asset_market_stats)
    (get_trade_history)
 
    // Witnesses
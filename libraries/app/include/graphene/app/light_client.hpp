@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/app/api.hpp>
+#include <graphene/chain/protocol/block.hpp>
+
+#include <fc/network/http/websocket.hpp>
+#include <fc/rpc/websocket_api.hpp>
+
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace graphene { namespace app {
+
+   using graphene::chain::block_id_type;
+   using graphene::chain::public_key_type;
+   using graphene::chain::signed_block_header;
+   using graphene::chain::witness_id_type;
+
+   /**
+    * @brief The headers of a chain, checked without applying the blocks
+    *
+    * Every header pushed must follow the head and be signed with the signing key of an active witness, and the last
+    * irreversible block is found from the newest block each active witness signed, as the chain database does.
+    * Which witnesses are active and their keys aren't known from the headers alone, they are set by the caller.
+    *
+    * The witness schedule is not followed: a header signed by any active witness is accepted in any slot.  The
+    * order of the schedule depends on the slots the chain skipped at maintenance, which the headers don't tell.
+    */
+   class header_chain
+   {
+      public:
+         typedef flat_map<witness_id_type, public_key_type> witness_keys;
+
+         /** starts over from a header the caller trusts, which is irreversible */
+         void reset( const signed_block_header& anchor, const witness_keys& active_witnesses );
+         /** the witnesses active from the next header on */
+         void set_active_witnesses( const witness_keys& active_witnesses );
+         const witness_keys& active_witnesses()const { return _active_witnesses; }
+
+         /** checks that h follows the head and is signed by an active witness, and makes it the head */
+         void push( const signed_block_header& h );
+         /** drops the headers after block_num, which must not be below the last irreversible block */
+         void pop_to( uint32_t block_num );
+
+         uint32_t           head_block_num()const { return signed_block_header::num_from_id( head().id ); }
+         block_id_type      head_block_id()const { return head().id; }
+         fc::time_point_sec head_block_time()const { return head().timestamp; }
+         uint32_t           last_irreversible_block_num()const
+         {
+            return signed_block_header::num_from_id( _last_irreversible.id );
+         }
+         /** @return the id of a block from the last irreversible one to the head */
+         optional<block_id_type> get_block_id( uint32_t block_num )const;
+
+      private:
+         struct pushed_header
+         {
+            block_id_type      id;
+            witness_id_type    witness;
+            fc::time_point_sec timestamp;
+         };
+
+         const pushed_header& head()const { return _reversible.empty() ? _last_irreversible : _reversible.back(); }
+         void update_last_irreversible_block();
+
+         witness_keys                              _active_witnesses;
+         /** the headers after the last irreversible block, oldest first */
+         std::deque<pushed_header>                 _reversible;
+         /** the newest block each witness signed */
+         flat_map<witness_id_type, uint32_t>       _confirmations;
+         /** the same up to the last irreversible block, which the others are counted from again after popping */
+         flat_map<witness_id_type, uint32_t>       _irreversible_confirmations;
+
+         pushed_header                             _last_irreversible;
+   };
+
+   /**
+    * @brief Follows the block headers of another node, for monitoring nodes which keep no chain state
+    *
+    * The client starts from the last irreversible block of the server and fetches the headers after it in bulk
+    * with packed_api::get_block_headers, then asks for new headers every block interval.  The headers are checked
+    * in a header_chain, no transaction is applied.  The active witnesses and their signing keys are those the
+    * server reports: they are fetched at the start, after every maintenance and whenever a header is signed by a
+    * witness or a key the client doesn't know.  The server only knows its current witnesses, so a header from
+    * before the maintenance that chose them which they can't check is an error, and the client starts over from
+    * the server's last irreversible block.  A server switching to a fork is followed back to the last
+    * irreversible block; a server whose chain differs from an irreversible header is an error.
+    *
+    * All methods are called on the thread the client was created on, which is also where the headers are pushed.
+    */
+   class light_client
+   {
+      public:
+         struct config
+         {
+            std::string server;            ///< websocket endpoint of the node to follow
+            std::string user;
+            std::string password;
+         };
+
+         light_client( const config& cfg );
+         ~light_client();
+
+         /** starts following the server */
+         void start();
+
+         const header_chain& headers()const { return _headers; }
+
+         /** emitted for every header pushed, after it became the head */
+         boost::signals2::signal<void(const signed_block_header&)> applied_header;
+
+      private:
+         static const uint32_t         headers_per_call = 1000;
+         static const fc::microseconds retry_interval;
+
+         void connect();
+         void disconnect();
+         /** connects if needed, fetches the new headers and schedules the next poll, or another try */
+         void follow();
+         void sync();
+         /** goes back to where the server's chain and the local headers meet */
+         void rewind();
+         void push( const signed_block_header& h );
+         header_chain::witness_keys fetch_active_witnesses();
+         void schedule_follow( const fc::microseconds& delay );
+         /** @return the header of a block of the server, if it has it */
+         optional<signed_block_header> fetch_header( uint32_t block_num );
+
+         config                                          _config;
+         fc::thread*                                     _thread;
+         bool                                            _stopped = false;
+         bool                                            _started = false;
+         header_chain                                    _headers;
+         fc::time_point_sec                              _next_maintenance_time;
+         /** when the maintenance that chose the active witnesses last fetched was */
+         fc::time_point_sec                              _witnesses_since;
+         fc::microseconds                                _poll_interval = fc::seconds( 5 );
+
+         std::unique_ptr<fc::http::websocket_client>     _client;
+         fc::http::websocket_connection_ptr              _connection;
+         std::shared_ptr<fc::rpc::websocket_api_connection> _api_connection;
+         boost::signals2::scoped_connection              _closed_connection;
+         optional< fc::api<database_api> >               _database_api;
+         optional< fc::api<packed_api> >                 _packed_api;
+         fc::future<void>                                _next_poll;
+   };
+
+} } // graphene::app
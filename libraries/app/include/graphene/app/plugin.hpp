@@ -25,8 +25,16 @@
 
 #include <graphene/app/application.hpp>
 
+#include <graphene/chain/operation_history_object.hpp>
+
 #include <boost/program_options.hpp>
 #include <fc/io/json.hpp>
+#include <fc/thread/future.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <deque>
+#include <functional>
+#include <memory>
 
 namespace graphene { namespace app {
 
@@ -114,10 +122,59 @@ class plugin : public abstract_plugin
    protected:
       net::node& p2p_node() { return *app().p2p_node(); }
 
+      /**
+       * Connects handler to the database's applied_block signal, timed under the plugin's name for the block
+       * trace when blocks are traced, see block_tracer.
+       */
+      boost::signals2::connection connect_applied_block( std::function<void(const chain::signed_block&)> handler );
+
    private:
       application* _app = nullptr;
 };
 
+/** what an @ref applied_block_queue hands its handler for each applied block */
+struct applied_block_data
+{
+   chain::signed_block                                   block;
+   /** shared with the database rather than copied, see database::share_applied_operations() */
+   std::shared_ptr< const vector< optional< chain::operation_history_object > > > operations;
+   uint32_t                                              last_irreversible_block_num = 0;
+};
+
+/**
+ * @brief Runs a plugin's handling of applied blocks on a thread of its own
+ *
+ * The block and the last irreversible block number are copied on the chain thread, the applied operations shared, and
+ * handled in order on the queue's thread, so the next block can be applied meanwhile.  This is only for plugins
+ * that keep their state outside the chain database, the handler must not touch the database, and has to guard
+ * whatever it shares with API calls.
+ *
+ * Once max_pending blocks wait to be handled, applying the next one waits for the oldest, so a slow plugin holds
+ * back the chain instead of falling further behind.  A handler that throws is logged and the block skipped.
+ */
+class applied_block_queue
+{
+   public:
+      typedef std::function< void( const applied_block_data& ) > handler_type;
+
+      applied_block_queue( const std::string& name, handler_type handler, uint32_t max_pending = 100 );
+      /** waits for the blocks still queued */
+      ~applied_block_queue();
+
+      /** pushes every block applied to db from now on */
+      void connect( chain::database& db );
+      void push( applied_block_data&& data );
+
+      /** waits until the blocks pushed so far have been handled */
+      void wait();
+
+   private:
+      handler_type                       _handler;
+      uint32_t                           _max_pending;
+      fc::thread                         _thread;
+      std::deque< fc::future<void> >     _pending;
+};
+
 /// @group Some useful tools for boost::program_options arguments using vectors of JSON strings
 /// @{
 template<typename T>
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <fc/time.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace graphene { namespace app {
+
+   /** refills at rate units per second up to burst units; a rate of 0 never runs out */
+   class token_bucket
+   {
+      public:
+         token_bucket( uint32_t rate = 0, uint32_t burst = 0 )
+            : _rate( rate ), _burst( burst ), _tokens( burst ) {}
+
+         /** @return true if cost units are there at now */
+         bool available( uint32_t cost, fc::time_point now );
+         /** takes cost units, which must be available() */
+         void take( uint32_t cost ) { if( _rate > 0 ) _tokens -= cost; }
+         /** true if it refilled to the full burst by now */
+         bool is_full( fc::time_point now );
+
+      private:
+         void refill( fc::time_point now );
+
+         uint32_t        _rate;
+         uint32_t        _burst;
+         double          _tokens;
+         fc::time_point  _last;
+   };
+
+   /**
+    * @brief Limits the API calls of each connection, and of all connections from one address together
+    *
+    * Every call costs the units configured for its method, 1 by default, taken from a token bucket of the
+    * connection and one of its address.  A call that finds either bucket short is rejected before it is dispatched,
+    * and costs nothing.  The buckets of the connections are kept by the connections themselves, those of the
+    * addresses here.
+    */
+   class api_rate_limits
+   {
+      public:
+         struct limits
+         {
+            uint32_t connection_rate = 0;   ///< units per second, 0 for no limit
+            uint32_t connection_burst = 0;
+            uint32_t address_rate = 0;      ///< units per second, 0 for no limit
+            uint32_t address_burst = 0;
+            /** by method name, e.g. get_account_history */
+            std::map<std::string, uint32_t> method_costs;
+         };
+
+         explicit api_rate_limits( const limits& l ) : _limits( l ) {}
+
+         /** parses method=cost, e.g. get_trade_history=20 */
+         static std::pair<std::string, uint32_t> parse_method_cost( const std::string& s );
+
+         bool enabled()const { return _limits.connection_rate > 0 || _limits.address_rate > 0; }
+         uint32_t cost_of( const std::string& method )const;
+         /** a bucket for a new connection */
+         token_bucket connection_bucket()const
+         {
+            return token_bucket( _limits.connection_rate, _limits.connection_burst );
+         }
+
+         /**
+          * @return true if both the connection's bucket and the bucket of address have cost units at now, and takes
+          * them from both
+          */
+         bool take( token_bucket& connection, const std::string& address, uint32_t cost, fc::time_point now );
+
+      private:
+         const limits                           _limits;
+         std::mutex                             _mutex;
+         std::map<std::string, token_bucket>    _addresses;
+         /** when the full buckets of the addresses were last dropped */
+         fc::time_point                         _last_prune;
+   };
+
+} } // graphene::app
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/app/api.hpp>
+#include <graphene/chain/database.hpp>
+
+#include <fc/network/http/websocket.hpp>
+#include <fc/rpc/websocket_api.hpp>
+
+#include <memory>
+#include <string>
+
+namespace graphene { namespace app {
+
+   /**
+    * @brief Follows the replication_api of a primary node, which makes this node its hot standby
+    *
+    * The client fetches the blocks the local chain is missing from the primary and then pushes every block the
+    * primary applies as soon as it is sent, which keeps the standby within a block of it.  Trusted blocks are
+    * pushed without checking their signatures, authorities and merkle roots again, which is most of the work
+    * of applying them; the primary already did.  A failed or closed connection is retried every retry_interval.
+    *
+    * All methods are called on the thread the chain database is used on, which is also where the blocks are
+    * pushed.
+    */
+   class replication_client
+   {
+      public:
+         struct config
+         {
+            std::string server;            ///< websocket endpoint of the primary
+            std::string user;
+            std::string password;
+            bool        trusted = false;   ///< skip the checks the primary did when pushing its blocks
+         };
+
+         /** what trusted blocks are pushed without */
+         static const uint32_t trusted_skip = graphene::chain::database::skip_witness_signature |
+                                              graphene::chain::database::skip_transaction_signatures |
+                                              graphene::chain::database::skip_authority_check |
+                                              graphene::chain::database::skip_merkle_check |
+                                              graphene::chain::database::skip_validate;
+
+         replication_client( graphene::chain::database& db, const config& cfg );
+         ~replication_client();
+
+         /**
+          * Copies the newest state checkpoint of the primary below dir and stores its head block in the block
+          * log at block_log_dir, so that database::reindex_from_snapshot can start from it.
+          *
+          * @return the directory of the copied checkpoint
+          */
+         fc::path fetch_state_checkpoint( const fc::path& dir, const fc::path& block_log_dir );
+
+         /** starts following the primary */
+         void start();
+
+      private:
+         static const uint32_t        read_size = 1024 * 1024;
+         static const fc::microseconds retry_interval;
+
+         void connect();
+         void disconnect();
+         /** connects, catches up and subscribes to the blocks, or schedules another try */
+         void follow();
+         /** pushes the blocks after the local head up to the primary's current head */
+         void catch_up();
+         void on_block( const fc::variant& packed_block );
+         void push( const graphene::chain::signed_block& b );
+
+         graphene::chain::database&                      _db;
+         config                                          _config;
+         fc::thread*                                     _chain_thread;
+         bool                                            _stopped = false;
+
+         std::unique_ptr<fc::http::websocket_client>     _client;
+         fc::http::websocket_connection_ptr              _connection;
+         std::shared_ptr<fc::rpc::websocket_api_connection> _api_connection;
+         boost::signals2::scoped_connection              _closed_connection;
+         optional< fc::api<packed_api> >                 _packed_api;
+         optional< fc::api<replication_api> >            _replication_api;
+         fc::future<void>                                _retry;
+   };
+
+} } // graphene::app
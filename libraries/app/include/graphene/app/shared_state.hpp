@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/database.hpp>
+
+#include <fc/interprocess/file_mapping.hpp>
+#include <fc/thread/future.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <map>
+#include <memory>
+
+namespace graphene { namespace app {
+
+   namespace detail { struct shared_state_header; struct shared_state_base_info; }
+
+   /**
+    * @brief Shares the objects of selected types with processes on the same host through a memory mapped file
+    *
+    * The objects can't live in the mapped file themselves, their strings, vectors and maps are allocated from the
+    * heap of the process holding them.  Instead the file holds a ring of frames, each with the packed objects a
+    * block changed, which the writer appends after every block, and next to it a base file with every shared
+    * object, written when the ring is about to overwrite frames that a follower loading the newest base still
+    * needs.  A follower loads the newest base into the indexes of its own database and then applies the frames
+    * as they are published, so that API processes serve the state of the validating node without applying
+    * blocks.
+    *
+    * Like state_replica, the changes of a block are taken from its undo session when applied_block is emitted;
+    * popped blocks and blocks applied without undo state are published as a new base.
+    *
+    * Bases are written on a thread of their own, from a copy of the shared objects it keeps up to date with the
+    * frames, so applying a block only costs packing what it changed.  A new base is asked for once half the ring
+    * is used since the last one, and a block only waits for it if the ring fills up before it is written.
+    */
+   class shared_state_writer
+   {
+      public:
+         typedef std::pair< uint8_t, uint8_t > object_type; ///< space and type
+         static const uint64_t min_ring_size = 1024 * 1024;
+
+         /**
+          * Maps file, creating it if it doesn't exist or has another ring size, and publishes a base of the
+          * current state.  The global, dynamic global and chain properties are always shared.
+          */
+         shared_state_writer( chain::database& db, const fc::path& file, uint64_t ring_size,
+                              const flat_set<object_type>& types );
+         ~shared_state_writer();
+
+      private:
+         void publish( const chain::signed_block& b );
+         void write_frame( const vector<char>& frame );
+         /** packs every shared object, for _base_thread to replace its copy with, and asks for a base of them */
+         void reset_base();
+         /** asks _base_thread for a base of its copy, as of the current ring position and head block */
+         void request_base();
+         /** once the base asked for is written, or right away if wait, makes it the one frames must not overwrite */
+         void finish_base( bool wait );
+         /** has _base_thread apply the records of a frame to its copy */
+         void post_records( vector<chain::object_record>&& records );
+         /** on _base_thread, writes its copy to the file of the next base and publishes it */
+         void write_base_file( const detail::shared_state_base_info& info );
+
+         chain::database&                    _db;
+         fc::path                            _file;
+         flat_set<object_type>               _types;
+         std::unique_ptr<fc::file_mapping>   _mapping;
+         std::unique_ptr<fc::mapped_region>  _region;
+         detail::shared_state_header*        _header = nullptr;
+         char*                               _ring = nullptr;
+         /** the ring position the newest base holds the state up to */
+         uint64_t                            _base_position = 0;
+         uint32_t                            _last_block_num = 0;
+         bool                                _needs_base = true;
+         /** the base being written, and the ring position it holds the state up to */
+         fc::future<void>                    _pending_base;
+         uint64_t                            _pending_base_position = 0;
+         /** the packed shared objects as of the last frame, only used on _base_thread */
+         std::map< object_id_type, vector<char> > _objects;
+         boost::signals2::scoped_connection  _applied_block_connection;
+         /** last, so it is stopped before the members its tasks use are destroyed */
+         std::unique_ptr<fc::thread>         _base_thread;
+   };
+
+   /**
+    * @brief Keeps the indexes of a database that applies no blocks up to date with a shared_state_writer
+    *
+    * The changes are applied on the thread poll() is called on, through database::apply_object_records, so that
+    * readers holding database::lock_state_for_reading() see whole blocks.  A follower which falls more than the
+    * ring behind, or whose writer restarted, loads the newest base again.
+    */
+   class shared_state_follower
+   {
+      public:
+         /** maps file, disables the undo database of db and loads the state if the writer has published any */
+         shared_state_follower( chain::database& db, const fc::path& file );
+         ~shared_state_follower();
+
+         /** applies what the writer published since the last call @return whether anything changed */
+         bool poll();
+         /** calls poll() every interval on the current thread until destroyed */
+         void start( fc::microseconds interval );
+
+         /** the last block whose changes were applied */
+         uint32_t block_num()const { return _block_num; }
+
+      private:
+         bool load_base();
+         void schedule_poll();
+
+         chain::database&                     _db;
+         fc::path                             _file;
+         std::unique_ptr<fc::file_mapping>    _mapping;
+         std::unique_ptr<fc::mapped_region>   _region;
+         const detail::shared_state_header*   _header = nullptr;
+         const char*                          _ring = nullptr;
+         uint64_t                             _epoch = 0;
+         uint64_t                             _base_generation = 0;
+         uint64_t                             _position = 0;
+         uint32_t                             _block_num = 0;
+         fc::microseconds                     _poll_interval;
+         fc::future<void>                     _poll;
+   };
+
+} } // graphene::app
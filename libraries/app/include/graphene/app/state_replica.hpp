@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/database.hpp>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace graphene { namespace app {
+
+   /**
+    * @brief Publishes immutable copies of selected object types after every block
+    *
+    * Each published version holds the objects of the replicated types as of the end of a block, and stays valid for
+    * as long as anyone holds it, so any number of threads can read it while the chain thread applies the next
+    * blocks.  Versions share storage: objects are kept chunk_size to a chunk, and a new version only copies the
+    * chunks holding an object that its block changed, found from the block's undo session.
+    *
+    * Popped blocks leave no undo record of what they changed, so the construction, the next block after a pop and
+    * every block applied with the undo database disabled rebuild the replica from the whole indexes.
+    */
+   class state_replica
+   {
+      public:
+         static const uint32_t chunk_size = 256;
+         typedef std::pair< uint8_t, uint8_t > object_type; ///< space and type
+
+         class version
+         {
+            public:
+               /** @return the object, or null if it does not exist or its type is not replicated */
+               const object* find( object_id_type id )const;
+               /** the block these objects are the state after */
+               uint32_t      block_num()const { return _block_num; }
+
+            private:
+               friend class state_replica;
+               typedef std::array< std::shared_ptr<const object>, chunk_size > chunk;
+
+               /** the chunks of each replicated type by instance, null for chunks without objects */
+               std::map< object_type, vector< std::shared_ptr<const chunk> > > _chunks;
+               uint32_t                                                       _block_num = 0;
+         };
+
+         state_replica( chain::database& db, const flat_set<object_type>& types );
+
+         bool replicates( object_id_type id )const
+         {
+            return _types.find( object_type( id.space(), id.type() ) ) != _types.end();
+         }
+
+         /** @return the latest version, null if the last block could not be published */
+         std::shared_ptr<const version> current()const;
+
+      private:
+         void publish( uint32_t block_num );
+         void rebuild( version& v )const;
+
+         chain::database&                    _db;
+         flat_set<object_type>               _types;
+         mutable std::mutex                  _current_mutex;
+         std::shared_ptr<const version>      _current;
+         bool                                _needs_rebuild = true;
+         boost::signals2::scoped_connection  _applied_block_connection;
+   };
+
+} } // graphene::app
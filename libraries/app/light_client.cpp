@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/light_client.hpp>
+#include <graphene/chain/config.hpp>
+#include <graphene/chain/global_property_object.hpp>
+#include <graphene/chain/witness_object.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace app {
+
+void header_chain::reset( const signed_block_header& anchor, const witness_keys& active_witnesses )
+{
+   _reversible.clear();
+   _last_irreversible.id = anchor.id();
+   _last_irreversible.witness = anchor.witness;
+   _last_irreversible.timestamp = anchor.timestamp;
+   _irreversible_confirmations.clear();
+   _irreversible_confirmations[anchor.witness] = anchor.block_num();
+   _confirmations = _irreversible_confirmations;
+   _active_witnesses = active_witnesses;
+}
+
+void header_chain::set_active_witnesses( const witness_keys& active_witnesses )
+{
+   _active_witnesses = active_witnesses;
+   update_last_irreversible_block();
+}
+
+void header_chain::push( const signed_block_header& h )
+{
+   FC_ASSERT( h.previous == head_block_id(), "The header does not follow the head",
+              ("head",head_block_id())("previous",h.previous) );
+   FC_ASSERT( h.timestamp > head_block_time(), "The header is not newer than the head",
+              ("head",head_block_time())("timestamp",h.timestamp) );
+   auto key = _active_witnesses.find( h.witness );
+   FC_ASSERT( key != _active_witnesses.end(), "The header is signed by ${w}, which is not an active witness",
+              ("w",h.witness)("block_num",h.block_num()) );
+   FC_ASSERT( h.validate_signee( key->second ), "The header is not signed with the key of ${w}",
+              ("w",h.witness)("block_num",h.block_num()) );
+
+   pushed_header pushed;
+   pushed.id = h.id();
+   pushed.witness = h.witness;
+   pushed.timestamp = h.timestamp;
+   _reversible.push_back( pushed );
+   _confirmations[h.witness] = h.block_num();
+   update_last_irreversible_block();
+}
+
+void header_chain::pop_to( uint32_t block_num )
+{
+   FC_ASSERT( block_num >= last_irreversible_block_num(), "Irreversible headers can't be popped",
+              ("block_num",block_num)("last_irreversible",last_irreversible_block_num()) );
+   while( !_reversible.empty() && signed_block_header::num_from_id( _reversible.back().id ) > block_num )
+      _reversible.pop_back();
+
+   _confirmations = _irreversible_confirmations;
+   for( const auto& h : _reversible )
+      _confirmations[h.witness] = signed_block_header::num_from_id( h.id );
+}
+
+optional<block_id_type> header_chain::get_block_id( uint32_t block_num )const
+{
+   const uint32_t last_irreversible = last_irreversible_block_num();
+   if( block_num == last_irreversible )
+      return _last_irreversible.id;
+   if( block_num < last_irreversible || block_num > head_block_num() )
+      return optional<block_id_type>();
+   // the reversible headers are consecutive
+   return _reversible[ block_num - last_irreversible - 1 ].id;
+}
+
+void header_chain::update_last_irreversible_block()
+{
+   if( _active_witnesses.empty() )
+      return;
+
+   vector<uint32_t> confirmed;
+   confirmed.reserve( _active_witnesses.size() );
+   for( const auto& w : _active_witnesses )
+   {
+      auto itr = _confirmations.find( w.first );
+      confirmed.push_back( itr == _confirmations.end() ? 0 : itr->second );
+   }
+
+   // the same as database::update_last_irreversible_block
+   size_t offset = ((GRAPHENE_100_PERCENT - GRAPHENE_IRREVERSIBLE_THRESHOLD) * confirmed.size() / GRAPHENE_100_PERCENT);
+   std::nth_element( confirmed.begin(), confirmed.begin() + offset, confirmed.end() );
+   const uint32_t new_last_irreversible = confirmed[offset];
+
+   while( !_reversible.empty() && signed_block_header::num_from_id( _reversible.front().id ) <= new_last_irreversible )
+   {
+      _last_irreversible = _reversible.front();
+      _irreversible_confirmations[_last_irreversible.witness] = signed_block_header::num_from_id( _last_irreversible.id );
+      _reversible.pop_front();
+   }
+}
+
+const fc::microseconds light_client::retry_interval = fc::seconds( 5 );
+const uint32_t         light_client::headers_per_call;
+
+light_client::light_client( const config& cfg )
+   : _config( cfg ), _thread( &fc::thread::current() )
+{
+}
+
+light_client::~light_client()
+{
+   _stopped = true;
+   if( _next_poll.valid() && !_next_poll.ready() )
+      _next_poll.cancel_and_wait( "light_client destroyed" );
+   disconnect();
+}
+
+void light_client::connect()
+{ try {
+   disconnect();
+   _client.reset( new fc::http::websocket_client );
+   _connection = _client->connect( _config.server );
+   _api_connection = std::make_shared<fc::rpc::websocket_api_connection>( *_connection );
+   auto login = _api_connection->get_remote_api< login_api >( 1 );
+   FC_ASSERT( login->login( _config.user, _config.password ), "The server did not accept the login" );
+   _database_api = login->database();
+   _packed_api = login->packed();
+   // the next poll connects again
+   _closed_connection = _connection->closed.connect( [this]() {
+      _thread->async( [this]() {
+         if( _stopped )
+            return;
+         wlog( "Lost the connection to ${s}", ("s",_config.server) );
+         disconnect();
+      } );
+   } );
+   ilog( "Connected to ${s}", ("s",_config.server) );
+} FC_CAPTURE_AND_RETHROW( (_config.server) ) }
+
+void light_client::disconnect()
+{
+   _closed_connection.disconnect();
+   _packed_api.reset();
+   _database_api.reset();
+   _api_connection.reset();
+   _connection.reset();
+   _client.reset();
+}
+
+void light_client::start()
+{
+   ilog( "Following the block headers of ${s}", ("s",_config.server) );
+   follow();
+}
+
+void light_client::schedule_follow( const fc::microseconds& delay )
+{
+   _next_poll = _thread->schedule( [this]() { follow(); }, fc::time_point::now() + delay, "light sync" );
+}
+
+void light_client::follow()
+{
+   if( _stopped )
+      return;
+   try
+   {
+      if( !_packed_api )
+         connect();
+      if( !_started )
+      {
+         // the headers before the server's last irreversible block are taken on trust
+         const uint32_t start = (*_database_api)->get_dynamic_global_properties().last_irreversible_block_num;
+         optional<signed_block_header> anchor = fetch_header( start );
+         FC_ASSERT( anchor.valid(), "The server does not have its last irreversible block ${n}", ("n",start) );
+         _headers.reset( *anchor, fetch_active_witnesses() );
+         _started = true;
+         ilog( "Starting from block ${n}", ("n",start) );
+      }
+      sync();
+      schedule_follow( _poll_interval );
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Could not follow ${s}, trying again in ${t} s: ${e}",
+            ("s",_config.server)("t",retry_interval.count()/1000000)("e",e.to_detail_string()) );
+      disconnect();
+      schedule_follow( retry_interval );
+   }
+}
+
+void light_client::sync()
+{
+   while( true )
+   {
+      vector<char> packed = (*_packed_api)->get_block_headers( _headers.head_block_num() + 1, headers_per_call );
+      auto headers = fc::raw::unpack< vector<signed_block_header> >( packed );
+      if( headers.empty() )
+         return;
+      if( headers.front().previous != _headers.head_block_id() )
+      {
+         rewind();
+         continue;
+      }
+      for( const auto& h : headers )
+         push( h );
+      if( headers.size() < headers_per_call )
+         return;
+      ilog( "Light sync at block ${n}, irreversible block ${i}",
+            ("n",_headers.head_block_num())("i",_headers.last_irreversible_block_num()) );
+   }
+}
+
+void light_client::rewind()
+{
+   const uint32_t last_irreversible = _headers.last_irreversible_block_num();
+   uint32_t n = _headers.head_block_num();
+   for( ; n > last_irreversible; --n )
+   {
+      optional<signed_block_header> h = fetch_header( n );
+      if( h.valid() && h->id() == *_headers.get_block_id( n ) )
+         break;
+   }
+   if( n == last_irreversible )
+   {
+      optional<signed_block_header> h = fetch_header( n );
+      FC_ASSERT( h.valid() && h->id() == *_headers.get_block_id( n ),
+                 "The chain of ${s} differs from irreversible block ${n}", ("s",_config.server)("n",n) );
+   }
+   wlog( "${s} switched to a fork, going back to block ${n}", ("s",_config.server)("n",n) );
+   _headers.pop_to( n );
+}
+
+void light_client::push( const signed_block_header& h )
+{
+   try
+   {
+      _headers.push( h );
+   }
+   catch( const fc::exception& )
+   {
+      if( h.previous != _headers.head_block_id() )
+         throw;
+      // the server only reports the witnesses active now, a header from before the maintenance that chose them may
+      // have been signed by witnesses that aren't known, so start over from where the current ones are in charge
+      if( h.timestamp <= _witnesses_since )
+      {
+         _started = false;
+         FC_THROW( "Block ${n} is older than the witnesses ${s} reports, which can't check it, starting over from "
+                   "its last irreversible block",
+                   ("n",h.block_num())("s",_config.server)("witnesses_since",_witnesses_since) );
+      }
+      // the witness may have changed its signing key, or have been voted in, since the set was fetched
+      _headers.set_active_witnesses( fetch_active_witnesses() );
+      _headers.push( h );
+   }
+   // the witnesses voted in at maintenance sign the blocks after the one that started it
+   if( h.timestamp >= _next_maintenance_time )
+      _headers.set_active_witnesses( fetch_active_witnesses() );
+   applied_header( h );
+}
+
+header_chain::witness_keys light_client::fetch_active_witnesses()
+{
+   const auto props = (*_database_api)->get_global_properties();
+   _next_maintenance_time = (*_database_api)->get_dynamic_global_properties().next_maintenance_time;
+   _witnesses_since = fc::time_point_sec( _next_maintenance_time.sec_since_epoch() -
+                                          std::min( _next_maintenance_time.sec_since_epoch(),
+                                                    props.parameters.maintenance_interval ) );
+   _poll_interval = fc::seconds( props.parameters.block_interval );
+
+   vector<witness_id_type> ids( props.active_witnesses.begin(), props.active_witnesses.end() );
+   header_chain::witness_keys keys;
+   for( const auto& w : (*_database_api)->get_witnesses( ids ) )
+      if( w.valid() )
+         keys[w->id] = w->signing_key;
+   return keys;
+}
+
+optional<signed_block_header> light_client::fetch_header( uint32_t block_num )
+{
+   auto headers = fc::raw::unpack< vector<signed_block_header> >( (*_packed_api)->get_block_headers( block_num, 1 ) );
+   if( headers.empty() )
+      return optional<signed_block_header>();
+   return headers.front();
+}
+
+} } // graphene::app
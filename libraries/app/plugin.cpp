@@ -22,7 +22,9 @@
  * THE SOFTWARE.
  */
 
+#include <graphene/app/block_trace.hpp>
 #include <graphene/app/plugin.hpp>
+#include <graphene/chain/database.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
 
 namespace graphene { namespace app {
@@ -58,6 +60,23 @@ void plugin::plugin_shutdown()
    return;
 }
 
+boost::signals2::connection plugin::connect_applied_block( std::function<void(const chain::signed_block&)> handler )
+{
+   application* a = &app();
+   const std::string name = plugin_name();
+   return database().applied_block.connect( [a,name,handler]( const chain::signed_block& b ) {
+      std::shared_ptr<block_tracer> tracer = a->get_block_tracer();
+      if( !tracer || !tracer->tracing() )
+      {
+         handler( b );
+         return;
+      }
+      fc::time_point start = fc::time_point::now();
+      handler( b );
+      tracer->add_plugin_time( name, ( fc::time_point::now() - start ).count() );
+   } );
+}
+
 void plugin::plugin_set_app( application* app )
 {
    _app = app;
@@ -72,4 +91,66 @@ void plugin::plugin_set_program_options(
    return;
 }
 
+applied_block_queue::applied_block_queue( const std::string& name, handler_type handler, uint32_t max_pending )
+   : _handler( std::move( handler ) ), _max_pending( std::max<uint32_t>( max_pending, 1 ) ), _thread( name )
+{
+}
+
+applied_block_queue::~applied_block_queue()
+{
+   wait();
+}
+
+void applied_block_queue::connect( chain::database& db )
+{
+   db.applied_block.connect( [this,&db]( const chain::signed_block& b ) {
+      applied_block_data data;
+      data.block = b;
+      data.operations = db.share_applied_operations();
+      data.last_irreversible_block_num = db.get_dynamic_global_properties().last_irreversible_block_num;
+      push( std::move( data ) );
+   } );
+}
+
+void applied_block_queue::push( applied_block_data&& data )
+{
+   while( !_pending.empty() && _pending.front().ready() )
+      _pending.pop_front();
+   if( _pending.size() >= _max_pending )
+   {
+      _pending.front().wait();
+      _pending.pop_front();
+   }
+
+   auto shared = std::make_shared<applied_block_data>( std::move( data ) );
+   _pending.push_back( _thread.async( [this,shared]() {
+      try
+      {
+         _handler( *shared );
+      }
+      catch( const fc::exception& e )
+      {
+         elog( "Failed to handle block ${n} on ${t}: ${e}",
+               ("n",shared->block.block_num())("t",fc::thread::current().name())("e",e.to_detail_string()) );
+      }
+      catch( const std::exception& e )
+      {
+         elog( "Failed to handle block ${n} on ${t}: ${e}",
+               ("n",shared->block.block_num())("t",fc::thread::current().name())("e",e.what()) );
+      }
+      catch( ... )
+      {
+         elog( "Failed to handle block ${n} on ${t}: ${e}",
+               ("n",shared->block.block_num())("t",fc::thread::current().name())("e",fc::except_str()) );
+      }
+   }, "applied block" ) );
+}
+
+void applied_block_queue::wait()
+{
+   for( auto& f : _pending )
+      f.wait();
+   _pending.clear();
+}
+
 } } // graphene::app
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/rate_limit.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <cctype>
+
+namespace graphene { namespace app {
+
+void token_bucket::refill( fc::time_point now )
+{
+   if( now > _last )
+   {
+      _tokens = std::min<double>( _burst, _tokens + double( ( now - _last ).count() ) * _rate / 1000000 );
+      _last = now;
+   }
+}
+
+bool token_bucket::available( uint32_t cost, fc::time_point now )
+{
+   if( _rate == 0 )
+      return true;
+   refill( now );
+   return _tokens >= cost;
+}
+
+bool token_bucket::is_full( fc::time_point now )
+{
+   if( _rate == 0 )
+      return true;
+   refill( now );
+   return _tokens >= _burst;
+}
+
+std::pair<std::string, uint32_t> api_rate_limits::parse_method_cost( const std::string& s )
+{
+   const auto eq = s.find( '=' );
+   FC_ASSERT( eq != std::string::npos && eq > 0 && eq + 1 < s.size(),
+              "method costs are given as method=cost, e.g. get_trade_history=20, not ${s}", ("s",s) );
+   const std::string cost = s.substr( eq + 1 );
+   FC_ASSERT( std::all_of( cost.begin(), cost.end(), ::isdigit ), "the cost of a method is a number, not ${c}",
+              ("c",cost) );
+   return std::make_pair( s.substr( 0, eq ), uint32_t( std::stoul( cost ) ) );
+}
+
+uint32_t api_rate_limits::cost_of( const std::string& method )const
+{
+   auto itr = _limits.method_costs.find( method );
+   return itr == _limits.method_costs.end() ? 1 : itr->second;
+}
+
+bool api_rate_limits::take( token_bucket& connection, const std::string& address, uint32_t cost,
+                            fc::time_point now )
+{
+   if( !connection.available( cost, now ) )
+      return false;
+   if( _limits.address_rate > 0 )
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      // addresses come and go, those which would be back to a full bucket anyway are forgotten once a minute
+      if( now - _last_prune > fc::seconds( 60 ) )
+      {
+         for( auto itr = _addresses.begin(); itr != _addresses.end(); )
+         {
+            if( itr->second.is_full( now ) )
+               itr = _addresses.erase( itr );
+            else
+               ++itr;
+         }
+         _last_prune = now;
+      }
+      auto itr = _addresses.find( address );
+      if( itr == _addresses.end() )
+         itr = _addresses.emplace( address, token_bucket( _limits.address_rate, _limits.address_burst ) ).first;
+      if( !itr->second.available( cost, now ) )
+         return false;
+      itr->second.take( cost );
+   }
+   connection.take( cost );
+   return true;
+}
+
+} } // graphene::app
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/replication_client.hpp>
+#include <graphene/chain/block_database.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <fstream>
+
+namespace graphene { namespace app {
+
+const uint32_t         replication_client::trusted_skip;
+const fc::microseconds replication_client::retry_interval = fc::seconds( 5 );
+
+replication_client::replication_client( graphene::chain::database& db, const config& cfg )
+   : _db( db ), _config( cfg ), _chain_thread( &fc::thread::current() )
+{
+}
+
+replication_client::~replication_client()
+{
+   _stopped = true;
+   if( _retry.valid() && !_retry.ready() )
+      _retry.cancel_and_wait( "replication_client destroyed" );
+   disconnect();
+}
+
+void replication_client::connect()
+{ try {
+   disconnect();
+   _client.reset( new fc::http::websocket_client );
+   _connection = _client->connect( _config.server );
+   _api_connection = std::make_shared<fc::rpc::websocket_api_connection>( *_connection );
+   auto login = _api_connection->get_remote_api< login_api >( 1 );
+   FC_ASSERT( login->login( _config.user, _config.password ), "The primary did not accept the login" );
+   _packed_api = login->packed();
+   _replication_api = login->replication();
+   _closed_connection = _connection->closed.connect( [this]() {
+      _chain_thread->async( [this]() {
+         if( _stopped )
+            return;
+         wlog( "Lost the connection to the primary ${s}", ("s",_config.server) );
+         disconnect();
+         _retry = _chain_thread->schedule( [this]() { follow(); }, fc::time_point::now() + retry_interval,
+                                           "replication retry" );
+      } );
+   } );
+   ilog( "Connected to the primary ${s}", ("s",_config.server) );
+} FC_CAPTURE_AND_RETHROW( (_config.server) ) }
+
+void replication_client::disconnect()
+{
+   _closed_connection.disconnect();
+   _replication_api.reset();
+   _packed_api.reset();
+   _api_connection.reset();
+   _connection.reset();
+   _client.reset();
+}
+
+fc::path replication_client::fetch_state_checkpoint( const fc::path& dir, const fc::path& block_log_dir )
+{ try {
+   if( !_replication_api )
+      connect();
+   optional<state_checkpoint_info> info = (*_replication_api)->get_state_checkpoint();
+   FC_ASSERT( info.valid(), "The primary has no state checkpoint" );
+   ilog( "Copying the state checkpoint at block ${n} from the primary", ("n",info->block_num) );
+
+   const fc::path checkpoint = dir / fc::to_string( info->block_num );
+   fc::remove_all( dir );
+   auto start = fc::time_point::now();
+   uint64_t total = 0;
+   for( const auto& f : info->files )
+   {
+      const fc::path file = checkpoint / f.path;
+      fc::create_directories( file.parent_path() );
+      std::ofstream out( file.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+      for( uint64_t offset = 0; offset < f.size; )
+      {
+         vector<char> part = (*_replication_api)->read_state_checkpoint( info->block_num, f.path, offset,
+                                                                         read_size );
+         FC_ASSERT( !part.empty(), "The checkpoint file ${f} ended early", ("f",f.path) );
+         out.write( part.data(), part.size() );
+         offset += part.size();
+      }
+      out.flush();
+      FC_ASSERT( out, "Error writing ${f}", ("f",file) );
+      total += f.size;
+   }
+
+   // the snapshot's head block must be in the block log to replay from it
+   vector<char> packed = (*_packed_api)->get_blocks( info->block_num, 1 );
+   auto blocks = fc::raw::unpack< vector<graphene::chain::signed_block> >( packed );
+   FC_ASSERT( blocks.size() == 1 && blocks.front().id() == info->block_id,
+              "The primary does not have the checkpoint's head block" );
+   graphene::chain::block_database block_log;
+   block_log.open( block_log_dir );
+   block_log.store( info->block_id, blocks.front() );
+   block_log.close();
+
+   ilog( "Copied ${mb} MiB of state in ${s} s",
+         ("mb",total/(1024*1024))("s",(fc::time_point::now() - start).count()/1000000) );
+   return checkpoint;
+} FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+void replication_client::start()
+{
+   ilog( "Following the primary ${s}${t}", ("s",_config.server)("t",_config.trusted ? " in trusted mode" : "") );
+   follow();
+}
+
+void replication_client::follow()
+{
+   if( _stopped )
+      return;
+   try
+   {
+      if( !_replication_api )
+         connect();
+      // blocks applied while catching up arrive through the callback too, push() skips those it already has
+      (*_replication_api)->set_block_callback( [this]( const fc::variant& packed_block ) {
+         on_block( packed_block );
+      } );
+      catch_up();
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Could not follow the primary ${s}, trying again in ${t} s: ${e}",
+            ("s",_config.server)("t",retry_interval.count()/1000000)("e",e.to_detail_string()) );
+      disconnect();
+      _retry = _chain_thread->schedule( [this]() { follow(); }, fc::time_point::now() + retry_interval,
+                                        "replication retry" );
+   }
+}
+
+void replication_client::catch_up()
+{
+   while( true )
+   {
+      vector<char> packed = (*_packed_api)->get_blocks( _db.head_block_num() + 1, 100 );
+      auto blocks = fc::raw::unpack< vector<graphene::chain::signed_block> >( packed );
+      if( blocks.empty() )
+         return;
+      for( const auto& b : blocks )
+         push( b );
+   }
+}
+
+void replication_client::on_block( const fc::variant& packed_block )
+{
+   vector<char> packed;
+   fc::from_variant( packed_block, packed );
+   _chain_thread->async( [this, packed]() {
+      try
+      {
+         auto b = fc::raw::unpack< graphene::chain::signed_block >( packed );
+         if( b.block_num() > _db.head_block_num() + 1 && _packed_api )
+            catch_up();
+         push( b );
+      }
+      catch( const fc::exception& e )
+      {
+         elog( "Error applying a block from the primary: ${e}", ("e",e.to_detail_string()) );
+      }
+   } );
+}
+
+void replication_client::push( const graphene::chain::signed_block& b )
+{
+   if( b.block_num() <= _db.head_block_num() && _db.is_known_block( b.id() ) )
+      return;
+   _db.push_block( b, _config.trusted ? trusted_skip : uint32_t( graphene::chain::database::skip_nothing ) );
+}
+
+} } // graphene::app
@@ -0,0 +1,495 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/shared_state.hpp>
+
+#include <fc/crypto/city.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <unordered_set>
+
+namespace graphene { namespace app {
+
+namespace detail {
+
+   static const uint32_t shared_state_magic  = 0x67737374; // "gsst"
+   static const uint32_t shared_state_format = 1;
+   static const uint32_t frame_magic         = 0x6672616d; // "fram"
+   static const uint32_t base_magic          = 0x62617365; // "base"
+
+   /**
+    * The start of the shared file, followed by the ring.  Lock free atomics are address free, so the writer and
+    * the followers can use them from their own mappings.
+    */
+   struct shared_state_header
+   {
+      uint32_t               magic;
+      uint32_t               format;
+      uint64_t               ring_size;
+      /** incremented whenever a writer starts, the frames of an earlier epoch don't follow from its base */
+      std::atomic<uint64_t>  epoch;
+      /** the newest base file, 0 until the first one is written */
+      std::atomic<uint64_t>  base_generation;
+      /** bytes ever written to the ring, the published frames end here */
+      std::atomic<uint64_t>  written;
+      /** where the frame being written ends, the ring before reserved - ring_size may be overwritten already */
+      std::atomic<uint64_t>  reserved;
+   };
+
+   /** the changes of one block, packed into the body of a frame */
+   struct shared_state_frame
+   {
+      uint32_t                        block_num = 0;
+      chain::block_id_type            block_id;
+      vector<chain::object_record>    records;
+   };
+
+   /** at the start of a base file, followed by the id and the packed value of every shared object */
+   struct shared_state_base_info
+   {
+      uint64_t                                   epoch = 0;
+      /** the ring position the frames after the base start at */
+      uint64_t                                   position = 0;
+      uint32_t                                   block_num = 0;
+      chain::block_id_type                       block_id;
+      vector< shared_state_writer::object_type > types;
+   };
+
+   static fc::path base_path( const fc::path& file, uint64_t generation )
+   {
+      return fc::path( file.generic_string() + ".base." + fc::to_string( generation ) );
+   }
+
+   static void copy_to_ring( char* ring, uint64_t ring_size, uint64_t position, const char* data, size_t size )
+   {
+      const uint64_t offset = position % ring_size;
+      const size_t first = std::min<uint64_t>( size, ring_size - offset );
+      memcpy( ring + offset, data, first );
+      memcpy( ring, data + first, size - first );
+   }
+
+   static void copy_from_ring( const char* ring, uint64_t ring_size, uint64_t position, char* data, size_t size )
+   {
+      const uint64_t offset = position % ring_size;
+      const size_t first = std::min<uint64_t>( size, ring_size - offset );
+      memcpy( data, ring + offset, first );
+      memcpy( data + first, ring, size - first );
+   }
+
+} // detail
+
+} } // graphene::app
+
+FC_REFLECT( graphene::app::detail::shared_state_frame, (block_num)(block_id)(records) )
+FC_REFLECT( graphene::app::detail::shared_state_base_info, (epoch)(position)(block_num)(block_id)(types) )
+
+namespace graphene { namespace app {
+
+using detail::shared_state_header;
+
+shared_state_writer::shared_state_writer( chain::database& db, const fc::path& file, uint64_t ring_size,
+                                          const flat_set<object_type>& types )
+   : _db( db ), _file( file ), _types( types )
+{ try {
+   // followers can't serve anything without the properties of the chain
+   _types.emplace( chain::implementation_ids, chain::impl_global_property_object_type );
+   _types.emplace( chain::implementation_ids, chain::impl_dynamic_global_property_object_type );
+   _types.emplace( chain::implementation_ids, chain::impl_chain_property_object_type );
+   for( const auto& t : _types )
+      _db.get_index( t.first, t.second ); // asserts the type exists
+   FC_ASSERT( ring_size >= min_ring_size, "The ring of the shared state must hold at least ${n} bytes",
+              ("n",min_ring_size) );
+
+   // followers of a file with another ring size keep the old one mapped until they are restarted
+   const uint64_t size = sizeof(shared_state_header) + ring_size;
+   const bool fresh = !fc::exists( file ) || fc::file_size( file ) != size;
+   if( fresh )
+   {
+      std::ofstream out( file.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      out.seekp( size - 1 );
+      out.put( 0 );
+      out.flush();
+      FC_ASSERT( out, "Error creating the shared state file", ("file",file) );
+   }
+   _mapping.reset( new fc::file_mapping( file.generic_string().c_str(), fc::read_write ) );
+   _region.reset( new fc::mapped_region( *_mapping, fc::read_write, 0, size ) );
+   char* address = (char*)_region->get_address();
+   _ring = address + sizeof(shared_state_header);
+
+   _header = reinterpret_cast<shared_state_header*>( address );
+   if( fresh || _header->magic != detail::shared_state_magic || _header->format != detail::shared_state_format ||
+       _header->ring_size != ring_size )
+   {
+      _header = new( address ) shared_state_header();
+      _header->ring_size = ring_size;
+      _header->epoch = 0;
+      _header->base_generation = 0;
+      _header->written = 0;
+      _header->reserved = 0;
+      _header->format = detail::shared_state_format;
+      _header->magic = detail::shared_state_magic;
+   }
+   ++_header->epoch;
+
+   _base_thread.reset( new fc::thread( "shared state base" ) );
+   _applied_block_connection = _db.applied_block.connect( [this]( const chain::signed_block& b ) {
+      publish( b );
+   } );
+   // followers can start as soon as the node runs
+   reset_base();
+   finish_base( true );
+   FC_ASSERT( !_needs_base, "Could not write the shared state base", ("file",file) );
+   ilog( "Sharing the state in ${f}", ("f",file) );
+} FC_CAPTURE_AND_RETHROW( (file)(ring_size) ) }
+
+shared_state_writer::~shared_state_writer()
+{
+   _applied_block_connection.disconnect();
+   finish_base( true );
+}
+
+void shared_state_writer::publish( const chain::signed_block& b )
+{ try {
+   const uint32_t block_num = b.block_num();
+   finish_base( false );
+   // without an undo session holding exactly this block's changes, or after blocks were popped, start over
+   if( _needs_base || _last_block_num + 1 != block_num || !_db._undo_db.enabled() || _db._undo_db.size() == 0 )
+   {
+      reset_base();
+      return;
+   }
+
+   auto shared = [this]( object_id_type id ) {
+      return _types.find( object_type( id.space(), id.type() ) ) != _types.end();
+   };
+   const auto& changes = _db._undo_db.head();
+   vector<object_id_type> touched;
+   for( const auto& item : changes.old_values )
+      if( shared( item.first ) ) touched.push_back( item.first );
+   for( const auto& id : changes.new_ids )
+      if( shared( id ) ) touched.push_back( id );
+   for( const auto& item : changes.removed )
+      if( shared( item.first ) ) touched.push_back( item.first );
+   std::sort( touched.begin(), touched.end() );
+   touched.erase( std::unique( touched.begin(), touched.end() ), touched.end() );
+
+   detail::shared_state_frame frame;
+   frame.block_num = block_num;
+   frame.block_id  = _db.head_block_id();
+   frame.records.reserve( touched.size() );
+   for( const auto& id : touched )
+   {
+      frame.records.emplace_back( id, optional< vector<char> >() );
+      const object* obj = _db.find_object( id );
+      if( obj != nullptr )
+         frame.records.back().second = obj->pack();
+   }
+
+   const vector<char> body = fc::raw::pack( frame );
+   const uint64_t checksum = fc::city_hash64( body.data(), body.size() );
+   vector<char> packed;
+   {
+      std::ostringstream out( std::ios::out | std::ios::binary );
+      fc::raw::pack( out, detail::frame_magic );
+      fc::raw::pack( out, body );
+      fc::raw::pack( out, checksum );
+      const std::string s = out.str();
+      packed.assign( s.begin(), s.end() );
+   }
+
+   // a frame overwriting what a follower loading the newest base still needs waits for the next base
+   const uint64_t ring_size = _header->ring_size;
+   if( _header->written.load() + packed.size() - _base_position > ring_size )
+      finish_base( true );
+   if( _header->written.load() + packed.size() - _base_position > ring_size )
+   {
+      // the frame doesn't fit even after the newest base, the block goes out in a base of its own
+      post_records( std::move( frame.records ) );
+      _last_block_num = block_num;
+      request_base();
+      finish_base( true );
+      return;
+   }
+   write_frame( packed );
+   post_records( std::move( frame.records ) );
+   _last_block_num = block_num;
+   if( !_pending_base.valid() && _header->written.load() - _base_position > ring_size / 2 )
+      request_base();
+} catch( const fc::exception& e ) {
+   // the followers must not miss a block, so the next one goes out as a base
+   elog( "failed to share the state after block ${n}: ${e}", ("n",b.block_num())("e",e.to_detail_string()) );
+   _needs_base = true;
+} }
+
+void shared_state_writer::write_frame( const vector<char>& frame )
+{
+   const uint64_t written = _header->written.load();
+   // followers check reserved after copying frames out, to find out whether they were overwritten meanwhile
+   _header->reserved.store( written + frame.size(), std::memory_order_seq_cst );
+   std::atomic_thread_fence( std::memory_order_seq_cst );
+   detail::copy_to_ring( _ring, _header->ring_size, written, frame.data(), frame.size() );
+   _header->written.store( written + frame.size(), std::memory_order_release );
+}
+
+void shared_state_writer::reset_base()
+{
+   finish_base( true );
+   auto records = std::make_shared< vector<chain::object_record> >();
+   for( const auto& t : _types )
+      _db.get_index( t.first, t.second ).inspect_all_objects( [&records]( const object& o ) {
+         records->emplace_back( o.id, o.pack() );
+      } );
+   _base_thread->async( [this,records]() {
+      _objects.clear();
+      for( auto& r : *records )
+         _objects[r.first] = std::move( *r.second );
+   }, "shared state reset" );
+   _last_block_num = _db.head_block_num();
+   _needs_base = false;
+   request_base();
+}
+
+void shared_state_writer::post_records( vector<chain::object_record>&& records )
+{
+   auto shared = std::make_shared< vector<chain::object_record> >( std::move( records ) );
+   _base_thread->async( [this,shared]() {
+      for( auto& r : *shared )
+         if( r.second )
+            _objects[r.first] = std::move( *r.second );
+         else
+            _objects.erase( r.first );
+   }, "shared state frame" );
+}
+
+void shared_state_writer::request_base()
+{
+   // one base at a time, each is written from the copy as of the frames posted before it
+   finish_base( true );
+   detail::shared_state_base_info info;
+   info.epoch     = _header->epoch.load();
+   info.position  = _header->written.load();
+   info.block_num = _db.head_block_num();
+   info.block_id  = _db.head_block_id();
+   info.types.assign( _types.begin(), _types.end() );
+   _pending_base_position = info.position;
+   _pending_base = _base_thread->async( [this,info]() { write_base_file( info ); }, "shared state base" );
+}
+
+void shared_state_writer::finish_base( bool wait )
+{
+   if( !_pending_base.valid() || ( !wait && !_pending_base.ready() ) )
+      return;
+   try
+   {
+      _pending_base.wait();
+      _base_position = _pending_base_position;
+   }
+   catch( const fc::exception& e )
+   {
+      // the followers must not miss a block, so the next one starts over
+      elog( "failed to write a base of the shared state: ${e}", ("e",e.to_detail_string()) );
+      _needs_base = true;
+   }
+   _pending_base = fc::future<void>();
+}
+
+void shared_state_writer::write_base_file( const detail::shared_state_base_info& info )
+{
+   const uint64_t generation = _header->base_generation.load() + 1;
+   const fc::path path = detail::base_path( _file, generation );
+   const fc::path tmp( path.generic_string() + ".tmp" );
+   {
+      std::ofstream out( tmp.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      FC_ASSERT( out, "Cannot create the shared state base", ("file",tmp) );
+      fc::raw::pack( out, detail::base_magic );
+      fc::raw::pack( out, info );
+      for( const auto& o : _objects )
+      {
+         fc::raw::pack( out, o.first );
+         fc::raw::pack( out, o.second );
+      }
+      out.flush();
+      FC_ASSERT( out, "Error writing the shared state base", ("file",tmp) );
+   }
+   fc::rename( tmp, path );
+   _header->base_generation.store( generation, std::memory_order_release );
+
+   // followers may still be loading the previous base
+   if( generation > 2 )
+      fc::remove_all( detail::base_path( _file, generation - 2 ) );
+}
+
+shared_state_follower::shared_state_follower( chain::database& db, const fc::path& file )
+   : _db( db ), _file( file )
+{ try {
+   FC_ASSERT( fc::exists( file ), "There is no shared state, start the node sharing it first", ("file",file) );
+   const uint64_t size = fc::file_size( file );
+   FC_ASSERT( size > sizeof(shared_state_header), "The shared state file is truncated", ("file",file) );
+   _mapping.reset( new fc::file_mapping( file.generic_string().c_str(), fc::read_only ) );
+   _region.reset( new fc::mapped_region( *_mapping, fc::read_only, 0, size ) );
+   const char* address = (const char*)_region->get_address();
+   _header = reinterpret_cast<const shared_state_header*>( address );
+   _ring = address + sizeof(shared_state_header);
+   FC_ASSERT( _header->magic == detail::shared_state_magic && _header->format == detail::shared_state_format &&
+              sizeof(shared_state_header) + _header->ring_size == size,
+              "The file does not hold a shared state this node can read", ("file",file) );
+
+   // the state only ever changes through the records of the writer
+   _db._undo_db.disable();
+   poll();
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+shared_state_follower::~shared_state_follower()
+{
+   if( _poll.valid() && !_poll.ready() )
+   {
+      try
+      {
+         _poll.cancel_and_wait( "shared_state_follower destroyed" );
+      }
+      catch( const fc::exception& )
+      {
+      }
+   }
+}
+
+bool shared_state_follower::load_base()
+{
+   const uint64_t generation = _header->base_generation.load( std::memory_order_acquire );
+   if( generation == 0 )
+      return false;
+   // the writer may have replaced it since, the next poll finds the newer one
+   std::ifstream in( detail::base_path( _file, generation ).generic_string(), std::ios::in | std::ios::binary );
+   if( !in )
+      return false;
+
+   uint32_t magic = 0;
+   detail::shared_state_base_info info;
+   fc::raw::unpack( in, magic );
+   FC_ASSERT( magic == detail::base_magic, "Not a shared state base", ("generation",generation) );
+   fc::raw::unpack( in, info );
+   // a writer which just started hasn't written the base of its epoch yet
+   if( info.epoch != _header->epoch.load() )
+      return false;
+
+   vector<chain::object_record> records;
+   std::unordered_set<object_id_type> ids;
+   while( in.peek() != std::ifstream::traits_type::eof() )
+   {
+      object_id_type id;
+      vector<char> data;
+      fc::raw::unpack( in, id );
+      fc::raw::unpack( in, data );
+      FC_ASSERT( in, "Truncated shared state base", ("generation",generation) );
+      records.emplace_back( id, std::move( data ) );
+      ids.insert( id );
+   }
+   // whatever this node holds and the base doesn't was removed in between
+   for( const auto& t : info.types )
+      _db.get_index( t.first, t.second ).inspect_all_objects( [&]( const object& o ) {
+         if( ids.find( o.id ) == ids.end() )
+            records.emplace_back( o.id, optional< vector<char> >() );
+      } );
+   _db.apply_object_records( records );
+
+   ilog( "Loaded the shared state of block ${n}, ${c} objects", ("n",info.block_num)("c",ids.size()) );
+   _epoch = info.epoch;
+   _base_generation = generation;
+   _position = info.position;
+   _block_num = info.block_num;
+   return true;
+}
+
+bool shared_state_follower::poll()
+{ try {
+   if( _base_generation == 0 || _header->epoch.load() != _epoch )
+      return load_base();
+
+   const uint64_t ring_size = _header->ring_size;
+   const uint64_t written = _header->written.load( std::memory_order_acquire );
+   if( written == _position )
+      return false;
+   if( written - _position > ring_size )
+      return load_base();
+
+   vector<char> bytes( written - _position );
+   detail::copy_from_ring( _ring, ring_size, _position, bytes.data(), bytes.size() );
+   std::atomic_thread_fence( std::memory_order_seq_cst );
+   if( _header->reserved.load( std::memory_order_seq_cst ) > _position + ring_size )
+      return load_base(); // overwritten while copying
+
+   vector<chain::object_record> records;
+   uint32_t block_num = _block_num;
+   fc::datastream<const char*> ds( bytes.data(), bytes.size() );
+   while( ds.remaining() > 0 )
+   {
+      uint32_t magic = 0;
+      vector<char> body;
+      uint64_t checksum = 0;
+      fc::raw::unpack( ds, magic );
+      FC_ASSERT( magic == detail::frame_magic, "Corrupt shared state frame", ("position",_position) );
+      fc::raw::unpack( ds, body );
+      fc::raw::unpack( ds, checksum );
+      FC_ASSERT( checksum == fc::city_hash64( body.data(), body.size() ), "Corrupt shared state frame",
+                 ("position",_position) );
+      auto frame = fc::raw::unpack<detail::shared_state_frame>( body );
+      block_num = frame.block_num;
+      std::move( frame.records.begin(), frame.records.end(), std::back_inserter( records ) );
+   }
+   // the frames of several blocks are applied at once, readers never see part of a block
+   _db.apply_object_records( records );
+   _position = written;
+   _block_num = block_num;
+   return true;
+} FC_CAPTURE_AND_RETHROW( (_file) ) }
+
+void shared_state_follower::start( fc::microseconds interval )
+{
+   _poll_interval = interval;
+   schedule_poll();
+}
+
+void shared_state_follower::schedule_poll()
+{
+   _poll = fc::schedule( [this]() {
+      try
+      {
+         poll();
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "Could not follow the shared state: ${e}", ("e",e.to_detail_string()) );
+      }
+      schedule_poll();
+   }, fc::time_point::now() + _poll_interval, "shared state poll" );
+}
+
+} } // graphene::app
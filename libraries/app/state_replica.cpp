@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/app/state_replica.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace app {
+
+const object* state_replica::version::find( object_id_type id )const
+{
+   auto itr = _chunks.find( object_type( id.space(), id.type() ) );
+   if( itr == _chunks.end() )
+      return nullptr;
+   const uint64_t c = id.instance() / chunk_size;
+   if( c >= itr->second.size() || !itr->second[c] )
+      return nullptr;
+   return (*itr->second[c])[ id.instance() % chunk_size ].get();
+}
+
+state_replica::state_replica( chain::database& db, const flat_set<object_type>& types )
+   : _db( db ), _types( types )
+{
+   for( const auto& t : _types )
+      _db.get_index( t.first, t.second ); // asserts the type exists
+   _applied_block_connection = _db.applied_block.connect( [this]( const signed_block& b ) {
+      publish( b.block_num() );
+   } );
+   publish( _db.head_block_num() );
+}
+
+std::shared_ptr<const state_replica::version> state_replica::current()const
+{
+   std::lock_guard<std::mutex> lock( _current_mutex );
+   return _current;
+}
+
+void state_replica::rebuild( version& v )const
+{
+   v._chunks.clear();
+   for( const auto& t : _types )
+   {
+      // fill the chunks while they are private to this thread, then freeze them
+      vector< std::shared_ptr<version::chunk> > chunks;
+      _db.get_index( t.first, t.second ).inspect_all_objects( [&chunks]( const object& o ) {
+         const uint64_t c = o.id.instance() / chunk_size;
+         if( c >= chunks.size() )
+            chunks.resize( c + 1 );
+         if( !chunks[c] )
+            chunks[c] = std::make_shared<version::chunk>();
+         (*chunks[c])[ o.id.instance() % chunk_size ] = std::shared_ptr<const object>( o.clone() );
+      } );
+      v._chunks[t].assign( chunks.begin(), chunks.end() );
+   }
+}
+
+void state_replica::publish( uint32_t block_num )
+{ try {
+   auto next = std::make_shared<version>();
+   next->_block_num = block_num;
+
+   std::shared_ptr<const version> previous = current();
+   // without an undo session holding exactly this block's changes, or after blocks were popped, start over
+   if( _needs_rebuild || !previous || previous->_block_num + 1 != block_num
+       || !_db._undo_db.enabled() || _db._undo_db.size() == 0 )
+   {
+      rebuild( *next );
+      _needs_rebuild = false;
+   }
+   else
+   {
+      next->_chunks = previous->_chunks;
+
+      const auto& changes = _db._undo_db.head();
+      vector<object_id_type> touched;
+      for( const auto& item : changes.old_values )
+         if( replicates( item.first ) ) touched.push_back( item.first );
+      for( const auto& id : changes.new_ids )
+         if( replicates( id ) ) touched.push_back( id );
+      for( const auto& item : changes.removed )
+         if( replicates( item.first ) ) touched.push_back( item.first );
+      // sorted, so all changes to a chunk are made to a single copy of it
+      std::sort( touched.begin(), touched.end() );
+      touched.erase( std::unique( touched.begin(), touched.end() ), touched.end() );
+
+      std::shared_ptr<version::chunk> copy;
+      object_type copy_type;
+      uint64_t copy_index = 0;
+      auto freeze = [&]() {
+         if( copy )
+            next->_chunks[copy_type][copy_index] = copy;
+         copy.reset();
+      };
+      for( const auto& id : touched )
+      {
+         const object_type t( id.space(), id.type() );
+         const uint64_t c = id.instance() / chunk_size;
+         if( !copy || t != copy_type || c != copy_index )
+         {
+            freeze();
+            auto& chunks = next->_chunks[t];
+            if( c >= chunks.size() )
+               chunks.resize( c + 1 );
+            copy = chunks[c] ? std::make_shared<version::chunk>( *chunks[c] ) : std::make_shared<version::chunk>();
+            copy_type = t;
+            copy_index = c;
+         }
+         const object* obj = _db.find_object( id );
+         (*copy)[ id.instance() % chunk_size ] = obj ? std::shared_ptr<const object>( obj->clone() )
+                                                     : std::shared_ptr<const object>();
+      }
+      freeze();
+   }
+
+   std::lock_guard<std::mutex> lock( _current_mutex );
+   _current = std::move( next );
+} catch( const fc::exception& e ) {
+   // a replica which could not be updated must not serve the state of an older block as current
+   elog( "failed to publish the state after block ${n}: ${e}", ("n",block_num)("e",e.to_detail_string()) );
+   _needs_rebuild = true;
+   std::lock_guard<std::mutex> lock( _current_mutex );
+   _current.reset();
+} }
+
+} } // graphene::app
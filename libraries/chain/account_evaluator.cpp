@@ -128,12 +128,8 @@ void_result account_create_evaluator::do_evaluate( const account_create_operatio
       evaluate_buyback_account_options( d, *op.extensions.value.buyback_options );
    verify_account_votes( d, op.options );
 
-   auto& acnt_indx = d.get_index_type<account_index>();
    if( op.name.size() )
-   {
-      auto current_account_itr = acnt_indx.indices().get<by_name>().find( op.name );
-      FC_ASSERT( current_account_itr == acnt_indx.indices().get<by_name>().end() );
-   }
+      FC_ASSERT( d.account_names().find( op.name ) == nullptr );
 
    return void_result();
 } FC_CAPTURE_AND_RETHROW( (op) ) }
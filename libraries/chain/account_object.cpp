@@ -27,8 +27,24 @@
 #include <graphene/chain/hardfork.hpp>
 #include <fc/uint128.hpp>
 
+#include <algorithm>
+
 namespace graphene { namespace chain {
 
+namespace {
+   /** drops the entries left without accounts, so that an empty map means nothing is referenced */
+   template<typename Map>
+   void remove_membership( Map& memberships, const typename Map::key_type& member, account_id_type account )
+   {
+      auto itr = memberships.find( member );
+      if( itr == memberships.end() )
+         return;
+      itr->second.erase( account );
+      if( itr->second.empty() )
+         memberships.erase( itr );
+   }
+}
+
 share_type cut_fee(share_type a, uint16_t p)
 {
    if( a == 0 || p == 0 )
@@ -165,17 +181,40 @@ void account_member_index::object_removed(const object& obj)
 
     auto key_members = get_key_members(a);
     for( auto item : key_members )
-       account_to_key_memberships[item].erase( obj.id );
+       remove_membership( account_to_key_memberships, item, obj.id );
 
     auto address_members = get_address_members(a);
     for( auto item : address_members )
-       account_to_address_memberships[item].erase( obj.id );
+       remove_membership( account_to_address_memberships, item, obj.id );
 
     auto account_members = get_account_members(a);
     for( auto item : account_members )
        account_to_account_memberships[item].erase( obj.id );
 }
 
+void authority_change_index::about_to_modify( const object& before )
+{
+   const account_object& a = static_cast<const account_object&>( before );
+   _before_owner = a.owner;
+   _before_active = a.active;
+}
+
+void authority_change_index::object_modified( const object& after )
+{
+   const account_object& a = static_cast<const account_object&>( after );
+   if( !( a.owner == _before_owner && a.active == _before_active ) )
+      ++_changes;
+}
+
+bool account_member_index::is_relevant_change( const object& before, const object& after )const
+{
+   assert( dynamic_cast<const account_object*>(&before) ); // for debug only
+   assert( dynamic_cast<const account_object*>(&after) ); // for debug only
+   const account_object& a = static_cast<const account_object&>(before);
+   const account_object& b = static_cast<const account_object&>(after);
+   return !( a.owner == b.owner && a.active == b.active && a.options.memo_key == b.options.memo_key );
+}
+
 void account_member_index::about_to_modify(const object& before)
 {
    before_key_members.clear();
@@ -221,7 +260,7 @@ void account_member_index::object_modified(const object& after)
                            std::inserter(removed, removed.end()));
 
        for( auto itr = removed.begin(); itr != removed.end(); ++itr )
-          account_to_key_memberships[*itr].erase(after.id);
+          remove_membership( account_to_key_memberships, *itr, after.id );
 
        vector<public_key_type> added; added.reserve(after_key_members.size());
        std::set_difference(after_key_members.begin(), after_key_members.end(),
@@ -241,7 +280,7 @@ void account_member_index::object_modified(const object& after)
                            std::inserter(removed, removed.end()));
 
        for( auto itr = removed.begin(); itr != removed.end(); ++itr )
-          account_to_address_memberships[*itr].erase(after.id);
+          remove_membership( account_to_address_memberships, *itr, after.id );
 
        vector<address> added; added.reserve(after_address_members.size());
        std::set_difference(after_address_members.begin(), after_address_members.end(),
@@ -267,4 +306,131 @@ void account_referrer_index::object_modified( const object& after  )
 {
 }
 
+void balances_by_account_index::object_inserted( const object& obj )
+{
+   const auto& balance = static_cast<const account_balance_object&>( obj );
+   if( balance.owner == GRAPHENE_TEMP_ACCOUNT )
+      ++_temp_account_changes;
+   if( _by_account.size() <= balance.owner.instance.value )
+      _by_account.resize( balance.owner.instance.value + 1 );
+   _by_account[balance.owner.instance.value].push_back( &balance );
+
+   std::lock_guard< std::mutex > lock( _sort_mutex );
+   if( _by_asset.size() <= balance.asset_type.instance.value )
+      _by_asset.resize( balance.asset_type.instance.value + 1 );
+   holders& h = _by_asset[balance.asset_type.instance.value];
+   h.balances.push_back( &balance );
+   h.changed.insert( &balance );
+}
+
+void balances_by_account_index::object_removed( const object& obj )
+{
+   const auto& balance = static_cast<const account_balance_object&>( obj );
+   auto& account_balances = _by_account[balance.owner.instance.value];
+   account_balances.erase( std::find( account_balances.begin(), account_balances.end(), &balance ) );
+
+   // removing one keeps the others in order
+   std::lock_guard< std::mutex > lock( _sort_mutex );
+   holders& h = _by_asset[balance.asset_type.instance.value];
+   h.balances.erase( std::find( h.balances.begin(), h.balances.end(), &balance ) );
+   h.changed.erase( &balance );
+}
+
+void balances_by_account_index::object_modified( const object& after )
+{
+   const auto& balance = static_cast<const account_balance_object&>( after );
+   if( balance.owner == GRAPHENE_TEMP_ACCOUNT )
+      ++_temp_account_changes;
+   std::lock_guard< std::mutex > lock( _sort_mutex );
+   _by_asset[balance.asset_type.instance.value].changed.insert( &balance );
+}
+
+const account_balance_object* balances_by_account_index::find( account_id_type account, asset_id_type asset )const
+{
+   if( account.instance.value >= _by_account.size() )
+      return nullptr;
+   for( const account_balance_object* balance : _by_account[account.instance.value] )
+      if( balance->asset_type == asset )
+         return balance;
+   return nullptr;
+}
+
+const vector< const account_balance_object* >& balances_by_account_index::get_account_balances( account_id_type account )const
+{
+   static const vector< const account_balance_object* > none;
+   if( account.instance.value >= _by_account.size() )
+      return none;
+   return _by_account[account.instance.value];
+}
+
+namespace {
+   bool by_balance( const account_balance_object* a, const account_balance_object* b )
+   {
+      if( a->balance != b->balance )
+         return a->balance > b->balance;
+      return a->owner < b->owner;
+   }
+}
+
+const vector< const account_balance_object* >& balances_by_account_index::get_asset_holders( asset_id_type asset )const
+{
+   static const vector< const account_balance_object* > none;
+   std::lock_guard< std::mutex > lock( _sort_mutex );
+   if( asset.instance.value >= _by_asset.size() )
+      return none;
+   holders& h = _by_asset[asset.instance.value];
+   if( h.changed.empty() )
+      return h.balances;
+
+   if( h.changed.size() * 8 > h.balances.size() )
+      std::sort( h.balances.begin(), h.balances.end(), by_balance );
+   else
+   {
+      // take the changed balances out, the rest are still in order, and merge them back in
+      vector< const account_balance_object* > changed( h.changed.begin(), h.changed.end() );
+      std::sort( changed.begin(), changed.end(), by_balance );
+      h.balances.erase( std::remove_if( h.balances.begin(), h.balances.end(),
+                                        [&]( const account_balance_object* b ) { return h.changed.count( b ) != 0; } ),
+                        h.balances.end() );
+      const size_t unchanged = h.balances.size();
+      h.balances.insert( h.balances.end(), changed.begin(), changed.end() );
+      std::inplace_merge( h.balances.begin(), h.balances.begin() + unchanged, h.balances.end(), by_balance );
+   }
+   h.changed.clear();
+   return h.balances;
+}
+
+vector< const account_balance_object* > balances_by_account_index::get_top_holders( asset_id_type asset,
+                                                                                   size_t count )const
+{
+   vector< const account_balance_object* > result;
+   std::lock_guard< std::mutex > lock( _sort_mutex );
+   if( asset.instance.value >= _by_asset.size() || count == 0 )
+      return result;
+   const holders& h = _by_asset[asset.instance.value];
+
+   // the top of the unchanged balances, which are in order, merged with the top of the changed ones
+   vector< const account_balance_object* > changed( h.changed.begin(), h.changed.end() );
+   const size_t changed_count = std::min( count, changed.size() );
+   std::partial_sort( changed.begin(), changed.begin() + changed_count, changed.end(), by_balance );
+   changed.resize( changed_count );
+
+   result.reserve( count );
+   auto next_changed = changed.begin();
+   for( const account_balance_object* balance : h.balances )
+   {
+      if( result.size() == count )
+         break;
+      if( h.changed.count( balance ) != 0 )
+         continue;
+      while( next_changed != changed.end() && result.size() < count && by_balance( *next_changed, balance ) )
+         result.push_back( *next_changed++ );
+      if( result.size() < count )
+         result.push_back( balance );
+   }
+   while( next_changed != changed.end() && result.size() < count )
+      result.push_back( *next_changed++ );
+   return result;
+}
+
 } } // graphene::chain
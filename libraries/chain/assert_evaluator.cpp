@@ -23,7 +23,6 @@
  */
 
 #include <graphene/chain/assert_evaluator.hpp>
-#include <graphene/chain/block_summary_object.hpp>
 #include <graphene/chain/database.hpp>
 
 #include <sstream>
@@ -47,7 +46,7 @@ struct predicate_evaluator
    }
    void operator()( const block_id_predicate& p )const
    {
-      FC_ASSERT( block_summary_id_type( block_header::num_from_id( p.id ) & 0xffff )(db).block_id == p.id );
+      FC_ASSERT( db.get_tapos_block_id( block_header::num_from_id( p.id ) & 0xffff ) == p.id );
    }
 };
 
@@ -49,9 +49,7 @@ void_result asset_create_evaluator::do_evaluate( const asset_create_operation& o
    for( auto id : op.common_options.blacklist_authorities )
       d.get_object(id);
 
-   auto& asset_indx = d.get_index_type<asset_index>().indices().get<by_symbol>();
-   auto asset_symbol_itr = asset_indx.find( op.symbol );
-   FC_ASSERT( asset_symbol_itr == asset_indx.end() );
+   FC_ASSERT( d.asset_symbols().find( op.symbol ) == nullptr );
 
    if( d.head_block_time() <= HARDFORK_409_TIME )
    {
@@ -59,10 +57,10 @@ void_result asset_create_evaluator::do_evaluate( const asset_create_operation& o
       if( dotpos != std::string::npos )
       {
          auto prefix = op.symbol.substr( 0, dotpos );
-         auto asset_symbol_itr = asset_indx.find( op.symbol );
-         FC_ASSERT( asset_symbol_itr != asset_indx.end(), "Asset ${s} may only be created by issuer of ${p}, but ${p} has not been registered",
+         const asset_object* prefix_asset = d.asset_symbols().find( op.symbol );
+         FC_ASSERT( prefix_asset != nullptr, "Asset ${s} may only be created by issuer of ${p}, but ${p} has not been registered",
                     ("s",op.symbol)("p",prefix) );
-         FC_ASSERT( asset_symbol_itr->issuer == op.issuer, "Asset ${s} may only be created by issuer of ${p}, ${i}",
+         FC_ASSERT( prefix_asset->issuer == op.issuer, "Asset ${s} may only be created by issuer of ${p}, ${i}",
                     ("s",op.symbol)("p",prefix)("i", op.issuer(d).name) );
       }
    }
@@ -72,10 +70,10 @@ void_result asset_create_evaluator::do_evaluate( const asset_create_operation& o
       if( dotpos != std::string::npos )
       {
          auto prefix = op.symbol.substr( 0, dotpos );
-         auto asset_symbol_itr = asset_indx.find( prefix );
-         FC_ASSERT( asset_symbol_itr != asset_indx.end(), "Asset ${s} may only be created by issuer of ${p}, but ${p} has not been registered",
+         const asset_object* prefix_asset = d.asset_symbols().find( prefix );
+         FC_ASSERT( prefix_asset != nullptr, "Asset ${s} may only be created by issuer of ${p}, but ${p} has not been registered",
                     ("s",op.symbol)("p",prefix) );
-         FC_ASSERT( asset_symbol_itr->issuer == op.issuer, "Asset ${s} may only be created by issuer of ${p}, ${i}",
+         FC_ASSERT( prefix_asset->issuer == op.issuer, "Asset ${s} may only be created by issuer of ${p}, ${i}",
                     ("s",op.symbol)("p",prefix)("i", op.issuer(d).name) );
       }
    }
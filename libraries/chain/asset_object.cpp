@@ -158,3 +158,63 @@ string asset_object::amount_to_string(share_type amount) const
       result += "." + fc::to_string(scaled_precision.value + decimals).erase(0,1);
    return result;
 }
+
+void feed_update_index::schedule( const asset_bitasset_data_object& b )
+{
+   const time_point_sec expiration = b.feed_expiration_time();
+   auto itr = _expiration.find( b.id );
+   if( itr != _expiration.end() )
+   {
+      if( itr->second == expiration )
+         return;
+      unschedule( b.id );
+   }
+   _expiration[b.id] = expiration;
+   by_feed_expiration[expiration].insert( b.id );
+}
+
+void feed_update_index::unschedule( asset_bitasset_data_id_type id )
+{
+   auto itr = _expiration.find( id );
+   if( itr == _expiration.end() )
+      return;
+   auto bucket = by_feed_expiration.find( itr->second );
+   bucket->second.erase( id );
+   if( bucket->second.empty() )
+      by_feed_expiration.erase( bucket );
+   _expiration.erase( itr );
+}
+
+void feed_update_index::object_inserted( const object& obj )
+{
+   object_modified( obj );
+}
+
+void feed_update_index::object_removed( const object& obj )
+{
+   if( obj.id.space() == protocol_ids )
+   {
+      const auto& a = static_cast<const asset_object&>( obj );
+      if( a.bitasset_data_id )
+         assets.erase( *a.bitasset_data_id );
+      return;
+   }
+   unschedule( obj.id );
+   changed.erase( obj.id );
+}
+
+void feed_update_index::object_modified( const object& after )
+{
+   if( after.id.space() == protocol_ids )
+   {
+      const auto& a = static_cast<const asset_object&>( after );
+      if( !a.bitasset_data_id )
+         return;
+      assets[*a.bitasset_data_id] = a.id;
+      changed.insert( *a.bitasset_data_id );
+      return;
+   }
+   const auto& b = static_cast<const asset_bitasset_data_object&>( after );
+   schedule( b );
+   changed.insert( b.id );
+}
@@ -23,58 +23,482 @@
  */
 #include <graphene/chain/block_database.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/smart_ref_impl.hpp>
 
+#include <zlib.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <iomanip>
+#include <sstream>
+
 namespace graphene { namespace chain {
 
-struct index_entry
+namespace {
+
+const uint32_t segment_magic   = 0x676c6f62; // "bolg"
+const uint8_t  segment_version = 1;
+
+struct segment_header
 {
-   uint64_t      block_pos = 0;
-   uint32_t      block_size = 0;
-   block_id_type block_id;
+   uint32_t magic = segment_magic;
+   uint8_t  version = segment_version;
+   uint8_t  compression = block_database::no_compression;
+   uint16_t reserved = 0;
+   uint32_t first_block_num = 0;
+   uint32_t blocks_per_segment = 0;
 };
- }}
-FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
 
-namespace graphene { namespace chain {
+static_assert( sizeof(segment_header) == 16, "segment_header is written to disk as is" );
+static_assert( sizeof(block_database::index_entry) == 32, "index_entry is written to disk as is" );
+
+fc::path segment_file( const fc::path& dbdir, uint32_t first_block_num, const char* ext )
+{
+   std::ostringstream name;
+   name << "segment-" << std::setw(10) << std::setfill('0') << first_block_num << ext;
+   return dbdir / name.str();
+}
+
+vector<char> compress_block( vector<char>&& packed, uint8_t compression )
+{
+   if( compression == block_database::no_compression )
+      return std::move( packed );
+
+   FC_ASSERT( compression == block_database::zlib_compression, "Unknown block compression ${c}", ("c",compression) );
+   uLongf compressed_size = compressBound( packed.size() );
+   vector<char> result( sizeof(uint32_t) + compressed_size );
+   uint32_t raw_size = packed.size();
+   memcpy( result.data(), &raw_size, sizeof(raw_size) );
+   int status = compress2( (Bytef*)result.data() + sizeof(raw_size), &compressed_size,
+                           (const Bytef*)packed.data(), packed.size(), Z_DEFAULT_COMPRESSION );
+   FC_ASSERT( status == Z_OK, "zlib compression failed with status ${s}", ("s",status) );
+   result.resize( sizeof(raw_size) + compressed_size );
+   return result;
+}
+
+vector<char> decompress_block( vector<char>&& stored, uint8_t compression )
+{
+   if( compression == block_database::no_compression )
+      return std::move( stored );
+
+   FC_ASSERT( compression == block_database::zlib_compression, "Unknown block compression ${c}", ("c",compression) );
+   FC_ASSERT( stored.size() >= sizeof(uint32_t) );
+   uint32_t raw_size;
+   memcpy( &raw_size, stored.data(), sizeof(raw_size) );
+   vector<char> result( raw_size );
+   uLongf result_size = raw_size;
+   int status = uncompress( (Bytef*)result.data(), &result_size,
+                            (const Bytef*)stored.data() + sizeof(raw_size), stored.size() - sizeof(raw_size) );
+   FC_ASSERT( status == Z_OK && result_size == raw_size, "zlib decompression failed with status ${s}", ("s",status) );
+   return result;
+}
+
+/** asks the OS to put a file that was just flushed on stable storage */
+void sync_file( const fc::path& file )
+{
+#ifndef WIN32
+   int fd = ::open( file.generic_string().c_str(), O_RDONLY );
+   FC_ASSERT( fd >= 0, "Unable to open ${f} for syncing", ("f",file) );
+   int status = ::fsync( fd );
+   ::close( fd );
+   FC_ASSERT( status == 0, "Unable to sync ${f}", ("f",file) );
+#endif
+}
+
+} // anonymous
+
+struct block_database::segment
+{
+   segment_header       header;
+   fc::path             blocks_path;
+   std::fstream         blocks;
+   std::fstream         index;
+   vector<index_entry>  entries; ///< entries[n] describes block header.first_block_num + n
+
+   uint64_t             written_size = 0; ///< bytes of the blocks file already handed to the OS
+   vector<char>         pending;          ///< stored blocks not yet written, they follow written_size
+   /** range of entries not yet written to the index file */
+   uint32_t             dirty_begin = 0;
+   uint32_t             dirty_end = 0;
+
+   /** read-only view of the blocks file, remapped when a read goes past its end */
+   std::unique_ptr<fc::file_mapping>  mapping;
+   std::unique_ptr<fc::mapped_region> region;
+
+   bool covers( uint32_t block_num )const
+   {
+      return block_num >= header.first_block_num && block_num - header.first_block_num < header.blocks_per_segment;
+   }
+
+   bool is_mapped( const index_entry& e )const
+   {
+      return region && e.block_pos + e.block_size <= region->get_size();
+   }
+
+   void remap()
+   {
+      blocks.flush();
+      region.reset();
+      mapping.reset();
+      mapping.reset( new fc::file_mapping( blocks_path.generic_string().c_str(), fc::read_only ) );
+      region.reset( new fc::mapped_region( *mapping, fc::read_only, 0, fc::file_size( blocks_path ) ) );
+   }
+
+   void unmap()
+   {
+      region.reset();
+      mapping.reset();
+   }
+
+   uint64_t size()const { return written_size + pending.size(); }
+
+   void mark_dirty( uint32_t begin, uint32_t end )
+   {
+      if( dirty_begin == dirty_end )
+      {
+         dirty_begin = begin;
+         dirty_end = end;
+      }
+      else
+      {
+         dirty_begin = std::min( dirty_begin, begin );
+         dirty_end = std::max( dirty_end, end );
+      }
+   }
+
+   /** @return true if anything was written */
+   bool write_pending()
+   {
+      if( pending.empty() && dirty_begin == dirty_end )
+         return false;
+      if( !pending.empty() )
+      {
+         blocks.seekp( written_size );
+         blocks.write( pending.data(), pending.size() );
+         written_size += pending.size();
+         pending.clear();
+      }
+      if( dirty_begin != dirty_end )
+      {
+         index.seekp( sizeof(index_entry) * dirty_begin );
+         index.write( (const char*)&entries[dirty_begin], sizeof(index_entry) * ( dirty_end - dirty_begin ) );
+         dirty_begin = dirty_end = 0;
+      }
+      blocks.flush();
+      index.flush();
+      return true;
+   }
+};
+
+block_database::block_database() {}
+block_database::~block_database() {}
+
+void block_database::set_segment_format( uint32_t blocks_per_segment, compression_type compression )
+{
+   FC_ASSERT( blocks_per_segment > 0 );
+   FC_ASSERT( compression == no_compression || compression == zlib_compression );
+   _blocks_per_segment = blocks_per_segment;
+   _compression = compression;
+}
+
+void block_database::set_cache_size( size_t blocks )
+{
+   std::lock_guard<std::mutex> guard( _cache_mutex );
+   _cache_capacity = blocks;
+   while( _cache.size() > _cache_capacity )
+   {
+      _cache.erase( _cache_order.back() );
+      _cache_order.pop_back();
+   }
+}
+
+void block_database::set_flush_policy( const flush_policy& policy )
+{
+   boost::unique_lock<boost::shared_mutex> lock( _lock );
+   _flush_policy = policy;
+}
 
 void block_database::open( const fc::path& dbdir )
 { try {
+   close();
+   boost::unique_lock<boost::shared_mutex> lock( _lock );
    fc::create_directories(dbdir);
-   _block_num_to_pos.exceptions(std::ios_base::failbit | std::ios_base::badbit);
-   _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+   _dbdir = dbdir;
 
-   if( !fc::exists( dbdir/"index" ) )
+   for( fc::directory_iterator itr( dbdir ); itr != fc::directory_iterator(); ++itr )
    {
-     _block_num_to_pos.open( (dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+      const fc::path file = *itr;
+      if( file.extension().generic_string() != ".blocks" )
+         continue;
+      fc::path index_file = file;
+      index_file.replace_extension( ".index" );
+      open_segment( file, index_file, false, 0 );
+   }
+
+   _open = true;
+
+   if( fc::exists( dbdir/"index" ) )
+      convert_legacy_files();
+} FC_CAPTURE_AND_RETHROW( (dbdir) ) }
+
+void block_database::open_segment( const fc::path& blocks_file, const fc::path& index_file, bool create,
+                                   uint32_t first_block_num )
+{ try {
+   std::unique_ptr<segment> seg( new segment );
+   seg->blocks_path = blocks_file;
+   seg->blocks.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+   seg->index.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+
+   auto mode = std::fstream::binary | std::fstream::in | std::fstream::out;
+   if( create )
+   {
+      seg->header.compression = _compression;
+      seg->header.first_block_num = first_block_num;
+      seg->header.blocks_per_segment = _blocks_per_segment;
+      seg->blocks.open( blocks_file.generic_string().c_str(), mode | std::fstream::trunc );
+      seg->index.open( index_file.generic_string().c_str(), mode | std::fstream::trunc );
+      seg->blocks.write( (const char*)&seg->header, sizeof(seg->header) );
+      seg->blocks.flush();
+      seg->written_size = sizeof(seg->header);
    }
    else
    {
-     _block_num_to_pos.open( (dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+      seg->blocks.open( blocks_file.generic_string().c_str(), mode );
+      seg->blocks.read( (char*)&seg->header, sizeof(seg->header) );
+      FC_ASSERT( seg->header.magic == segment_magic && seg->header.version == segment_version,
+                 "Not a block log segment" );
+      FC_ASSERT( seg->header.blocks_per_segment > 0 );
+      if( fc::exists( index_file ) )
+         seg->index.open( index_file.generic_string().c_str(), mode );
+      else
+         seg->index.open( index_file.generic_string().c_str(), mode | std::fstream::trunc );
+
+      seg->index.seekg( 0, seg->index.end );
+      size_t count = size_t(seg->index.tellg()) / sizeof(index_entry);
+      count = std::min<size_t>( count, seg->header.blocks_per_segment );
+      seg->entries.resize( count );
+      seg->index.seekg( 0 );
+      if( count )
+         seg->index.read( (char*)seg->entries.data(), count * sizeof(index_entry) );
+      seg->written_size = fc::file_size( blocks_file );
+      seg->remap();
    }
-} FC_CAPTURE_AND_RETHROW( (dbdir) ) }
+
+   uint32_t first = seg->header.first_block_num;
+   FC_ASSERT( _segments.find( first ) == _segments.end(), "Duplicate block log segment ${f}", ("f",first) );
+   _segments[first] = std::move( seg );
+} FC_CAPTURE_AND_RETHROW( (blocks_file) ) }
+
+void block_database::convert_legacy_files()
+{ try {
+   ilog( "Converting block database ${d} to segmented format", ("d",_dbdir) );
+   std::fstream old_index( (_dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in );
+   std::fstream old_blocks( (_dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in );
+   old_index.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+   old_blocks.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+
+   old_index.seekg( 0, old_index.end );
+   uint32_t count = uint64_t(old_index.tellg()) / sizeof(index_entry);
+   old_index.seekg( 0 );
+   uint32_t converted = 0;
+   for( uint32_t num = 0; num < count; ++num )
+   {
+      index_entry e;
+      old_index.read( (char*)&e, sizeof(e) );
+      if( e.block_size == 0 || e.block_id == block_id_type() )
+         continue;
+      vector<char> data( e.block_size );
+      old_blocks.seekg( e.block_pos );
+      old_blocks.read( data.data(), e.block_size );
+      store_locked( e.block_id, fc::raw::unpack<signed_block>( data ) );
+      ++converted;
+   }
+   old_index.close();
+   old_blocks.close();
+   write_pending();
+
+   fc::remove( _dbdir/"index" );
+   fc::remove( _dbdir/"blocks" );
+   ilog( "Converted ${n} blocks", ("n",converted) );
+} FC_CAPTURE_AND_RETHROW( (_dbdir) ) }
 
 bool block_database::is_open()const
 {
-  return _blocks.is_open();
+   boost::shared_lock<boost::shared_mutex> lock( _lock );
+   return _open;
 }
 
 void block_database::close()
 {
-  _blocks.close();
-  _block_num_to_pos.close();
+   boost::unique_lock<boost::shared_mutex> lock( _lock );
+   if( _open )
+      write_pending();
+   for( auto& s : _segments )
+   {
+      s.second->unmap();
+      s.second->blocks.close();
+      s.second->index.close();
+   }
+   _segments.clear();
+   _open = false;
+
+   std::lock_guard<std::mutex> guard( _cache_mutex );
+   _cache.clear();
+   _cache_order.clear();
 }
 
 void block_database::flush()
 {
-  _blocks.flush();
-  _block_num_to_pos.flush();
+   boost::unique_lock<boost::shared_mutex> lock( _lock );
+   write_pending();
 }
 
-void block_database::store( const block_id_type& _id, const signed_block& b )
+void block_database::write_pending()
+{ try {
+   // write every segment first and sync afterwards, so one flush costs a single round of fsyncs
+   vector<segment*> written;
+   for( auto& s : _segments )
+      if( s.second->write_pending() )
+         written.push_back( s.second.get() );
+   if( _flush_policy.sync )
+   {
+      for( segment* seg : written )
+      {
+         fc::path index_file = seg->blocks_path;
+         index_file.replace_extension( ".index" );
+         sync_file( seg->blocks_path );
+         sync_file( index_file );
+      }
+   }
+   _pending_blocks = 0;
+} FC_CAPTURE_AND_RETHROW( (_dbdir) ) }
+
+block_database::segment* block_database::find_segment( uint32_t block_num )const
+{
+   auto itr = _segments.upper_bound( block_num );
+   if( itr == _segments.begin() )
+      return nullptr;
+   --itr;
+   return itr->second->covers( block_num ) ? itr->second.get() : nullptr;
+}
+
+block_database::segment& block_database::get_or_create_segment( uint32_t block_num )
+{
+   segment* seg = find_segment( block_num );
+   if( seg != nullptr )
+      return *seg;
+
+   // start the new segment on a multiple of the segment size, unless that would overlap the previous one
+   uint32_t first = block_num - block_num % _blocks_per_segment;
+   auto prev = _segments.upper_bound( block_num );
+   if( prev != _segments.begin() )
+   {
+      --prev;
+      first = std::max( first, prev->first + prev->second->header.blocks_per_segment );
+   }
+   open_segment( segment_file( _dbdir, first, ".blocks" ), segment_file( _dbdir, first, ".index" ), true, first );
+   seg = find_segment( block_num );
+   FC_ASSERT( seg != nullptr, "Block log segment starting at ${f} does not cover block ${n}",
+              ("f",first)("n",block_num) );
+   return *seg;
+}
+
+const block_database::index_entry* block_database::find_entry( uint32_t block_num )const
+{
+   const segment* seg = find_segment( block_num );
+   if( seg == nullptr )
+      return nullptr;
+   uint32_t offset = block_num - seg->header.first_block_num;
+   if( offset >= seg->entries.size() )
+      return nullptr;
+   return &seg->entries[offset];
+}
+
+const block_database::index_entry* block_database::find_last_entry( uint32_t& block_num )const
+{
+   for( auto itr = _segments.rbegin(); itr != _segments.rend(); ++itr )
+   {
+      const auto& entries = itr->second->entries;
+      for( size_t i = entries.size(); i > 0; --i )
+      {
+         if( entries[i-1].block_size != 0 )
+         {
+            block_num = itr->first + i - 1;
+            return &entries[i-1];
+         }
+      }
+   }
+   return nullptr;
+}
+
+block_database::packed_block_ptr block_database::read_packed( uint32_t block_num, const block_id_type* id,
+                                                               block_id_type* stored_id )const
+{
+   packed_block_ptr result = cache_find( block_num, id, stored_id );
+   if( result )
+      return result;
+
+   auto read = [&]( bool may_remap ) -> bool {
+      segment* seg = find_segment( block_num );
+      const index_entry* e = find_entry( block_num );
+      if( e == nullptr || e->block_size == 0 || ( id != nullptr && e->block_id != *id ) )
+         return true;
+      if( stored_id != nullptr )
+         *stored_id = e->block_id;
+      if( e->block_pos >= seg->written_size )
+      {
+         // still buffered
+         const char* begin = seg->pending.data() + ( e->block_pos - seg->written_size );
+         result = std::make_shared<const vector<char>>(
+                     decompress_block( vector<char>( begin, begin + e->block_size ), seg->header.compression ) );
+         cache_insert( block_num, e->block_id, result );
+         return true;
+      }
+      if( !seg->is_mapped( *e ) )
+      {
+         if( !may_remap )
+            return false;
+         seg->remap();
+         FC_ASSERT( seg->is_mapped( *e ), "Block ${n} lies past the end of its segment", ("n",block_num) );
+      }
+      const char* begin = (const char*)seg->region->get_address() + e->block_pos;
+      result = std::make_shared<const vector<char>>(
+                  decompress_block( vector<char>( begin, begin + e->block_size ), seg->header.compression ) );
+      cache_insert( block_num, e->block_id, result );
+      return true;
+   };
+
+   {
+      boost::shared_lock<boost::shared_mutex> lock( _lock );
+      if( read( false ) )
+         return result;
+   }
+   // the block was appended after the segment was last mapped
+   boost::unique_lock<boost::shared_mutex> lock( _lock );
+   read( true );
+   return result;
+}
+
+optional<signed_block> block_database::unpack_block( const packed_block_ptr& packed )const
+{
+   if( !packed )
+      return optional<signed_block>();
+   return fc::raw::unpack<signed_block>( *packed );
+}
+
+void block_database::store( const block_id_type& id, const signed_block& b )
+{
+   boost::unique_lock<boost::shared_mutex> lock( _lock );
+   store_locked( id, b );
+}
+
+void block_database::store_locked( const block_id_type& _id, const signed_block& b )
 {
    block_id_type id = _id;
    if( id == block_id_type() )
@@ -83,33 +507,60 @@ void block_database::store( const block_id_type& _id, const signed_block& b )
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
    auto num = block_header::num_from_id(id);
-   _block_num_to_pos.seekp( sizeof( index_entry ) * num );
+   segment& seg = get_or_create_segment( num );
+   uint32_t offset = num - seg.header.first_block_num;
+
+   auto packed = std::make_shared<const vector<char>>( fc::raw::pack( b ) );
+   auto vec = compress_block( vector<char>( *packed ), seg.header.compression );
    index_entry e;
-   _blocks.seekp( 0, _blocks.end );
-   auto vec = fc::raw::pack( b );
-   e.block_pos  = _blocks.tellp();
+   e.block_pos  = seg.size();
    e.block_size = vec.size();
    e.block_id   = id;
-   _blocks.write( vec.data(), vec.size() );
-   _block_num_to_pos.write( (char*)&e, sizeof(e) );
+   seg.pending.insert( seg.pending.end(), vec.begin(), vec.end() );
+
+   if( seg.entries.size() <= offset )
+   {
+      // keep the on-disk index the same length as the in-memory one, with empty entries for any gap
+      seg.mark_dirty( seg.entries.size(), offset + 1 );
+      seg.entries.resize( offset + 1 );
+   }
+   else
+      seg.mark_dirty( offset, offset + 1 );
+   seg.entries[offset] = e;
+
+   // peers usually ask for the blocks we just stored, so serve them from the cache until the mapping catches up
+   cache_insert( num, id, packed );
+
+   if( _pending_blocks++ == 0 )
+      _oldest_pending = fc::time_point::now();
+   if( ( _flush_policy.max_pending_blocks > 0 && _pending_blocks >= _flush_policy.max_pending_blocks ) ||
+       ( _flush_policy.max_pending_time.count() > 0 &&
+         fc::time_point::now() - _oldest_pending >= _flush_policy.max_pending_time ) )
+      write_pending();
 }
 
 void block_database::remove( const block_id_type& id )
 { try {
-   index_entry e;
-   auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   boost::unique_lock<boost::shared_mutex> lock( _lock );
+   auto num = block_header::num_from_id(id);
+   segment* seg = find_segment( num );
+   uint32_t offset = seg ? num - seg->header.first_block_num : 0;
+   if( seg == nullptr || offset >= seg->entries.size() )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
+   index_entry& e = seg->entries[offset];
    if( e.block_id == id )
    {
+      // a popped block is usually the last one stored, drop it from the write buffer if it is still there
+      if( e.block_pos >= seg->written_size && e.block_pos + e.block_size == seg->size() )
+         seg->pending.resize( e.block_pos - seg->written_size );
       e.block_size = 0;
-      _block_num_to_pos.seekp( sizeof(e)*block_header::num_from_id(id) );
-      _block_num_to_pos.write( (char*)&e, sizeof(e) );
+      // the entry is written right away rather than with the next flush, so that a block which has been
+      // popped is not found in the log again after a crash
+      seg->index.seekp( sizeof(e) * offset );
+      seg->index.write( (const char*)&e, sizeof(e) );
+      seg->index.flush();
+      cache_erase( num );
    }
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
@@ -118,54 +569,44 @@ bool block_database::contains( const block_id_type& id )const
    if( id == block_id_type() )
       return false;
 
-   index_entry e;
-   auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
-      return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-   return e.block_id == id && e.block_size > 0;
+   boost::shared_lock<boost::shared_mutex> lock( _lock );
+   const index_entry* e = find_entry( block_header::num_from_id(id) );
+   return e != nullptr && e->block_id == id && e->block_size > 0;
 }
 
 block_id_type block_database::fetch_block_id( uint32_t block_num )const
 {
    assert( block_num != 0 );
-   index_entry e;
-   auto index_pos = sizeof(e)*block_num;
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= int64_t(index_pos) )
+   boost::shared_lock<boost::shared_mutex> lock( _lock );
+   const index_entry* e = find_entry( block_num );
+   if( e == nullptr )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
+   FC_ASSERT( e->block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
+   return e->block_id;
+}
 
-   FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
-   return e.block_id;
+std::shared_ptr<const vector<char>> block_database::fetch_packed( const block_id_type& id )const
+{
+   try
+   {
+      return read_packed( block_header::num_from_id(id), &id );
+   }
+   catch (const fc::exception&)
+   {
+   }
+   catch (const std::exception&)
+   {
+   }
+   return packed_block_ptr();
 }
 
 optional<signed_block> block_database::fetch_optional( const block_id_type& id )const
 {
    try
    {
-      index_entry e;
-      auto index_pos = sizeof(e)*block_header::num_from_id(id);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
-         return {};
-
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      if( e.block_id != id ) return optional<signed_block>();
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      if (e.block_size)
-         _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
+      auto result = unpack_block( read_packed( block_header::num_from_id(id), &id ) );
+      FC_ASSERT( !result.valid() || result->id() == id );
       return result;
    }
    catch (const fc::exception&)
@@ -181,20 +622,9 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
 {
    try
    {
-      index_entry e;
-      auto index_pos = sizeof(e)*block_num;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
-         return {};
-
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
+      block_id_type stored_id;
+      auto result = unpack_block( read_packed( block_num, nullptr, &stored_id ) );
+      FC_ASSERT( !result.valid() || result->id() == stored_id );
       return result;
    }
    catch (const fc::exception&)
@@ -210,30 +640,10 @@ optional<signed_block> block_database::last()const
 {
    try
    {
-      index_entry e;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-
-      if( _block_num_to_pos.tellp() < sizeof(index_entry) )
-         return optional<signed_block>();
-
-      _block_num_to_pos.seekg( -sizeof(index_entry), _block_num_to_pos.end );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      uint64_t pos = _block_num_to_pos.tellg();
-      while( e.block_size == 0 && pos > 0 )
-      {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      }
-
-      if( e.block_size == 0 )
+      optional<block_id_type> id = last_id();
+      if( !id.valid() )
          return optional<signed_block>();
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      return result;
+      return unpack_block( read_packed( block_header::num_from_id(*id), &*id ) );
    }
    catch (const fc::exception&)
    {
@@ -246,36 +656,105 @@ optional<signed_block> block_database::last()const
 
 optional<block_id_type> block_database::last_id()const
 {
-   try
-   {
-      index_entry e;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
+   boost::shared_lock<boost::shared_mutex> lock( _lock );
+   uint32_t block_num = 0;
+   const index_entry* e = find_last_entry( block_num );
+   if( e == nullptr )
+      return optional<block_id_type>();
+   return e->block_id;
+}
 
-      if( _block_num_to_pos.tellp() < sizeof(index_entry) )
-         return optional<block_id_type>();
+uint32_t block_database::first_retained_block_num()const
+{
+   boost::shared_lock<boost::shared_mutex> lock( _lock );
+   if( _segments.empty() )
+      return 0;
+   return _segments.begin()->first;
+}
+
+uint32_t block_database::prune_below( uint32_t block_num )
+{ try {
+   boost::unique_lock<boost::shared_mutex> lock( _lock );
+   uint32_t removed = 0;
+   while( _segments.size() > 1 )
+   {
+      auto itr = _segments.begin();
+      segment& seg = *itr->second;
+      uint32_t end = seg.header.first_block_num + seg.header.blocks_per_segment;
+      if( end > block_num )
+         break;
+
+      seg.unmap();
+      seg.blocks.close();
+      seg.index.close();
+      fc::path index_file = seg.blocks_path;
+      index_file.replace_extension( ".index" );
+      fc::remove( seg.blocks_path );
+      fc::remove( index_file );
 
-      _block_num_to_pos.seekg( -sizeof(index_entry), _block_num_to_pos.end );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      uint64_t pos = _block_num_to_pos.tellg();
-      while( e.block_size == 0 && pos > 0 )
       {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
+         std::lock_guard<std::mutex> guard( _cache_mutex );
+         for( auto c = _cache_order.begin(); c != _cache_order.end(); )
+         {
+            if( *c < end )
+            {
+               _cache.erase( *c );
+               c = _cache_order.erase( c );
+            }
+            else
+               ++c;
+         }
       }
+      ilog( "Pruned block log segment with blocks ${f} to ${l}", ("f",itr->first)("l",end - 1) );
+      _segments.erase( itr );
+      ++removed;
+   }
+   return removed;
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
-      if( e.block_size == 0 )
-         return optional<block_id_type>();
+block_database::packed_block_ptr block_database::cache_find( uint32_t block_num, const block_id_type* id,
+                                                             block_id_type* stored_id )const
+{
+   std::lock_guard<std::mutex> guard( _cache_mutex );
+   auto itr = _cache.find( block_num );
+   if( itr == _cache.end() || ( id != nullptr && itr->second.id != *id ) )
+      return packed_block_ptr();
+   if( stored_id != nullptr )
+      *stored_id = itr->second.id;
+   _cache_order.splice( _cache_order.begin(), _cache_order, itr->second.position );
+   return itr->second.packed;
+}
 
-      return e.block_id;
-   }
-   catch (const fc::exception&)
+void block_database::cache_insert( uint32_t block_num, const block_id_type& id, const packed_block_ptr& packed )const
+{
+   std::lock_guard<std::mutex> guard( _cache_mutex );
+   if( _cache_capacity == 0 )
+      return;
+   auto itr = _cache.find( block_num );
+   if( itr != _cache.end() )
    {
+      itr->second.id = id;
+      itr->second.packed = packed;
+      _cache_order.splice( _cache_order.begin(), _cache_order, itr->second.position );
+      return;
    }
-   catch (const std::exception&)
+   _cache_order.push_front( block_num );
+   _cache[block_num] = cache_entry{ id, packed, _cache_order.begin() };
+   if( _cache.size() > _cache_capacity )
    {
+      _cache.erase( _cache_order.back() );
+      _cache_order.pop_back();
    }
-   return optional<block_id_type>();
+}
+
+void block_database::cache_erase( uint32_t block_num )const
+{
+   std::lock_guard<std::mutex> guard( _cache_mutex );
+   auto itr = _cache.find( block_num );
+   if( itr == _cache.end() )
+      return;
+   _cache_order.erase( itr->second.position );
+   _cache.erase( itr );
 }
 
 
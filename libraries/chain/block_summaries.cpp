@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/block_summaries.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+namespace graphene { namespace chain {
+
+const uint32_t block_summaries::size;
+
+void block_summaries::set( uint32_t block_num, const block_id_type& id )
+{
+   const uint16_t slot = block_num & 0xffff;
+   if( recording() )
+      _journal.push_back( change{ slot, _block_ids[slot] } );
+   _block_ids[slot] = id;
+}
+
+void block_summaries::rollback( uint64_t pos )
+{
+   FC_ASSERT( pos >= _journal_start, "The journal has been forgotten up to ${s}", ("s",_journal_start)("pos",pos) );
+   while( position() > pos )
+   {
+      const change& last = _journal.back();
+      _block_ids[last.slot] = last.replaced;
+      _journal.pop_back();
+   }
+}
+
+void block_summaries::forget_before( uint64_t pos )
+{
+   while( _journal_start < pos && !_journal.empty() )
+   {
+      _journal.pop_front();
+      ++_journal_start;
+   }
+}
+
+void block_summaries::clear()
+{
+   std::fill( _block_ids.begin(), _block_ids.end(), block_id_type() );
+   _journal_start = position();
+   _journal.clear();
+}
+
+void block_summaries::save( const fc::path& file )const
+{ try {
+   std::ofstream out( file.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+   FC_ASSERT( out );
+   fc::raw::pack( out, _block_ids );
+   out.flush();
+   FC_ASSERT( out, "Error writing ${f}", ("f",file) );
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+bool block_summaries::load( const fc::path& file )
+{ try {
+   clear();
+   if( !fc::exists( file ) )
+      return false;
+   std::ifstream in( file.generic_string(), std::ifstream::binary | std::ifstream::in );
+   FC_ASSERT( in );
+   vector<block_id_type> block_ids;
+   fc::raw::unpack( in, block_ids );
+   FC_ASSERT( block_ids.size() == size, "${f} holds ${n} block ids", ("f",file)("n",block_ids.size()) );
+   _block_ids = std::move( block_ids );
+   return true;
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+} } // graphene::chain
@@ -33,11 +33,10 @@ namespace graphene { namespace chain {
 
 asset database::get_balance(account_id_type owner, asset_id_type asset_id) const
 {
-   auto& index = get_index_type<account_balance_index>().indices().get<by_account_asset>();
-   auto itr = index.find(boost::make_tuple(owner, asset_id));
-   if( itr == index.end() )
+   const account_balance_object* balance = _balances_by_account->find(owner, asset_id);
+   if( balance == nullptr )
       return asset(0, asset_id);
-   return itr->get_balance();
+   return balance->get_balance();
 }
 
 asset database::get_balance(const account_object& owner, const asset_object& asset_obj) const
@@ -55,9 +54,8 @@ void database::adjust_balance(account_id_type account, asset delta )
    if( delta.amount == 0 )
       return;
 
-   auto& index = get_index_type<account_balance_index>().indices().get<by_account_asset>();
-   auto itr = index.find(boost::make_tuple(account, delta.asset_id));
-   if(itr == index.end())
+   const account_balance_object* itr = _balances_by_account->find(account, delta.asset_id);
+   if( itr == nullptr )
    {
       FC_ASSERT( delta.amount > 0, "Insufficient Balance: ${a}'s balance of ${b} is less than required ${r}", 
                  ("a",account(*this).name)
@@ -78,6 +76,47 @@ void database::adjust_balance(account_id_type account, asset delta )
 
 } FC_CAPTURE_AND_RETHROW( (account)(delta) ) }
 
+namespace {
+   /** @return the vesting balance deposit_lazy_vesting deposits into, or null if it creates a new one */
+   const vesting_balance_object* find_lazy_vesting( const database& db, const optional< vesting_balance_id_type >& ovbid,
+                                                    uint32_t req_vesting_seconds, account_id_type req_owner )
+   {
+      if( !ovbid.valid() )
+         return nullptr;
+      const vesting_balance_object& vbo = (*ovbid)(db);
+      if( vbo.owner != req_owner )
+         return nullptr;
+      if( vbo.policy.which() != vesting_policy::tag< cdd_vesting_policy >::value )
+         return nullptr;
+      if( vbo.policy.get< cdd_vesting_policy >().vesting_seconds != req_vesting_seconds )
+         return nullptr;
+      return &vbo;
+   }
+
+   void deposit_lazy_vesting_into( vesting_balance_object& vbo, fc::time_point_sec now, share_type amount,
+                                   bool require_vesting )
+   {
+      if( require_vesting )
+         vbo.deposit(now, amount);
+      else
+         vbo.deposit_vested(now, amount);
+   }
+
+   void init_lazy_vesting( vesting_balance_object& vbo, fc::time_point_sec now, share_type amount,
+                           uint32_t req_vesting_seconds, account_id_type req_owner, bool require_vesting )
+   {
+      vbo.owner = req_owner;
+      vbo.balance = amount;
+
+      cdd_vesting_policy policy;
+      policy.vesting_seconds = req_vesting_seconds;
+      policy.coin_seconds_earned = require_vesting ? 0 : amount.value * policy.vesting_seconds;
+      policy.coin_seconds_earned_last_update = now;
+
+      vbo.policy = policy;
+   }
+}
+
 optional< vesting_balance_id_type > database::deposit_lazy_vesting(
    const optional< vesting_balance_id_type >& ovbid,
    share_type amount, uint32_t req_vesting_seconds,
@@ -89,38 +128,18 @@ optional< vesting_balance_id_type > database::deposit_lazy_vesting(
 
    fc::time_point_sec now = head_block_time();
 
-   while( true )
+   if( const vesting_balance_object* vbo = find_lazy_vesting( *this, ovbid, req_vesting_seconds, req_owner ) )
    {
-      if( !ovbid.valid() )
-         break;
-      const vesting_balance_object& vbo = (*ovbid)(*this);
-      if( vbo.owner != req_owner )
-         break;
-      if( vbo.policy.which() != vesting_policy::tag< cdd_vesting_policy >::value )
-         break;
-      if( vbo.policy.get< cdd_vesting_policy >().vesting_seconds != req_vesting_seconds )
-         break;
-      modify( vbo, [&]( vesting_balance_object& _vbo )
+      modify( *vbo, [&]( vesting_balance_object& _vbo )
       {
-         if( require_vesting )
-            _vbo.deposit(now, amount);
-         else
-            _vbo.deposit_vested(now, amount);
+         deposit_lazy_vesting_into( _vbo, now, amount, require_vesting );
       } );
       return optional< vesting_balance_id_type >();
    }
 
    const vesting_balance_object& vbo = create< vesting_balance_object >( [&]( vesting_balance_object& _vbo )
    {
-      _vbo.owner = req_owner;
-      _vbo.balance = amount;
-
-      cdd_vesting_policy policy;
-      policy.vesting_seconds = req_vesting_seconds;
-      policy.coin_seconds_earned = require_vesting ? 0 : amount.value * policy.vesting_seconds;
-      policy.coin_seconds_earned_last_update = now;
-
-      _vbo.policy = policy;
+      init_lazy_vesting( _vbo, now, amount, req_vesting_seconds, req_owner, require_vesting );
    } );
 
    return vbo.id;
@@ -139,12 +158,44 @@ void database::deposit_cashback(const account_object& acct, share_type amount, b
        acct.get_id() == GRAPHENE_TEMP_ACCOUNT )
    {
       // The blockchain's accounts do not get cashback; it simply goes to the reserve pool.
+      if( _cashback_batch )
+      {
+         _cashback_batch->to_reserve += amount;
+         return;
+      }
       modify(get(asset_id_type()).dynamic_asset_data_id(*this), [amount](asset_dynamic_data_object& d) {
          d.current_supply -= amount;
       });
       return;
    }
 
+   if( _cashback_batch )
+   {
+      const fc::time_point_sec now = head_block_time();
+      const uint32_t vesting_seconds = get_global_properties().parameters.cashback_vesting_period_seconds;
+      cashback_batch& batch = *_cashback_batch;
+      auto itr = batch.by_account.find( acct.id );
+      if( itr != batch.by_account.end() )
+         deposit_lazy_vesting_into( batch.deposits[itr->second].balance, now, amount, require_vesting );
+      else
+      {
+         batch.by_account.emplace( acct.id, batch.deposits.size() );
+         batch.deposits.emplace_back();
+         cashback_batch::deposit& d = batch.deposits.back();
+         d.account = acct.id;
+         if( const vesting_balance_object* vbo = find_lazy_vesting( *this, acct.cashback_vb, vesting_seconds, acct.id ) )
+         {
+            d.existing = vbo->id;
+            d.balance = *vbo;
+            deposit_lazy_vesting_into( d.balance, now, amount, require_vesting );
+         }
+         else
+            init_lazy_vesting( d.balance, now, amount, vesting_seconds, acct.id, require_vesting );
+      }
+      batch.recipients.push_back( acct.id );
+      return;
+   }
+
    optional< vesting_balance_id_type > new_vbid = deposit_lazy_vesting(
       acct.cashback_vb,
       amount,
@@ -163,6 +214,53 @@ void database::deposit_cashback(const account_object& acct, share_type amount, b
    return;
 }
 
+share_type database::get_cashback_balance(const account_object& acct)const
+{
+   if( _cashback_batch )
+   {
+      auto itr = _cashback_batch->by_account.find( acct.id );
+      if( itr != _cashback_batch->by_account.end() )
+         return _cashback_batch->deposits[itr->second].balance.balance.amount;
+   }
+   return acct.cashback_vb.valid() ? (*acct.cashback_vb)(*this).balance.amount : share_type(0);
+}
+
+void database::apply_cashback_batch()
+{
+   std::unique_ptr<cashback_batch> batch = std::move( _cashback_batch );
+   if( batch->to_reserve != 0 )
+      modify( get(asset_id_type()).dynamic_asset_data_id(*this), [&]( asset_dynamic_data_object& d ) {
+         d.current_supply -= batch->to_reserve;
+      });
+   for( const cashback_batch::deposit& d : batch->deposits )
+   {
+      if( d.existing.valid() )
+      {
+         modify( (*d.existing)(*this), [&]( vesting_balance_object& vbo ) {
+            vbo.balance = d.balance.balance;
+            vbo.policy = d.balance.policy;
+         });
+         continue;
+      }
+      const vesting_balance_object& vbo = create< vesting_balance_object >( [&]( vesting_balance_object& _vbo ) {
+         _vbo.owner = d.balance.owner;
+         _vbo.balance = d.balance.balance;
+         _vbo.policy = d.balance.policy;
+      });
+      modify( d.account(*this), [&]( account_object& _acct ) {
+         _acct.cashback_vb = vbo.id;
+      });
+   }
+}
+
+void database::take_cashback_recipients( vector<account_id_type>& recipients )
+{
+   if( !_cashback_batch )
+      return;
+   recipients.insert( recipients.end(), _cashback_batch->recipients.begin(), _cashback_batch->recipients.end() );
+   _cashback_batch->recipients.clear();
+}
+
 void database::deposit_witness_pay(const witness_object& wit, share_type amount)
 {
    if( amount == 0 )
@@ -26,17 +26,16 @@
 #include <graphene/chain/db_with.hpp>
 #include <graphene/chain/hardfork.hpp>
 
-#include <graphene/chain/block_summary_object.hpp>
 #include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/operation_history_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
-#include <graphene/chain/transaction_object.hpp>
 #include <graphene/chain/witness_object.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <graphene/chain/exceptions.hpp>
 #include <graphene/chain/evaluator.hpp>
 
 #include <fc/smart_ref_impl.hpp>
+#include <fc/thread/thread.hpp>
 
 namespace graphene { namespace chain {
 
@@ -51,15 +50,94 @@ bool database::is_known_block( const block_id_type& id )const
  */
 bool database::is_known_transaction( const transaction_id_type& id )const
 {
-   const auto& trx_idx = get_index_type<transaction_index>().indices().get<by_trx_id>();
-   return trx_idx.find( id ) != trx_idx.end();
+   return _recent_transactions.contains( id );
 }
 
 block_id_type  database::get_block_id_for_num( uint32_t block_num )const
 { try {
+   if( block_num >= _recent_first_num && block_num - _recent_first_num < _recent_block_ids.size() )
+      return _recent_block_ids[ block_num - _recent_first_num ];
    return _block_id_to_block.fetch_block_id( block_num );
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
+void database::note_applied_block( uint32_t block_num, const block_id_type& id )
+{
+   if( _recent_block_ids.empty() || _recent_first_num + _recent_block_ids.size() != block_num )
+   {
+      _recent_block_ids.clear();
+      _recent_first_num = block_num;
+   }
+   _recent_block_ids.push_back( id );
+
+   uint32_t low = last_non_undoable_block_num();
+   while( _recent_first_num < low && _recent_block_ids.size() > 1 )
+   {
+      _recent_block_ids.pop_front();
+      ++_recent_first_num;
+   }
+
+   if( _supply_checks )
+   {
+      try
+      {
+         verify_supply_totals();
+      }
+      catch( const fc::exception& e )
+      {
+         elog( "The supply doesn't add up after block ${n} ${id}: ${e}", ("n",block_num)("id",id)("e",e.to_string()) );
+      }
+   }
+
+   if( _state_digest_blocks == 0 )
+      return;
+   if( !_state_digests.empty() && _state_digests.back().block_num + 1 != block_num )
+      _state_digests.clear();
+   block_state_digest digest;
+   digest.block_num = block_num;
+   digest.block_id  = id;
+   digest.state     = get_digest();
+   _state_digests.push_back( std::move( digest ) );
+   while( _state_digests.size() > _state_digest_blocks )
+      _state_digests.pop_front();
+}
+
+void database::note_popped_block( uint32_t block_num )
+{
+   if( !_recent_block_ids.empty() && _recent_first_num + _recent_block_ids.size() - 1 == block_num )
+      _recent_block_ids.pop_back();
+   else
+      _recent_block_ids.clear();
+
+   if( !_state_digests.empty() && _state_digests.back().block_num == block_num )
+      _state_digests.pop_back();
+   else
+      _state_digests.clear();
+}
+
+void database::set_state_digest_blocks( uint32_t blocks )
+{
+   _state_digest_blocks = blocks;
+   set_maintain_digests( blocks != 0 );
+   while( _state_digests.size() > blocks )
+      _state_digests.pop_front();
+}
+
+optional<block_state_digest> database::get_state_digest( uint32_t block_num )const
+{
+   if( block_num == 0 )
+   {
+      block_state_digest digest;
+      digest.block_num = head_block_num();
+      digest.block_id  = head_block_id();
+      digest.state     = get_digest();
+      return digest;
+   }
+   for( const auto& digest : _state_digests )
+      if( digest.block_num == block_num )
+         return digest;
+   return optional<block_state_digest>();
+}
+
 optional<signed_block> database::fetch_block_by_id( const block_id_type& id )const
 {
    auto b = _fork_db.fetch_block( id );
@@ -68,6 +146,19 @@ optional<signed_block> database::fetch_block_by_id( const block_id_type& id )con
    return b->data;
 }
 
+std::shared_ptr<const vector<char>> database::fetch_packed_block_by_id( const block_id_type& id )const
+{
+   auto b = _fork_db.fetch_block( id );
+   if( !b )
+      return _block_id_to_block.fetch_packed(id);
+   return std::make_shared<const vector<char>>( fc::raw::pack( b->data ) );
+}
+
+uint32_t database::earliest_available_block_num()const
+{
+   return std::max<uint32_t>( _block_id_to_block.first_retained_block_num(), 1 );
+}
+
 optional<signed_block> database::fetch_block_by_number( uint32_t num )const
 {
    auto results = _fork_db.fetch_block_by_number(num);
@@ -78,12 +169,11 @@ optional<signed_block> database::fetch_block_by_number( uint32_t num )const
    return optional<signed_block>();
 }
 
-const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
+signed_transaction database::get_recent_transaction(const transaction_id_type& trx_id) const
 {
-   auto& index = get_index_type<transaction_index>().indices().get<by_trx_id>();
-   auto itr = index.find(trx_id);
-   FC_ASSERT(itr != index.end());
-   return itr->trx;
+   optional<signed_transaction> trx = _recent_transactions.find(trx_id);
+   FC_ASSERT(trx.valid());
+   return *trx;
 }
 
 std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of_fork) const
@@ -104,6 +194,147 @@ std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of
   return result;
 }
 
+precomputed_block database::precompute_block( const signed_block& b, bool trusted )
+{
+   precomputed_block result;
+   result.id          = b.id();
+   if( !trusted )
+   {
+      result.merkle_root = b.calculate_merkle_root();
+      try
+      {
+         result.signee = b.signee();
+      }
+      catch( const fc::exception& )
+      {
+         // leave it to validate_block_header() to reject the block
+      }
+   }
+   result.transaction_ids.reserve( b.transactions.size() );
+   for( const auto& trx : b.transactions )
+      result.transaction_ids.push_back( trx.id() );
+   return result;
+}
+
+/** holds database::_state_mutex exclusively, recursively within the fiber that changes the state */
+class database::state_write_guard
+{
+   public:
+      explicit state_write_guard( database& db ) : _db( db )
+      {
+         if( !_db._state_write_depth )
+            _db._state_write_depth.reset( new uint32_t( 0 ) );
+         if( *_db._state_write_depth == 0 )
+         {
+            // undoing and applying changes may touch the indexes of plugins, which may still be loading
+            _db.wait_for_deferred_indexes();
+            // a fiber which holds the guard may yield, others must wait for it rather than enter
+            _db._state_write_mutex.lock();
+            _db._state_mutex.lock();
+         }
+         ++*_db._state_write_depth;
+      }
+      ~state_write_guard()
+      {
+         if( --*_db._state_write_depth == 0 )
+         {
+            _db._state_mutex.unlock();
+            _db._state_write_mutex.unlock();
+         }
+      }
+   private:
+      database& _db;
+};
+
+namespace {
+   /**
+    * Runs check on every transaction of trxs, spread over the threads, and waits for all of them.  check must not
+    * throw, and must only write to the result slot of its own transaction.
+    */
+   template< typename Trx, typename Check >
+   void check_on_threads( const vector< std::unique_ptr<fc::thread> >& threads, const vector<Trx>& trxs,
+                          const Check& check )
+   {
+      const size_t workers = std::min( threads.size(), trxs.size() );
+      vector< fc::future<void> > done;
+      done.reserve( workers );
+      for( size_t w = 0; w < workers; ++w )
+         done.push_back( threads[w]->async( [&trxs,&check,w,workers]() {
+            for( size_t i = w; i < trxs.size(); i += workers )
+               check( i, trxs[i] );
+         }, "check transactions" ) );
+      for( auto& d : done )
+         d.wait();
+   }
+}
+
+vector< optional< flat_set<public_key_type> > > database::recover_signature_keys( const signed_block& b,
+                                                                                 const chain_id_type& chain_id )const
+{
+   vector< optional< flat_set<public_key_type> > > result;
+   for( auto& checked : check_block_transactions( b, chain_id, true, false ) )
+      result.push_back( std::move( checked.keys ) );
+   return result;
+}
+
+vector<database::checked_transaction> database::check_block_transactions( const signed_block& b,
+                                                                          const chain_id_type& chain_id,
+                                                                          bool recover_keys, bool validate )const
+{
+   vector<checked_transaction> result;
+   if( _signature_threads.empty() || b.transactions.size() < 2 || !( recover_keys || validate ) )
+      return result;
+
+   result.resize( b.transactions.size() );
+   check_on_threads( _signature_threads, b.transactions,
+                     [&chain_id,&result,recover_keys,validate]( size_t i, const processed_transaction& trx ) {
+      // whatever is left undone, _apply_transaction does again and reports the error in order
+      if( validate )
+      {
+         try
+         {
+            trx.validate();
+            result[i].validated = true;
+         }
+         catch( const fc::exception& )
+         {
+            return;
+         }
+      }
+      if( recover_keys )
+      {
+         try
+         {
+            result[i].keys = trx.get_signature_keys( chain_id );
+         }
+         catch( const fc::exception& )
+         {
+         }
+      }
+   } );
+   return result;
+}
+
+bool database::push_block( const signed_block& b, uint32_t skip, const precomputed_block& pre )
+{
+   FC_ASSERT( _precomputed_block == nullptr );
+   _precomputed_block = &b;
+   _precomputed = &pre;
+   try
+   {
+      bool result = push_block( b, skip );
+      _precomputed_block = nullptr;
+      _precomputed = nullptr;
+      return result;
+   }
+   catch( ... )
+   {
+      _precomputed_block = nullptr;
+      _precomputed = nullptr;
+      throw;
+   }
+}
+
 /**
  * Push block "may fail" in which case every partial change is unwound.  After
  * push block is successful the block is appended to the chain database on disk.
@@ -113,6 +344,7 @@ std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of
 bool database::push_block(const signed_block& new_block, uint32_t skip)
 {
    //idump((new_block.block_num())(new_block.id())(new_block.timestamp)(new_block.previous));
+   state_write_guard guard( *this );
    bool result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -128,12 +360,14 @@ bool database::push_block(const signed_block& new_block, uint32_t skip)
 bool database::_push_block(const signed_block& new_block)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
+   const precomputed_block* pre = precomputed_for( new_block );
+   const block_id_type new_block_id = pre ? pre->id : new_block.id();
    if( !(skip&skip_fork_db) )
    {
       /// TODO: if the block is greater than the head block and before the next maitenance interval
       // verify that the block signer is in the current set of active witnesses.
 
-      shared_ptr<fork_item> new_head = _fork_db.push_block(new_block);
+      item_ptr new_head = _fork_db.push_block( new_block, new_block_id );
       //If the head block from the longest chain does not build off of the current head, we need to switch forks.
       if( new_head->data.previous != head_block_id() )
       {
@@ -144,20 +378,46 @@ bool database::_push_block(const signed_block& new_block)
             wlog( "Switching to fork: ${id}", ("id",new_head->data.id()) );
             auto branches = _fork_db.fetch_branch_from(new_head->data.id(), head_block_id());
 
+            const bool too_deep = _undo_db.squash_depth() != 0 && branches.second.size() > _undo_db.unsquashed_size();
+            if( too_deep )
+               _fork_db.set_head( branches.second.front() );
+            GRAPHENE_ASSERT( !too_deep, undo_database_exception,
+                             "Not switching to a fork ${n} blocks deep, past the squashed undo states",
+                             ("n",branches.second.size()) );
+
+            // the blocks checked in the background while their branch was behind, oldest first
+            vector<fork_block_checks_ptr> checks;
+            checks.reserve( branches.first.size() );
+            for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr )
+            {
+               checks.push_back( take_fork_block_checks( (*ritr)->id ) );
+               if( checks.back() && !checks.back()->valid )
+               {
+                  // nothing has been popped yet, so dropping the branch from the invalid block on is all it takes
+                  const block_id_type invalid_id = (*ritr)->id;
+                  while( ritr != branches.first.rend() )
+                  {
+                     _fork_db.remove( (*ritr)->id );
+                     ++ritr;
+                  }
+                  _fork_db.set_head( branches.second.front() );
+                  FC_THROW( "Not switching to a fork with block ${id}, which fails its stateless checks",
+                            ("id",invalid_id) );
+               }
+            }
+
             // pop blocks until we hit the forked block
             while( head_block_id() != branches.second.back()->data.previous )
                pop_block();
 
             // push all blocks on the new fork
+            auto next_checks = checks.begin();
             for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr )
             {
                 ilog( "pushing blocks from fork ${n} ${id}", ("n",(*ritr)->data.block_num())("id",(*ritr)->data.id()) );
                 optional<fc::exception> except;
                 try {
-                   undo_database::session session = _undo_db.start_undo_session();
-                   apply_block( (*ritr)->data, skip );
-                   _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
-                   session.commit();
+                   reapply_block( (*ritr)->data, (*ritr)->id, skip, (next_checks++)->get() );
                 }
                 catch ( const fc::exception& e ) { except = e; }
                 if( except )
@@ -177,35 +437,284 @@ bool database::_push_block(const signed_block& new_block)
 
                    // restore all blocks from the good fork
                    for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr )
-                   {
-                      auto session = _undo_db.start_undo_session();
-                      apply_block( (*ritr)->data, skip );
-                      _block_id_to_block.store( new_block.id(), (*ritr)->data );
-                      session.commit();
-                   }
+                      reapply_block( (*ritr)->data, (*ritr)->id, skip );
                    throw *except;
                 }
             }
             return true;
          }
-         else return false;
+         else
+         {
+            // a block of a competing branch, which may become the longest one later
+            if( _fork_checker )
+               start_fork_block_checks( new_block, new_block_id );
+            return false;
+         }
       }
    }
 
    try {
-      auto session = _undo_db.start_undo_session();
-      apply_block(new_block, skip);
-      _block_id_to_block.store(new_block.id(), new_block);
-      session.commit();
+      reapply_block( new_block, new_block_id, skip );
    } catch ( const fc::exception& e ) {
       elog("Failed to push new block:\n${e}", ("e", e.to_detail_string()));
-      _fork_db.remove(new_block.id());
+      _fork_db.remove(new_block_id);
       throw;
    }
 
    return false;
 } FC_CAPTURE_AND_RETHROW( (new_block) ) }
 
+void database::remember_popped_block( const signed_block& b, const block_id_type& id )
+{
+   popped_block& popped = _popped_blocks[id];
+   popped.previous = b.previous;
+   popped.diff.reset();
+   if( !_fork_diff_replay )
+      return;
+
+   auto diff = std::make_shared<block_diff>();
+   const auto& state = _undo_db.head();
+   diff->modified.reserve( state.old_values.size() );
+   for( const auto& item : state.old_values )
+      diff->modified.emplace_back( item.first, get_object( item.first ).pack() );
+   diff->created.reserve( state.new_ids.size() );
+   for( const auto& new_id : state.new_ids )
+      diff->created.push_back( get_object( new_id ).clone() );
+   diff->removed.reserve( state.removed.size() );
+   for( const auto& item : state.removed )
+      diff->removed.push_back( item.first );
+   diff->next_ids.reserve( state.old_index_next_ids.size() );
+   for( const auto& item : state.old_index_next_ids )
+      diff->next_ids.emplace_back( item.first, get_index( item.first.space(), item.first.type() ).get_next_id() );
+   diff->recorded_transactions = !b.transactions.empty() && _recent_transactions.contains( b.transactions.front().id() );
+   auto ops = _reversible_applied_ops.find( id );
+   if( ops != _reversible_applied_ops.end() )
+   {
+      diff->applied_ops = ops->second;
+      _reversible_applied_ops.erase( ops );
+   }
+   popped.diff = diff;
+}
+
+void database::reapply_block( const signed_block& b, const block_id_type& id, uint32_t skip,
+                              const fork_block_checks* checks )
+{
+   auto popped = _popped_blocks.find( id );
+   if( popped != _popped_blocks.end() && popped->second.previous != head_block_id() )
+      popped = _popped_blocks.end();
+
+   // the checks made in the background stand in for the ones the block was pushed with, if any
+   const signed_block* pushed_block = _precomputed_block;
+   const precomputed_block* pushed = _precomputed;
+   if( checks != nullptr && _precomputed_block != &b )
+   {
+      _precomputed_block = &b;
+      _precomputed = &checks->pre;
+   }
+   try
+   {
+      auto session = _undo_db.start_undo_session();
+      if( popped != _popped_blocks.end() && popped->second.diff )
+         replay_block_diff( b, id, *popped->second.diff );
+      else if( popped != _popped_blocks.end() )
+         // the block passed every check on this very state before, applying it again gives the same result
+         apply_block( b, skip | skip_witness_signature | skip_transaction_signatures | skip_merkle_check );
+      else
+         apply_block( b, skip );
+      _block_id_to_block.store( id, b );
+      session.commit();
+   }
+   catch( ... )
+   {
+      _precomputed_block = pushed_block;
+      _precomputed = pushed;
+      throw;
+   }
+   _precomputed_block = pushed_block;
+   _precomputed = pushed;
+   if( popped != _popped_blocks.end() )
+      _popped_blocks.erase( popped );
+   prune_fork_state();
+}
+
+void database::prune_fork_state()
+{
+   if( _popped_blocks.empty() && _fork_block_checks.empty() && _reversible_applied_ops.empty() )
+      return;
+   const uint32_t last_irreversible = get_dynamic_global_properties().last_irreversible_block_num;
+   for( auto itr = _reversible_applied_ops.begin(); itr != _reversible_applied_ops.end(); )
+   {
+      if( block_header::num_from_id( itr->first ) <= last_irreversible )
+         itr = _reversible_applied_ops.erase( itr );
+      else
+         ++itr;
+   }
+   for( auto itr = _popped_blocks.begin(); itr != _popped_blocks.end(); )
+   {
+      if( block_header::num_from_id( itr->first ) <= last_irreversible )
+         itr = _popped_blocks.erase( itr );
+      else
+         ++itr;
+   }
+   for( auto itr = _fork_block_checks.begin(); itr != _fork_block_checks.end(); )
+   {
+      if( block_header::num_from_id( itr->first ) <= last_irreversible )
+         itr = _fork_block_checks.erase( itr );
+      else
+         ++itr;
+   }
+}
+
+void database::set_fork_prevalidation( bool enabled )
+{
+   if( enabled && !_fork_checker )
+      _fork_checker.reset( new fc::thread( "fork checker" ) );
+   else if( !enabled && _fork_checker )
+   {
+      for( auto& item : _fork_block_checks )
+      {
+         try
+         {
+            item.second.wait();
+         }
+         catch( ... )
+         {
+         }
+      }
+      _fork_block_checks.clear();
+      _fork_checker.reset();
+   }
+}
+
+void database::start_fork_block_checks( const signed_block& b, const block_id_type& id )
+{
+   if( is_trusted_block( b.block_num() ) || _fork_block_checks.find( id ) != _fork_block_checks.end() )
+      return;
+   auto block = std::make_shared<const signed_block>( b );
+   auto chain_id = get_chain_id();
+   _fork_block_checks[id] = _fork_checker->async( [block,chain_id]() -> fork_block_checks_ptr {
+      auto checks = std::make_shared<fork_block_checks>();
+      checks->pre = precompute_block( *block );
+      checks->valid = checks->pre.merkle_root == block->transaction_merkle_root && checks->pre.signee.valid();
+      checks->pre.signature_keys.reserve( block->transactions.size() );
+      for( const auto& trx : block->transactions )
+      {
+         if( !checks->valid )
+            break;
+         try
+         {
+            trx.validate();
+         }
+         catch( const fc::exception& )
+         {
+            checks->valid = false;
+            break;
+         }
+         optional< flat_set<public_key_type> > keys;
+         try
+         {
+            keys = trx.get_signature_keys( chain_id );
+         }
+         catch( const fc::exception& )
+         {
+            // a signature which can't be recovered doesn't satisfy any authority; applying the block reports it
+         }
+         checks->pre.signature_keys.push_back( std::move( keys ) );
+      }
+      checks->pre.transactions_validated = checks->valid;
+      return checks;
+   }, "fork block checks" );
+}
+
+database::fork_block_checks_ptr database::take_fork_block_checks( const block_id_type& id )
+{
+   auto itr = _fork_block_checks.find( id );
+   if( itr == _fork_block_checks.end() )
+      return fork_block_checks_ptr();
+   fc::future<fork_block_checks_ptr> done = itr->second;
+   _fork_block_checks.erase( itr );
+   try
+   {
+      return done.wait();
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Unable to check fork block ${id}: ${e}", ("id",id)("e",e.to_detail_string()) );
+   }
+   return fork_block_checks_ptr();
+}
+
+void database::apply_object_records( const vector<object_record>& records )
+{ try {
+   state_write_guard guard( *this );
+   for( const auto& r : records )
+   {
+      if( r.second.valid() )
+         get_mutable_index( r.first ).import( r.second->data(), r.second->size() );
+      else
+      {
+         const object* obj = find_object( r.first );
+         if( obj != nullptr )
+            remove( *obj );
+      }
+   }
+   notify_changed_objects();
+} FC_CAPTURE_AND_RETHROW( (records.size()) ) }
+
+void database::replay_block_diff( const signed_block& b, const block_id_type& id, const block_diff& diff )
+{ try {
+   wait_for_deferred_indexes();
+   clear_applied_ops();
+   // the ids used up go first, so inserting the created objects doesn't move the next ids
+   for( const auto& item : diff.next_ids )
+   {
+      index& idx = get_mutable_index( item.first.space(), item.first.type() );
+      _undo_db.on_id_used( idx.get_next_id() );
+      idx.set_next_id( item.second );
+   }
+   for( const auto& removed : diff.removed )
+      remove( get_object( removed ) );
+   for( const auto& item : diff.modified )
+      modify( get_object( item.first ), [&item]( object& obj ) {
+         obj.unpack_from( item.second.data(), item.second.size() );
+      } );
+   for( const auto& created : diff.created )
+      insert( std::move( *created->clone() ) );
+
+   // what lives outside of the object database is recorded again from the block
+   if( diff.recorded_transactions )
+      for( const auto& trx : b.transactions )
+         _recent_transactions.insert( trx.id(), trx );
+   _recent_transactions.remove_expired( b.timestamp );
+   _block_summaries.set( b.block_num(), id );
+
+   // the observers hear of the block again, with the operations it applied
+   if( diff.applied_ops )
+      _applied_ops = std::make_shared< vector< optional<operation_history_object> > >( *diff.applied_ops );
+   _replaying_block_diff = true;
+   try
+   {
+      applied_block( b ); //emit
+   }
+   catch( ... )
+   {
+      _replaying_block_diff = false;
+      clear_applied_ops();
+      throw;
+   }
+   _replaying_block_diff = false;
+   if( _fork_diff_replay )
+      _reversible_applied_ops[id] = share_applied_operations();
+   clear_applied_ops();
+
+   notify_changed_objects();
+   note_applied_block( b.block_num(), id );
+   if( _state_checkpoint_interval != 0 )
+      update_state_checkpoint();
+   if( _flush_interval != 0 )
+      update_background_flush();
+} FC_CAPTURE_AND_RETHROW( (b.block_num()) ) }
+
 /**
  * Attempts to push the transaction into the pending queue
  *
@@ -217,6 +726,7 @@ bool database::_push_block(const signed_block& new_block)
  */
 processed_transaction database::push_transaction( const signed_transaction& trx, uint32_t skip )
 { try {
+   state_write_guard guard( *this );
    processed_transaction result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -225,12 +735,162 @@ processed_transaction database::push_transaction( const signed_transaction& trx,
    return result;
 } FC_CAPTURE_AND_RETHROW( (trx) ) }
 
-processed_transaction database::_push_transaction( const signed_transaction& trx )
+void database::set_pending_transaction_limits( const pending_transaction_pool::limits& limits )
+{
+   _pending_pool.set_limits( limits );
+}
+
+vector<transaction_id_type> database::trim_pending_transactions( vector<processed_transaction>& txs )const
+{
+   pending_transaction_pool pool;
+   pool.set_limits( _pending_pool.get_limits() );
+   vector<transaction_id_type> ids;
+   ids.reserve( txs.size() );
+   for( uint32_t i = 0; i < txs.size(); ++i )
+   {
+      auto entry = pending_transaction_pool::make_entry( *this, txs[i], i );
+      ids.push_back( entry.id );
+      pool.add( entry );
+   }
+   auto removed = pool.trim( head_block_time() );
+   if( removed.empty() )
+      return ids;
+
+   vector<bool> drop( txs.size() );
+   for( uint32_t i : removed )
+      drop[i] = true;
+   vector<processed_transaction> kept;
+   vector<transaction_id_type> kept_ids;
+   kept.reserve( txs.size() - removed.size() );
+   kept_ids.reserve( txs.size() - removed.size() );
+   for( uint32_t i = 0; i < txs.size(); ++i )
+      if( !drop[i] )
+      {
+         kept.push_back( std::move( txs[i] ) );
+         kept_ids.push_back( ids[i] );
+      }
+   txs = std::move( kept );
+   return kept_ids;
+}
+
+processed_transaction database::push_checked_transaction( const signed_transaction& trx,
+                                                          const flat_set<public_key_type>& signature_keys,
+                                                          uint32_t skip )
+{ try {
+   state_write_guard guard( *this );
+   processed_transaction result;
+   detail::with_skip_flags( *this, skip, [&]()
+   {
+      result = _push_transaction( trx, &signature_keys, true );
+   } );
+   return result;
+} FC_CAPTURE_AND_RETHROW( (trx) ) }
+
+void database::precheck_transaction( const signed_transaction& trx )const
 {
+   // no FC_CAPTURE_AND_RETHROW, a flood of bad transactions shouldn't cost a variant of each
+   FC_ASSERT( !_recent_transactions.contains( trx.id() ), "transaction is already known" );
+   if( head_block_num() == 0 )
+      return;
+   const fc::time_point_sec now = head_block_time();
+   FC_ASSERT( now <= trx.expiration, "", ("now",now)("trx.exp",trx.expiration) );
+   FC_ASSERT( trx.expiration <= now + get_global_properties().parameters.maximum_time_until_expiration, "",
+              ("trx.expiration",trx.expiration)("now",now)
+              ("max_til_exp",get_global_properties().parameters.maximum_time_until_expiration) );
+   FC_ASSERT( trx.ref_block_prefix == get_tapos_block_id( trx.ref_block_num )._hash[1], "TaPoS block mismatch" );
+}
+
+vector<database::push_result> database::push_transactions( const vector<signed_transaction>& trxs, uint32_t skip )
+{ try {
+   vector<push_result> results( trxs.size() );
+   // the stateless checks, done on the signature threads if there are several transactions
+   vector< flat_set<public_key_type> > keys( trxs.size() );
+   const chain_id_type& chain_id = get_chain_id();
+   const bool check_signatures = !(skip & (skip_transaction_signatures | skip_authority_check));
+   auto check = [&]( size_t i, const signed_transaction& trx ) {
+      try
+      {
+         trx.validate();
+         if( check_signatures )
+            keys[i] = trx.get_signature_keys( chain_id );
+      }
+      catch( const fc::exception& e )
+      {
+         results[i].error = e;
+      }
+   };
+   if( _signature_threads.empty() || trxs.size() < 2 )
+      for( size_t i = 0; i < trxs.size(); ++i )
+         check( i, trxs[i] );
+   else
+      check_on_threads( _signature_threads, trxs, check );
+
+   state_write_guard guard( *this );
+   detail::with_skip_flags( *this, skip, [&]()
+   {
+      for( size_t i = 0; i < trxs.size(); ++i )
+      {
+         if( results[i].error.valid() )
+            continue;
+         try
+         {
+            results[i].trx = _push_transaction( trxs[i], check_signatures ? &keys[i] : nullptr, true );
+         }
+         catch( const fc::exception& e )
+         {
+            results[i].error = e;
+         }
+      }
+   } );
+   return results;
+} FC_CAPTURE_AND_RETHROW( (trxs.size()) ) }
+
+processed_transaction database::_push_transaction( const signed_transaction& trx,
+                                                   const flat_set<public_key_type>* signature_keys,
+                                                   bool validated,
+                                                   const transaction_id_type* known_id )
+{
+   auto pool_entry = pending_transaction_pool::make_entry( *this, trx, _pending_tx.size(), known_id );
+   auto evicted = _pending_pool.check_admission( pool_entry );
+   if( !evicted.empty() )
+   {
+      wlog( "Evicting ${n} pending transactions to make room for ${id}", ("n",evicted.size())("id",pool_entry.id) );
+      vector<bool> drop( _pending_tx.size() );
+      for( uint32_t i : evicted )
+         drop[i] = true;
+      vector<processed_transaction> kept;
+      for( uint32_t i = 0; i < _pending_tx.size(); ++i )
+         if( !drop[i] )
+            kept.push_back( std::move( _pending_tx[i] ) );
+      _pending_tx.clear();
+      // rebuild the pending state without them
+      {
+         detail::pending_transactions_restorer restorer( *this, std::move( kept ) );
+      }
+      pool_entry.position = _pending_tx.size();
+   }
+
    // If this is the first transaction pushed after applying a block, start a new undo session.
    // This allows us to quickly rewind to the clean state of the head block, in case a new block arrives.
    if( !_pending_tx_session.valid() )
+   {
       _pending_tx_session = _undo_db.start_undo_session();
+      // left over pending transactions, e.g. after pop_block(), are not part of the new session
+      if( _pending_tx.empty() )
+      {
+         _pending_tx_head = head_block_id();
+         _pending_tx_skip = 0;
+         clear_applied_ops();
+      }
+      else
+         _pending_tx_head.reset();
+   }
+   _pending_tx_skip |= get_node_properties().skip_flags;
+
+   // record the operations as those of the next block, so _generate_block can use them as they are
+   _current_block_num    = head_block_num() + 1;
+   _current_trx_in_block = _block_candidate.valid() ? _block_candidate->transactions.size() : _pending_tx.size();
+   size_t old_applied_ops_size = _applied_ops->size();
 
    // Create a temporary undo session as a child of _pending_tx_session.
    // The temporary session will be discarded by the destructor if
@@ -238,8 +898,38 @@ processed_transaction database::_push_transaction( const signed_transaction& trx
    // apply the changes.
 
    auto temp_session = _undo_db.start_undo_session();
-   auto processed_trx = _apply_transaction( trx );
+   processed_transaction processed_trx;
+   try
+   {
+      // set right before the call, any transactions pushed again above must not pick them up
+      _current_trx_id = &pool_entry.id;
+      _current_trx_keys = signature_keys;
+      _current_trx_validated = validated;
+      processed_trx = _apply_transaction( trx );
+   }
+   catch( ... )
+   {
+      writable_applied_ops().resize( old_applied_ops_size );
+      throw;
+   }
    _pending_tx.push_back(processed_trx);
+   _pending_pool.add( pool_entry );
+
+   // the candidate block's transactions are the pending state, so the new one goes at its end if it fits
+   // and wasn't applied with checks the block doesn't skip
+   if( _block_candidate.valid() )
+   {
+      size_t trx_size = fc::raw::pack_size( processed_trx );
+      if( _block_candidate_size + trx_size < get_global_properties().parameters.maximum_block_size &&
+          !(get_node_properties().skip_flags & ~_block_candidate_skip) )
+      {
+         _block_candidate->transactions.push_back( processed_trx );
+         _block_candidate_size += trx_size;
+         _block_candidate_signed = false;
+      }
+      else
+         _block_candidate.reset();
+   }
 
    notify_changed_objects();
    // The transaction applied successfully. Merge its changes into the pending block session.
@@ -252,8 +942,20 @@ processed_transaction database::_push_transaction( const signed_transaction& trx
 
 processed_transaction database::validate_transaction( const signed_transaction& trx )
 {
-   auto session = _undo_db.start_undo_session();
-   return _apply_transaction( trx );
+   state_write_guard guard( *this );
+   size_t old_applied_ops_size = _applied_ops->size();
+   try
+   {
+      auto session = _undo_db.start_undo_session();
+      auto result = _apply_transaction( trx );
+      writable_applied_ops().resize( old_applied_ops_size );
+      return result;
+   }
+   catch( ... )
+   {
+      writable_applied_ops().resize( old_applied_ops_size );
+      throw;
+   }
 }
 
 processed_transaction database::push_proposal(const proposal_object& proposal)
@@ -264,7 +966,7 @@ processed_transaction database::push_proposal(const proposal_object& proposal)
    eval_state.operation_results.reserve(proposal.proposed_transaction.operations.size());
    processed_transaction ptrx(proposal.proposed_transaction);
    eval_state._trx = &ptrx;
-   size_t old_applied_ops_size = _applied_ops.size();
+   size_t old_applied_ops_size = _applied_ops->size();
 
    try {
       auto session = _undo_db.start_undo_session(true);
@@ -275,15 +977,15 @@ processed_transaction database::push_proposal(const proposal_object& proposal)
    } catch ( const fc::exception& e ) {
       if( head_block_time() <= HARDFORK_483_TIME )
       {
-         for( size_t i=old_applied_ops_size,n=_applied_ops.size(); i<n; i++ )
+         for( size_t i=old_applied_ops_size,n=_applied_ops->size(); i<n; i++ )
          {
-            ilog( "removing failed operation from applied_ops: ${op}", ("op", *(_applied_ops[i])) );
-            _applied_ops[i].reset();
+            ilog( "removing failed operation from applied_ops: ${op}", ("op", *(*_applied_ops)[i]) );
+            writable_applied_ops()[i].reset();
          }
       }
       else
       {
-         _applied_ops.resize( old_applied_ops_size );
+         writable_applied_ops().resize( old_applied_ops_size );
       }
       elog( "e", ("e",e.to_detail_string() ) );
       throw;
@@ -297,24 +999,97 @@ signed_block database::generate_block(
    fc::time_point_sec when,
    witness_id_type witness_id,
    const fc::ecc::private_key& block_signing_private_key,
-   uint32_t skip /* = 0 */
+   uint32_t skip /* = 0 */,
+   const std::function<void(const signed_block&)>& on_signed
    )
 { try {
+   state_write_guard guard( *this );
    signed_block result;
    detail::with_skip_flags( *this, skip, [&]()
    {
-      result = _generate_block( when, witness_id, block_signing_private_key );
+      result = _generate_block( when, witness_id, block_signing_private_key, on_signed );
    } );
    return result;
 } FC_CAPTURE_AND_RETHROW() }
 
+void database::prepare_block(
+   fc::time_point_sec when,
+   witness_id_type witness_id,
+   const fc::ecc::private_key& block_signing_private_key,
+   uint32_t skip /* = 0 */
+   )
+{ try {
+   state_write_guard guard( *this );
+   detail::with_skip_flags( *this, skip, [&]()
+   {
+      if( _block_candidate.valid() && _block_candidate->previous == head_block_id() &&
+          _block_candidate->timestamp == when && _block_candidate->witness == witness_id &&
+          _block_candidate_skip == skip )
+         return;
+      _block_candidate.reset();
+      signed_block candidate = _build_block( when, witness_id, block_signing_private_key );
+      _block_candidate_size = fc::raw::pack_size( candidate );
+      _block_candidate_skip = skip;
+      _block_candidate_signed = true;
+      _block_candidate = std::move( candidate );
+   } );
+} FC_CAPTURE_AND_RETHROW( (when)(witness_id) ) }
+
 signed_block database::_generate_block(
    fc::time_point_sec when,
    witness_id_type witness_id,
-   const fc::ecc::private_key& block_signing_private_key
+   const fc::ecc::private_key& block_signing_private_key,
+   const std::function<void(const signed_block&)>& on_signed
    )
 {
    try {
+   uint32_t skip = get_node_properties().skip_flags;
+   signed_block pending_block;
+
+   if( _block_candidate.valid() && _block_candidate->previous == head_block_id() &&
+       _block_candidate->timestamp == when && _block_candidate->witness == witness_id &&
+       _block_candidate_skip == skip &&
+       ( (skip & skip_witness_signature) ||
+         witness_id(*this).signing_key == block_signing_private_key.get_public_key() ) )
+   {
+      // only the transactions pushed since it was built are new, the rest is already applied
+      pending_block = std::move( *_block_candidate );
+      _block_candidate.reset();
+      if( !_block_candidate_signed )
+      {
+         pending_block.transaction_merkle_root = pending_block.calculate_merkle_root();
+         if( !(skip & skip_witness_signature) )
+            pending_block.sign( block_signing_private_key );
+      }
+   }
+   else
+   {
+      _block_candidate.reset();
+      pending_block = _build_block( when, witness_id, block_signing_private_key );
+   }
+
+   if( on_signed )
+      on_signed( pending_block );
+
+   // a block the fork database wouldn't make the new head has to go through push_block()
+   if( (skip & skip_fork_db) || _fork_db.head() == nullptr || _fork_db.head()->id == head_block_id() )
+      push_prebuilt_block( pending_block );
+   else
+   {
+      _pending_tx_session.reset();
+      _pending_tx_head.reset();
+      push_block( pending_block, skip );
+   }
+
+   return pending_block;
+} FC_CAPTURE_AND_RETHROW( (witness_id) ) }
+
+signed_block database::_build_block(
+   fc::time_point_sec when,
+   witness_id_type witness_id,
+   const fc::ecc::private_key& block_signing_private_key
+   )
+{
    uint32_t skip = get_node_properties().skip_flags;
    uint32_t slot_num = get_slot_at_time( when );
    FC_ASSERT( slot_num > 0 );
@@ -332,64 +1107,85 @@ signed_block database::_generate_block(
 
    signed_block pending_block;
 
-   //
-   // The following code throws away existing pending_tx_session and
-   // rebuilds it by re-applying pending transactions.
-   //
-   // This rebuild is necessary because pending transactions' validity
-   // and semantics may have changed since they were received, because
-   // time-based semantics are evaluated based on the current block
-   // time.  These changes can only be reflected in the database when
-   // the value of the "when" variable is known, which means we need to
-   // re-apply pending transactions in this method.
-   //
-   _pending_tx_session.reset();
-   _pending_tx_session = _undo_db.start_undo_session();
-
-   uint64_t postponed_tx_count = 0;
-   // pop pending state (reset to head block state)
-   for( const processed_transaction& tx : _pending_tx )
+   // Transactions are evaluated against the head block time, not "when", so as long as the head hasn't moved
+   // the pending state is what applying the pending transactions again would produce.  It can be used as the
+   // state of the new block if all of them fit and none was applied with checks this block wouldn't skip.
+   bool reuse_pending = _pending_tx_head.valid() && *_pending_tx_head == head_block_id() &&
+                        _pending_tx_session.valid() && !(_pending_tx_skip & ~skip);
+   if( reuse_pending )
    {
-      size_t new_total_size = total_block_size + fc::raw::pack_size( tx );
-
-      // postpone transaction if it would make block too big
-      if( new_total_size >= maximum_block_size )
+      for( const processed_transaction& tx : _pending_tx )
       {
-         postponed_tx_count++;
-         continue;
+         total_block_size += fc::raw::pack_size( tx );
+         if( total_block_size >= maximum_block_size )
+         {
+            reuse_pending = false;
+            total_block_size = max_block_header_size;
+            break;
+         }
       }
+   }
 
-      try
+   if( reuse_pending )
+      pending_block.transactions.assign( _pending_tx.begin(), _pending_tx.end() );
+   else
+   {
+      //
+      // The following code throws away existing pending_tx_session and
+      // rebuilds it by re-applying pending transactions that fit in the block.
+      //
+      _pending_tx_session.reset();
+      _pending_tx_session = _undo_db.start_undo_session();
+      clear_applied_ops();
+      _current_block_num = head_block_num() + 1;
+
+      uint64_t postponed_tx_count = 0;
+      // they don't all fit, so the best paying go first
+      // applying them leaves the pool alone, so its entries and the ids they hold stay put
+      for( const auto& entry : _pending_pool.entries().get<pending_transaction_pool::by_fee_rate>() )
       {
-         auto temp_session = _undo_db.start_undo_session();
-         processed_transaction ptx = _apply_transaction( tx );
-         temp_session.merge();
-
-         // We have to recompute pack_size(ptx) because it may be different
-         // than pack_size(tx) (i.e. if one or more results increased
-         // their size)
-         total_block_size += fc::raw::pack_size( ptx );
-         pending_block.transactions.push_back( ptx );
+         const processed_transaction& tx = _pending_tx[entry.position];
+         size_t new_total_size = total_block_size + fc::raw::pack_size( tx );
+
+         // postpone transaction if it would make block too big
+         if( new_total_size >= maximum_block_size )
+         {
+            postponed_tx_count++;
+            continue;
+         }
+
+         size_t old_applied_ops_size = _applied_ops->size();
+         try
+         {
+            _current_trx_in_block = pending_block.transactions.size();
+            auto temp_session = _undo_db.start_undo_session();
+            _current_trx_id = &entry.id;
+            processed_transaction ptx = _apply_transaction( tx );
+            temp_session.merge();
+
+            // We have to recompute pack_size(ptx) because it may be different
+            // than pack_size(tx) (i.e. if one or more results increased
+            // their size)
+            total_block_size += fc::raw::pack_size( ptx );
+            pending_block.transactions.push_back( std::move( ptx ) );
+         }
+         catch ( const fc::exception& e )
+         {
+            // Do nothing, transaction will not be re-applied
+            writable_applied_ops().resize( old_applied_ops_size );
+            wlog( "Transaction was not processed while generating block due to ${e}", ("e", e) );
+            wlog( "The transaction was ${t}", ("t", tx) );
+         }
       }
-      catch ( const fc::exception& e )
+      if( postponed_tx_count > 0 )
       {
-         // Do nothing, transaction will not be re-applied
-         wlog( "Transaction was not processed while generating block due to ${e}", ("e", e) );
-         wlog( "The transaction was ${t}", ("t", tx) );
+         wlog( "Postponed ${n} transactions due to block size limit", ("n", postponed_tx_count) );
       }
-   }
-   if( postponed_tx_count > 0 )
-   {
-      wlog( "Postponed ${n} transactions due to block size limit", ("n", postponed_tx_count) );
-   }
-
-   _pending_tx_session.reset();
 
-   // We have temporarily broken the invariant that
-   // _pending_tx_session is the result of applying _pending_tx, as
-   // _pending_tx now consists of the set of postponed transactions.
-   // However, the push_block() call below will re-create the
-   // _pending_tx_session.
+      // _pending_tx_session now holds the transactions of pending_block rather than _pending_tx, which
+      // push_prebuilt_block() restores after the block is pushed
+      _pending_tx_head.reset();
+   }
 
    pending_block.previous = head_block_id();
    pending_block.timestamp = when;
@@ -405,10 +1201,41 @@ signed_block database::_generate_block(
       FC_ASSERT( fc::raw::pack_size(pending_block) <= get_global_properties().parameters.maximum_block_size );
    }
 
-   push_block( pending_block, skip );
-
    return pending_block;
-} FC_CAPTURE_AND_RETHROW( (witness_id) ) }
+}
+
+void database::push_prebuilt_block( const signed_block& b )
+{ try {
+   uint32_t skip = get_node_properties().skip_flags;
+   const block_id_type id = b.id();
+   if( !(skip & skip_fork_db) )
+      _fork_db.push_block( b, id );
+
+   try
+   {
+      // the block's own changes go on top of its transactions, into the same undo state
+      _prebuilt_block = &b;
+      apply_block( b, skip );
+      _prebuilt_block = nullptr;
+      _block_id_to_block.store( id, b );
+      _pending_tx_session->commit();
+   }
+   catch( const fc::exception& e )
+   {
+      elog( "Failed to push new block:\n${e}", ("e", e.to_detail_string()) );
+      _prebuilt_block = nullptr;
+      _fork_db.remove( id );
+      _pending_tx_head.reset();
+      // undo the transactions along with the block, and apply the pending ones again
+      detail::without_pending_transactions( *this, std::move(_pending_tx), [](){} );
+      throw;
+   }
+
+   _pending_tx_session.reset();
+   _pending_tx_head.reset();
+   // the pending transactions not included in b are applied again on top of it
+   detail::without_pending_transactions( *this, std::move(_pending_tx), [](){} );
+} FC_CAPTURE_AND_RETHROW( (b.block_num()) ) }
 
 /**
  * Removes the most recent block from the database and
@@ -416,41 +1243,64 @@ signed_block database::_generate_block(
  */
 void database::pop_block()
 { try {
+   state_write_guard guard( *this );
    _pending_tx_session.reset();
+   _pending_tx_head.reset();
+   _block_candidate.reset();
    auto head_id = head_block_id();
    optional<signed_block> head_block = fetch_block_by_id( head_id );
    GRAPHENE_ASSERT( head_block.valid(), pop_empty_chain, "there are no blocks to pop" );
+   GRAPHENE_ASSERT( !_undo_db.head_is_squashed(), undo_database_exception,
+                    "The undo state of block ${n} has been squashed with older ones, it can't be popped",
+                    ("n",head_block->block_num()) );
 
+   remember_popped_block( *head_block, head_id );
    _fork_db.pop_block();
    _block_id_to_block.remove( head_id );
    pop_undo();
+   note_popped_block( block_header::num_from_id( head_id ) );
 
-   _popped_tx.insert( _popped_tx.begin(), head_block->transactions.begin(), head_block->transactions.end() );
+   _popped_tx.insert( _popped_tx.begin(), std::make_move_iterator( head_block->transactions.begin() ),
+                      std::make_move_iterator( head_block->transactions.end() ) );
 
 } FC_CAPTURE_AND_RETHROW() }
 
 void database::clear_pending()
 { try {
+   state_write_guard guard( *this );
    assert( (_pending_tx.size() == 0) || _pending_tx_session.valid() );
    _pending_tx.clear();
+   _pending_pool.clear();
    _pending_tx_session.reset();
+   _pending_tx_head.reset();
+   _block_candidate.reset();
 } FC_CAPTURE_AND_RETHROW() }
 
 uint32_t database::push_applied_operation( const operation& op )
 {
-   _applied_ops.emplace_back(op);
-   operation_history_object& oh = *(_applied_ops.back());
+   // like skip_validate, only honoured for blocks pinned by a checkpoint
+   if( (get_node_properties().skip_flags & skip_operation_history) && before_last_checkpoint() )
+   {
+      ++_current_virtual_op;
+      return uint32_t(-1);
+   }
+   auto& applied_ops = writable_applied_ops();
+   applied_ops.emplace_back(op);
+   operation_history_object& oh = *(applied_ops.back());
    oh.block_num    = _current_block_num;
    oh.trx_in_block = _current_trx_in_block;
    oh.op_in_trx    = _current_op_in_trx;
    oh.virtual_op   = _current_virtual_op++;
-   return _applied_ops.size() - 1;
+   return applied_ops.size() - 1;
 }
 void database::set_applied_operation_result( uint32_t op_id, const operation_result& result )
 {
-   assert( op_id < _applied_ops.size() );
-   if( _applied_ops[op_id] )
-      _applied_ops[op_id]->result = result;
+   if( op_id == uint32_t(-1) )
+      return; // skip_operation_history
+   assert( op_id < _applied_ops->size() );
+   auto& applied_ops = writable_applied_ops();
+   if( applied_ops[op_id] )
+      applied_ops[op_id]->result = result;
    else
    {
       elog( "Could not set operation result (head_block_num=${b})", ("b", head_block_num()) );
@@ -458,23 +1308,48 @@ void database::set_applied_operation_result( uint32_t op_id, const operation_res
 }
 
 const vector<optional< operation_history_object > >& database::get_applied_operations() const
+{
+   return *_applied_ops;
+}
+
+std::shared_ptr< const vector<optional< operation_history_object > > > database::share_applied_operations()const
 {
    return _applied_ops;
 }
 
+vector<optional<operation_history_object> >& database::writable_applied_ops()
+{
+   // someone holds on to the list handed out, which must not change under them
+   if( !_applied_ops.unique() )
+      _applied_ops = std::make_shared< vector<optional<operation_history_object> > >( *_applied_ops );
+   return *_applied_ops;
+}
+
+void database::clear_applied_ops()
+{
+   if( _applied_ops.unique() )
+      _applied_ops->clear();
+   else
+   {
+      const size_t recorded = _applied_ops->size();
+      _applied_ops = std::make_shared< vector<optional<operation_history_object> > >();
+      _applied_ops->reserve( recorded );
+   }
+}
+
 //////////////////// private methods ////////////////////
 
 void database::apply_block( const signed_block& next_block, uint32_t skip )
 {
+   wait_for_deferred_indexes();
    auto block_num = next_block.block_num();
-   if( _checkpoints.size() && _checkpoints.rbegin()->second != block_id_type() )
+   if( is_trusted_block( block_num ) )
    {
       auto itr = _checkpoints.find( block_num );
       if( itr != _checkpoints.end() )
          FC_ASSERT( next_block.id() == itr->second, "Block did not match checkpoint", ("checkpoint",*itr)("block_id",next_block.id()) );
 
-      if( _checkpoints.rbegin()->first >= block_num )
-         skip = ~0;// WE CAN SKIP ALMOST EVERYTHING
+      skip = trusted_skip_flags();
    }
 
    detail::with_skip_flags( *this, skip, [&]()
@@ -488,9 +1363,35 @@ void database::_apply_block( const signed_block& next_block )
 { try {
    uint32_t next_block_num = next_block.block_num();
    uint32_t skip = get_node_properties().skip_flags;
-   _applied_ops.clear();
 
-   FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == next_block.calculate_merkle_root(), "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",next_block.calculate_merkle_root())("next_block",next_block)("id",next_block.id()) );
+   // with profiling enabled, adds the time since the last phase ended to the phase that just did
+   optional<block_apply_profile> block_profile;
+   fc::time_point block_start;
+   fc::time_point phase_start;
+   if( _apply_profile.valid() )
+   {
+      block_profile = block_apply_profile();
+      block_profile->block_num = next_block_num;
+      block_profile->transaction_count = next_block.transactions.size();
+      block_start = phase_start = fc::time_point::now();
+   }
+   auto end_phase = [&]( uint64_t block_apply_profile::* phase )
+   {
+      if( !block_profile.valid() )
+         return;
+      fc::time_point now = fc::time_point::now();
+      (*block_profile).*phase += ( now - phase_start ).count();
+      phase_start = now;
+   };
+
+   const bool prebuilt = ( &next_block == _prebuilt_block );
+   // a prebuilt block's operations were recorded when its transactions were applied
+   if( !prebuilt )
+      clear_applied_ops();
+   const precomputed_block* pre = precomputed_for( next_block );
+
+   FC_ASSERT( (skip & skip_merkle_check) ||
+              next_block.transaction_merkle_root == ( pre ? pre->merkle_root : next_block.calculate_merkle_root() ), "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",next_block.calculate_merkle_root())("next_block",next_block)("id",next_block.id()) );
 
    const witness_object& signing_witness = validate_block_header(skip, next_block);
    const auto& global_props = get_global_properties();
@@ -499,8 +1400,36 @@ void database::_apply_block( const signed_block& next_block )
 
    _current_block_num    = next_block_num;
    _current_trx_in_block = 0;
+   end_phase( &block_apply_profile::header_time );
+
+   // recovering the signature keys and validating don't depend on the state, so do them for the whole block up front
+   vector<checked_transaction> checked;
+   if( !prebuilt )
+   {
+      const size_t trx_count = next_block.transactions.size();
+      const bool recover_keys = !(skip & (skip_transaction_signatures | skip_authority_check));
+      const bool validate = !(skip & skip_validate) || !before_last_checkpoint();
+      const bool have_keys = pre && pre->signature_keys.size() == trx_count;
+      const bool have_validated = pre && pre->transactions_validated;
+      checked = check_block_transactions( next_block, get_chain_id(), recover_keys && !have_keys,
+                                          validate && !have_validated );
+      if( ( recover_keys && have_keys ) || ( validate && have_validated ) )
+      {
+         checked.resize( trx_count );
+         for( size_t i = 0; i < trx_count; ++i )
+         {
+            if( recover_keys && have_keys )
+               checked[i].keys = pre->signature_keys[i];
+            if( validate && have_validated )
+               checked[i].validated = true;
+         }
+      }
+   }
+   end_phase( &block_apply_profile::signature_time );
 
-   for( const auto& trx : next_block.transactions )
+   if( prebuilt )
+      _current_trx_in_block = next_block.transactions.size();
+   else for( const auto& trx : next_block.transactions )
    {
       /* We do not need to push the undo state for each transaction
        * because they either all apply and are valid or the
@@ -508,17 +1437,29 @@ void database::_apply_block( const signed_block& next_block )
        * for transactions when validating broadcast transactions or
        * when building a block.
        */
+      _current_trx_id = pre ? &pre->transaction_ids[_current_trx_in_block] : nullptr;
+      if( _current_trx_in_block < checked.size() )
+      {
+         auto& result = checked[_current_trx_in_block];
+         _current_trx_keys = result.keys.valid() ? &*result.keys : nullptr;
+         _current_trx_validated = result.validated;
+      }
+      else
+         _current_trx_keys = nullptr;
       apply_transaction( trx, skip );
       ++_current_trx_in_block;
    }
+   end_phase( &block_apply_profile::transaction_time );
 
    update_global_dynamic_data(next_block);
    update_signing_witness(signing_witness, next_block);
    update_last_irreversible_block();
+   end_phase( &block_apply_profile::dynamic_data_time );
 
    // Are we at the maintenance interval?
    if( maint_needed )
       perform_chain_maintenance(next_block, global_props);
+   end_phase( &block_apply_profile::maintenance_time );
 
    create_block_summary(next_block);
    clear_expired_transactions();
@@ -526,6 +1467,7 @@ void database::_apply_block( const signed_block& next_block )
    clear_expired_orders();
    update_expired_feeds();
    update_withdraw_permissions();
+   end_phase( &block_apply_profile::expiration_time );
 
    // n.b., update_maintenance_flag() happens this late
    // because get_slot_time() / get_slot_at_time() is needed above
@@ -536,31 +1478,51 @@ void database::_apply_block( const signed_block& next_block )
    update_witness_schedule();
    if( !_node_property_object.debug_updates.empty() )
       apply_debug_updates();
+   end_phase( &block_apply_profile::schedule_time );
 
    // notify observers that the block has been applied
    applied_block( next_block ); //emit
-   _applied_ops.clear();
+   // kept in case the block is popped and restored from its changes
+   if( _fork_diff_replay )
+   {
+      _reversible_applied_ops[ head_block_id() ] = share_applied_operations();
+      prune_fork_state();
+   }
+   clear_applied_ops();
+   end_phase( &block_apply_profile::applied_block_time );
 
    notify_changed_objects();
+   note_applied_block( next_block_num, head_block_id() );
+   end_phase( &block_apply_profile::changed_objects_time );
+   // profiling may have been turned off while the block was applied
+   if( block_profile.valid() && _apply_profile.valid() )
+      record_block_profile( *block_profile, block_start );
+
+   if( _snapshot_block_num != 0 && next_block_num == _snapshot_block_num )
+      write_snapshot( _snapshot_dir );
+   if( _state_checkpoint_interval != 0 )
+      update_state_checkpoint();
+   if( _flush_interval != 0 )
+      update_background_flush();
 } FC_CAPTURE_AND_RETHROW( (next_block.block_num()) )  }
 
 void database::notify_changed_objects()
 { try {
-   if( _undo_db.enabled() ) 
-   {
-      const auto& head_undo = _undo_db.head();
-      vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size());
-      for( const auto& item : head_undo.old_values ) changed_ids.push_back(item.first);
-      for( const auto& item : head_undo.new_ids ) changed_ids.push_back(item);
-      vector<const object*> removed;
-      removed.reserve( head_undo.removed.size() );
-      for( const auto& item : head_undo.removed )
-      {
-         changed_ids.push_back( item.first );
-         removed.emplace_back( item.second.get() );
-      }
-      changed_objects(changed_ids);
+   object_changes changes = take_object_changes();
+   vector<object_id_type> changed_ids;
+   changed_ids.reserve( changes.modified.size() + changes.created.size() + changes.removed.size() );
+   changed_ids.insert( changed_ids.end(), changes.modified.begin(), changes.modified.end() );
+   changed_ids.insert( changed_ids.end(), changes.created.begin(), changes.created.end() );
+   vector<const object*> removed;
+   removed.reserve( changes.removed.size() );
+   for( const auto& item : changes.removed )
+   {
+      changed_ids.push_back( item.first );
+      removed.emplace_back( item.second.get() );
    }
+   if( !removed.empty() )
+      removed_objects(removed);
+   changed_objects(changed_ids);
 } FC_CAPTURE_AND_RETHROW() }
 
 processed_transaction database::apply_transaction(const signed_transaction& trx, uint32_t skip)
@@ -576,24 +1538,34 @@ processed_transaction database::apply_transaction(const signed_transaction& trx,
 processed_transaction database::_apply_transaction(const signed_transaction& trx)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
-
-   if( true || !(skip&skip_validate) )   /* issue #505 explains why this skip_flag is disabled */
+   // computed ahead by _apply_block for this call only
+   const transaction_id_type*       known_id   = _current_trx_id;
+   const flat_set<public_key_type>* known_keys = _current_trx_keys;
+   const bool                       validated  = _current_trx_validated;
+   _current_trx_id        = nullptr;
+   _current_trx_keys      = nullptr;
+   _current_trx_validated = false;
+
+   /* issue #505 explains why this skip_flag is only honoured for blocks pinned by a checkpoint */
+   if( !validated && ( !(skip&skip_validate) || !before_last_checkpoint() ) )
       trx.validate();
 
-   auto& trx_idx = get_mutable_index_type<transaction_index>();
    const chain_id_type& chain_id = get_chain_id();
-   auto trx_id = trx.id();
-   FC_ASSERT( (skip & skip_transaction_dupe_check) ||
-              trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
+   auto trx_id = known_id ? *known_id : trx.id();
+   FC_ASSERT( (skip & skip_transaction_dupe_check) || !_recent_transactions.contains(trx_id) );
    transaction_evaluation_state eval_state(this);
    const chain_parameters& chain_parameters = get_global_properties().parameters;
    eval_state._trx = &trx;
 
    if( !(skip & (skip_transaction_signatures | skip_authority_check) ) )
    {
-      auto get_active = [&]( account_id_type id ) { return &id(*this).active; };
-      auto get_owner  = [&]( account_id_type id ) { return &id(*this).owner;  };
-      trx.verify_authority( chain_id, get_active, get_owner, get_global_properties().parameters.max_authority_depth );
+      auto get_active = [&]( account_id_type id ) { return &authority_account( id ).active; };
+      auto get_owner  = [&]( account_id_type id ) { return &authority_account( id ).owner;  };
+      if( known_keys )
+         graphene::chain::verify_authority( trx.operations, *known_keys, get_active, get_owner,
+                                            get_global_properties().parameters.max_authority_depth );
+      else
+         trx.verify_authority( chain_id, get_active, get_owner, get_global_properties().parameters.max_authority_depth );
    }
 
    //Skip all manner of expiration and TaPoS checking if we're on block 1; It's impossible that the transaction is
@@ -602,10 +1574,10 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    {
       if( !(skip & skip_tapos_check) )
       {
-         const auto& tapos_block_summary = block_summary_id_type( trx.ref_block_num )(*this);
+         const block_id_type& tapos_block_id = get_tapos_block_id( trx.ref_block_num );
 
          //Verify TaPoS block summary has correct ID prefix, and that this block's time is not past the expiration
-         FC_ASSERT( trx.ref_block_prefix == tapos_block_summary.block_id._hash[1] );
+         FC_ASSERT( trx.ref_block_prefix == tapos_block_id._hash[1] );
       }
 
       fc::time_point_sec now = head_block_time();
@@ -618,15 +1590,13 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    //Insert transaction into unique transactions database.
    if( !(skip & skip_transaction_dupe_check) )
    {
-      create<transaction_object>([&](transaction_object& transaction) {
-         transaction.trx_id = trx_id;
-         transaction.trx = trx;
-      });
+      _recent_transactions.insert(trx_id, trx);
    }
 
    eval_state.operation_results.reserve(trx.operations.size());
 
    //Finally process the operations
+   const uint64_t temp_account_changes = _balances_by_account->temp_account_changes();
    processed_transaction ptrx(trx);
    _current_op_in_trx = 0;
    for( const auto& op : ptrx.operations )
@@ -636,10 +1606,10 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    }
    ptrx.operation_results = std::move(eval_state.operation_results);
 
-   //Make sure the temp account has no non-zero balances
-   const auto& index = get_index_type<account_balance_index>().indices().get<by_account_asset>();
-   auto range = index.equal_range( boost::make_tuple( GRAPHENE_TEMP_ACCOUNT ) );
-   std::for_each(range.first, range.second, [](const account_balance_object& b) { FC_ASSERT(b.balance == 0); });
+   //Make sure the temp account has no non-zero balances, only the operations which touched them may have left any
+   if( _balances_by_account->temp_account_changes() != temp_account_changes )
+      for( const account_balance_object* b : _balances_by_account->get_account_balances( GRAPHENE_TEMP_ACCOUNT ) )
+         FC_ASSERT( b->balance == 0 );
 
    return ptrx;
 } FC_CAPTURE_AND_RETHROW( (trx) ) }
@@ -652,11 +1622,11 @@ operation_result database::apply_operation(transaction_evaluation_state& eval_st
       assert( "Negative operation tag" && false );
    if( u_which >= _operation_evaluators.size() )
       assert( "No registered evaluator for this operation" && false );
-   unique_ptr<op_evaluator>& eval = _operation_evaluators[ u_which ];
+   op_evaluator eval = _operation_evaluators[ u_which ];
    if( !eval )
       assert( "No registered evaluator for this operation" && false );
    auto op_id = push_applied_operation( op );
-   auto result = eval->evaluate( eval_state, op, true );
+   auto result = _apply_profile.valid() ? profile_operation( eval, eval_state, op ) : eval( eval_state, op, true );
    set_applied_operation_result( op_id, result );
    return result;
 } FC_CAPTURE_AND_RETHROW(  ) }
@@ -667,8 +1637,14 @@ const witness_object& database::validate_block_header( uint32_t skip, const sign
    FC_ASSERT( head_block_time() < next_block.timestamp, "", ("head_block_time",head_block_time())("next",next_block.timestamp)("blocknum",next_block.block_num()) );
    const witness_object& witness = next_block.witness(*this);
 
-   if( !(skip&skip_witness_signature) ) 
-      FC_ASSERT( next_block.validate_signee( witness.signing_key ) );
+   if( !(skip&skip_witness_signature) )
+   {
+      const precomputed_block* pre = precomputed_for( next_block );
+      if( pre && pre->signee.valid() )
+         FC_ASSERT( *pre->signee == fc::ecc::public_key( witness.signing_key ) );
+      else
+         FC_ASSERT( next_block.validate_signee( witness.signing_key ) );
+   }
 
    if( !(skip&skip_witness_schedule_check) )
    {
@@ -686,10 +1662,7 @@ const witness_object& database::validate_block_header( uint32_t skip, const sign
 
 void database::create_block_summary(const signed_block& next_block)
 {
-   block_summary_id_type sid(next_block.block_num() & 0xffff );
-   modify( sid(*this), [&](block_summary_object& p) {
-         p.block_id = next_block.id();
-   });
+   _block_summaries.set( next_block.block_num(), next_block.id() );
 }
 
 void database::add_checkpoints( const flat_map<uint32_t,block_id_type>& checkpts )
@@ -703,4 +1676,18 @@ bool database::before_last_checkpoint()const
    return (_checkpoints.size() > 0) && (_checkpoints.rbegin()->first >= head_block_num());
 }
 
+bool database::is_trusted_block( uint32_t block_num )const
+{
+   return _checkpoints.size() && _checkpoints.rbegin()->second != block_id_type() &&
+          _checkpoints.rbegin()->first >= block_num;
+}
+
+uint32_t database::trusted_skip_flags()const
+{
+   uint32_t skip = ~0; // WE CAN SKIP ALMOST EVERYTHING
+   if( _applied_operations_required )
+      skip &= ~skip_operation_history;
+   return skip;
+}
+
 } }
@@ -26,73 +26,86 @@
 
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/fba_object.hpp>
+#include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/market_object.hpp>
+#include <graphene/chain/supply_tally_index.hpp>
 #include <graphene/chain/vesting_balance_object.hpp>
 #include <graphene/chain/witness_object.hpp>
 
+#include <fc/io/raw.hpp>
+
+#include <fstream>
+
 namespace graphene { namespace chain {
 
 /**
- *  This method dumps the state of the blockchain in a semi-human readable form for the
- *  purpose of tracking down funds and mismatches in currency allocation
+ *  This method logs what verify_supply_totals() finds for the purpose of tracking down funds and mismatches in
+ *  currency allocation
  */
 void database::debug_dump()
 {
-   const auto& db = *this;
-   const asset_dynamic_data_object& core_asset_data = db.get_core_asset().dynamic_asset_data_id(db);
-
-   const auto& balance_index = db.get_index_type<account_balance_index>().indices();
-   const simple_index<account_statistics_object>& statistics_index = db.get_index_type<simple_index<account_statistics_object>>();
-   map<asset_id_type,share_type> total_balances;
-   map<asset_id_type,share_type> total_debts;
-   share_type core_in_orders;
-   share_type reported_core_in_orders;
-
-   for( const account_balance_object& a : balance_index )
-   {
-    //  idump(("balance")(a));
-      total_balances[a.asset_type] += a.balance;
-   }
-   for( const account_statistics_object& s : statistics_index )
+   try
    {
-    //  idump(("statistics")(s));
-      reported_core_in_orders += s.total_core_in_orders;
+      verify_supply_totals();
    }
-   for( const limit_order_object& o : db.get_index_type<limit_order_index>().indices() )
+   catch( const fc::exception& e )
    {
- //     idump(("limit_order")(o));
-      auto for_sale = o.amount_for_sale();
-      if( for_sale.asset_id == asset_id_type() ) core_in_orders += for_sale.amount;
-      total_balances[for_sale.asset_id] += for_sale.amount;
+      edump( (e.to_detail_string()) );
    }
-   for( const call_order_object& o : db.get_index_type<call_order_index>().indices() )
-   {
-//      idump(("call_order")(o));
-      auto col = o.get_collateral();
-      if( col.asset_id == asset_id_type() ) core_in_orders += col.amount;
-      total_balances[col.asset_id] += col.amount;
-      total_debts[o.get_debt().asset_id] += o.get_debt().amount;
-   }
-   for( const asset_object& asset_obj : db.get_index_type<asset_index>().indices() )
+}
+
+void database::verify_supply_totals()const
+{
+   flat_map<asset_id_type,share_type> total_balances;
+   flat_map<asset_id_type,share_type> total_debts;
+   share_type core_in_orders;
+   share_type reported_core_in_orders;
+
+   for( const supply_tally_index* tally : _supply_tallies )
    {
-      total_balances[asset_obj.id] += asset_obj.dynamic_asset_data_id(db).accumulated_fees;
-      total_balances[asset_id_type()] += asset_obj.dynamic_asset_data_id(db).fee_pool;
-//      edump((total_balances[asset_obj.id])(asset_obj.dynamic_asset_data_id(db).current_supply ) );
+      for( const auto& item : tally->held )
+         total_balances[item.first] += item.second;
+      for( const auto& item : tally->debts )
+         total_debts[item.first] += item.second;
+      core_in_orders += tally->core_in_orders;
+      reported_core_in_orders += tally->reported_core_in_orders;
    }
 
-   if( total_balances[asset_id_type()].value != core_asset_data.current_supply.value )
+   // the rest is held by the few objects of every asset and a handful of others
+   for( const fba_accumulator_object& fba : get_index_type< simple_index< fba_accumulator_object > >() )
+      total_balances[asset_id_type()] += fba.accumulated_fba_fees;
+   total_balances[asset_id_type()] += get_dynamic_global_properties().witness_budget;
+   const auto& assets = get_index_type<asset_index>().indices();
+   for( const asset_object& asset_obj : assets )
    {
-      edump( (total_balances[asset_id_type()].value)(core_asset_data.current_supply.value ));
+      const asset_dynamic_data_object& data = get_dynamic_data( asset_obj );
+      total_balances[asset_obj.id] += data.accumulated_fees;
+      total_balances[asset_id_type()] += data.fee_pool;
+      if( asset_obj.is_market_issued() )
+      {
+         const asset_bitasset_data_object& bitasset = get_bitasset_data( asset_obj );
+         total_balances[bitasset.options.short_backing_asset] += bitasset.settlement_fund;
+      }
    }
 
-
-   /*
-   const auto& vbidx = db.get_index_type<simple_index<vesting_balance_object>>();
-   for( const auto& s : vbidx )
+   for( const asset_object& asset_obj : assets )
    {
-//      idump(("vesting_balance")(s));
+      const asset_dynamic_data_object& data = get_dynamic_data( asset_obj );
+      const share_type held = total_balances[asset_obj.id];
+      FC_ASSERT( held == data.current_supply - data.confidential_supply,
+                 "${held} ${a} is held but its supply is ${s}, of which ${c} is confidential",
+                 ("held",held)("a",asset_obj.symbol)("s",data.current_supply)("c",data.confidential_supply) );
+      // a globally settled asset owes its supply to the settlement fund rather than to call orders
+      auto debt = total_debts.find( asset_obj.id );
+      if( debt != total_debts.end() && debt->second != 0 )
+         FC_ASSERT( debt->second == data.current_supply, "Call orders owe ${d} ${a} but its supply is ${s}",
+                    ("d",debt->second)("a",asset_obj.symbol)("s",data.current_supply) );
    }
-   */
+
+   FC_ASSERT( core_in_orders == reported_core_in_orders,
+              "${o} core is in orders but the account statistics report ${r}",
+              ("o",core_in_orders)("r",reported_core_in_orders) );
 }
 
 void debug_apply_update( database& db, const fc::variant_object& vo )
@@ -108,6 +121,7 @@ void debug_apply_update( database& db, const fc::variant_object& vo )
    // "_action" : "write"    object may exist, is replaced entirely, unspecified fields take defaults
    // "_action" : "update"   object must exist, unspecified fields don't change
    // "_action" : "delete"   object must exist, will be deleted
+   // "_action" : "import"   "file" names a file of packed objects to write, see database::debug_import_objects
 
    // if _action is unspecified:
    // - delete if object contains only ID field
@@ -179,16 +193,56 @@ void database::apply_debug_updates()
    if( it == _node_property_object.debug_updates.end() )
       return;
    for( const fc::variant_object& update : it->second )
-      debug_apply_update( *this, update );
+   {
+      auto it_action = update.find( "_action" );
+      if( it_action != update.end() && it_action->value().get_string() == "import" )
+         debug_import_objects( update["file"].as_string() );
+      else
+         debug_apply_update( *this, update );
+   }
 }
 
+/**
+ *  The file holds one record after another, each the ID of an object followed by the object packed as a
+ *  vector<char>.  Objects replace the ones with the same ID and may have IDs past the next ID of their index.
+ *
+ *  The file is read again whenever the block the import was added to is applied again, so it must stay in place
+ *  for as long as the node may pop that block.
+ */
+void database::debug_import_objects( const fc::path& file )
+{ try {
+   std::ifstream in( file.generic_string(), std::ios::in | std::ios::binary );
+   FC_ASSERT( in, "Cannot open file to import", ("file",file) );
+
+   uint64_t count = 0;
+   vector<char> data;
+   while( in.peek() != std::ifstream::traits_type::eof() )
+   {
+      object_id_type id;
+      fc::raw::unpack( in, id );
+      fc::raw::unpack( in, data );
+      FC_ASSERT( in, "Truncated record", ("record",count) );
+      get_mutable_index( id ).import( data.data(), data.size() );
+      ++count;
+   }
+   ilog( "Imported ${n} objects from ${file}", ("n",count)("file",file) );
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
 void database::debug_update( const fc::variant_object& update )
 {
+   debug_update( vector<fc::variant_object>{ update } );
+}
+
+void database::debug_update( const vector<fc::variant_object>& updates )
+{
+   if( updates.empty() )
+      return;
+
    block_id_type head_id = head_block_id();
    auto it = _node_property_object.debug_updates.find( head_id );
    if( it == _node_property_object.debug_updates.end() )
       it = _node_property_object.debug_updates.emplace( head_id, std::vector< fc::variant_object >() ).first;
-   it->second.emplace_back( update );
+   it->second.insert( it->second.end(), updates.begin(), updates.end() );
 
    optional<signed_block> head_block = fetch_block_by_id( head_id );
    FC_ASSERT( head_block.valid() );
@@ -198,4 +252,83 @@ void database::debug_update( const fc::variant_object& update )
    push_block( *head_block );
 }
 
+void database::set_apply_profiling( bool enabled )
+{
+   if( !enabled )
+   {
+      _apply_profile.reset();
+      return;
+   }
+   _apply_profile = apply_profile();
+   _apply_profile->operations.resize( operation::count() );
+}
+
+apply_profile database::get_apply_profile()const
+{
+   return _apply_profile.valid() ? *_apply_profile : apply_profile();
+}
+
+optional<block_apply_profile> database::get_last_block_profile()const
+{
+   if( !_apply_profile.valid() || _apply_profile->recent_blocks.empty() )
+      return optional<block_apply_profile>();
+   return _apply_profile->recent_blocks.back();
+}
+
+operation_result database::profile_operation( op_evaluator eval, transaction_evaluation_state& eval_state,
+                                              const operation& op )
+{
+   const object_database::change_counts before = get_change_counts();
+   operation_timing timing;
+   operation_timing* outer_timing = eval_state.timing;
+   eval_state.timing = &timing;
+   operation_result result;
+   try
+   {
+      result = eval( eval_state, op, true );
+   }
+   catch( ... )
+   {
+      eval_state.timing = outer_timing;
+      throw;
+   }
+   eval_state.timing = outer_timing;
+
+   operation_profile& p = _apply_profile->operations[ op.which() ];
+   const object_database::change_counts& after = get_change_counts();
+   ++p.count;
+   p.evaluate_time += timing.evaluate.count();
+   p.max_evaluate_time = std::max<uint64_t>( p.max_evaluate_time, timing.evaluate.count() );
+   p.apply_time += timing.apply.count();
+   p.max_apply_time = std::max<uint64_t>( p.max_apply_time, timing.apply.count() );
+   p.objects_created += after.created - before.created;
+   p.objects_modified += after.modified - before.modified;
+   p.objects_removed += after.removed - before.removed;
+   return result;
+}
+
+void database::record_block_profile( block_apply_profile& block, fc::time_point start )
+{
+   block.total_time = ( fc::time_point::now() - start ).count();
+
+   block_apply_profile& totals = _apply_profile->block_totals;
+   ++totals.block_num;
+   totals.transaction_count += block.transaction_count;
+   totals.header_time += block.header_time;
+   totals.signature_time += block.signature_time;
+   totals.transaction_time += block.transaction_time;
+   totals.dynamic_data_time += block.dynamic_data_time;
+   totals.maintenance_time += block.maintenance_time;
+   totals.expiration_time += block.expiration_time;
+   totals.schedule_time += block.schedule_time;
+   totals.applied_block_time += block.applied_block_time;
+   totals.changed_objects_time += block.changed_objects_time;
+   totals.total_time += block.total_time;
+
+   auto& recent = _apply_profile->recent_blocks;
+   if( recent.size() >= apply_profile::max_recent_blocks )
+      recent.erase( recent.begin() );
+   recent.push_back( block );
+}
+
 } }
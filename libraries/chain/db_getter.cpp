@@ -37,6 +37,29 @@ const asset_object& database::get_core_asset() const
    return get(asset_id_type());
 }
 
+const asset_object& database::get_asset( asset_id_type id )const
+{
+   // qualified calls, so find() is the dense table lookup rather than a virtual call through get_index()
+   const object* result = _assets->asset_index::find( id );
+   FC_ASSERT( result != nullptr, "Unable to find asset ${id}", ("id",id) );
+   return static_cast<const asset_object&>( *result );
+}
+
+const asset_dynamic_data_object& database::get_dynamic_data( const asset_object& a )const
+{
+   const object* result = _asset_dynamic_data->simple_index<asset_dynamic_data_object>::find( a.dynamic_asset_data_id );
+   FC_ASSERT( result != nullptr, "Unable to find the dynamic data of asset ${id}", ("id",a.id) );
+   return static_cast<const asset_dynamic_data_object&>( *result );
+}
+
+const asset_bitasset_data_object& database::get_bitasset_data( const asset_object& a )const
+{
+   FC_ASSERT( a.bitasset_data_id.valid(), "Asset ${id} is not a market issued asset", ("id",a.id) );
+   const object* result = _asset_bitasset_data->asset_bitasset_data_index::find( *a.bitasset_data_id );
+   FC_ASSERT( result != nullptr, "Unable to find the bitasset data of asset ${id}", ("id",a.id) );
+   return static_cast<const asset_bitasset_data_object&>( *result );
+}
+
 const global_property_object& database::get_global_properties()const
 {
    return get( global_property_id_type() );
@@ -97,5 +120,21 @@ uint32_t database::last_non_undoable_block_num() const
    return head_block_num() - _undo_db.size();
 }
 
+const account_object& database::authority_account( account_id_type id )
+{
+   const uint32_t block_num = head_block_num();
+   if( _authority_accounts_block != block_num || _authority_accounts_changes != _authority_changes->changes() )
+   {
+      // account_update_operation and undoing account changes count as authority changes
+      _authority_accounts.clear();
+      _authority_accounts_block = block_num;
+      _authority_accounts_changes = _authority_changes->changes();
+   }
+   const account_object*& account = _authority_accounts[ id.instance.value ];
+   if( account == nullptr )
+      account = &id(*this);
+   return *account;
+}
+
 
 } }
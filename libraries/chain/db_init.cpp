@@ -28,7 +28,6 @@
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/balance_object.hpp>
-#include <graphene/chain/block_summary_object.hpp>
 #include <graphene/chain/budget_record_object.hpp>
 #include <graphene/chain/buyback_object.hpp>
 #include <graphene/chain/chain_property_object.hpp>
@@ -40,8 +39,9 @@
 #include <graphene/chain/operation_history_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
 #include <graphene/chain/special_authority_object.hpp>
-#include <graphene/chain/transaction_object.hpp>
+#include <graphene/chain/supply_tally_index.hpp>
 #include <graphene/chain/vesting_balance_object.hpp>
+#include <graphene/chain/vote_tally_object.hpp>
 #include <graphene/chain/withdraw_permission_object.hpp>
 #include <graphene/chain/witness_object.hpp>
 #include <graphene/chain/witness_schedule_object.hpp>
@@ -87,8 +87,6 @@ const uint8_t account_object::type_id;
 const uint8_t asset_object::space_id;
 const uint8_t asset_object::type_id;
 
-const uint8_t block_summary_object::space_id;
-const uint8_t block_summary_object::type_id;
 
 const uint8_t call_order_object::space_id;
 const uint8_t call_order_object::type_id;
@@ -111,8 +109,6 @@ const uint8_t operation_history_object::type_id;
 const uint8_t proposal_object::space_id;
 const uint8_t proposal_object::type_id;
 
-const uint8_t transaction_object::space_id;
-const uint8_t transaction_object::type_id;
 
 const uint8_t vesting_balance_object::space_id;
 const uint8_t vesting_balance_object::type_id;
@@ -179,36 +175,77 @@ void database::initialize_indexes()
    _undo_db.set_max_size( GRAPHENE_MIN_UNDO_HISTORY );
 
    //Protocol object indexes
-   add_index< primary_index<asset_index> >();
-   add_index< primary_index<force_settlement_index> >();
+   auto asset_idx = add_index< primary_index<asset_index> >();
+   asset_idx->add_secondary_index<feed_update_index>();
+   _asset_feeds = &asset_idx->get_secondary_index<feed_update_index>();
+   asset_idx->add_secondary_index<asset_symbol_index>();
+   _asset_symbols = &asset_idx->get_secondary_index<asset_symbol_index>();
+   _assets = asset_idx;
+   _supply_tallies.clear();
+   auto settle_idx = add_index< primary_index<force_settlement_index> >();
+   settle_idx->add_secondary_index<supply_tally_index>();
+   _supply_tallies.push_back( &settle_idx->get_secondary_index<supply_tally_index>() );
 
    auto acnt_index = add_index< primary_index<account_index> >();
    acnt_index->add_secondary_index<account_member_index>();
    acnt_index->add_secondary_index<account_referrer_index>();
+   acnt_index->add_secondary_index<vote_change_index>();
+   acnt_index->add_secondary_index<authority_change_index>();
+   acnt_index->add_secondary_index<account_name_index>();
+   _account_names = &acnt_index->get_secondary_index<account_name_index>();
 
    add_index< primary_index<committee_member_index> >();
-   add_index< primary_index<witness_index> >();
-   add_index< primary_index<limit_order_index > >();
-   add_index< primary_index<call_order_index > >();
+   auto wit_index = add_index< primary_index<witness_index> >();
+   wit_index->add_secondary_index<witness_node_index>();
+   _witness_nodes = &wit_index->get_secondary_index<witness_node_index>();
+   _active_witness_objs.clear();
+   auto limit_order_idx = add_index< primary_index<limit_order_index > >();
+   limit_order_idx->add_secondary_index<limit_order_book_index>();
+   limit_order_idx->add_secondary_index<limit_order_match_index>();
+   _limit_order_books = &limit_order_idx->get_secondary_index<limit_order_match_index>();
+   limit_order_idx->add_secondary_index<supply_tally_index>();
+   _supply_tallies.push_back( &limit_order_idx->get_secondary_index<supply_tally_index>() );
+   auto call_order_idx = add_index< primary_index<call_order_index > >();
+   call_order_idx->add_secondary_index<supply_tally_index>();
+   _supply_tallies.push_back( &call_order_idx->get_secondary_index<supply_tally_index>() );
 
    auto prop_index = add_index< primary_index<proposal_index > >();
    prop_index->add_secondary_index<required_approval_index>();
+   prop_index->add_secondary_index<proposal_authorization_index>();
+   _proposal_authorizations = &prop_index->get_secondary_index<proposal_authorization_index>();
+   _authority_changes = &acnt_index->get_secondary_index<authority_change_index>();
+   _authority_accounts.clear();
+   _proposal_authorizations->set_authority_changes( _authority_changes );
 
    add_index< primary_index<withdraw_permission_index > >();
-   add_index< primary_index<vesting_balance_index> >();
+   auto vesting_idx = add_index< primary_index<vesting_balance_index> >();
+   vesting_idx->add_secondary_index<vote_change_index>();
+   vesting_idx->add_secondary_index<supply_tally_index>();
+   _supply_tallies.push_back( &vesting_idx->get_secondary_index<supply_tally_index>() );
    add_index< primary_index<worker_index> >();
-   add_index< primary_index<balance_index> >();
+   auto genesis_balance_idx = add_index< primary_index<balance_index> >();
+   genesis_balance_idx->add_secondary_index<supply_tally_index>();
+   _supply_tallies.push_back( &genesis_balance_idx->get_secondary_index<supply_tally_index>() );
    add_index< primary_index<blinded_balance_index> >();
 
    //Implementation object indexes
-   add_index< primary_index<transaction_index                             > >();
-   add_index< primary_index<account_balance_index                         > >();
-   add_index< primary_index<asset_bitasset_data_index                     > >();
+   auto bal_index = add_index< primary_index<account_balance_index        > >();
+   bal_index->add_secondary_index<vote_change_index>();
+   bal_index->add_secondary_index<balances_by_account_index>();
+   _balances_by_account = &bal_index->get_secondary_index<balances_by_account_index>();
+   bal_index->add_secondary_index<supply_tally_index>();
+   _supply_tallies.push_back( &bal_index->get_secondary_index<supply_tally_index>() );
+   auto bitasset_idx = add_index< primary_index<asset_bitasset_data_index   > >();
+   bitasset_idx->add_secondary_index<feed_update_index>();
+   _bitasset_feeds = &bitasset_idx->get_secondary_index<feed_update_index>();
+   _asset_bitasset_data = bitasset_idx;
    add_index< primary_index<simple_index<global_property_object          >> >();
    add_index< primary_index<simple_index<dynamic_global_property_object  >> >();
-   add_index< primary_index<simple_index<account_statistics_object       >> >();
-   add_index< primary_index<simple_index<asset_dynamic_data_object       >> >();
-   add_index< primary_index<flat_index<  block_summary_object            >> >();
+   auto stats_idx = add_index< primary_index<slab_index<  account_statistics_object       >> >();
+   stats_idx->add_secondary_index<vote_change_index>();
+   stats_idx->add_secondary_index<supply_tally_index>();
+   _supply_tallies.push_back( &stats_idx->get_secondary_index<supply_tally_index>() );
+   _asset_dynamic_data = add_index< primary_index<simple_index<asset_dynamic_data_object       >> >();
    add_index< primary_index<simple_index<chain_property_object          > > >();
    add_index< primary_index<simple_index<witness_schedule_object        > > >();
    add_index< primary_index<simple_index<budget_record_object           > > >();
@@ -216,6 +253,7 @@ void database::initialize_indexes()
    add_index< primary_index< buyback_index                                > >();
 
    add_index< primary_index< simple_index< fba_accumulator_object       > > >();
+   add_index< primary_index< simple_index< vote_tally_object            > > >()->add_secondary_index<vote_change_index>();
 }
 
 void database::init_genesis(const genesis_state_type& genesis_state)
@@ -241,9 +279,6 @@ void database::init_genesis(const genesis_state_type& genesis_state)
 
    transaction_evaluation_state genesis_eval_state(this);
 
-   flat_index<block_summary_object>& bsi = get_mutable_index_type< flat_index<block_summary_object> >();
-   bsi.resize(0xffff+1);
-
    // Create blockchain accounts
    fc::ecc::private_key null_private_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")));
    create<account_balance_object>([](account_balance_object& b) {
@@ -404,9 +439,17 @@ void database::init_genesis(const genesis_state_type& genesis_state)
       p.chain_id = chain_id;
       p.immutable_parameters = genesis_state.immutable_parameters;
    } );
-   create<block_summary_object>([&](block_summary_object&) {});
 
-   // Create initial accounts
+   // Create initial accounts.  There may be millions of them, so rather than evaluating an account_create_operation
+   // for each they are created here the way account_create_evaluator would: registered by the temp account for
+   // nothing, referred by the committee, and with keys for authorities so there is nothing else for it to check.
+   // Nobody sees the operations applied during the genesis, so none are recorded for these either.
+   const auto& global_properties = get_global_properties();
+   const auto& create_fees = global_properties.parameters.current_fees->get<account_create_operation>();
+   const bool free_accounts = create_fees.basic_fee == 0 && create_fees.premium_fee == 0 && create_fees.price_per_kbyte == 0;
+   const account_id_type genesis_lifetime_referrer = account_id_type()(*this).lifetime_referrer;
+   const auto& genesis_accounts_by_name = get_index_type<account_index>().indices().get<by_name>();
+   uint64_t genesis_accounts_registered = 0;
    for( const auto& account : genesis_state.initial_accounts )
    {
       account_create_operation cop;
@@ -423,7 +466,32 @@ void database::init_genesis(const genesis_state_type& genesis_state)
          cop.active = authority(1, account.active_key, 1);
          cop.options.memo_key = account.active_key;
       }
-      account_id_type account_id(apply_operation(genesis_eval_state, cop).get<object_id_type>());
+      // the names, authorities and options of the genesis are checked as they would be for the operation
+      cop.validate();
+      if( !free_accounts )
+      {
+         share_type required_fee = current_fee_schedule().calculate_fee( cop ).amount;
+         GRAPHENE_ASSERT( required_fee <= 0, insufficient_fee, "Insufficient Fee Paid",
+                          ("core_fee_paid",share_type(0))("required",required_fee) );
+      }
+      if( cop.name.size() )
+         FC_ASSERT( genesis_accounts_by_name.find( cop.name ) == genesis_accounts_by_name.end(),
+                    "Account ${n} is already in the genesis", ("n",cop.name) );
+
+      account_id_type account_id = create<account_object>( [&]( account_object& obj ) {
+         obj.registrar = cop.registrar;
+         obj.referrer = cop.referrer;
+         obj.lifetime_referrer = genesis_lifetime_referrer;
+         obj.network_fee_percentage = global_properties.parameters.network_percent_of_fee;
+         obj.lifetime_referrer_fee_percentage = global_properties.parameters.lifetime_referrer_percent_of_fee;
+         obj.referrer_rewards_percentage = cop.referrer_percent;
+         obj.name = std::move( cop.name );
+         obj.owner = std::move( cop.owner );
+         obj.active = std::move( cop.active );
+         obj.options = std::move( cop.options );
+         obj.statistics = create<account_statistics_object>( [&]( account_statistics_object& s ) { s.owner = obj.id; } ).id;
+      }).id;
+      ++genesis_accounts_registered;
 
       if( account.is_lifetime_member )
       {
@@ -434,6 +502,28 @@ void database::init_genesis(const genesis_state_type& genesis_state)
       }
    }
 
+   // Count the registrations as the evaluator does, raising the account fee once for every accounts_per_fee_scale
+   if( genesis_accounts_registered > 0 )
+   {
+      const auto& dynamic_properties = get_dynamic_global_properties();
+      const uint64_t registered_before = dynamic_properties.accounts_registered_this_interval;
+      modify( dynamic_properties, [genesis_accounts_registered]( dynamic_global_property_object& p ) {
+         p.accounts_registered_this_interval += genesis_accounts_registered;
+      });
+      const uint64_t fee_scale = global_properties.parameters.accounts_per_fee_scale;
+      if( fee_scale > 0 )
+      {
+         const uint64_t fee_raises = ( dynamic_properties.accounts_registered_this_interval / fee_scale )
+                                   - ( registered_before / fee_scale );
+         if( fee_raises > 0 )
+            modify( global_properties, [fee_raises]( global_property_object& p ) {
+               auto& basic_fee = p.parameters.current_fees->get<account_create_operation>().basic_fee;
+               for( uint64_t i = 0; i < fee_raises && basic_fee != 0; ++i )
+                  basic_fee <<= p.parameters.account_fee_scale_bitshifts;
+            });
+      }
+   }
+
    // Helper function to get account ID by name
    const auto& accounts_by_name = get_index_type<account_index>().indices().get<by_name>();
    auto get_account_id = [&accounts_by_name](const string& name) {
@@ -42,6 +42,7 @@
 #include <graphene/chain/market_object.hpp>
 #include <graphene/chain/special_authority_object.hpp>
 #include <graphene/chain/vesting_balance_object.hpp>
+#include <graphene/chain/vote_tally_object.hpp>
 #include <graphene/chain/vote_count.hpp>
 #include <graphene/chain/witness_object.hpp>
 #include <graphene/chain/worker_object.hpp>
@@ -49,35 +50,271 @@
 namespace graphene { namespace chain {
 
 template<class Index>
-vector<std::reference_wrapper<const typename Index::object_type>> database::sort_votable_objects(size_t count) const
+vector<std::reference_wrapper<const typename Index::object_type>> database::top_votable_objects(size_t count)
 {
    using ObjectType = typename Index::object_type;
-   const auto& all_objects = get_index_type<Index>().indices();
-   count = std::min(count, all_objects.size());
-   vector<std::reference_wrapper<const ObjectType>> refs;
-   refs.reserve(all_objects.size());
-   std::transform(all_objects.begin(), all_objects.end(),
-                  std::back_inserter(refs),
-                  [](const ObjectType& o) { return std::cref(o); });
-   std::partial_sort(refs.begin(), refs.begin() + count, refs.end(),
-                   [this](const ObjectType& a, const ObjectType& b)->bool {
-      share_type oa_vote = _vote_tally_buffer[a.vote_id];
-      share_type ob_vote = _vote_tally_buffer[b.vote_id];
-      if( oa_vote != ob_vote )
-         return oa_vote > ob_vote;
-      return a.vote_id < b.vote_id;
-   });
+   const auto& idx = get_index_type<Index>().indices();
 
-   refs.resize(count, refs.front());
+   // only the objects whose votes changed move in the by_votes order, then the elected ones are its first count
+   for( const ObjectType& o : idx )
+   {
+      const uint64_t votes = _vote_tally_buffer[o.vote_id];
+      if( o.total_votes != votes )
+         modify( o, [votes]( ObjectType& obj ) { obj.total_votes = votes; } );
+   }
+
+   const auto& by_votes_idx = idx.template get<by_votes>();
+   count = std::min(count, by_votes_idx.size());
+   vector<std::reference_wrapper<const ObjectType>> refs;
+   refs.reserve(count);
+   for( auto itr = by_votes_idx.begin(); refs.size() < count; ++itr )
+      refs.emplace_back( *itr );
    return refs;
 }
 
-template<class... Types>
-void database::perform_account_maintenance(std::tuple<Types...> helpers)
+namespace {
+   template< typename IndexType >
+   vote_change_index& vote_changes( const database& db )
+   {
+      const auto& idx = dynamic_cast< const primary_index<IndexType>& >( db.get_index_type<IndexType>() );
+      return const_cast< vote_change_index& >( idx.template get_secondary_index<vote_change_index>() );
+   }
+
+   struct by_name_less
+   {
+      bool operator()( const account_object* a, const account_object* b )const { return a->name < b->name; }
+   };
+}
+
+void database::tally_votes_and_process_fees( const global_property_object& props )
 {
-   const auto& idx = get_index_type<account_index>().indices().get<by_name>();
-   for( const account_object& a : idx )
-      detail::for_each(helpers, a, detail::gen_seq<sizeof...(Types)>());
+   vote_change_index& tally_changes = vote_changes< simple_index<vote_tally_object> >( *this );
+   const vector<vote_change_index*> stake_changes = {
+      &vote_changes< account_index >( *this ),
+      &vote_changes< account_balance_index >( *this ),
+      &vote_changes< vesting_balance_index >( *this ),
+      &vote_changes< slab_index<account_statistics_object> >( *this )
+   };
+   const vote_change_index& stats_changes = *stake_changes.back();
+
+   // membership expires with time rather than with a change, so without non-member votes every account is counted
+   // again, as is every account when the parameters the last totals were counted with are not the current ones
+   const vote_tally_object* last_tally = find( vote_tally_id_type() );
+   const bool recount = last_tally == nullptr || !props.parameters.count_non_member_votes ||
+                        last_tally->next_available_vote_id != props.next_available_vote_id ||
+                        last_tally->maximum_witness_count != props.parameters.maximum_witness_count ||
+                        last_tally->maximum_committee_count != props.parameters.maximum_committee_count;
+
+   // the change in the stake voting with each opinion account's opinions
+   std::map< account_id_type, int64_t > stake_deltas;
+   std::set< account_id_type > opinions_to_refresh;
+   if( !recount )
+      opinions_to_refresh = tally_changes.opinions_changed;
+
+   // Accounts are visited in name order, tallying the stake of each one that changed and then paying out its fees.
+   // Paying out fees changes the stake of other accounts, the ones after the payer are tallied with it and the
+   // ones before it are left for the next maintenance, as counting every account in this order always did.
+   // The cashback is collected in a batch and deposited after the pass, the vesting balances it changes mark
+   // their owners for the next maintenance then.
+   std::set< account_id_type > cashback_recipients;
+   vector< account_id_type > recent_recipients;
+   auto visit = [&]( const account_object& stake_account ) {
+      const auto& stats = stake_account.statistics( *this );
+      bool changed = recount || cashback_recipients.count( stake_account.id ) != 0;
+      for( const vote_change_index* c : stake_changes )
+         changed = changed || c->changed.count( stake_account.id ) != 0;
+      if( changed )
+      {
+         uint64_t voting_stake = 0;
+         account_id_type opinion_account_id = stake_account.id;
+         if( props.parameters.count_non_member_votes || stake_account.is_member( head_block_time() ) )
+         {
+            // There may be a difference between the account whose stake is voting and the one specifying opinions.
+            // Usually they're the same, but if the stake account has specified a voting_account, that account is the one
+            // specifying the opinions.
+            if( stake_account.options.voting_account != GRAPHENE_PROXY_TO_SELF_ACCOUNT )
+               opinion_account_id = get( stake_account.options.voting_account ).id;
+
+            voting_stake = stats.total_core_in_orders.value
+                  + get_cashback_balance(stake_account).value
+                  + get_balance(stake_account.get_id(), asset_id_type()).amount.value;
+         }
+
+         if( !recount && stats.tallied_stake > 0 )
+         {
+            stake_deltas[stats.tallied_opinion_account] -= stats.tallied_stake;
+            opinions_to_refresh.insert( stats.tallied_opinion_account );
+         }
+         if( voting_stake > 0 )
+            stake_deltas[opinion_account_id] += voting_stake;
+         // its own opinions may have changed too
+         opinions_to_refresh.insert( opinion_account_id );
+         opinions_to_refresh.insert( stake_account.id );
+
+         if( stats.tallied_stake != voting_stake || stats.tallied_opinion_account != opinion_account_id )
+            modify( stats, [&]( account_statistics_object& s ) {
+               s.tallied_stake = voting_stake;
+               s.tallied_opinion_account = opinion_account_id;
+            } );
+         for( vote_change_index* c : stake_changes )
+            c->tallied( stake_account.id );
+         cashback_recipients.erase( stake_account.id );
+      }
+
+      stats.process_fees( stake_account, *this );
+      take_cashback_recipients( recent_recipients );
+   };
+
+   for( vote_change_index* c : stake_changes )
+      c->recent.clear();
+   _cashback_batch.reset( new cashback_batch );
+   try {
+      if( recount )
+      {
+         for( const account_object& a : get_index_type<account_index>().indices().get<by_name>() )
+         {
+            visit( a );
+            recent_recipients.clear();
+         }
+      }
+      else
+      {
+         std::set< const account_object*, by_name_less > to_visit;
+         for( const vote_change_index* c : stake_changes )
+            for( account_id_type id : c->changed )
+               to_visit.insert( &id(*this) );
+         for( account_id_type id : stats_changes.fee_payers )
+            to_visit.insert( &id(*this) );
+
+         while( !to_visit.empty() )
+         {
+            const account_object& a = **to_visit.begin();
+            to_visit.erase( to_visit.begin() );
+            visit( a );
+            for( vote_change_index* c : stake_changes )
+            {
+               for( account_id_type id : c->recent )
+               {
+                  const account_object& changed_account = id(*this);
+                  if( changed_account.name > a.name && c->changed.count( id ) != 0 )
+                     to_visit.insert( &changed_account );
+               }
+               c->recent.clear();
+            }
+            for( account_id_type id : recent_recipients )
+            {
+               const account_object& recipient = id(*this);
+               cashback_recipients.insert( id );
+               if( recipient.name > a.name )
+                  to_visit.insert( &recipient );
+            }
+            recent_recipients.clear();
+         }
+      }
+   } catch( ... ) {
+      _cashback_batch.reset();
+      throw;
+   }
+   apply_cashback_batch();
+
+   // the totals are sums over the opinion accounts of the stake voting with their opinions, only the ones whose
+   // stake or opinions changed are subtracted as they were counted last time and added as they are now
+   vector<uint64_t> votes( props.next_available_vote_id );
+   vector<uint64_t> witness_counts( props.parameters.maximum_witness_count / 2 + 1 );
+   vector<uint64_t> committee_counts( props.parameters.maximum_committee_count / 2 + 1 );
+   uint64_t total_voting_stake = 0;
+   std::map< account_id_type, vote_tally_object::opinion_tally > opinions;
+   if( !recount )
+   {
+      votes = last_tally->votes;
+      witness_counts = last_tally->witness_counts;
+      committee_counts = last_tally->committee_counts;
+      total_voting_stake = last_tally->total_voting_stake;
+      opinions = last_tally->opinions;
+   }
+   else
+   {
+      opinions_to_refresh.clear();
+      for( const auto& delta : stake_deltas )
+         opinions_to_refresh.insert( delta.first );
+   }
+
+   auto count = [&]( const vote_tally_object::opinion_tally& t, bool add ) {
+      auto apply = [&]( uint64_t& total ) {
+         if( add )
+            total += t.stake;
+         else
+            total -= t.stake;
+      };
+      for( vote_id_type id : t.votes )
+      {
+         uint32_t offset = id.instance();
+         // if they somehow managed to specify an illegal offset, ignore it.
+         if( offset < votes.size() )
+            apply( votes[offset] );
+      }
+
+      // votes for a number greater than maximum_witness_count
+      // are turned into votes for maximum_witness_count.
+      //
+      // in particular, this takes care of the case where a
+      // member was voting for a high number, then the
+      // parameter was lowered.
+      if( t.num_witness <= props.parameters.maximum_witness_count )
+         apply( witness_counts[ std::min( size_t(t.num_witness/2), witness_counts.size() - 1 ) ] );
+      // same rationale as for witnesses
+      if( t.num_committee <= props.parameters.maximum_committee_count )
+         apply( committee_counts[ std::min( size_t(t.num_committee/2), committee_counts.size() - 1 ) ] );
+      apply( total_voting_stake );
+   };
+
+   for( account_id_type opinion_account_id : opinions_to_refresh )
+   {
+      auto itr = opinions.find( opinion_account_id );
+      const vote_tally_object::opinion_tally counted = itr == opinions.end() ? vote_tally_object::opinion_tally()
+                                                                           : itr->second;
+      const account_object& opinion_account = opinion_account_id(*this);
+      vote_tally_object::opinion_tally current;
+      auto delta = stake_deltas.find( opinion_account_id );
+      current.stake = counted.stake + ( delta == stake_deltas.end() ? 0 : delta->second );
+      current.votes = opinion_account.options.votes;
+      current.num_witness = opinion_account.options.num_witness;
+      current.num_committee = opinion_account.options.num_committee;
+      if( current == counted )
+         continue;
+
+      if( counted.stake > 0 )
+         count( counted, false );
+      if( current.stake > 0 )
+      {
+         count( current, true );
+         opinions[opinion_account_id] = std::move( current );
+      }
+      else if( itr != opinions.end() )
+         opinions.erase( itr );
+   }
+
+   _vote_tally_buffer = votes;
+   _witness_count_histogram_buffer = witness_counts;
+   _committee_count_histogram_buffer = committee_counts;
+   _total_voting_stake = total_voting_stake;
+
+   auto store = [&]( vote_tally_object& t ) {
+      t.votes = std::move( votes );
+      t.witness_counts = std::move( witness_counts );
+      t.committee_counts = std::move( committee_counts );
+      t.total_voting_stake = total_voting_stake;
+      t.opinions = std::move( opinions );
+      t.next_available_vote_id = props.next_available_vote_id;
+      t.maximum_witness_count = props.parameters.maximum_witness_count;
+      t.maximum_committee_count = props.parameters.maximum_committee_count;
+   };
+   if( last_tally == nullptr )
+      create<vote_tally_object>( store );
+   else
+      modify( *last_tally, store );
+   // the entries just written are up to date, undoing this maintenance marks them again
+   tally_changes.opinions_changed.clear();
 }
 
 /// @brief A visitor for @ref worker_type which calls pay_worker on the worker within
@@ -105,10 +342,13 @@ void database::update_worker_votes()
    bool allow_negative_votes = (head_block_time() < HARDFORK_607_TIME);
    while( itr != idx.indices().get<by_account>().end() )
    {
-      modify( *itr, [&]( worker_object& obj ){
-         obj.total_votes_for = _vote_tally_buffer[obj.vote_for];
-         obj.total_votes_against = allow_negative_votes ? _vote_tally_buffer[obj.vote_against] : 0;
-      });
+      const uint64_t votes_for = _vote_tally_buffer[itr->vote_for];
+      const uint64_t votes_against = allow_negative_votes ? _vote_tally_buffer[itr->vote_against] : 0;
+      if( itr->total_votes_for != votes_for || itr->total_votes_against != votes_against )
+         modify( *itr, [&]( worker_object& obj ){
+            obj.total_votes_for = votes_for;
+            obj.total_votes_against = votes_against;
+         });
       ++itr;
    }
 }
@@ -116,23 +356,14 @@ void database::update_worker_votes()
 void database::pay_workers( share_type& budget )
 {
 //   ilog("Processing payroll! Available budget is ${b}", ("b", budget));
-   vector<std::reference_wrapper<const worker_object>> active_workers;
-   get_index_type<worker_index>().inspect_all_objects([this, &active_workers](const object& o) {
-      const worker_object& w = static_cast<const worker_object&>(o);
-      auto now = head_block_time();
-      if( w.is_active(now) && w.approving_stake() > 0 )
-         active_workers.emplace_back(w);
-   });
-
    // worker with more votes is preferred
    // if two workers exactly tie for votes, worker with lower ID is preferred
-   std::sort(active_workers.begin(), active_workers.end(), [this](const worker_object& wa, const worker_object& wb) {
-      share_type wa_vote = wa.approving_stake();
-      share_type wb_vote = wb.approving_stake();
-      if( wa_vote != wb_vote )
-         return wa_vote > wb_vote;
-      return wa.id < wb.id;
-   });
+   const auto& by_stake_idx = get_index_type<worker_index>().indices().get<by_approving_stake>();
+   const auto now = head_block_time();
+   vector<std::reference_wrapper<const worker_object>> active_workers;
+   for( auto itr = by_stake_idx.begin(); itr != by_stake_idx.end() && itr->approving_stake() > 0; ++itr )
+      if( itr->is_active(now) )
+         active_workers.emplace_back(*itr);
 
    for( uint32_t i = 0; i < active_workers.size() && budget > 0; ++i )
    {
@@ -177,19 +408,10 @@ void database::update_active_witnesses()
    }
 
    const chain_property_object& cpo = get_chain_properties();
-   auto wits = sort_votable_objects<witness_index>(std::max(witness_count*2+1, (size_t)cpo.immutable_parameters.min_witness_count));
+   auto wits = top_votable_objects<witness_index>(std::max(witness_count*2+1, (size_t)cpo.immutable_parameters.min_witness_count));
 
    const global_property_object& gpo = get_global_properties();
 
-   const auto& all_witnesses = get_index_type<witness_index>().indices();
-
-   for( const witness_object& wit : all_witnesses )
-   {
-      modify( wit, [&]( witness_object& obj ){
-              obj.total_votes = _vote_tally_buffer[wit.vote_id];
-              });
-   }
-
    // Update witness authority
    modify( get(GRAPHENE_WITNESS_ACCOUNT), [&]( account_object& a )
    {
@@ -256,14 +478,7 @@ void database::update_active_committee_members()
          stake_tally += _committee_count_histogram_buffer[++committee_member_count];
 
    const chain_property_object& cpo = get_chain_properties();
-   auto committee_members = sort_votable_objects<committee_member_index>(std::max(committee_member_count*2+1, (size_t)cpo.immutable_parameters.min_committee_member_count));
-
-   for( const committee_member_object& del : committee_members )
-   {
-      modify( del, [&]( committee_member_object& obj ){
-              obj.total_votes = _vote_tally_buffer[del.vote_id];
-              });
-   }
+   auto committee_members = top_votable_objects<committee_member_index>(std::max(committee_member_count*2+1, (size_t)cpo.immutable_parameters.min_committee_member_count));
 
    // Update committee authorities
    if( !committee_members.empty() )
@@ -494,15 +709,14 @@ void update_top_n_authorities( database& db )
 
          const top_holders_special_authority& tha = auth.get< top_holders_special_authority >();
          vote_counter vc;
-         const auto& bal_idx = db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
          uint8_t num_needed = tha.num_top_holders;
          if( num_needed == 0 )
             return;
 
-         // find accounts
-         const auto range = bal_idx.equal_range( boost::make_tuple( tha.asset ) );
-         for( const account_balance_object& bal : boost::make_iterator_range( range.first, range.second ) )
+         // find accounts, one more than needed in case acct is among them
+         for( const account_balance_object* holder : db.balances_by_account().get_top_holders( tha.asset, num_needed + 1 ) )
          {
+             const account_balance_object& bal = *holder;
              assert( bal.asset_type == tha.asset );
              if( bal.owner == acct.id )
                 continue;
@@ -512,11 +726,18 @@ void update_top_n_authorities( database& db )
                 break;
          }
 
+         // most of the time the top holders are the same as at the last maintenance
+         const uint8_t flag = is_owner ? account_object::top_n_control_owner : account_object::top_n_control_active;
+         authority updated = is_owner ? acct.owner : acct.active;
+         vc.finish( updated );
+         if( updated == ( is_owner ? acct.owner : acct.active ) && ( vc.is_empty() || ( acct.top_n_control_flags & flag ) ) )
+            return;
+
          db.modify( acct, [&]( account_object& a )
          {
-            vc.finish( is_owner ? a.owner : a.active );
+            ( is_owner ? a.owner : a.active ) = updated;
             if( !vc.is_empty() )
-               a.top_n_control_flags |= (is_owner ? account_object::top_n_control_owner : account_object::top_n_control_active);
+               a.top_n_control_flags |= flag;
          } );
       }
    } );
@@ -612,7 +833,6 @@ void distribute_fba_balances( database& db )
 void create_buyback_orders( database& db )
 {
    const auto& bbo_idx = db.get_index_type< buyback_index >().indices().get<by_id>();
-   const auto& bal_idx = db.get_index_type< account_balance_index >().indices().get< by_account_asset >();
 
    for( const buyback_object& bbo : bbo_idx )
    {
@@ -620,7 +840,6 @@ void create_buyback_orders( database& db )
       assert( asset_to_buy.buyback_account.valid() );
 
       const account_object& buyback_account = (*(asset_to_buy.buyback_account))(db);
-      asset_id_type next_asset = asset_id_type();
 
       if( !buyback_account.allowed_assets.valid() )
       {
@@ -628,16 +847,17 @@ void create_buyback_orders( database& db )
          continue;
       }
 
-      while( true )
+      // the account's few balances in the order of their assets, selling one only changes it and the balance of
+      // the asset bought, so they can be read up front
+      vector< std::pair< asset_id_type, share_type > > holdings;
+      for( const account_balance_object* balance : db.balances_by_account().get_account_balances( buyback_account.id ) )
+         holdings.emplace_back( balance->asset_type, balance->balance );
+      std::sort( holdings.begin(), holdings.end() );
+
+      for( const auto& holding : holdings )
       {
-         auto it = bal_idx.lower_bound( boost::make_tuple( buyback_account.id, next_asset ) );
-         if( it == bal_idx.end() )
-            break;
-         if( it->owner != buyback_account.id )
-            break;
-         asset_id_type asset_to_sell = it->asset_type;
-         share_type amount_to_sell = it->balance;
-         next_asset = asset_to_sell + 1;
+         asset_id_type asset_to_sell = holding.first;
+         share_type amount_to_sell = holding.second;
          if( asset_to_sell == asset_to_buy.id )
             continue;
          if( amount_to_sell == 0 )
@@ -650,6 +870,9 @@ void create_buyback_orders( database& db )
 
          try
          {
+            if( db.sweep_book( buyback_account, asset( amount_to_sell, asset_to_sell ), asset_to_buy ) )
+               continue;
+
             transaction_evaluation_state buyback_context(&db);
             buyback_context.skip_fee_schedule_check = true;
 
@@ -723,86 +946,7 @@ void database::perform_chain_maintenance(const signed_block& next_block, const g
    distribute_fba_balances(*this);
    create_buyback_orders(*this);
 
-   struct vote_tally_helper {
-      database& d;
-      const global_property_object& props;
-
-      vote_tally_helper(database& d, const global_property_object& gpo)
-         : d(d), props(gpo)
-      {
-         d._vote_tally_buffer.resize(props.next_available_vote_id);
-         d._witness_count_histogram_buffer.resize(props.parameters.maximum_witness_count / 2 + 1);
-         d._committee_count_histogram_buffer.resize(props.parameters.maximum_committee_count / 2 + 1);
-         d._total_voting_stake = 0;
-      }
-
-      void operator()(const account_object& stake_account) {
-         if( props.parameters.count_non_member_votes || stake_account.is_member(d.head_block_time()) )
-         {
-            // There may be a difference between the account whose stake is voting and the one specifying opinions.
-            // Usually they're the same, but if the stake account has specified a voting_account, that account is the one
-            // specifying the opinions.
-            const account_object& opinion_account =
-                  (stake_account.options.voting_account ==
-                   GRAPHENE_PROXY_TO_SELF_ACCOUNT)? stake_account
-                                     : d.get(stake_account.options.voting_account);
-
-            const auto& stats = stake_account.statistics(d);
-            uint64_t voting_stake = stats.total_core_in_orders.value
-                  + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(d).balance.amount.value: 0)
-                  + d.get_balance(stake_account.get_id(), asset_id_type()).amount.value;
-
-            for( vote_id_type id : opinion_account.options.votes )
-            {
-               uint32_t offset = id.instance();
-               // if they somehow managed to specify an illegal offset, ignore it.
-               if( offset < d._vote_tally_buffer.size() )
-                  d._vote_tally_buffer[offset] += voting_stake;
-            }
-
-            if( opinion_account.options.num_witness <= props.parameters.maximum_witness_count )
-            {
-               uint16_t offset = std::min(size_t(opinion_account.options.num_witness/2),
-                                          d._witness_count_histogram_buffer.size() - 1);
-               // votes for a number greater than maximum_witness_count
-               // are turned into votes for maximum_witness_count.
-               //
-               // in particular, this takes care of the case where a
-               // member was voting for a high number, then the
-               // parameter was lowered.
-               d._witness_count_histogram_buffer[offset] += voting_stake;
-            }
-            if( opinion_account.options.num_committee <= props.parameters.maximum_committee_count )
-            {
-               uint16_t offset = std::min(size_t(opinion_account.options.num_committee/2),
-                                          d._committee_count_histogram_buffer.size() - 1);
-               // votes for a number greater than maximum_committee_count
-               // are turned into votes for maximum_committee_count.
-               //
-               // same rationale as for witnesses
-               d._committee_count_histogram_buffer[offset] += voting_stake;
-            }
-
-            d._total_voting_stake += voting_stake;
-         }
-      }
-   } tally_helper(*this, gpo);
-   struct process_fees_helper {
-      database& d;
-      const global_property_object& props;
-
-      process_fees_helper(database& d, const global_property_object& gpo)
-         : d(d), props(gpo) {}
-
-      void operator()(const account_object& a) {
-         a.statistics(d).process_fees(a, d);
-      }
-   } fee_helper(*this, gpo);
-
-   perform_account_maintenance(std::tie(
-      tally_helper,
-      fee_helper
-      ));
+   tally_votes_and_process_fees( gpo );
 
    struct clear_canary {
       clear_canary(vector<uint64_t>& target): target(target){}
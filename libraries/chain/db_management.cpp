@@ -23,20 +23,200 @@
  */
 
 #include <graphene/chain/database.hpp>
+#include <graphene/chain/db_with.hpp>
 
 #include <graphene/chain/operation_history_object.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
 
 #include <fc/io/fstream.hpp>
+#include <fc/io/json.hpp>
+#include <fc/thread/thread.hpp>
 
+#include <algorithm>
+#include <condition_variable>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
+
+namespace graphene { namespace chain { namespace detail {
+
+/** stored next to the index files of a state snapshot */
+struct snapshot_info
+{
+   uint32_t      head_block_num = 0;
+   block_id_type head_block_id;
+   chain_id_type chain_id;
+};
+
+} } }
+
+FC_REFLECT( graphene::chain::detail::snapshot_info, (head_block_num)(head_block_id)(chain_id) )
 
 namespace graphene { namespace chain {
 
+namespace detail {
+
+/**
+ * Reads blocks first_block_num..last_block_num from the block log on a pool of threads, each with its
+ * own block_database handle so the seeks don't interfere, and hands them out in order.
+ * At most queue_depth blocks are read ahead of the consumer.
+ */
+class block_prefetcher
+{
+   public:
+      block_prefetcher( const fc::path& block_dir, uint32_t first_block_num, uint32_t last_block_num,
+                        uint32_t thread_count, uint32_t queue_depth )
+         : _last_block_num( last_block_num ), _queue_depth( std::max<uint32_t>( queue_depth, 1 ) ),
+           _next_to_read( first_block_num ), _next_to_apply( first_block_num )
+      {
+         thread_count = std::max<uint32_t>( thread_count, 1 );
+         for( uint32_t i = 0; i < thread_count; ++i )
+         {
+            _readers.emplace_back( new block_database );
+            _readers.back()->set_cache_size( 0 );
+            _readers.back()->open( block_dir );
+            _threads.emplace_back( new fc::thread( "replay reader " + fc::to_string(i) ) );
+            block_database& reader = *_readers.back();
+            _done.push_back( _threads.back()->async( [this,&reader]() { read_loop( reader ); } ) );
+         }
+      }
+
+      ~block_prefetcher()
+      {
+         try
+         {
+            stop();
+         }
+         catch( const fc::exception& e )
+         {
+            edump( (e.to_detail_string()) );
+         }
+      }
+
+      /**
+       * Waits until block_num has been read, returns an invalid optional if it is not in the log.
+       * Rethrows the error if reading the block failed.
+       */
+      optional<signed_block> next( uint32_t block_num )
+      {
+         std::unique_lock<std::mutex> lock( _mutex );
+         _block_ready.wait( lock, [&]() {
+            return _ready.find( block_num ) != _ready.end() || _errors.find( block_num ) != _errors.end();
+         } );
+         auto error = _errors.find( block_num );
+         if( error != _errors.end() )
+         {
+            fc::exception_ptr e = error->second;
+            _errors.erase( error );
+            lock.unlock();
+            e->dynamic_rethrow_exception();
+         }
+         auto itr = _ready.find( block_num );
+         optional<signed_block> result = std::move( itr->second );
+         _ready.erase( itr );
+         _next_to_apply = block_num + 1;
+         lock.unlock();
+         _space_available.notify_all();
+         return result;
+      }
+
+      /** number of blocks that have been read but not yet handed out */
+      size_t depth()const
+      {
+         std::lock_guard<std::mutex> lock( _mutex );
+         return _ready.size();
+      }
+
+      void stop()
+      {
+         {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _stopping = true;
+         }
+         _space_available.notify_all();
+         for( auto& f : _done )
+            f.wait();
+         _done.clear();
+         _threads.clear();
+         for( auto& r : _readers )
+            r->close();
+         _readers.clear();
+      }
+
+   private:
+      void read_loop( block_database& blocks )
+      {
+         while( true )
+         {
+            uint32_t block_num;
+            {
+               std::unique_lock<std::mutex> lock( _mutex );
+               _space_available.wait( lock, [&]() {
+                  return _stopping || _next_to_read > _last_block_num || _next_to_read < _next_to_apply + _queue_depth;
+               } );
+               if( _stopping || _next_to_read > _last_block_num )
+                  return;
+               block_num = _next_to_read++;
+            }
+            // fetch_by_number() validates the block id, so a torn or missing block comes back invalid
+            optional<signed_block> block;
+            fc::exception_ptr error;
+            try
+            {
+               block = blocks.fetch_by_number( block_num );
+            }
+            catch( const fc::exception& e )
+            {
+               error = e.dynamic_copy_exception();
+            }
+            catch( const std::exception& e )
+            {
+               error = fc::unhandled_exception( FC_LOG_MESSAGE( error, "reading block ${n}: ${e}",
+                                                                ("n",block_num)("e",e.what()) ) )
+                          .dynamic_copy_exception();
+            }
+            catch( ... )
+            {
+               error = fc::unhandled_exception( FC_LOG_MESSAGE( error, "reading block ${n}: ${e}",
+                                                                ("n",block_num)("e",fc::except_str()) ) )
+                          .dynamic_copy_exception();
+            }
+            {
+               std::lock_guard<std::mutex> lock( _mutex );
+               if( error )
+                  _errors.emplace( block_num, error );
+               else
+                  _ready.emplace( block_num, std::move( block ) );
+            }
+            _block_ready.notify_all();
+         }
+      }
+
+      const uint32_t                               _last_block_num;
+      const uint32_t                               _queue_depth;
+      uint32_t                                     _next_to_read;
+      uint32_t                                     _next_to_apply;
+      bool                                         _stopping      = false;
+      std::map< uint32_t, optional<signed_block> > _ready;
+      /** the blocks which could not be read, next() rethrows the error */
+      std::map< uint32_t, fc::exception_ptr >      _errors;
+      mutable std::mutex                           _mutex;
+      std::condition_variable                      _block_ready;
+      std::condition_variable                      _space_available;
+
+      vector< unique_ptr<block_database> >         _readers;
+      vector< unique_ptr<fc::thread> >             _threads;
+      vector< fc::future<void> >                   _done;
+};
+
+} // detail
+
 database::database()
 {
+   _undo_db.add_journal( &_recent_transactions );
+   _undo_db.add_journal( &_block_summaries );
    initialize_indexes();
    initialize_evaluators();
 }
@@ -44,6 +224,29 @@ database::database()
 database::~database()
 {
    clear_pending();
+   try
+   {
+      if( _pending_checkpoint_num != 0 )
+         _pending_checkpoint_write.wait();
+   }
+   catch( ... )
+   {
+   }
+   try
+   {
+      if( _flush_pending )
+         _flush_write.wait();
+   }
+   catch( ... )
+   {
+   }
+}
+
+void database::set_signature_threads( uint32_t thread_count )
+{
+   _signature_threads.clear();
+   for( uint32_t i = 0; i < thread_count; ++i )
+      _signature_threads.emplace_back( new fc::thread( "signature recovery " + fc::to_string(i) ) );
 }
 
 void database::reindex(fc::path data_dir, const genesis_state_type& initial_allocation)
@@ -60,44 +263,398 @@ void database::reindex(fc::path data_dir, const genesis_state_type& initial_allo
       return;
    }
 
-   const auto last_block_num = last_block->block_num();
+   replay_blocks( data_dir, 1, last_block->block_num() );
+   auto end = fc::time_point::now();
+   ilog( "Done reindexing, elapsed time: ${t} sec", ("t",double((end-start).count())/1000000.0 ) );
+} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+void database::reindex_from_snapshot( fc::path data_dir, const fc::path& snapshot_dir )
+{ try {
+   FC_ASSERT( fc::exists( snapshot_dir / "snapshot.json" ), "No complete snapshot in ${d}", ("d",snapshot_dir) );
+   auto info = fc::json::from_file( snapshot_dir / "snapshot.json" ).as<detail::snapshot_info>();
+   ilog( "reindexing blockchain from the snapshot at block ${n}", ("n",info.head_block_num) );
+   wipe(data_dir, false);
+
+   // the snapshot uses the object_database layout, so it only needs to be copied in place
+   const fc::path snapshot_objects = snapshot_dir / "object_database";
+   for( fc::directory_iterator space( snapshot_objects ); space != fc::directory_iterator(); ++space )
+   {
+      const fc::path space_dir = data_dir / "object_database" / fc::path(*space).filename();
+      fc::create_directories( space_dir );
+      for( fc::directory_iterator file( *space ); file != fc::directory_iterator(); ++file )
+         fc::copy( *file, space_dir / fc::path(*file).filename() );
+   }
+
+   object_database::open(data_dir);
+   replay_after_state( data_dir, snapshot_dir, snapshot_dir / "snapshot.json" );
+} FC_CAPTURE_AND_RETHROW( (data_dir)(snapshot_dir) ) }
 
-   ilog( "Replaying blocks..." );
+/** marks the object database files in a data dir as the complete result of a background flush */
+static fc::path flushed_state_info( const fc::path& data_dir )
+{
+   return data_dir / "object_database" / "flushed.json";
+}
+
+bool database::has_flushed_state( const fc::path& data_dir )
+{
+   return fc::exists( flushed_state_info( data_dir ) );
+}
+
+void database::reindex_from_flushed_state( fc::path data_dir )
+{ try {
+   FC_ASSERT( has_flushed_state( data_dir ), "No complete flushed state in ${d}", ("d",data_dir) );
+   ilog( "reindexing blockchain from the flushed state" );
+   object_database::open(data_dir);
+   replay_after_state( data_dir, data_dir / "object_database", flushed_state_info( data_dir ) );
+} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+void database::replay_after_state( const fc::path& data_dir, const fc::path& state_dir, const fc::path& info_file )
+{
+   auto info = fc::json::from_file( info_file ).as<detail::snapshot_info>();
+   _recent_transactions.load( state_dir / "recent_transactions" );
+   _block_id_to_block.open(data_dir / "database" / "block_num_to_block");
+   FC_ASSERT( find(global_property_id_type()), "Saved state does not contain the chain state" );
+   if( !_block_summaries.load( state_dir / "block_summaries" ) )
+      rebuild_block_summaries();
+   FC_ASSERT( head_block_id() == info.head_block_id && get_chain_id() == info.chain_id,
+              "Saved state does not match ${f}", ("f",info_file.filename())("state",head_block_id())("info",info) );
+   FC_ASSERT( _block_id_to_block.contains( head_block_id() ),
+              "The block log does not contain the saved head block ${id}, it is on another fork or pruned",
+              ("id",head_block_id()) );
+
+   auto start = fc::time_point::now();
+   auto last_block = _block_id_to_block.last();
+   FC_ASSERT( last_block.valid() );
+   _fork_db.start_block( *last_block );
+   replay_blocks( data_dir, head_block_num() + 1, last_block->block_num() );
+   auto end = fc::time_point::now();
+   ilog( "Done reindexing from block ${n}, elapsed time: ${t} sec",
+         ("n",info.head_block_num)("t",double((end-start).count())/1000000.0 ) );
+}
+
+void database::replay_blocks( const fc::path& data_dir, uint32_t first_block_num, uint32_t last_block_num )
+{
+   FC_ASSERT( _block_id_to_block.first_retained_block_num() <= first_block_num,
+              "Blocks below ${n} have been pruned from the block log, the chain cannot be replayed from ${f}",
+              ("n",_block_id_to_block.first_retained_block_num())("f",first_block_num) );
+
+   if( _replay_last_block != 0 && _replay_last_block < last_block_num )
+   {
+      last_block_num = std::max( _replay_last_block, first_block_num - 1 );
+      _replay_stopped_early = true;
+   }
+   ilog( "Replaying blocks ${f} to ${l} using ${n} reader thread(s)...",
+         ("f",first_block_num)("l",last_block_num)("n",_replay_threads) );
+   _replay_statistics = replay_statistics();
+   _replay_statistics.first_block = first_block_num;
+   const auto replay_start = fc::time_point::now();
    _undo_db.disable();
-   for( uint32_t i = 1; i <= last_block_num; ++i )
    {
-      if( i % 2000 == 0 ) std::cerr << "   " << double(i*100)/last_block_num << "%   "<<i << " of " <<last_block_num<<"   \n";
-      fc::optional< signed_block > block = _block_id_to_block.fetch_by_number(i);
-      if( !block.valid() )
+      detail::block_prefetcher prefetcher( data_dir / "database" / "block_num_to_block", first_block_num,
+                                           last_block_num, _replay_threads, _replay_queue_depth );
+      auto     last_report     = fc::time_point::now();
+      uint32_t blocks_since    = 0;
+      uint64_t ops_since       = 0;
+      for( uint32_t i = first_block_num; i <= last_block_num; ++i )
       {
-         wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
-         uint32_t dropped_count = 0;
-         while( true )
+         fc::optional< signed_block > block = prefetcher.next(i);
+         if( !block.valid() )
+         {
+            prefetcher.stop();
+            wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
+            uint32_t dropped_count = 0;
+            while( true )
+            {
+               fc::optional< block_id_type > last_id = _block_id_to_block.last_id();
+               // this can trigger if we attempt to e.g. read a file that has block #2 but no block #1
+               if( !last_id.valid() )
+                  break;
+               // we've caught up to the gap
+               if( block_header::num_from_id( *last_id ) <= i )
+                  break;
+               _block_id_to_block.remove( *last_id );
+               dropped_count++;
+            }
+            wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
+            break;
+         }
+         apply_block( *block, _replay_skip );
+
+         ++blocks_since;
+         uint64_t ops = 0;
+         for( const auto& trx : block->transactions )
+            ops += trx.operations.size();
+         ops_since += ops;
+         _replay_statistics.last_block = i;
+         ++_replay_statistics.blocks;
+         _replay_statistics.transactions += block->transactions.size();
+         _replay_statistics.operations += ops;
+         if( i % 2000 == 0 || i == last_block_num )
          {
-            fc::optional< block_id_type > last_id = _block_id_to_block.last_id();
-            // this can trigger if we attempt to e.g. read a file that has block #2 but no block #1
-            if( !last_id.valid() )
-               break;
-            // we've caught up to the gap
-            if( block_header::num_from_id( *last_id ) <= i )
-               break;
-            _block_id_to_block.remove( *last_id );
-            dropped_count++;
+            auto now = fc::time_point::now();
+            double secs = std::max<double>( double((now - last_report).count()) / 1000000.0, 0.000001 );
+            ilog( "   ${p}%   ${i} of ${n}   ${bps} blocks/s   ${ops} ops/s   ${q} blocks queued",
+                  ("p",double(i)*100/last_block_num)("i",i)("n",last_block_num)
+                  ("bps",uint64_t(blocks_since/secs))("ops",uint64_t(ops_since/secs))("q",prefetcher.depth()) );
+            last_report  = now;
+            blocks_since = 0;
+            ops_since    = 0;
          }
-         wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
-         break;
       }
-      apply_block(*block, skip_witness_signature |
-                          skip_transaction_signatures |
-                          skip_transaction_dupe_check |
-                          skip_tapos_check |
-                          skip_witness_schedule_check |
-                          skip_authority_check);
    }
+   _replay_statistics.elapsed_time = ( fc::time_point::now() - replay_start ).count();
    _undo_db.enable();
-   auto end = fc::time_point::now();
-   ilog( "Done reindexing, elapsed time: ${t} sec", ("t",double((end-start).count())/1000000.0 ) );
-} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+}
+
+void database::export_snapshot( const fc::path& dir )
+{
+   detail::without_pending_transactions( *this, std::move(_pending_tx), [&]()
+   {
+      write_snapshot( dir );
+   } );
+}
+
+void database::write_snapshot( const fc::path& dir )
+{ try {
+   ilog( "Exporting state snapshot at block ${n} to ${d}", ("n",head_block_num())("d",dir) );
+   auto start = fc::time_point::now();
+   // snapshot.json is written last, so its presence marks a complete snapshot
+   fc::create_directories( dir );
+   fc::remove_all( dir / "snapshot.json" );
+   fc::remove_all( dir / "object_database" );
+   object_database::export_snapshot( dir / "object_database" );
+   _recent_transactions.save( dir / "recent_transactions" );
+   _block_summaries.save( dir / "block_summaries" );
+
+   detail::snapshot_info info;
+   info.head_block_num = head_block_num();
+   info.head_block_id  = head_block_id();
+   info.chain_id       = get_chain_id();
+   fc::json::save_to_file( info, dir / "snapshot.json" );
+   ilog( "Done exporting snapshot in ${ms} ms", ("ms",(fc::time_point::now() - start).count()/1000) );
+} FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+void database::set_state_checkpoints( uint32_t interval, const fc::path& dir )
+{
+   if( _pending_checkpoint_num != 0 )
+   {
+      _pending_checkpoint_write.wait();
+      fc::remove_all( _state_checkpoint_dir / ( fc::to_string(_pending_checkpoint_num) + ".tmp" ) );
+      _pending_checkpoint_num = 0;
+   }
+   _state_checkpoint_interval = interval;
+   _state_checkpoint_dir = dir;
+}
+
+/** the block number a checkpoint directory is named after, 0 if name is not one */
+static uint32_t state_checkpoint_num( const std::string& name )
+{
+   if( name.empty() || name.size() > 9 || name.find_first_not_of( "0123456789" ) != std::string::npos )
+      return 0;
+   return std::stoul( name );
+}
+
+fc::optional<fc::path> database::find_state_checkpoint( const fc::path& dir )
+{
+   fc::optional<fc::path> result;
+   if( !fc::is_directory( dir ) )
+      return result;
+   uint32_t newest = 0;
+   for( fc::directory_iterator itr( dir ); itr != fc::directory_iterator(); ++itr )
+   {
+      const fc::path checkpoint = *itr;
+      const uint32_t num = state_checkpoint_num( checkpoint.filename().string() );
+      if( num > newest && fc::exists( checkpoint / "snapshot.json" ) )
+      {
+         newest = num;
+         result = checkpoint;
+      }
+   }
+   return result;
+}
+
+void database::update_state_checkpoint()
+{
+   // a broken checkpoint must not cost the block, the next interval tries again
+   try
+   {
+      if( _pending_checkpoint_num != 0 && _pending_checkpoint_write.ready() &&
+          get_dynamic_global_properties().last_irreversible_block_num >= _pending_checkpoint_num )
+         finish_state_checkpoint();
+      if( _pending_checkpoint_num == 0 && head_block_num() % _state_checkpoint_interval == 0 )
+         start_state_checkpoint();
+   }
+   catch( const fc::exception& e )
+   {
+      elog( "State checkpoint failed: ${e}", ("e",e.to_detail_string()) );
+   }
+}
+
+void database::start_state_checkpoint()
+{ try {
+   const uint32_t num = head_block_num();
+   const fc::path tmp = _state_checkpoint_dir / ( fc::to_string(num) + ".tmp" );
+   auto start = fc::time_point::now();
+   fc::remove_all( tmp );
+   fc::create_directories( tmp );
+   _recent_transactions.save( tmp / "recent_transactions" );
+   _block_summaries.save( tmp / "block_summaries" );
+   auto packed = std::make_shared<const graphene::db::packed_snapshot>( object_database::pack_snapshot() );
+   ilog( "Packed the state checkpoint at block ${n}, ${kb} KiB in ${ms} ms",
+         ("n",num)("kb",packed->size()/1024)("ms",(fc::time_point::now() - start).count()/1000) );
+
+   if( !_state_writer )
+      _state_writer.reset( new fc::thread( "state writer" ) );
+   _pending_checkpoint_num = num;
+   _pending_checkpoint_id  = head_block_id();
+   _pending_checkpoint_write = _state_writer->async( [packed, tmp]()
+   {
+      packed->write( tmp / "object_database" );
+   } );
+} FC_CAPTURE_AND_RETHROW() }
+
+void database::finish_state_checkpoint()
+{ try {
+   const uint32_t num = _pending_checkpoint_num;
+   const fc::path tmp = _state_checkpoint_dir / ( fc::to_string(num) + ".tmp" );
+   _pending_checkpoint_num = 0;
+   try
+   {
+      _pending_checkpoint_write.wait();
+   }
+   catch( ... )
+   {
+      fc::remove_all( tmp );
+      throw;
+   }
+   if( get_dynamic_global_properties().last_irreversible_block_num < num ||
+       get_block_id_for_num( num ) != _pending_checkpoint_id )
+   {
+      // not irreversible yet when closing, or a fork switch replaced its block
+      fc::remove_all( tmp );
+      return;
+   }
+
+   detail::snapshot_info info;
+   info.head_block_num = num;
+   info.head_block_id  = _pending_checkpoint_id;
+   info.chain_id       = get_chain_id();
+   fc::json::save_to_file( info, tmp / "snapshot.json" );
+   const fc::path checkpoint = _state_checkpoint_dir / fc::to_string(num);
+   fc::remove_all( checkpoint );
+   fc::rename( tmp, checkpoint );
+
+   vector<fc::path> older;
+   for( fc::directory_iterator itr( _state_checkpoint_dir ); itr != fc::directory_iterator(); ++itr )
+   {
+      const fc::path old = *itr;
+      std::string name = old.filename().string();
+      if( name.size() > 4 && name.compare( name.size() - 4, 4, ".tmp" ) == 0 )
+         name.resize( name.size() - 4 );
+      const uint32_t old_num = state_checkpoint_num( name );
+      if( old_num != 0 && old_num != num )
+         older.push_back( old );
+   }
+   for( const auto& old : older )
+      fc::remove_all( old );
+   ilog( "Completed the state checkpoint at block ${n}", ("n",num) );
+} FC_CAPTURE_AND_RETHROW() }
+
+void database::update_background_flush()
+{
+   try
+   {
+      if( _flush_pending && _flush_write.ready() &&
+          get_dynamic_global_properties().last_irreversible_block_num >= _flush_block_num )
+      {
+         // the files of the last flush stay complete until the ones written by this flush are moved into place
+         const fc::path info_file = flushed_state_info( get_data_dir() );
+         fc::remove_all( info_file );
+         finish_background_flush();
+         // the block may have been replaced by a fork switch in the meantime
+         if( get_block_id_for_num( _flush_block_num ) == _flush_block_id )
+         {
+            detail::snapshot_info info;
+            info.head_block_num = _flush_block_num;
+            info.head_block_id  = _flush_block_id;
+            info.chain_id       = get_chain_id();
+            const fc::path tmp( info_file.generic_string() + ".tmp" );
+            fc::json::save_to_file( info, tmp );
+            fc::rename( tmp, info_file );
+         }
+      }
+      if( !_flush_pending && head_block_num() % _flush_interval == 0 )
+      {
+         auto start = fc::time_point::now();
+         // everything is written next to the files of the last flush, finish_background_flush() swaps it in
+         _recent_transactions.save( get_data_dir() / "object_database" / "recent_transactions.tmp" );
+         _block_summaries.save( get_data_dir() / "object_database" / "block_summaries.tmp" );
+         std::function<void()> write;
+         try
+         {
+            write = object_database::prepare_flush();
+         }
+         catch( ... )
+         {
+            object_database::discard_flushed();
+            throw;
+         }
+         dlog( "Packed the flush at block ${n} in ${ms} ms",
+               ("n",head_block_num())("ms",(fc::time_point::now() - start).count()/1000) );
+
+         if( !_state_writer )
+            _state_writer.reset( new fc::thread( "state writer" ) );
+         _flush_pending   = true;
+         _flush_block_num = head_block_num();
+         _flush_block_id  = head_block_id();
+         _flush_write = _state_writer->async( write );
+      }
+   }
+   catch( const fc::exception& e )
+   {
+      elog( "Background flush failed: ${e}", ("e",e.to_detail_string()) );
+   }
+}
+
+void database::finish_background_flush()
+{ try {
+   _flush_pending = false;
+   try
+   {
+      _flush_write.wait();
+      const fc::path dir = get_data_dir() / "object_database";
+      object_database::commit_flushed();
+      fc::rename( dir / "recent_transactions.tmp", dir / "recent_transactions" );
+      fc::rename( dir / "block_summaries.tmp", dir / "block_summaries" );
+   }
+   catch( ... )
+   {
+      object_database::discard_flushed();
+      throw;
+   }
+} FC_CAPTURE_AND_RETHROW() }
+
+void database::rebuild_block_summaries()
+{ try {
+   // a state saved without them, the blocks they refer to must all be in the block log.  Leaving the slots of
+   // pruned blocks empty would fail every transaction with TaPoS on them, so that is refused instead
+   const uint32_t head = head_block_num();
+   const uint32_t first = head >= block_summaries::size ? head - block_summaries::size + 1 : 1;
+   FC_ASSERT( _block_id_to_block.first_retained_block_num() <= first,
+              "The state has no TaPoS block summaries and blocks below ${n} have been pruned from the block log, "
+              "so they cannot be rebuilt for blocks ${f} to ${h}; restore from a snapshot that includes them "
+              "or replay from an unpruned block log",
+              ("n",_block_id_to_block.first_retained_block_num())("f",first)("h",head) );
+   wlog( "Rebuilding the TaPoS block summaries of blocks ${f} to ${h} from the block log", ("f",first)("h",head) );
+   for( uint32_t num = first; num <= head; ++num )
+      _block_summaries.set( num, _block_id_to_block.fetch_block_id( num ) );
+} FC_CAPTURE_AND_RETHROW() }
+
+void database::set_replay_prefetch( uint32_t thread_count, uint32_t queue_depth )
+{
+   _replay_threads     = std::max<uint32_t>( thread_count, 1 );
+   _replay_queue_depth = std::max<uint32_t>( queue_depth, 1 );
+}
 
 void database::wipe(const fc::path& data_dir, bool include_blocks)
 {
@@ -115,11 +672,14 @@ void database::open(
    try
    {
       object_database::open(data_dir);
+      _recent_transactions.load( data_dir / "object_database" / "recent_transactions" );
 
       _block_id_to_block.open(data_dir / "database" / "block_num_to_block");
 
       if( !find(global_property_id_type()) )
          init_genesis(genesis_loader());
+      else if( !_block_summaries.load( data_dir / "object_database" / "block_summaries" ) )
+         rebuild_block_summaries();
 
       fc::optional<signed_block> last_block = _block_id_to_block.last();
       if( last_block.valid() )
@@ -143,7 +703,10 @@ void database::close(bool rewind)
 
    // pop all of the blocks that we can given our undo history, this should
    // throw when there is no more undo history to pop
-   if( rewind )
+   // the blocks popped here are never pushed again, so don't keep their changes
+   const bool fork_diff_replay = _fork_diff_replay;
+   _fork_diff_replay = false;
+   if( rewind && !_replay_stopped_early )
    {
       try
       {
@@ -173,14 +736,56 @@ void database::close(bool rewind)
    // we have to clear_pending() after we're done popping to get a clean
    // DB state (issue #336).
    clear_pending();
+   _fork_diff_replay = fork_diff_replay;
 
-   object_database::flush();
+   if( _pending_checkpoint_num != 0 )
+   {
+      try
+      {
+         finish_state_checkpoint();
+      }
+      catch( const fc::exception& e )
+      {
+         elog( "State checkpoint failed: ${e}", ("e",e.to_detail_string()) );
+      }
+   }
+
+   if( _flush_pending )
+   {
+      try
+      {
+         finish_background_flush();
+      }
+      catch( const fc::exception& e )
+      {
+         elog( "Background flush failed: ${e}", ("e",e.to_detail_string()) );
+      }
+   }
+   fc::remove_all( flushed_state_info( get_data_dir() ) );
+
+   // a replay stopped before the end of the block log left the state below the blocks it holds, saving it would
+   // have the next start take it for the head; the state was wiped for the replay, so the next start replays again
+   if( _replay_stopped_early )
+      wlog( "The replay stopped at block ${n} before the end of the block log, not saving the state",
+            ("n",head_block_num()) );
+   else
+   {
+      object_database::flush();
+      _recent_transactions.save( get_data_dir() / "object_database" / "recent_transactions" );
+      _block_summaries.save( get_data_dir() / "object_database" / "block_summaries" );
+   }
    object_database::close();
+   _recent_transactions.clear();
+   _block_summaries.clear();
 
    if( _block_id_to_block.is_open() )
       _block_id_to_block.close();
 
    _fork_db.reset();
+   _recent_block_ids.clear();
+   _popped_blocks.clear();
+   _reversible_applied_ops.clear();
+   _fork_block_checks.clear();
 }
 
 } }
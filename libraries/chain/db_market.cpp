@@ -27,6 +27,7 @@
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/hardfork.hpp>
+#include <graphene/chain/is_authorized_asset.hpp>
 #include <graphene/chain/market_object.hpp>
 
 #include <fc/uint128.hpp>
@@ -49,13 +50,13 @@ void database::globally_settle_asset( const asset_object& mia, const price& sett
    edump( (mia.symbol)(settlement_price) );
    */
 
-   const asset_bitasset_data_object& bitasset = mia.bitasset_data(*this);
+   const asset_bitasset_data_object& bitasset = get_bitasset_data( mia );
    FC_ASSERT( !bitasset.has_settlement(), "black swan already occurred, it should not happen again" );
 
-   const asset_object& backing_asset = bitasset.options.short_backing_asset(*this);
+   const asset_object& backing_asset = get_asset( bitasset.options.short_backing_asset );
    asset collateral_gathered = backing_asset.amount(0);
 
-   const asset_dynamic_data_object& mia_dyn = mia.dynamic_asset_data_id(*this);
+   const asset_dynamic_data_object& mia_dyn = get_dynamic_data( mia );
    auto original_mia_supply = mia_dyn.current_supply;
 
    const call_order_index& call_index = get_index_type<call_order_index>();
@@ -167,24 +168,31 @@ bool database::apply_order(const limit_order_object& new_order_object, bool allo
    if( called_some && !find_object(order_id) ) // then we were filled by call order
       return true;
 
-   const auto& limit_price_idx = get_index_type<limit_order_index>().indices().get<by_price>();
+   // the orders the new one can fill, best first, are those of the other side of the market down to its price;
+   // matching only goes on after the best one was filled, so the next is always the best one left
+   const auto& books = limit_order_books();
+   const auto max_price = ~new_order_object.sell_price;
+   auto matches = [&]() -> const limit_order_object* {
+      const limit_order_object* best = books.first( max_price.base.asset_id, max_price.quote.asset_id );
+      return best != nullptr && !( best->sell_price < max_price ) ? best : nullptr;
+   };
 
-   // TODO: it should be possible to simply check the NEXT/PREV iterator after new_order_object to
-   // determine whether or not this order has "changed the book" in a way that requires us to
-   // check orders. For now I just lookup the lower bound and check for equality... this is log(n) vs
-   // constant time check. Potential optimization.
-
-   auto max_price = ~new_order_object.sell_price;
-   auto limit_itr = limit_price_idx.lower_bound(max_price.max());
-   auto limit_end = limit_price_idx.upper_bound(max_price);
-
-   bool finished = false;
-   while( !finished && limit_itr != limit_end )
+   if( matches() != nullptr )
    {
-      auto old_limit_itr = limit_itr;
-      ++limit_itr;
-      // match returns 2 when only the old order was fully filled. In this case, we keep matching; otherwise, we stop.
-      finished = (match(new_order_object, *old_limit_itr, old_limit_itr->sell_price) != 2);
+      _fill_batch.reset( new fill_batch );
+      try {
+         bool finished = false;
+         const limit_order_object* maker = nullptr;
+         while( !finished && ( maker = matches() ) != nullptr )
+         {
+            // match returns 2 when only the old order was fully filled. In this case, we keep matching; otherwise, we stop.
+            finished = (match(new_order_object, *maker, maker->sell_price) != 2);
+         }
+      } catch( ... ) {
+         _fill_batch.reset();
+         throw;
+      }
+      apply_fill_batch();
    }
 
    //Possible optimization: only check calls if the new order completely filled some old order
@@ -203,6 +211,135 @@ bool database::apply_order(const limit_order_object& new_order_object, bool allo
    return maybe_cull_small_order( *this, *updated_order_object );
 }
 
+bool database::sweep_book( const account_object& seller, const asset& amount_to_sell, const asset_object& receive_asset )
+{
+   const asset_object& sell_asset = get_asset( amount_to_sell.asset_id );
+
+   // before #555 the order was culled after its first partial fill, and an order selling a market issued asset for
+   // its collateral or buying it with it can be margin called, either needs the order in the book
+   if( head_block_time() <= HARDFORK_555_TIME )
+      return false;
+   if( sell_asset.is_market_issued() &&
+       get_bitasset_data( sell_asset ).options.short_backing_asset == receive_asset.id )
+      return false;
+   if( receive_asset.is_market_issued() &&
+       get_bitasset_data( receive_asset ).options.short_backing_asset == sell_asset.id )
+      return false;
+
+   // what limit_order_create_evaluator checks
+   if( sell_asset.options.whitelist_markets.size() )
+      FC_ASSERT( sell_asset.options.whitelist_markets.find(receive_asset.id) != sell_asset.options.whitelist_markets.end() );
+   if( sell_asset.options.blacklist_markets.size() )
+      FC_ASSERT( sell_asset.options.blacklist_markets.find(receive_asset.id) == sell_asset.options.blacklist_markets.end() );
+   FC_ASSERT( is_authorized_asset( *this, seller, sell_asset ) );
+   FC_ASSERT( is_authorized_asset( *this, seller, receive_asset ) );
+   FC_ASSERT( get_balance( seller, sell_asset ) >= amount_to_sell, "insufficient balance",
+              ("balance",get_balance(seller,sell_asset))("amount_to_sell",amount_to_sell) );
+
+   limit_order_create_operation create_op;
+   create_op.fee = asset( 0, asset_id_type() );
+   create_op.seller = seller.id;
+   create_op.amount_to_sell = amount_to_sell;
+   create_op.min_to_receive = asset( 1, receive_asset.id );
+   create_op.expiration = time_point_sec::maximum();
+   create_op.fill_or_kill = false;
+   const price sell_price = create_op.get_price();
+
+   // the order is reported, and its id used up, as if it had been created
+   auto create_op_id = push_applied_operation( create_op );
+   limit_order_id_type order_id = use_next_id<limit_order_object>();
+
+   check_call_orders( sell_asset );
+   check_call_orders( receive_asset );
+
+   // as in apply_order(), the sweep only goes on after filling the best order
+   const auto& books = limit_order_books();
+   const auto max_price = ~sell_price;
+   auto matches = [&]() -> const limit_order_object* {
+      const limit_order_object* best = books.first( max_price.base.asset_id, max_price.quote.asset_id );
+      return best != nullptr && !( best->sell_price < max_price ) ? best : nullptr;
+   };
+
+   asset for_sale = amount_to_sell;
+   if( matches() != nullptr )
+   {
+      _fill_batch.reset( new fill_batch );
+      try {
+         while( const limit_order_object* best = matches() )
+         {
+            const limit_order_object& maker = *best;
+
+            // match() with the order as the bid...
+            const price& match_price = maker.sell_price;
+            asset pays, receives;
+            if( for_sale <= maker.amount_for_sale() * match_price )
+            {
+               pays = for_sale;
+               receives = for_sale * match_price;
+            }
+            else
+            {
+               receives = maker.amount_for_sale();
+               pays = receives * match_price;
+            }
+
+            // ...and fill_order() on its side of the trade, which pay_order() would also debit the order total of
+            auto issuer_fees = pay_market_fees( receive_asset, receives );
+            asset received = receives - issuer_fees;
+            if( received.amount > 0 )
+            {
+               auto key = std::make_pair( seller.id, receive_asset.id );
+               auto itr = _fill_batch->balances.find( key );
+               if( itr != _fill_batch->balances.end() )
+                  itr->second += received.amount;
+               else if( _balances_by_account->find( seller.id, receive_asset.id ) == nullptr )
+                  adjust_balance( seller.id, received );
+               else
+                  _fill_batch->balances.emplace( key, received.amount );
+            }
+            push_applied_operation( fill_order_operation( order_id, seller.id, pays, receives, issuer_fees ) );
+            for_sale -= pays;
+
+            bool maker_filled = fill_order( maker, receives, pays, true );
+            if( for_sale.amount == 0 || !maker_filled )
+               break;
+         }
+      } catch( ... ) {
+         _fill_batch.reset();
+         throw;
+      }
+      apply_fill_batch();
+   }
+   adjust_balance( seller.id, -( amount_to_sell - for_sale ) );
+   set_applied_operation_result( create_op_id, object_id_type( order_id ) );
+
+   check_call_orders( sell_asset );
+   check_call_orders( receive_asset );
+
+   if( for_sale.amount == 0 )
+      return true;
+   if( ( for_sale * sell_price ).amount == 0 )
+   {
+      // the rest is culled by maybe_cull_small_order()
+      limit_order_cancel_operation vop;
+      vop.order = order_id;
+      vop.fee_paying_account = seller.id;
+      push_applied_operation( vop );
+      return true;
+   }
+
+   // the buyback cancels the rest
+   limit_order_cancel_operation cancel_op;
+   cancel_op.fee = asset( 0, asset_id_type() );
+   cancel_op.order = order_id;
+   cancel_op.fee_paying_account = seller.id;
+   auto cancel_op_id = push_applied_operation( cancel_op );
+   set_applied_operation_result( cancel_op_id, for_sale );
+   check_call_orders( sell_asset );
+   check_call_orders( receive_asset );
+   return true;
+}
+
 /**
  *  Matches the two orders,
  *
@@ -300,7 +437,7 @@ bool database::fill_order( const limit_order_object& order, const asset& pays, c
    FC_ASSERT( pays.asset_id != receives.asset_id );
 
    const account_object& seller = order.seller(*this);
-   const asset_object& recv_asset = receives.asset_id(*this);
+   const asset_object& recv_asset = get_asset( receives.asset_id );
 
    auto issuer_fees = pay_market_fees( recv_asset, receives );
    pay_order( seller, receives - issuer_fees, pays );
@@ -352,10 +489,10 @@ bool database::fill_order( const call_order_object& order, const asset& pays, co
               o.collateral = 0;
             }
        });
-   const asset_object& mia = receives.asset_id(*this);
+   const asset_object& mia = get_asset( receives.asset_id );
    assert( mia.is_market_issued() );
 
-   const asset_dynamic_data_object& mia_ddo = mia.dynamic_asset_data_id(*this);
+   const asset_dynamic_data_object& mia_ddo = get_dynamic_data( mia );
 
    modify( mia_ddo, [&]( asset_dynamic_data_object& ao ){
        //idump((receives));
@@ -392,7 +529,7 @@ bool database::fill_order(const force_settlement_object& settle, const asset& pa
 { try {
    bool filled = false;
 
-   auto issuer_fees = pay_market_fees(get(receives.asset_id), receives);
+   auto issuer_fees = pay_market_fees(get_asset(receives.asset_id), receives);
 
    if( pays < settle.balance )
    {
@@ -414,6 +551,46 @@ bool database::fill_order(const force_settlement_object& settle, const asset& pa
    return filled;
 } FC_CAPTURE_AND_RETHROW( (settle)(pays)(receives) ) }
 
+/**
+ *  The least collateralized position is the first of its asset in call_order_index::by_price, which is kept up to date
+ *  as call orders change, so this only takes that one and the best bid.  It returns false when the position is neither
+ *  swanned by the feed and the bid nor margin called by the bid, which is when check_for_blackswan() and one pass
+ *  of check_call_orders() would do nothing.
+ */
+bool database::margin_call_possible( const asset_object& mia )const
+{
+    const asset_bitasset_data_object& bitasset = get_bitasset_data( mia );
+    if( bitasset.has_settlement() )
+       return false;
+    const price& settle_price = bitasset.current_feed.settlement_price;
+    if( settle_price.is_null() )
+       return false;
+    const asset_id_type backing = bitasset.options.short_backing_asset;
+
+    const auto& call_price_index = get_index_type<call_order_index>().indices().get<by_price>();
+    auto call_itr = call_price_index.lower_bound( price::min( backing, mia.id ) );
+    if( call_itr == call_price_index.end() || call_itr->call_price.base.asset_id != backing
+        || call_itr->call_price.quote.asset_id != mia.id )
+       return false;
+
+    const limit_order_object* limit_itr = limit_order_books().first( mia.id, backing );
+    const bool has_bid = limit_itr != nullptr;
+
+    price highest = settle_price;
+    if( has_bid )
+       highest = std::max( limit_itr->sell_price, settle_price );
+    if( ~call_itr->collateralization() >= highest )
+       return true;
+
+    if( bitasset.is_prediction_market )
+       return false;
+    if( !has_bid || limit_itr->sell_price < bitasset.current_feed.max_short_squeeze_price() )
+       return false;
+    if( settle_price > ~call_itr->call_price && head_block_time() > HARDFORK_436_TIME )
+       return false;
+    return !( limit_itr->sell_price > ~call_itr->call_price );
+}
+
 /**
  *  Starting with the least collateralized orders, fill them if their
  *  call price is above the max(lowest bid,call_limit).
@@ -430,30 +607,31 @@ bool database::check_call_orders(const asset_object& mia, bool enable_black_swan
 { try {
     if( !mia.is_market_issued() ) return false;
 
+    if( !margin_call_possible( mia ) )
+       return false;
+
     if( check_for_blackswan( mia, enable_black_swan ) ) 
        return false;
 
-    const asset_bitasset_data_object& bitasset = mia.bitasset_data(*this);
+    const asset_bitasset_data_object& bitasset = get_bitasset_data( mia );
     if( bitasset.is_prediction_market ) return false;
     if( bitasset.current_feed.settlement_price.is_null() ) return false;
 
     const call_order_index& call_index = get_index_type<call_order_index>();
     const auto& call_price_index = call_index.indices().get<by_price>();
 
-    const limit_order_index& limit_index = get_index_type<limit_order_index>();
-    const auto& limit_price_index = limit_index.indices().get<by_price>();
+    const limit_order_match_index& books = limit_order_books();
 
-    // looking for limit orders selling the most USD for the least CORE
+    // looking for limit orders selling the most USD for the least CORE, starting with the best
     auto max_price = price::max( mia.id, bitasset.options.short_backing_asset );
     // stop when limit orders are selling too little USD for too much CORE
     auto min_price = bitasset.current_feed.max_short_squeeze_price();
 
     assert( max_price.base.asset_id == min_price.base.asset_id );
-    // NOTE limit_price_index is sorted from greatest to least
-    auto limit_itr = limit_price_index.lower_bound( max_price );
-    auto limit_end = limit_price_index.upper_bound( min_price );
+    auto in_range = [&]( const limit_order_object* o ) { return o != nullptr && !( o->sell_price < min_price ); };
+    const limit_order_object* limit_itr = books.first( max_price.base.asset_id, max_price.quote.asset_id );
 
-    if( limit_itr == limit_end )
+    if( !in_range( limit_itr ) )
        return false;
 
     auto call_min = price::min( bitasset.options.short_backing_asset, mia.id );
@@ -469,9 +647,8 @@ bool database::check_call_orders(const asset_object& mia, bool enable_black_swan
        bool  filled_call      = false;
        price match_price;
        asset usd_for_sale;
-       if( limit_itr != limit_end )
+       if( in_range( limit_itr ) )
        {
-          assert( limit_itr != limit_price_index.end() );
           match_price      = limit_itr->sell_price;
           usd_for_sale     = limit_itr->amount_for_sale();
        }
@@ -538,7 +715,10 @@ bool database::check_call_orders(const asset_object& mia, bool enable_black_swan
        if( filled_call ) ++call_itr;
        fill_order(*old_call_itr, call_pays, call_receives);
 
-       auto old_limit_itr = filled_limit ? limit_itr++ : limit_itr;
+       // filled_limit stays set, from the first order filled on every round moves on to the next order
+       const limit_order_object* old_limit_itr = limit_itr;
+       if( filled_limit )
+          limit_itr = books.next( *old_limit_itr );
        fill_order(*old_limit_itr, order_pays, order_receives, true);
 
     } // whlie call_itr != call_end
@@ -548,6 +728,27 @@ bool database::check_call_orders(const asset_object& mia, bool enable_black_swan
 
 void database::pay_order( const account_object& receiver, const asset& receives, const asset& pays )
 {
+   if( _fill_batch )
+   {
+      if( pays.asset_id == asset_id_type() )
+         _fill_batch->core_in_orders[ receiver.get_id() ] += pays.amount;
+      if( receives.amount == 0 )
+         return;
+      auto key = std::make_pair( receiver.get_id(), receives.asset_id );
+      auto itr = _fill_batch->balances.find( key );
+      if( itr != _fill_batch->balances.end() )
+         itr->second += receives.amount;
+      else
+      {
+         // a new balance object is created right away, so that it gets the same id as without the batch
+         if( _balances_by_account->find( key.first, key.second ) == nullptr )
+            adjust_balance( key.first, receives );
+         else
+            _fill_batch->balances.emplace( key, receives.amount );
+      }
+      return;
+   }
+
    const auto& balances = receiver.statistics(*this);
    modify( balances, [&]( account_statistics_object& b ){
          if( pays.asset_id == asset_id_type() )
@@ -558,6 +759,21 @@ void database::pay_order( const account_object& receiver, const asset& receives,
    adjust_balance(receiver.get_id(), receives);
 }
 
+void database::apply_fill_batch()
+{
+   std::unique_ptr<fill_batch> batch = std::move( _fill_batch );
+   for( const auto& item : batch->balances )
+      adjust_balance( item.first.first, asset( item.second, item.first.second ) );
+   for( const auto& item : batch->core_in_orders )
+      modify( item.first(*this).statistics(*this), [&]( account_statistics_object& b ){
+         b.total_core_in_orders -= item.second;
+      });
+   for( const auto& item : batch->market_fees )
+      modify( get_dynamic_data( get_asset( item.first ) ), [&]( asset_dynamic_data_object& obj ){
+         obj.accumulated_fees += item.second;
+      });
+}
+
 asset database::calculate_market_fee( const asset_object& trade_asset, const asset& trade_amount )
 {
    assert( trade_asset.id == trade_amount.asset_id );
@@ -584,9 +800,11 @@ asset database::pay_market_fees( const asset_object& recv_asset, const asset& re
    assert(issuer_fees <= receives );
 
    //Don't dirty undo state if not actually collecting any fees
-   if( issuer_fees.amount > 0 )
+   if( issuer_fees.amount > 0 && _fill_batch )
+      _fill_batch->market_fees[ recv_asset.id ] += issuer_fees.amount;
+   else if( issuer_fees.amount > 0 )
    {
-      const auto& recv_dyn_data = recv_asset.dynamic_asset_data_id(*this);
+      const auto& recv_dyn_data = get_dynamic_data( recv_asset );
       modify( recv_dyn_data, [&]( asset_dynamic_data_object& obj ){
                    //idump((issuer_fees));
          obj.accumulated_fees += issuer_fees.amount;
@@ -30,9 +30,9 @@
 #include <graphene/chain/hardfork.hpp>
 #include <graphene/chain/market_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
-#include <graphene/chain/transaction_object.hpp>
 #include <graphene/chain/withdraw_permission_object.hpp>
 #include <graphene/chain/witness_object.hpp>
+#include <graphene/chain/witness_schedule_object.hpp>
 
 #include <graphene/chain/protocol/fee_schedule.hpp>
 
@@ -48,19 +48,23 @@ void database::update_global_dynamic_data( const signed_block& b )
    uint32_t missed_blocks = get_slot_at_time( b.timestamp );
    assert( missed_blocks != 0 );
    missed_blocks--;
-   for( uint32_t i = 0; i < missed_blocks; ++i ) {
-      const auto& witness_missed = get_scheduled_witness( i+1 )(*this);
-      if(  witness_missed.id != b.witness ) {
-         /*
-         const auto& witness_account = witness_missed.witness_account(*this);
-         if( (fc::time_point::now() - b.timestamp) < fc::seconds(30) )
-            wlog( "Witness ${name} missed block ${n} around ${t}", ("name",witness_account.name)("n",b.block_num())("t",b.timestamp) );
-            */
-
-         modify( witness_missed, [&]( witness_object& w ) {
-           w.total_missed++;
+   if( missed_blocks > 0 )
+   {
+      // the schedule repeats every round, so the witness k slots after the head missed the slots k, k + n, k + 2n
+      // and so on, all of them counted in one modify however many rounds were missed
+      const auto& shuffled = witness_schedule_id_type()(*this).current_shuffled_witnesses;
+      const uint64_t n = shuffled.size();
+      const uint64_t first_aslot = _dgp.current_aslot + 1;
+      for( uint64_t k = 0; k < std::min<uint64_t>( n, missed_blocks ); ++k )
+      {
+         const witness_id_type missed_id = shuffled[ (first_aslot + k) % n ];
+         if( missed_id == b.witness )
+            continue;
+         const int64_t missed = missed_blocks / n + ( k < missed_blocks % n ? 1 : 0 );
+         modify( missed_id(*this), [&]( witness_object& w ) {
+           w.total_missed += missed;
          });
-      } 
+      }
    }
 
    // dynamic global properties updating
@@ -123,13 +127,10 @@ void database::update_signing_witness(const witness_object& signing_witness, con
 
 void database::update_last_irreversible_block()
 {
-   const global_property_object& gpo = get_global_properties();
    const dynamic_global_property_object& dpo = get_dynamic_global_properties();
 
-   vector< const witness_object* > wit_objs;
-   wit_objs.reserve( gpo.active_witnesses.size() );
-   for( const witness_id_type& wid : gpo.active_witnesses )
-      wit_objs.push_back( &(wid(*this)) );
+   vector< const witness_object* >& wit_objs = _irreversible_witness_objs;
+   wit_objs = active_witness_objects();
 
    static_assert( GRAPHENE_IRREVERSIBLE_THRESHOLD > 0, "irreversible threshold must be nonzero" );
 
@@ -153,17 +154,35 @@ void database::update_last_irreversible_block()
       {
          _dpo.last_irreversible_block_num = new_last_irreversible_block_num;
       } );
+
+      if( _block_log_retain_blocks > 0 && new_last_irreversible_block_num > _block_log_retain_blocks )
+         _block_id_to_block.prune_below( new_last_irreversible_block_num - _block_log_retain_blocks );
+      if( _block_id_to_block.get_flush_policy().flush_on_irreversible )
+         _block_id_to_block.flush();
+   }
+}
+
+const vector<const witness_object*>& database::active_witness_objects()
+{
+   const global_property_object& gpo = get_global_properties();
+   if( _active_witness_nodes != _witness_nodes->changes() || _active_witness_ids != gpo.active_witnesses ||
+       _active_witness_objs.size() != gpo.active_witnesses.size() )
+   {
+      _active_witness_objs.clear();
+      _active_witness_objs.reserve( gpo.active_witnesses.size() );
+      for( const witness_id_type& wid : gpo.active_witnesses )
+         _active_witness_objs.push_back( &(wid(*this)) );
+      _active_witness_ids = gpo.active_witnesses;
+      _active_witness_nodes = _witness_nodes->changes();
    }
+   return _active_witness_objs;
 }
 
 void database::clear_expired_transactions()
 { try {
    //Look for expired transactions in the deduplication list, and remove them.
    //Transactions must have expired by at least two forking windows in order to be removed.
-   auto& transaction_idx = static_cast<transaction_index&>(get_mutable_index(implementation_ids, impl_transaction_object_type));
-   const auto& dedupe_index = transaction_idx.indices().get<by_expiration>();
-   while( (!dedupe_index.empty()) && (head_block_time() > dedupe_index.rbegin()->trx.expiration) )
-      transaction_idx.remove(*dedupe_index.rbegin());
+   _recent_transactions.remove_expired( head_block_time() );
 } FC_CAPTURE_AND_RETHROW() }
 
 void database::clear_expired_proposals()
@@ -209,18 +228,8 @@ bool database::check_for_blackswan( const asset_object& mia, bool enable_black_s
     const call_order_index& call_index = get_index_type<call_order_index>();
     const auto& call_price_index = call_index.indices().get<by_price>();
 
-    const limit_order_index& limit_index = get_index_type<limit_order_index>();
-    const auto& limit_price_index = limit_index.indices().get<by_price>();
-
-    // looking for limit orders selling the most USD for the least CORE
-    auto highest_possible_bid = price::max( mia.id, bitasset.options.short_backing_asset );
-    // stop when limit orders are selling too little USD for too much CORE
-    auto lowest_possible_bid  = price::min( mia.id, bitasset.options.short_backing_asset );
-
-    assert( highest_possible_bid.base.asset_id == lowest_possible_bid.base.asset_id );
-    // NOTE limit_price_index is sorted from greatest to least
-    auto limit_itr = limit_price_index.lower_bound( highest_possible_bid );
-    auto limit_end = limit_price_index.upper_bound( lowest_possible_bid );
+    // the limit order selling the most USD for the least CORE
+    const limit_order_object* best_bid = limit_order_books().first( mia.id, bitasset.options.short_backing_asset );
 
     auto call_min = price::min( bitasset.options.short_backing_asset, mia.id );
     auto call_max = price::max( bitasset.options.short_backing_asset, mia.id );
@@ -230,9 +239,9 @@ bool database::check_for_blackswan( const asset_object& mia, bool enable_black_s
     if( call_itr == call_end ) return false;  // no call orders
 
     price highest = settle_price;
-    if( limit_itr != limit_end ) {
-       assert( settle_price.base.asset_id == limit_itr->sell_price.base.asset_id );
-       highest = std::max( limit_itr->sell_price, settle_price );
+    if( best_bid != nullptr ) {
+       assert( settle_price.base.asset_id == best_bid->sell_price.base.asset_id );
+       highest = std::max( best_bid->sell_price, settle_price );
     }
 
     auto least_collateral = call_itr->collateralization();
@@ -256,81 +265,61 @@ bool database::check_for_blackswan( const asset_object& mia, bool enable_black_s
 
 void database::clear_expired_orders()
 { try {
+   const fc::time_point_sec now = head_block_time();
+
    detail::with_skip_flags( *this,
       get_node_properties().skip_flags | skip_authority_check, [&](){
          transaction_evaluation_state cancel_context(this);
+         // we know the fee for this op is set correctly since it is set by the chain.
+         // this allows us to avoid a hung chain:
+         // - if #549 case below triggers
+         // - if the fee is incorrect, which may happen due to #435 (although since cancel is a fixed-fee op, it shouldn't)
+         cancel_context.skip_fee_schedule_check = true;
+         // cancel is a fixed-fee op, so the fee is the same for every order
+         const asset cancel_fee = current_fee_schedule().calculate_fee( limit_order_cancel_operation() );
 
          //Cancel expired limit orders
+         // each one still goes through the evaluator, since the margin calls it checks for depend on the
+         // orders canceled before it
          auto& limit_index = get_index_type<limit_order_index>().indices().get<by_expiration>();
-         while( !limit_index.empty() && limit_index.begin()->expiration <= head_block_time() )
+         while( !limit_index.empty() && limit_index.begin()->expiration <= now )
          {
             limit_order_cancel_operation canceler;
             const limit_order_object& order = *limit_index.begin();
             canceler.fee_paying_account = order.seller;
             canceler.order = order.id;
-            canceler.fee = current_fee_schedule().calculate_fee( canceler );
+            canceler.fee = cancel_fee;
             if( canceler.fee.amount > order.deferred_fee )
             {
                // Cap auto-cancel fees at deferred_fee; see #549
                wlog( "At block ${b}, fee for clearing expired order ${oid} was capped at deferred_fee ${fee}", ("b", head_block_num())("oid", order.id)("fee", order.deferred_fee) );
                canceler.fee = asset( order.deferred_fee, asset_id_type() );
             }
-            // we know the fee for this op is set correctly since it is set by the chain.
-            // this allows us to avoid a hung chain:
-            // - if #549 case above triggers
-            // - if the fee is incorrect, which may happen due to #435 (although since cancel is a fixed-fee op, it shouldn't)
-            cancel_context.skip_fee_schedule_check = true;
             apply_operation(cancel_context, canceler);
          }
      });
 
    //Process expired force settlement orders
+   // They are sorted by asset and then by settlement date, so each asset is handled in one pass: its state is
+   // looked up once, and its settled volume is written once at the end.
    auto& settlement_index = get_index_type<force_settlement_index>().indices().get<by_expiration>();
-   if( !settlement_index.empty() )
+   auto& call_index = get_index_type<call_order_index>().indices().get<by_collateral>();
+   for( auto asset_itr = settlement_index.begin(); asset_itr != settlement_index.end(); )
    {
-      asset_id_type current_asset = settlement_index.begin()->settlement_asset_id();
-      asset max_settlement_volume;
-      bool extra_dump = false;
-
-      auto next_asset = [&current_asset, &settlement_index, &extra_dump] {
-         auto bound = settlement_index.upper_bound(current_asset);
-         if( bound == settlement_index.end() )
-         {
-            if( extra_dump )
-            {
-               ilog( "next_asset() returning false" );
-            }
-            return false;
-         }
-         if( extra_dump )
-         {
-            ilog( "next_asset returning true, bound is ${b}", ("b", *bound) );
-         }
-         current_asset = bound->settlement_asset_id();
-         return true;
-      };
-
-      uint32_t count = 0;
+      const asset_id_type current_asset = asset_itr->settlement_asset_id();
+      const asset_object& mia_object = get(current_asset);
+      const asset_bitasset_data_object& mia = mia_object.bitasset_data(*this);
+      const price call_min = price::min( mia.options.short_backing_asset, current_asset );
+      // only computed once an order is ready to settle, like before, as settling reduces the supply
+      optional<asset> max_settlement_volume;
+      asset settled = mia_object.amount(mia.force_settled_volume);
 
       // At each iteration, we either consume the current order and remove it, or we move to the next asset
       for( auto itr = settlement_index.lower_bound(current_asset);
-           itr != settlement_index.end();
+           itr != settlement_index.end() && itr->settlement_asset_id() == current_asset;
            itr = settlement_index.lower_bound(current_asset) )
       {
-         ++count;
          const force_settlement_object& order = *itr;
-         auto order_id = order.id;
-         current_asset = order.settlement_asset_id();
-         const asset_object& mia_object = get(current_asset);
-         const asset_bitasset_data_object& mia = mia_object.bitasset_data(*this);
-
-         extra_dump = ((count >= 1000) && (count <= 1020));
-
-         if( extra_dump )
-         {
-            wlog( "clear_expired_orders() dumping extra data for iteration ${c}", ("c", count) );
-            ilog( "head_block_num is ${hb} current_asset is ${a}", ("hb", head_block_num())("a", current_asset) );
-         }
 
          if( mia.has_settlement() )
          {
@@ -339,19 +328,9 @@ void database::clear_expired_orders()
             continue;
          }
 
-         // Has this order not reached its settlement date?
-         if( order.settlement_date > head_block_time() )
-         {
-            if( next_asset() )
-            {
-               if( extra_dump )
-               {
-                  ilog( "next_asset() returned true when order.settlement_date > head_block_time()" );
-               }
-               continue;
-            }
+         // Has this order not reached its settlement date?  Then neither have the later ones.
+         if( order.settlement_date > now )
             break;
-         }
          // Can we still settle in this asset?
          if( mia.current_feed.settlement_price.is_null() )
          {
@@ -360,25 +339,10 @@ void database::clear_expired_orders()
             cancel_order(order);
             continue;
          }
-         if( max_settlement_volume.asset_id != current_asset )
+         if( !max_settlement_volume )
             max_settlement_volume = mia_object.amount(mia.max_force_settlement_volume(mia_object.dynamic_data(*this).current_supply));
-         if( mia.force_settled_volume >= max_settlement_volume.amount )
-         {
-            /*
-            ilog("Skipping force settlement in ${asset}; settled ${settled_volume} / ${max_volume}",
-                 ("asset", mia_object.symbol)("settlement_price_null",mia.current_feed.settlement_price.is_null())
-                 ("settled_volume", mia.force_settled_volume)("max_volume", max_settlement_volume));
-                 */
-            if( next_asset() )
-            {
-               if( extra_dump )
-               {
-                  ilog( "next_asset() returned true when mia.force_settled_volume >= max_settlement_volume.amount" );
-               }
-               continue;
-            }
+         if( settled >= *max_settlement_volume )
             break;
-         }
 
          auto& pays = order.balance;
          auto receives = (order.balance * mia.current_feed.settlement_price);
@@ -388,16 +352,14 @@ void database::clear_expired_orders()
 
          price settlement_price = pays / receives;
 
-         auto& call_index = get_index_type<call_order_index>().indices().get<by_collateral>();
-         asset settled = mia_object.amount(mia.force_settled_volume);
          // Match against the least collateralized short until the settlement is finished or we reach max settlements
-         while( settled < max_settlement_volume && find_object(order_id) )
+         bool order_filled = false;
+         while( settled < *max_settlement_volume && !order_filled )
          {
-            auto itr = call_index.lower_bound(boost::make_tuple(price::min(mia_object.bitasset_data(*this).options.short_backing_asset,
-                                                                           mia_object.get_id())));
+            auto call_itr = call_index.lower_bound(boost::make_tuple(call_min));
             // There should always be a call order, since asset exists!
-            assert(itr != call_index.end() && itr->debt_type() == mia_object.get_id());
-            asset max_settlement = max_settlement_volume - settled;
+            assert(call_itr != call_index.end() && call_itr->debt_type() == current_asset);
+            asset max_settlement = *max_settlement_volume - settled;
 
             if( order.balance.amount == 0 )
             {
@@ -406,7 +368,11 @@ void database::clear_expired_orders()
                break;
             }
             try {
-               settled += match(*itr, order, settlement_price, max_settlement);
+               // the settlement is removed once all of its balance is matched
+               const asset balance = order.balance;
+               const asset matched = match(*call_itr, order, settlement_price, max_settlement);
+               settled += matched;
+               order_filled = ( matched == balance );
             } 
             catch ( const black_swan_exception& e ) { 
                wlog( "black swan detected: ${e}", ("e", e.to_detail_string() ) );
@@ -414,32 +380,30 @@ void database::clear_expired_orders()
                break;
             }
          }
-         if( mia.force_settled_volume != settled.amount )
-         {
-            modify(mia, [settled](asset_bitasset_data_object& b) {
-               b.force_settled_volume = settled.amount;
-            });
-         }
       }
+
+      if( mia.force_settled_volume != settled.amount )
+      {
+         modify(mia, [&settled](asset_bitasset_data_object& b) {
+            b.force_settled_volume = settled.amount;
+         });
+      }
+      asset_itr = settlement_index.upper_bound(current_asset);
    }
 } FC_CAPTURE_AND_RETHROW() }
 
 void database::update_expired_feeds()
 {
-   auto& asset_idx = get_index_type<asset_index>().indices().get<by_type>();
-   auto itr = asset_idx.lower_bound( true /** market issued */ );
-   while( itr != asset_idx.end() )
-   {
-      const asset_object& a = *itr;
-      ++itr;
+   const fc::time_point_sec now = head_block_time();
+   auto update = [&]( const asset_object& a ) {
       assert( a.is_market_issued() );
 
       const asset_bitasset_data_object& b = a.bitasset_data(*this);
       bool feed_is_expired;
-      if( head_block_time() < HARDFORK_615_TIME )
-         feed_is_expired = b.feed_is_expired_before_hardfork_615( head_block_time() );
+      if( now < HARDFORK_615_TIME )
+         feed_is_expired = b.feed_is_expired_before_hardfork_615( now );
       else
-         feed_is_expired = b.feed_is_expired( head_block_time() );
+         feed_is_expired = b.feed_is_expired( now );
       if( feed_is_expired )
       {
          modify(b, [this](asset_bitasset_data_object& a) {
@@ -452,7 +416,38 @@ void database::update_expired_feeds()
          modify(a, [&b](asset_object& a) {
             a.options.core_exchange_rate = b.current_feed.core_exchange_rate;
          });
+   };
+
+   // the changes noted from here on are for the next block
+   flat_set<asset_bitasset_data_id_type> changed;
+   changed.swap( _bitasset_feeds->changed );
+   changed.insert( _asset_feeds->changed.begin(), _asset_feeds->changed.end() );
+   _asset_feeds->changed.clear();
+
+   if( now < HARDFORK_615_TIME )
+   {
+      // every feed which has not expired counts as expired
+      auto& asset_idx = get_index_type<asset_index>().indices().get<by_type>();
+      auto itr = asset_idx.lower_bound( true /** market issued */ );
+      while( itr != asset_idx.end() )
+         update( *itr++ );
+      return;
+   }
+
+   // the rest can only have to copy a core exchange rate if they or their feeds changed
+   std::set<asset_id_type> assets;
+   for( auto bucket = _bitasset_feeds->by_feed_expiration.begin();
+        bucket != _bitasset_feeds->by_feed_expiration.end() && bucket->first <= now; ++bucket )
+      changed.insert( bucket->second.begin(), bucket->second.end() );
+   for( const auto& id : changed )
+   {
+      auto itr = _asset_feeds->assets.find( id );
+      if( itr != _asset_feeds->assets.end() )
+         assets.insert( itr->second );
    }
+   // in the order of the assets, like updating all of them would
+   for( const auto& id : assets )
+      update( id(*this) );
 }
 
 void database::update_maintenance_flag( bool new_maintenance_flag )
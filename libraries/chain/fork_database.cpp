@@ -26,172 +26,231 @@
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <fc/smart_ref_impl.hpp>
 
+#include <algorithm>
+
 namespace graphene { namespace chain {
 fork_database::fork_database()
 {
+   resize_ring( _max_size + 2 );
 }
 void fork_database::reset()
 {
-   _head.reset();
-   _index.clear();
+   _head = nullptr;
+   _items.clear();
+   _free_slots.clear();
+   for( auto& slots : _by_num )
+      slots.clear();
+   _lowest_num = 0;
+   _highest_num = 0;
 }
 
 void fork_database::pop_block()
 {
    FC_ASSERT( _head, "no blocks to pop" );
-   auto prev = _head->prev.lock();
-   FC_ASSERT( prev, "poping block would leave head block null" );
-    _head = prev;
+   auto p = prev( _head );
+   FC_ASSERT( p, "poping block would leave head block null" );
+    _head = p;
 }
 
 void     fork_database::start_block(signed_block b)
 {
-   auto item = std::make_shared<fork_item>(std::move(b));
-   _index.insert(item);
-   _head = item;
+   _head = &allocate( b, b.id() );
 }
 
 /**
- * Pushes the block into the fork database and caches it if it doesn't link
+ * Pushes the block into the fork database, it must link to a block that is already in it
  *
  */
-shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
+item_ptr  fork_database::push_block(const signed_block& b)
+{
+   return push_block( b, b.id() );
+}
+
+item_ptr  fork_database::push_block(const signed_block& b, const block_id_type& id)
 {
-   auto item = std::make_shared<fork_item>(b);
    try {
-      _push_block(item);
+      if( fetch_block( id ) != nullptr )
+         return _head;
+      fork_item& item = allocate( b, id );
+      try {
+         _push_block( item );
+      } catch( ... ) {
+         release( item );
+         throw;
+      }
    }
    catch ( const unlinkable_block_exception& e )
    {
-      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",b.id())("num",b.block_num()) );
+      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",id)("num",b.block_num()) );
       wlog( "Head: ${num}, ${id}", ("num",_head->data.block_num())("id",_head->data.id()) );
       throw;
-      _unlinked_index.insert( item );
    }
    return _head;
 }
 
-void  fork_database::_push_block(const item_ptr& item)
+void  fork_database::_push_block( fork_item& item )
 {
    if( _head ) // make sure the block is within the range that we are caching
    {
-      FC_ASSERT( item->num > std::max<int64_t>( 0, int64_t(_head->num) - (_max_size) ),
+      FC_ASSERT( item.num > std::max<int64_t>( 0, int64_t(_head->num) - (_max_size) ),
                  "attempting to push a block that is too old", 
-                 ("item->num",item->num)("head",_head->num)("max_size",_max_size));
+                 ("item->num",item.num)("head",_head->num)("max_size",_max_size));
    }
 
-   if( _head && item->previous_id() != block_id_type() )
+   if( _head && item.previous_id() != block_id_type() )
    {
-      auto& index = _index.get<block_id>();
-      auto itr = index.find(item->previous_id());
-      GRAPHENE_ASSERT(itr != index.end(), unlinkable_block_exception, "block does not link to known chain");
-      FC_ASSERT(!(*itr)->invalid);
-      item->prev = *itr;
+      item_ptr p = fetch_block( item.previous_id() );
+      GRAPHENE_ASSERT(p != nullptr, unlinkable_block_exception, "block does not link to known chain");
+      FC_ASSERT(!p->invalid);
+      item.prev_slot = p->slot;
    }
 
-   _index.insert(item);
-   if( !_head ) _head = item;
-   else if( item->num > _head->num )
+   if( !_head ) _head = &item;
+   else if( item.num > _head->num )
    {
-      _head = item;
+      _head = &item;
       uint32_t min_num = _head->num - std::min( _max_size, _head->num );
 //      ilog( "min block in fork DB ${n}, max_size: ${m}", ("n",min_num)("m",_max_size) );
-      auto& num_idx = _index.get<block_num>();
-      while( num_idx.size() && (*num_idx.begin())->num < min_num )
-         num_idx.erase( num_idx.begin() );
-      
-      _unlinked_index.get<block_num>().erase(_head->num - _max_size);
+      prune_below( min_num );
    }
-   //_push_next( item );
 }
 
-/**
- *  Iterate through the unlinked cache and insert anything that
- *  links to the newly inserted item.  This will start a recursive
- *  set of calls performing a depth-first insertion of pending blocks as
- *  _push_next(..) calls _push_block(...) which will in turn call _push_next
- */
-void fork_database::_push_next( const item_ptr& new_item )
+fork_item& fork_database::allocate( const signed_block& b, const block_id_type& id )
 {
-    auto& prev_idx = _unlinked_index.get<by_previous>();
+   uint32_t num = b.block_num();
+   bool empty = _items.size() == _free_slots.size();
+   if( empty )
+      _lowest_num = _highest_num = num;
+   _lowest_num  = std::min( _lowest_num, num );
+   _highest_num = std::max( _highest_num, num );
+   // every stored height needs its own place in the ring
+   resize_ring( size_t(_highest_num - _lowest_num) + 1 );
 
-    auto itr = prev_idx.find( new_item->id );
-    while( itr != prev_idx.end() )
-    {
-       auto tmp = *itr;
-       prev_idx.erase( itr );
-       _push_block( tmp );
+   uint32_t slot;
+   if( !_free_slots.empty() )
+   {
+      slot = _free_slots.back();
+      _free_slots.pop_back();
+   }
+   else
+   {
+      slot = _items.size();
+      _items.emplace_back();
+   }
 
-       itr = prev_idx.find( new_item->id );
-    }
+   fork_item& item = _items[slot];
+   item.data      = b;
+   item.num       = num;
+   item.id        = id;
+   item.invalid   = false;
+   item.in_use    = true;
+   item.slot      = slot;
+   item.prev_slot = fork_item::no_slot;
+   slots_at( num ).push_back( slot );
+   return item;
 }
 
-void fork_database::set_max_size( uint32_t s )
+void fork_database::release( fork_item& item )
 {
-   _max_size = s;
-   if( !_head ) return;
+   auto& slots = slots_at( item.num );
+   auto itr = std::find( slots.begin(), slots.end(), item.slot );
+   if( itr != slots.end() )
+      slots.erase( itr );
+   item.in_use    = false;
+   item.prev_slot = fork_item::no_slot;
+   item.data      = signed_block();
+   _free_slots.push_back( item.slot );
+}
 
-   { /// index
-      auto& by_num_idx = _index.get<block_num>();
-      auto itr = by_num_idx.begin();
-      while( itr != by_num_idx.end() )
-      {
-         if( (*itr)->num < std::max(int64_t(0),int64_t(_head->num) - _max_size) )
-            by_num_idx.erase(itr);
-         else
-            break;
-         itr = by_num_idx.begin();
-      }
+item_ptr fork_database::prev( item_ptr item )const
+{
+   if( item->prev_slot != fork_item::no_slot )
+   {
+      const fork_item& p = _items[item->prev_slot];
+      if( p.in_use && p.id == item->previous_id() )
+         return &p;
    }
-   { /// unlinked_index
-      auto& by_num_idx = _unlinked_index.get<block_num>();
-      auto itr = by_num_idx.begin();
-      while( itr != by_num_idx.end() )
+   // the previous block was removed and possibly pushed again since item was linked to it
+   return fetch_block( item->previous_id() );
+}
+
+void fork_database::resize_ring( size_t count )
+{
+   size_t size = 16;
+   while( size < count )
+      size *= 2;
+   if( size <= _by_num.size() )
+      return;
+
+   vector< vector<uint32_t> > ring( size );
+   for( const fork_item& item : _items )
+      if( item.in_use )
+         ring[ item.num & (size - 1) ].push_back( item.slot );
+   _by_num = std::move( ring );
+}
+
+void fork_database::prune_below( uint32_t min_num )
+{
+   if( min_num <= _lowest_num )
+      return;
+
+   // everything stored is at most one lap of the ring below min_num
+   uint32_t ring_size = _by_num.size();
+   uint32_t from = std::max<uint32_t>( _lowest_num, min_num > ring_size ? min_num - ring_size : 0 );
+   for( uint32_t n = from; n < min_num; ++n )
+   {
+      auto& slots = slots_at( n );
+      for( size_t i = 0; i < slots.size(); )
       {
-         if( (*itr)->num < std::max(int64_t(0),int64_t(_head->num) - _max_size) )
-            by_num_idx.erase(itr);
+         fork_item& item = _items[ slots[i] ];
+         if( item.num < min_num )
+         {
+            if( _head == &item )
+               _head = nullptr;
+            release( item ); // erases slots[i]
+         }
          else
-            break;
-         itr = by_num_idx.begin();
+            ++i;
       }
    }
+   _lowest_num  = min_num;
+   _highest_num = std::max( _highest_num, min_num );
+}
+
+void fork_database::set_max_size( uint32_t s )
+{
+   _max_size = s;
+   resize_ring( size_t(_max_size) + 2 );
+   if( !_head ) return;
+
+   prune_below( uint32_t( std::max( int64_t(0), int64_t(_head->num) - _max_size ) ) );
 }
 
 bool fork_database::is_known_block(const block_id_type& id)const
 {
-   auto& index = _index.get<block_id>();
-   auto itr = index.find(id);
-   if( itr != index.end() )
-      return true;
-   auto& unlinked_index = _unlinked_index.get<block_id>();
-   auto unlinked_itr = unlinked_index.find(id);
-   return unlinked_itr != unlinked_index.end();
+   return fetch_block( id ) != nullptr;
 }
 
 item_ptr fork_database::fetch_block(const block_id_type& id)const
 {
-   auto& index = _index.get<block_id>();
-   auto itr = index.find(id);
-   if( itr != index.end() )
-      return *itr;
-   auto& unlinked_index = _unlinked_index.get<block_id>();
-   auto unlinked_itr = unlinked_index.find(id);
-   if( unlinked_itr != unlinked_index.end() )
-      return *unlinked_itr;
-   return item_ptr();
+   uint32_t num = block_header::num_from_id( id );
+   for( uint32_t slot : slots_at( num ) )
+   {
+      const fork_item& item = _items[slot];
+      if( item.in_use && item.id == id )
+         return &item;
+   }
+   return nullptr;
 }
 
 vector<item_ptr> fork_database::fetch_block_by_number(uint32_t num)const
 {
    vector<item_ptr> result;
-   auto itr = _index.get<block_num>().find(num);
-   while( itr != _index.get<block_num>().end() )
+   for( uint32_t slot : slots_at( num ) )
    {
-      if( (*itr)->num == num )
-         result.push_back( *itr );
-      else
-         break;
-      ++itr;
+      const fork_item& item = _items[slot];
+      if( item.in_use && item.num == num )
+         result.push_back( &item );
    }
    return result;
 }
@@ -202,34 +261,32 @@ pair<fork_database::branch_type,fork_database::branch_type>
    // This function gets a branch (i.e. vector<fork_item>) leading
    // back to the most recent common ancestor.
    pair<branch_type,branch_type> result;
-   auto first_branch_itr = _index.get<block_id>().find(first);
-   FC_ASSERT(first_branch_itr != _index.get<block_id>().end());
-   auto first_branch = *first_branch_itr;
+   item_ptr first_branch = fetch_block(first);
+   FC_ASSERT(first_branch);
 
-   auto second_branch_itr = _index.get<block_id>().find(second);
-   FC_ASSERT(second_branch_itr != _index.get<block_id>().end());
-   auto second_branch = *second_branch_itr;
+   item_ptr second_branch = fetch_block(second);
+   FC_ASSERT(second_branch);
 
 
-   while( first_branch->data.block_num() > second_branch->data.block_num() )
+   while( first_branch->num > second_branch->num )
    {
       result.first.push_back(first_branch);
-      first_branch = first_branch->prev.lock();
+      first_branch = prev(first_branch);
       FC_ASSERT(first_branch);
    }
-   while( second_branch->data.block_num() > first_branch->data.block_num() )
+   while( second_branch->num > first_branch->num )
    {
       result.second.push_back( second_branch );
-      second_branch = second_branch->prev.lock();
+      second_branch = prev(second_branch);
       FC_ASSERT(second_branch);
    }
    while( first_branch->data.previous != second_branch->data.previous )
    {
       result.first.push_back(first_branch);
       result.second.push_back(second_branch);
-      first_branch = first_branch->prev.lock();
+      first_branch = prev(first_branch);
       FC_ASSERT(first_branch);
-      second_branch = second_branch->prev.lock();
+      second_branch = prev(second_branch);
       FC_ASSERT(second_branch);
    }
    if( first_branch && second_branch )
@@ -240,14 +297,20 @@ pair<fork_database::branch_type,fork_database::branch_type>
    return result;
 } FC_CAPTURE_AND_RETHROW( (first)(second) ) }
 
-void fork_database::set_head(shared_ptr<fork_item> h)
+void fork_database::set_head(item_ptr h)
 {
    _head = h;
 }
 
 void fork_database::remove(block_id_type id)
 {
-   _index.get<block_id>().erase(id);
+   item_ptr item = fetch_block( id );
+   if( item == nullptr )
+      return;
+   // the head is left on the previous block, rather than on a block that is no longer stored
+   if( _head == item )
+      _head = prev( item );
+   release( _items[item->slot] );
 }
 
 } } // graphene::chain
@@ -24,8 +24,13 @@
 #pragma once
 #include <graphene/chain/protocol/operations.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <graphene/db/name_lookup_index.hpp>
+#include <graphene/db/slab_index.hpp>
 #include <boost/multi_index/composite_key.hpp>
 
+#include <mutex>
+#include <unordered_set>
+
 namespace graphene { namespace chain {
    class database;
 
@@ -79,6 +84,13 @@ namespace graphene { namespace chain {
           */
          share_type pending_vested_fees;
 
+         /**
+          * What the last maintenance added to the vote totals for this account, see @ref vote_tally_object.
+          * tallied_stake is the stake this account voted with, for the opinions of tallied_opinion_account.
+          */
+         uint64_t        tallied_stake = 0;
+         account_id_type tallied_opinion_account;
+
          /// @brief Split up and pay out @ref pending_fees and @ref pending_vested_fees
          void process_fees(const account_object& a, database& d) const;
 
@@ -124,6 +136,10 @@ namespace graphene { namespace chain {
          static const uint8_t space_id = protocol_ids;
          static const uint8_t type_id  = account_object_type;
 
+         // The fields read while applying most operations come first, so that they share the first cache lines of
+         // the object; the name, authorities and options are only read by the evaluators and API calls that need
+         // them.  The serialized order is the one in FC_REFLECT below and does not depend on this one.
+
          /**
           * The time at which this account's membership expires.
           * If set to any time in the past, the account is a basic account.
@@ -149,27 +165,15 @@ namespace graphene { namespace chain {
          /// to referrer. The remainder of referral rewards goes to the registrar.
          uint16_t referrer_rewards_percentage = 0;
 
-         /// The account's name. This name must be unique among all account names on the graph. May not be empty.
-         string name;
-
-         /**
-          * The owner authority represents absolute control over the account. Usually the keys in this authority will
-          * be kept in cold storage, as they should not be needed very often and compromise of these keys constitutes
-          * complete and irrevocable loss of the account. Generally the only time the owner authority is required is to
-          * update the active authority.
-          */
-         authority owner;
-         /// The owner authority contains the hot keys of the account. This authority has control over nearly all
-         /// operations the account may perform.
-         authority active;
-
-         typedef account_options  options_type;
-         account_options options;
-
          /// The reference implementation records the account's statistics in a separate object. This field contains the
          /// ID of that object.
          account_statistics_id_type statistics;
 
+         /**
+          * Vesting balance which receives cashback_reward deposits.
+          */
+         optional<vesting_balance_id_type> cashback_vb;
+
          /**
           * This is a set of all accounts which have 'whitelisted' this account. Whitelisting is only used in core
           * validation for the purpose of authorizing accounts to hold and transact in whitelisted assets. This
@@ -178,21 +182,6 @@ namespace graphene { namespace chain {
           */
          flat_set<account_id_type> whitelisting_accounts;
 
-         /**
-          * Optionally track all of the accounts this account has whitelisted or blacklisted, these should
-          * be made Immutable so that when the account object is cloned no deep copy is required.  This state is
-          * tracked for GUI display purposes.
-          *
-          * TODO: move white list tracking to its own multi-index container rather than having 4 fields on an
-          * account.   This will scale better because under the current design if you whitelist 2000 accounts,
-          * then every time someone fetches this account object they will get the full list of 2000 accounts.
-          */
-         ///@{
-         set<account_id_type> whitelisted_accounts;
-         set<account_id_type> blacklisted_accounts;
-         ///@}
-
-
          /**
           * This is a set of all accounts which have 'blacklisted' this account. Blacklisting is only used in core
           * validation for the purpose of forbidding accounts from holding and transacting in whitelisted assets. This
@@ -202,12 +191,11 @@ namespace graphene { namespace chain {
          flat_set<account_id_type> blacklisting_accounts;
 
          /**
-          * Vesting balance which receives cashback_reward deposits.
+          * This is a set of assets which the account is allowed to have.
+          * This is utilized to restrict buyback accounts to the assets that trade in their markets.
+          * In the future we may expand this to allow accounts to e.g. voluntarily restrict incoming transfers.
           */
-         optional<vesting_balance_id_type> cashback_vb;
-
-         special_authority owner_special_authority = no_special_authority();
-         special_authority active_special_authority = no_special_authority();
+         optional< flat_set<asset_id_type> > allowed_assets;
 
          /**
           * This flag is set when the top_n logic sets both authorities,
@@ -217,12 +205,39 @@ namespace graphene { namespace chain {
          static const uint8_t top_n_control_owner  = 1;
          static const uint8_t top_n_control_active = 2;
 
+         /// The account's name. This name must be unique among all account names on the graph. May not be empty.
+         string name;
+
          /**
-          * This is a set of assets which the account is allowed to have.
-          * This is utilized to restrict buyback accounts to the assets that trade in their markets.
-          * In the future we may expand this to allow accounts to e.g. voluntarily restrict incoming transfers.
+          * The owner authority represents absolute control over the account. Usually the keys in this authority will
+          * be kept in cold storage, as they should not be needed very often and compromise of these keys constitutes
+          * complete and irrevocable loss of the account. Generally the only time the owner authority is required is to
+          * update the active authority.
           */
-         optional< flat_set<asset_id_type> > allowed_assets;
+         authority owner;
+         /// The owner authority contains the hot keys of the account. This authority has control over nearly all
+         /// operations the account may perform.
+         authority active;
+
+         typedef account_options  options_type;
+         account_options options;
+
+         /**
+          * Optionally track all of the accounts this account has whitelisted or blacklisted, these should
+          * be made Immutable so that when the account object is cloned no deep copy is required.  This state is
+          * tracked for GUI display purposes.
+          *
+          * TODO: move white list tracking to its own multi-index container rather than having 4 fields on an
+          * account.   This will scale better because under the current design if you whitelist 2000 accounts,
+          * then every time someone fetches this account object they will get the full list of 2000 accounts.
+          */
+         ///@{
+         set<account_id_type> whitelisted_accounts;
+         set<account_id_type> blacklisted_accounts;
+         ///@}
+
+         special_authority owner_special_authority = no_special_authority();
+         special_authority active_special_authority = no_special_authority();
 
          bool has_special_authority()const
          {
@@ -274,12 +289,17 @@ namespace graphene { namespace chain {
          virtual void about_to_modify( const object& before ) override;
          virtual void object_modified( const object& after  ) override;
 
+         /** only used by the API, so modifications are coalesced until the index is read */
+         virtual bool defer_modifications()const override { return true; }
+         /** only the owner and active authorities and the memo key are indexed */
+         virtual bool is_relevant_change( const object& before, const object& after )const override;
+
 
          /** given an account or key, map it to the set of accounts that reference it in an active or owner authority */
          map< account_id_type, set<account_id_type> > account_to_account_memberships;
-         map< public_key_type, set<account_id_type> > account_to_key_memberships;
+         unordered_map< public_key_type, set<account_id_type> > account_to_key_memberships;
          /** some accounts use address authorities in the genesis block */
-         map< address, set<account_id_type> >         account_to_address_memberships;
+         unordered_map< address, set<account_id_type> >         account_to_address_memberships;
 
 
       protected:
@@ -293,6 +313,27 @@ namespace graphene { namespace chain {
    };
 
 
+   /**
+    *  Counts the changes to the owner and active authorities of accounts, so that results derived from them can
+    *  tell whether they are still current.  Creating or removing an account counts as a change, and so does
+    *  undoing any of these.
+    */
+   class authority_change_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override { ++_changes; }
+         virtual void object_removed( const object& obj ) override { ++_changes; }
+         virtual void about_to_modify( const object& before ) override;
+         virtual void object_modified( const object& after  ) override;
+
+         uint64_t changes()const { return _changes; }
+
+      private:
+         uint64_t   _changes = 0;
+         authority  _before_owner;
+         authority  _before_active;
+   };
+
    /**
     *  @brief This secondary index will allow a reverse lookup of all accounts that have been referred by
     *  a particular account.
@@ -309,8 +350,55 @@ namespace graphene { namespace chain {
          map< account_id_type, set<account_id_type> > referred_by;
    };
 
+   /**
+    *  @brief This secondary index will allow a constant time lookup of the balance of an account in an asset, and
+    *  a listing of the holders of an asset by their balances.
+    *
+    *  The ordering of the holders is only needed by maintenance and the API, so rather than moving every balance
+    *  that changes in an ordered index, the balances that changed are noted and put back in order when the holders
+    *  are read.
+    */
+   class balances_by_account_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override;
+         virtual void object_removed( const object& obj ) override;
+         virtual void about_to_modify( const object& before ) override {}
+         virtual void object_modified( const object& after  ) override;
+
+         /** @return the balance of account in asset, or null if the account never held it */
+         const account_balance_object* find( account_id_type account, asset_id_type asset )const;
+         /** @return the balances of account, in the order it first held each asset */
+         const vector< const account_balance_object* >& get_account_balances( account_id_type account )const;
+         /** @return the balances of asset, the largest first and equal ones by owner */
+         const vector< const account_balance_object* >& get_asset_holders( asset_id_type asset )const;
+         /**
+          * @return the first count of get_asset_holders(), without putting the changed balances back in order, so
+          * the cost depends on count and the number of changed balances rather than on the number of holders
+          */
+         vector< const account_balance_object* > get_top_holders( asset_id_type asset, size_t count )const;
+
+         /** counts the balances of GRAPHENE_TEMP_ACCOUNT created or changed, including by undoing changes */
+         uint64_t temp_account_changes()const { return _temp_account_changes; }
+
+      private:
+         struct holders
+         {
+            /** in order, except for the ones in changed */
+            vector< const account_balance_object* >           balances;
+            std::unordered_set< const account_balance_object* > changed;
+         };
+
+         /** by account instance, the few assets most accounts hold are found by scanning */
+         vector< vector< const account_balance_object* > > _by_account;
+         /** by asset instance */
+         mutable vector< holders >                         _by_asset;
+         /** readers holding database::lock_state_for_reading() may sort the holders at the same time */
+         mutable std::mutex                                _sort_mutex;
+         uint64_t                                          _temp_account_changes = 0;
+   };
+
    struct by_account_asset;
-   struct by_asset_balance;
    /**
     * @ingroup object_index
     */
@@ -324,27 +412,15 @@ namespace graphene { namespace chain {
                member<account_balance_object, account_id_type, &account_balance_object::owner>,
                member<account_balance_object, asset_id_type, &account_balance_object::asset_type>
             >
-         >,
-         ordered_unique< tag<by_asset_balance>,
-            composite_key<
-               account_balance_object,
-               member<account_balance_object, asset_id_type, &account_balance_object::asset_type>,
-               member<account_balance_object, share_type, &account_balance_object::balance>,
-               member<account_balance_object, account_id_type, &account_balance_object::owner>
-            >,
-            composite_key_compare<
-               std::less< asset_id_type >,
-               std::greater< share_type >,
-               std::less< account_id_type >
-            >
          >
-      >
+      >,
+      graphene::db::pool_allocator<account_balance_object>
    > account_balance_object_multi_index_type;
 
    /**
     * @ingroup object_index
     */
-   typedef generic_index<account_balance_object, account_balance_object_multi_index_type> account_balance_index;
+   typedef generic_index<account_balance_object, account_balance_object_multi_index_type, true> account_balance_index;
 
    struct by_name{};
 
@@ -362,7 +438,10 @@ namespace graphene { namespace chain {
    /**
     * @ingroup object_index
     */
-   typedef generic_index<account_object, account_multi_index_type> account_index;
+   typedef generic_index<account_object, account_multi_index_type, true> account_index;
+
+   /** finds accounts by name, see name_lookup_index */
+   typedef graphene::db::name_lookup_index<account_object, &account_object::name> account_name_index;
 
 }}
 
@@ -378,6 +457,10 @@ FC_REFLECT_DERIVED( graphene::chain::account_object,
                     (allowed_assets)
                     )
 
+GRAPHENE_DECLARE_PRIMARY_INDEX( graphene::chain::account_balance_object, graphene::chain::account_balance_index )
+GRAPHENE_DECLARE_PRIMARY_INDEX( graphene::chain::account_statistics_object,
+                                graphene::db::slab_index<graphene::chain::account_statistics_object> )
+
 FC_REFLECT_DERIVED( graphene::chain::account_balance_object,
                     (graphene::db::object),
                     (owner)(asset_type)(balance) )
@@ -390,5 +473,6 @@ FC_REFLECT_DERIVED( graphene::chain::account_statistics_object,
                     (total_core_in_orders)
                     (lifetime_fees_paid)
                     (pending_fees)(pending_vested_fees)
+                    (tallied_stake)(tallied_opinion_account)
                   )
 
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/protocol/types.hpp>
+
+namespace graphene { namespace chain {
+
+   /**
+    * Where the time went applying the operations of one type, see database::set_apply_profiling().  Times are in
+    * microseconds, and those of an operation include the operations it applies itself, like the proposed ones.
+    */
+   struct operation_profile
+   {
+      uint64_t count = 0;
+      /** the evaluator's fee checks and do_evaluate() */
+      uint64_t evaluate_time = 0;
+      uint64_t max_evaluate_time = 0;
+      /** the evaluator's fee payment and do_apply() */
+      uint64_t apply_time = 0;
+      uint64_t max_apply_time = 0;
+      uint64_t objects_created = 0;
+      /** every modification, modifying one object twice counts twice */
+      uint64_t objects_modified = 0;
+      uint64_t objects_removed = 0;
+   };
+
+   /** microseconds spent in each phase of applying a block */
+   struct block_apply_profile
+   {
+      uint32_t block_num = 0;
+      uint32_t transaction_count = 0;
+      /** checking the merkle root and the header */
+      uint64_t header_time = 0;
+      /** recovering the signature keys and validating the transactions on the signature threads, waited for */
+      uint64_t signature_time = 0;
+      uint64_t transaction_time = 0;
+      /** updating the dynamic global properties, the signing witness and the last irreversible block */
+      uint64_t dynamic_data_time = 0;
+      uint64_t maintenance_time = 0;
+      /** the block summary and clearing expired transactions, proposals, orders, feeds and withdrawals */
+      uint64_t expiration_time = 0;
+      /** the maintenance flag, the witness schedule and debug updates */
+      uint64_t schedule_time = 0;
+      /** the applied_block observers, which is where the plugins work */
+      uint64_t applied_block_time = 0;
+      /** the changed and removed object observers */
+      uint64_t changed_objects_time = 0;
+      uint64_t total_time = 0;
+   };
+
+   struct apply_profile
+   {
+      static const size_t max_recent_blocks = 100;
+
+      /** indexed by operation tag */
+      vector<operation_profile>    operations;
+      /** the sums over all profiled blocks, whose number is in block_num */
+      block_apply_profile          block_totals;
+      /** the last max_recent_blocks profiled blocks, oldest first */
+      vector<block_apply_profile>  recent_blocks;
+   };
+
+   /** what the last replay of the block log did, see database::get_replay_statistics() */
+   struct replay_statistics
+   {
+      uint32_t first_block = 0;
+      /** the last block applied */
+      uint32_t last_block = 0;
+      uint32_t blocks = 0;
+      uint64_t transactions = 0;
+      uint64_t operations = 0;
+      /** microseconds spent replaying, from reading the first block to applying the last one */
+      uint64_t elapsed_time = 0;
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::operation_profile,
+            (count)(evaluate_time)(max_evaluate_time)(apply_time)(max_apply_time)
+            (objects_created)(objects_modified)(objects_removed) )
+FC_REFLECT( graphene::chain::block_apply_profile,
+            (block_num)(transaction_count)(header_time)(signature_time)(transaction_time)(dynamic_data_time)
+            (maintenance_time)(expiration_time)(schedule_time)(applied_block_time)(changed_objects_time)(total_time) )
+FC_REFLECT( graphene::chain::apply_profile, (operations)(block_totals)(recent_blocks) )
+FC_REFLECT( graphene::chain::replay_statistics,
+            (first_block)(last_block)(blocks)(transactions)(operations)(elapsed_time) )
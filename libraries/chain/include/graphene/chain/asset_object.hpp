@@ -26,6 +26,8 @@
 #include <boost/multi_index/composite_key.hpp>
 #include <graphene/db/flat_index.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <graphene/db/name_lookup_index.hpp>
+#include <graphene/db/simple_index.hpp>
 
 /**
  * @defgroup prediction_market Prediction Market
@@ -230,6 +232,35 @@ namespace graphene { namespace chain {
    > asset_bitasset_data_object_multi_index_type;
    typedef flat_index<asset_bitasset_data_object> asset_bitasset_data_index;
 
+   /**
+    *  @brief Schedules the bitassets by the time their feeds expire, and notes the ones that changed, so that
+    *  each block only updates the feeds of the market issued assets that need it.
+    *
+    *  One instance watches the bitasset index and keeps the schedule, another watches the asset index and keeps
+    *  the asset of each bitasset.  Both note the bitassets that changed.
+    */
+   class feed_update_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override;
+         virtual void object_removed( const object& obj ) override;
+         virtual void about_to_modify( const object& before ) override {}
+         virtual void object_modified( const object& after  ) override;
+
+         /** the bitassets by the time their current feeds expire */
+         map< time_point_sec, flat_set<asset_bitasset_data_id_type> > by_feed_expiration;
+         /** bitassets changed since the feeds were last updated, their core exchange rates may have to be copied */
+         flat_set<asset_bitasset_data_id_type>                       changed;
+         /** the asset each bitasset belongs to, only kept by the asset index instance */
+         flat_map<asset_bitasset_data_id_type, asset_id_type>         assets;
+
+      private:
+         void schedule( const asset_bitasset_data_object& b );
+         void unschedule( asset_bitasset_data_id_type id );
+
+         flat_map<asset_bitasset_data_id_type, time_point_sec>        _expiration;
+   };
+
    struct by_symbol;
    struct by_type;
    typedef multi_index_container<
@@ -245,10 +276,17 @@ namespace graphene { namespace chain {
          >
       >
    > asset_object_multi_index_type;
-   typedef generic_index<asset_object, asset_object_multi_index_type> asset_index;
+   typedef generic_index<asset_object, asset_object_multi_index_type, true> asset_index;
+
+   /** finds assets by symbol, see name_lookup_index */
+   typedef graphene::db::name_lookup_index<asset_object, &asset_object::symbol> asset_symbol_index;
 
 } } // graphene::chain
 
+GRAPHENE_DECLARE_PRIMARY_INDEX( graphene::chain::asset_dynamic_data_object,
+                                graphene::db::simple_index<graphene::chain::asset_dynamic_data_object> )
+GRAPHENE_DECLARE_PRIMARY_INDEX( graphene::chain::asset_bitasset_data_object, graphene::chain::asset_bitasset_data_index )
+
 FC_REFLECT_DERIVED( graphene::chain::asset_dynamic_data_object, (graphene::db::object),
                     (current_supply)(confidential_supply)(accumulated_fees)(fee_pool) )
 
@@ -23,14 +23,81 @@
  */
 #pragma once
 #include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <graphene/chain/protocol/block.hpp>
 
+#include <fc/time.hpp>
+
+#include <boost/thread/shared_mutex.hpp>
+
 namespace graphene { namespace chain {
+
+   /**
+    * @brief Stores the raw block log as a series of segments
+    *
+    * Each segment covers a fixed range of block numbers and consists of two files: segment-<first>.blocks
+    * holds a small header followed by the (optionally compressed) packed blocks, and segment-<first>.index
+    * holds one fixed size entry per block number.  The index of every open segment is kept in memory, so
+    * lookups never touch the disk except to read the block itself, and old segments can be archived or
+    * removed independently of the head of the log, see @ref prune_below.
+    *
+    * A database written in the old single file format is converted to segments the first time it is opened.
+    *
+    * Blocks are read through a read-only memory mapping of each segment, and the packed form of recently
+    * read or stored blocks is kept in a small LRU cache.  The const methods may be called from several
+    * threads at once; store(), remove(), open(), close() and flush() take an exclusive lock.
+    *
+    * Stored blocks and index entries are buffered in memory and written to the segment files in groups as
+    * set by the @ref flush_policy.  Buffered blocks can be read like any other, they are only at risk if the
+    * process dies before the next write.
+    */
    class block_database 
    {
       public:
+         enum compression_type
+         {
+            no_compression   = 0,
+            zlib_compression = 1
+         };
+
+         struct index_entry
+         {
+            uint64_t      block_pos = 0;  ///< offset of the stored block within its segment's blocks file
+            uint32_t      block_size = 0; ///< stored (possibly compressed) size, 0 if the block was removed
+            block_id_type block_id;
+         };
+
+         /** When buffered blocks are written to disk; whichever limit is reached first triggers a write */
+         struct flush_policy
+         {
+            uint32_t         max_pending_blocks = 1;  ///< write once this many blocks are buffered, 0 for no limit
+            fc::microseconds max_pending_time;        ///< write once the oldest buffered block is this old, 0 for no limit
+            bool             sync = false;            ///< fsync the segment files after each write
+            bool             flush_on_irreversible = false; ///< used by the database, flush whenever a block becomes irreversible
+         };
+
+         block_database();
+         ~block_database();
+
+         /**
+          * Sets the size and compression of segments created after this call; segments that already exist keep
+          * the format they were written with.
+          */
+         void set_segment_format( uint32_t blocks_per_segment, compression_type compression );
+
+         /** Number of packed blocks kept in the LRU cache, 0 disables it */
+         void set_cache_size( size_t blocks );
+
+         void set_flush_policy( const flush_policy& policy );
+         const flush_policy& get_flush_policy()const { return _flush_policy; }
+
          void open( const fc::path& dbdir );
          bool is_open()const;
+         /** writes all buffered blocks, and syncs them if the flush policy asks for it */
          void flush();
          void close();
 
@@ -43,8 +110,76 @@ namespace graphene { namespace chain {
          optional<signed_block> fetch_by_number( uint32_t block_num )const;
          optional<signed_block> last()const;
          optional<block_id_type> last_id()const;
+
+         /**
+          * @return the packed (uncompressed) block with this id, or a null pointer if it is not in the database.
+          * The bytes are shared with the cache and must not be modified.
+          */
+         std::shared_ptr<const vector<char>> fetch_packed( const block_id_type& id )const;
+
+         /** @return the lowest block number that may still be stored, blocks below it have been pruned */
+         uint32_t first_retained_block_num()const;
+
+         /**
+          * Deletes every segment that only holds blocks below block_num.  The segment holding the last block is
+          * never deleted.
+          *
+          * @return the number of segments deleted
+          */
+         uint32_t prune_below( uint32_t block_num );
+
       private:
-         mutable std::fstream _blocks;
-         mutable std::fstream _block_num_to_pos;
+         struct segment;
+         typedef std::shared_ptr<const vector<char>> packed_block_ptr;
+
+         segment*           find_segment( uint32_t block_num )const;
+         segment&           get_or_create_segment( uint32_t block_num );
+         const index_entry* find_entry( uint32_t block_num )const;
+         const index_entry* find_last_entry( uint32_t& block_num )const;
+         /**
+          *  reads the packed block_num, or returns null if it is absent or its id does not match *id,
+          *  and sets *stored_id to the id the index holds for it
+          */
+         packed_block_ptr   read_packed( uint32_t block_num, const block_id_type* id,
+                                         block_id_type* stored_id = nullptr )const;
+         optional<signed_block> unpack_block( const packed_block_ptr& packed )const;
+         void               open_segment( const fc::path& blocks_file, const fc::path& index_file, bool create,
+                                          uint32_t first_block_num );
+         void               convert_legacy_files();
+         void               store_locked( const block_id_type& id, const signed_block& b );
+         void               write_pending();
+
+         packed_block_ptr   cache_find( uint32_t block_num, const block_id_type* id,
+                                        block_id_type* stored_id = nullptr )const;
+         void               cache_insert( uint32_t block_num, const block_id_type& id, const packed_block_ptr& packed )const;
+         void               cache_erase( uint32_t block_num )const;
+
+         fc::path                                      _dbdir;
+         bool                                          _open = false;
+         uint32_t                                      _blocks_per_segment = 100000;
+         compression_type                              _compression = no_compression;
+         /** maps the first block number of each segment to the segment */
+         std::map< uint32_t, std::unique_ptr<segment> > _segments;
+         /** shared by readers, exclusive for anything that changes the segments or their mappings */
+         mutable boost::shared_mutex                   _lock;
+
+         flush_policy                                  _flush_policy;
+         /** number of stored blocks not yet written, and when the first of them was stored */
+         uint32_t                                      _pending_blocks = 0;
+         fc::time_point                                _oldest_pending;
+
+         struct cache_entry
+         {
+            block_id_type                  id;
+            packed_block_ptr               packed;
+            std::list<uint32_t>::iterator  position;
+         };
+         size_t                                          _cache_capacity = 1024;
+         mutable std::mutex                              _cache_mutex;
+         /** block numbers in the cache, most recently used first */
+         mutable std::list<uint32_t>                     _cache_order;
+         mutable std::unordered_map<uint32_t, cache_entry> _cache;
    };
 } }
+
+FC_REFLECT_ENUM( graphene::chain::block_database::compression_type, (no_compression)(zlib_compression) )
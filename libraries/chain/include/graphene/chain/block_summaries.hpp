@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/protocol/types.hpp>
+#include <graphene/db/undo_database.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <deque>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @brief tracks the ids of the last 65536 blocks to implement TaPoS
+    *
+    *  When attempting to calculate the validity of a transaction we need to look up a past block by the low 16 bits
+    *  of its number and compare its id.  The ids are kept in a ring by those bits, and the ids they replace are
+    *  recorded in a journal that the undo database rolls back along with the blocks it undoes.
+    */
+   class block_summaries : public graphene::db::undo_journal
+   {
+      public:
+         static const uint32_t size = 0x10000;
+
+         explicit block_summaries( const graphene::db::undo_database& undo_db )
+            : _block_ids( size ), _undo_db( undo_db ) {}
+
+         /** @return the id of the latest block whose number ends in ref_block_num, or a null id */
+         const block_id_type& get( uint16_t ref_block_num )const { return _block_ids[ref_block_num]; }
+         void                 set( uint32_t block_num, const block_id_type& id );
+         /** forgets every block id and the journal, for a database which is being closed */
+         void                 clear();
+
+         /** the ids are saved along with the object database, in a file of their own */
+         void save( const fc::path& file )const;
+         /** @return false if there is no file to load */
+         bool load( const fc::path& file );
+
+         virtual uint64_t position()const override { return _journal_start + _journal.size(); }
+         virtual void     rollback( uint64_t position ) override;
+         virtual void     forget_before( uint64_t position ) override;
+
+      private:
+         struct change
+         {
+            uint16_t      slot;
+            block_id_type replaced;
+         };
+
+         /** changes made without an undo state to undo them are permanent */
+         bool recording()const { return _undo_db.enabled() && _undo_db.size() > 0; }
+
+         vector<block_id_type>              _block_ids;
+         std::deque<change>                 _journal;
+         /** the position of the first change in _journal */
+         uint64_t                           _journal_start = 0;
+
+         const graphene::db::undo_database& _undo_db;
+   };
+
+} } // graphene::chain
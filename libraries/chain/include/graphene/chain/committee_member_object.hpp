@@ -25,6 +25,7 @@
 #include <graphene/chain/protocol/types.hpp>
 #include <graphene/db/object.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <boost/multi_index/composite_key.hpp>
 
 namespace graphene { namespace chain {
    using namespace graphene::db;
@@ -56,6 +57,7 @@ namespace graphene { namespace chain {
 
    struct by_account;
    struct by_vote_id;
+   struct by_votes;
    using committee_member_multi_index_type = multi_index_container<
       committee_member_object,
       indexed_by<
@@ -67,6 +69,14 @@ namespace graphene { namespace chain {
          >,
          ordered_unique< tag<by_vote_id>,
             member<committee_member_object, vote_id_type, &committee_member_object::vote_id>
+         >,
+         /// most votes first, ties go to the lower vote id, as maintenance elects them
+         ordered_unique< tag<by_votes>,
+            composite_key< committee_member_object,
+               member<committee_member_object, uint64_t, &committee_member_object::total_votes>,
+               member<committee_member_object, vote_id_type, &committee_member_object::vote_id>
+            >,
+            composite_key_compare< std::greater<uint64_t>, std::less<vote_id_type> >
          >
       >
    >;
@@ -144,7 +144,11 @@
 #define GRAPHENE_RECENTLY_MISSED_COUNT_INCREMENT             4
 #define GRAPHENE_RECENTLY_MISSED_COUNT_DECREMENT             3
 
-#define GRAPHENE_CURRENT_DB_VERSION                          "GPH2.5"
+/**
+ * Changing this replays the chain of every node that opens an older database.  GPH2.6 added the vote totals kept
+ * between maintenance intervals, which must be counted from every account once, see vote_tally_object.
+ */
+#define GRAPHENE_CURRENT_DB_VERSION                          "GPH2.6"
 
 #define GRAPHENE_IRREVERSIBLE_THRESHOLD                      (70 * GRAPHENE_1_PERCENT)
 
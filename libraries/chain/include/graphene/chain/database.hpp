@@ -22,12 +22,17 @@
  * THE SOFTWARE.
  */
 #pragma once
+#include <graphene/chain/apply_profile.hpp>
 #include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/node_property_object.hpp>
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/fork_database.hpp>
 #include <graphene/chain/block_database.hpp>
+#include <graphene/chain/block_summaries.hpp>
+#include <graphene/chain/pending_transaction_pool.hpp>
+#include <graphene/chain/transaction_dedupe.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
 #include <graphene/chain/genesis_state.hpp>
 #include <graphene/chain/evaluator.hpp>
 
@@ -35,18 +40,61 @@
 #include <graphene/db/object.hpp>
 #include <graphene/db/simple_index.hpp>
 #include <fc/signals.hpp>
+#include <fc/thread/future.hpp>
+#include <fc/thread/mutex.hpp>
+#include <fc/thread/thread_specific.hpp>
 
 #include <graphene/chain/protocol/protocol.hpp>
 
 #include <fc/log/logger.hpp>
 
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <deque>
 #include <map>
+#include <unordered_map>
+
+namespace fc { class thread; }
 
 namespace graphene { namespace chain {
    using graphene::db::abstract_object;
    using graphene::db::object;
-   class op_evaluator;
+
+   /**
+    * Checks of a block that don't depend on the chain state, see @ref database::precompute_block
+    */
+   struct precomputed_block
+   {
+      block_id_type                        id;
+      checksum_type                        merkle_root;
+      optional<fc::ecc::public_key>        signee; ///< not set if the signature could not be recovered
+      vector<transaction_id_type>          transaction_ids;
+      /**
+       * The signature keys of each transaction, an entry holds no value if they could not be recovered.  Empty if
+       * they were not recovered at all, precompute_block() leaves them to the signature threads.
+       */
+      vector< optional< flat_set<public_key_type> > > signature_keys;
+      /** true if every transaction has been validated */
+      bool                                 transactions_validated = false;
+   };
+   /**
+    * The digest of the state right after a block was applied, see @ref database::set_state_digest_blocks
+    */
+   struct block_state_digest
+   {
+      uint32_t                    block_num = 0;
+      block_id_type               block_id;
+      db::object_database_digest  state;
+   };
+   /** an object packed as a vector<char>, or no value if it was removed, see @ref database::apply_object_records */
+   typedef std::pair< object_id_type, optional< vector<char> > > object_record;
+
    class transaction_evaluation_state;
+   class limit_order_match_index;
+   class proposal_authorization_index;
+   class supply_tally_index;
+   class witness_node_index;
 
    struct budget_record;
 
@@ -76,9 +124,15 @@ namespace graphene { namespace chain {
             skip_assert_evaluation      = 1 << 8,  ///< used while reindexing
             skip_undo_history_check     = 1 << 9,  ///< used while reindexing
             skip_witness_schedule_check = 1 << 10,  ///< used while reindexing
-            skip_validate               = 1 << 11 ///< used prior to checkpoint, skips validate() call on transaction
+            skip_validate               = 1 << 11, ///< used prior to checkpoint, skips validate() call on transaction
+            skip_operation_history      = 1 << 12  ///< used prior to checkpoint, get_applied_operations() stays empty
          };
 
+         /** the checks skipped when replaying blocks which have been validated before */
+         static const uint32_t default_replay_skip = skip_witness_signature | skip_transaction_signatures |
+                                                     skip_transaction_dupe_check | skip_tapos_check |
+                                                     skip_witness_schedule_check | skip_authority_check;
+
          /**
           * @brief Open a database, creating a new one if necessary
           *
@@ -102,6 +156,103 @@ namespace graphene { namespace chain {
           */
          void reindex(fc::path data_dir, const genesis_state_type& initial_allocation = genesis_state_type());
 
+         /**
+          * @brief Rebuild the object graph from a state snapshot and the blocks after it
+          *
+          * Loads the snapshot written by @ref export_snapshot from snapshot_dir in place of the object database in
+          * data_dir, then replays only the blocks after the snapshot's head block from the block log.  The block
+          * log must still contain the snapshot's head block.  When this method exits successfully, the database
+          * will be open.
+          */
+         void reindex_from_snapshot( fc::path data_dir, const fc::path& snapshot_dir );
+
+         /**
+          * @brief Rebuild the object graph from the state the last background flush saved in data_dir
+          *
+          * Opens the object database as the last complete flush by @ref set_flush_interval left it, then replays
+          * only the blocks after it from the block log, which is how a node resumes after a crash.  When this
+          * method exits successfully, the database will be open.
+          */
+         void reindex_from_flushed_state( fc::path data_dir );
+         /** whether a background flush completed in data_dir since the object database last changed on disk */
+         static bool has_flushed_state( const fc::path& data_dir );
+
+         /**
+          * Writes the current state (every object_database index and the head block id) to dir, excluding pending
+          * transactions.
+          */
+         void export_snapshot( const fc::path& dir );
+
+         /** Export a snapshot to dir right after block_num is applied, 0 disables */
+         void set_snapshot_at_block( uint32_t block_num, const fc::path& dir )
+         { _snapshot_block_num = block_num; _snapshot_dir = dir; }
+
+         /**
+          * Checkpoint the state every interval blocks below dir, 0 disables checkpoints.  The indexes are packed into
+          * memory right after the block is applied and written by a background thread, which needs as much memory
+          * again as the objects take.  A checkpoint only becomes complete, and replaces the previous one, once its
+          * block is irreversible; @ref reindex_from_snapshot can load it like a snapshot.
+          */
+         void set_state_checkpoints( uint32_t interval, const fc::path& dir );
+         uint32_t get_state_checkpoint_interval()const { return _state_checkpoint_interval; }
+         const fc::path& get_state_checkpoint_dir()const { return _state_checkpoint_dir; }
+         /** the newest complete checkpoint below dir, if any */
+         static fc::optional<fc::path> find_state_checkpoint( const fc::path& dir );
+
+         /**
+          * Flush the object database every interval blocks while the chain goes on, 0 only flushes on close.  The
+          * changes are packed into memory right after the block is applied and written next to the index files by a
+          * background thread.  Once they are all written and the block is irreversible they are moved into place and
+          * the flushed state is marked complete, so that @ref reindex_from_flushed_state can replay from it after a
+          * crash.  The state of the previous flush stays complete until then.
+          */
+         void set_flush_interval( uint32_t interval ) { _flush_interval = interval; }
+
+         /**
+          * Keep the digest of every index up to date and record it after each of the last blocks applied, 0 stops.
+          * Nodes which run the same plugins and agree on a block have the same digests for it, comparing them by
+          * index tells which part of the state diverged.  Hashing each object as it changes costs a little on
+          * every block.
+          */
+         void set_state_digest_blocks( uint32_t blocks );
+         /**
+          * The digest recorded right after block_num was applied, or of the current state including the pending
+          * transactions if block_num is 0.
+          */
+         optional<block_state_digest> get_state_digest( uint32_t block_num )const;
+
+         /**
+          * Number of threads reading and unpacking blocks ahead of the apply loop during @ref reindex, and how
+          * many unpacked blocks they may buffer before waiting for the apply loop to catch up.
+          */
+         void set_replay_prefetch( uint32_t thread_count, uint32_t queue_depth = 256 );
+
+         /** Checks skipped while replaying the block log, default_replay_skip unless set */
+         void set_replay_skip_flags( uint32_t skip ) { _replay_skip = skip; }
+         uint32_t get_replay_skip_flags()const { return _replay_skip; }
+         /**
+          * Stop replaying the block log after block_num, 0 replays all of it.  The blocks after it stay in the block
+          * log, so this is only for benchmarks which close the database right after the replay.  The state of a
+          * replay stopped early is not saved when the database is closed.
+          */
+         void set_replay_last_block( uint32_t block_num ) { _replay_last_block = block_num; }
+         /** what the last replay did */
+         const replay_statistics& get_replay_statistics()const { return _replay_statistics; }
+
+         /** Segment size and compression for block log segments created from now on, see @ref block_database */
+         void set_block_log_format( uint32_t blocks_per_segment, block_database::compression_type compression )
+         { _block_id_to_block.set_segment_format( blocks_per_segment, compression ); }
+
+         /** How stored blocks are grouped into writes and syncs of the block log, see @ref block_database */
+         void set_block_log_flush_policy( const block_database::flush_policy& policy )
+         { _block_id_to_block.set_flush_policy( policy ); }
+
+         /**
+          * Keep only the last retain_blocks blocks below the last irreversible block in the block log, 0 keeps
+          * everything.  Older blocks are dropped a whole segment at a time as the chain advances.
+          */
+         void set_block_log_retain_blocks( uint32_t retain_blocks ) { _block_log_retain_blocks = retain_blocks; }
+
          /**
           * @brief wipe Delete database from disk, and potentially the raw chain as well.
           * @param include_blocks If true, delete the raw chain as well as the database.
@@ -122,7 +273,14 @@ namespace graphene { namespace chain {
          block_id_type              get_block_id_for_num( uint32_t block_num )const;
          optional<signed_block>     fetch_block_by_id( const block_id_type& id )const;
          optional<signed_block>     fetch_block_by_number( uint32_t num )const;
-         const signed_transaction&  get_recent_transaction( const transaction_id_type& trx_id )const;
+         /** @return the packed form of the block, without re-packing it if it comes from the block database */
+         std::shared_ptr<const vector<char>> fetch_packed_block_by_id( const block_id_type& id )const;
+         /** @return the lowest block number that can still be fetched, older blocks have been pruned */
+         uint32_t                   earliest_available_block_num()const;
+         signed_transaction         get_recent_transaction( const transaction_id_type& trx_id )const;
+         /** @return the id of the latest block whose number ends in the 16 bits of ref_block_num, for TaPoS */
+         const block_id_type&       get_tapos_block_id( uint16_t ref_block_num )const
+         { return _block_summaries.get( ref_block_num ); }
          std::vector<block_id_type> get_block_ids_on_fork(block_id_type head_of_fork) const;
 
          /**
@@ -134,30 +292,163 @@ namespace graphene { namespace chain {
          void                              add_checkpoints( const flat_map<uint32_t,block_id_type>& checkpts );
          const flat_map<uint32_t,block_id_type> get_checkpoints()const { return _checkpoints; }
          bool before_last_checkpoint()const;
+         /** true if block_num is at or below the last checkpoint, so its block is applied with trusted_skip_flags() */
+         bool is_trusted_block( uint32_t block_num )const;
+
+         /**
+          * Skip flags used for blocks at or below the last checkpoint.  Their ids are pinned by the checkpoint, so
+          * everything that does not change the resulting state is skipped, including the virtual operation history
+          * unless some observer asked for it with @ref require_applied_operations.
+          */
+         uint32_t trusted_skip_flags()const;
 
          bool push_block( const signed_block& b, uint32_t skip = skip_nothing );
+
+         /**
+          * Keep the changes of each reversible block which is popped, e.g. by a fork switch, so that pushing it
+          * on the same block again replays them instead of applying the block.  Replayed blocks signal
+          * applied_block with the operations the block applied, while is_replaying_block_diff() is set: what the
+          * observers keep in the object database was restored with the rest of the block's changes and must be
+          * left as it is, what they keep outside of it they handle as for any other block.  Without it, popped
+          * blocks are still applied again without checking their signatures, which passed on the same state before.
+          */
+         void set_fork_diff_replay( bool enabled ) { _fork_diff_replay = enabled; }
+         /** set while applied_block is signalled for a block restored from its changes, see set_fork_diff_replay() */
+         bool is_replaying_block_diff()const { return _replaying_block_diff; }
+
+         /**
+          * Squash the undo states of the blocks more than depth below the head into one, see
+          * undo_database::set_squash_depth.  The blocks in it can no longer be popped, so a fork switch deeper
+          * than depth is refused.  0, the default, never squashes.
+          */
+         void set_undo_squash_depth( uint32_t depth ) { _undo_db.set_squash_depth( depth ); }
+
+         /**
+          * Check the blocks of competing branches in the background as they arrive: their merkle roots,
+          * signatures and transactions, as far as that doesn't depend on the state.  A switch to such a branch
+          * then reuses the results, and a branch with a block which fails them is dropped before any block is
+          * popped for it.
+          */
+         void set_fork_prevalidation( bool enabled );
+
+         /**
+          * Computes the id, merkle root, signee and transaction ids of b.  This only reads b, so it may be called
+          * on any thread, typically for blocks that are still waiting for their turn to be pushed.  A trusted block,
+          * see @ref is_trusted_block, only gets its ids computed, its merkle root and signee are never checked.
+          */
+         static precomputed_block precompute_block( const signed_block& b, bool trusted = false );
+
+         /**
+          * Locks the state against changes, for reading it on a thread other than the one blocks and transactions
+          * are pushed on.  Pushing, popping and generating blocks and pushing or validating transactions wait for
+          * every such lock to be released; reads on the pushing thread itself need no lock.
+          */
+         boost::shared_lock<boost::shared_mutex> lock_state_for_reading()const
+         {
+            return boost::shared_lock<boost::shared_mutex>( _state_mutex );
+         }
+
+         /**
+          * Number of threads recovering the signature keys of a block's transactions before they are applied, 0
+          * recovers them as each transaction is applied.
+          */
+         void set_signature_threads( uint32_t thread_count );
+
+         /**
+          * Recovers the signature keys of every transaction of b on the signature threads.  The result is empty if
+          * there are no signature threads, and holds no value for transactions whose keys could not be recovered.
+          */
+         vector< optional< flat_set<public_key_type> > > recover_signature_keys( const signed_block& b,
+                                                                                  const chain_id_type& chain_id )const;
+
+         /** Pushes b using the results of precompute_block(b) instead of computing them again */
+         bool push_block( const signed_block& b, uint32_t skip, const precomputed_block& pre );
          processed_transaction push_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
+
+         /**
+          * Like push_transaction(), for a transaction the caller has already run validate() on and recovered the
+          * signature keys of, e.g. on another thread.
+          */
+         processed_transaction push_checked_transaction( const signed_transaction& trx,
+                                                         const flat_set<public_key_type>& signature_keys,
+                                                         uint32_t skip = skip_nothing );
+
+         /**
+          * Throws if push_transaction() would refuse trx for a reason that is cheap to find out: it is already known,
+          * it has expired or expires too far ahead, or its TaPoS doesn't refer to a block of our chain.  Meant for
+          * transactions from the network, so those are refused before their signature keys are recovered.
+          */
+         void precheck_transaction( const signed_transaction& trx )const;
+
+         /** outcome of pushing one transaction of a batch, exactly one of the members is set */
+         struct push_result
+         {
+            optional<processed_transaction> trx;
+            optional<fc::exception>         error;
+         };
+
+         /**
+          * Pushes each of trxs like push_transaction() does, in order, returning one result per transaction.  The
+          * checks that don't depend on the state, validate() and recovering the signature keys, are done for the
+          * whole batch up front on the signature threads.  A transaction that fails leaves no trace, the others are
+          * not affected.
+          */
+         vector<push_result> push_transactions( const vector<signed_transaction>& trxs, uint32_t skip = skip_nothing );
          bool _push_block( const signed_block& b );
-         processed_transaction _push_transaction( const signed_transaction& trx );
+         /**
+          * signature_keys and validated pass on stateless checks that were already done, see push_transactions,
+          * and known_id the id of trx if the caller has it
+          */
+         processed_transaction _push_transaction( const signed_transaction& trx,
+                                                  const flat_set<public_key_type>* signature_keys = nullptr,
+                                                  bool validated = false,
+                                                  const transaction_id_type* known_id = nullptr );
 
          ///@throws fc::exception if the proposed transaction fails to apply.
          processed_transaction push_proposal( const proposal_object& proposal );
 
+         /**
+          * on_signed, if set, is called with the block once it is signed and before it is applied, e.g. to send it
+          * to the network without waiting for the applied_block handlers.  It must not yield.
+          */
          signed_block generate_block(
             const fc::time_point_sec when,
             witness_id_type witness_id,
             const fc::ecc::private_key& block_signing_private_key,
-            uint32_t skip
+            uint32_t skip,
+            const std::function<void(const signed_block&)>& on_signed = std::function<void(const signed_block&)>()
             );
          signed_block _generate_block(
             const fc::time_point_sec when,
             witness_id_type witness_id,
-            const fc::ecc::private_key& block_signing_private_key
+            const fc::ecc::private_key& block_signing_private_key,
+            const std::function<void(const signed_block&)>& on_signed = std::function<void(const signed_block&)>()
+            );
+
+         /**
+          * Builds and signs the block generate_block() would produce with the same arguments on top of the
+          * current head, ahead of its slot.  Transactions pushed in the meantime are added to it while they fit,
+          * so at the slot it only needs signing again; a new head block or a change to the pending transactions
+          * other than a push drops it, and generate_block() builds the block from scratch.
+          */
+         void prepare_block(
+            const fc::time_point_sec when,
+            witness_id_type witness_id,
+            const fc::ecc::private_key& block_signing_private_key,
+            uint32_t skip
             );
 
          void pop_block();
          void clear_pending();
 
+         /**
+          * Replaces the objects of the records with their packed values and removes the ones without, for a
+          * database which follows the state another one maintains rather than applying blocks.  Objects may have
+          * ids past the next id of their index.  No undo state is recorded, and subscribers are notified of the
+          * changes as after a block.
+          */
+         void apply_object_records( const vector<object_record>& records );
+
          /**
           *  This method is used to track appied operations during the evaluation of a block, these
           *  operations should include any operation actually included in a transaction as well
@@ -170,6 +461,14 @@ namespace graphene { namespace chain {
          uint32_t  push_applied_operation( const operation& op );
          void      set_applied_operation_result( uint32_t op_id, const operation_result& r );
          const vector<optional< operation_history_object > >& get_applied_operations()const;
+         /**
+          * The same operations as get_applied_operations(), to be kept past the applied_block signal, e.g. by
+          * a plugin handling the block on another thread.  Handing them out doesn't copy them, the database starts
+          * a new list for the operations recorded from then on instead.
+          */
+         std::shared_ptr< const vector<optional< operation_history_object > > > share_applied_operations()const;
+         /** called by observers of get_applied_operations(), so the history is built even for trusted blocks */
+         void      require_applied_operations() { _applied_operations_required = true; }
 
          string to_pretty_string( const asset& a )const;
 
@@ -191,12 +490,14 @@ namespace graphene { namespace chain {
 
          /**
           *  Emitted After a block has been applied and committed.  The callback
-          *  should not yield and should execute quickly.
+          *  should not yield and should execute quickly.  Lists the objects changed since the last time it was
+          *  emitted, see object_database::take_object_changes(), also while undo is disabled.
           */
          fc::signal<void(const vector<object_id_type>&)> changed_objects;
 
          /** this signal is emitted any time an object is removed and contains a
-          * pointer to the last value of every object that was removed.
+          * pointer to the last value of every object that was removed.  It comes right
+          * before the changed_objects signal that lists their ids.
           */
          fc::signal<void(const vector<const object*>&)>  removed_objects;
 
@@ -272,7 +573,7 @@ namespace graphene { namespace chain {
          void register_evaluator()
          {
             _operation_evaluators[
-               operation::tag<typename EvaluatorType::operation_type>::value].reset( new op_evaluator_impl<EvaluatorType>() );
+               operation::tag<typename EvaluatorType::operation_type>::value] = &evaluate_operation<EvaluatorType>;
          }
 
          //////////////////// db_balance.cpp ////////////////////
@@ -316,14 +617,62 @@ namespace graphene { namespace chain {
 
          // helper to handle cashback rewards
          void deposit_cashback(const account_object& acct, share_type amount, bool require_vesting = true);
+         /** the per account balances, and the holders of each asset by balance */
+         const balances_by_account_index& balances_by_account()const { return *_balances_by_account; }
+         /** the accounts by name and the assets by symbol, for lookups of single names */
+         const account_name_index& account_names()const { return *_account_names; }
+         const asset_symbol_index& asset_symbols()const { return *_asset_symbols; }
+         /** the limit orders of each market by price level, the books matching walks */
+         const limit_order_match_index& limit_order_books()const { return *_limit_order_books; }
+         /**
+          * The asset and its dynamic and bitasset data straight from the dense tables of their indexes, without
+          * the index dispatch of get(), for the lookups market operations repeat for every fill.
+          */
+         const asset_object& get_asset( asset_id_type id )const;
+         const asset_dynamic_data_object& get_dynamic_data( const asset_object& a )const;
+         const asset_bitasset_data_object& get_bitasset_data( const asset_object& a )const;
+         /** see proposal_object::is_authorized_to_execute */
+         proposal_authorization_index& proposal_authorizations() { return *_proposal_authorizations; }
+         /**
+          * The account whose authorities the authority checks read, looked up once per block rather than for every
+          * operation and nesting level, and again only once an account authority changes.
+          */
+         const account_object& authority_account( account_id_type id );
+         /// @return the balance of the account's cashback vesting balance, with the cashback maintenance has yet to deposit
+         share_type get_cashback_balance(const account_object& acct)const;
          // helper to handle witness pay
          void deposit_witness_pay(const witness_object& wit, share_type amount);
 
          //////////////////// db_debug.cpp ////////////////////
 
+         /** logs the assets whose supply doesn't match where it is held, see verify_supply_totals() */
          void debug_dump();
+         /**
+          * Checks that the supply of every asset is what the balances, orders, vesting balances, fee pools, fees and
+          * settlement funds hold, and that the core in orders is what the account statistics report.  The amounts
+          * held are totalled as they change by a supply_tally_index on each of their indexes, so this only reads
+          * the assets, and is cheap enough to run every block.
+          *
+          * @throws fc::assert_exception naming the first asset that doesn't match
+          */
+         void verify_supply_totals()const;
+         /** runs verify_supply_totals() after every block applied, logging the blocks after which it fails */
+         void set_supply_checks( bool enabled ) { _supply_checks = enabled; }
          void apply_debug_updates();
          void debug_update( const fc::variant_object& update );
+         /** adds all of the updates to the head block, which is applied again once rather than once for each */
+         void debug_update( const vector<fc::variant_object>& updates );
+
+         /**
+          * Starts collecting an apply_profile from scratch, or stops and forgets it if enabled is false.  Every
+          * operation applied is profiled, in blocks as well as in pending transactions, and every block applied.
+          * While enabled, the clock is read around every operation and every phase of applying a block.
+          */
+         void set_apply_profiling( bool enabled );
+         /** @return what has been collected since profiling was enabled, empty if it is not */
+         apply_profile get_apply_profile()const;
+         /** @return the profile of the last block applied while profiling, without copying all of the profile */
+         optional<block_apply_profile> get_last_block_profile()const;
 
          //////////////////// db_market.cpp ////////////////////
 
@@ -342,6 +691,17 @@ namespace graphene { namespace chain {
           */
          bool apply_order(const limit_order_object& new_order_object, bool allow_black_swan = true);
 
+         /**
+          * @brief Sells to the book what a buyback order would, without creating the order
+          *
+          * Matches amount_to_sell against the orders buying it with receive_asset, the way a limit order asking one
+          * satoshi of receive_asset for all of it and cancelled once it stops matching would, with the same fills,
+          * applied operations and object ids.  Throws where limit_order_create_evaluator would reject the order.
+          *
+          * @return false if the order has to be placed in the book to match the same, nothing is changed then
+          */
+         bool sweep_book( const account_object& seller, const asset& amount_to_sell, const asset_object& receive_asset );
+
          /**
           * Matches the two orders,
           *
@@ -371,8 +731,11 @@ namespace graphene { namespace chain {
          bool fill_order( const force_settlement_object& settle, const asset& pays, const asset& receives );
 
          bool check_call_orders( const asset_object& mia, bool enable_black_swan = true );
+         /** @return false if check_call_orders() on mia would neither margin call nor globally settle anything */
+         bool margin_call_possible( const asset_object& mia )const;
 
          // helpers to fill_order
+         /** while apply_order() sweeps the book the changes are only recorded, see _fill_batch */
          void pay_order( const account_object& receiver, const asset& receives, const asset& pays );
 
          asset calculate_market_fee(const asset_object& recv_asset, const asset& trade_amount);
@@ -391,6 +754,18 @@ namespace graphene { namespace chain {
           * can be reapplied at the proper time */
          std::deque< signed_transaction >       _popped_tx;
 
+         /** Bounds the pending transactions, see @ref pending_transaction_pool */
+         void set_pending_transaction_limits( const pending_transaction_pool::limits& limits );
+         const pending_transaction_pool& get_pending_transaction_pool()const { return _pending_pool; }
+
+         /**
+          * Drops the expired transactions and, if they take more than the pending transaction limit, the lowest
+          * paying ones from txs.  Used before the pending transactions are applied again on top of a new head.
+          *
+          * @return the ids of the transactions kept, in their order, so they need not be hashed again
+          */
+         vector<transaction_id_type> trim_pending_transactions( vector<processed_transaction>& txs )const;
+
          /**
           * @}
           */
@@ -400,11 +775,69 @@ namespace graphene { namespace chain {
          void notify_changed_objects();
 
       private:
+         /** pushes b, whose transactions are the ones applied in _pending_tx_session, see _generate_block */
+         void push_prebuilt_block( const signed_block& b );
+
          optional<undo_database::session>       _pending_tx_session;
-         vector< unique_ptr<op_evaluator> >     _operation_evaluators;
+         /**
+          * Set while _pending_tx_session holds exactly the changes of _pending_tx, and _applied_ops their
+          * operations, on top of this head block.  _pending_tx_skip collects the skip flags they were applied with.
+          */
+         optional<block_id_type>                _pending_tx_head;
+         uint32_t                               _pending_tx_skip = 0;
+         /** selects, applies and signs the transactions of the next block, leaving them in _pending_tx_session */
+         signed_block _build_block( fc::time_point_sec when, witness_id_type witness_id,
+                                    const fc::ecc::private_key& block_signing_private_key );
 
+         /**
+          * Block built by prepare_block(), whose transactions are exactly the ones applied in _pending_tx_session.
+          * _block_candidate_size is its packed size and _block_candidate_skip the skip flags it was built with.
+          */
+         optional<signed_block>                 _block_candidate;
+         size_t                                 _block_candidate_size = 0;
+         uint32_t                               _block_candidate_skip = 0;
+         bool                                   _block_candidate_signed = false;
+         /** block whose transactions _apply_block finds already applied, see push_prebuilt_block */
+         const signed_block*                    _prebuilt_block = nullptr;
+         vector< op_evaluator >                 _operation_evaluators;
+
+         /**
+          * Brings the total_votes of the objects in Index up to date with the vote tally and returns the count with
+          * the most votes, in the order of their by_votes index.
+          */
          template<class Index>
-         vector<std::reference_wrapper<const typename Index::object_type>> sort_votable_objects(size_t count)const;
+         vector<std::reference_wrapper<const typename Index::object_type>> top_votable_objects(size_t count);
+
+         //////////////////// db_management.cpp ////////////////////
+
+         /** applies blocks first_block_num and up from the block log, reading ahead on _replay_threads threads */
+         void replay_blocks( const fc::path& data_dir, uint32_t first_block_num, uint32_t last_block_num );
+         void write_snapshot( const fc::path& dir );
+         /** starts or completes a state checkpoint after a block was applied */
+         void update_state_checkpoint();
+         void start_state_checkpoint();
+         /** waits for the pending checkpoint to be written and completes it if its block is irreversible */
+         void finish_state_checkpoint();
+         /** starts a background flush after a block was applied, or completes a finished one */
+         void update_background_flush();
+         /**
+          * waits for the pending background flush and moves what it wrote into place, after a failed one the next
+          * flush writes every index
+          */
+         void finish_background_flush();
+         /** loads what goes with the object database just opened from state_dir and replays the blocks after it */
+         void replay_after_state( const fc::path& data_dir, const fc::path& state_dir, const fc::path& info_file );
+
+         //////////////////// db_debug.cpp ////////////////////
+
+         /** puts the objects packed in file in their indexes, for an "import" debug update */
+         void debug_import_objects( const fc::path& file );
+         /** evaluates and applies op with eval, adding to the profile of its type */
+         operation_result profile_operation( op_evaluator eval, transaction_evaluation_state& eval_state,
+                                             const operation& op );
+         void record_block_profile( block_apply_profile& block, fc::time_point start );
+
+         optional<apply_profile>                _apply_profile;
 
          //////////////////// db_block.cpp ////////////////////
 
@@ -423,11 +856,15 @@ namespace graphene { namespace chain {
          const witness_object& validate_block_header( uint32_t skip, const signed_block& next_block )const;
          const witness_object& _validate_block_header( const signed_block& next_block )const;
          void create_block_summary(const signed_block& next_block);
+         /** fills in the block summaries of a state saved without them from the block log, which must not be pruned below them */
+         void rebuild_block_summaries();
 
          //////////////////// db_update.cpp ////////////////////
          void update_global_dynamic_data( const signed_block& b );
          void update_signing_witness(const witness_object& signing_witness, const signed_block& new_block);
          void update_last_irreversible_block();
+         /** the objects of the active witnesses, looked up again only once the active set or the witness objects change */
+         const vector<const witness_object*>& active_witness_objects();
          void clear_expired_transactions();
          void clear_expired_proposals();
          void clear_expired_orders();
@@ -449,12 +886,17 @@ namespace graphene { namespace chain {
          void update_active_committee_members();
          void update_worker_votes();
 
-         template<class... Types>
-         void perform_account_maintenance(std::tuple<Types...> helpers);
+         /**
+          * Fills the vote tally buffers and pays out the accounts' pending fees.  The totals of the last maintenance
+          * are updated for the accounts that changed since, see @ref vote_tally_object.
+          */
+         void tally_votes_and_process_fees( const global_property_object& props );
          ///@}
          ///@}
 
          vector< processed_transaction >        _pending_tx;
+         /** indexes _pending_tx, entry positions are indices into it */
+         pending_transaction_pool               _pending_pool;
          fork_database                          _fork_db;
 
          /**
@@ -468,13 +910,199 @@ namespace graphene { namespace chain {
           */
          block_database   _block_id_to_block;
 
+         /**
+          * Ids of the main chain blocks _recent_first_num and up to the head, covering at least the reversible
+          * blocks.  Peers syncing from us mostly ask about those, so get_block_id_for_num() and the synopsis
+          * built from it don't have to go through the block log.
+          */
+         std::deque<block_id_type>        _recent_block_ids;
+         uint32_t                         _recent_first_num = 0;
+         void                             note_applied_block( uint32_t block_num, const block_id_type& id );
+         void                             note_popped_block( uint32_t block_num );
+
+         /** the digests of the most recent blocks, the last one is of the head block */
+         std::deque<block_state_digest>   _state_digests;
+         uint32_t                         _state_digest_blocks = 0;
+
+         /** see verify_supply_totals() */
+         vector<const supply_tally_index*> _supply_tallies;
+         bool                              _supply_checks = false;
+
+         /** the changes a popped block made, which turn the state of its previous block into its own */
+         struct block_diff
+         {
+            /** the packed values after the block of the objects it modified */
+            vector< std::pair< object_id_type, vector<char> > >   modified;
+            vector< unique_ptr<object> >                          created;
+            vector< object_id_type >                              removed;
+            /** the next id of each index the block used ids of, by index */
+            vector< std::pair< object_id_type, object_id_type > > next_ids;
+            /** whether the transactions of the block were recorded for the duplicate check */
+            bool                                                  recorded_transactions = false;
+            /** what get_applied_operations() held when the block was applied */
+            std::shared_ptr< const vector< optional<operation_history_object> > > applied_ops;
+         };
+         /** a reversible block which was applied and popped, see set_fork_diff_replay() */
+         struct popped_block
+         {
+            block_id_type                    previous;
+            std::shared_ptr<block_diff>      diff;
+         };
+         bool                                           _fork_diff_replay = false;
+         bool                                           _replaying_block_diff = false;
+         std::map< block_id_type, popped_block >        _popped_blocks;
+         /** the applied operations of each reversible block, kept for its diff if it is popped */
+         std::map< block_id_type, std::shared_ptr< const vector< optional<operation_history_object> > > >
+                                                        _reversible_applied_ops;
+         /** records the head block, which is about to be popped, in _popped_blocks */
+         void                             remember_popped_block( const signed_block& b, const block_id_type& id );
+
+         /** the stateless checks of a block on a competing branch, see set_fork_prevalidation() */
+         struct fork_block_checks
+         {
+            precomputed_block pre;
+            /** false if the block fails a check which doesn't depend on the state, it can never be applied */
+            bool              valid = true;
+         };
+         typedef std::shared_ptr<const fork_block_checks> fork_block_checks_ptr;
+         std::unique_ptr<fc::thread>                                  _fork_checker;
+         std::map< block_id_type, fc::future<fork_block_checks_ptr> > _fork_block_checks;
+         void                             start_fork_block_checks( const signed_block& b, const block_id_type& id );
+         /** waits for and removes the checks of a block, null if it was not checked */
+         fork_block_checks_ptr            take_fork_block_checks( const block_id_type& id );
+         /** drops the checks and popped blocks which are irreversible */
+         void                             prune_fork_state();
+         /**
+          * applies b on the head block, from the changes it made if it was popped from there before, using checks
+          * made in the background if there are any
+          */
+         void                             reapply_block( const signed_block& b, const block_id_type& id, uint32_t skip,
+                                                         const fork_block_checks* checks = nullptr );
+         void                             replay_block_diff( const signed_block& b, const block_id_type& id,
+                                                             const block_diff& diff );
+
+         /** set for the transaction applied next, by _apply_block or _push_transaction, see _apply_transaction */
+         const transaction_id_type*       _current_trx_id = nullptr;
+         const flat_set<public_key_type>* _current_trx_keys = nullptr;
+         bool                             _current_trx_validated = false;
+
+         vector< std::unique_ptr<fc::thread> > _signature_threads;
+
+         /** the results of the stateless checks of a block transaction, made before the block is applied */
+         struct checked_transaction
+         {
+            /** holds no value if the keys were not recovered, or could not be */
+            optional< flat_set<public_key_type> > keys;
+            /** false if the transaction was not validated, or is invalid */
+            bool                                  validated = false;
+         };
+         /**
+          * Recovers the signature keys of the transactions of b, validates them or both, on the signature threads.
+          * The result is empty if there are no signature threads.  The transactions which fail are only reported
+          * when they are applied, in order.
+          */
+         vector<checked_transaction> check_block_transactions( const signed_block& b, const chain_id_type& chain_id,
+                                                               bool recover_keys, bool validate )const;
+
+         /** see lock_state_for_reading(), taken exclusively by a state_write_guard */
+         mutable boost::shared_mutex           _state_mutex;
+         /**
+          * taken by the outermost state_write_guard of a fiber before _state_mutex, so another fiber of the same
+          * thread waits for it by yielding rather than blocking the thread or changing the state alongside it
+          */
+         fc::mutex                             _state_write_mutex;
+         /** state_write_guards nest within a fiber, only the outermost one of each fiber takes the locks */
+         fc::task_specific_ptr<uint32_t>       _state_write_depth;
+         class state_write_guard;
+
+         /**
+          * Balance, order total and market fee changes of the fills made while apply_order() matches a new order,
+          * summed per account and asset and applied once the order stops matching.  They only ever add to a
+          * balance and the fills don't read them, so deferring them doesn't change the outcome.
+          */
+         struct fill_batch
+         {
+            map< pair<account_id_type,asset_id_type>, share_type > balances;
+            map< account_id_type, share_type >                     core_in_orders;
+            map< asset_id_type, share_type >                       market_fees;
+         };
+         const balances_by_account_index* _balances_by_account = nullptr;
+         const account_name_index*        _account_names = nullptr;
+         const asset_symbol_index*        _asset_symbols = nullptr;
+         const limit_order_match_index*   _limit_order_books = nullptr;
+         proposal_authorization_index*    _proposal_authorizations = nullptr;
+         const authority_change_index*    _authority_changes = nullptr;
+         /** see authority_account(), valid for the block _authority_accounts_block and the authority changes
+          *  _authority_accounts_changes, by account instance */
+         std::unordered_map<uint64_t, const account_object*> _authority_accounts;
+         uint32_t                         _authority_accounts_block = 0;
+         uint64_t                         _authority_accounts_changes = 0;
+         const witness_node_index*        _witness_nodes = nullptr;
+         /** see active_witness_objects(), valid while the active witnesses are _active_witness_ids and the witness
+          *  node count is _active_witness_nodes */
+         vector<const witness_object*>    _active_witness_objs;
+         flat_set<witness_id_type>        _active_witness_ids;
+         uint64_t                         _active_witness_nodes = 0;
+         /** reused by update_last_irreversible_block */
+         vector<const witness_object*>    _irreversible_witness_objs;
+         /** see get_asset() */
+         const asset_index*                               _assets = nullptr;
+         const simple_index<asset_dynamic_data_object>*   _asset_dynamic_data = nullptr;
+         const asset_bitasset_data_index*                 _asset_bitasset_data = nullptr;
+         /** the feed expirations of the bitassets, and the bitassets the asset and bitasset indexes changed */
+         feed_update_index*               _bitasset_feeds = nullptr;
+         feed_update_index*               _asset_feeds = nullptr;
+         /** the transactions applied which have not expired, to reject them if they are applied again */
+         transaction_dedupe               _recent_transactions{ _undo_db };
+         block_summaries                  _block_summaries{ _undo_db };
+
+         std::unique_ptr<fill_batch>      _fill_batch;
+         void                             apply_fill_batch();
+
+         /**
+          * The cashback deposit_cashback pays while maintenance pays out fees, kept as each account's cashback vesting
+          * balance will be after all of its deposits and written once the fees are paid out.  New vesting balances
+          * are created in the order their accounts first received cashback, which is the order deposit_cashback
+          * would have created them in, so the outcome is the same as depositing each payment as it is made.
+          */
+         struct cashback_batch
+         {
+            struct deposit
+            {
+               account_id_type                     account;
+               /** the vesting balance to deposit into, none if it is to be created */
+               optional< vesting_balance_id_type > existing;
+               vesting_balance_object              balance;
+            };
+            vector< deposit >                      deposits;
+            map< account_id_type, size_t >         by_account;
+            /** cashback to the blockchain's own accounts, which goes back to the reserve pool */
+            share_type                             to_reserve;
+            /** accounts that received cashback since maintenance last took them, see take_cashback_recipients */
+            vector< account_id_type >              recipients;
+         };
+         std::unique_ptr<cashback_batch>  _cashback_batch;
+         void                             apply_cashback_batch();
+         /** moves the accounts that received cashback since the last call to the end of recipients */
+         void                             take_cashback_recipients( vector<account_id_type>& recipients );
+
+         /** precomputed checks of the block being pushed, only used while _precomputed_block is applied */
+         const signed_block*              _precomputed_block = nullptr;
+         const precomputed_block*         _precomputed = nullptr;
+         const precomputed_block*         precomputed_for( const signed_block& b )const
+         { return &b == _precomputed_block ? _precomputed : nullptr; }
+
          /**
           * Contains the set of ops that are in the process of being applied from
           * the current block.  It contains real and virtual operations in the
           * order they occur and is cleared after the applied_block signal is
-          * emited.
+          * emited.  Once share_applied_operations() has handed it out it is never changed again, see
+          * writable_applied_ops().
           */
-         vector<optional<operation_history_object> >  _applied_ops;
+         std::shared_ptr< vector<optional<operation_history_object> > >  _applied_ops =
+               std::make_shared< vector<optional<operation_history_object> > >();
+         vector<optional<operation_history_object> >&                    writable_applied_ops();
+         void                                                            clear_applied_ops();
 
          uint32_t                          _current_block_num    = 0;
          uint16_t                          _current_trx_in_block = 0;
@@ -488,26 +1116,36 @@ namespace graphene { namespace chain {
 
          flat_map<uint32_t,block_id_type>  _checkpoints;
 
+         uint32_t                          _replay_threads     = 1;
+         uint32_t                          _replay_queue_depth = 256;
+         uint32_t                          _replay_skip        = default_replay_skip;
+         uint32_t                          _replay_last_block  = 0;
+         /** set when a replay stopped at _replay_last_block, the state is then not saved on close */
+         bool                              _replay_stopped_early = false;
+         replay_statistics                 _replay_statistics;
+         uint32_t                          _block_log_retain_blocks = 0;
+
+         uint32_t                          _snapshot_block_num = 0;
+         bool                              _applied_operations_required = false;
+         fc::path                          _snapshot_dir;
+
+         uint32_t                          _state_checkpoint_interval = 0;
+         fc::path                          _state_checkpoint_dir;
+         /** the checkpoint being written, 0 if none */
+         uint32_t                          _pending_checkpoint_num = 0;
+         block_id_type                     _pending_checkpoint_id;
+         fc::future<void>                  _pending_checkpoint_write;
+         uint32_t                          _flush_interval = 0;
+         bool                              _flush_pending = false;
+         uint32_t                          _flush_block_num = 0;
+         block_id_type                     _flush_block_id;
+         fc::future<void>                  _flush_write;
+         /** writes checkpoints and background flushes, one at a time */
+         std::unique_ptr<fc::thread>       _state_writer;
+
          node_property_object              _node_property_object;
    };
 
-   namespace detail
-   {
-       template<int... Is>
-       struct seq { };
-
-       template<int N, int... Is>
-       struct gen_seq : gen_seq<N - 1, N - 1, Is...> { };
-
-       template<int... Is>
-       struct gen_seq<0, Is...> : seq<Is...> { };
-
-       template<typename T, int... Is>
-       void for_each(T&& t, const account_object& a, seq<Is...>)
-       {
-           auto l = { (std::get<Is>(t)(a), 0)... };
-           (void)l;
-       }
-   }
-
 } }
+
+FC_REFLECT( graphene::chain::block_state_digest, (block_num)(block_id)(state) )
@@ -88,14 +88,18 @@ struct pending_transactions_restorer
          }
       }
       _db._popped_tx.clear();
-      for( const processed_transaction& tx : _pending_transactions )
+      // each id is computed once, here, rather than by every check and every index it goes through
+      const auto ids = _db.trim_pending_transactions( _pending_transactions );
+      for( size_t i = 0; i < _pending_transactions.size(); ++i )
       {
+         const processed_transaction& tx = _pending_transactions[i];
          try
          {
-            if( !_db.is_known_transaction( tx.id() ) ) {
+            if( !_db.is_known_transaction( ids[i] ) ) {
                // since push_transaction() takes a signed_transaction,
                // the operation_results field will be ignored.
-               _db._push_transaction( tx );
+               // validate() passed when it was first pushed and doesn't depend on the state.
+               _db._push_transaction( tx, nullptr, true, &ids[i] );
             }
          }
          catch( const fc::exception& e )
@@ -117,23 +117,8 @@ namespace graphene { namespace chain {
       transaction_evaluation_state*    trx_state;
    };
 
-   class op_evaluator
-   {
-   public:
-      virtual ~op_evaluator(){}
-      virtual operation_result evaluate(transaction_evaluation_state& eval_state, const operation& op, bool apply) = 0;
-   };
-
-   template<typename T>
-   class op_evaluator_impl : public op_evaluator
-   {
-   public:
-      virtual operation_result evaluate(transaction_evaluation_state& eval_state, const operation& op, bool apply = true) override
-      {
-         T eval;
-         return eval.start_evaluate(eval_state, op, apply);
-      }
-   };
+   /** evaluates op, and applies it if apply is set, see @ref evaluate_operation */
+   typedef operation_result (*op_evaluator)( transaction_evaluation_state& eval_state, const operation& op, bool apply );
 
    template<typename DerivedEvaluator>
    class evaluator : public generic_evaluator
@@ -165,7 +150,8 @@ namespace graphene { namespace chain {
          const auto& op = o.get<typename DerivedEvaluator::operation_type>();
 
          convert_fee();
-         pay_fee();
+         // qualified, so the call is resolved at compile time; *this is always a DerivedEvaluator
+         eval->DerivedEvaluator::pay_fee();
 
          auto result = eval->do_apply(op);
 
@@ -173,5 +159,42 @@ namespace graphene { namespace chain {
 
          return result;
       }
+
+      /**
+       * Does what start_evaluate() does without going through the virtual interface, for callers that know the
+       * concrete evaluator type.
+       */
+      operation_result start_evaluate_direct(transaction_evaluation_state& eval_state, const operation& op, bool apply)
+      { try {
+         trx_state = &eval_state;
+         if( eval_state.timing == nullptr )
+         {
+            auto result = evaluator::evaluate( op );
+            if( apply ) result = evaluator::apply( op );
+            return result;
+         }
+
+         fc::time_point start = fc::time_point::now();
+         auto result = evaluator::evaluate( op );
+         fc::time_point evaluated = fc::time_point::now();
+         eval_state.timing->evaluate = evaluated - start;
+         if( apply )
+         {
+            result = evaluator::apply( op );
+            eval_state.timing->apply = fc::time_point::now() - evaluated;
+         }
+         return result;
+      } FC_CAPTURE_AND_RETHROW() }
    };
+
+   /**
+    * The database keeps one instance of this function per registered evaluator in a table indexed by operation
+    * tag.  The evaluator lives on the stack and every call it makes is resolved at compile time.
+    */
+   template<typename EvaluatorType>
+   operation_result evaluate_operation(transaction_evaluation_state& eval_state, const operation& op, bool apply)
+   {
+      EvaluatorType eval;
+      return eval.start_evaluate_direct(eval_state, op, apply);
+   }
 } }
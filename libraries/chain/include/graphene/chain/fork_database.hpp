@@ -30,6 +30,7 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 
+#include <deque>
 
 namespace graphene { namespace chain {
    using boost::multi_index_container;
@@ -37,13 +38,13 @@ namespace graphene { namespace chain {
 
    struct fork_item
    {
+      fork_item(){}
       fork_item( signed_block d )
       :num(d.block_num()),id(d.id()),data( std::move(d) ){}
 
       block_id_type previous_id()const { return data.previous; }
 
-      weak_ptr< fork_item > prev;
-      uint32_t              num;    // initialized in ctor
+      uint32_t              num = 0;
       /**
        * Used to flag a block as invalid and prevent other blocks from
        * building on top of it.
@@ -51,8 +52,18 @@ namespace graphene { namespace chain {
       bool                  invalid = false;
       block_id_type         id;
       signed_block          data;
+
+   private:
+      friend class fork_database;
+      static const uint32_t no_slot = uint32_t(-1);
+
+      bool                  in_use = false;
+      uint32_t              slot = no_slot;
+      /** slot of the previous block, only valid if that slot still holds data.previous */
+      uint32_t              prev_slot = no_slot;
    };
-   typedef shared_ptr<fork_item> item_ptr;
+   /** points into the fork database, valid until the block is removed or pruned from it */
+   typedef const fork_item* item_ptr;
 
 
    /**
@@ -64,6 +75,11 @@ namespace graphene { namespace chain {
     *
     *  Every time a block is pushed into the fork DB the
     *  block with the highest block_num will be returned.
+    *
+    *  Blocks live in an arena of reusable slots and link to their previous block by slot
+    *  number.  They are found through a ring of per-height slot lists indexed by block
+    *  number, which is also encoded in the block id, so lookups don't need a hash index and
+    *  pushing, branch walks, and pruning don't allocate once the arena has warmed up.
     */
    class fork_database
    {
@@ -77,16 +93,18 @@ namespace graphene { namespace chain {
 
          void                             start_block(signed_block b);
          void                             remove(block_id_type b);
-         void                             set_head(shared_ptr<fork_item> h);
+         void                             set_head(item_ptr h);
          bool                             is_known_block(const block_id_type& id)const;
-         shared_ptr<fork_item>            fetch_block(const block_id_type& id)const;
+         item_ptr                         fetch_block(const block_id_type& id)const;
          vector<item_ptr>                 fetch_block_by_number(uint32_t n)const;
 
          /**
           *  @return the new head block ( the longest fork )
           */
-         shared_ptr<fork_item>            push_block(const signed_block& b);
-         shared_ptr<fork_item>            head()const { return _head; }
+         item_ptr                         push_block(const signed_block& b);
+         /** as above, with the id of b already known */
+         item_ptr                         push_block(const signed_block& b, const block_id_type& id);
+         item_ptr                         head()const { return _head; }
          void                             pop_block();
 
          /**
@@ -96,29 +114,29 @@ namespace graphene { namespace chain {
          pair< branch_type, branch_type >  fetch_branch_from(block_id_type first,
                                                              block_id_type second)const;
 
-         struct block_id;
-         struct block_num;
-         struct by_previous;
-         typedef multi_index_container<
-            item_ptr,
-            indexed_by<
-               hashed_unique<tag<block_id>, member<fork_item, block_id_type, &fork_item::id>, std::hash<fc::ripemd160>>,
-               hashed_non_unique<tag<by_previous>, const_mem_fun<fork_item, block_id_type, &fork_item::previous_id>, std::hash<fc::ripemd160>>,
-               ordered_non_unique<tag<block_num>, member<fork_item,uint32_t,&fork_item::num>>
-            >
-         > fork_multi_index_type;
-
          void set_max_size( uint32_t s );
 
       private:
-         /** @return a pointer to the newly pushed item */
-         void _push_block(const item_ptr& b );
-         void _push_next(const item_ptr& newly_inserted);
+         void      _push_block( fork_item& item );
+         fork_item& allocate( const signed_block& b, const block_id_type& id );
+         void      release( fork_item& item );
+         /** @return the previous block of item, or nullptr if it is not in the database */
+         item_ptr  prev( item_ptr item )const;
+         vector<uint32_t>&       slots_at( uint32_t num )       { return _by_num[ num & (_by_num.size() - 1) ]; }
+         const vector<uint32_t>& slots_at( uint32_t num )const { return _by_num[ num & (_by_num.size() - 1) ]; }
+         /** resizes the ring to hold at least count heights and re-files every block */
+         void      resize_ring( size_t count );
+         /** releases every block below min_num */
+         void      prune_below( uint32_t min_num );
 
          uint32_t                 _max_size = 1024;
 
-         fork_multi_index_type    _unlinked_index;
-         fork_multi_index_type    _index;
-         shared_ptr<fork_item>    _head;
+         std::deque<fork_item>    _items;      ///< the arena, a deque so item_ptrs stay valid as it grows
+         vector<uint32_t>         _free_slots;
+         /** _by_num[num % size] lists the slots holding blocks at height num, size is a power of two */
+         vector< vector<uint32_t> > _by_num;
+         uint32_t                 _lowest_num = 0;  ///< no block below this height is stored
+         uint32_t                 _highest_num = 0; ///< no block above this height is stored
+         item_ptr                 _head = nullptr;
    };
 } } // graphene::chain
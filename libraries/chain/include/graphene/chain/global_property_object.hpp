@@ -124,6 +124,9 @@ namespace graphene { namespace chain {
    };
 }}
 
+GRAPHENE_DECLARE_PRIMARY_INDEX( graphene::chain::dynamic_global_property_object,
+                                graphene::db::simple_index<graphene::chain::dynamic_global_property_object> )
+
 FC_REFLECT_DERIVED( graphene::chain::dynamic_global_property_object, (graphene::db::object),
                     (head_block_number)
                     (head_block_id)
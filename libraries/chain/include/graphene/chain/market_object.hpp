@@ -30,6 +30,8 @@
 
 #include <boost/multi_index/composite_key.hpp>
 
+#include <unordered_map>
+
 namespace graphene { namespace chain {
 
 using namespace graphene::db;
@@ -92,11 +94,109 @@ typedef multi_index_container<
             member<object, object_id_type, &object::id>
          >
       >
-   >
+   >,
+   graphene::db::pool_allocator<limit_order_object>
 > limit_order_multi_index_type;
 
 typedef generic_index<limit_order_object, limit_order_multi_index_type> limit_order_index;
 
+/** all limit orders selling at one price */
+struct order_book_level
+{
+   price      sell_price;      ///< the price of the first order placed at this level
+   share_type for_sale;        ///< in sell_price.base
+   uint32_t   order_count = 0;
+};
+
+/**
+ *  @brief Aggregates the limit orders of every market by price, so that order books can be read level by level
+ *  instead of order by order.
+ *
+ *  Levels are sorted like the @ref by_price index of limit_order_index: by market, then best price first.
+ */
+class limit_order_book_index : public secondary_index
+{
+   public:
+      typedef std::map< price, order_book_level, std::greater<price> > level_map;
+
+      virtual void object_inserted( const object& obj ) override;
+      virtual void object_removed( const object& obj ) override;
+      virtual void about_to_modify( const object& before ) override;
+      virtual void object_modified( const object& after  ) override;
+
+      /** only used by the API, so modifications are coalesced until the index is read */
+      virtual bool defer_modifications()const override { return true; }
+      virtual bool is_relevant_change( const object& before, const object& after )const override;
+
+      const level_map& levels()const { return _levels; }
+
+      /** changes whenever a level of the market (a,b), a < b, changes, so readers can skip unchanged markets */
+      uint64_t market_revision( const pair<asset_id_type,asset_id_type>& market )const
+      {
+         auto itr = _revisions.find( market );
+         return itr == _revisions.end() ? 0 : itr->second;
+      }
+
+   private:
+      void add( const price& sell_price, share_type for_sale );
+      void subtract( const price& sell_price, share_type for_sale );
+
+      level_map  _levels;
+      map< pair<asset_id_type,asset_id_type>, uint64_t > _revisions;
+      price      _before_price;
+      share_type _before_for_sale;
+};
+
+/**
+ *  @brief The limit orders of every market by side, price level and age, which matching walks instead of the
+ *  @ref by_price index of limit_order_index.
+ *
+ *  A side is the orders selling one asset for another.  It keeps its price levels in a vector from the worst price
+ *  to the best, so that the best level, where most orders are placed and filled, is at the end, and each level keeps
+ *  its orders oldest first.  Walking a side from first() with next() visits the orders in the by_price order, and
+ *  the lookups only search the few levels of one side instead of every order of every market.
+ */
+class limit_order_match_index : public secondary_index
+{
+   public:
+      struct level
+      {
+         price                              sell_price;  ///< the price of the first order placed at this level
+         vector<const limit_order_object*>  orders;      ///< by id
+      };
+      /** worst price first */
+      typedef vector<level> side;
+
+      virtual void object_inserted( const object& obj ) override;
+      virtual void object_removed( const object& obj ) override;
+      virtual void about_to_modify( const object& before ) override;
+      virtual void object_modified( const object& after  ) override;
+
+      /** @return the levels of the orders selling sell for receive, null if there are none */
+      const side* find_side( asset_id_type sell, asset_id_type receive )const;
+      /** @return the best order selling sell for receive, the oldest of those at the best price, null if none */
+      const limit_order_object* first( asset_id_type sell, asset_id_type receive )const;
+      /** @return the order after o on its side, null if o is the last one */
+      const limit_order_object* next( const limit_order_object& o )const;
+
+   private:
+      struct side_hash
+      {
+         size_t operator()( const pair<asset_id_type,asset_id_type>& k )const
+         {
+            return std::hash<uint64_t>()( ( uint64_t( k.first.instance.value ) << 32 ) ^ k.second.instance.value );
+         }
+      };
+
+      /** @return the index of the level of sell_price in s, or of where to insert it */
+      static size_t find_level( const side& s, const price& sell_price );
+      void add( const limit_order_object& o );
+      void remove( const limit_order_object& o, const price& sell_price );
+
+      std::unordered_map< pair<asset_id_type,asset_id_type>, side, side_hash > _sides;
+      price _before_price;
+};
+
 /**
  * @class call_order_object
  * @brief tracks debt and call price information
@@ -169,7 +269,8 @@ typedef multi_index_container<
             member< object, object_id_type, &object::id >
          >
       >
-   >
+   >,
+   graphene::db::pool_allocator<call_order_object>
 > call_order_multi_index_type;
 
 struct by_expiration;
@@ -190,7 +291,8 @@ typedef multi_index_container<
             member< object, object_id_type, &object::id >
          >
       >
-   >
+   >,
+   graphene::db::pool_allocator<force_settlement_object>
 > force_settlement_object_multi_index_type;
 
 typedef generic_index<call_order_object, call_order_multi_index_type>                      call_order_index;
@@ -198,6 +300,9 @@ typedef generic_index<force_settlement_object, force_settlement_object_multi_ind
 
 } } // graphene::chain
 
+GRAPHENE_DECLARE_PRIMARY_INDEX( graphene::chain::limit_order_object, graphene::chain::limit_order_index )
+GRAPHENE_DECLARE_PRIMARY_INDEX( graphene::chain::call_order_object, graphene::chain::call_order_index )
+
 FC_REFLECT_DERIVED( graphene::chain::limit_order_object,
                     (graphene::db::object),
                     (expiration)(seller)(for_sale)(sell_price)(deferred_fee)
@@ -210,3 +315,5 @@ FC_REFLECT_DERIVED( graphene::chain::force_settlement_object,
                     (graphene::db::object),
                     (owner)(balance)(settlement_date)
                   )
+
+FC_REFLECT( graphene::chain::order_book_level, (sell_price)(for_sale)(order_count) )
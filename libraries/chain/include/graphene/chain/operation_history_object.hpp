@@ -106,12 +106,14 @@ typedef multi_index_container<
    account_transaction_history_object,
    indexed_by<
       ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
+      /// the history of an account by position, for paging through it without walking the next links
       ordered_unique< tag<by_seq>,
          composite_key< account_transaction_history_object,
             member< account_transaction_history_object, account_id_type, &account_transaction_history_object::account>,
             member< account_transaction_history_object, uint32_t, &account_transaction_history_object::sequence>
          >
       >,
+      /// the history of an account by operation id
       ordered_unique< tag<by_op>,
          composite_key< account_transaction_history_object,
             member< account_transaction_history_object, account_id_type, &account_transaction_history_object::account>,
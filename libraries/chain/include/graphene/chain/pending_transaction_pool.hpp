@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/protocol/transaction.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/composite_key.hpp>
+
+namespace graphene { namespace chain {
+   using boost::multi_index_container;
+   using namespace boost::multi_index;
+
+   class database;
+
+   /**
+    * @brief Indexes the pending transactions of a database
+    *
+    * The transactions themselves are kept by the database in the order they were applied to the pending state.
+    * The pool tracks them by id, expiration, fee rate and fee paying account, so that the database can bound
+    * their total size and the number paid for by any one account, evict the ones paying the least when full,
+    * and fill a block with the best paying ones first when they don't all fit.
+    */
+   class pending_transaction_pool
+   {
+      public:
+         struct limits
+         {
+            uint64_t max_bytes = 0;        ///< total packed size of the pending transactions, 0 for no limit
+            uint32_t max_per_account = 0;  ///< pending transactions paid for by one account, 0 for no limit
+         };
+
+         struct entry
+         {
+            transaction_id_type id;
+            fc::time_point_sec  expiration;
+            account_id_type     fee_payer;    ///< pays the fee of the first operation
+            uint64_t            fee_rate = 0; ///< core asset fees paid per kilobyte
+            uint32_t            size = 0;     ///< packed size
+            uint32_t            position = 0; ///< order in which the transaction was applied to the pending state
+         };
+
+         struct by_id;
+         struct by_expiration;
+         struct by_fee_rate;
+         struct by_fee_payer;
+         typedef multi_index_container<
+            entry,
+            indexed_by<
+               hashed_non_unique< tag<by_id>, member< entry, transaction_id_type, &entry::id >, std::hash<transaction_id_type> >,
+               ordered_non_unique< tag<by_expiration>, member< entry, fc::time_point_sec, &entry::expiration > >,
+               /// best paying first, earliest first among equals
+               ordered_unique< tag<by_fee_rate>,
+                  composite_key< entry,
+                     member< entry, uint64_t, &entry::fee_rate >,
+                     member< entry, uint32_t, &entry::position >
+                  >,
+                  composite_key_compare< std::greater<uint64_t>, std::less<uint32_t> >
+               >,
+               ordered_non_unique< tag<by_fee_payer>, member< entry, account_id_type, &entry::fee_payer > >
+            >
+         > index_type;
+
+         /** fees paid in other assets are valued at their core exchange rate, known_id is the id of trx if known */
+         static entry make_entry( const database& db, const signed_transaction& trx, uint32_t position,
+                                  const transaction_id_type* known_id = nullptr );
+
+         void          set_limits( const limits& l ) { _limits = l; }
+         const limits& get_limits()const { return _limits; }
+
+         /**
+          * Checks that e can be added without going over the limits.  If the pool is full but e pays more than
+          * some of the entries, those are evicted to make room for it and some more.
+          *
+          * @return positions of the entries that have to be removed before e is added
+          * @throws tx_pending_account_limit or tx_pending_pool_full if e may not be added
+          */
+         vector<uint32_t> check_admission( const entry& e )const;
+
+         /**
+          * Removes the entries that expire before now, then the lowest paying ones until the total size is within
+          * the limit.
+          *
+          * @return positions of the removed entries
+          */
+         vector<uint32_t> trim( fc::time_point_sec now );
+
+         /** @return the positions of all entries, best paying first */
+         vector<uint32_t> positions_by_priority()const;
+
+         void     add( const entry& e );
+         void     clear();
+         bool     contains( const transaction_id_type& id )const;
+         uint32_t count_paid_by( account_id_type account )const;
+         uint64_t total_bytes()const { return _total_bytes; }
+         size_t   size()const { return _entries.size(); }
+
+         const index_type& entries()const { return _entries; }
+
+      private:
+         limits     _limits;
+         index_type _entries;
+         uint64_t   _total_bytes = 0;
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::pending_transaction_pool::limits, (max_bytes)(max_per_account) )
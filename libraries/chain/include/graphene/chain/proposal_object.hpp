@@ -63,19 +63,64 @@ class proposal_object : public abstract_object<proposal_object>
  *
  *  This is a secondary index on the proposal_index
  *
- *  @note the set of required approvals is constant
+ *  Both the accounts whose approval is required and those which have approved are tracked.  The required
+ *  approvals are constant, the available ones change as the proposal is updated.
  */
 class required_approval_index : public secondary_index
 {
    public:
       virtual void object_inserted( const object& obj ) override;
       virtual void object_removed( const object& obj ) override;
-      virtual void about_to_modify( const object& before ) override{};
-      virtual void object_modified( const object& after  ) override{};
+      virtual void about_to_modify( const object& before ) override;
+      virtual void object_modified( const object& after  ) override;
 
       void remove( account_id_type a, proposal_id_type p );
 
       map<account_id_type, set<proposal_id_type> > _account_to_proposals;
+
+   private:
+      flat_set<account_id_type> get_accounts( const proposal_object& p )const;
+
+      flat_set<account_id_type> _before_accounts;
+};
+
+class authority_change_index;
+
+/**
+ *  Remembers whether the approvals of each proposal satisfied the authorities it requires when that was last
+ *  checked, so that checking again while nothing it depends on has changed doesn't verify the authorities again.
+ *  An entry is dropped when the approvals of its proposal change or the proposal is removed, and is ignored once
+ *  the authorities of any account or the maximum authority depth have changed since.
+ *
+ *  This is a secondary index on the proposal_index
+ */
+class proposal_authorization_index : public secondary_index
+{
+   public:
+      virtual void object_removed( const object& obj ) override;
+      virtual void about_to_modify( const object& before ) override;
+      virtual void object_modified( const object& after  ) override;
+
+      void set_authority_changes( const authority_change_index* changes ) { _authority_changes = changes; }
+
+      /** @return the result of the last check of p, if it is still current */
+      optional<bool> find( proposal_id_type p, uint8_t max_authority_depth )const;
+      void           store( proposal_id_type p, uint8_t max_authority_depth, bool authorized );
+
+   private:
+      struct entry
+      {
+         uint64_t authority_changes = 0;
+         uint8_t  max_authority_depth = 0;
+         bool     authorized = false;
+      };
+      std::map<proposal_id_type, entry> _entries;
+      const authority_change_index*     _authority_changes = nullptr;
+
+      /** the approvals of the proposal being modified */
+      flat_set<account_id_type>         _before_active;
+      flat_set<account_id_type>         _before_owner;
+      flat_set<public_key_type>         _before_keys;
 };
 
 struct by_expiration{};
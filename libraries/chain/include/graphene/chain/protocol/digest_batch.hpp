@@ -22,29 +22,16 @@
  * THE SOFTWARE.
  */
 #pragma once
-#include <graphene/db/object.hpp>
+#include <graphene/chain/protocol/types.hpp>
 
 namespace graphene { namespace chain {
-   using namespace graphene::db;
 
    /**
-    *  @brief tracks minimal information about past blocks to implement TaPOS
-    *  @ingroup object
-    *
-    *  When attempting to calculate the validity of a transaction we need to
-    *  lookup a past block and check its block hash and the time it occurred
-    *  so we can calculate whether the current transaction is valid and at
-    *  what time it should expire.
+    * Sets out[i] to the hash of in[2i] followed by in[2i+1] for each i below pairs, which is what
+    * hash_packed<digest_type>( in[2i], in[2i+1] ) returns, for a whole level of a merkle tree at a time.  Uses the
+    * SHA extensions of the CPU where it has them, and fc::sha256 otherwise.  out may be in, so a level can be
+    * replaced by the next one in place.
     */
-   class block_summary_object : public abstract_object<block_summary_object>
-   {
-      public:
-         static const uint8_t space_id = implementation_ids;
-         static const uint8_t type_id  = impl_block_summary_object_type;
+   void hash_digest_pairs( const digest_type* in, size_t pairs, digest_type* out );
 
-         block_id_type      block_id;
-   };
-
-} }
-
-FC_REFLECT_DERIVED( graphene::chain::block_summary_object, (graphene::db::object), (block_id) )
+} } // graphene::chain
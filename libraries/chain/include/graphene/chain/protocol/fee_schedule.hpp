@@ -57,12 +57,29 @@ namespace graphene { namespace chain {
        */
       void validate()const;
 
+      /**
+       *  @return the parameters of the operation with the given tag, or null if there are none.  Schedules
+       *  normally have the parameters of every operation, in tag order, so they are found by position.
+       */
+      const fee_parameters* find_parameters( int which )const
+      {
+         if( which >= 0 && size_t( which ) < parameters.size() )
+         {
+            auto itr = parameters.begin() + which;
+            if( itr->which() == which )
+               return &*itr;
+         }
+         fee_parameters key; key.set_which( which );
+         auto itr = parameters.find( key );
+         return itr == parameters.end() ? nullptr : &*itr;
+      }
+
       template<typename Operation>
       const typename Operation::fee_parameters_type& get()const
       {
-         auto itr = parameters.find( typename Operation::fee_parameters_type() );
-         FC_ASSERT( itr != parameters.end() );
-         return itr->template get<typename Operation::fee_parameters_type>();
+         const fee_parameters* p = find_parameters( fee_parameters::tag<typename Operation::fee_parameters_type>::value );
+         FC_ASSERT( p != nullptr );
+         return p->template get<typename Operation::fee_parameters_type>();
       }
       template<typename Operation>
       typename Operation::fee_parameters_type& get()
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace graphene { namespace chain { namespace detail {
+
+   /** maps keys to values, least recently used entries are evicted first */
+   template< typename Key, typename Value, typename Hash >
+   class lru_cache
+   {
+      public:
+         explicit lru_cache( size_t capacity ) : _capacity( capacity ) {}
+
+         void set_capacity( size_t entries )
+         {
+            std::lock_guard<std::mutex> guard( _mutex );
+            _capacity = entries;
+            while( _entries.size() > _capacity )
+               evict();
+         }
+
+         bool find( const Key& k, Value& result )
+         {
+            std::lock_guard<std::mutex> guard( _mutex );
+            auto itr = _entries.find( k );
+            if( itr == _entries.end() )
+               return false;
+            _order.splice( _order.begin(), _order, itr->second.position );
+            result = itr->second.value;
+            return true;
+         }
+
+         void clear()
+         {
+            std::lock_guard<std::mutex> guard( _mutex );
+            _entries.clear();
+            _order.clear();
+         }
+
+         void insert( const Key& k, const Value& value )
+         {
+            std::lock_guard<std::mutex> guard( _mutex );
+            if( _capacity == 0 || _entries.find( k ) != _entries.end() )
+               return;
+            if( _entries.size() >= _capacity )
+               evict();
+            _order.push_front( k );
+            _entries[k] = entry{ value, _order.begin() };
+         }
+
+      private:
+         struct entry
+         {
+            Value                            value;
+            typename std::list<Key>::iterator position;
+         };
+
+         void evict()
+         {
+            _entries.erase( _order.back() );
+            _order.pop_back();
+         }
+
+         std::mutex                                          _mutex;
+         size_t                                              _capacity;
+         std::list<Key>                                      _order;
+         std::unordered_map<Key, entry, Hash>                _entries;
+   };
+
+} } } // graphene::chain::detail
@@ -23,6 +23,7 @@
  */
 #pragma once
 #include <graphene/chain/protocol/types.hpp>
+#include <graphene/chain/protocol/lru_cache.hpp>
 
 namespace graphene { namespace chain {
 
@@ -64,6 +65,8 @@ namespace graphene { namespace chain {
 
       std::string get_message(const fc::ecc::private_key& priv,
                               const fc::ecc::public_key& pub)const;
+      /** decrypts the message with the shared secret of its from and to keys, as derived by get_shared_secret() */
+      std::string get_message(const fc::sha512& shared_secret)const;
    };
 
    /**
@@ -85,6 +88,44 @@ namespace graphene { namespace chain {
       static memo_message deserialize(const string& serial);
    };
 
+   /**
+    * @brief reads the memos to or from a set of private keys
+    *
+    * Deriving the shared secret of a memo costs an elliptic curve multiplication, which is most of the cost of
+    * reading it.  The secret of each pair of keys is kept, so reading the memos of many transfers between the
+    * same accounts, such as the deposits to an exchange, derives it once.  The keys and secrets stay in memory
+    * until clear() is called.
+    */
+   class memo_decryptor
+   {
+      public:
+         /** @param max_secrets how many shared secrets to keep, the least recently used are dropped first */
+         explicit memo_decryptor( size_t max_secrets = 1000 );
+
+         void add_key( const fc::ecc::private_key& key );
+         bool has_key( const public_key_type& key )const { return _keys.find( key ) != _keys.end(); }
+         /** forgets the keys and the shared secrets derived from them */
+         void clear();
+
+         /**
+          * @return the text of the memo, null if it is encrypted to and from keys that were not added or the
+          * message does not decrypt
+          */
+         optional<string>           decrypt( const memo_data& memo );
+         vector< optional<string> > decrypt( const vector<memo_data>& memos );
+
+      private:
+         struct key_pair_hash
+         {
+            size_t operator()( const std::pair<public_key_type,public_key_type>& p )const;
+         };
+
+         fc::sha512 shared_secret( const public_key_type& mine, const public_key_type& theirs );
+
+         flat_map<public_key_type, fc::ecc::private_key>                                       _keys;
+         detail::lru_cache< std::pair<public_key_type,public_key_type>, fc::sha512, key_pair_hash > _secrets;
+   };
+
 } } // namespace graphene::chain
 
 FC_REFLECT( graphene::chain::memo_message, (checksum)(text) )
@@ -109,6 +109,33 @@ namespace graphene { namespace chain {
 
    void operation_validate( const operation& op );
 
+   /**
+    *  @brief What applying an operation may read and change, declared from its fields alone
+    *
+    *  The keys are the ids of the accounts, assets and other objects.  An account key covers the account and its
+    *  balances and statistics, an asset key covers the asset, its supply and fee pool and the markets it trades
+    *  in.  Creating objects of a type is keyed by next_id_key(), so that creations get their ids in order.
+    *
+    *  Operations whose effects reach state their fields don't name, like canceling an order of an unknown market
+    *  or executing a proposal, are marked unknown and conflict with every other operation.
+    */
+   struct operation_access
+   {
+      flat_set<object_id_type> writes;
+      flat_set<object_id_type> reads;
+      bool                     unknown = false;
+
+      /** the key of the next id of the objects of a type */
+      static object_id_type next_id_key( uint8_t space, uint8_t type )
+      { return object_id_type( space, type, GRAPHENE_DB_MAX_INSTANCE_ID ); }
+
+      /** @return true if applying the operations of this and those of o in another order may give other results */
+      bool conflicts_with( const operation_access& o )const;
+   };
+
+   /** returns a superset of the state applying op reads and changes, see operation_access */
+   void operation_get_access( const operation& op, operation_access& result );
+
    /**
     *  @brief necessary to support nested operations inside the proposal_create_operation
     */
@@ -94,6 +94,15 @@ namespace graphene { namespace chain {
       void set_expiration( fc::time_point_sec expiration_time );
       void set_reference_block( const block_id_type& reference_block );
 
+      /**
+       * Computes digest(), id() and sig_digest( chain_id ) once and returns the stored results from then on.  Only
+       * for transactions that will not be modified any more, e.g. ones received from the network or included in a
+       * block.  Copies keep the stored results; set_expiration() and set_reference_block() drop them, and a sealed
+       * transaction must not be modified in any other way.
+       */
+      void seal( const chain_id_type& chain_id )const;
+      bool is_sealed()const { return _sealed; }
+
       /// visit all operations
       template<typename Visitor>
       vector<typename Visitor::result_type> visit( Visitor&& visitor )
@@ -113,6 +122,17 @@ namespace graphene { namespace chain {
       }
 
       void get_required_authorities( flat_set<account_id_type>& active, flat_set<account_id_type>& owner, vector<authority>& other )const;
+
+   protected:
+      void unseal() { _sealed = false; _merkle_sealed = false; }
+
+      /** valid while _sealed, not serialized */
+      mutable bool                _sealed = false;
+      /** only set by processed_transaction::seal() */
+      mutable bool                _merkle_sealed = false;
+      mutable digest_type         _digest;
+      mutable chain_id_type       _sig_chain_id;
+      mutable digest_type         _sig_digest;
    };
 
    /**
@@ -165,14 +185,31 @@ namespace graphene { namespace chain {
          uint32_t max_recursion = GRAPHENE_MAX_SIG_CHECK_DEPTH
          ) const;
 
+      /**
+       * Recovers the keys of all signatures.  Recovered keys are kept in a cache shared by all transactions,
+       * see @ref set_signature_cache_size, so a signature checked when the transaction is pushed is not
+       * recovered again when it arrives in a block or is reapplied.
+       */
       flat_set<public_key_type> get_signature_keys( const chain_id_type& chain_id )const;
 
       vector<signature_type> signatures;
 
       /// Removes all operations and signatures
-      void clear() { operations.clear(); signatures.clear(); }
+      void clear() { operations.clear(); signatures.clear(); unseal(); }
    };
 
+   /**
+    * Sets how many (signature digest, signature) pairs signed_transaction::get_signature_keys() remembers the
+    * recovered key of, 0 disables the cache.  The least recently used entries are dropped first.
+    */
+   void set_signature_cache_size( size_t entries );
+
+   /**
+    * Sets how many transactions with confidential operations transaction::validate() remembers passed, so their
+    * commitments are not verified again, 0 disables the cache.  The least recently used entries are dropped first.
+    */
+   void set_validation_cache_size( size_t entries );
+
    void verify_authority( const vector<operation>& ops, const flat_set<public_key_type>& sigs,
                           const std::function<const authority*(account_id_type)>& get_active,
                           const std::function<const authority*(account_id_type)>& get_owner,
@@ -197,13 +234,29 @@ namespace graphene { namespace chain {
    struct processed_transaction : public signed_transaction
    {
       processed_transaction( const signed_transaction& trx = signed_transaction() )
-         : signed_transaction(trx){}
+         : signed_transaction(trx){ _merkle_sealed = false; }
 
       vector<operation_result> operation_results;
 
       digest_type merkle_digest()const;
+
+      /** like transaction::seal(), and also stores merkle_digest() */
+      void seal( const chain_id_type& chain_id )const;
+
+   private:
+      /** valid while _merkle_sealed */
+      mutable digest_type _merkle_digest;
    };
 
+   /**
+    *  Groups trxs into lanes by what their operations declare they access, see operation_get_access().  The
+    *  transactions of different lanes don't conflict, so the lanes can be applied in any order or at the same time;
+    *  the transactions of a lane are applied in the order they are given.
+    *
+    *  @return the lane of each transaction, the lanes are numbered in the order of their first transactions
+    */
+   vector<uint32_t> get_transaction_lanes( const vector<processed_transaction>& trxs );
+
    /// @} transactions group
 
 } } // graphene::chain
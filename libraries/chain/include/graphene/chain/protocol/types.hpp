@@ -38,13 +38,16 @@
 #include <fc/static_variant.hpp>
 #include <fc/smart_ref_fwd.hpp>
 
+#include <array>
 #include <memory>
 #include <vector>
 #include <deque>
 #include <cstdint>
+#include <cstring>
 #include <graphene/chain/protocol/address.hpp>
 #include <graphene/db/object_id.hpp>
 #include <graphene/chain/protocol/config.hpp>
+#include <graphene/chain/protocol/seeded_hash.hpp>
 
 namespace graphene { namespace chain {
    using namespace graphene::db;
@@ -155,7 +158,8 @@ namespace graphene { namespace chain {
       impl_budget_record_object_type,
       impl_special_authority_object_type,
       impl_buyback_object_type,
-      impl_fba_accumulator_object_type
+      impl_fba_accumulator_object_type,
+      impl_vote_tally_object_type
    };
 
    //typedef fc::unsigned_int            object_id_type;
@@ -207,6 +211,7 @@ namespace graphene { namespace chain {
    class special_authority_object;
    class buyback_object;
    class fba_accumulator_object;
+   class vote_tally_object;
 
    typedef object_id< implementation_ids, impl_global_property_object_type,  global_property_object>                    global_property_id_type;
    typedef object_id< implementation_ids, impl_dynamic_global_property_object_type,  dynamic_global_property_object>    dynamic_global_property_id_type;
@@ -227,6 +232,7 @@ namespace graphene { namespace chain {
    typedef object_id< implementation_ids, impl_special_authority_object_type, special_authority_object >                special_authority_id_type;
    typedef object_id< implementation_ids, impl_buyback_object_type, buyback_object >                                    buyback_id_type;
    typedef object_id< implementation_ids, impl_fba_accumulator_object_type, fba_accumulator_object >                    fba_accumulator_id_type;
+   typedef object_id< implementation_ids, impl_vote_tally_object_type, vote_tally_object >                              vote_tally_id_type;
 
    typedef fc::array<char, GRAPHENE_MAX_ASSET_SYMBOL_LENGTH>    symbol_type;
    typedef fc::ripemd160                                        block_id_type;
@@ -260,6 +266,20 @@ namespace graphene { namespace chain {
        bool is_valid_v1( const std::string& base58str );
    };
 
+   /**
+    * The addresses a key owns: the four pts_address forms, uncompressed and compressed with versions 56 and 0,
+    * followed by address( key ).  Deriving the uncompressed forms decompresses the key, so the results are kept
+    * in a cache shared by all callers, see @ref set_key_cache_size.
+    */
+   std::array<address,5> key_addresses( const public_key_type& key );
+
+   /**
+    * Sets how many keys key_addresses() remembers the addresses of, and how many key strings the conversions of
+    * public_key_type to and from strings remember, 0 disables the caches.  The least recently used entries are
+    * dropped first.
+    */
+   void set_key_cache_size( size_t entries );
+
    struct extended_public_key_type
    {
       struct binary_key
@@ -303,6 +323,71 @@ namespace graphene { namespace chain {
       friend bool operator == ( const extended_private_key_type& p1, const extended_private_key_type& p2);
       friend bool operator != ( const extended_private_key_type& p1, const extended_private_key_type& p2);
    };
+
+   namespace detail
+   {
+      /**
+       * A stream fc::raw packs into which gathers the packed bytes in a fixed buffer on the stack and passes them
+       * to a hash encoder whenever it fills up, so the encoder sees few, large writes and nothing is allocated.
+       */
+      template< typename Encoder, size_t BufferSize = 1024 >
+      class buffered_hash_stream
+      {
+         public:
+            explicit buffered_hash_stream( Encoder& enc ) : _enc( enc ) {}
+
+            void write( const char* d, size_t s )
+            {
+               if( _used + s > BufferSize )
+               {
+                  flush();
+                  if( s > BufferSize )
+                  {
+                     _enc.write( d, uint32_t( s ) );
+                     return;
+                  }
+               }
+               memcpy( _buffer + _used, d, s );
+               _used += s;
+            }
+            void put( char c ) { write( &c, 1 ); }
+            /** passes what is left in the buffer to the encoder, call it before taking the result */
+            void flush()
+            {
+               if( _used > 0 )
+                  _enc.write( _buffer, uint32_t( _used ) );
+               _used = 0;
+            }
+
+         private:
+            Encoder& _enc;
+            char     _buffer[BufferSize];
+            size_t   _used = 0;
+      };
+   }
+
+   /** The same as H::hash( v ), but the encoder gets the packed v in chunks instead of one packed field at a time */
+   template< typename H, typename T >
+   H hash_packed( const T& v )
+   {
+      typename H::encoder enc;
+      detail::buffered_hash_stream< typename H::encoder > s( enc );
+      fc::raw::pack( s, v );
+      s.flush();
+      return enc.result();
+   }
+
+   /** hashes the packed prefix followed by the packed v, as H::hash would of a struct holding the two */
+   template< typename H, typename P, typename T >
+   H hash_packed( const P& prefix, const T& v )
+   {
+      typename H::encoder enc;
+      detail::buffered_hash_stream< typename H::encoder > s( enc );
+      fc::raw::pack( s, prefix );
+      fc::raw::pack( s, v );
+      s.flush();
+      return enc.result();
+   }
 } }  // graphene::chain
 
 namespace fc
@@ -315,6 +400,19 @@ namespace fc
     void from_variant( const fc::variant& var, graphene::chain::extended_private_key_type& vo );
 }
 
+namespace std
+{
+   template<>
+   struct hash<graphene::chain::public_key_type>
+   {
+       public:
+         size_t operator()( const graphene::chain::public_key_type& k )const
+         {
+            return graphene::chain::seeded_hash( k.key_data.data, sizeof(k.key_data.data) );
+         }
+   };
+}
+
 FC_REFLECT( graphene::chain::public_key_type, (key_data) )
 FC_REFLECT( graphene::chain::public_key_type::binary_key, (data)(check) )
 FC_REFLECT( graphene::chain::extended_public_key_type, (key_data) )
@@ -359,6 +457,7 @@ FC_REFLECT_ENUM( graphene::chain::impl_object_type,
                  (impl_special_authority_object_type)
                  (impl_buyback_object_type)
                  (impl_fba_accumulator_object_type)
+                 (impl_vote_tally_object_type)
                )
 
 FC_REFLECT_TYPENAME( graphene::chain::share_type )
@@ -390,6 +489,7 @@ FC_REFLECT_TYPENAME( graphene::chain::budget_record_id_type )
 FC_REFLECT_TYPENAME( graphene::chain::special_authority_id_type )
 FC_REFLECT_TYPENAME( graphene::chain::buyback_id_type )
 FC_REFLECT_TYPENAME( graphene::chain::fba_accumulator_id_type )
+FC_REFLECT_TYPENAME( graphene::chain::vote_tally_id_type )
 
 FC_REFLECT( graphene::chain::void_t, )
 
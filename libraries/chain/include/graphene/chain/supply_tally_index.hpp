@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/protocol/types.hpp>
+#include <graphene/db/object.hpp>
+#include <graphene/db/index.hpp>
+
+namespace graphene { namespace chain {
+
+/**
+ * Running totals of the amounts of each asset held by the objects of an index, kept from the changes to them so
+ * that the supply of every asset can be checked each block without counting every balance, order and vesting
+ * balance.  One instance watches each of the account balance, account statistics, limit order, call order, force
+ * settlement, vesting balance and genesis balance indexes, database::verify_supply_totals() adds them up.  Undoing
+ * changes passes through here too, so the totals are always those of the current state.
+ */
+class supply_tally_index : public graphene::db::secondary_index
+{
+   public:
+      virtual void object_inserted( const object& obj ) override { note( obj, 1 ); }
+      virtual void object_removed( const object& obj ) override  { note( obj, -1 ); }
+      virtual void about_to_modify( const object& before ) override { note( before, -1 ); }
+      virtual void object_modified( const object& after ) override  { note( after, 1 ); }
+
+      /** the amounts held of each asset, including the core asset fees not yet paid out */
+      flat_map<asset_id_type, share_type>  held;
+      /** the debt of call orders in each market issued asset */
+      flat_map<asset_id_type, share_type>  debts;
+      /** the core asset for sale in limit orders and the collateral of call orders */
+      share_type                           core_in_orders;
+      /** the sum of account_statistics_object::total_core_in_orders, which should be core_in_orders */
+      share_type                           reported_core_in_orders;
+
+   private:
+      void note( const object& obj, int64_t sign );
+};
+
+} } // graphene::chain
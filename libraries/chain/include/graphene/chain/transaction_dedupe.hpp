@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/protocol/transaction.hpp>
+#include <graphene/db/undo_database.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+   /**
+    * The purpose of this structure is to enable the detection of duplicate transactions.  When a transaction is
+    * included in a block it is added here, and at the end of block processing the transactions that have expired
+    * are removed.
+    *
+    * It is not part of the object database, so that a transaction costs neither an object nor an undo copy of
+    * one: each addition and removal is recorded in a journal, and the undo database rolls the journal back along
+    * with the undo states it undoes.  The transactions are kept in buckets by expiration, the expired ones are
+    * the first buckets.  The transactions themselves are kept for get_recent_transaction(), which the API and the
+    * p2p code serve them with.  They are rarely asked for, so they are kept packed as they are on the wire, a
+    * fraction of the size of a signed_transaction whose operations each take the size of the largest operation,
+    * and unpacked by find().
+    */
+   class transaction_dedupe : public graphene::db::undo_journal
+   {
+      public:
+         explicit transaction_dedupe( const graphene::db::undo_database& undo_db ) : _undo_db( undo_db ) {}
+
+         bool                      contains( const transaction_id_type& id )const
+         { return _transactions.find( id ) != _transactions.end(); }
+         /** @return the transaction, or nothing if it was not applied or has expired */
+         optional<signed_transaction> find( const transaction_id_type& id )const;
+         size_t                    size()const { return _transactions.size(); }
+         /** the total packed size of the transactions */
+         uint64_t                  packed_bytes()const { return _packed_bytes; }
+
+         void insert( const transaction_id_type& id, const signed_transaction& trx );
+         /** removes the transactions which expired before now */
+         void remove_expired( fc::time_point_sec now );
+         /** forgets every transaction and the journal, for a database which is being closed */
+         void clear();
+
+         /** the transactions are saved along with the object database, in a file of their own */
+         void save( const fc::path& file )const;
+         void load( const fc::path& file );
+
+         virtual uint64_t position()const override { return _journal_start + _journal.size(); }
+         virtual void     rollback( uint64_t position ) override;
+         virtual void     forget_before( uint64_t position ) override;
+
+      private:
+         struct packed_transaction
+         {
+            fc::time_point_sec   expiration;
+            vector<char>         data;
+         };
+         typedef std::shared_ptr<const packed_transaction> transaction_ptr;
+         static transaction_ptr pack( const signed_transaction& trx );
+
+         /** an addition if removed is null, otherwise the removal of removed */
+         struct change
+         {
+            transaction_id_type id;
+            transaction_ptr     removed;
+         };
+
+         /** changes made without an undo state to undo them are permanent */
+         bool recording()const { return _undo_db.enabled() && _undo_db.size() > 0; }
+         void add( const transaction_id_type& id, transaction_ptr trx );
+         void erase( const transaction_id_type& id );
+
+         std::unordered_map< transaction_id_type, transaction_ptr >    _transactions;
+         std::map< fc::time_point_sec, vector<transaction_id_type> >   _by_expiration;
+
+         std::deque< change >                                          _journal;
+         uint64_t                                                      _packed_bytes = 0;
+         /** the position of the first change in _journal */
+         uint64_t                                                      _journal_start = 0;
+
+         const graphene::db::undo_database&                            _undo_db;
+   };
+
+} } // graphene::chain
@@ -28,6 +28,13 @@ namespace graphene { namespace chain {
    class database;
    struct signed_transaction;
 
+   /** how long the evaluator of an operation took to evaluate and to apply it */
+   struct operation_timing
+   {
+      fc::microseconds evaluate;
+      fc::microseconds apply;
+   };
+
    /**
     *  Place holder for state tracked while processing a transaction. This class provides helper methods that are
     *  common to many different operations and also tracks which keys have signed the transaction
@@ -47,5 +54,7 @@ namespace graphene { namespace chain {
          bool                             _is_proposed_trx = false;
          bool                             skip_fee = false;
          bool                             skip_fee_schedule_check = false;
+         /** when set, the evaluator of the operation being applied stores its timing there */
+         operation_timing*                timing = nullptr;
    };
 } } // namespace graphene::chain
@@ -167,6 +167,23 @@ namespace graphene { namespace chain {
           */
          asset get_allowed_withdraw(const time_point_sec& now)const;
    };
+
+   /**
+    * Computes get_allowed_withdraw( now ) of many vesting balances at once, returned in the order given.
+    *
+    * The balances are grouped by policy first, so each policy's arithmetic runs over all of its balances in one
+    * loop with one reused context, instead of constructing a visitor and dispatching on the policy per balance.
+    */
+   vector<asset> get_allowed_withdraws( const vector<const vesting_balance_object*>& balances,
+                                        const time_point_sec& now );
+
+   /**
+    * The coin seconds each of the balances has earned by now, in the order given.  Linear vesting balances
+    * don't accrue coin seconds and get 0.
+    */
+   vector<fc::uint128_t> get_coin_seconds_earned( const vector<const vesting_balance_object*>& balances,
+                                                  const time_point_sec& now );
+
    /**
     * @ingroup object_index
     */
@@ -183,7 +200,7 @@ namespace graphene { namespace chain {
    /**
     * @ingroup object_index
     */
-   typedef generic_index<vesting_balance_object, vesting_balance_multi_index_type> vesting_balance_index;
+   typedef generic_index<vesting_balance_object, vesting_balance_multi_index_type, true> vesting_balance_index;
 
 } } // graphene::chain
 
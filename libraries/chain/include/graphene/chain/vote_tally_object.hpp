@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/protocol/types.hpp>
+#include <graphene/chain/protocol/vote.hpp>
+#include <graphene/db/object.hpp>
+#include <graphene/db/index.hpp>
+
+#include <map>
+#include <set>
+
+namespace graphene { namespace chain {
+
+/**
+ * The vote totals of the last maintenance, which the next one updates for the accounts that changed in between
+ * rather than counting every account again.
+ *
+ * The stake each account voted with is kept in its account_statistics_object; here are the totals of the stake
+ * voting with each opinion account's opinions, and which opinions they were counted for.  The totals are only
+ * valid for the parameters they were counted with, any change to those counts every account again.
+ *
+ * The totals are only right if they were counted from the first maintenance on, or from a full count.  A database
+ * written before they existed has no tallied stake in its account statistics, so it has to be replayed; this is why
+ * GRAPHENE_CURRENT_DB_VERSION was raised with them.
+ *
+ * This class is an implementation detail.
+ */
+class vote_tally_object : public graphene::db::abstract_object< vote_tally_object >
+{
+   public:
+      static const uint8_t space_id = implementation_ids;
+      static const uint8_t type_id  = impl_vote_tally_object_type;
+
+      struct opinion_tally
+      {
+         uint64_t                stake = 0;
+         flat_set<vote_id_type>  votes;
+         uint16_t                num_witness = 0;
+         uint16_t                num_committee = 0;
+
+         bool operator == ( const opinion_tally& o )const
+         {
+            return stake == o.stake && num_witness == o.num_witness && num_committee == o.num_committee &&
+                   votes == o.votes;
+         }
+      };
+
+      vector<uint64_t>                           votes;
+      vector<uint64_t>                           witness_counts;
+      vector<uint64_t>                           committee_counts;
+      uint64_t                                   total_voting_stake = 0;
+      /** only opinion accounts with stake voting for their opinions */
+      std::map<account_id_type, opinion_tally>   opinions;
+
+      uint32_t next_available_vote_id = 0;
+      uint16_t maximum_witness_count = 0;
+      uint16_t maximum_committee_count = 0;
+};
+
+/**
+ * Collects the accounts whose voting stake or opinions may have changed since maintenance last tallied them, from
+ * the changes to the objects the tally reads.  One instance watches each of the account, core balance, vesting
+ * balance, account statistics and vote tally indexes.  Undoing changes passes through here too, so the collected
+ * accounts are a superset of the ones whose tally is out of date.
+ */
+class vote_change_index : public graphene::db::secondary_index
+{
+   public:
+      virtual void object_inserted( const object& obj ) override;
+      virtual void object_removed( const object& obj ) override;
+      virtual void about_to_modify( const object& before ) override;
+      virtual void object_modified( const object& after ) override;
+
+      /** forgets an account that has just been tallied */
+      void tallied( account_id_type a ) { changed.erase( a ); }
+
+      /** stake accounts to tally again */
+      std::set<account_id_type>    changed;
+      /** accounts added to changed since maintenance last looked, in order */
+      vector<account_id_type>      recent;
+      /** accounts with fees to pay out, only kept by the account statistics instance */
+      std::set<account_id_type>    fee_payers;
+      /** opinion accounts whose entry in the vote tally must be refreshed, only kept by the vote tally instance */
+      std::set<account_id_type>    opinions_changed;
+
+   private:
+      void mark( account_id_type a )
+      {
+         if( changed.insert( a ).second )
+            recent.push_back( a );
+      }
+      void note( const object& obj );
+
+      /** what the tally reads from the account statistics object being modified */
+      share_type                                 _before_core_in_orders;
+      uint64_t                                   _before_tallied_stake = 0;
+      account_id_type                            _before_tallied_opinion_account;
+      /** the opinions of the vote tally object being modified */
+      std::map<account_id_type, vote_tally_object::opinion_tally> _before_opinions;
+};
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::vote_tally_object::opinion_tally, (stake)(votes)(num_witness)(num_committee) )
+FC_REFLECT_DERIVED( graphene::chain::vote_tally_object, (graphene::db::object),
+                    (votes)(witness_counts)(committee_counts)(total_voting_stake)(opinions)
+                    (next_available_vote_id)(maximum_witness_count)(maximum_committee_count) )
@@ -25,6 +25,7 @@
 #include <graphene/chain/protocol/asset.hpp>
 #include <graphene/db/object.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <boost/multi_index/composite_key.hpp>
 
 namespace graphene { namespace chain {
    using namespace graphene::db;
@@ -53,6 +54,7 @@ namespace graphene { namespace chain {
    struct by_account;
    struct by_vote_id;
    struct by_last_block;
+   struct by_votes;
    using witness_multi_index_type = multi_index_container<
       witness_object,
       indexed_by<
@@ -64,10 +66,34 @@ namespace graphene { namespace chain {
          >,
          ordered_unique< tag<by_vote_id>,
             member<witness_object, vote_id_type, &witness_object::vote_id>
+         >,
+         /// most votes first, ties go to the lower vote id, as maintenance elects them
+         ordered_unique< tag<by_votes>,
+            composite_key< witness_object,
+               member<witness_object, uint64_t, &witness_object::total_votes>,
+               member<witness_object, vote_id_type, &witness_object::vote_id>
+            >,
+            composite_key_compare< std::greater<uint64_t>, std::less<vote_id_type> >
          >
       >
    >;
    using witness_index = generic_index<witness_object, witness_multi_index_type>;
+
+   /**
+    * Counts the witness objects inserted and removed, including by undo, which puts a removed object back in a new
+    * node.  Pointers to witness objects taken while the count stays the same are still valid.
+    */
+   class witness_node_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override { ++_changes; }
+         virtual void object_removed( const object& obj ) override { ++_changes; }
+
+         uint64_t changes()const { return _changes; }
+
+      private:
+         uint64_t _changes = 0;
+   };
 } } // graphene::chain
 
 FC_REFLECT_DERIVED( graphene::chain::witness_object, (graphene::db::object),
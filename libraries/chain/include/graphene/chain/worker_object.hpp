@@ -24,6 +24,7 @@
 #pragma once
 #include <graphene/db/object.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <boost/multi_index/composite_key.hpp>
 
 namespace graphene { namespace chain {
 
@@ -143,13 +144,22 @@ class worker_object : public abstract_object<worker_object>
 struct by_account;
 struct by_vote_for;
 struct by_vote_against;
+struct by_approving_stake;
 typedef multi_index_container<
    worker_object,
    indexed_by<
       ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
       ordered_non_unique< tag<by_account>, member< worker_object, account_id_type, &worker_object::worker_account > >,
       ordered_unique< tag<by_vote_for>, member< worker_object, vote_id_type, &worker_object::vote_for > >,
-   ordered_unique< tag<by_vote_against>, member< worker_object, vote_id_type, &worker_object::vote_against > >
+   ordered_unique< tag<by_vote_against>, member< worker_object, vote_id_type, &worker_object::vote_against > >,
+      /// the order workers are paid in: most approving stake first, ties go to the lower id
+      ordered_unique< tag<by_approving_stake>,
+         composite_key< worker_object,
+            const_mem_fun< worker_object, share_type, &worker_object::approving_stake >,
+            member< object, object_id_type, &object::id >
+         >,
+         composite_key_compare< std::greater<share_type>, std::less<object_id_type> >
+      >
    >
 > worker_object_multi_index_type;
 
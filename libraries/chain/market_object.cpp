@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/market_object.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace chain {
+
+namespace {
+   pair<asset_id_type,asset_id_type> market_of( const price& p )
+   {
+      return std::minmax( p.base.asset_id, p.quote.asset_id );
+   }
+}
+
+void limit_order_book_index::add( const price& sell_price, share_type for_sale )
+{
+   ++_revisions[ market_of( sell_price ) ];
+   auto itr = _levels.find( sell_price );
+   if( itr == _levels.end() )
+   {
+      itr = _levels.emplace( sell_price, order_book_level() ).first;
+      itr->second.sell_price = sell_price;
+   }
+   itr->second.for_sale += for_sale;
+   ++itr->second.order_count;
+}
+
+void limit_order_book_index::subtract( const price& sell_price, share_type for_sale )
+{
+   ++_revisions[ market_of( sell_price ) ];
+   auto itr = _levels.find( sell_price );
+   assert( itr != _levels.end() );
+   if( itr == _levels.end() ) return;
+   if( --itr->second.order_count == 0 )
+      _levels.erase( itr );
+   else
+      itr->second.for_sale -= for_sale;
+}
+
+void limit_order_book_index::object_inserted( const object& obj )
+{
+   assert( dynamic_cast<const limit_order_object*>(&obj) ); // for debug only
+   const limit_order_object& o = static_cast<const limit_order_object&>(obj);
+   add( o.sell_price, o.for_sale );
+}
+
+void limit_order_book_index::object_removed( const object& obj )
+{
+   assert( dynamic_cast<const limit_order_object*>(&obj) ); // for debug only
+   const limit_order_object& o = static_cast<const limit_order_object&>(obj);
+   subtract( o.sell_price, o.for_sale );
+}
+
+bool limit_order_book_index::is_relevant_change( const object& before, const object& after )const
+{
+   assert( dynamic_cast<const limit_order_object*>(&before) ); // for debug only
+   assert( dynamic_cast<const limit_order_object*>(&after) ); // for debug only
+   const limit_order_object& a = static_cast<const limit_order_object&>(before);
+   const limit_order_object& b = static_cast<const limit_order_object&>(after);
+   return !( a.for_sale == b.for_sale && a.sell_price == b.sell_price );
+}
+
+void limit_order_book_index::about_to_modify( const object& before )
+{
+   assert( dynamic_cast<const limit_order_object*>(&before) ); // for debug only
+   const limit_order_object& o = static_cast<const limit_order_object&>(before);
+   _before_price = o.sell_price;
+   _before_for_sale = o.for_sale;
+}
+
+void limit_order_book_index::object_modified( const object& after )
+{
+   assert( dynamic_cast<const limit_order_object*>(&after) ); // for debug only
+   const limit_order_object& o = static_cast<const limit_order_object&>(after);
+   subtract( _before_price, _before_for_sale );
+   add( o.sell_price, o.for_sale );
+}
+
+size_t limit_order_match_index::find_level( const side& s, const price& sell_price )
+{
+   return std::lower_bound( s.begin(), s.end(), sell_price,
+                            []( const level& l, const price& p ) { return l.sell_price < p; } ) - s.begin();
+}
+
+void limit_order_match_index::add( const limit_order_object& o )
+{
+   side& s = _sides[ std::make_pair( o.sell_price.base.asset_id, o.sell_price.quote.asset_id ) ];
+   size_t i = find_level( s, o.sell_price );
+   if( i == s.size() || !( s[i].sell_price == o.sell_price ) )
+   {
+      level l;
+      l.sell_price = o.sell_price;
+      s.insert( s.begin() + i, std::move( l ) );
+   }
+
+   // new orders have the highest id, only undoing a removal puts an older one back
+   auto& orders = s[i].orders;
+   auto pos = orders.end();
+   if( !orders.empty() && o.id < orders.back()->id )
+      pos = std::lower_bound( orders.begin(), orders.end(), o.id,
+                              []( const limit_order_object* a, const object_id_type& id ) { return a->id < id; } );
+   orders.insert( pos, &o );
+}
+
+void limit_order_match_index::remove( const limit_order_object& o, const price& sell_price )
+{
+   auto sitr = _sides.find( std::make_pair( sell_price.base.asset_id, sell_price.quote.asset_id ) );
+   assert( sitr != _sides.end() );
+   if( sitr == _sides.end() ) return;
+   side& s = sitr->second;
+   const size_t i = find_level( s, sell_price );
+   assert( i < s.size() && s[i].sell_price == sell_price );
+   if( i == s.size() || !( s[i].sell_price == sell_price ) ) return;
+
+   auto& orders = s[i].orders;
+   auto pos = std::lower_bound( orders.begin(), orders.end(), o.id,
+                                []( const limit_order_object* a, const object_id_type& id ) { return a->id < id; } );
+   assert( pos != orders.end() && *pos == &o );
+   if( pos == orders.end() || *pos != &o ) return;
+   orders.erase( pos );
+
+   // first() relies on sides and levels never being empty
+   if( orders.empty() )
+   {
+      s.erase( s.begin() + i );
+      if( s.empty() )
+         _sides.erase( sitr );
+   }
+}
+
+void limit_order_match_index::object_inserted( const object& obj )
+{
+   assert( dynamic_cast<const limit_order_object*>(&obj) ); // for debug only
+   add( static_cast<const limit_order_object&>(obj) );
+}
+
+void limit_order_match_index::object_removed( const object& obj )
+{
+   assert( dynamic_cast<const limit_order_object*>(&obj) ); // for debug only
+   const limit_order_object& o = static_cast<const limit_order_object&>(obj);
+   remove( o, o.sell_price );
+}
+
+void limit_order_match_index::about_to_modify( const object& before )
+{
+   assert( dynamic_cast<const limit_order_object*>(&before) ); // for debug only
+   _before_price = static_cast<const limit_order_object&>(before).sell_price;
+}
+
+void limit_order_match_index::object_modified( const object& after )
+{
+   assert( dynamic_cast<const limit_order_object*>(&after) ); // for debug only
+   const limit_order_object& o = static_cast<const limit_order_object&>(after);
+   // fills only change the amount for sale, which doesn't move the order
+   if( o.sell_price == _before_price )
+      return;
+   remove( o, _before_price );
+   add( o );
+}
+
+const limit_order_match_index::side* limit_order_match_index::find_side( asset_id_type sell,
+                                                                          asset_id_type receive )const
+{
+   auto itr = _sides.find( std::make_pair( sell, receive ) );
+   return itr == _sides.end() ? nullptr : &itr->second;
+}
+
+const limit_order_object* limit_order_match_index::first( asset_id_type sell, asset_id_type receive )const
+{
+   const side* s = find_side( sell, receive );
+   return s == nullptr ? nullptr : s->back().orders.front();
+}
+
+const limit_order_object* limit_order_match_index::next( const limit_order_object& o )const
+{
+   const side* s = find_side( o.sell_price.base.asset_id, o.sell_price.quote.asset_id );
+   if( s == nullptr )
+      return nullptr;
+   const size_t i = find_level( *s, o.sell_price );
+   if( i == s->size() || !( (*s)[i].sell_price == o.sell_price ) )
+      return nullptr;
+
+   const auto& orders = (*s)[i].orders;
+   auto pos = std::upper_bound( orders.begin(), orders.end(), o.id,
+                                []( const object_id_type& id, const limit_order_object* a ) { return id < a->id; } );
+   if( pos != orders.end() )
+      return *pos;
+   return i > 0 ? (*s)[i - 1].orders.front() : nullptr;
+}
+
+} } // graphene::chain
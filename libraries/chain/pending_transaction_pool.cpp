@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/pending_transaction_pool.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/exceptions.hpp>
+
+#include <fc/smart_ref_impl.hpp>
+#include <fc/uint128.hpp>
+
+namespace graphene { namespace chain {
+
+namespace {
+   struct fee_visitor
+   {
+      typedef void result_type;
+
+      account_id_type payer;
+      asset           fee;
+
+      template<typename Op>
+      void operator()( const Op& op )
+      {
+         payer = op.fee_payer();
+         fee = op.fee;
+      }
+   };
+}
+
+pending_transaction_pool::entry pending_transaction_pool::make_entry( const database& db, const signed_transaction& trx,
+                                                                      uint32_t position,
+                                                                      const transaction_id_type* known_id )
+{
+   entry result;
+   result.id = known_id ? *known_id : trx.id();
+   result.expiration = trx.expiration;
+   result.size = fc::raw::pack_size( trx );
+   result.position = position;
+
+   share_type core_fees = 0;
+   for( size_t i = 0; i < trx.operations.size(); ++i )
+   {
+      fee_visitor v;
+      trx.operations[i].visit( v );
+      if( i == 0 )
+         result.fee_payer = v.payer;
+      if( v.fee.asset_id == asset_id_type() )
+         core_fees += v.fee.amount;
+      else
+      {
+         // an unknown fee asset or a bad rate fails the transaction later on, it just pays nothing here
+         const asset_object* fee_asset = db.find( v.fee.asset_id );
+         if( fee_asset == nullptr )
+            continue;
+         try
+         {
+            core_fees += ( v.fee * fee_asset->options.core_exchange_rate ).amount;
+         }
+         catch( const fc::exception& )
+         {
+         }
+      }
+   }
+   if( core_fees > 0 )
+      result.fee_rate = ( fc::uint128( core_fees.value ) * 1024 / std::max<uint32_t>( result.size, 1 ) ).to_uint64();
+   return result;
+}
+
+vector<uint32_t> pending_transaction_pool::check_admission( const entry& e )const
+{
+   GRAPHENE_ASSERT( _limits.max_per_account == 0 || count_paid_by( e.fee_payer ) < _limits.max_per_account,
+                    tx_pending_account_limit, "account ${a} already has ${n} pending transactions",
+                    ("a",e.fee_payer)("n",_limits.max_per_account) );
+
+   vector<uint32_t> evicted;
+   if( _limits.max_bytes == 0 || _total_bytes + e.size <= _limits.max_bytes )
+      return evicted;
+
+   // evict down to 90% of the limit, so one eviction makes room for several more transactions
+   const uint64_t target = _limits.max_bytes - _limits.max_bytes / 10;
+   uint64_t total = _total_bytes;
+   const auto& by_rate = _entries.get<by_fee_rate>();
+   for( auto itr = by_rate.rbegin(); itr != by_rate.rend() && total + e.size > target; ++itr )
+   {
+      if( itr->fee_rate >= e.fee_rate )
+         break;
+      total -= itr->size;
+      evicted.push_back( itr->position );
+   }
+   GRAPHENE_ASSERT( total + e.size <= _limits.max_bytes, tx_pending_pool_full,
+                    "pending transactions take ${b} of ${m} bytes, the transaction pays ${r} per kilobyte",
+                    ("b",_total_bytes)("m",_limits.max_bytes)("r",e.fee_rate) );
+   return evicted;
+}
+
+vector<uint32_t> pending_transaction_pool::trim( fc::time_point_sec now )
+{
+   vector<uint32_t> removed;
+   auto& by_exp = _entries.get<by_expiration>();
+   while( !by_exp.empty() && by_exp.begin()->expiration < now )
+   {
+      removed.push_back( by_exp.begin()->position );
+      _total_bytes -= by_exp.begin()->size;
+      by_exp.erase( by_exp.begin() );
+   }
+
+   auto& by_rate = _entries.get<by_fee_rate>();
+   while( _limits.max_bytes != 0 && _total_bytes > _limits.max_bytes )
+   {
+      auto lowest = std::prev( by_rate.end() );
+      removed.push_back( lowest->position );
+      _total_bytes -= lowest->size;
+      by_rate.erase( lowest );
+   }
+   return removed;
+}
+
+vector<uint32_t> pending_transaction_pool::positions_by_priority()const
+{
+   vector<uint32_t> result;
+   result.reserve( _entries.size() );
+   for( const auto& e : _entries.get<by_fee_rate>() )
+      result.push_back( e.position );
+   return result;
+}
+
+void pending_transaction_pool::add( const entry& e )
+{
+   _entries.insert( e );
+   _total_bytes += e.size;
+}
+
+void pending_transaction_pool::clear()
+{
+   _entries.clear();
+   _total_bytes = 0;
+}
+
+bool pending_transaction_pool::contains( const transaction_id_type& id )const
+{
+   return _entries.get<by_id>().find( id ) != _entries.get<by_id>().end();
+}
+
+uint32_t pending_transaction_pool::count_paid_by( account_id_type account )const
+{
+   return uint32_t( _entries.get<by_fee_payer>().count( account ) );
+}
+
+} } // graphene::chain
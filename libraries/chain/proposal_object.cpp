@@ -29,14 +29,19 @@ namespace graphene { namespace chain {
 
 bool proposal_object::is_authorized_to_execute(database& db) const
 {
-   transaction_evaluation_state dry_run_eval(&db);
+   const uint8_t max_authority_depth = db.get_global_properties().parameters.max_authority_depth;
+   proposal_authorization_index& authorizations = db.proposal_authorizations();
+   const optional<bool> cached = authorizations.find( id, max_authority_depth );
+   if( cached.valid() )
+      return *cached;
 
+   bool authorized = true;
    try {
       verify_authority( proposed_transaction.operations, 
                         available_key_approvals,
-                        [&]( account_id_type id ){ return &id(db).active; },
-                        [&]( account_id_type id ){ return &id(db).owner;  },
-                        db.get_global_properties().parameters.max_authority_depth,
+                        [&]( account_id_type id ){ return &db.authority_account( id ).active; },
+                        [&]( account_id_type id ){ return &db.authority_account( id ).owner;  },
+                        max_authority_depth,
                         true, /* allow committeee */
                         available_active_approvals,
                         available_owner_approvals );
@@ -45,27 +50,93 @@ bool proposal_object::is_authorized_to_execute(database& db) const
    {
       //idump((available_active_approvals));
       //wlog((e.to_detail_string()));
-      return false;
+      authorized = false;
    }
-   return true;
+   authorizations.store( id, max_authority_depth, authorized );
+   return authorized;
 }
 
+optional<bool> proposal_authorization_index::find( proposal_id_type p, uint8_t max_authority_depth )const
+{
+   auto itr = _entries.find( p );
+   if( itr == _entries.end() || itr->second.max_authority_depth != max_authority_depth ||
+       itr->second.authority_changes != _authority_changes->changes() )
+      return optional<bool>();
+   return itr->second.authorized;
+}
+
+void proposal_authorization_index::store( proposal_id_type p, uint8_t max_authority_depth, bool authorized )
+{
+   entry& e = _entries[p];
+   e.authority_changes = _authority_changes->changes();
+   e.max_authority_depth = max_authority_depth;
+   e.authorized = authorized;
+}
+
+void proposal_authorization_index::object_removed( const object& obj )
+{
+   _entries.erase( obj.id );
+}
+
+void proposal_authorization_index::about_to_modify( const object& before )
+{
+   const proposal_object& p = static_cast<const proposal_object&>( before );
+   _before_active = p.available_active_approvals;
+   _before_owner = p.available_owner_approvals;
+   _before_keys = p.available_key_approvals;
+}
+
+void proposal_authorization_index::object_modified( const object& after )
+{
+   const proposal_object& p = static_cast<const proposal_object&>( after );
+   if( !( p.available_active_approvals == _before_active && p.available_owner_approvals == _before_owner &&
+          p.available_key_approvals == _before_keys ) )
+      _entries.erase( p.id );
+}
+
+
+flat_set<account_id_type> required_approval_index::get_accounts( const proposal_object& p )const
+{
+    flat_set<account_id_type> result;
+    result.reserve( p.required_active_approvals.size() + p.required_owner_approvals.size()
+                    + p.available_active_approvals.size() + p.available_owner_approvals.size() );
+    result.insert( p.required_active_approvals.begin(), p.required_active_approvals.end() );
+    result.insert( p.required_owner_approvals.begin(), p.required_owner_approvals.end() );
+    result.insert( p.available_active_approvals.begin(), p.available_active_approvals.end() );
+    result.insert( p.available_owner_approvals.begin(), p.available_owner_approvals.end() );
+    return result;
+}
 
 void required_approval_index::object_inserted( const object& obj )
 {
     assert( dynamic_cast<const proposal_object*>(&obj) );
     const proposal_object& p = static_cast<const proposal_object&>(obj);
 
-    for( const auto& a : p.required_active_approvals )
-       _account_to_proposals[a].insert( p.id );
-    for( const auto& a : p.required_owner_approvals )
-       _account_to_proposals[a].insert( p.id );
-    for( const auto& a : p.available_active_approvals )
-       _account_to_proposals[a].insert( p.id );
-    for( const auto& a : p.available_owner_approvals )
+    for( const auto& a : get_accounts( p ) )
        _account_to_proposals[a].insert( p.id );
 }
 
+void required_approval_index::about_to_modify( const object& before )
+{
+    assert( dynamic_cast<const proposal_object*>(&before) );
+    _before_accounts = get_accounts( static_cast<const proposal_object&>(before) );
+}
+
+void required_approval_index::object_modified( const object& after )
+{
+    assert( dynamic_cast<const proposal_object*>(&after) );
+    const proposal_object& p = static_cast<const proposal_object&>(after);
+    const flat_set<account_id_type> after_accounts = get_accounts( p );
+
+    for( const auto& a : _before_accounts )
+       if( after_accounts.find( a ) == after_accounts.end() )
+          remove( a, p.id );
+    for( const auto& a : after_accounts )
+       if( _before_accounts.find( a ) == _before_accounts.end() )
+          _account_to_proposals[a].insert( p.id );
+    _before_accounts.clear();
+}
+
 void required_approval_index::remove( account_id_type a, proposal_id_type p )
 {
     auto itr = _account_to_proposals.find(a);
@@ -82,13 +153,7 @@ void required_approval_index::object_removed( const object& obj )
     assert( dynamic_cast<const proposal_object*>(&obj) );
     const proposal_object& p = static_cast<const proposal_object&>(obj);
 
-    for( const auto& a : p.required_active_approvals )
-       remove( a, p.id );
-    for( const auto& a : p.required_owner_approvals )
-       remove( a, p.id );
-    for( const auto& a : p.available_active_approvals )
-       remove( a, p.id );
-    for( const auto& a : p.available_owner_approvals )
+    for( const auto& a : get_accounts( p ) )
        remove( a, p.id );
 }
 
@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  */
 #include <graphene/chain/protocol/block.hpp>
+#include <graphene/chain/protocol/digest_batch.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/bitutil.hpp>
 #include <algorithm>
@@ -29,7 +30,7 @@
 namespace graphene { namespace chain {
    digest_type block_header::digest()const
    {
-      return digest_type::hash(*this);
+      return hash_packed<digest_type>( *this );
    }
 
    uint32_t block_header::num_from_id(const block_id_type& id)
@@ -39,7 +40,7 @@ namespace graphene { namespace chain {
 
    block_id_type signed_block_header::id()const
    {
-      auto tmp = fc::sha224::hash( *this );
+      auto tmp = hash_packed<fc::sha224>( *this );
       tmp._hash[0] = fc::endian_reverse_u32(block_num()); // store the block num in the ID, 160 bits is plenty for the hash
       static_assert( sizeof(tmp._hash[0]) == 4, "should be 4 bytes" );
       block_id_type result;
@@ -75,12 +76,11 @@ namespace graphene { namespace chain {
       vector<digest_type>::size_type current_number_of_hashes = ids.size();
       while( current_number_of_hashes > 1 )
       {
-         // hash ID's in pairs
+         // hash ID's in pairs, the whole level at once
          uint32_t i_max = current_number_of_hashes - (current_number_of_hashes&1);
-         uint32_t k = 0;
+         uint32_t k = i_max / 2;
 
-         for( uint32_t i = 0; i < i_max; i += 2 )
-            ids[k++] = digest_type::hash( std::make_pair( ids[i], ids[i+1] ) );
+         hash_digest_pairs( ids.data(), k, ids.data() );
 
          if( current_number_of_hashes&1 )
             ids[k++] = ids[i_max];
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/protocol/digest_batch.hpp>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define GRAPHENE_SHA256_SHANI 1
+#endif
+
+namespace graphene { namespace chain {
+
+namespace {
+
+#ifdef GRAPHENE_SHA256_SHANI
+const uint32_t k256[64] = {
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/** the rounds of one block with the SHA extensions, state is ABEF and CDGH as sha256rnds2 wants them */
+__attribute__((target("sha,sse4.1")))
+inline void rounds_shani( __m128i& abef, __m128i& cdgh, const __m128i msg[4] )
+{
+   const __m128i abef_save = abef, cdgh_save = cdgh;
+   __m128i m0 = msg[0], m1 = msg[1], m2 = msg[2], m3 = msg[3];
+   __m128i t;
+   for( int i = 0; i < 16; ++i )
+   {
+      t = _mm_add_epi32( m0, _mm_loadu_si128( reinterpret_cast<const __m128i*>( k256 + 4 * i ) ) );
+      cdgh = _mm_sha256rnds2_epu32( cdgh, abef, t );
+      abef = _mm_sha256rnds2_epu32( abef, cdgh, _mm_shuffle_epi32( t, 0x0e ) );
+      if( i < 12 )
+      {
+         // the next four words of the schedule, from the last sixteen
+         __m128i next = _mm_sha256msg1_epu32( m0, m1 );
+         next = _mm_add_epi32( next, _mm_alignr_epi8( m3, m2, 4 ) );
+         next = _mm_sha256msg2_epu32( next, m3 );
+         m0 = m1; m1 = m2; m2 = m3; m3 = next;
+      }
+      else
+      {
+         m0 = m1; m1 = m2; m2 = m3;
+      }
+   }
+   abef = _mm_add_epi32( abef, abef_save );
+   cdgh = _mm_add_epi32( cdgh, cdgh_save );
+}
+
+/**
+ * Each message is the 64 bytes of two digests, so the second block of every message is the same padding, whose
+ * words are set up once for the whole batch.  The output of a pair is written after its input has been read, so
+ * out may be in.
+ */
+__attribute__((target("sha,sse4.1")))
+void hash_pairs_shani( const unsigned char* in, size_t pairs, unsigned char* out )
+{
+   const __m128i byte_swap = _mm_set_epi64x( 0x0c0d0e0f08090a0bull, 0x0405060700010203ull );
+   // ABEF and CDGH of the initial state
+   const __m128i init_abef = _mm_set_epi32( 0x6a09e667, 0xbb67ae85, 0x510e527f, 0x9b05688c );
+   const __m128i init_cdgh = _mm_set_epi32( 0x3c6ef372, 0xa54ff53a, 0x1f83d9ab, 0x5be0cd19 );
+   __m128i padding[4];
+   {
+      uint32_t w[16] = { 0x80000000 };
+      w[15] = 512;
+      for( int i = 0; i < 4; ++i )
+         padding[i] = _mm_set_epi32( w[4*i+3], w[4*i+2], w[4*i+1], w[4*i] );
+   }
+
+   for( size_t p = 0; p < pairs; ++p )
+   {
+      __m128i msg[4];
+      for( int i = 0; i < 4; ++i )
+         msg[i] = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + 64 * p + 16 * i ) ),
+                                    byte_swap );
+      __m128i abef = init_abef, cdgh = init_cdgh;
+      rounds_shani( abef, cdgh, msg );
+      rounds_shani( abef, cdgh, padding );
+
+      // back to ABCD and EFGH, big endian
+      const __m128i feba = _mm_shuffle_epi32( abef, 0x1b );
+      const __m128i hgdc = _mm_shuffle_epi32( cdgh, 0x1b );
+      const __m128i abcd = _mm_shuffle_epi8( _mm_unpacklo_epi64( feba, hgdc ), byte_swap );
+      const __m128i efgh = _mm_shuffle_epi8( _mm_unpackhi_epi64( feba, hgdc ), byte_swap );
+      _mm_storeu_si128( reinterpret_cast<__m128i*>( out + 32 * p ), abcd );
+      _mm_storeu_si128( reinterpret_cast<__m128i*>( out + 32 * p + 16 ), efgh );
+   }
+}
+
+/** asks cpuid directly, __builtin_cpu_supports only knows "sha" from GCC 11 on */
+bool cpu_has_shani()
+{
+   unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+   if( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) || !( ecx & ( 1u << 19 ) ) ) // SSE4.1
+      return false;
+   if( __get_cpuid_max( 0, nullptr ) < 7 )
+      return false;
+   __cpuid_count( 7, 0, eax, ebx, ecx, edx );
+   return ( ebx & ( 1u << 29 ) ) != 0; // SHA
+}
+
+bool has_shani()
+{
+   static const bool supported = cpu_has_shani();
+   return supported;
+}
+#endif
+
+} // anonymous namespace
+
+void hash_digest_pairs( const digest_type* in, size_t pairs, digest_type* out )
+{
+   static_assert( sizeof( digest_type ) == 32, "a digest is one SHA-256" );
+   const unsigned char* src = reinterpret_cast<const unsigned char*>( in );
+#ifdef GRAPHENE_SHA256_SHANI
+   if( has_shani() )
+   {
+      hash_pairs_shani( src, pairs, reinterpret_cast<unsigned char*>( out ) );
+      return;
+   }
+#endif
+   for( size_t p = 0; p < pairs; ++p )
+      out[p] = digest_type::hash( reinterpret_cast<const char*>( src + 64 * p ), 64 );
+}
+
+} } // graphene::chain
@@ -125,10 +125,11 @@ namespace graphene { namespace chain {
    asset fee_schedule::calculate_fee( const operation& op, const price& core_exchange_rate )const
    {
       //idump( (op)(core_exchange_rate) );
-      fee_parameters params; params.set_which(op.which());
-      auto itr = parameters.find(params);
-      if( itr != parameters.end() ) params = *itr;
-      auto base_value = op.visit( calc_fee_visitor( params ) );
+      const fee_parameters* found = find_parameters( op.which() );
+      fee_parameters params;
+      if( found == nullptr )
+         params.set_which( op.which() );
+      auto base_value = op.visit( calc_fee_visitor( found != nullptr ? *found : params ) );
       auto scaled = fc::uint128(base_value) * scale;
       scaled /= GRAPHENE_100_PERCENT;
       FC_ASSERT( scaled <= GRAPHENE_MAX_SHARE_SUPPLY );
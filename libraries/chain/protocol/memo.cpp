@@ -24,6 +24,8 @@
 #include <graphene/chain/protocol/memo.hpp>
 #include <fc/crypto/aes.hpp>
 
+#include <cstring>
+
 namespace graphene { namespace chain {
 
 void memo_data::set_message(const fc::ecc::private_key& priv, const fc::ecc::public_key& pub,
@@ -57,20 +59,22 @@ string memo_data::get_message(const fc::ecc::private_key& priv,
                               const fc::ecc::public_key& pub)const
 {
    if( from != public_key_type() )
-   {
-      auto secret = priv.get_shared_secret(pub);
-      auto nonce_plus_secret = fc::sha512::hash(fc::to_string(nonce) + secret.str());
-      auto plain_text = fc::aes_decrypt( nonce_plus_secret, message );
-      auto result = memo_message::deserialize(string(plain_text.begin(), plain_text.end()));
-      FC_ASSERT( result.checksum == uint32_t(digest_type::hash(result.text)._hash[0]) );
-      return result.text;
-   }
+      return get_message( priv.get_shared_secret(pub) );
    else
    {
       return memo_message::deserialize(string(message.begin(), message.end())).text;
    }
 }
 
+string memo_data::get_message(const fc::sha512& shared_secret)const
+{
+   auto nonce_plus_secret = fc::sha512::hash(fc::to_string(nonce) + shared_secret.str());
+   auto plain_text = fc::aes_decrypt( nonce_plus_secret, message );
+   auto result = memo_message::deserialize(string(plain_text.begin(), plain_text.end()));
+   FC_ASSERT( result.checksum == uint32_t(digest_type::hash(result.text)._hash[0]) );
+   return result.text;
+}
+
 string memo_message::serialize() const
 {
    auto serial_checksum = string(sizeof(checksum), ' ');
@@ -87,4 +91,63 @@ memo_message memo_message::deserialize(const string& serial)
    return result;
 }
 
+size_t memo_decryptor::key_pair_hash::operator()( const std::pair<public_key_type,public_key_type>& p )const
+{
+   char bytes[ 2 * sizeof(p.first.key_data.data) ];
+   std::memcpy( bytes, p.first.key_data.data, sizeof(p.first.key_data.data) );
+   std::memcpy( bytes + sizeof(p.first.key_data.data), p.second.key_data.data, sizeof(p.second.key_data.data) );
+   return seeded_hash( bytes, sizeof(bytes) );
+}
+
+memo_decryptor::memo_decryptor( size_t max_secrets ) : _secrets( max_secrets ) {}
+
+void memo_decryptor::add_key( const fc::ecc::private_key& key )
+{
+   _keys[ key.get_public_key() ] = key;
+}
+
+void memo_decryptor::clear()
+{
+   _keys.clear();
+   _secrets.clear();
+}
+
+fc::sha512 memo_decryptor::shared_secret( const public_key_type& mine, const public_key_type& theirs )
+{
+   auto key_pair = std::make_pair( mine, theirs );
+   fc::sha512 secret;
+   if( _secrets.find( key_pair, secret ) )
+      return secret;
+   secret = _keys.at( mine ).get_shared_secret( theirs );
+   _secrets.insert( key_pair, secret );
+   return secret;
+}
+
+optional<string> memo_decryptor::decrypt( const memo_data& memo )
+{
+   try
+   {
+      if( memo.from == public_key_type() )
+         return memo_message::deserialize( string( memo.message.begin(), memo.message.end() ) ).text;
+      if( has_key( memo.to ) )
+         return memo.get_message( shared_secret( memo.to, memo.from ) );
+      if( has_key( memo.from ) )
+         return memo.get_message( shared_secret( memo.from, memo.to ) );
+   }
+   catch( const fc::exception& e )
+   {
+      dlog( "Could not decrypt memo: ${e}", ("e", e.to_detail_string()) );
+   }
+   return optional<string>();
+}
+
+vector< optional<string> > memo_decryptor::decrypt( const vector<memo_data>& memos )
+{
+   vector< optional<string> > result;
+   result.reserve( memos.size() );
+   for( const auto& memo : memos )
+      result.push_back( decrypt( memo ) );
+   return result;
+}
+
 } } // graphene::chain
@@ -71,6 +71,196 @@ struct operation_get_required_auth
    }
 };
 
+/**
+ * Declares what each operation reads and changes, on top of paying its fee.  The operations not listed are unknown.
+ */
+struct operation_get_access_visitor
+{
+   typedef void result_type;
+
+   operation_access& result;
+   explicit operation_get_access_visitor( operation_access& r ) : result( r ) {}
+
+   void write( object_id_type id )const { result.writes.insert( id ); }
+   void read( object_id_type id )const  { result.reads.insert( id ); }
+   void create( uint8_t space, uint8_t type )const { write( operation_access::next_id_key( space, type ) ); }
+
+   template<typename T>
+   void operator()( const T& op )const
+   {
+      // the fee comes out of the payer's balance, and out of the fee pool of the asset it is paid in
+      write( op.fee_payer() );
+      if( op.fee.asset_id == asset_id_type() )
+         read( op.fee.asset_id );
+      else
+         write( op.fee.asset_id );
+      get( op );
+   }
+
+   /** if not declared more precisely below */
+   template<typename T>
+   void get( const T& )const { result.unknown = true; }
+
+   void get( const transfer_operation& op )const
+   {
+      write( op.to );
+      read( op.amount.asset_id );
+   }
+   void get( const override_transfer_operation& op )const
+   {
+      write( op.from );
+      write( op.to );
+      read( op.amount.asset_id );
+   }
+   void get( const limit_order_create_operation& op )const
+   {
+      // the orders it fills are in the market of the two assets
+      write( op.amount_to_sell.asset_id );
+      write( op.min_to_receive.asset_id );
+      create( protocol_ids, limit_order_object_type );
+   }
+   void get( const call_order_update_operation& op )const
+   {
+      write( op.delta_collateral.asset_id );
+      write( op.delta_debt.asset_id );
+      create( protocol_ids, call_order_object_type );
+   }
+   void get( const account_create_operation& op )const
+   {
+      read( op.referrer );
+      // names are unique, so the creations are ordered like the ids
+      create( protocol_ids, account_object_type );
+      for( const auto& a : op.owner.account_auths )
+         read( a.first );
+      for( const auto& a : op.active.account_auths )
+         read( a.first );
+      read( op.options.voting_account );
+   }
+   void get( const account_update_operation& op )const
+   {
+      if( op.owner )
+         for( const auto& a : op.owner->account_auths )
+            read( a.first );
+      if( op.active )
+         for( const auto& a : op.active->account_auths )
+            read( a.first );
+      if( op.new_options )
+         read( op.new_options->voting_account );
+   }
+   void get( const account_whitelist_operation& op )const
+   {
+      write( op.account_to_list );
+   }
+   void get( const asset_create_operation& op )const
+   {
+      // symbols are unique, so the creations are ordered like the ids
+      create( protocol_ids, asset_object_type );
+      if( op.bitasset_opts )
+         read( op.bitasset_opts->short_backing_asset );
+   }
+   void get( const asset_update_operation& op )const
+   {
+      write( op.asset_to_update );
+      if( op.new_issuer )
+         read( *op.new_issuer );
+   }
+   void get( const asset_issue_operation& op )const
+   {
+      write( op.asset_to_issue.asset_id );
+      write( op.issue_to_account );
+   }
+   void get( const asset_reserve_operation& op )const
+   {
+      write( op.amount_to_reserve.asset_id );
+   }
+   void get( const asset_fund_fee_pool_operation& op )const
+   {
+      write( op.asset_id );
+      read( asset_id_type() );
+   }
+   void get( const asset_claim_fees_operation& op )const
+   {
+      write( op.amount_to_claim.asset_id );
+   }
+   void get( const withdraw_permission_create_operation& op )const
+   {
+      read( op.authorized_account );
+      read( op.withdrawal_limit.asset_id );
+      create( protocol_ids, withdraw_permission_object_type );
+   }
+   void get( const withdraw_permission_update_operation& op )const
+   {
+      write( op.permission_to_update );
+      read( op.withdrawal_limit.asset_id );
+   }
+   void get( const withdraw_permission_claim_operation& op )const
+   {
+      write( op.withdraw_permission );
+      write( op.withdraw_from_account );
+      read( op.amount_to_withdraw.asset_id );
+   }
+   void get( const withdraw_permission_delete_operation& op )const
+   {
+      write( op.withdrawal_permission );
+   }
+   void get( const vesting_balance_create_operation& op )const
+   {
+      write( op.owner );
+      read( op.amount.asset_id );
+      create( protocol_ids, vesting_balance_object_type );
+   }
+   void get( const vesting_balance_withdraw_operation& op )const
+   {
+      write( op.vesting_balance );
+      read( op.amount.asset_id );
+   }
+   void get( const balance_claim_operation& op )const
+   {
+      write( op.balance_to_claim );
+      read( op.total_claimed.asset_id );
+   }
+   void get( const custom_operation& )const {}
+   struct predicate_reads
+   {
+      typedef void result_type;
+      const operation_get_access_visitor& v;
+      void operator()( const account_name_eq_lit_predicate& p )const { v.read( p.account_id ); }
+      void operator()( const asset_symbol_eq_lit_predicate& p )const { v.read( p.asset_id ); }
+      void operator()( const block_id_predicate& )const {}
+   };
+   void get( const assert_operation& op )const
+   {
+      for( const auto& p : op.predicates )
+         p.visit( predicate_reads{ *this } );
+   }
+};
+
+bool operation_access::conflicts_with( const operation_access& o )const
+{
+   if( unknown || o.unknown )
+      return true;
+   auto intersects = []( const flat_set<object_id_type>& a, const flat_set<object_id_type>& b ) {
+      auto ia = a.begin();
+      auto ib = b.begin();
+      while( ia != a.end() && ib != b.end() )
+      {
+         if( *ia < *ib )
+            ++ia;
+         else if( *ib < *ia )
+            ++ib;
+         else
+            return true;
+      }
+      return false;
+   };
+   return intersects( writes, o.writes ) || intersects( writes, o.reads ) || intersects( reads, o.writes );
+}
+
+void operation_get_access( const operation& op, operation_access& result )
+{
+   op.visit( operation_get_access_visitor( result ) );
+}
+
 void operation_validate( const operation& op )
 {
    op.visit( operation_validator() );
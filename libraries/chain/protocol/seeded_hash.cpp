@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/protocol/seeded_hash.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+namespace graphene { namespace chain {
+
+namespace {
+
+   struct sip_key
+   {
+      uint64_t k0;
+      uint64_t k1;
+   };
+
+   sip_key random_key()
+   {
+      std::random_device rd;
+      sip_key key;
+      key.k0 = ( uint64_t( rd() ) << 32 ) | rd();
+      key.k1 = ( uint64_t( rd() ) << 32 ) | rd();
+      return key;
+   }
+
+   inline uint64_t rotl( uint64_t x, int b )
+   {
+      return ( x << b ) | ( x >> ( 64 - b ) );
+   }
+
+   inline void sip_round( uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3 )
+   {
+      v0 += v1; v1 = rotl( v1, 13 ); v1 ^= v0; v0 = rotl( v0, 32 );
+      v2 += v3; v3 = rotl( v3, 16 ); v3 ^= v2;
+      v0 += v3; v3 = rotl( v3, 21 ); v3 ^= v0;
+      v2 += v1; v1 = rotl( v1, 17 ); v1 ^= v2; v2 = rotl( v2, 32 );
+   }
+
+}
+
+size_t seeded_hash( const void* data, size_t size )
+{
+   static const sip_key key = random_key();
+   const unsigned char* bytes = static_cast<const unsigned char*>( data );
+
+   uint64_t v0 = 0x736f6d6570736575ULL ^ key.k0;
+   uint64_t v1 = 0x646f72616e646f6dULL ^ key.k1;
+   uint64_t v2 = 0x6c7967656e657261ULL ^ key.k0;
+   uint64_t v3 = 0x7465646279746573ULL ^ key.k1;
+
+   const size_t whole = size - size % 8;
+   for( size_t i = 0; i < whole; i += 8 )
+   {
+      // the byte order only changes which hash a value gets, not how well they spread
+      uint64_t m;
+      std::memcpy( &m, bytes + i, sizeof(m) );
+      v3 ^= m;
+      sip_round( v0, v1, v2, v3 );
+      sip_round( v0, v1, v2, v3 );
+      v0 ^= m;
+   }
+
+   uint64_t last = uint64_t( size ) << 56;
+   for( size_t i = whole; i < size; ++i )
+      last |= uint64_t( bytes[i] ) << ( 8 * ( i - whole ) );
+   v3 ^= last;
+   sip_round( v0, v1, v2, v3 );
+   sip_round( v0, v1, v2, v3 );
+   v0 ^= last;
+
+   v2 ^= 0xff;
+   for( int i = 0; i < 4; ++i )
+      sip_round( v0, v1, v2, v3 );
+   return size_t( v0 ^ v1 ^ v2 ^ v3 );
+}
+
+} } // graphene::chain
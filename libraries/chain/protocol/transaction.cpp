@@ -23,40 +23,160 @@
  */
 #include <graphene/chain/exceptions.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
+#include <graphene/chain/protocol/lru_cache.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/bitutil.hpp>
 #include <fc/smart_ref_impl.hpp>
 #include <algorithm>
+#include <cstring>
 
 namespace graphene { namespace chain {
 
+namespace detail {
+
+   struct signature_key
+   {
+      digest_type    digest;
+      signature_type signature;
+
+      bool operator == ( const signature_key& other )const
+      {
+         return digest == other.digest &&
+                std::memcmp( signature.begin(), other.signature.begin(), signature.size() ) == 0;
+      }
+   };
+
+   struct signature_key_hash
+   {
+      size_t operator()( const signature_key& k )const
+      {
+         char bytes[ sizeof(k.digest) + sizeof(k.signature) ];
+         std::memcpy( bytes, k.digest.data(), sizeof(k.digest) );
+         std::memcpy( bytes + sizeof(k.digest), k.signature.begin(), sizeof(k.signature) );
+         return seeded_hash( bytes, sizeof(bytes) );
+      }
+   };
+
+   struct digest_hash
+   {
+      size_t operator()( const digest_type& d )const
+      {
+         return seeded_hash( d.data(), sizeof(d) );
+      }
+   };
+
+   /** maps (signature digest, signature) to the recovered key */
+   typedef lru_cache< signature_key, public_key_type, signature_key_hash > signature_key_cache;
+   static signature_key_cache& signature_keys()
+   {
+      static signature_key_cache cache( 100000 );
+      return cache;
+   }
+
+   /** the digests of the transactions with confidential operations which passed validate() */
+   typedef lru_cache< digest_type, bool, digest_hash > validated_digest_cache;
+   static validated_digest_cache& validated_digests()
+   {
+      static validated_digest_cache cache( 10000 );
+      return cache;
+   }
+
+   /** the operations whose validation verifies commitments, which is worth remembering */
+   struct is_confidential_visitor
+   {
+      typedef bool result_type;
+      template<typename T>
+      bool operator()( const T& )const { return false; }
+      bool operator()( const transfer_to_blind_operation& )const { return true; }
+      bool operator()( const blind_transfer_operation& )const { return true; }
+      bool operator()( const transfer_from_blind_operation& )const { return true; }
+   };
+
+} // detail
+
+void set_signature_cache_size( size_t entries )
+{
+   detail::signature_keys().set_capacity( entries );
+}
+
+void set_validation_cache_size( size_t entries )
+{
+   detail::validated_digests().set_capacity( entries );
+}
+
 digest_type processed_transaction::merkle_digest()const
 {
+   if( _sealed && _merkle_sealed )
+      return _merkle_digest;
+   return hash_packed<digest_type>( *this );
+}
+
+void processed_transaction::seal( const chain_id_type& chain_id )const
+{
+   if( _sealed && _merkle_sealed && _sig_chain_id == chain_id )
+      return;
+   // the packed processed_transaction starts with the packed transaction, so pack once and hash both
+   auto packed = fc::raw::pack( *this );
+   auto trx_size = fc::raw::pack_size( static_cast<const transaction&>( *this ) );
+   _merkle_digest = digest_type::hash( packed.data(), packed.size() );
+   _digest = digest_type::hash( packed.data(), trx_size );
    digest_type::encoder enc;
-   fc::raw::pack( enc, *this );
-   return enc.result();
+   fc::raw::pack( enc, chain_id );
+   enc.write( packed.data(), trx_size );
+   _sig_digest = enc.result();
+   _sig_chain_id = chain_id;
+   _merkle_sealed = true;
+   _sealed = true;
 }
 
 digest_type transaction::digest()const
 {
-   digest_type::encoder enc;
-   fc::raw::pack( enc, *this );
-   return enc.result();
+   if( _sealed )
+      return _digest;
+   return hash_packed<digest_type>( *this );
 }
 
 digest_type transaction::sig_digest( const chain_id_type& chain_id )const
 {
+   if( _sealed && _sig_chain_id == chain_id )
+      return _sig_digest;
+   return hash_packed<digest_type>( chain_id, *this );
+}
+
+void transaction::seal( const chain_id_type& chain_id )const
+{
+   if( _sealed && _sig_chain_id == chain_id )
+      return;
+   auto packed = fc::raw::pack( *this );
+   _digest = digest_type::hash( packed.data(), packed.size() );
    digest_type::encoder enc;
    fc::raw::pack( enc, chain_id );
-   fc::raw::pack( enc, *this );
-   return enc.result();
+   enc.write( packed.data(), packed.size() );
+   _sig_digest = enc.result();
+   _sig_chain_id = chain_id;
+   _sealed = true;
 }
 
 void transaction::validate() const
 {
    FC_ASSERT( operations.size() > 0, "A transaction must have at least one operation", ("trx",*this) );
+   // verifying the commitments of confidential transfers costs much more than hashing the transaction, and the
+   // same transaction is validated when it is pushed and again when it arrives in a block
+   bool confidential = false;
+   for( const auto& op : operations )
+      confidential = confidential || op.visit( detail::is_confidential_visitor() );
+   digest_type d;
+   if( confidential )
+   {
+      d = digest();
+      bool validated;
+      if( detail::validated_digests().find( d, validated ) )
+         return;
+   }
    for( const auto& op : operations )
       operation_validate(op); 
+   if( confidential )
+      detail::validated_digests().insert( d, true );
 }
 
 graphene::chain::transaction_id_type graphene::chain::transaction::id() const
@@ -71,24 +191,25 @@ const signature_type& graphene::chain::signed_transaction::sign(const private_ke
 {
    digest_type h = sig_digest( chain_id );
    signatures.push_back(key.sign_compact(h));
+   // the signatures are part of the merkle digest
+   unseal();
    return signatures.back();
 }
 
 signature_type graphene::chain::signed_transaction::sign(const private_key_type& key, const chain_id_type& chain_id)const
 {
-   digest_type::encoder enc;
-   fc::raw::pack( enc, chain_id );
-   fc::raw::pack( enc, *this );
-   return key.sign_compact(enc.result());
+   return key.sign_compact( hash_packed<digest_type>( chain_id, *this ) );
 }
 
 void transaction::set_expiration( fc::time_point_sec expiration_time )
 {
     expiration = expiration_time;
+    unseal();
 }
 
 void transaction::set_reference_block( const block_id_type& reference_block )
 {
+   unseal();
    ref_block_num = fc::endian_reverse_u32(reference_block._hash[0]);
    ref_block_prefix = reference_block._hash[1];
 }
@@ -120,46 +241,42 @@ struct sign_state
          return itr->second = true;
       }
 
-      optional<map<address,public_key_type>> available_address_sigs;
-      optional<map<address,public_key_type>> provided_address_sigs;
+      /** every address form of the provided and available keys, built on first use */
+      optional<flat_map<address,public_key_type>> address_sigs;
 
       bool signed_by( const address& a ) {
-         if( !available_address_sigs ) {
-            available_address_sigs = std::map<address,public_key_type>();
-            provided_address_sigs = std::map<address,public_key_type>();
-            for( auto& item : available_keys ) {
-             (*available_address_sigs)[ address(pts_address(item, false, 56) ) ] = item;
-             (*available_address_sigs)[ address(pts_address(item, true, 56) ) ] = item;
-             (*available_address_sigs)[ address(pts_address(item, false, 0) ) ] = item;
-             (*available_address_sigs)[ address(pts_address(item, true, 0) ) ] = item;
-             (*available_address_sigs)[ address(item) ] = item;
-            }
-            for( auto& item : provided_signatures ) {
-             (*provided_address_sigs)[ address(pts_address(item.first, false, 56) ) ] = item.first;
-             (*provided_address_sigs)[ address(pts_address(item.first, true, 56) ) ] = item.first;
-             (*provided_address_sigs)[ address(pts_address(item.first, false, 0) ) ] = item.first;
-             (*provided_address_sigs)[ address(pts_address(item.first, true, 0) ) ] = item.first;
-             (*provided_address_sigs)[ address(item.first) ] = item.first;
-            }
+         if( !address_sigs ) {
+            address_sigs = flat_map<address,public_key_type>();
+            address_sigs->reserve( 5 * ( provided_signatures.size() + available_keys.size() ) );
+            auto add = [this]( const public_key_type& k ) {
+               // insert() keeps the first key seen for an address, so provided signatures take precedence
+               for( const auto& a : key_addresses( k ) )
+                  address_sigs->insert( std::make_pair( a, k ) );
+            };
+            for( const auto& item : provided_signatures )
+               add( item.first );
+            for( const auto& item : available_keys )
+               add( item );
          }
-         auto itr = provided_address_sigs->find(a);
-         if( itr == provided_address_sigs->end() )
-         {
-            auto aitr = available_address_sigs->find(a);
-            if( aitr != available_address_sigs->end() ) {
-               auto pk = available_keys.find(aitr->second);
-               if( pk != available_keys.end() )
-                  return provided_signatures[aitr->second] = true;
-               return false;
-            }
-         }
-         return provided_signatures[itr->second] = true;
+         auto itr = address_sigs->find(a);
+         if( itr == address_sigs->end() )
+            return false;
+         return signed_by( itr->second );
+      }
+
+      /** looks up the active authority of each account once per transaction */
+      const authority* active_of( account_id_type id )
+      {
+         auto itr = active_authorities.find(id);
+         if( itr == active_authorities.end() )
+            itr = active_authorities.emplace( id, get_active(id) ).first;
+         return itr->second;
       }
 
       bool check_authority( account_id_type id )
       {
          if( approved_by.find(id) != approved_by.end() ) return true;
-         return check_authority( get_active(id) );
+         return check_authority( active_of(id) );
       }
 
       /**
@@ -194,7 +311,7 @@ struct sign_state
             {
                if( depth == max_recursion )
                   return false;
-               if( check_authority( get_active( a.first ), depth+1 ) )
+               if( check_authority( active_of( a.first ), depth+1 ) )
                {
                   approved_by.insert( a.first );
                   total_weight += a.second;
@@ -229,8 +346,10 @@ struct sign_state
                   const flat_set<public_key_type>& keys = flat_set<public_key_type>() )
       :get_active(a),available_keys(keys)
       {
+         // sigs is sorted, so each key goes at the end
+         provided_signatures.reserve( sigs.size() );
          for( const auto& key : sigs )
-            provided_signatures[ key ] = false;
+            provided_signatures.emplace_hint( provided_signatures.end(), key, false );
          approved_by.insert( GRAPHENE_TEMP_ACCOUNT  );
       }
 
@@ -239,6 +358,7 @@ struct sign_state
 
       flat_map<public_key_type,bool>   provided_signatures;
       flat_set<account_id_type>        approved_by;
+      flat_map<account_id_type,const authority*> active_authorities;
       uint32_t                         max_recursion = GRAPHENE_MAX_SIG_CHECK_DEPTH;
 };
 
@@ -300,11 +420,19 @@ void verify_authority( const vector<operation>& ops, const flat_set<public_key_t
 flat_set<public_key_type> signed_transaction::get_signature_keys( const chain_id_type& chain_id )const
 { try {
    auto d = sig_digest( chain_id );
+   auto& cache = detail::signature_keys();
    flat_set<public_key_type> result;
    for( const auto&  sig : signatures )
    {
+      detail::signature_key k{ d, sig };
+      public_key_type key;
+      if( !cache.find( k, key ) )
+      {
+         key = fc::ecc::public_key( sig, d );
+         cache.insert( k, key );
+      }
       GRAPHENE_ASSERT(
-         result.insert( fc::ecc::public_key(sig,d) ).second,
+         result.insert( key ).second,
          tx_duplicate_sig,
          "Duplicate Signature detected" );
    }
@@ -383,4 +511,57 @@ void signed_transaction::verify_authority(
    graphene::chain::verify_authority( operations, get_signature_keys( chain_id ), get_active, get_owner, max_recursion );
 } FC_CAPTURE_AND_RETHROW( (*this) ) }
 
+vector<uint32_t> get_transaction_lanes( const vector<processed_transaction>& trxs )
+{
+   // joins the transactions which share a key that one of them writes
+   vector<uint32_t> parent( trxs.size() );
+   std::iota( parent.begin(), parent.end(), 0 );
+   auto find = [&parent]( uint32_t i ) {
+      while( parent[i] != i )
+         i = parent[i] = parent[parent[i]];
+      return i;
+   };
+   auto join = [&]( uint32_t a, uint32_t b ) {
+      a = find( a );
+      b = find( b );
+      if( a != b )
+         parent[std::max( a, b )] = std::min( a, b );
+   };
+
+   std::unordered_map< object_id_type, uint32_t > writer;
+   vector< std::pair<object_id_type, uint32_t> > reads;
+   optional<uint32_t> first_unknown;
+   for( uint32_t i = 0; i < trxs.size(); ++i )
+   {
+      operation_access access;
+      for( const auto& op : trxs[i].operations )
+         operation_get_access( op, access );
+      if( access.unknown && !first_unknown )
+         first_unknown = i;
+      for( const auto& key : access.writes )
+      {
+         auto itr = writer.emplace( key, i ).first;
+         join( itr->second, i );
+      }
+      for( const auto& key : access.reads )
+         reads.emplace_back( key, i );
+   }
+   for( const auto& r : reads )
+   {
+      auto itr = writer.find( r.first );
+      if( itr != writer.end() )
+         join( itr->second, r.second );
+   }
+   // the unknown ones may conflict with any other
+   if( first_unknown )
+      for( uint32_t i = 0; i < trxs.size(); ++i )
+         join( *first_unknown, i );
+
+   vector<uint32_t> result( trxs.size() );
+   std::unordered_map< uint32_t, uint32_t > lane_of_root;
+   for( uint32_t i = 0; i < trxs.size(); ++i )
+      result[i] = lane_of_root.emplace( find( i ), uint32_t( lane_of_root.size() ) ).first->second;
+   return result;
+}
+
 } } // graphene::chain
@@ -23,14 +23,74 @@
  */
 #include <graphene/chain/config.hpp>
 #include <graphene/chain/protocol/types.hpp>
+#include <graphene/chain/protocol/lru_cache.hpp>
 
 #include <fc/crypto/base58.hpp>
 #include <fc/crypto/ripemd160.hpp>
 #include <fc/exception/exception.hpp>
 #include <fc/io/raw.hpp>
 
+#include <cstring>
+
 namespace graphene { namespace chain {
 
+namespace detail {
+
+   struct key_data_hash
+   {
+      size_t operator()( const fc::ecc::public_key_data& k )const
+      {
+         return seeded_hash( k.data, sizeof(k.data) );
+      }
+   };
+
+   typedef lru_cache< fc::ecc::public_key_data, std::array<address,5>, key_data_hash > key_address_cache;
+   static key_address_cache& key_address_lookup()
+   {
+      static key_address_cache cache( 10000 );
+      return cache;
+   }
+
+   /** key strings that were converted to keys */
+   typedef lru_cache< std::string, fc::ecc::public_key_data, std::hash<std::string> > decoded_key_cache;
+   static decoded_key_cache& decoded_keys()
+   {
+      static decoded_key_cache cache( 10000 );
+      return cache;
+   }
+
+   /** keys that were converted to strings */
+   typedef lru_cache< fc::ecc::public_key_data, std::string, key_data_hash > encoded_key_cache;
+   static encoded_key_cache& encoded_keys()
+   {
+      static encoded_key_cache cache( 10000 );
+      return cache;
+   }
+
+} // detail
+
+    std::array<address,5> key_addresses( const public_key_type& key )
+    {
+       std::array<address,5> result;
+       if( detail::key_address_lookup().find( key.key_data, result ) )
+          return result;
+       fc::ecc::public_key pub( key.key_data );
+       result[0] = pts_address( pub, false, 56 );
+       result[1] = pts_address( pub, true, 56 );
+       result[2] = pts_address( pub, false, 0 );
+       result[3] = pts_address( pub, true, 0 );
+       result[4] = address( key );
+       detail::key_address_lookup().insert( key.key_data, result );
+       return result;
+    }
+
+    void set_key_cache_size( size_t entries )
+    {
+       detail::key_address_lookup().set_capacity( entries );
+       detail::decoded_keys().set_capacity( entries );
+       detail::encoded_keys().set_capacity( entries );
+    }
+
     public_key_type::public_key_type():key_data(){};
 
     public_key_type::public_key_type( const fc::ecc::public_key_data& data )
@@ -41,6 +101,8 @@ namespace graphene { namespace chain {
 
     public_key_type::public_key_type( const std::string& base58str )
     {
+       if( detail::decoded_keys().find( base58str, key_data ) )
+          return;
       // TODO:  Refactor syntactic checks into static is_valid()
       //        to make public_key_type API more similar to address API
        std::string prefix( GRAPHENE_ADDRESS_PREFIX );
@@ -62,6 +124,7 @@ namespace graphene { namespace chain {
        auto bin_key = fc::raw::unpack<binary_key>(bin);
        key_data = bin_key.data;
        FC_ASSERT( fc::ripemd160::hash( key_data.data, key_data.size() )._hash[0] == bin_key.check );
+       detail::decoded_keys().insert( base58str, key_data );
     };
 
     // TODO: This is temporary for testing
@@ -90,11 +153,16 @@ namespace graphene { namespace chain {
 
     public_key_type::operator std::string() const
     {
+       std::string result;
+       if( detail::encoded_keys().find( key_data, result ) )
+          return result;
        binary_key k;
        k.data = key_data;
        k.check = fc::ripemd160::hash( k.data.data, k.data.size() )._hash[0];
        auto data = fc::raw::pack( k );
-       return GRAPHENE_ADDRESS_PREFIX + fc::to_base58( data.data(), data.size() );
+       result = GRAPHENE_ADDRESS_PREFIX + fc::to_base58( data.data(), data.size() );
+       detail::encoded_keys().insert( key_data, result );
+       return result;
     }
 
     bool operator == ( const public_key_type& p1, const fc::ecc::public_key& p2)
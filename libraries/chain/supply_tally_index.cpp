@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/supply_tally_index.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/balance_object.hpp>
+#include <graphene/chain/market_object.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
+
+namespace graphene { namespace chain {
+
+void supply_tally_index::note( const object& obj, int64_t sign )
+{
+   auto add = [this,sign]( const asset& a ) {
+      if( a.amount != 0 )
+         held[a.asset_id] += a.amount * sign;
+   };
+
+   if( obj.id.space() == protocol_ids )
+   {
+      switch( obj.id.type() )
+      {
+         case limit_order_object_type:
+         {
+            const auto& order = static_cast<const limit_order_object&>( obj );
+            const asset for_sale = order.amount_for_sale();
+            add( for_sale );
+            add( asset( order.deferred_fee ) );
+            if( for_sale.asset_id == asset_id_type() )
+               core_in_orders += for_sale.amount * sign;
+            break;
+         }
+         case call_order_object_type:
+         {
+            const auto& order = static_cast<const call_order_object&>( obj );
+            const asset collateral = order.get_collateral();
+            add( collateral );
+            if( collateral.asset_id == asset_id_type() )
+               core_in_orders += collateral.amount * sign;
+            debts[order.debt_type()] += order.debt * sign;
+            break;
+         }
+         case force_settlement_object_type:
+            add( static_cast<const force_settlement_object&>( obj ).balance );
+            break;
+         case vesting_balance_object_type:
+            add( static_cast<const vesting_balance_object&>( obj ).balance );
+            break;
+         case balance_object_type:
+            add( static_cast<const balance_object&>( obj ).balance );
+            break;
+         default:
+            break;
+      }
+      return;
+   }
+
+   switch( obj.id.type() )
+   {
+      case impl_account_balance_object_type:
+      {
+         const auto& balance = static_cast<const account_balance_object&>( obj );
+         if( balance.balance != 0 )
+            held[balance.asset_type] += balance.balance * sign;
+         break;
+      }
+      case impl_account_statistics_object_type:
+      {
+         const auto& stats = static_cast<const account_statistics_object&>( obj );
+         add( asset( stats.pending_fees + stats.pending_vested_fees ) );
+         reported_core_in_orders += stats.total_core_in_orders * sign;
+         break;
+      }
+      default:
+         break;
+   }
+}
+
+} } // graphene::chain
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/transaction_dedupe.hpp>
+
+#include <fc/io/fstream.hpp>
+#include <fc/io/raw.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+namespace graphene { namespace chain {
+
+optional<signed_transaction> transaction_dedupe::find( const transaction_id_type& id )const
+{
+   auto itr = _transactions.find( id );
+   if( itr == _transactions.end() )
+      return optional<signed_transaction>();
+   return fc::raw::unpack<signed_transaction>( itr->second->data );
+}
+
+transaction_dedupe::transaction_ptr transaction_dedupe::pack( const signed_transaction& trx )
+{
+   auto packed = std::make_shared<packed_transaction>();
+   packed->expiration = trx.expiration;
+   packed->data = fc::raw::pack( trx );
+   return packed;
+}
+
+void transaction_dedupe::add( const transaction_id_type& id, transaction_ptr trx )
+{
+   _by_expiration[trx->expiration].push_back( id );
+   _packed_bytes += trx->data.size();
+   _transactions.emplace( id, std::move( trx ) );
+}
+
+void transaction_dedupe::erase( const transaction_id_type& id )
+{
+   auto itr = _transactions.find( id );
+   FC_ASSERT( itr != _transactions.end() );
+   auto bucket = _by_expiration.find( itr->second->expiration );
+   assert( bucket != _by_expiration.end() );
+   // the transaction rolled back is most likely the last one added
+   auto& ids = bucket->second;
+   auto pos = std::find( ids.rbegin(), ids.rend(), id );
+   assert( pos != ids.rend() );
+   ids.erase( std::next( pos ).base() );
+   if( ids.empty() )
+      _by_expiration.erase( bucket );
+   _packed_bytes -= itr->second->data.size();
+   _transactions.erase( itr );
+}
+
+void transaction_dedupe::insert( const transaction_id_type& id, const signed_transaction& trx )
+{
+   FC_ASSERT( !contains( id ), "Duplicate transaction", ("id",id) );
+   add( id, pack( trx ) );
+   if( recording() )
+      _journal.push_back( change{ id, transaction_ptr() } );
+}
+
+void transaction_dedupe::remove_expired( fc::time_point_sec now )
+{
+   const bool record = recording();
+   while( !_by_expiration.empty() && _by_expiration.begin()->first < now )
+   {
+      for( const transaction_id_type& id : _by_expiration.begin()->second )
+      {
+         auto itr = _transactions.find( id );
+         _packed_bytes -= itr->second->data.size();
+         if( record )
+            _journal.push_back( change{ id, std::move( itr->second ) } );
+         _transactions.erase( itr );
+      }
+      _by_expiration.erase( _by_expiration.begin() );
+   }
+}
+
+void transaction_dedupe::rollback( uint64_t pos )
+{
+   FC_ASSERT( pos >= _journal_start, "The journal has been forgotten up to ${s}", ("s",_journal_start)("pos",pos) );
+   while( position() > pos )
+   {
+      change& last = _journal.back();
+      if( last.removed )
+         add( last.id, std::move( last.removed ) );
+      else
+         erase( last.id );
+      _journal.pop_back();
+   }
+}
+
+void transaction_dedupe::forget_before( uint64_t pos )
+{
+   while( _journal_start < pos && !_journal.empty() )
+   {
+      _journal.pop_front();
+      ++_journal_start;
+   }
+}
+
+void transaction_dedupe::clear()
+{
+   _transactions.clear();
+   _by_expiration.clear();
+   _packed_bytes = 0;
+   _journal_start = position();
+   _journal.clear();
+}
+
+void transaction_dedupe::save( const fc::path& file )const
+{ try {
+   // the file holds the vector< pair<transaction_id_type, signed_transaction> > of the transactions, which is
+   // written straight from their packed form
+   std::ofstream out( file.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+   FC_ASSERT( out );
+   fc::raw::pack( out, fc::unsigned_int( _transactions.size() ) );
+   for( const auto& bucket : _by_expiration )
+      for( const transaction_id_type& id : bucket.second )
+      {
+         const vector<char>& data = _transactions.at( id )->data;
+         fc::raw::pack( out, id );
+         out.write( data.data(), data.size() );
+      }
+   out.flush();
+   FC_ASSERT( out, "Error writing ${f}", ("f",file) );
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+void transaction_dedupe::load( const fc::path& file )
+{ try {
+   clear();
+   if( !fc::exists( file ) )
+      return;
+   std::ifstream in( file.generic_string(), std::ifstream::binary | std::ifstream::in );
+   FC_ASSERT( in );
+   vector< std::pair<transaction_id_type, signed_transaction> > transactions;
+   fc::raw::unpack( in, transactions );
+   for( auto& item : transactions )
+      add( item.first, pack( item.second ) );
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+} } // graphene::chain
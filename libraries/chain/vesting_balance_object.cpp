@@ -237,4 +237,51 @@ asset vesting_balance_object::get_allowed_withdraw(const time_point_sec& now)con
    return policy.visit(get_allowed_withdraw_visitor(balance, now, amount));
 }
 
+namespace {
+   /** positions of the balances with a policy of type Policy, in the order given */
+   template< typename Policy >
+   vector<uint32_t> balances_with_policy( const vector<const vesting_balance_object*>& balances )
+   {
+      const int tag = vesting_policy::tag<Policy>::value;
+      vector<uint32_t> result;
+      result.reserve( balances.size() );
+      for( uint32_t i = 0; i < balances.size(); ++i )
+         if( balances[i]->policy.which() == tag )
+            result.push_back( i );
+      return result;
+   }
+}
+
+vector<asset> get_allowed_withdraws( const vector<const vesting_balance_object*>& balances, const time_point_sec& now )
+{
+   vector<asset> result( balances.size() );
+   vesting_policy_context ctx( asset(), now, asset() );
+
+   for( uint32_t i : balances_with_policy<linear_vesting_policy>( balances ) )
+   {
+      ctx.balance = balances[i]->balance;
+      result[i] = balances[i]->policy.get<linear_vesting_policy>().get_allowed_withdraw( ctx );
+   }
+   for( uint32_t i : balances_with_policy<cdd_vesting_policy>( balances ) )
+   {
+      ctx.balance = balances[i]->balance;
+      result[i] = balances[i]->policy.get<cdd_vesting_policy>().get_allowed_withdraw( ctx );
+   }
+   return result;
+}
+
+vector<fc::uint128_t> get_coin_seconds_earned( const vector<const vesting_balance_object*>& balances,
+                                               const time_point_sec& now )
+{
+   vector<fc::uint128_t> result( balances.size() );
+   vesting_policy_context ctx( asset(), now, asset() );
+
+   for( uint32_t i : balances_with_policy<cdd_vesting_policy>( balances ) )
+   {
+      ctx.balance = balances[i]->balance;
+      result[i] = balances[i]->policy.get<cdd_vesting_policy>().compute_coin_seconds_earned( ctx );
+   }
+   return result;
+}
+
 } } // graphene::chain
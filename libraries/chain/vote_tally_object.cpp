@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/vote_tally_object.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
+
+namespace graphene { namespace chain {
+
+void vote_change_index::note( const object& obj )
+{
+   if( obj.id.space() == protocol_ids )
+   {
+      if( obj.id.type() == account_object_type )
+         mark( static_cast<const account_object&>( obj ).id );
+      else if( obj.id.type() == vesting_balance_object_type )
+         mark( static_cast<const vesting_balance_object&>( obj ).owner );
+      return;
+   }
+
+   switch( obj.id.type() )
+   {
+      case impl_account_balance_object_type:
+      {
+         const auto& balance = static_cast<const account_balance_object&>( obj );
+         if( balance.asset_type == asset_id_type() )
+            mark( balance.owner );
+         break;
+      }
+      case impl_account_statistics_object_type:
+      {
+         const auto& stats = static_cast<const account_statistics_object&>( obj );
+         mark( stats.owner );
+         if( stats.pending_fees > 0 || stats.pending_vested_fees > 0 )
+            fee_payers.insert( stats.owner );
+         else
+            fee_payers.erase( stats.owner );
+         break;
+      }
+      case impl_vote_tally_object_type:
+         for( const auto& o : static_cast<const vote_tally_object&>( obj ).opinions )
+            opinions_changed.insert( o.first );
+         break;
+      default:
+         break;
+   }
+}
+
+void vote_change_index::object_inserted( const object& obj )
+{
+   note( obj );
+}
+
+void vote_change_index::object_removed( const object& obj )
+{
+   note( obj );
+   if( obj.id.space() == implementation_ids && obj.id.type() == impl_account_statistics_object_type )
+      fee_payers.erase( static_cast<const account_statistics_object&>( obj ).owner );
+}
+
+void vote_change_index::about_to_modify( const object& before )
+{
+   if( before.id.space() != implementation_ids )
+      return;
+   if( before.id.type() == impl_account_statistics_object_type )
+   {
+      const auto& stats = static_cast<const account_statistics_object&>( before );
+      _before_core_in_orders = stats.total_core_in_orders;
+      _before_tallied_stake = stats.tallied_stake;
+      _before_tallied_opinion_account = stats.tallied_opinion_account;
+   }
+   else if( before.id.type() == impl_vote_tally_object_type )
+      _before_opinions = static_cast<const vote_tally_object&>( before ).opinions;
+}
+
+void vote_change_index::object_modified( const object& after )
+{
+   if( after.id.space() != implementation_ids )
+   {
+      note( after );
+      return;
+   }
+
+   if( after.id.type() == impl_account_statistics_object_type )
+   {
+      // the statistics change with every operation, most of the time in fields the tally doesn't read
+      const auto& stats = static_cast<const account_statistics_object&>( after );
+      if( stats.total_core_in_orders != _before_core_in_orders || stats.tallied_stake != _before_tallied_stake ||
+          stats.tallied_opinion_account != _before_tallied_opinion_account )
+         mark( stats.owner );
+      if( stats.pending_fees > 0 || stats.pending_vested_fees > 0 )
+         fee_payers.insert( stats.owner );
+      else
+         fee_payers.erase( stats.owner );
+   }
+   else if( after.id.type() == impl_vote_tally_object_type )
+   {
+      // only the entries that differ, which is all of the ones maintenance wrote or an undo restored
+      const auto& opinions = static_cast<const vote_tally_object&>( after ).opinions;
+      for( const auto& o : opinions )
+      {
+         auto itr = _before_opinions.find( o.first );
+         if( itr == _before_opinions.end() || !( itr->second == o.second ) )
+            opinions_changed.insert( o.first );
+      }
+      for( const auto& o : _before_opinions )
+         if( opinions.find( o.first ) == opinions.end() )
+            opinions_changed.insert( o.first );
+      _before_opinions.clear();
+   }
+   else
+      note( after );
+}
+
+} } // graphene::chain
@@ -57,6 +57,13 @@ namespace graphene { namespace db {
             modify_callback( _objects[obj.id.instance()] );
          }
 
+         template<typename Lambda>
+         void modify_object( const T& obj, const Lambda& m )
+         {
+            assert( obj.id.instance() < _objects.size() );
+            m( _objects[obj.id.instance()] );
+         }
+
          virtual const object& insert( object&& obj )override
          {
             auto instance = obj.id.instance();
@@ -101,6 +108,15 @@ namespace graphene { namespace db {
             return result;
          }
 
+         virtual index_memory_usage get_memory_usage()const override
+         {
+            index_memory_usage usage;
+            usage.object_count = _objects.size();
+            usage.object_bytes = usage.object_count * sizeof(T);
+            usage.index_bytes  = ( _objects.capacity() - _objects.size() ) * sizeof(T);
+            return usage;
+         }
+
          class const_iterator
          {
             public:
@@ -23,10 +23,12 @@
  */
 #pragma once
 #include <graphene/db/index.hpp>
+#include <graphene/db/pool_allocator.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
+#include <boost/mpl/size.hpp>
 
 namespace graphene { namespace chain {
 
@@ -38,8 +40,16 @@ namespace graphene { namespace chain {
     *  Almost all objects can be tracked and managed via a boost::multi_index container that uses
     *  an unordered_unique key on the object ID.  This template class adapts the generic index interface
     *  to work with arbitrary boost multi_index containers on the same type.
+    *
+    *  When DenseIdLookup is true the index also maintains a vector from instance number to object,
+    *  making find() a constant time lookup rather than a walk of the ordered by_id index.  The vector
+    *  grows with the highest instance ever created, so this should only be enabled for object types
+    *  whose instances are mostly alive (e.g. accounts and balances), not for short lived objects.
+    *
+    *  Object types with a lot of churn, like orders, should give their MultiIndexType a
+    *  graphene::db::pool_allocator so that creating and removing objects reuses freed nodes.
     */
-   template<typename ObjectType, typename MultiIndexType>
+   template<typename ObjectType, typename MultiIndexType, bool DenseIdLookup = false>
    class generic_index : public index
    {
       public:
@@ -51,6 +61,7 @@ namespace graphene { namespace chain {
             assert( nullptr != dynamic_cast<ObjectType*>(&obj) );
             auto insert_result = _indices.insert( std::move( static_cast<ObjectType&>(obj) ) );
             FC_ASSERT( insert_result.second, "Could not insert object, most likely a uniqueness constraint was violated" );
+            set_instance( *insert_result.first );
             return *insert_result.first;
          }
 
@@ -62,19 +73,28 @@ namespace graphene { namespace chain {
             auto insert_result = _indices.insert( std::move(item) );
             FC_ASSERT(insert_result.second, "Could not create object! Most likely a uniqueness constraint is violated.");
             use_next_id();
+            set_instance( *insert_result.first );
             return *insert_result.first;
          }
 
          virtual void modify( const object& obj, const std::function<void(object&)>& m )override
          {
             assert( nullptr != dynamic_cast<const ObjectType*>(&obj) );
-            auto ok = _indices.modify( _indices.iterator_to( static_cast<const ObjectType&>(obj) ),
-                                       [&m]( ObjectType& o ){ m(o); } );
+            modify_object( static_cast<const ObjectType&>(obj), m );
+         }
+
+         template<typename Lambda>
+         void modify_object( const ObjectType& obj, const Lambda& m )
+         {
+            const auto instance = obj.id.instance();
+            auto ok = _indices.modify( _indices.iterator_to( obj ), [&m]( ObjectType& o ){ m(o); } );
+            if( !ok ) clear_instance( instance ); // modify() erased the object
             FC_ASSERT( ok, "Could not modify object, most likely a index constraint was violated" );
          }
 
          virtual void remove( const object& obj )override
          {
+            clear_instance( obj.id.instance() );
             _indices.erase( _indices.iterator_to( static_cast<const ObjectType&>(obj) ) );
          }
 
@@ -82,6 +102,14 @@ namespace graphene { namespace chain {
          {
             static_assert(std::is_same<typename MultiIndexType::key_type, object_id_type>::value,
                           "First index of MultiIndexType MUST be object_id_type!");
+            if( DenseIdLookup )
+            {
+               const auto instance = id.instance();
+               if( instance >= _by_instance.size() ) return nullptr;
+               const ObjectType* result = _by_instance[instance];
+               assert( result == nullptr || result->id == id );
+               return result;
+            }
             auto itr = _indices.find( id );
             if( itr == _indices.end() ) return nullptr;
             return &*itr;
@@ -107,9 +135,44 @@ namespace graphene { namespace chain {
             return result;
          }
 
+         virtual index_memory_usage get_memory_usage()const override
+         {
+            // each node holds the object and, for every ordered index, the parent (with the color packed
+            // into it), left and right pointers; a pooled allocator knows what its slabs take, free nodes included
+            const uint64_t index_count = boost::mpl::size< typename MultiIndexType::index_type_list >::value;
+            const uint64_t node_overhead = index_count * 3 * sizeof(void*) + heap_allocation_overhead;
+            index_memory_usage usage;
+            usage.object_count = _indices.size();
+            usage.object_bytes = usage.object_count * sizeof(ObjectType);
+            const uint64_t node_bytes = graphene::db::allocated_node_bytes( _indices.get_allocator(),
+                                           usage.object_count * ( sizeof(ObjectType) + node_overhead ) );
+            usage.index_bytes  = std::max( node_bytes, usage.object_bytes ) - usage.object_bytes
+                                 + _by_instance.capacity() * sizeof(const ObjectType*);
+            return usage;
+         }
+
       private:
-         fc::uint128 _current_hash;
-         index_type  _indices;
+         void set_instance( const ObjectType& obj )
+         {
+            if( !DenseIdLookup ) return;
+            const auto instance = obj.id.instance();
+            if( instance >= _by_instance.size() )
+               _by_instance.resize( instance + 1, nullptr );
+            _by_instance[instance] = &obj;
+         }
+         void clear_instance( uint64_t instance )
+         {
+            if( !DenseIdLookup ) return;
+            if( instance < _by_instance.size() )
+               _by_instance[instance] = nullptr;
+            while( !_by_instance.empty() && _by_instance.back() == nullptr )
+               _by_instance.pop_back();
+         }
+
+         fc::uint128                        _current_hash;
+         index_type                         _indices;
+         /** instance to object, only maintained when DenseIdLookup is set */
+         vector< const ObjectType* >        _by_instance;
    };
 
    /**
@@ -23,16 +23,33 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/memory_usage.hpp>
 #include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/io/json.hpp>
+#include <fc/crypto/city.hpp>
 #include <fc/crypto/sha256.hpp>
+#include <cstring>
 #include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
 
 namespace graphene { namespace db {
    class object_database;
    using fc::path;
 
+   /**
+    *  Maps an object type to the concrete primary_index registered for it with
+    *  object_database::add_index(), which lets object_database::modify() call that
+    *  index directly rather than through the virtual index interface.
+    *
+    *  Specialize with GRAPHENE_DECLARE_PRIMARY_INDEX, types without a specialization
+    *  keep using the virtual interface.
+    */
+   template<typename ObjectType>
+   struct primary_index_type { typedef void type; };
+
    /**
     * @class index_observer
     * @brief used to get callbacks when objects change
@@ -84,6 +101,13 @@ namespace graphene { namespace db {
           */
          virtual const object& insert( object&& obj ) = 0;
 
+         /**
+          *  Unpacks the object packed at data and puts it in the index, replacing the object with the same ID if
+          *  there is one and moving the next ID past it if it is new.  Undo state is recorded and the observers
+          *  and secondary indexes are notified as if the object had been created or modified.
+          */
+         virtual const object&  import( const char* data, size_t size ) = 0;
+
          /**
           * Builds a new object and assigns it the next available ID and then
           * initializes it with constructor and lastly inserts it into the index.
@@ -95,6 +119,23 @@ namespace graphene { namespace db {
           */
          virtual void open( const fc::path& db ) = 0;
          virtual void save( const fc::path& db ) = 0;
+         /**
+          * Packs what save( db ) would write into memory and returns the task writing it, which may run on any
+          * thread while this index goes on changing.  The index counts as saved from then on, so the task must
+          * run before the next save, and discard_saved() must be called if it fails.
+          *
+          * The task writes next to the files at db and leaves them as they were, commit_saved( db ) then moves
+          * what it wrote into place.
+          */
+         virtual std::function<void()> prepare_save( const fc::path& db ) = 0;
+         /** moves what the task of the last prepare_save( db ) wrote into place */
+         virtual void commit_saved( const fc::path& db ) = 0;
+         /** makes the next save write a complete snapshot, after a save which did not complete */
+         virtual void discard_saved() = 0;
+         /** writes a complete snapshot to file, which open() can load, without affecting later calls to save() */
+         virtual void export_snapshot( const fc::path& file )const = 0;
+         /** writes what export_snapshot() would write to the file to out */
+         virtual void export_snapshot( std::ostream& out )const = 0;
 
 
 
@@ -132,6 +173,18 @@ namespace graphene { namespace db {
 
          virtual void               object_from_variant( const fc::variant& var, object& obj )const = 0;
          virtual void               object_default( object& obj )const = 0;
+
+         /** @return the approximate memory held by this index, see index_memory_usage */
+         virtual index_memory_usage get_memory_usage()const = 0;
+
+         /**
+          *  Starts or stops keeping the digest of this index up to date as objects change.  The digest
+          *  equals hash(), the order independent sum of the object hashes, but costs hashing each
+          *  object as it changes rather than every object whenever it is read.
+          */
+         virtual void               set_maintain_digest( bool maintain ) = 0;
+         /** @return hash(), kept up to date if set_maintain_digest() and computed now otherwise */
+         virtual fc::uint128        get_digest()const = 0;
    };
 
    class secondary_index
@@ -142,6 +195,20 @@ namespace graphene { namespace db {
          virtual void object_removed( const object& obj ){};
          virtual void about_to_modify( const object& before ){};
          virtual void object_modified( const object& after  ){};
+
+         /**
+          *  Secondary indexes which are not read while blocks and transactions are being evaluated
+          *  (e.g. indexes only used by the API) may return true to have all modifications of an object
+          *  coalesced into a single about_to_modify()/object_modified() pair, delivered the next time
+          *  the index is fetched with base_primary_index::get_secondary_index().
+          */
+         virtual bool defer_modifications()const { return false; }
+
+         /**
+          *  For deferred indexes, returns false if the fields this index depends on are identical in
+          *  before and after, in which case the coalesced modification is not delivered at all.
+          */
+         virtual bool is_relevant_change( const object& before, const object& after )const { return true; }
    };
 
    /**
@@ -164,15 +231,24 @@ namespace graphene { namespace db {
          /** called just after obj is modified */
          void on_modify( const object& obj );
 
+         /** called just before the next ID is moved on by anything but create() */
+         void save_undo_next_id( object_id_type next_id );
+
+         /** the version to stamp an object with as it is created, modified or loaded, see object::version */
+         uint64_t next_object_version();
+
          template<typename T>
          void add_secondary_index()
          {
             _sindex.emplace_back( new T() );
+            if( _sindex.back()->defer_modifications() )
+               _has_deferred_sindex = true;
          }
 
          template<typename T>
          const T& get_secondary_index()const
          {
+            flush_deferred_modifications();
             for( const auto& item : _sindex )
             {
                const T* result = dynamic_cast<const T*>(item.get());
@@ -181,11 +257,66 @@ namespace graphene { namespace db {
             FC_THROW_EXCEPTION( fc::assert_exception, "invalid index type" );
          }
 
+         template<typename T>
+         T& get_secondary_index()
+         {
+            return const_cast<T&>( static_cast<const base_primary_index*>(this)->get_secondary_index<T>() );
+         }
+
+         /** delivers the coalesced modifications to the secondary indexes which defer them */
+         void flush_deferred_modifications()const;
+
       protected:
+         /** called when an object is restored by undo without passing through create() */
+         void on_insert( const object& obj );
+
+         /** notifies the secondary indexes that obj is about to be modified */
+         void sindex_about_to_modify( const object& obj );
+         /** notifies the secondary indexes that obj has been modified */
+         void sindex_modified( const object& obj );
+         /** notifies the secondary indexes that obj is about to be removed */
+         void sindex_removed( const object& obj );
+
+         /** adds the memory held by _dirty and the deferred modifications, and the secondary index count */
+         void add_tracking_memory_usage( index_memory_usage& usage )const;
+
+         /** the sum of the hashes of the objects in the index, only kept while _maintain_digest */
+         fc::uint128                            _digest;
+         bool                                   _maintain_digest = false;
+
          vector< shared_ptr<index_observer> >   _observers;
          vector< unique_ptr<secondary_index> >  _sindex;
 
+         /**
+          *  IDs of objects which have been added, modified or removed since the last
+          *  time this index was opened or saved.  These are the only objects which
+          *  need to be written to the delta segment on the next save.
+          */
+         std::unordered_set<object_id_type>     _dirty;
+
+         /**
+          *  True when the snapshot on disk reflects the in-memory state except for
+          *  the objects in _dirty, which means the next save() may append a delta
+          *  segment rather than rewriting the whole snapshot.
+          */
+         bool                                   _snapshot_valid = false;
+
       private:
+         struct deferred_modification
+         {
+            /** shared so that the memory accounting can pack it without holding the lock */
+            std::shared_ptr<object>  before;
+            const object*            after = nullptr;
+         };
+
+         static const size_t max_deferred_modifications = 1024;
+
+         bool                                                               _has_deferred_sindex = false;
+         /** the value of each object before its first modification since the last flush */
+         mutable std::unordered_map< object_id_type, deferred_modification > _deferred;
+         /** readers holding database::lock_state_for_reading() may flush at the same time */
+         mutable std::mutex                                                 _deferred_mutex;
+
          object_database& _db;
    };
 
@@ -222,54 +353,263 @@ namespace graphene { namespace db {
             return fc::sha256::hash(desc);
          }
 
+         /**
+          *  The snapshot of an index is stored in two files: the base snapshot at @ref db
+          *  containing every object, and an append-only delta segment next to it containing
+          *  one frame per save() with the objects which changed since the previous save().
+          *
+          *  The base snapshot is:  next_id, version, objects as packed vector<char>, trailer
+          *  where the trailer is the checksum of the object records followed by snapshot_trailer_magic.
+          *
+          *  The delta segment starts with a header:  delta_header_magic, checksum of the base snapshot
+          *  so that a segment left behind by an older base snapshot is never applied to a newer one.
+          *
+          *  Each delta frame is:  magic, next_id, body, checksum of body
+          *  where body is a packed vector of (id, optional<packed object>) and an empty optional
+          *  means the object was removed.
+          */
+         static fc::path delta_path( const path& db ) { return fc::path( db.generic_string() + ".delta" ); }
+         /** where prepare_save() stages a base snapshot and what it appends to the delta segment */
+         static fc::path staged_snapshot_path( const path& db ) { return fc::path( db.generic_string() + ".tmp" ); }
+         static fc::path staged_delta_path( const path& db ) { return fc::path( db.generic_string() + ".delta.tmp" ); }
+
          virtual void open( const path& db )override
          { 
+            _dirty.clear();
+            _snapshot_valid = false;
             if( !fc::exists( db ) ) return;
             fc::file_mapping fm( db.generic_string().c_str(), fc::read_only );
             fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(db) );
-            fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
+            const char* begin = (const char*)mr.get_address();
+            size_t      size  = mr.get_size();
             fc::sha256 open_ver;
 
+            // a snapshot written before checksums were added has no trailer
+            bool has_trailer = false;
+            uint64_t expected_checksum = 0;
+            if( size >= sizeof(uint64_t) + sizeof(uint32_t) )
+            {
+               uint32_t magic;
+               memcpy( &magic, begin + size - sizeof(magic), sizeof(magic) );
+               if( magic == snapshot_trailer_magic )
+               {
+                  has_trailer = true;
+                  size -= sizeof(uint64_t) + sizeof(uint32_t);
+                  memcpy( &expected_checksum, begin + size, sizeof(expected_checksum) );
+               }
+            }
+            if( !has_trailer )
+               wlog( "Index file ${f} has no checksum", ("f",db) );
+
+            fc::datastream<const char*> ds( begin, size );
             fc::raw::unpack(ds, _next_id);
             fc::raw::unpack(ds, open_ver);
             FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
-            try {
-               vector<char> tmp;
-               while( true ) 
+
+            // verify the whole file before loading anything so that a damaged index is left empty
+            const auto records = ds;
+            uint64_t checksum = 0;
+            while( ds.remaining() > 0 )
+            {
+               const char* record = ds.pos();
+               fc::unsigned_int record_size;
+               fc::raw::unpack( ds, record_size );
+               FC_ASSERT( record_size.value <= ds.remaining(), "Truncated object in index file",
+                          ("file",db)("size",record_size.value)("remaining",ds.remaining()) );
+               ds.skip( record_size.value );
+               checksum = update_checksum( checksum, record, ds.pos() - record );
+            }
+            FC_ASSERT( !has_trailer || checksum == expected_checksum, "Index file checksum mismatch", ("file",db) );
+
+            // each object is stored as a packed vector<char>, unpack it straight from the mapped file
+            ds = records;
+            while( ds.remaining() > 0 )
+            {
+               fc::unsigned_int record_size;
+               fc::raw::unpack( ds, record_size );
+               load( ds.pos(), record_size.value );
+               ds.skip( record_size.value );
+            }
+
+            _base_checksum = expected_checksum;
+            _snapshot_valid = has_trailer && open_delta( delta_path( db ) );
+            // loading bypasses the callbacks
+            if( _maintain_digest )
+               _digest = DerivedIndex::hash();
+         }
+
+         virtual void save( const path& db ) override
+         {
+            if( needs_snapshot( db ) )
+               save_snapshot( db );
+            else
+            {
+               prepare_save( db )();
+               commit_saved( db );
+            }
+         }
+
+         virtual std::function<void()> prepare_save( const path& db ) override
+         {
+            const auto delta = delta_path( db );
+            if( needs_snapshot( db ) )
+               return prepare_save_snapshot( db );
+            if( _dirty.empty() && _next_id == _saved_next_id )
+               return [](){};
+
+            delta_records records;
+            records.reserve( _dirty.size() );
+            for( const auto& id : _dirty )
+            {
+               records.emplace_back( id, fc::optional< vector<char> >() );
+               const object* obj = this->find( id );
+               if( obj != nullptr )
+                  records.back().second = fc::raw::pack( static_cast<const object_type&>(*obj) );
+            }
+            const auto body = fc::raw::pack( records );
+            uint64_t checksum = update_checksum( 0, body.data(), body.size() );
+
+            std::ostringstream frame( std::ios::out | std::ios::binary );
+            uint32_t magic = delta_frame_magic;
+            fc::raw::pack( frame, magic );
+            fc::raw::pack( frame, _next_id );
+            fc::raw::pack( frame, body );
+            fc::raw::pack( frame, checksum );
+            _dirty.clear();
+            _saved_next_id = _next_id;
+
+            auto packed = std::make_shared<const std::string>( frame.str() );
+            const uint64_t base_checksum = _base_checksum;
+            return [db, delta, packed, base_checksum]() {
+               // the frame is staged on its own, commit_saved() appends it to the segment
+               const fc::path staged = staged_delta_path( db );
+               fc::remove_all( staged_snapshot_path( db ) );
+               const bool new_segment = !fc::exists( delta ) || fc::file_size( delta ) == 0;
+               std::ofstream out( staged.generic_string(),
+                                  std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+               FC_ASSERT( out );
+               if( new_segment )
                {
-                  fc::raw::unpack( ds, tmp );
-                  load( tmp );
+                  uint32_t header_magic = delta_header_magic;
+                  out.write( (const char*)&header_magic, sizeof(header_magic) );
+                  out.write( (const char*)&base_checksum, sizeof(base_checksum) );
                }
-            } catch ( const fc::exception&  ){}
+               out.write( packed->data(), packed->size() );
+               out.flush();
+               FC_ASSERT( out, "Error writing delta segment", ("file",staged) );
+            };
          }
 
-         virtual void save( const path& db ) override 
+         virtual void commit_saved( const path& db ) override
          {
-            std::ofstream out( db.generic_string(), 
-                               std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
-            FC_ASSERT( out );
-            auto ver  = get_object_version();
-            fc::raw::pack( out, _next_id );
-            fc::raw::pack( out, ver );
-            this->inspect_all_objects( [&]( const object& o ) {
-                auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
-                auto packed_vec = fc::raw::pack( vec );
-                out.write( packed_vec.data(), packed_vec.size() );
-            });
+            const fc::path snapshot = staged_snapshot_path( db );
+            const fc::path staged   = staged_delta_path( db );
+            const fc::path delta    = delta_path( db );
+            if( fc::exists( snapshot ) )
+            {
+               // a crash between the two leaves a delta segment whose header no longer matches the base
+               fc::rename( snapshot, db );
+               fc::remove_all( delta );
+            }
+            if( !fc::exists( staged ) )
+               return;
+            if( !fc::exists( delta ) || fc::file_size( delta ) == 0 )
+            {
+               fc::rename( staged, delta );
+               return;
+            }
+            // a crash while appending leaves a torn frame, which opening the index discards
+            {
+               std::ifstream in( staged.generic_string(), std::ifstream::binary | std::ifstream::in );
+               std::ofstream out( delta.generic_string(),
+                                  std::ofstream::binary | std::ofstream::out | std::ofstream::app );
+               FC_ASSERT( in && out );
+               out << in.rdbuf();
+               out.flush();
+               FC_ASSERT( out, "Error writing delta segment", ("file",delta) );
+            }
+            fc::remove_all( staged );
+         }
+
+         virtual void discard_saved() override
+         {
+            _snapshot_valid = false;
+         }
+
+         virtual void export_snapshot( const path& file )const override
+         {
+            write_snapshot( file );
+         }
+
+         virtual void export_snapshot( std::ostream& out )const override
+         {
+            write_snapshot( out );
          }
 
          virtual const object&  load( const std::vector<char>& data )override
          {
-            const auto& result = DerivedIndex::insert( fc::raw::unpack<object_type>( data ) );
+            return load( data.data(), data.size() );
+         }
+
+         /** unpacks the object packed at data and inserts it without recording undo state */
+         const object&  load( const char* data, size_t size )
+         {
+            object_type obj;
+            fc::datastream<const char*> ds( data, size );
+            fc::raw::unpack( ds, obj );
+            obj.version = next_object_version();
+            const auto& result = DerivedIndex::insert( std::move(obj) );
             for( const auto& item : _sindex )
                item->object_inserted( result );
             return result;
          }
 
 
+         virtual const object&  insert( object&& obj )override
+         {
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            // undo restores removed objects this way, and removing them updated the secondary indexes
+            for( const auto& item : _sindex )
+               item->object_inserted( result );
+            on_insert( result );
+            return result;
+         }
+
+         virtual const object&  import( const char* data, size_t size )override
+         {
+            object_type obj;
+            fc::datastream<const char*> ds( data, size );
+            fc::raw::unpack( ds, obj );
+            FC_ASSERT( obj.id.space() == object_type::space_id && obj.id.type() == object_type::type_id,
+                       "Object does not belong in this index", ("id",obj.id) );
+
+            const object* existing = this->find( obj.id );
+            if( existing != nullptr )
+            {
+               modify( *existing, [&]( object& o ) { static_cast<object_type&>( o ) = std::move( obj ); } );
+               return *existing;
+            }
+
+            if( obj.id.instance() >= _next_id.instance() )
+            {
+               save_undo_next_id( _next_id );
+               _next_id = object_id_type( object_type::space_id, object_type::type_id, obj.id.instance() + 1 );
+            }
+            obj.version = next_object_version();
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            for( const auto& item : _sindex )
+               item->object_inserted( result );
+            on_add( result );
+            return result;
+         }
+
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
-            const auto& result = DerivedIndex::create( constructor );
+            const uint64_t version = next_object_version();
+            const auto& result = DerivedIndex::create( [&constructor,version]( object& o ) {
+               constructor( o );
+               o.version = version;
+            } );
             for( const auto& item : _sindex )
                item->object_inserted( result );
             on_add( result );
@@ -278,8 +618,7 @@ namespace graphene { namespace db {
 
          virtual void  remove( const object& obj ) override
          {
-            for( const auto& item : _sindex )
-               item->object_removed( obj );
+            sindex_removed( obj );
             on_remove(obj);
             DerivedIndex::remove(obj);
          }
@@ -287,11 +626,39 @@ namespace graphene { namespace db {
          virtual void modify( const object& obj, const std::function<void(object&)>& m )override
          {
             save_undo( obj );
-            for( const auto& item : _sindex )
-               item->about_to_modify( obj );
-            DerivedIndex::modify( obj, m );
-            for( const auto& item : _sindex )
-               item->object_modified( obj );
+            sindex_about_to_modify( obj );
+            const uint64_t version = next_object_version();
+            DerivedIndex::modify( obj, [&m,version]( object& o ) {
+               m( o );
+               o.version = version;
+            } );
+            sindex_modified( obj );
+            on_modify( obj );
+         }
+
+         /**
+          *  Statically dispatched version of modify() which passes the lambda straight to
+          *  the derived index without wrapping it in a std::function.
+          */
+         template<typename Lambda>
+         void modify_object( const object_type& obj, const Lambda& m )
+         {
+            save_undo( obj );
+            const uint64_t version = next_object_version();
+            auto stamped = [&m,version]( object_type& o ) {
+               m( o );
+               o.version = version;
+            };
+            if( _sindex.empty() )
+            {
+               DerivedIndex::modify_object( obj, stamped );
+            }
+            else
+            {
+               sindex_about_to_modify( obj );
+               DerivedIndex::modify_object( obj, stamped );
+               sindex_modified( obj );
+            }
             on_modify( obj );
          }
 
@@ -318,8 +685,217 @@ namespace graphene { namespace db {
             obj.id = id;
          }
 
+         virtual index_memory_usage get_memory_usage()const override
+         {
+            index_memory_usage usage = DerivedIndex::get_memory_usage();
+            usage.space_id = object_type::space_id;
+            usage.type_id  = object_type::type_id;
+            add_tracking_memory_usage( usage );
+            usage.total_bytes = usage.object_bytes + usage.index_bytes + usage.tracking_bytes;
+            return usage;
+         }
+
+         virtual void set_maintain_digest( bool maintain ) override
+         {
+            if( maintain && !_maintain_digest )
+               _digest = DerivedIndex::hash();
+            _maintain_digest = maintain;
+         }
+
+         virtual fc::uint128 get_digest()const override
+         {
+            return _maintain_digest ? _digest : DerivedIndex::hash();
+         }
+
       private:
+         static const uint32_t delta_header_magic     = 0x64686472; // "dhdr"
+         static const uint32_t delta_frame_magic      = 0x64656c74; // "delt"
+         static const uint32_t snapshot_trailer_magic = 0x736e6170; // "snap"
+
+         typedef vector< std::pair< object_id_type, fc::optional< vector<char> > > > delta_records;
+
+         /** cheap order dependent checksum over the records of a snapshot, not meant to be cryptographic */
+         static uint64_t update_checksum( uint64_t checksum, const char* data, size_t size )
+         {
+            return ( checksum * 1099511628211ull ) ^ fc::city_hash64( data, size );
+         }
+
+         /** whether the next save rewrites the base snapshot rather than appending to the delta segment */
+         bool needs_snapshot( const path& db )const
+         {
+            const auto delta = delta_path( db );
+            return !_snapshot_valid || !fc::exists( db ) ||
+                   ( fc::exists( delta ) && fc::file_size( delta ) > fc::file_size( db ) );
+         }
+
+         /** writes every object to a fresh base snapshot and discards the delta segment */
+         void save_snapshot( const path& db )
+         {
+            // write next to the old snapshot and swap it in, a crash while writing leaves the old one intact
+            const fc::path tmp = staged_snapshot_path( db );
+            _base_checksum = write_snapshot( tmp );
+
+            // a crash between the two leaves a delta segment whose header no longer matches the base
+            fc::rename( tmp, db );
+            fc::remove_all( delta_path( db ) );
+            fc::remove_all( staged_delta_path( db ) );
+            _dirty.clear();
+            _saved_next_id = _next_id;
+            _snapshot_valid = true;
+         }
+
+         /** save_snapshot() split into packing the objects now and a task doing the rest */
+         std::function<void()> prepare_save_snapshot( const path& db )
+         {
+            std::ostringstream out( std::ios::out | std::ios::binary );
+            _base_checksum = write_snapshot( out );
+            _dirty.clear();
+            _saved_next_id = _next_id;
+            _snapshot_valid = true;
+
+            auto packed = std::make_shared<const std::string>( out.str() );
+            return [db, packed]() {
+               // staged next to the old snapshot, commit_saved() swaps it in
+               const fc::path tmp = staged_snapshot_path( db );
+               fc::remove_all( staged_delta_path( db ) );
+               std::ofstream out( tmp.generic_string(),
+                                  std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+               FC_ASSERT( out );
+               out.write( packed->data(), packed->size() );
+               out.flush();
+               FC_ASSERT( out, "Error writing snapshot", ("file",tmp) );
+            };
+         }
+
+         /** @return the checksum stored in the trailer of the snapshot */
+         uint64_t write_snapshot( const path& file )const
+         {
+            std::ofstream out( file.generic_string(),
+                               std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+            FC_ASSERT( out );
+            const uint64_t checksum = write_snapshot( out );
+            out.flush();
+            FC_ASSERT( out, "Error writing snapshot", ("file",file) );
+            return checksum;
+         }
+
+         uint64_t write_snapshot( std::ostream& out )const
+         {
+            auto ver  = get_object_version();
+            uint64_t checksum = 0;
+            fc::raw::pack( out, _next_id );
+            fc::raw::pack( out, ver );
+            this->inspect_all_objects( [&]( const object& o ) {
+                auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
+                auto packed_vec = fc::raw::pack( vec );
+                out.write( packed_vec.data(), packed_vec.size() );
+                checksum = update_checksum( checksum, packed_vec.data(), packed_vec.size() );
+            });
+            uint32_t magic = snapshot_trailer_magic;
+            out.write( (const char*)&checksum, sizeof(checksum) );
+            out.write( (const char*)&magic, sizeof(magic) );
+            return checksum;
+         }
+
+         /**
+          *  Applies the frames of the delta segment on top of the objects loaded from the
+          *  base snapshot.  A frame is only applied once it has been read completely and its
+          *  checksum verified, so a frame torn by a crash during save() is discarded as a whole.
+          *
+          *  A segment whose header does not carry the checksum of the base snapshot was
+          *  written against another base, e.g. when a crash interrupted folding it into the
+          *  base, and is ignored entirely.
+          *
+          *  @return false if a torn frame or a foreign segment was found, in which case the next
+          *  save() must rewrite the whole snapshot rather than append to the damaged segment.
+          */
+         bool open_delta( const path& delta )
+         {
+            if( !fc::exists( delta ) || fc::file_size( delta ) == 0 )
+            {
+               _saved_next_id = _next_id;
+               return true;
+            }
+            fc::file_mapping fm( delta.generic_string().c_str(), fc::read_only );
+            fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(delta) );
+            fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
+
+            uint32_t header_magic = 0;
+            uint64_t base_checksum = 0;
+            if( ds.remaining() < sizeof(header_magic) + sizeof(base_checksum) )
+            {
+               wlog( "Discarding truncated delta segment ${f}", ("f",delta) );
+               _saved_next_id = _next_id;
+               return false;
+            }
+            fc::raw::unpack( ds, header_magic );
+            fc::raw::unpack( ds, base_checksum );
+            if( header_magic != delta_header_magic || base_checksum != _base_checksum )
+            {
+               wlog( "Ignoring delta segment ${f} which does not belong to its snapshot", ("f",delta) );
+               _saved_next_id = _next_id;
+               return false;
+            }
+
+            uint32_t frame_num = 0;
+            while( ds.remaining() > 0 )
+            {
+               object_id_type next_id;
+               delta_records records;
+               try {
+                  uint32_t magic = 0;
+                  fc::unsigned_int body_size;
+                  uint64_t checksum = 0;
+                  fc::raw::unpack( ds, magic );
+                  FC_ASSERT( magic == delta_frame_magic );
+                  fc::raw::unpack( ds, next_id );
+                  fc::raw::unpack( ds, body_size );
+                  FC_ASSERT( body_size.value <= ds.remaining() );
+                  const char* body = ds.pos();
+                  ds.skip( body_size.value );
+                  fc::raw::unpack( ds, checksum );
+                  FC_ASSERT( checksum == update_checksum( 0, body, body_size.value ) );
+
+                  fc::datastream<const char*> body_ds( body, body_size.value );
+                  fc::raw::unpack( body_ds, records );
+               } catch ( const fc::exception& ) {
+                  wlog( "Discarding torn frame ${n} of ${f}", ("n",frame_num)("f",delta) );
+                  _saved_next_id = _next_id;
+                  return false;
+               }
+
+               for( const auto& r : records )
+               {
+                  const object* existing = this->find( r.first );
+                  if( existing != nullptr )
+                  {
+                     for( const auto& item : _sindex )
+                        item->object_removed( *existing );
+                     DerivedIndex::remove( *existing );
+                  }
+                  if( r.second.valid() )
+                     load( *r.second );
+               }
+               _next_id = next_id;
+               ++frame_num;
+            }
+            _saved_next_id = _next_id;
+            return true;
+         }
+
          object_id_type _next_id;
+         object_id_type _saved_next_id;
+         /** checksum of the base snapshot on disk, the delta segment is bound to it */
+         uint64_t       _base_checksum = 0;
    };
 
 } } // graphene::db
+
+/**
+ *  Declares INDEX_TYPE, as passed to primary_index<>, to be the index of OBJECT_TYPE.
+ *  Must be used at global scope.
+ */
+#define GRAPHENE_DECLARE_PRIMARY_INDEX( OBJECT_TYPE, INDEX_TYPE ) \
+   namespace graphene { namespace db { \
+      template<> struct primary_index_type< OBJECT_TYPE > { typedef primary_index< INDEX_TYPE > type; }; \
+   } }
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <fc/reflect/reflect.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    *  Estimate of the bookkeeping the heap adds to every allocation.  The memory reported below is
+    *  computed from the sizes of the types involved rather than measured, it is meant for comparing
+    *  indexes and sizing nodes, not for exact accounting.
+    */
+   static const uint64_t heap_allocation_overhead = 2 * sizeof(void*);
+
+   /**
+    *  Approximate memory held by an index.  Memory the objects allocate themselves, such as the
+    *  contents of their vectors, maps and strings, is not included.
+    */
+   struct index_memory_usage
+   {
+      uint8_t  space_id = 0;
+      uint8_t  type_id = 0;
+      uint64_t object_count = 0;
+      /** the objects themselves, object_count times the size of the object type */
+      uint64_t object_bytes = 0;
+      /** the container around the objects: multi_index nodes, slots, lookup vectors and heap overhead */
+      uint64_t index_bytes = 0;
+      /** the ids changed since the last save and the clones held for deferred secondary indexes */
+      uint64_t tracking_bytes = 0;
+      uint32_t secondary_index_count = 0;
+      uint64_t total_bytes = 0;
+   };
+
+   /** approximate memory held by one undo state */
+   struct undo_state_memory_usage
+   {
+      /** the sessions squashed into the state */
+      uint32_t sessions = 1;
+      uint64_t modified_count = 0;
+      uint64_t created_count = 0;
+      uint64_t removed_count = 0;
+      uint64_t next_id_count = 0;
+      /** the arena holding the packed values of the modified objects */
+      uint64_t packed_bytes = 0;
+      /** the packed size of the removed objects, which are kept whole */
+      uint64_t removed_bytes = 0;
+      /** the nodes and buckets of the maps */
+      uint64_t container_bytes = 0;
+      uint64_t total_bytes = 0;
+   };
+
+   struct undo_memory_usage
+   {
+      uint32_t                               max_size = 0;
+      /** oldest first */
+      std::vector<undo_state_memory_usage>   states;
+      /** arenas of popped states kept for reuse */
+      uint64_t                               spare_arena_bytes = 0;
+      /** container nodes of popped states kept on the free lists of the node_pool for reuse */
+      uint64_t                               free_node_bytes = 0;
+      uint64_t                               total_bytes = 0;
+   };
+
+   struct object_database_memory_usage
+   {
+      /** every index, in order of space and type */
+      std::vector<index_memory_usage>  indexes;
+      undo_memory_usage                undo;
+      uint64_t                         total_bytes = 0;
+   };
+
+} } // graphene::db
+
+FC_REFLECT( graphene::db::index_memory_usage,
+            (space_id)(type_id)(object_count)(object_bytes)(index_bytes)(tracking_bytes)(secondary_index_count)
+            (total_bytes) )
+FC_REFLECT( graphene::db::undo_state_memory_usage,
+            (sessions)(modified_count)(created_count)(removed_count)(next_id_count)(packed_bytes)(removed_bytes)
+            (container_bytes)(total_bytes) )
+FC_REFLECT( graphene::db::undo_memory_usage, (max_size)(states)(spare_arena_bytes)(free_node_bytes)(total_bytes) )
+FC_REFLECT( graphene::db::object_database_memory_usage, (indexes)(undo)(total_bytes) )
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/db/index.hpp>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+namespace graphene { namespace db {
+
+   /**
+    *  @class name_lookup_index
+    *  @brief A secondary index that finds objects by the string in their Name member in constant time
+    *
+    *  The ordered index on the name remains the one to list names in order; this one answers the lookups of
+    *  single names, the account creation and asset creation checks and the API calls resolving names, with one
+    *  precomputed hash comparison and usually a single string comparison.
+    *
+    *  The table doesn't copy the names.  Each entry is a handle holding the address of the name inside the object
+    *  and its hash, so the table costs a few words per object.  The addresses stay valid because objects are
+    *  only moved by removing and inserting them again, which passes through here.
+    */
+   template<typename ObjectType, std::string ObjectType::*Name>
+   class name_lookup_index : public secondary_index
+   {
+      public:
+         virtual void object_inserted( const object& obj ) override
+         {
+            const ObjectType& o = static_cast<const ObjectType&>( obj );
+            _objects[ name_handle( o.*Name ) ] = &o;
+         }
+         virtual void object_removed( const object& obj ) override
+         {
+            _objects.erase( name_handle( static_cast<const ObjectType&>( obj ).*Name ) );
+         }
+         virtual void about_to_modify( const object& before ) override { object_removed( before ); }
+         virtual void object_modified( const object& after  ) override { object_inserted( after ); }
+
+         /** @return the object named name, or null if there is none */
+         const ObjectType* find( const std::string& name )const
+         {
+            auto itr = _objects.find( name_handle( name ) );
+            return itr == _objects.end() ? nullptr : itr->second;
+         }
+
+         size_t size()const { return _objects.size(); }
+
+      private:
+         struct name_handle
+         {
+            explicit name_handle( const std::string& n ) : name( &n ), hash( std::hash<std::string>()( n ) ) {}
+
+            bool operator == ( const name_handle& o )const { return hash == o.hash && *name == *o.name; }
+
+            const std::string*  name;
+            size_t              hash;
+         };
+         struct name_handle_hash
+         {
+            size_t operator()( const name_handle& h )const { return h.hash; }
+         };
+
+         std::unordered_map< name_handle, const ObjectType*, name_handle_hash > _objects;
+   };
+
+} } // graphene::db
@@ -70,12 +70,25 @@ namespace graphene { namespace db {
          // serialized
          object_id_type          id;
 
+         /**
+          * Changes with every change to the object, undo included, taken from one counter of the whole database so
+          * that an object id with an unchanged version has an unchanged value.  Not serialized: objects loaded
+          * from disk get new versions, and the counter starts from the time the database is constructed so
+          * versions handed out before a restart aren't handed out again.
+          */
+         uint64_t                version = 0;
+
          /// these methods are implemented for derived classes by inheriting abstract_object<DerivedClass>
          virtual unique_ptr<object> clone()const = 0;
          virtual void               move_from( object& obj ) = 0;
          virtual variant            to_variant()const  = 0;
          virtual vector<char>       pack()const = 0;
          virtual fc::uint128        hash()const = 0;
+
+         /** appends the packed object to buffer without an intermediate allocation */
+         virtual void               pack_into( vector<char>& buffer )const = 0;
+         /** replaces the content of this object with the packed value at data */
+         virtual void               unpack_from( const char* data, size_t size ) = 0;
    };
 
    /**
@@ -104,6 +117,23 @@ namespace graphene { namespace db {
              auto tmp = this->pack();
              return fc::city_hash_crc_128( tmp.data(), tmp.size() );
          }
+
+         virtual void pack_into( vector<char>& buffer )const
+         {
+            const auto& self = static_cast<const DerivedClass&>(*this);
+            const auto offset = buffer.size();
+            buffer.resize( offset + fc::raw::pack_size( self ) );
+            fc::datastream<char*> ds( buffer.data() + offset, buffer.size() - offset );
+            fc::raw::pack( ds, self );
+         }
+         virtual void unpack_from( const char* data, size_t size )
+         {
+            // unpack into a fresh value, fc::raw::unpack does not reset every member type
+            DerivedClass tmp;
+            fc::datastream<const char*> ds( data, size );
+            fc::raw::unpack( ds, tmp );
+            static_cast<DerivedClass&>(*this) = std::move( tmp );
+         }
    };
 
    typedef flat_map<uint8_t, object_id_type> annotation_map;
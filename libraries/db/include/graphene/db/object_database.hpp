@@ -28,10 +28,47 @@
 
 #include <fc/log/logger.hpp>
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fc { class thread; }
 
 namespace graphene { namespace db {
 
+   /**
+    * A snapshot of every index packed in memory by object_database::pack_snapshot(), which can be written to disk
+    * later from any thread while the database goes on changing.
+    */
+   struct packed_snapshot
+   {
+      /** the contents of each index file, by its path relative to the snapshot directory */
+      vector< std::pair<fc::path, std::string> > files;
+
+      uint64_t size()const;
+      /** writes the files below dir, laid out as object_database::export_snapshot() does */
+      void write( const fc::path& dir )const;
+   };
+
+   /** The digest of an index, see index::get_digest() */
+   struct index_digest
+   {
+      uint8_t     space_id = 0;
+      uint8_t     type_id = 0;
+      fc::uint128 digest;
+   };
+
+   /** The digests of every index, and their sum */
+   struct object_database_digest
+   {
+      /** every index, in order of space and type */
+      vector<index_digest> indexes;
+      fc::uint128          digest;
+   };
+
    /**
     *   @class object_database
     *   @brief maintains a set of indexed objects that can be modified with multi-level rollback support
@@ -42,17 +79,67 @@ namespace graphene { namespace db {
          object_database();
          ~object_database();
 
-         void reset_indexes() { _index.clear(); _index.resize(255); }
+         void reset_indexes()
+         {
+            wait_for_deferred_indexes();
+            _index.clear();
+            _index.resize(255);
+            _deferred_indexes.clear();
+         }
 
          void open(const fc::path& data_dir );
 
          /**
-          * Saves the complete state of the object_database to disk, this could take a while
+          * Saves the state of the object_database to disk.  Indexes which were opened from (or previously
+          * saved to) a snapshot only append the objects changed since then, otherwise the complete
+          * snapshot is written which could take a while.
           */
          void flush();
+         /**
+          * Packs what flush() would write into memory and returns the task writing it, so that it can be written by
+          * another thread while the database goes on changing.  The task must have run before the next flush, and
+          * discard_flushed() must be called if it fails.
+          *
+          * The task leaves the files of the last flush as they were, commit_flushed() moves what it wrote into
+          * place, so that the files hold either the state of the last flush or that of this one.
+          */
+         std::function<void()> prepare_flush();
+         /** moves what the task of the last prepare_flush() wrote into place, it must have completed */
+         void commit_flushed();
+         /** makes the next flush write complete snapshots of every index, after a flush which did not complete */
+         void discard_flushed();
+         /**
+          * Writes a complete snapshot of every index below dir, laid out like the object_database directory so
+          * it can be opened in place of it.  Unlike flush() this does not change what the next flush() writes.
+          */
+         void export_snapshot( const fc::path& dir );
+         /**
+          * Packs what export_snapshot() would write into memory, which is the part of taking a snapshot that
+          * has to see a consistent state.  Writing it to disk can then happen in the background.
+          */
+         packed_snapshot pack_snapshot()const;
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
+         /**
+          * Sets the number of threads used to open and flush the indexes, which are stored
+          * in independent files.  The default of 1 opens and flushes them sequentially.
+          */
+         void set_io_threads( uint32_t thread_count ) { _io_threads = std::max<uint32_t>( thread_count, 1 ); }
+         uint32_t get_io_threads()const { return _io_threads; }
+
+         /**
+          * While set, the indexes added are opened in the background: open() returns once the other indexes are
+          * loaded and leaves these to a thread of its own.  For indexes the chain itself never reads, like those
+          * of plugins.  Getting one of them, or an object in one of them, waits until they are loaded; whatever
+          * reads or changes them otherwise must call wait_for_deferred_indexes() first.
+          */
+         void defer_opening_new_indexes( bool defer ) { _defer_new_indexes = defer; }
+         /** waits until the indexes open() deferred are loaded, throws if loading them failed */
+         void wait_for_deferred_indexes()const;
+         /** whether open() is still loading deferred indexes in the background */
+         bool deferred_indexes_pending()const { return _deferred_open_state == deferred_open_loading; }
+
          template<typename T, typename F>
          const T& create( F&& constructor )
          {
@@ -80,15 +167,58 @@ namespace graphene { namespace db {
          const object& get_object( object_id_type id )const;
          const object* find_object( object_id_type id )const;
 
+         /** numbers of the objects created, modified and removed through this database, every modification counted */
+         struct change_counts
+         {
+            uint64_t created  = 0;
+            uint64_t modified = 0;
+            uint64_t removed  = 0;
+         };
+         const change_counts& get_change_counts()const { return _change_counts; }
+
+         /**
+          * The objects created, modified and removed since the last take_object_changes(), tracked by every change
+          * whether or not undo is enabled.  An object created and removed again in between is in none of them,
+          * and a removed object is kept as it was when it was removed.
+          */
+         struct object_changes
+         {
+            vector<object_id_type>                                created;
+            vector<object_id_type>                                modified;
+            std::unordered_map< object_id_type, unique_ptr<object> > removed;
+         };
+         object_changes take_object_changes();
+
+         /** @return the approximate memory held by every index and by the undo states */
+         object_database_memory_usage get_memory_usage()const;
+
+         /**
+          * Keeps the digest of every index up to date as objects change, including the indexes added later, so that
+          * get_digest() doesn't have to hash every object.  Turning it on hashes every object once.
+          */
+         void set_maintain_digests( bool maintain );
+         /** @return the digest of every index, comparable between nodes which hold the same objects */
+         object_database_digest get_digest()const;
+
          /// These methods are mutators of the object_database. You must use these methods to make changes to the object_database,
          /// in order to maintain proper undo history.
          ///@{
 
          const object& insert( object&& obj ) { return get_mutable_index(obj.id).insert( std::move(obj) ); }
+         /** uses up the id the next object of type T would get, as if it had been created and removed again */
+         template<typename T>
+         object_id_type use_next_id()
+         {
+            auto& idx = get_mutable_index<T>();
+            object_id_type id = idx.get_next_id();
+            _undo_db.on_id_used( id );
+            idx.use_next_id();
+            return id;
+         }
          void          remove( const object& obj ) { get_mutable_index(obj.id).remove( obj ); }
          template<typename T, typename Lambda>
          void modify( const T& obj, const Lambda& m ) {
-            get_mutable_index(obj.id).modify(obj,m);
+            modify_dispatch( obj, m, std::is_void< typename primary_index_type<T>::type >() );
          }
 
          ///@}
@@ -135,7 +265,11 @@ namespace graphene { namespace db {
                 _index[ObjectType::space_id].resize( 255 );
             assert(!_index[ObjectType::space_id][ObjectType::type_id]);
             unique_ptr<index> indexptr( new IndexType(*this) );
+            if( _maintain_digests )
+               indexptr->set_maintain_digest( true );
             _index[ObjectType::space_id][ObjectType::type_id] = std::move(indexptr);
+            if( _defer_new_indexes )
+               _deferred_indexes.insert( _index[ObjectType::space_id][ObjectType::type_id].get() );
             return static_cast<IndexType*>(_index[ObjectType::space_id][ObjectType::type_id].get());
          }
 
@@ -157,17 +291,71 @@ namespace graphene { namespace db {
          index& get_mutable_index(uint8_t space_id, uint8_t type_id);
 
      private:
+         template<typename T, typename Lambda>
+         void modify_dispatch( const T& obj, const Lambda& m, std::true_type ) {
+            get_mutable_index(obj.id).modify(obj,m);
+         }
+         /** the index type of T is known at compile time, see primary_index_type */
+         template<typename T, typename Lambda>
+         void modify_dispatch( const T& obj, const Lambda& m, std::false_type ) {
+            typedef typename primary_index_type<T>::type index_type;
+            index& idx = get_mutable_index( T::space_id, T::type_id );
+            assert( nullptr != dynamic_cast<index_type*>(&idx) );
+            static_cast<index_type&>(idx).modify_object( obj, m );
+         }
 
          friend class base_primary_index;
          friend class undo_database;
          void save_undo( const object& obj );
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
+         void save_undo_next_id( object_id_type next_id );
+         /** an object undo or a replay inserted again without creating it, see base_primary_index::on_insert */
+         void note_inserted( const object& obj );
+         uint64_t next_object_version() { return ++_object_version; }
+
+         /**
+          * calls io( index, file ) for every index with its file below dir, on _io_threads threads, only for the
+          * indexes filter accepts if given
+          */
+         void for_each_index_file( const char* what, const fc::path& dir,
+                                   const std::function<void(index&, const fc::path&)>& io,
+                                   const std::function<bool(const index&)>& filter = std::function<bool(const index&)>() );
+
+         enum deferred_open_state_type
+         {
+            deferred_open_done,
+            deferred_open_loading,
+            deferred_open_failed
+         };
 
          fc::path                                                  _data_dir;
          vector< vector< unique_ptr<index> > >                     _index;
+         uint32_t                                                  _io_threads = 1;
+         change_counts                                             _change_counts;
+         /** see take_object_changes() */
+         std::unordered_set<object_id_type>                        _changes_created;
+         std::unordered_set<object_id_type>                        _changes_modified;
+         std::unordered_map< object_id_type, unique_ptr<object> >  _changes_removed;
+         /** see object::version, atomic as deferred indexes load on their own thread */
+         std::atomic<uint64_t>                                     _object_version;
+
+         /** waits for the deferred indexes if idx is one of them and they are still loading */
+         void wait_if_deferred( const index& idx )const;
+
+         bool                                                      _defer_new_indexes = false;
+         bool                                                      _maintain_digests = false;
+         std::unordered_set<const index*>                          _deferred_indexes;
+         std::atomic<int>                                          _deferred_open_state{ deferred_open_done };
+         fc::exception_ptr                                         _deferred_open_error;
+         mutable std::mutex                                        _deferred_open_mutex;
+         mutable std::condition_variable                           _deferred_open_done;
+         unique_ptr<fc::thread>                                    _deferred_loader;
    };
 
 } } // graphene::db
 
+FC_REFLECT( graphene::db::index_digest, (space_id)(type_id)(digest) )
+FC_REFLECT( graphene::db::object_database_digest, (indexes)(digest) )
+
 
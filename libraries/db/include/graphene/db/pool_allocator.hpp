@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    *  @class node_pool
+    *  @brief Hands out blocks of a few fixed sizes carved from slabs, and keeps the freed ones for reuse
+    *
+    *  Containers allocating one node per element, like the boost::multi_index_container behind a generic_index,
+    *  pay a heap allocation and a free for every object created and removed.  Blocks handed out by the pool come
+    *  from slabs of blocks_per_slab blocks and go back on a free list of their size when freed, so churn
+    *  within the peak size of the container reaches the heap only once per slab.  The slabs are only freed with
+    *  the pool.
+    *
+    *  Not thread safe, like the containers using it.
+    */
+   class node_pool
+   {
+      public:
+         static const size_t blocks_per_slab = 64;
+
+         node_pool() {}
+         node_pool( const node_pool& ) = delete;
+         node_pool& operator = ( const node_pool& ) = delete;
+
+         ~node_pool()
+         {
+            for( void* slab : _slabs )
+               ::operator delete( slab );
+         }
+
+         void* allocate( size_t size )
+         {
+            size_class& c = class_of( size );
+            if( c.free == nullptr )
+               add_slab( c );
+            free_block* block = c.free;
+            c.free = block->next;
+            --c.free_count;
+            return block;
+         }
+
+         void deallocate( void* p, size_t size )
+         {
+            size_class& c = class_of( size );
+            free_block* block = static_cast<free_block*>( p );
+            block->next = c.free;
+            c.free = block;
+            ++c.free_count;
+         }
+
+         /** bytes of all slabs, handed out or free */
+         uint64_t reserved_bytes()const { return _reserved_bytes; }
+
+         /** bytes of the blocks on the free lists */
+         uint64_t free_bytes()const
+         {
+            uint64_t result = 0;
+            for( const auto& c : _classes )
+               result += c.free_count * c.block_size;
+            return result;
+         }
+
+      private:
+         struct free_block { free_block* next; };
+         struct size_class
+         {
+            size_t      block_size = 0;
+            free_block* free = nullptr;
+            uint64_t    free_count = 0;
+         };
+
+         static size_t block_size_of( size_t size )
+         {
+            // every block must hold a free list link and be aligned for any node type
+            const size_t align = alignof(std::max_align_t);
+            size = std::max( size, sizeof(free_block) );
+            return ( size + align - 1 ) / align * align;
+         }
+
+         /** only one or two node sizes per container, a linear search beats anything else */
+         size_class& class_of( size_t size )
+         {
+            const size_t block_size = block_size_of( size );
+            for( auto& c : _classes )
+               if( c.block_size == block_size )
+                  return c;
+            _classes.emplace_back();
+            _classes.back().block_size = block_size;
+            return _classes.back();
+         }
+
+         void add_slab( size_class& c )
+         {
+            char* slab = static_cast<char*>( ::operator new( c.block_size * blocks_per_slab ) );
+            _slabs.push_back( slab );
+            _reserved_bytes += c.block_size * blocks_per_slab;
+            for( size_t i = blocks_per_slab; i > 0; --i )
+            {
+               free_block* block = reinterpret_cast<free_block*>( slab + ( i - 1 ) * c.block_size );
+               block->next = c.free;
+               c.free = block;
+            }
+            c.free_count += blocks_per_slab;
+         }
+
+         std::vector<size_class>  _classes;
+         std::vector<void*>       _slabs;
+         uint64_t                 _reserved_bytes = 0;
+   };
+
+   /**
+    *  @class pool_allocator
+    *  @brief An allocator taking single elements from a node_pool, for the multi_index containers of indexes
+    *  with a lot of churn
+    *
+    *  A default constructed allocator creates its own pool, and its copies and rebinds share it, so every
+    *  container gets a pool of its own.  Containers which should share a pool, like the maps of the undo
+    *  states of a database, are given allocators constructed from it.  Arrays, like the buckets of hashed
+    *  indexes, come from the heap.
+    *
+    *  To use it, pass it as the allocator of the multi_index_container given to generic_index:
+    *  @code
+    *  typedef multi_index_container< T, indexed_by< ... >, graphene::db::pool_allocator<T> > T_multi_index_type;
+    *  @endcode
+    */
+   template<typename T>
+   class pool_allocator
+   {
+      public:
+         typedef T              value_type;
+         typedef T*             pointer;
+         typedef const T*       const_pointer;
+         typedef T&             reference;
+         typedef const T&       const_reference;
+         typedef std::size_t    size_type;
+         typedef std::ptrdiff_t difference_type;
+
+         template<typename U>
+         struct rebind { typedef pool_allocator<U> other; };
+
+         pool_allocator() : _pool( std::make_shared<node_pool>() ) {}
+         explicit pool_allocator( const std::shared_ptr<node_pool>& pool ) : _pool( pool ) {}
+         template<typename U>
+         pool_allocator( const pool_allocator<U>& other ) : _pool( other.pool_ptr() ) {}
+
+         pointer allocate( size_type n, const void* = nullptr )
+         {
+            if( n == 1 )
+               return static_cast<pointer>( _pool->allocate( sizeof(T) ) );
+            return static_cast<pointer>( ::operator new( n * sizeof(T) ) );
+         }
+
+         void deallocate( pointer p, size_type n )
+         {
+            if( n == 1 )
+               _pool->deallocate( p, sizeof(T) );
+            else
+               ::operator delete( p );
+         }
+
+         pointer       address( reference r )const       { return &r; }
+         const_pointer address( const_reference r )const { return &r; }
+         size_type     max_size()const                   { return size_type(-1) / sizeof(T); }
+
+         template<typename U, typename... Args>
+         void construct( U* p, Args&&... args ) { ::new( (void*)p ) U( std::forward<Args>(args)... ); }
+         template<typename U>
+         void destroy( U* p ) { p->~U(); }
+
+         const node_pool&                  pool()const     { return *_pool; }
+         const std::shared_ptr<node_pool>& pool_ptr()const { return _pool; }
+
+         template<typename U>
+         bool operator == ( const pool_allocator<U>& other )const { return _pool == other.pool_ptr(); }
+         template<typename U>
+         bool operator != ( const pool_allocator<U>& other )const { return _pool != other.pool_ptr(); }
+
+      private:
+         std::shared_ptr<node_pool> _pool;
+   };
+
+   /** the bytes of the nodes of a container using alloc, estimated for allocators other than pool_allocator */
+   template<typename Allocator>
+   uint64_t allocated_node_bytes( const Allocator&, uint64_t estimate ) { return estimate; }
+
+   template<typename T>
+   uint64_t allocated_node_bytes( const pool_allocator<T>& alloc, uint64_t ) { return alloc.pool().reserved_bytes(); }
+
+} } // graphene::db
@@ -59,6 +59,13 @@ namespace graphene { namespace db {
             modify_callback( *_objects[obj.id.instance()] );
          }
 
+         template<typename Lambda>
+         void modify_object( const T& obj, const Lambda& m )
+         {
+            assert( obj.id.instance() < _objects.size() );
+            m( static_cast<T&>( *_objects[obj.id.instance()] ) );
+         }
+
          virtual const object& insert( object&& obj )override
          {
             auto instance = obj.id.instance();
@@ -106,6 +113,18 @@ namespace graphene { namespace db {
             return result;
          }
 
+         virtual index_memory_usage get_memory_usage()const override
+         {
+            index_memory_usage usage;
+            for( const auto& ptr : _objects )
+               if( ptr ) ++usage.object_count;
+            usage.object_bytes = usage.object_count * sizeof(T);
+            // one allocation per object and a slot for every instance up to the highest
+            usage.index_bytes  = usage.object_count * heap_allocation_overhead
+                               + _objects.capacity() * sizeof(unique_ptr<object>);
+            return usage;
+         }
+
          class const_iterator
          {
             public:
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/db/index.hpp>
+
+#include <algorithm>
+#include <bitset>
+#include <new>
+#include <type_traits>
+
+namespace graphene { namespace db {
+
+   /**
+    *  @class slab_index
+    *  @brief A slab index stores objects in contiguous chunks of ChunkSize objects
+    *
+    *  Like simple_index, the object with instance N lives in slot N, so access by ID is
+    *  a direct lookup and the addresses of objects never change.  Unlike simple_index,
+    *  objects are constructed in place inside chunks allocated ChunkSize at a time rather
+    *  than being individually allocated, which saves one heap allocation per object and
+    *  keeps neighbouring objects next to each other for inspect_all_objects() and hash().
+    *
+    *  Removing an object destroys it in place and marks its slot as free, the slot is
+    *  reused if its instance is ever created again (e.g. after undo).  A chunk is freed
+    *  once all of its objects are removed, so pruning old objects returns their memory.
+    *
+    *  This index is preferred for append-mostly object types which are only accessed by ID.
+    */
+   template<typename T, uint32_t ChunkSize = 1024>
+   class slab_index : public index
+   {
+      public:
+         typedef T object_type;
+
+         slab_index() {}
+         slab_index( const slab_index& ) = delete;
+         slab_index& operator = ( const slab_index& ) = delete;
+
+         virtual ~slab_index()
+         {
+            for( const auto& c : _chunks )
+               if( c )
+                  for( uint32_t i = 0; i < ChunkSize; ++i )
+                     if( c->used[i] ) c->slot(i).~T();
+         }
+
+         virtual const object&  create( const std::function<void(object&)>& constructor ) override
+         {
+             auto id = get_next_id();
+             T& result = construct( id.instance(), T() );
+             result.id = id;
+             constructor( result );
+             result.id = id; // just in case it changed
+             use_next_id();
+             return result;
+         }
+
+         virtual void modify( const object& obj, const std::function<void(object&)>& modify_callback ) override
+         {
+            modify_callback( slot_of( obj ) );
+         }
+
+         template<typename Lambda>
+         void modify_object( const T& obj, const Lambda& m )
+         {
+            m( slot_of( obj ) );
+         }
+
+         virtual const object& insert( object&& obj )override
+         {
+            assert( nullptr != dynamic_cast<T*>(&obj) );
+            return construct( obj.id.instance(), std::move( static_cast<T&>(obj) ) );
+         }
+
+         virtual void remove( const object& obj ) override
+         {
+            assert( nullptr != dynamic_cast<const T*>(&obj) );
+            const auto instance = obj.id.instance();
+            chunk& c = *_chunks[instance / ChunkSize];
+            assert( c.used[instance % ChunkSize] );
+            c.slot( instance % ChunkSize ).~T();
+            c.used[instance % ChunkSize] = false;
+            if( c.used.none() )
+               _chunks[instance / ChunkSize].reset();
+
+            if( instance + 1 == _size )
+            {
+               while( _size > 0 && !is_used( _size - 1 ) )
+                  --_size;
+            }
+         }
+
+         virtual const object* find( object_id_type id )const override
+         {
+            assert( id.space() == T::space_id );
+            assert( id.type() == T::type_id );
+
+            const auto instance = id.instance();
+            if( instance >= _size || !is_used( instance ) ) return nullptr;
+            return &_chunks[instance / ChunkSize]->slot( instance % ChunkSize );
+         }
+
+         virtual void inspect_all_objects(std::function<void (const object&)> inspector)const override
+         {
+            try {
+               for( const T& obj : *this )
+                  inspector( obj );
+            } FC_CAPTURE_AND_RETHROW()
+         }
+
+         virtual fc::uint128 hash()const override {
+            fc::uint128 result;
+            for( const T& obj : *this )
+               result += obj.hash();
+
+            return result;
+         }
+
+         virtual index_memory_usage get_memory_usage()const override
+         {
+            index_memory_usage usage;
+            uint64_t chunk_count = 0;
+            for( const auto& c : _chunks )
+            {
+               if( !c ) continue;
+               ++chunk_count;
+               usage.object_count += c->used.count();
+            }
+            usage.object_bytes = usage.object_count * sizeof(T);
+            // the free slots of the allocated chunks count as overhead
+            usage.index_bytes  = chunk_count * ( sizeof(chunk) + heap_allocation_overhead ) - usage.object_bytes
+                               + _chunks.capacity() * sizeof(unique_ptr<chunk>);
+            return usage;
+         }
+
+         class const_iterator
+         {
+            public:
+               const_iterator( const slab_index& idx, uint64_t instance ):_index(&idx),_instance(instance)
+               {
+                  skip_free();
+               }
+               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._instance == b._instance; }
+               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._instance != b._instance; }
+               const T& operator*()const { return _index->_chunks[_instance / ChunkSize]->slot( _instance % ChunkSize ); }
+               const T* operator->()const { return &**this; }
+               const_iterator operator++(int)     // postfix
+               {
+                  const_iterator result( *this );
+                  ++(*this);
+                  return result;
+               }
+               const_iterator& operator++()       // prefix
+               {
+                  ++_instance;
+                  skip_free();
+                  return *this;
+               }
+               typedef std::forward_iterator_tag iterator_category;
+               typedef T                         value_type;
+               typedef std::ptrdiff_t            difference_type;
+               typedef const T*                  pointer;
+               typedef const T&                  reference;
+            private:
+               void skip_free()
+               {
+                  while( _instance < _index->_size && !_index->is_used( _instance ) )
+                  {
+                     if( !_index->_chunks[_instance / ChunkSize] )
+                        _instance = std::min<uint64_t>( ( _instance / ChunkSize + 1 ) * ChunkSize, _index->_size );
+                     else
+                        ++_instance;
+                  }
+               }
+
+               const slab_index* _index;
+               uint64_t          _instance;
+         };
+         const_iterator begin()const { return const_iterator( *this, 0 );     }
+         const_iterator end()const   { return const_iterator( *this, _size ); }
+
+         /** @return one past the highest instance in use, like simple_index::size() */
+         size_t size()const { return _size; }
+
+      private:
+         friend class const_iterator;
+
+         struct chunk
+         {
+            T&       slot( uint32_t i )       { return *reinterpret_cast<T*>( &slots[i] );       }
+            const T& slot( uint32_t i )const  { return *reinterpret_cast<const T*>( &slots[i] ); }
+
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type  slots[ChunkSize];
+            std::bitset<ChunkSize>                                       used;
+         };
+
+         bool is_used( uint64_t instance )const
+         {
+            const auto& c = _chunks[instance / ChunkSize];
+            return c && c->used[instance % ChunkSize];
+         }
+
+         T& slot_of( const object& obj )
+         {
+            const auto instance = obj.id.instance();
+            assert( instance < _size );
+            assert( _chunks[instance / ChunkSize]->used[instance % ChunkSize] );
+            return _chunks[instance / ChunkSize]->slot( instance % ChunkSize );
+         }
+
+         template<typename Value>
+         T& construct( uint64_t instance, Value&& value )
+         {
+            while( _chunks.size() <= instance / ChunkSize )
+               _chunks.emplace_back( new chunk );
+            if( !_chunks[instance / ChunkSize] )
+               _chunks[instance / ChunkSize].reset( new chunk );
+            chunk& c = *_chunks[instance / ChunkSize];
+            FC_ASSERT( !c.used[instance % ChunkSize], "Instance already exists", ("instance",instance) );
+            T* result = new (&c.slots[instance % ChunkSize]) T( std::forward<Value>(value) );
+            c.used[instance % ChunkSize] = true;
+            if( instance >= _size ) _size = instance + 1;
+            return *result;
+         }
+
+         vector< unique_ptr<chunk> > _chunks;
+         uint64_t                    _size = 0;
+   };
+
+} } // graphene::db
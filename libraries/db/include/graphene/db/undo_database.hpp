@@ -23,7 +23,11 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/memory_usage.hpp>
+#include <graphene/db/pool_allocator.hpp>
 #include <deque>
+#include <memory>
+#include <unordered_set>
 #include <fc/exception/exception.hpp>
 
 namespace graphene { namespace db {
@@ -32,12 +36,82 @@ namespace graphene { namespace db {
    using fc::flat_set;
    class object_database;
 
+   /**
+    *  The containers of undo_state take their nodes from the node_pool of the undo_database owning the
+    *  state, like the indexes using pool_allocator, so the maps which are filled and torn down once per
+    *  pending transaction and once per block stop hitting malloc/free once the pool is warm.  Each
+    *  database has a pool of its own, so databases used from different threads share nothing.
+    */
+   template<typename Key, typename Value>
+   using undo_map = unordered_map< Key, Value, std::hash<Key>, std::equal_to<Key>,
+                                   pool_allocator< std::pair<const Key, Value> > >;
+   template<typename Key>
+   using undo_set = std::unordered_set< Key, std::hash<Key>, std::equal_to<Key>, pool_allocator<Key> >;
+
+   /**
+    *  The pre-modification values of modified objects are stored packed in a single
+    *  arena per undo_state rather than as one heap allocated clone per object, the
+    *  whole arena is released at once when the state is merged or popped.
+    */
    struct undo_state
    {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
+      explicit undo_state( const std::shared_ptr<node_pool>& pool )
+      : old_values( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(),
+                    pool_allocator< std::pair<const object_id_type, packed_object> >( pool ) ),
+        old_index_next_ids( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(),
+                            pool_allocator< std::pair<const object_id_type, object_id_type> >( pool ) ),
+        new_ids( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(),
+                 pool_allocator<object_id_type>( pool ) ),
+        removed( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(),
+                 pool_allocator< std::pair<const object_id_type, unique_ptr<object> > >( pool ) )
+      {}
+
+      /** location of a packed object within packed_values */
+      struct packed_object
+      {
+         uint32_t offset = 0;
+         uint32_t size   = 0;
+      };
+
+      const char* data( const packed_object& p )const { return packed_values.data() + p.offset; }
+
+      /** packs obj at the end of the arena */
+      packed_object pack( const object& obj )
+      {
+         packed_object result;
+         result.offset = packed_values.size();
+         obj.pack_into( packed_values );
+         result.size = packed_values.size() - result.offset;
+         return result;
+      }
+
+      undo_map<object_id_type, packed_object>            old_values;
+      undo_map<object_id_type, object_id_type>           old_index_next_ids;
+      undo_set<object_id_type>                           new_ids;
+      undo_map<object_id_type, unique_ptr<object> >      removed;
+      vector<char>                                       packed_values;
+      /** the position of each undo_journal when this state was pushed */
+      vector<uint64_t>                                   journal_positions;
+      /** the number of committed sessions this state undoes, more than one once they have been squashed */
+      uint32_t                                           sessions = 1;
+   };
+
+   /**
+    *  State kept outside of the object database which is undone along with it.  The journal records its
+    *  changes in order, and undoing an undo state rolls it back to the position it had when the state was
+    *  pushed.  Changes made while there is no undo state to undo them must not be recorded.
+    */
+   class undo_journal
+   {
+      public:
+         virtual ~undo_journal() {}
+
+         /** @return the position after the last recorded change */
+         virtual uint64_t position()const = 0;
+         /** undoes the changes recorded at and after position */
+         virtual void     rollback( uint64_t position ) = 0;
+         /** the changes before position will not be rolled back any more */
+         virtual void     forget_before( uint64_t position ) = 0;
    };
 
 
@@ -95,11 +169,24 @@ namespace graphene { namespace db {
          void    enable();
          bool    enabled()const { return !_disabled; }
 
+         /**
+          *  Changes to the objects of the given space and type are never recorded, so undoing a session leaves
+          *  them as they are.  For state which only ever follows irreversible blocks, such as plugin statistics,
+          *  which would otherwise have to disable undo altogether while in the middle of a block's session.
+          */
+         void    exempt( uint8_t space_id, uint8_t type_id ) { _exempt.insert( std::make_pair( space_id, type_id ) ); }
+         bool    is_exempt( object_id_type id )const
+         { return !_exempt.empty() && _exempt.count( std::make_pair( id.space(), id.type() ) ) != 0; }
+
          session start_undo_session( bool force_enable = false );
          /**
           * This should be called just after an object is created
           */
          void on_create( const object& obj );
+         /**
+          * This should be called just before an id is used up without creating an object with it
+          */
+         void on_id_used( object_id_type id );
          /**
           * This should be called just before an object is modified
           *
@@ -126,22 +213,62 @@ namespace graphene { namespace db {
           */
          void pop_commit();
 
-         std::size_t size()const { return _stack.size(); }
+         /** the number of sessions which can be undone, counting each one squashed into another state */
+         std::size_t size()const { return _stack.size() + _squashed; }
          void set_max_size(size_t new_max_size) { _max_size = new_max_size; }
          size_t max_size()const { return _max_size; }
 
+         /**
+          *  Squash the committed states older than the newest depth ones into a single state, 0 never squashes.
+          *  An object modified in every one of them is then kept once rather than once per state, which caps the
+          *  memory they take when the oldest state is not discarded for a long time.  The sessions of the squashed
+          *  state can only be undone all at once, so depth must cover every block which may still be popped.
+          */
+         void set_squash_depth( size_t depth ) { _squash_depth = depth; }
+         size_t squash_depth()const { return _squash_depth; }
+         /** true if popping the last committed session would undo more than one */
+         bool head_is_squashed()const { return !_stack.empty() && _stack.back().sessions > 1; }
+         /** the number of states of the newest sessions, which can be undone one at a time */
+         std::size_t unsquashed_size()const
+         { return _stack.empty() || _stack.front().sessions == 1 ? _stack.size() : _stack.size() - 1; }
+
          const undo_state& head()const;
 
+         /** @return the approximate memory held by each state on the stack and the arenas kept for reuse */
+         undo_memory_usage get_memory_usage()const;
+
+         /** journal must outlive this undo_database, or be added before any state is pushed and never removed */
+         void add_journal( undo_journal* journal ) { _journals.push_back( journal ); }
+
       private:
          void undo();
          void merge();
          void commit();
 
+         /** pushes a new state, reusing the arena of a previously popped state if one is available */
+         void push_state();
+         /** keeps the arena of a state which is about to be popped for reuse by push_state() */
+         void recycle_state( undo_state& state );
+         /** rolls the journals back to where they were when state was pushed */
+         void rollback_journals( const undo_state& state );
+         /** composes state into prev_state, the state pushed right before it */
+         static void merge_states( undo_state& prev_state, undo_state& state );
+         /** squashes the states beyond _squash_depth into the oldest one */
+         void squash();
+
          uint32_t                _active_sessions = 0;
          bool                    _disabled = true;
+         /** the nodes of the containers of the states */
+         std::shared_ptr<node_pool> _pool = std::make_shared<node_pool>();
          std::deque<undo_state>  _stack;
+         vector< vector<char> >  _spare_arenas;
+         vector< undo_journal* > _journals;
          object_database&        _db;
          size_t                  _max_size = 256;
+         size_t                  _squash_depth = 0;
+         /** the sessions squashed into the oldest state, beyond the one it started as */
+         size_t                  _squashed = 0;
+         flat_set< std::pair<uint8_t,uint8_t> > _exempt;
    };
 
 } } // graphene::db
@@ -27,17 +27,123 @@
 
 namespace graphene { namespace db {
    void base_primary_index::save_undo( const object& obj )
-   { _db.save_undo( obj ); }
+   {
+      // the hash comes back in on_modify(), a modification which fails erases the object and doesn't
+      if( _maintain_digest ) _digest -= obj.hash();
+      _db.save_undo( obj );
+   }
 
    void base_primary_index::on_add( const object& obj )
    {
+      if( _maintain_digest ) _digest += obj.hash();
+      _dirty.insert( obj.id );
       _db.save_undo_add( obj );
       for( auto ob : _observers ) ob->on_add( obj );
    }
 
    void base_primary_index::on_remove( const object& obj )
-   { _db.save_undo_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj ); }
+   {
+      if( _maintain_digest ) _digest -= obj.hash();
+      _dirty.insert( obj.id ); _db.save_undo_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj );
+   }
 
    void base_primary_index::on_modify( const object& obj )
-   {for( auto ob : _observers ) ob->on_modify(  obj ); }
+   {
+      if( _maintain_digest ) _digest += obj.hash();
+      _dirty.insert( obj.id ); for( auto ob : _observers ) ob->on_modify(  obj );
+   }
+
+   void base_primary_index::on_insert( const object& obj )
+   {
+      if( _maintain_digest ) _digest += obj.hash();
+      _dirty.insert( obj.id ); _db.note_inserted( obj );
+   }
+
+   void base_primary_index::save_undo_next_id( object_id_type next_id )
+   { _db.save_undo_next_id( next_id ); }
+
+   uint64_t base_primary_index::next_object_version()
+   { return _db.next_object_version(); }
+
+   void base_primary_index::sindex_about_to_modify( const object& obj )
+   {
+      for( const auto& item : _sindex )
+         if( !item->defer_modifications() )
+            item->about_to_modify( obj );
+
+      if( _has_deferred_sindex )
+      {
+         // bound the memory held by the clones when nobody reads the deferred indexes
+         if( _deferred.size() >= max_deferred_modifications && _deferred.find( obj.id ) == _deferred.end() )
+            flush_deferred_modifications();
+         auto& pending = _deferred[obj.id];
+         if( !pending.before )
+         {
+            pending.before = obj.clone();
+            pending.after  = &obj;
+         }
+      }
+   }
+
+   void base_primary_index::sindex_modified( const object& obj )
+   {
+      for( const auto& item : _sindex )
+         if( !item->defer_modifications() )
+            item->object_modified( obj );
+   }
+
+   void base_primary_index::sindex_removed( const object& obj )
+   {
+      auto itr = _deferred.find( obj.id );
+      for( const auto& item : _sindex )
+      {
+         // deferred indexes have not seen the pending modification yet, so remove the value they know
+         if( itr != _deferred.end() && item->defer_modifications() )
+            item->object_removed( *itr->second.before );
+         else
+            item->object_removed( obj );
+      }
+      if( itr != _deferred.end() )
+         _deferred.erase( itr );
+   }
+
+   void base_primary_index::flush_deferred_modifications()const
+   {
+      std::lock_guard<std::mutex> guard( _deferred_mutex );
+      if( _deferred.empty() ) return;
+      for( const auto& pending : _deferred )
+      {
+         for( const auto& item : _sindex )
+         {
+            if( !item->defer_modifications() ||
+                !item->is_relevant_change( *pending.second.before, *pending.second.after ) )
+               continue;
+            item->about_to_modify( *pending.second.before );
+            item->object_modified( *pending.second.after );
+         }
+      }
+      _deferred.clear();
+   }
+
+   void base_primary_index::add_tracking_memory_usage( index_memory_usage& usage )const
+   {
+      // unordered containers allocate a node per element and an array of bucket pointers
+      usage.tracking_bytes += _dirty.size() * ( sizeof(object_id_type) + sizeof(void*) + heap_allocation_overhead )
+                            + _dirty.bucket_count() * sizeof(void*);
+      vector< std::shared_ptr<object> > clones;
+      {
+         std::lock_guard<std::mutex> guard( _deferred_mutex );
+         usage.tracking_bytes += _deferred.size() * ( sizeof(object_id_type) + sizeof(deferred_modification)
+                                                      + sizeof(void*) + 2 * heap_allocation_overhead )
+                               + _deferred.bucket_count() * sizeof(void*);
+         clones.reserve( _deferred.size() );
+         for( const auto& pending : _deferred )
+            clones.push_back( pending.second.before );
+      }
+      // the clones are of the object type, which only the derived index knows, their packed size will do; packing
+      // them is left until the lock is released, so that the chain isn't held up by it
+      for( const auto& clone : clones )
+         usage.tracking_bytes += clone->pack().size();
+      usage.secondary_index_count = _sindex.size();
+   }
 } } // graphene::chain
@@ -25,21 +25,57 @@
 
 #include <fc/io/raw.hpp>
 #include <fc/container/flat.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/time.hpp>
 #include <fc/uint128.hpp>
 
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
 namespace graphene { namespace db {
 
 object_database::object_database()
-:_undo_db(*this)
+:_undo_db(*this),
+ _object_version( fc::time_point::now().time_since_epoch().count() )
 {
    _index.resize(255);
    _undo_db.enable();
 }
 
-object_database::~object_database(){}
+object_database::~object_database()
+{
+   close();
+}
 
 void object_database::close()
 {
+   try
+   {
+      wait_for_deferred_indexes();
+   }
+   catch( const fc::exception& )
+   {
+   }
+}
+
+void object_database::wait_for_deferred_indexes()const
+{
+   if( _deferred_open_state == deferred_open_done )
+      return;
+   std::unique_lock<std::mutex> lock( _deferred_open_mutex );
+   _deferred_open_done.wait( lock, [this]() { return _deferred_open_state != deferred_open_loading; } );
+   if( _deferred_open_error )
+      _deferred_open_error->dynamic_rethrow_exception();
+}
+
+void object_database::wait_if_deferred( const index& idx )const
+{
+   // the loader itself goes on, the indexes it loads may look up others while it does
+   if( _deferred_open_state == deferred_open_done || _deferred_indexes.count( &idx ) == 0
+       || ( _deferred_loader && &fc::thread::current() == _deferred_loader.get() ) )
+      return;
+   wait_for_deferred_indexes();
 }
 
 const object* object_database::find_object( object_id_type id )const
@@ -57,6 +93,7 @@ const index& object_database::get_index(uint8_t space_id, uint8_t type_id)const
    FC_ASSERT( _index[space_id].size() > type_id, "", ("space_id",space_id)("type_id",type_id)("index[space_id].size",_index[space_id].size()) );
    const auto& tmp = _index[space_id][type_id];
    FC_ASSERT( tmp );
+   wait_if_deferred( *tmp );
    return *tmp;
 }
 index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
@@ -65,22 +102,199 @@ index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
    FC_ASSERT( _index[space_id].size() > type_id , "", ("space_id",space_id)("type_id",type_id)("index[space_id].size",_index[space_id].size()) );
    const auto& idx = _index[space_id][type_id];
    FC_ASSERT( idx, "", ("space",space_id)("type",type_id) );
+   wait_if_deferred( *idx );
    return *idx;
 }
 
+object_database_memory_usage object_database::get_memory_usage()const
+{
+   wait_for_deferred_indexes();
+   object_database_memory_usage usage;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+         {
+            usage.indexes.push_back( idx->get_memory_usage() );
+            usage.total_bytes += usage.indexes.back().total_bytes;
+         }
+   usage.undo = _undo_db.get_memory_usage();
+   usage.total_bytes += usage.undo.total_bytes;
+   return usage;
+}
+
+void object_database::set_maintain_digests( bool maintain )
+{
+   wait_for_deferred_indexes();
+   _maintain_digests = maintain;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+            idx->set_maintain_digest( maintain );
+}
+
+object_database_digest object_database::get_digest()const
+{
+   wait_for_deferred_indexes();
+   object_database_digest result;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+         {
+            index_digest item;
+            item.space_id = idx->object_space_id();
+            item.type_id  = idx->object_type_id();
+            item.digest   = idx->get_digest();
+            result.digest += item.digest;
+            result.indexes.push_back( item );
+         }
+   return result;
+}
+
+void object_database::for_each_index_file( const char* what, const fc::path& dir,
+                                           const std::function<void(index&, const fc::path&)>& io,
+                                           const std::function<bool(const index&)>& filter )
+{
+   vector< std::pair<index*, fc::path> > files;
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] && ( !filter || filter( *_index[space][type] ) ) )
+            files.emplace_back( _index[space][type].get(),
+                                dir / fc::to_string(space)/fc::to_string(type) );
+
+   std::atomic<size_t> next_file( 0 );
+   auto worker = [&]() {
+      for( size_t i = next_file++; i < files.size(); i = next_file++ )
+      {
+         auto start = fc::time_point::now();
+         io( *files[i].first, files[i].second );
+         auto elapsed = fc::time_point::now() - start;
+         ilog( "${what} index ${s}.${t} in ${ms} ms",
+               ("what",what)("s",files[i].first->object_space_id())("t",files[i].first->object_type_id())
+               ("ms",elapsed.count()/1000) );
+      }
+   };
+
+   if( _io_threads <= 1 )
+   {
+      worker();
+      return;
+   }
+
+   vector< unique_ptr<fc::thread> > threads;
+   vector< fc::future<void> >       done;
+   for( uint32_t i = 0; i < _io_threads; ++i )
+   {
+      threads.emplace_back( new fc::thread( "object_database io " + fc::to_string(i) ) );
+      done.push_back( threads.back()->async( worker ) );
+   }
+   // the workers use the locals above, every one of them has to finish before an error is passed on
+   fc::exception_ptr error;
+   for( auto& f : done )
+   {
+      try
+      {
+         f.wait();
+      }
+      catch( const fc::exception& e )
+      {
+         if( !error )
+            error = e.dynamic_copy_exception();
+      }
+   }
+   if( error )
+      error->dynamic_rethrow_exception();
+}
+
 void object_database::flush()
 {
+   wait_for_deferred_indexes();
 //   ilog("Save object_database in ${d}", ("d", _data_dir));
    for( uint32_t space = 0; space < _index.size(); ++space )
-   {
       fc::create_directories( _data_dir / "object_database" / fc::to_string(space) );
-      const auto types = _index[space].size();
-      for( uint32_t type = 0; type  <  types; ++type )
+   for_each_index_file( "Saved", _data_dir / "object_database",
+                        []( index& idx, const fc::path& file ) { idx.save( file ); } );
+}
+
+std::function<void()> object_database::prepare_flush()
+{ try {
+   wait_for_deferred_indexes();
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      fc::create_directories( _data_dir / "object_database" / fc::to_string(space) );
+   auto writes = std::make_shared< vector< std::function<void()> > >();
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            _index[space][type]->save( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
-   }
+            writes->push_back( _index[space][type]->prepare_save(
+                                  _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) ) );
+   return [writes]() {
+      for( const auto& write : *writes )
+         write();
+   };
+} FC_CAPTURE_AND_RETHROW() }
+
+void object_database::commit_flushed()
+{ try {
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+            _index[space][type]->commit_saved( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+} FC_CAPTURE_AND_RETHROW() }
+
+void object_database::discard_flushed()
+{
+   for( auto& space : _index )
+      for( auto& idx : space )
+         if( idx )
+            idx->discard_saved();
+}
+
+void object_database::export_snapshot( const fc::path& dir )
+{ try {
+   wait_for_deferred_indexes();
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      fc::create_directories( dir / fc::to_string(space) );
+   for_each_index_file( "Exported", dir,
+                        []( index& idx, const fc::path& file ) { idx.export_snapshot( file ); } );
+} FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+packed_snapshot object_database::pack_snapshot()const
+{ try {
+   wait_for_deferred_indexes();
+   packed_snapshot result;
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+         {
+            std::ostringstream out( std::ios::out | std::ios::binary );
+            _index[space][type]->export_snapshot( out );
+            FC_ASSERT( out, "Error packing index ${s}.${t}", ("s",space)("t",type) );
+            result.files.emplace_back( fc::path( fc::to_string(space) ) / fc::to_string(type), out.str() );
+         }
+   return result;
+} FC_CAPTURE_AND_RETHROW() }
+
+uint64_t packed_snapshot::size()const
+{
+   uint64_t result = 0;
+   for( const auto& f : files )
+      result += f.second.size();
+   return result;
 }
 
+void packed_snapshot::write( const fc::path& dir )const
+{ try {
+   for( const auto& f : files )
+   {
+      const fc::path file = dir / f.first;
+      fc::create_directories( file.parent_path() );
+      std::ofstream out( file.generic_string(),
+                         std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      out.write( f.second.data(), f.second.size() );
+      out.flush();
+      FC_ASSERT( out, "Error writing snapshot", ("file",file) );
+   }
+} FC_CAPTURE_AND_RETHROW( (dir) ) }
+
 void object_database::wipe(const fc::path& data_dir)
 {
    close();
@@ -93,11 +307,43 @@ void object_database::open(const fc::path& data_dir)
 { try {
    ilog("Opening object database from ${d} ...", ("d", data_dir));
    _data_dir = data_dir;
-   for( uint32_t space = 0; space < _index.size(); ++space )
-      for( uint32_t type = 0; type  < _index[space].size(); ++type )
-         if( _index[space][type] )
-            _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
-   ilog( "Done opening object database." );
+   wait_for_deferred_indexes();
+   auto start = fc::time_point::now();
+   auto open_index = []( index& idx, const fc::path& file ) { idx.open( file ); };
+   auto is_deferred = [this]( const index& idx ) { return _deferred_indexes.count( &idx ) != 0; };
+   for_each_index_file( "Opened", _data_dir / "object_database", open_index,
+                        [&is_deferred]( const index& idx ) { return !is_deferred( idx ); } );
+   ilog( "Done opening object database in ${ms} ms using ${n} thread(s).",
+         ("ms",(fc::time_point::now() - start).count()/1000)("n",_io_threads) );
+
+   if( !_deferred_indexes.empty() )
+   {
+      _deferred_open_error.reset();
+      _deferred_open_state = deferred_open_loading;
+      if( !_deferred_loader )
+         _deferred_loader.reset( new fc::thread( "deferred index loader" ) );
+      _deferred_loader->async( [this, open_index, is_deferred]() {
+         auto start = fc::time_point::now();
+         fc::exception_ptr error;
+         try
+         {
+            for_each_index_file( "Opened deferred", _data_dir / "object_database", open_index, is_deferred );
+            ilog( "Done opening ${n} deferred indexes in ${ms} ms",
+                  ("n",_deferred_indexes.size())("ms",(fc::time_point::now() - start).count()/1000) );
+         }
+         catch( const fc::exception& e )
+         {
+            elog( "Failed to open the deferred indexes: ${e}", ("e",e.to_detail_string()) );
+            error = e.dynamic_copy_exception();
+         }
+         {
+            std::lock_guard<std::mutex> lock( _deferred_open_mutex );
+            _deferred_open_error = error;
+            _deferred_open_state = error ? deferred_open_failed : deferred_open_done;
+         }
+         _deferred_open_done.notify_all();
+      } );
+   }
 
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
@@ -109,17 +355,54 @@ void object_database::pop_undo()
 
 void object_database::save_undo( const object& obj )
 {
+   ++_change_counts.modified;
+   if( _changes_created.find( obj.id ) == _changes_created.end() )
+      _changes_modified.insert( obj.id );
    _undo_db.on_modify( obj );
 }
 
 void object_database::save_undo_add( const object& obj )
 {
+   ++_change_counts.created;
+   _changes_created.insert( obj.id );
    _undo_db.on_create( obj );
 }
 
 void object_database::save_undo_remove(const object& obj)
 {
+   ++_change_counts.removed;
+   if( _changes_created.erase( obj.id ) == 0 )
+   {
+      _changes_modified.erase( obj.id );
+      _changes_removed[ obj.id ] = obj.clone();
+   }
    _undo_db.on_remove( obj );
 }
 
+void object_database::note_inserted( const object& obj )
+{
+   // back after being removed is a change to the object, otherwise it is new
+   if( _changes_removed.erase( obj.id ) != 0 )
+      _changes_modified.insert( obj.id );
+   else
+      _changes_created.insert( obj.id );
+}
+
+object_database::object_changes object_database::take_object_changes()
+{
+   object_changes result;
+   result.created.assign( _changes_created.begin(), _changes_created.end() );
+   result.modified.assign( _changes_modified.begin(), _changes_modified.end() );
+   result.removed = std::move( _changes_removed );
+   _changes_created.clear();
+   _changes_modified.clear();
+   _changes_removed.clear();
+   return result;
+}
+
+void object_database::save_undo_next_id( object_id_type next_id )
+{
+   _undo_db.on_id_used( next_id );
+}
+
 } } // namespace graphene::db
@@ -30,6 +30,34 @@ namespace graphene { namespace db {
 void undo_database::enable()  { _disabled = false; }
 void undo_database::disable() { _disabled = true; }
 
+void undo_database::push_state()
+{
+   _stack.emplace_back( _pool );
+   if( !_spare_arenas.empty() )
+   {
+      _stack.back().packed_values.swap( _spare_arenas.back() );
+      _spare_arenas.pop_back();
+   }
+   for( const undo_journal* journal : _journals )
+      _stack.back().journal_positions.push_back( journal->position() );
+}
+
+void undo_database::rollback_journals( const undo_state& state )
+{
+   for( size_t i = 0; i < _journals.size() && i < state.journal_positions.size(); ++i )
+      _journals[i]->rollback( state.journal_positions[i] );
+}
+
+void undo_database::recycle_state( undo_state& state )
+{
+   // a handful of arenas is enough to cover the nested block / pending / transaction sessions
+   if( state.packed_values.capacity() == 0 || _spare_arenas.size() >= 8 )
+      return;
+   state.packed_values.clear();
+   _spare_arenas.emplace_back();
+   _spare_arenas.back().swap( state.packed_values );
+}
+
 undo_database::session undo_database::start_undo_session( bool force_enable )
 {
    if( _disabled && !force_enable ) return session(*this);
@@ -37,19 +65,45 @@ undo_database::session undo_database::start_undo_session( bool force_enable )
    if( force_enable ) 
       _disabled = false;
 
-   while( size() > max_size() )
+   // a squashed state is only discarded once every session it undoes is too old
+   while( !_stack.empty() && size() - _stack.front().sessions >= max_size() )
+   {
+      _squashed -= _stack.front().sessions - 1;
+      recycle_state( _stack.front() );
       _stack.pop_front();
+      for( size_t i = 0; i < _journals.size(); ++i )
+         _journals[i]->forget_before( _stack.empty() || i >= _stack.front().journal_positions.size()
+                                      ? _journals[i]->position() : _stack.front().journal_positions[i] );
+   }
 
-   _stack.emplace_back();
+   squash();
+   push_state();
    ++_active_sessions;
    return session(*this, disable_on_exit );
 }
+
+void undo_database::squash()
+{
+   if( _squash_depth == 0 )
+      return;
+   // the states of the sessions in progress are the newest ones, and stay as they are
+   while( _stack.size() > 1 + _squash_depth + _active_sessions )
+   {
+      undo_state& base = _stack[0];
+      undo_state& next = _stack[1];
+      merge_states( base, next );
+      base.sessions += next.sessions;
+      _squashed += next.sessions;
+      // without keeping the arena for reuse, its memory goes back right away
+      _stack.erase( _stack.begin() + 1 );
+   }
+}
 void undo_database::on_create( const object& obj )
 {
-   if( _disabled ) return;
+   if( _disabled || is_exempt( obj.id ) ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_state();
    auto& state = _stack.back();
    auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
    auto itr = state.old_index_next_ids.find( index_id );
@@ -57,39 +111,52 @@ void undo_database::on_create( const object& obj )
       state.old_index_next_ids[index_id] = obj.id;
    state.new_ids.insert(obj.id);
 }
+void undo_database::on_id_used( object_id_type id )
+{
+   if( _disabled || is_exempt( id ) ) return;
+
+   if( _stack.empty() )
+      push_state();
+   auto& state = _stack.back();
+   auto index_id = object_id_type( id.space(), id.type(), 0 );
+   auto itr = state.old_index_next_ids.find( index_id );
+   if( itr == state.old_index_next_ids.end() )
+      state.old_index_next_ids[index_id] = id;
+}
 void undo_database::on_modify( const object& obj )
 {
-   if( _disabled ) return;
+   if( _disabled || is_exempt( obj.id ) ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_state();
    auto& state = _stack.back();
    if( state.new_ids.find(obj.id) != state.new_ids.end() )
       return;
    auto itr =  state.old_values.find(obj.id);
    if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   state.old_values[obj.id] = state.pack( obj );
 }
 void undo_database::on_remove( const object& obj )
 {
-   if( _disabled ) return;
+   if( _disabled || is_exempt( obj.id ) ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_state();
    undo_state& state = _stack.back();
    if( state.new_ids.count(obj.id) )
    {
       state.new_ids.erase(obj.id);
       return;
    }
-   if( state.old_values.count(obj.id) )
+   if( state.removed.count(obj.id) ) return;
+   auto old = obj.clone();
+   auto itr = state.old_values.find(obj.id);
+   if( itr != state.old_values.end() )
    {
-      state.removed[obj.id] = std::move(state.old_values[obj.id]);
-      state.old_values.erase(obj.id);
-      return;
+      old->unpack_from( state.data( itr->second ), itr->second.size );
+      state.old_values.erase( itr );
    }
-   if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+   state.removed[obj.id] = std::move(old);
 }
 
 void undo_database::undo()
@@ -101,7 +168,7 @@ void undo_database::undo()
    auto& state = _stack.back();
    for( auto& item : state.old_values )
    {
-      _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
+      _db.modify( _db.get_object( item.first ), [&]( object& obj ){ obj.unpack_from( state.data( item.second ), item.second.size ); } );
    }
 
    for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
@@ -117,9 +184,11 @@ void undo_database::undo()
    for( auto& item : state.removed )
       _db.insert( std::move(*item.second) );
 
+   rollback_journals( state );
+   recycle_state( state );
    _stack.pop_back();
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_state();
    enable();
    --_active_sessions;
 } FC_CAPTURE_AND_RETHROW() }
@@ -128,8 +197,14 @@ void undo_database::merge()
 {
    FC_ASSERT( _active_sessions > 0 );
    FC_ASSERT( _stack.size() >=2 );
-   auto& state = _stack.back();
-   auto& prev_state = _stack[_stack.size()-2];
+   merge_states( _stack[_stack.size()-2], _stack.back() );
+   recycle_state( _stack.back() );
+   _stack.pop_back();
+   --_active_sessions;
+}
+
+void undo_database::merge_states( undo_state& prev_state, undo_state& state )
+{
 
    // An object's relationship to a state can be:
    // in new_ids            : new
@@ -176,20 +251,25 @@ void undo_database::merge()
    // *+upd
    for( auto& obj : state.old_values )
    {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
+      if( prev_state.new_ids.find(obj.first) != prev_state.new_ids.end() )
       {
          // new+upd -> new, type A
          continue;
       }
-      if( prev_state.old_values.find(obj.second->id) != prev_state.old_values.end() )
+      if( prev_state.old_values.find(obj.first) != prev_state.old_values.end() )
       {
          // upd(was=X) + upd(was=Y) -> upd(was=X), type A
          continue;
       }
       // del+upd -> N/A
-      assert( prev_state.removed.find(obj.second->id) == prev_state.removed.end() );
+      assert( prev_state.removed.find(obj.first) == prev_state.removed.end() );
       // nop+upd(was=Y) -> upd(was=Y), type B
-      prev_state.old_values[obj.second->id] = std::move(obj.second);
+      undo_state::packed_object moved;
+      moved.offset = prev_state.packed_values.size();
+      moved.size = obj.second.size;
+      prev_state.packed_values.insert( prev_state.packed_values.end(),
+                                       state.data( obj.second ), state.data( obj.second ) + obj.second.size );
+      prev_state.old_values[obj.first] = moved;
    }
 
    // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
@@ -226,8 +306,9 @@ void undo_database::merge()
       if( it != prev_state.old_values.end() )
       {
          // upd(was=X) + del(was=Y) -> del(was=X)
-         prev_state.removed[obj.second->id] = std::move(it->second);
-         prev_state.old_values.erase(obj.second->id);
+         obj.second->unpack_from( prev_state.data( it->second ), it->second.size );
+         prev_state.removed[obj.second->id] = std::move(obj.second);
+         prev_state.old_values.erase(it);
          continue;
       }
       // del + del -> N/A
@@ -235,8 +316,6 @@ void undo_database::merge()
       // nop + del(was=Y) -> del(was=Y)
       prev_state.removed[obj.second->id] = std::move(obj.second);
    }
-   _stack.pop_back();
-   --_active_sessions;
 }
 void undo_database::commit()
 {
@@ -248,6 +327,7 @@ void undo_database::pop_commit()
 {
    FC_ASSERT( _active_sessions == 0 );
    FC_ASSERT( !_stack.empty() );
+   FC_ASSERT( _stack.back().sessions == 1, "The last committed session has been squashed with older ones" );
 
    disable();
    try {
@@ -255,7 +335,7 @@ void undo_database::pop_commit()
 
       for( auto& item : state.old_values )
       {
-         _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
+         _db.modify( _db.get_object( item.first ), [&]( object& obj ){ obj.unpack_from( state.data( item.second ), item.second.size ); } );
       }
 
       for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
@@ -271,6 +351,8 @@ void undo_database::pop_commit()
       for( auto& item : state.removed )
          _db.insert( std::move(*item.second) );
 
+      rollback_journals( state );
+      recycle_state( state );
       _stack.pop_back();
    }
    catch ( const fc::exception& e )
@@ -287,4 +369,44 @@ const undo_state& undo_database::head()const
    return _stack.back();
 }
 
+/**
+ *  an unordered container allocates a node per element, from the node_pool of the database for undo_state,
+ *  and a bucket array
+ */
+template<typename Container>
+static uint64_t container_bytes( const Container& c )
+{
+   return c.size() * ( sizeof(typename Container::value_type) + sizeof(void*) ) + c.bucket_count() * sizeof(void*);
+}
+
+undo_memory_usage undo_database::get_memory_usage()const
+{
+   undo_memory_usage usage;
+   usage.max_size = _max_size;
+   usage.states.reserve( _stack.size() );
+   for( const auto& state : _stack )
+   {
+      undo_state_memory_usage s;
+      s.sessions       = state.sessions;
+      s.modified_count = state.old_values.size();
+      s.created_count  = state.new_ids.size();
+      s.removed_count  = state.removed.size();
+      s.next_id_count  = state.old_index_next_ids.size();
+      s.packed_bytes   = state.packed_values.capacity();
+      for( const auto& item : state.removed )
+         s.removed_bytes += item.second->pack().size() + heap_allocation_overhead;
+      s.container_bytes = container_bytes( state.old_values ) + container_bytes( state.old_index_next_ids )
+                        + container_bytes( state.new_ids ) + container_bytes( state.removed )
+                        + state.journal_positions.capacity() * sizeof(uint64_t);
+      s.total_bytes = s.packed_bytes + s.removed_bytes + s.container_bytes;
+      usage.total_bytes += s.total_bytes;
+      usage.states.push_back( s );
+   }
+   for( const auto& arena : _spare_arenas )
+      usage.spare_arena_bytes += arena.capacity();
+   usage.free_node_bytes = _pool->free_bytes();
+   usage.total_bytes += usage.spare_arena_bytes + usage.free_node_bytes;
+   return usage;
+}
+
 } } // graphene::db
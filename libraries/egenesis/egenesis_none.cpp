@@ -43,4 +43,14 @@ fc::sha256 get_egenesis_json_hash()
    return fc::sha256::hash( "" );
 }
 
+bool compute_egenesis_state( genesis_state_type& result )
+{
+   return false;
+}
+
+fc::sha256 get_egenesis_packed_hash()
+{
+   return fc::sha256::hash( "" );
+}
+
 } }
@@ -34,6 +34,7 @@
 #include <fc/string.hpp>
 #include <fc/io/fstream.hpp>
 #include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
 #include <graphene/chain/genesis_state.hpp>
 #include <graphene/chain/protocol/types.hpp>
 
@@ -144,6 +145,29 @@ void convert_to_c_array(
    return;
 }
 
+/**
+ * Writes binary data as the initializer of an unsigned char array.  Unlike string literals the bytes need no
+ * escaping, so any following byte can't be read as part of an escape sequence.
+ */
+void convert_to_byte_array(
+   const std::vector<char>& src,
+   std::string& dest,
+   int width = 16 )
+{
+   static const char hex_digits[] = "0123456789abcdef";
+   dest.reserve( src.size() * 6 );
+   for( std::vector<char>::size_type i=0; i<src.size(); i++ )
+   {
+      if( i > 0 )
+         dest.append( i % width == 0 ? ",\n" : "," );
+      unsigned char c = static_cast<unsigned char>( src[i] );
+      dest.append( "0x" );
+      dest.append( 1, hex_digits[c >> 4] );
+      dest.append( 1, hex_digits[c & 15] );
+   }
+   return;
+}
+
 struct egenesis_info
 {
    fc::optional< genesis_state_type > genesis;
@@ -153,6 +177,9 @@ struct egenesis_info
    fc::optional< std::string > genesis_json_array;
    int genesis_json_array_width,
        genesis_json_array_height;
+   fc::optional< std::string > genesis_packed_array;
+   size_t genesis_packed_size = 0;
+   fc::optional< fc::sha256 > genesis_packed_hash;
 
    void fillin()
    {
@@ -191,6 +218,15 @@ struct egenesis_info
          genesis_json_array_width = width;
          genesis_json_array_height = height;
       }
+      // init genesis_packed_array from genesis
+      if( !genesis_packed_array.valid() )
+      {
+         std::vector<char> packed = fc::raw::pack( *genesis );
+         genesis_packed_array = std::string();
+         convert_to_byte_array( packed, *genesis_packed_array );
+         genesis_packed_size = packed.size();
+         genesis_packed_hash = fc::sha256::hash( packed.data(), packed.size() );
+      }
    }
 };
 
@@ -263,6 +299,12 @@ int main( int argc, char** argv )
       template_context["genesis_json_array_width"] = info.genesis_json_array_width;
       template_context["genesis_json_array_height"] = info.genesis_json_array_height;
    }
+   if( info.genesis_packed_array.valid() )
+   {
+      template_context["genesis_packed_array"] = (*info.genesis_packed_array);
+      template_context["genesis_packed_size"] = info.genesis_packed_size;
+      template_context["genesis_packed_hash"] = (*info.genesis_packed_hash).str();
+   }
 
    for( const std::string& src_dest : options["tmplsub"].as< std::vector< std::string > >() )
    {
@@ -48,4 +48,17 @@ void compute_egenesis_json( std::string& result );
  */
 fc::sha256 get_egenesis_json_hash();
 
+/**
+ * Get the egenesis state unpacked from its binary form, which for a large genesis is much faster than parsing the
+ * JSON.  The state is the one compute_egenesis_json() returns the JSON of.
+ *
+ * @return false if no packed egenesis was compiled in
+ */
+bool compute_egenesis_state( graphene::chain::genesis_state_type& result );
+
+/**
+ * The packed state compute_egenesis_state() unpacks should have this hash.
+ */
+fc::sha256 get_egenesis_packed_hash();
+
 } } // graphene::egenesis
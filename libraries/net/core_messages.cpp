@@ -45,6 +45,23 @@ namespace graphene { namespace net {
   const core_message_type_enum check_firewall_reply_message::type            = core_message_type_enum::check_firewall_reply_message_type;
   const core_message_type_enum get_current_connections_request_message::type = core_message_type_enum::get_current_connections_request_message_type;
   const core_message_type_enum get_current_connections_reply_message::type   = core_message_type_enum::get_current_connections_reply_message_type;
+  const core_message_type_enum compact_block_message::type                   = core_message_type_enum::compact_block_message_type;
+  const core_message_type_enum fetch_block_transactions_message::type        = core_message_type_enum::fetch_block_transactions_message_type;
+  const core_message_type_enum block_transactions_message::type              = core_message_type_enum::block_transactions_message_type;
+  const core_message_type_enum trx_batch_message::type                       = core_message_type_enum::trx_batch_message_type;
+
+  compact_block_message::compact_block_message(const signed_block& block, const block_id_type& block_id) :
+    header(block),
+    block_id(block_id)
+  {
+    transaction_ids.reserve(block.transactions.size());
+    operation_results.reserve(block.transactions.size());
+    for (const processed_transaction& trx : block.transactions)
+    {
+      transaction_ids.push_back(trx.id());
+      operation_results.push_back(trx.operation_results);
+    }
+  }
 
 } } // graphene::net
 
@@ -37,6 +37,13 @@
  * 2MiB
  */
 #define MAX_MESSAGE_SIZE                                     1024*1024*2
+
+/**
+ * Connections keep the buffer they pad messages in for sending between messages, unless it grew
+ * beyond this size for a big one
+ */
+#define GRAPHENE_NET_SEND_BUFFER_RETAINED_SIZE               (64 * 1024)
+
 #define GRAPHENE_NET_DEFAULT_PEER_CONNECTION_RETRY_TIME      30 // seconds
 
 /**
@@ -57,6 +64,14 @@
 
 #define GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES        (1024 * 1024)
 
+/**
+ * Higher priority messages are sent ahead of lower priority ones that were
+ * queued before them, but once the oldest message of a lower priority has
+ * waited this long it goes out next, so a steady stream of blocks can't keep
+ * a peer from ever getting its transactions or addresses.
+ */
+#define GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGE_DELAY_MS         1000
+
 /**
  * When we receive a message from the network, we advertise it to
  * our peers and save a copy in a cache were we will find it if
@@ -68,6 +83,12 @@
  */
 #define GRAPHENE_NET_MESSAGE_CACHE_DURATION_IN_BLOCKS        5
 
+/**
+ * The message cache evicts the least recently used items once it holds this many bytes,
+ * before they have been there for GRAPHENE_NET_MESSAGE_CACHE_DURATION_IN_BLOCKS
+ */
+#define GRAPHENE_NET_MESSAGE_CACHE_MAX_BYTES                 (256 * 1024 * 1024)
+
 /**
  * We prevent a peer from offering us a list of blocks which, if we fetched them
  * all, would result in a blockchain that extended into the future.
@@ -81,6 +102,50 @@
 
 #define GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING      200
 
+/**
+ * How many blocks a peer that pushes items may have sent us as compact blocks we're still completing,
+ * on top of the blocks we've requested from it
+ */
+#define GRAPHENE_NET_MAX_PUSHED_COMPACT_BLOCKS_PER_PEER      2
+
+/**
+ * A node which accepts pushed items takes this many blocks and transactions per second that it didn't
+ * request from each peer, and up to BURST_SECONDS worth of them at once; a peer pushing more is
+ * disconnected
+ */
+#define GRAPHENE_NET_PUSHED_ITEMS_PER_SECOND                 100
+#define GRAPHENE_NET_PUSHED_ITEMS_BURST_SECONDS              10
+
+/**
+ * Transactions sent to a peer together are split into trx_batch_messages of about this many bytes
+ */
+#define GRAPHENE_NET_MAX_TRX_BATCH_SIZE                      (256 * 1024)
+
+/**
+ * Peers are scored by the rate we expect them to deliver the items we request at, see
+ * peer_connection::get_request_score().  Each new measurement of a peer counts for 1/SMOOTHING
+ * of its statistics, the score assumes items of ITEM_SIZE bytes, and peers whose latency
+ * hasn't been measured yet are assumed to have UNMEASURED_PEER_LATENCY_MS
+ */
+#define GRAPHENE_NET_REQUEST_STATISTICS_SMOOTHING            8
+#define GRAPHENE_NET_REQUEST_SCORE_ITEM_SIZE                 (16 * 1024)
+#define GRAPHENE_NET_UNMEASURED_PEER_LATENCY_MS              250
+
+/**
+ * Each peer has a budget of delegate time for validating the transactions it sends us, which refills at
+ * BUDGET_PER_SECOND_US microseconds per second up to BURST_US.  A transaction costs the time the delegate
+ * spent on it, not counting the wait for the delegate thread, and one the delegate rejects costs
+ * REJECTED_TRX_PENALTY times that, unless it was rejected because we already have it.  While a peer's
+ * budget is spent we drop its transactions
+ * and don't fetch any from it.  A peer is disconnected once more than MIN_REJECTED_TRX_TO_DISCONNECT of
+ * the transactions it sent in the last REJECTED_TRX_WINDOW_SEC were rejected and they are most of them
+ */
+#define GRAPHENE_NET_TRX_VALIDATION_BUDGET_PER_SECOND_US     100000
+#define GRAPHENE_NET_TRX_VALIDATION_BURST_US                 1000000
+#define GRAPHENE_NET_REJECTED_TRX_PENALTY                    10
+#define GRAPHENE_NET_MIN_REJECTED_TRX_TO_DISCONNECT          100
+#define GRAPHENE_NET_REJECTED_TRX_WINDOW_SEC                 60
+
 /**
  * During normal operation, how many items will be fetched from each
  * peer at a time.  This will only come into play when the network
@@ -103,3 +168,10 @@
 #define GRAPHENE_NET_MIN_BLOCK_IDS_TO_PREFETCH               10000
 
 #define GRAPHENE_NET_MAX_TRX_PER_SECOND                      1000
+
+/**
+ * Addresses from address messages wait in a queue of up to MAX_PENDING_PEER_ADDRESSES, and are merged into
+ * the peer database PEER_ADDRESSES_PER_MERGE at a time by a low priority task that yields in between
+ */
+#define GRAPHENE_NET_MAX_PENDING_PEER_ADDRESSES              2000
+#define GRAPHENE_NET_PEER_ADDRESSES_PER_MERGE                50
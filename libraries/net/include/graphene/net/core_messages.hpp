@@ -24,6 +24,7 @@
 #pragma once
 
 #include <graphene/net/config.hpp>
+#include <graphene/net/message.hpp>
 #include <graphene/chain/protocol/block.hpp>
 
 #include <fc/crypto/ripemd160.hpp>
@@ -44,6 +45,7 @@ namespace graphene { namespace net {
   using graphene::chain::block_id_type;
   using graphene::chain::transaction_id_type;
   using graphene::chain::signed_block;
+  using graphene::chain::processed_transaction;
 
   typedef fc::ecc::public_key_data node_id_t;
   typedef fc::ripemd160 item_hash_t;
@@ -86,6 +88,10 @@ namespace graphene { namespace net {
     check_firewall_reply_message_type            = 5015,
     get_current_connections_request_message_type = 5016,
     get_current_connections_reply_message_type   = 5017,
+    compact_block_message_type                   = 5018,
+    fetch_block_transactions_message_type        = 5019,
+    block_transactions_message_type              = 5020,
+    trx_batch_message_type                       = 5021,
     core_message_type_last                       = 5099
   };
 
@@ -115,6 +121,63 @@ namespace graphene { namespace net {
 
    };
 
+  /**
+   * A block with its transactions replaced by their ids, sent instead of the block_message to peers that
+   * advertise "compact_blocks" in their hello.  The peer takes the transactions it already has from its
+   * message cache and fetches the others with a fetch_block_transactions_message.
+   */
+  struct compact_block_message
+  {
+    static const core_message_type_enum type;
+
+    graphene::chain::signed_block_header header;
+    block_id_type                        block_id;
+    std::vector<transaction_id_type>     transaction_ids;
+    /// the results are part of the transactions' merkle digests, but they aren't in the peer's copies
+    std::vector<std::vector<graphene::chain::operation_result> > operation_results;
+
+    compact_block_message() {}
+    compact_block_message(const signed_block& block, const block_id_type& block_id);
+  };
+
+  struct fetch_block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type         block_id;
+    std::vector<uint32_t> transaction_indexes;
+
+    fetch_block_transactions_message() {}
+    fetch_block_transactions_message(const block_id_type& block_id, const std::vector<uint32_t>& transaction_indexes) :
+      block_id(block_id),
+      transaction_indexes(transaction_indexes)
+    {}
+  };
+
+  struct block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type                      block_id;
+    std::vector<processed_transaction> transactions; /// in the order they were requested, empty if we don't have the block
+
+    block_transactions_message() {}
+    block_transactions_message(const block_id_type& block_id) :
+      block_id(block_id)
+    {}
+  };
+
+  /**
+   * Several trx_messages sent as one, to peers that advertise "transaction_batches" in their hello.  The peer
+   * handles each of them as if it had been sent on its own.
+   */
+  struct trx_batch_message
+  {
+    static const core_message_type_enum type;
+
+    std::vector<message> transactions; /// each one a trx_message
+  };
+
   struct item_ids_inventory_message
   {
     static const core_message_type_enum type;
@@ -424,10 +487,23 @@ FC_REFLECT_ENUM( graphene::net::core_message_type_enum,
                  (check_firewall_reply_message_type)
                  (get_current_connections_request_message_type)
                  (get_current_connections_reply_message_type)
+                 (compact_block_message_type)
+                 (fetch_block_transactions_message_type)
+                 (block_transactions_message_type)
+                 (trx_batch_message_type)
                  (core_message_type_last) )
 
 FC_REFLECT( graphene::net::trx_message, (trx) )
 FC_REFLECT( graphene::net::block_message, (block)(block_id) )
+FC_REFLECT( graphene::net::compact_block_message, (header)
+                                             (block_id)
+                                             (transaction_ids)
+                                             (operation_results) )
+FC_REFLECT( graphene::net::fetch_block_transactions_message, (block_id)
+                                                        (transaction_indexes) )
+FC_REFLECT( graphene::net::block_transactions_message, (block_id)
+                                                  (transactions) )
+FC_REFLECT( graphene::net::trx_batch_message, (transactions) )
 
 FC_REFLECT( graphene::net::item_id, (item_type)
                                (item_hash) )
@@ -30,6 +30,7 @@
 #include <graphene/chain/protocol/types.hpp>
 
 #include <list>
+#include <map>
 
 namespace graphene { namespace net {
 
@@ -54,6 +55,43 @@ namespace graphene { namespace net {
     node_id_t originating_peer;
   };
 
+  /** messages of one type sent to or received from peers, the bytes include the message headers */
+  struct traffic_counter
+  {
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+
+    void record(const message& m) { ++messages; bytes += sizeof(message_header) + m.size; }
+    traffic_counter& operator += (const traffic_counter& o) { messages += o.messages; bytes += o.bytes; return *this; }
+  };
+  /** traffic_counters by the name of the message type in core_message_type_enum */
+  typedef std::map<std::string, traffic_counter> traffic_by_message_type;
+
+  struct peer_traffic
+  {
+    fc::optional<fc::ip::endpoint> endpoint;
+    node_id_t                      node_id;
+    traffic_by_message_type        received;
+    traffic_by_message_type        sent;
+  };
+
+  /** what node::get_traffic_statistics() returns */
+  struct traffic_statistics
+  {
+    /// of all the peers since the node started
+    traffic_by_message_type   received;
+    traffic_by_message_type   sent;
+    /// of each peer connected now, since it connected
+    std::vector<peer_traffic> peers;
+    /// bytes per second read and written, averaged over each of the last seconds, minutes and hours, oldest first
+    std::vector<uint32_t>     read_by_second;
+    std::vector<uint32_t>     written_by_second;
+    std::vector<uint32_t>     read_by_minute;
+    std::vector<uint32_t>     written_by_minute;
+    std::vector<uint32_t>     read_by_hour;
+    std::vector<uint32_t>     written_by_hour;
+  };
+
    /**
     *  @class node_delegate
     *  @brief used by node reports status to client or fetch data from client
@@ -79,6 +117,25 @@ namespace graphene { namespace net {
           */
          virtual bool handle_block( const graphene::net::block_message& blk_msg, bool sync_mode, 
                                     std::vector<fc::uint160_t>& contained_transaction_message_ids ) = 0;
+
+         /**
+          *  @brief Called as soon as a block arrives through the sync process, usually well before it can be
+          *         passed to handle_block()
+          *
+          *  Lets the delegate start on the checks that don't depend on the earlier blocks.  This is called on
+          *  the p2p thread and must not block.
+          */
+         virtual void sync_block_received( const graphene::net::block_message& blk_msg ) {}
+
+         /**
+          *  @brief Called once a block received during normal operation has been accepted by handle_block() and
+          *         broadcast to the peers
+          *
+          *  received is when the block arrived from the peer and broadcast_start when broadcasting it began, it
+          *  ended just before the call.  This is called on the p2p thread and must not block.
+          */
+         virtual void block_broadcast( const graphene::net::block_message& blk_msg, fc::time_point received,
+                                       fc::time_point broadcast_start ) {}
          
          /**
           *  @brief Called when a new transaction comes in from the network
@@ -260,6 +317,11 @@ namespace graphene { namespace net {
          *  I have a message ready.
          */
         virtual void  broadcast( const message& item_to_broadcast );
+        /**
+         *  Like broadcast(), but returns once the message is handed to the p2p
+         *  thread instead of waiting for it, for callers that must not yield.
+         */
+        virtual void  broadcast_without_waiting( const message& item_to_broadcast );
         virtual void  broadcast_transaction( const signed_transaction& trx )
         {
            broadcast( trx_message(trx) );
@@ -290,6 +352,8 @@ namespace graphene { namespace net {
 
         fc::variant_object network_get_info() const;
         fc::variant_object network_get_usage_stats() const;
+        /** the messages and bytes exchanged with the peers by message type, and the bandwidth history */
+        traffic_statistics get_traffic_statistics() const;
 
         std::vector<potential_peer_record> get_potential_peers() const;
 
@@ -312,6 +376,7 @@ namespace graphene { namespace net {
 
       void      sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers) override {}
       void      broadcast(const message& item_to_broadcast) override;
+      void      broadcast_without_waiting(const message& item_to_broadcast) override { broadcast(item_to_broadcast); }
       void      add_node_delegate(node_delegate* node_delegate_to_add);
 
       virtual uint32_t get_connection_count() const override { return 8; }
@@ -328,4 +393,9 @@ namespace graphene { namespace net {
 } } // graphene::net
 
 FC_REFLECT(graphene::net::message_propagation_data, (received_time)(validated_time)(originating_peer));
+FC_REFLECT(graphene::net::traffic_counter, (messages)(bytes));
+FC_REFLECT(graphene::net::peer_traffic, (endpoint)(node_id)(received)(sent));
+FC_REFLECT(graphene::net::traffic_statistics,
+           (received)(sent)(peers)(read_by_second)(written_by_second)(read_by_minute)(written_by_minute)
+           (read_by_hour)(written_by_hour));
 FC_REFLECT( graphene::net::peer_status, (version)(host)(info) );
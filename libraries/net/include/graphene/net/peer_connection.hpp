@@ -40,6 +40,8 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 
+#include <array>
+#include <map>
 #include <queue>
 #include <boost/container/deque.hpp>
 #include <fc/thread/future.hpp>
@@ -68,7 +70,7 @@ namespace graphene { namespace net
       virtual void on_message(peer_connection* originating_peer,
                               const message& received_message) = 0;
       virtual void on_connection_closed(peer_connection* originating_peer) = 0;
-      virtual message get_message_for_item(const item_id& item) = 0;
+      virtual std::shared_ptr<const message> get_message_for_item(const item_id& item) = 0;
     };
 
     class peer_connection;
@@ -110,6 +112,21 @@ namespace graphene { namespace net
       fc::optional<fc::ip::endpoint> _remote_endpoint;
       message_oriented_connection    _message_connection;
 
+      /* each class of message waits in its own send queue, and the queues are
+       * served in this order, so a block never waits behind a burst of
+       * transactions or address messages queued before it
+       */
+      enum message_priority
+      {
+        block_priority,           // blocks and the transactions of compact blocks
+        block_inventory_priority, // block inventory, requests, and small control messages
+        transaction_priority,     // transactions and their inventory
+        other_priority,           // addresses, firewall checks, everything else
+        number_of_message_priorities
+      };
+      static message_priority get_message_priority(const message& message_to_send);
+      static message_priority get_item_priority(uint32_t item_type);
+
       /* a base class for messages on the queue, to hide the fact that some
        * messages are complete messages and some are only hashes of messages.
        */
@@ -123,7 +140,8 @@ namespace graphene { namespace net
           enqueue_time(enqueue_time)
         {}
 
-        virtual message get_message(peer_connection_delegate* node) = 0;
+        virtual std::shared_ptr<const message> get_message(peer_connection_delegate* node) = 0;
+        virtual message_priority get_priority() const = 0;
         /** returns roughly the number of bytes of memory the message is consuming while
          * it is sitting on the queue
          */
@@ -131,21 +149,23 @@ namespace graphene { namespace net
         virtual ~queued_message() {}
       };
 
-      /* when you queue up a 'real_queued_message', a full copy of the message is
-       * stored on the heap until it is sent
+      /* when you queue up a 'real_queued_message', the message is stored on the heap
+       * until it is sent.  The same copy may be shared by the queues of several peers
+       * and the node's message cache, it is never modified once it has been queued
        */
       struct real_queued_message : queued_message
       {
-        message        message_to_send;
-        size_t         message_send_time_field_offset;
+        std::shared_ptr<const message> message_to_send;
+        size_t                         message_send_time_field_offset;
 
-        real_queued_message(message message_to_send,
+        real_queued_message(std::shared_ptr<const message> message_to_send,
                             size_t message_send_time_field_offset = (size_t)-1) :
           message_to_send(std::move(message_to_send)),
           message_send_time_field_offset(message_send_time_field_offset)
         {}
 
-        message get_message(peer_connection_delegate* node) override;
+        std::shared_ptr<const message> get_message(peer_connection_delegate* node) override;
+        message_priority get_priority() const override { return get_message_priority(*message_to_send); }
         size_t get_size_in_queue() override;
       };
 
@@ -161,13 +181,16 @@ namespace graphene { namespace net
           item_to_send(std::move(item_to_send))
         {}
 
-        message get_message(peer_connection_delegate* node) override;
+        std::shared_ptr<const message> get_message(peer_connection_delegate* node) override;
+        message_priority get_priority() const override { return get_item_priority(item_to_send.item_type); }
         size_t get_size_in_queue() override;
       };
 
 
+      typedef std::queue<std::unique_ptr<queued_message>, std::list<std::unique_ptr<queued_message> > > message_queue;
+
       size_t _total_queued_messages_size;
-      std::queue<std::unique_ptr<queued_message>, std::list<std::unique_ptr<queued_message> > > _queued_messages;
+      std::array<message_queue, number_of_message_priorities> _queued_messages;
       fc::future<void> _send_queued_messages_done;
     public:
       fc::time_point connection_initiation_time;
@@ -259,8 +282,49 @@ namespace graphene { namespace net
       // blockchain catch up
       fc::time_point transaction_fetching_inhibited_until;
 
+      /// messages exchanged with this peer by message type, since it connected; the messages received of types we
+      /// don't know are all counted under other_message_types, so a peer can't make the map grow
+      /// @{
+      static const uint32_t other_message_types = 0;
+      std::map<uint32_t, traffic_counter> traffic_received;
+      std::map<uint32_t, traffic_counter> traffic_sent;
+      /// @}
+
+      /// transaction validation budget, see GRAPHENE_NET_TRX_VALIDATION_BUDGET_PER_SECOND_US
+      /// @{
+      int64_t        transaction_validation_budget;         /// microseconds of delegate time, negative once overspent
+      fc::time_point transaction_validation_budget_time;    /// when the budget was last refilled
+      fc::time_point transaction_counts_window_start;
+      uint32_t       transactions_accepted_in_window;
+      uint32_t       transactions_rejected_in_window;
+      /// @}
+
       uint32_t last_known_fork_block_number;
 
+      /// compact block state data
+      /// @{
+      struct partial_compact_block
+      {
+        signed_block          block;                /// the missing transactions are default constructed
+        std::vector<uint32_t> missing_transactions; /// indexes of the transactions we've requested from this peer
+      };
+      bool supports_compact_blocks; /// the peer advertised "compact_blocks" in its hello, so we send it new blocks as compact_block_messages
+      std::map<block_id_type, partial_compact_block> partial_compact_blocks; /// compact blocks from this peer waiting for the transactions we didn't have
+      /// @}
+
+      bool supports_pushed_items; /// the peer advertised "pushed_items" in its hello, so it accepts items we didn't advertise
+      double         pushed_item_allowance;      /// items this peer may still push to us, see GRAPHENE_NET_PUSHED_ITEMS_PER_SECOND
+      fc::time_point pushed_item_allowance_time; /// when the allowance was last refilled
+      bool supports_transaction_batches; /// the peer advertised "transaction_batches" in its hello, so we may send it trx_batch_messages
+
+      /// request statistics, smoothed over the last requests, used to route our requests to the peers that answer them best
+      /// @{
+      fc::microseconds average_item_delay;         /// from requesting an item to receiving it, 0 until one arrived
+      double           average_bytes_per_second;   /// at which the items we requested arrived, 0 until one arrived
+      double           request_failure_rate;       /// fraction of our requests answered with an item_not_available_message
+      fc::time_point   last_requested_item_received_time;
+      /// @}
+
       fc::future<void> accept_or_connect_task_done;
 
       firewall_check_state_data *firewall_check_state;
@@ -285,12 +349,16 @@ namespace graphene { namespace net
 
       void send_queueable_message(std::unique_ptr<queued_message>&& message_to_send);
       void send_message(const message& message_to_send, size_t message_send_time_field_offset = (size_t)-1);
+      /** queues a message without copying it, for messages sent to many peers */
+      void send_shared_message(const std::shared_ptr<const message>& message_to_send);
       void send_item(const item_id& item_to_send);
       void close_connection();
       void destroy_connection();
 
       uint64_t get_total_bytes_sent() const;
       uint64_t get_total_bytes_received() const;
+      /** the size of the messages waiting to be sent to this peer */
+      size_t get_total_queued_messages_size() const { return _total_queued_messages_size; }
 
       fc::time_point get_last_message_sent_time() const;
       fc::time_point get_last_message_received_time() const;
@@ -303,6 +371,18 @@ namespace graphene { namespace net
       bool idle();
 
       bool is_transaction_fetching_inhibited() const;
+      /** refills the transaction validation budget, if it is spent inhibits fetching transactions until it isn't */
+      bool has_transaction_validation_budget();
+      /** charges the delegate time a transaction took, @return true if the peer sends mostly transactions we reject */
+      bool charge_transaction_validation(fc::microseconds validation_time, bool rejected);
+      /** charges the delegate time a transaction took without counting it as accepted or rejected */
+      void charge_transaction_validation_time(fc::microseconds validation_time);
+      /** refills the pushed item allowance at items_per_second, @return false if the peer has no item left to push */
+      bool take_pushed_item_allowance(uint32_t items_per_second);
+      void record_requested_item_received(fc::time_point request_time, size_t item_size);
+      void record_requested_item_not_available();
+      /** @return the requested items per second we expect to get from this peer, higher is better */
+      double get_request_score() const;
       fc::sha512 get_shared_secret() const;
       void clear_old_inventory();
       bool is_inventory_advertised_to_us_list_full_for_transactions() const;
@@ -310,6 +390,7 @@ namespace graphene { namespace net
       bool performing_firewall_check() const;
       fc::optional<fc::ip::endpoint> get_endpoint_for_connecting() const;
     private:
+      std::unique_ptr<queued_message> pop_next_queued_message();
       void send_queued_messages_task();
       void accept_connection_task();
       void connect_to_task(const fc::ip::endpoint& remote_endpoint);
@@ -98,7 +98,12 @@ namespace graphene { namespace net {
     peer_database();
     ~peer_database();
 
-    void open(const fc::path& databaseFilename);
+    /**
+     * The database is kept in a binary file that changes are appended to on a thread of its own, and that is
+     * compacted when it is opened and whenever it grows to twice the entries it needs.  If the file doesn't
+     * exist yet, the peers are imported from legacy_json_filename, the JSON file older versions kept them in.
+     */
+    void open(const fc::path& databaseFilename, const fc::path& legacy_json_filename = fc::path());
     void close();
     void clear();
 
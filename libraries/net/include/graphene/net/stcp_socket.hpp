@@ -57,6 +57,9 @@ class stcp_socket : public virtual fc::iostream
     void             get( char& c ) { read( &c, 1 ); }
     fc::sha512       get_shared_secret() const { return _shared_secret; }
   private:
+    /** the most that is decrypted or encrypted per readsome() or writesome(), each of which is one socket call */
+    static const size_t crypt_buffer_length = 64 * 1024;
+
     void do_key_exchange();
 
     fc::sha512           _shared_secret;
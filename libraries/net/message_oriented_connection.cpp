@@ -61,6 +61,7 @@ namespace graphene { namespace net {
       fc::time_point _last_message_sent_time;
 
       bool _send_message_in_progress;
+      std::vector<char> _send_buffer; /// holds each message padded for sending, kept for the next one to reuse
 
 #ifndef NDEBUG
       fc::thread* _thread;
@@ -141,9 +142,13 @@ namespace graphene { namespace net {
     void message_oriented_connection_impl::read_loop()
     {
       VERIFY_CORRECT_THREAD();
-      const int BUFFER_SIZE = 16;
-      const int LEFTOVER = BUFFER_SIZE - sizeof(message_header);
-      static_assert(BUFFER_SIZE >= sizeof(message_header), "insufficient buffer");
+      // messages are padded to whole 16 byte blocks, the first of which holds the header and the start of the data
+      const int BLOCK_SIZE = 16;
+      const int LEFTOVER = BLOCK_SIZE - sizeof(message_header);
+      static_assert(BLOCK_SIZE >= sizeof(message_header), "insufficient buffer");
+      // messages that fit are parsed straight out of this buffer, as many of them as each read from the socket returns
+      const size_t READ_BUFFER_SIZE = 64 * 1024;
+      static_assert(READ_BUFFER_SIZE % BLOCK_SIZE == 0, "the socket is read in whole blocks");
 
       _connected_time = fc::time_point::now();
 
@@ -152,25 +157,57 @@ namespace graphene { namespace net {
 
       try
       {
+        std::unique_ptr<char[]> read_buffer(new char[READ_BUFFER_SIZE]);
+        size_t buffer_begin = 0; // the first byte that isn't parsed yet
+        size_t buffer_end = 0;   // the end of the bytes read
+        // makes sure bytes_needed bytes are buffered from buffer_begin on, moving them to the start of the buffer if they wouldn't fit
+        auto fill_buffer = [&](size_t bytes_needed) {
+          if (buffer_begin + bytes_needed > READ_BUFFER_SIZE)
+          {
+            memmove(read_buffer.get(), read_buffer.get() + buffer_begin, buffer_end - buffer_begin);
+            buffer_end -= buffer_begin;
+            buffer_begin = 0;
+          }
+          while (buffer_end - buffer_begin < bytes_needed)
+          {
+            size_t bytes_read = _sock.readsome(read_buffer.get() + buffer_end, READ_BUFFER_SIZE - buffer_end);
+            buffer_end += bytes_read;
+            _bytes_received += bytes_read;
+          }
+        };
+
+        // reused for every message, so its data is only reallocated for messages bigger than any before
         message m;
         while( true )
         {
-          char buffer[BUFFER_SIZE];
-          _sock.read(buffer, BUFFER_SIZE);
-          _bytes_received += BUFFER_SIZE;
-          memcpy((char*)&m, buffer, sizeof(message_header));
+          fill_buffer(BLOCK_SIZE);
+          const char* first_block = read_buffer.get() + buffer_begin;
+          memcpy((char*)&m, first_block, sizeof(message_header));
 
           FC_ASSERT( m.size <= MAX_MESSAGE_SIZE, "", ("m.size",m.size)("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
 
           size_t remaining_bytes_with_padding = 16 * ((m.size - LEFTOVER + 15) / 16);
-          m.data.resize(LEFTOVER + remaining_bytes_with_padding); //give extra 16 bytes to allow for padding added in send call
-          std::copy(buffer + sizeof(message_header), buffer + sizeof(buffer), m.data.begin());
-          if (remaining_bytes_with_padding)
+          size_t message_length = BLOCK_SIZE + remaining_bytes_with_padding;
+          if (message_length <= READ_BUFFER_SIZE)
+          {
+            fill_buffer(message_length);
+            const char* message_data = read_buffer.get() + buffer_begin + sizeof(message_header);
+            m.data.assign(message_data, message_data + m.size);
+            buffer_begin += message_length;
+            if (buffer_begin == buffer_end)
+              buffer_begin = buffer_end = 0;
+          }
+          else
           {
-            _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
-            _bytes_received += remaining_bytes_with_padding;
+            // too big for the buffer, read the rest of it straight into the message
+            size_t data_buffered = buffer_end - buffer_begin - sizeof(message_header);
+            m.data.resize(LEFTOVER + remaining_bytes_with_padding); //give extra 16 bytes to allow for padding added in send call
+            memcpy(m.data.data(), first_block + sizeof(message_header), data_buffered);
+            _sock.read(&m.data[data_buffered], m.data.size() - data_buffered);
+            _bytes_received += m.data.size() - data_buffered;
+            m.data.resize(m.size); // truncate off the padding bytes
+            buffer_begin = buffer_end = 0;
           }
-          m.data.resize(m.size); // truncate off the padding bytes
 
           _last_message_received_time = fc::time_point::now();
 
@@ -188,6 +225,10 @@ namespace graphene { namespace net {
             wlog( "message transmission failed ${er}", ("er", e.to_detail_string() ) );
             throw;
           }
+
+          // don't hold on to the memory of a big block for the rest of the connection
+          if (m.data.capacity() > READ_BUFFER_SIZE)
+            std::vector<char>().swap(m.data);
         }
       }
       catch ( const fc::canceled_exception& e )
@@ -260,11 +301,16 @@ namespace graphene { namespace net {
            elog("Trying to send a message larger than MAX_MESSAGE_SIZE. This probably won't work...");
         //pad the message we send to a multiple of 16 bytes
         size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
-        std::unique_ptr<char[]> padded_message(new char[size_with_padding]);
-        memcpy(padded_message.get(), (char*)&message_to_send, sizeof(message_header));
-        memcpy(padded_message.get() + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
-        _sock.write(padded_message.get(), size_with_padding);
+        if (_send_buffer.size() < size_with_padding)
+          _send_buffer.resize(size_with_padding);
+        memcpy(_send_buffer.data(), (char*)&message_to_send, sizeof(message_header));
+        memcpy(_send_buffer.data() + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
+        memset(_send_buffer.data() + size_of_message_and_header, 0, size_with_padding - size_of_message_and_header);
+        _sock.write(_send_buffer.data(), size_with_padding);
         _sock.flush();
+        // don't hold on to the memory of a big block
+        if (_send_buffer.size() > GRAPHENE_NET_SEND_BUFFER_RETAINED_SIZE)
+          std::vector<char>().swap(_send_buffer);
         _bytes_sent += size_with_padding;
         _last_message_sent_time = fc::time_point::now();
       } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" );
@@ -29,6 +29,7 @@
 #include <forward_list>
 #include <iostream>
 #include <algorithm>
+#include <array>
 #include <tuple>
 #include <boost/tuple/tuple.hpp>
 #include <boost/circular_buffer.hpp>
@@ -124,6 +125,11 @@ namespace graphene { namespace net {
   namespace detail
   {
     namespace bmi = boost::multi_index;
+    /**
+     * Holds the blocks and transactions we've validated, to serve our peers' requests for them.  Messages stay for
+     * cache_duration_in_blocks blocks, unless the cache grows over its byte limit first: then the least recently
+     * used ones are evicted, so a burst of spam can't make it grow without bound.
+     */
     class blockchain_tied_message_cache
     {
     private:
@@ -132,10 +138,18 @@ namespace graphene { namespace net {
       struct message_hash_index{};
       struct message_contents_hash_index{};
       struct block_clock_index{};
+      struct recently_used_index{};
+      struct uint160_hash
+      {
+        size_t operator()(const fc::uint160_t& hash) const
+        {
+          return fc::city_hash_size_t(hash.data(), sizeof(hash));
+        }
+      };
       struct message_info
       {
         message_hash_type message_hash;
-        message           message_body;
+        std::shared_ptr<const message> message_body; // shared with the queues of the peers it is being sent to
         uint32_t          block_clock_when_received;
 
         // for network performance stats
@@ -148,44 +162,94 @@ namespace graphene { namespace net {
                       const message_propagation_data& propagation_data,
                       fc::uint160_t            message_contents_hash ) :
           message_hash( message_hash ),
-          message_body( message_body ),
+          message_body( std::make_shared<message>( message_body ) ),
           block_clock_when_received( block_clock_when_received ),
           propagation_data( propagation_data ),
           message_contents_hash( message_contents_hash )
         {}
+
+        /// roughly the memory the entry takes
+        size_t size() const { return sizeof(*this) + sizeof(message) + message_body->data.size(); }
       };
       typedef boost::multi_index_container
         < message_info,
-            bmi::indexed_by< bmi::ordered_unique< bmi::tag<message_hash_index>,
-                                                  bmi::member<message_info, message_hash_type, &message_info::message_hash> >,
-                             bmi::ordered_non_unique< bmi::tag<message_contents_hash_index>,
-                                                      bmi::member<message_info, fc::uint160_t, &message_info::message_contents_hash> >,
+            bmi::indexed_by< bmi::hashed_unique< bmi::tag<message_hash_index>,
+                                                 bmi::member<message_info, message_hash_type, &message_info::message_hash>,
+                                                 uint160_hash >,
+                             bmi::hashed_non_unique< bmi::tag<message_contents_hash_index>,
+                                                     bmi::member<message_info, fc::uint160_t, &message_info::message_contents_hash>,
+                                                     uint160_hash >,
                              bmi::ordered_non_unique< bmi::tag<block_clock_index>,
-                                                      bmi::member<message_info, uint32_t, &message_info::block_clock_when_received> > >
+                                                      bmi::member<message_info, uint32_t, &message_info::block_clock_when_received> >,
+                             /// least recently cached or requested first
+                             bmi::sequenced< bmi::tag<recently_used_index> > >
         > message_cache_container;
 
       message_cache_container _message_cache;
 
       uint32_t block_clock;
+      size_t   _size_in_bytes;
+      size_t   _max_size_in_bytes;
+      uint64_t _hits;
+      uint64_t _misses;
+      uint64_t _evictions;
+
+      void erase( message_cache_container::index<block_clock_index>::type::iterator first,
+                  message_cache_container::index<block_clock_index>::type::iterator last );
+      void evict_to_fit();
 
     public:
       blockchain_tied_message_cache() :
-        block_clock( 0 )
+        block_clock( 0 ),
+        _size_in_bytes( 0 ),
+        _max_size_in_bytes( GRAPHENE_NET_MESSAGE_CACHE_MAX_BYTES ),
+        _hits( 0 ),
+        _misses( 0 ),
+        _evictions( 0 )
       {}
       void block_accepted();
       void cache_message( const message& message_to_cache, const message_hash_type& hash_of_message_to_cache,
                         const message_propagation_data& propagation_data, const fc::uint160_t& message_content_hash );
-      message get_message( const message_hash_type& hash_of_message_to_lookup );
+      std::shared_ptr<const message> get_message( const message_hash_type& hash_of_message_to_lookup );
+      bool has_message( const message_hash_type& hash_of_message_to_lookup ) const
+      {
+        return _message_cache.get<message_hash_index>().find( hash_of_message_to_lookup ) != _message_cache.get<message_hash_index>().end();
+      }
+      std::shared_ptr<const message> find_message_by_contents( uint32_t message_type, const fc::uint160_t& hash_of_message_contents_to_lookup );
       message_propagation_data get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const;
       size_t size() const { return _message_cache.size(); }
+
+      void   set_max_size_in_bytes( size_t max_size_in_bytes ) { _max_size_in_bytes = max_size_in_bytes; evict_to_fit(); }
+      size_t get_max_size_in_bytes() const { return _max_size_in_bytes; }
+      fc::variant_object get_statistics() const;
     };
 
+    void blockchain_tied_message_cache::erase( message_cache_container::index<block_clock_index>::type::iterator first,
+                                               message_cache_container::index<block_clock_index>::type::iterator last )
+    {
+      for( auto iter = first; iter != last; ++iter )
+        _size_in_bytes -= iter->size();
+      _message_cache.get<block_clock_index>().erase( first, last );
+    }
+
+    void blockchain_tied_message_cache::evict_to_fit()
+    {
+      auto& recently_used = _message_cache.get<recently_used_index>();
+      // always keep the newest message, even if it's bigger than the limit on its own
+      while( _size_in_bytes > _max_size_in_bytes && recently_used.size() > 1 )
+      {
+        _size_in_bytes -= recently_used.front().size();
+        recently_used.pop_front();
+        ++_evictions;
+      }
+    }
+
     void blockchain_tied_message_cache::block_accepted()
     {
       ++block_clock;
       if( block_clock > cache_duration_in_blocks )
-        _message_cache.get<block_clock_index>().erase(_message_cache.get<block_clock_index>().begin(),
-                                                      _message_cache.get<block_clock_index>().lower_bound(block_clock - cache_duration_in_blocks ) );
+        erase( _message_cache.get<block_clock_index>().begin(),
+               _message_cache.get<block_clock_index>().lower_bound(block_clock - cache_duration_in_blocks ) );
     }
 
     void blockchain_tied_message_cache::cache_message( const message& message_to_cache,
@@ -193,22 +257,61 @@ namespace graphene { namespace net {
                                                      const message_propagation_data& propagation_data,
                                                      const fc::uint160_t& message_content_hash )
     {
-      _message_cache.insert( message_info(hash_of_message_to_cache,
-                                         message_to_cache,
-                                         block_clock,
-                                         propagation_data,
-                                         message_content_hash ) );
+      auto result = _message_cache.insert( message_info(hash_of_message_to_cache,
+                                                        message_to_cache,
+                                                        block_clock,
+                                                        propagation_data,
+                                                        message_content_hash ) );
+      if( result.second )
+      {
+        _size_in_bytes += result.first->size();
+        evict_to_fit();
+      }
     }
 
-    message blockchain_tied_message_cache::get_message( const message_hash_type& hash_of_message_to_lookup )
+    std::shared_ptr<const message> blockchain_tied_message_cache::get_message( const message_hash_type& hash_of_message_to_lookup )
     {
       message_cache_container::index<message_hash_index>::type::const_iterator iter =
          _message_cache.get<message_hash_index>().find(hash_of_message_to_lookup );
       if( iter != _message_cache.get<message_hash_index>().end() )
+      {
+        ++_hits;
+        auto& recently_used = _message_cache.get<recently_used_index>();
+        recently_used.relocate( recently_used.end(), _message_cache.project<recently_used_index>( iter ) );
         return iter->message_body;
+      }
+      ++_misses;
       FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
     }
 
+    std::shared_ptr<const message> blockchain_tied_message_cache::find_message_by_contents( uint32_t message_type,
+                                                                                   const fc::uint160_t& hash_of_message_contents_to_lookup )
+    {
+      auto range = _message_cache.get<message_contents_hash_index>().equal_range( hash_of_message_contents_to_lookup );
+      for( auto iter = range.first; iter != range.second; ++iter )
+        if( iter->message_body->msg_type == message_type )
+        {
+          ++_hits;
+          auto& recently_used = _message_cache.get<recently_used_index>();
+          recently_used.relocate( recently_used.end(), _message_cache.project<recently_used_index>( iter ) );
+          return iter->message_body;
+        }
+      ++_misses;
+      return std::shared_ptr<const message>();
+    }
+
+    fc::variant_object blockchain_tied_message_cache::get_statistics() const
+    {
+      fc::mutable_variant_object result;
+      result["messages"] = (uint64_t)_message_cache.size();
+      result["size_in_bytes"] = (uint64_t)_size_in_bytes;
+      result["max_size_in_bytes"] = (uint64_t)_max_size_in_bytes;
+      result["hits"] = _hits;
+      result["misses"] = _misses;
+      result["evictions"] = _evictions;
+      return result;
+    }
+
     message_propagation_data blockchain_tied_message_cache::get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const
     {
       if( hash_of_message_contents_to_lookup != fc::uint160_t() )
@@ -303,12 +406,38 @@ namespace graphene { namespace net { namespace detail {
                                    (get_current_block_interval_in_seconds)
 
 
+      /// counts the calls by duration since the node started, bucket i holds the ones that took less than 2^i microseconds
+      struct latency_histogram
+      {
+        std::array<uint64_t, 32> buckets;
+
+        latency_histogram() { buckets.fill(0); }
+        void record(int64_t duration_us)
+        {
+          uint32_t bucket = 0;
+          while (bucket < buckets.size() - 1 && (int64_t(1) << bucket) <= duration_us)
+            ++bucket;
+          ++buckets[bucket];
+        }
+        fc::variant_object get_counts() const;
+      };
+      struct call_latency_histograms
+      {
+        latency_histogram delay_before; /// from the p2p thread making the call to the delegate thread starting it
+        latency_histogram execution;
+        latency_histogram delay_after; /// from the delegate returning to the p2p thread going on
+        latency_histogram total;
+      };
+
 #define DECLARE_ACCUMULATOR(r, data, method_name) \
       mutable call_stats_accumulator BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _execution_accumulator)); \
       mutable call_stats_accumulator BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_before_accumulator)); \
-      mutable call_stats_accumulator BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_after_accumulator));
+      mutable call_stats_accumulator BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_after_accumulator)); \
+      mutable call_latency_histograms BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _latency_histograms));
       BOOST_PP_SEQ_FOR_EACH(DECLARE_ACCUMULATOR, unused, NODE_DELEGATE_METHOD_NAMES)
 #undef DECLARE_ACCUMULATOR
+      /// the time the delegate spent executing calls of any method since the node started, in microseconds
+      int64_t _total_execution_time = 0;
 
       class call_statistics_collector
       {
@@ -320,6 +449,8 @@ namespace graphene { namespace net { namespace detail {
         call_stats_accumulator* _execution_accumulator;
         call_stats_accumulator* _delay_before_accumulator;
         call_stats_accumulator* _delay_after_accumulator;
+        call_latency_histograms* _latency_histograms;
+        int64_t* _total_execution_time;
       public:
         class actual_execution_measurement_helper
         {
@@ -338,12 +469,16 @@ namespace graphene { namespace net { namespace detail {
         call_statistics_collector(const char* method_name,
                                   call_stats_accumulator* execution_accumulator,
                                   call_stats_accumulator* delay_before_accumulator,
-                                  call_stats_accumulator* delay_after_accumulator) :
+                                  call_stats_accumulator* delay_after_accumulator,
+                                  call_latency_histograms* latency_histograms,
+                                  int64_t* total_execution_time) :
           _call_requested_time(fc::time_point::now()),
           _method_name(method_name),
           _execution_accumulator(execution_accumulator),
           _delay_before_accumulator(delay_before_accumulator),
-          _delay_after_accumulator(delay_after_accumulator)
+          _delay_after_accumulator(delay_after_accumulator),
+          _latency_histograms(latency_histograms),
+          _total_execution_time(total_execution_time)
         {}
         ~call_statistics_collector()
         {
@@ -353,8 +488,13 @@ namespace graphene { namespace net { namespace detail {
           fc::microseconds delay_after(end_time - _execution_completed_time);
           fc::microseconds total_duration(actual_execution_time + delay_before + delay_after);
           (*_execution_accumulator)(actual_execution_time.count());
+          *_total_execution_time += actual_execution_time.count();
           (*_delay_before_accumulator)(delay_before.count());
           (*_delay_after_accumulator)(delay_after.count());
+          _latency_histograms->delay_before.record(delay_before.count());
+          _latency_histograms->execution.record(actual_execution_time.count());
+          _latency_histograms->delay_after.record(delay_after.count());
+          _latency_histograms->total.record(total_duration.count());
           if (total_duration > fc::milliseconds(500))
           {
             ilog("Call to method node_delegate::${method} took ${total_duration}us, longer than our target maximum of 500ms",
@@ -375,16 +515,28 @@ namespace graphene { namespace net { namespace detail {
         {
           _execution_completed_time = fc::time_point::now();
         }
+        /** how long the delegate took, without the delays before and after it ran */
+        fc::microseconds get_execution_time() const
+        {
+          return _execution_completed_time - _begin_execution_time;
+        }
       };
     public:
       statistics_gathering_node_delegate_wrapper(node_delegate* delegate, fc::thread* thread_for_delegate_calls);
 
       fc::variant_object get_call_statistics();
+      /** the time the delegate has spent executing calls since the node started */
+      fc::microseconds get_total_execution_time() const { return fc::microseconds(_total_execution_time); }
 
       bool has_item( const net::item_id& id ) override;
       void handle_message( const message& ) override;
       bool handle_block( const graphene::net::block_message& block_message, bool sync_mode, std::vector<fc::uint160_t>& contained_transaction_message_ids ) override;
+      void sync_block_received( const graphene::net::block_message& block_message ) override;
+      void block_broadcast( const graphene::net::block_message& block_message, fc::time_point received,
+                            fc::time_point broadcast_start ) override;
       void handle_transaction( const graphene::net::trx_message& transaction_message ) override;
+      /** like handle_transaction, and sets execution_time to the time the delegate took, even if it threw */
+      void handle_transaction( const graphene::net::trx_message& transaction_message, fc::microseconds& execution_time );
       std::vector<item_hash_t> get_block_ids(const std::vector<item_hash_t>& blockchain_synopsis,
                                              uint32_t& remaining_item_count,
                                              uint32_t limit = 2000) override;
@@ -415,7 +567,8 @@ namespace graphene { namespace net { namespace detail {
       fc::sha256           _chain_id;
 
 #define NODE_CONFIGURATION_FILENAME      "node_config.json"
-#define POTENTIAL_PEER_DATABASE_FILENAME "peers.json"
+#define POTENTIAL_PEER_DATABASE_FILENAME "peers.dat"
+#define LEGACY_POTENTIAL_PEER_DATABASE_FILENAME "peers.json"
       fc::path             _node_configuration_directory;
       node_configuration   _node_configuration;
 
@@ -438,6 +591,9 @@ namespace graphene { namespace net { namespace detail {
       fc::promise<void>::ptr    _retrigger_connect_loop_promise;
       bool                      _potential_peer_database_updated;
       fc::future<void>          _p2p_network_connect_loop_done;
+      /// addresses from address messages, merged into the database a few at a time by a low priority task
+      std::deque<address_info>  _pending_peer_addresses;
+      fc::future<void>          _merge_peer_addresses_done;
       // @}
 
       /// used by the task that fetches sync items during synchronization
@@ -449,8 +605,8 @@ namespace graphene { namespace net { namespace detail {
       typedef std::unordered_map<graphene::net::block_id_type, fc::time_point> active_sync_requests_map;
 
       active_sync_requests_map              _active_sync_requests; /// list of sync blocks we've asked for from peers but have not yet received
-      std::list<graphene::net::block_message> _new_received_sync_items; /// list of sync blocks we've just received but haven't yet tried to process
-      std::list<graphene::net::block_message> _received_sync_items; /// list of sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain
+      /// sync blocks we've received but haven't passed to the client yet, because it's busy or we are still missing blocks that come earlier in the chain
+      std::unordered_map<graphene::net::block_id_type, graphene::net::block_message> _received_sync_items;
       // @}
 
       fc::future<void> _process_backlog_of_sync_blocks_done;
@@ -547,6 +703,10 @@ namespace graphene { namespace net { namespace detail {
       unsigned _average_network_usage_second_counter;
       unsigned _average_network_usage_minute_counter;
 
+      /// what the peers that have been deleted exchanged with us, for the totals of get_traffic_statistics()
+      std::map<uint32_t, traffic_counter> _traffic_received_from_deleted_peers;
+      std::map<uint32_t, traffic_counter> _traffic_sent_to_deleted_peers;
+
       fc::time_point_sec _bandwidth_monitor_last_update_time;
       fc::future<void> _bandwidth_monitor_loop_done;
 
@@ -576,6 +736,30 @@ namespace graphene { namespace net { namespace detail {
       unsigned _maximum_number_of_blocks_to_handle_at_one_time;
       unsigned _maximum_number_of_sync_blocks_to_prefetch;
       unsigned _maximum_blocks_per_peer_during_syncing;
+      /// send new items straight to the peers that accept pushed items instead of advertising them
+      bool _push_items;
+      /// accept items peers push to us without advertising them first, otherwise an unrequested item gets the peer disconnected
+      bool _accept_pushed_items;
+      /// how many pushed items a single peer may send us each second, see peer_connection::take_pushed_item_allowance
+      uint32_t _pushed_items_per_second;
+      /// how long new inventory is left to pile up before it is advertised or pushed, so peers get fewer, bigger messages
+      fc::microseconds _relay_batch_window;
+      /// blocks and transactions are unpacked and hashed on these threads, round robin, if there are any
+      std::vector<std::unique_ptr<fc::thread> > _message_decode_threads;
+      unsigned _next_message_decode_thread;
+      /// the compact form of the last cached block sent to a peer, so it is built once for all the peers it goes to
+      std::pair<message_hash_type, std::shared_ptr<const message> > _last_compact_block_message;
+      /// lower the connection limit while the node is overloaded, and raise it back when the load goes down, off
+      /// unless asked for
+      bool _adaptive_connections;
+      /// the connection limit the load allows, between _desired_number_of_connections and _maximum_number_of_connections
+      uint32_t _load_connection_limit;
+      /// percentages of capacity used, in delegate time, upload bandwidth or outbound queues, above which we shed
+      /// connections and below which we take more again
+      uint32_t _load_high_percent;
+      uint32_t _load_low_percent;
+      fc::time_point _last_load_measurement_time;
+      fc::microseconds _last_delegate_execution_time;
 
       std::list<fc::future<void> > _handle_message_calls_in_progress;
 
@@ -601,6 +785,7 @@ namespace graphene { namespace net { namespace detail {
       void trigger_advertise_inventory_loop();
 
       void terminate_inactive_connections_loop();
+      void adjust_connections_to_load();
 
       void fetch_updated_peer_lists_loop();
       void update_bandwidth_data(uint32_t bytes_read_this_second, uint32_t bytes_written_this_second);
@@ -614,6 +799,8 @@ namespace graphene { namespace net { namespace detail {
 
       bool is_already_connected_to_id(const node_id_t& node_id);
       bool merge_address_info_with_potential_peer_database( const std::vector<address_info> addresses );
+      void queue_peer_addresses( const std::vector<address_info>& addresses );
+      void merge_pending_peer_addresses();
       void display_current_connections();
       uint32_t calculate_unsynced_block_count_from_all_peers();
       std::vector<item_hash_t> create_blockchain_synopsis_for_peer( const peer_connection* peer );
@@ -678,6 +865,24 @@ namespace graphene { namespace net { namespace detail {
       void on_get_current_connections_reply_message(peer_connection* originating_peer,
                                                     const get_current_connections_reply_message& get_current_connections_reply_message_received);
 
+      void on_compact_block_message(peer_connection* originating_peer,
+                                    const compact_block_message& compact_block_message_received);
+
+      void on_fetch_block_transactions_message(peer_connection* originating_peer,
+                                               const fetch_block_transactions_message& fetch_block_transactions_message_received);
+
+      void on_block_transactions_message(peer_connection* originating_peer,
+                                         const block_transactions_message& block_transactions_message_received);
+
+      void process_reconstructed_compact_block(peer_connection* originating_peer, const signed_block& block);
+
+      std::shared_ptr<const message> get_compact_block_message(const message_hash_type& block_message_hash,
+                                                               const message& block_message_to_compact);
+      void push_item(peer_connection* peer, const item_id& item_to_push);
+      void send_transactions(peer_connection* peer, const std::vector<std::shared_ptr<const message> >& transactions);
+      void on_trx_batch_message(peer_connection* originating_peer, const trx_batch_message& trx_batch_message_received);
+      bool accept_pushed_item(peer_connection* originating_peer, const item_id& item_received);
+
       void on_connection_closed(peer_connection* originating_peer) override;
 
       void send_sync_block_to_node_delegate(const graphene::net::block_message& block_message_to_send);
@@ -686,8 +891,11 @@ namespace graphene { namespace net { namespace detail {
       void process_block_during_sync(peer_connection* originating_peer, const graphene::net::block_message& block_message, const message_hash_type& message_hash);
       void process_block_during_normal_operation(peer_connection* originating_peer, const graphene::net::block_message& block_message, const message_hash_type& message_hash);
       void process_block_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash);
+      void process_block_message(peer_connection* originating_peer, const graphene::net::block_message& block_message_to_process, const message_hash_type& message_hash,
+                                 size_t message_size);
 
-      void process_ordinary_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash);
+      void process_ordinary_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash,
+                                    const trx_message* decoded_transaction = nullptr);
 
       void start_synchronizing();
       void start_synchronizing_with_peer(const peer_connection_ptr& peer);
@@ -751,10 +959,11 @@ namespace graphene { namespace net { namespace detail {
       void                       set_total_bandwidth_limit( uint32_t upload_bytes_per_second, uint32_t download_bytes_per_second );
       void                       disable_peer_advertising();
       fc::variant_object         get_call_statistics() const;
-      message                    get_message_for_item(const item_id& item) override;
+      std::shared_ptr<const message> get_message_for_item(const item_id& item) override;
 
       fc::variant_object         network_get_info() const;
       fc::variant_object         network_get_usage_stats() const;
+      traffic_statistics         get_traffic_statistics() const;
 
       bool is_hard_fork_block(uint32_t block_number) const;
       uint32_t get_next_known_hard_fork_block_number(uint32_t block_number) const;
@@ -825,7 +1034,16 @@ namespace graphene { namespace net { namespace detail {
       _node_is_shutting_down(false),
       _maximum_number_of_blocks_to_handle_at_one_time(MAXIMUM_NUMBER_OF_BLOCKS_TO_HANDLE_AT_ONE_TIME),
       _maximum_number_of_sync_blocks_to_prefetch(MAXIMUM_NUMBER_OF_BLOCKS_TO_PREFETCH),
-      _maximum_blocks_per_peer_during_syncing(GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING)
+      _maximum_blocks_per_peer_during_syncing(GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING),
+      _push_items(false),
+      _accept_pushed_items(false),
+      _pushed_items_per_second(GRAPHENE_NET_PUSHED_ITEMS_PER_SECOND),
+      _relay_batch_window(0),
+      _next_message_decode_thread(0),
+      _adaptive_connections(false),
+      _load_connection_limit(GRAPHENE_NET_DEFAULT_MAX_CONNECTIONS),
+      _load_high_percent(75),
+      _load_low_percent(50)
     {
       _rate_limiter.set_actual_rate_time_constant(fc::seconds(2));
       fc::rand_pseudo_bytes(&_node_id.data[0], (int)_node_id.size());
@@ -921,21 +1139,40 @@ namespace graphene { namespace net { namespace detail {
             bool initiated_connection_this_pass = false;
             _potential_peer_database_updated = false;
 
+            // pick the peers to try in one pass over the database, then connect to them one at a time, letting the
+            // block and transaction handling run in between since this task has a low priority
+            std::unordered_set<fc::ip::endpoint> endpoints_in_progress;
+            for (const peer_connection_ptr& peer : _active_connections)
+              if (peer->get_remote_endpoint())
+                endpoints_in_progress.insert(*peer->get_remote_endpoint());
+            for (const peer_connection_ptr& peer : _handshaking_connections)
+              if (peer->get_remote_endpoint())
+                endpoints_in_progress.insert(*peer->get_remote_endpoint());
+            const uint32_t connections_wanted = _desired_number_of_connections - get_number_of_connections();
+            std::vector<fc::ip::endpoint> endpoints_to_try;
             for (peer_database::iterator iter = _potential_peer_db.begin();
-                 iter != _potential_peer_db.end() && is_wanting_new_connections();
+                 iter != _potential_peer_db.end() && endpoints_to_try.size() < connections_wanted;
                  ++iter)
             {
               fc::microseconds delay_until_retry = fc::seconds((iter->number_of_failed_connection_attempts + 1) * _peer_connection_retry_timeout);
 
-              if (!is_connection_to_endpoint_in_progress(iter->endpoint) &&
+              if (endpoints_in_progress.find(iter->endpoint) == endpoints_in_progress.end() &&
                   ((iter->last_connection_disposition != last_connection_failed &&
                     iter->last_connection_disposition != last_connection_rejected &&
                     iter->last_connection_disposition != last_connection_handshaking_failed) ||
                    (fc::time_point::now() - iter->last_connection_attempt_time) > delay_until_retry))
-              {
-                connect_to_endpoint(iter->endpoint);
-                initiated_connection_this_pass = true;
-              }
+                endpoints_to_try.push_back(iter->endpoint);
+            }
+
+            for (const fc::ip::endpoint& endpoint : endpoints_to_try)
+            {
+              if (!is_wanting_new_connections())
+                break;
+              if (is_connection_to_endpoint_in_progress(endpoint))
+                continue;
+              connect_to_endpoint(endpoint);
+              initiated_connection_this_pass = true;
+              fc::yield();
             }
 
             if (!initiated_connection_this_pass && !_potential_peer_database_updated)
@@ -994,10 +1231,7 @@ namespace graphene { namespace net { namespace detail {
     bool node_impl::have_already_received_sync_item( const item_hash_t& item_hash )
     {
       VERIFY_CORRECT_THREAD();
-      return std::find_if(_received_sync_items.begin(), _received_sync_items.end(),
-                          [&item_hash]( const graphene::net::block_message& message ) { return message.block_id == item_hash; } ) != _received_sync_items.end() ||
-             std::find_if(_new_received_sync_items.begin(), _new_received_sync_items.end(),
-                          [&item_hash]( const graphene::net::block_message& message ) { return message.block_id == item_hash; } ) != _new_received_sync_items.end();                          ;
+      return _received_sync_items.find( item_hash ) != _received_sync_items.end();
     }
 
     void node_impl::request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request )
@@ -1041,13 +1275,31 @@ namespace graphene { namespace net { namespace detail {
             ASSERT_TASK_NOT_PREEMPTED();
             std::set<item_hash_t> sync_items_to_request;
 
-            // for each idle peer that we're syncing with
+            // the best scoring peers get to ask for the blocks we need first, and the others get fewer
+            // blocks in flight, in proportion to their scores.  Only the peers we're syncing with take part, so a
+            // fast peer we don't sync from doesn't shrink everyone else's window
+            std::vector<std::pair<double, peer_connection_ptr> > peers_by_score;
             for( const peer_connection_ptr& peer : _active_connections )
+              if( peer->we_need_sync_items_from_peer )
+                peers_by_score.emplace_back( peer->get_request_score(), peer );
+            std::sort( peers_by_score.begin(), peers_by_score.end(),
+                       []( const std::pair<double, peer_connection_ptr>& a, const std::pair<double, peer_connection_ptr>& b ) { return a.first > b.first; } );
+            const double best_score = peers_by_score.empty() ? 0 : peers_by_score.front().first;
+
+            // for each peer that we're syncing with and that isn't busy with anything but sync blocks,
+            // top the requests outstanding up to its window once half of them have arrived, so the peer
+            // never waits for us to ask for more
+            for( const auto& score_and_peer : peers_by_score )
             {
+              const peer_connection_ptr& peer = score_and_peer.second;
+              const size_t peer_window = best_score > 0 ? std::max<size_t>( 1, size_t( _maximum_blocks_per_peer_during_syncing * score_and_peer.first / best_score ) )
+                                                        : _maximum_blocks_per_peer_during_syncing;
               if( peer->we_need_sync_items_from_peer &&
                   sync_item_requests_to_send.find(peer) == sync_item_requests_to_send.end() && // if we've already scheduled a request for this peer, don't consider scheduling another
-                  peer->idle() )
+                  peer->items_requested_from_peer.empty() && !peer->item_ids_requested_from_peer &&
+                  peer->sync_items_requested_from_peer.size() <= peer_window / 2 )
               {
+                const size_t window_available = peer_window - peer->sync_items_requested_from_peer.size();
                 if (!peer->inhibit_fetching_sync_blocks)
                 {
                   // loop through the items it has that we don't yet have on our blockchain
@@ -1062,7 +1314,7 @@ namespace graphene { namespace net { namespace detail {
                       // then schedule a request from this peer
                       sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
                       sync_items_to_request.insert( item_to_potentially_request );
-                      if (sync_item_requests_to_send[peer].size() >= _maximum_blocks_per_peer_during_syncing)
+                      if (sync_item_requests_to_send[peer].size() >= window_available)
                         break;
                     }
                   }
@@ -1122,26 +1374,20 @@ namespace graphene { namespace net { namespace detail {
 
         // we need to construct a list of items to request from each peer first,
         // then send the messages (in two steps, to avoid yielding while iterating)
-        // we want to evenly distribute our requests among our peers.
-        struct requested_item_count_index {};
+        // we want to distribute our requests among our peers in proportion to their scores.
         struct peer_and_items_to_fetch
         {
           peer_connection_ptr peer;
+          double score;
           std::vector<item_id> item_ids;
-          peer_and_items_to_fetch(const peer_connection_ptr& peer) : peer(peer) {}
-          bool operator<(const peer_and_items_to_fetch& rhs) const { return peer < rhs.peer; }
-          size_t number_of_items() const { return item_ids.size(); }
+          peer_and_items_to_fetch(const peer_connection_ptr& peer) : peer(peer), score(peer->get_request_score()) {}
         };
-        typedef boost::multi_index_container<peer_and_items_to_fetch,
-                                             boost::multi_index::indexed_by<boost::multi_index::ordered_unique<boost::multi_index::member<peer_and_items_to_fetch, peer_connection_ptr, &peer_and_items_to_fetch::peer> >,
-                                                                            boost::multi_index::ordered_non_unique<boost::multi_index::tag<requested_item_count_index>,
-                                                                                                                   boost::multi_index::const_mem_fun<peer_and_items_to_fetch, size_t, &peer_and_items_to_fetch::number_of_items> > > > fetch_messages_to_send_set;
-        fetch_messages_to_send_set items_by_peer;
+        std::vector<peer_and_items_to_fetch> items_by_peer;
 
         // initialize the fetch_messages_to_send with an empty set of items for all idle peers
         for (const peer_connection_ptr& peer : _active_connections)
           if (peer->idle())
-            items_by_peer.insert(peer_and_items_to_fetch(peer));
+            items_by_peer.emplace_back(peer);
 
         // now loop over all items we want to fetch
         for (auto item_iter = _items_to_fetch.begin(); item_iter != _items_to_fetch.end();)
@@ -1156,9 +1402,11 @@ namespace graphene { namespace net { namespace detail {
           }
           else
           {
-            // find a peer that has it, we'll use the one who has the least requests going to it to load balance
-            bool item_fetched = false;
-            for (auto peer_iter = items_by_peer.get<requested_item_count_index>().begin(); peer_iter != items_by_peer.get<requested_item_count_index>().end(); ++peer_iter)
+            // find the peers that have it, we'll use the one with the best score per request we've already
+            // decided to send it, so the fastest peers get the most requests and slow ones are rotated out
+            auto best_peer_iter = items_by_peer.end();
+            double best_peer_score = 0;
+            for (auto peer_iter = items_by_peer.begin(); peer_iter != items_by_peer.end(); ++peer_iter)
             {
               const peer_connection_ptr& peer = peer_iter->peer;
               // if they have the item and we haven't already decided to ask them for too many other items
@@ -1169,20 +1417,25 @@ namespace graphene { namespace net { namespace detail {
                   next_peer_unblocked_time = std::min(peer->transaction_fetching_inhibited_until, next_peer_unblocked_time);
                 else
                 {
-                  //dlog("requesting item ${hash} from peer ${endpoint}",
-                  //     ("hash", iter->item.item_hash)("endpoint", peer->get_remote_endpoint()));
-                  item_id item_id_to_fetch = item_iter->item;
-                  peer->items_requested_from_peer.insert(peer_connection::item_to_time_map_type::value_type(item_id_to_fetch, fc::time_point::now()));
-                  item_iter = _items_to_fetch.erase(item_iter);
-                  item_fetched = true;
-                  items_by_peer.get<requested_item_count_index>().modify(peer_iter, [&item_id_to_fetch](peer_and_items_to_fetch& peer_and_items) {
-                    peer_and_items.item_ids.push_back(item_id_to_fetch);
-                  });
-                  break;
+                  double score_per_request = peer_iter->score / (peer_iter->item_ids.size() + 1);
+                  if (best_peer_iter == items_by_peer.end() || score_per_request > best_peer_score)
+                  {
+                    best_peer_iter = peer_iter;
+                    best_peer_score = score_per_request;
+                  }
                 }
-              }  
+              }
             }
-            if (!item_fetched)
+            if (best_peer_iter != items_by_peer.end())
+            {
+              //dlog("requesting item ${hash} from peer ${endpoint}",
+              //     ("hash", iter->item.item_hash)("endpoint", best_peer_iter->peer->get_remote_endpoint()));
+              item_id item_id_to_fetch = item_iter->item;
+              best_peer_iter->peer->items_requested_from_peer.insert(peer_connection::item_to_time_map_type::value_type(item_id_to_fetch, fc::time_point::now()));
+              item_iter = _items_to_fetch.erase(item_iter);
+              best_peer_iter->item_ids.push_back(item_id_to_fetch);
+            }
+            else
               ++item_iter;
           }
         }
@@ -1241,6 +1494,8 @@ namespace graphene { namespace net { namespace detail {
       while (!_advertise_inventory_loop_done.canceled())
       {
         dlog("beginning an iteration of advertise inventory");
+        if (_relay_batch_window.count() > 0)
+          fc::usleep(_relay_batch_window);
         // swap inventory into local variable, clearing the node's copy
         std::unordered_set<item_id> inventory_to_advertise;
         inventory_to_advertise.swap(_new_inventory);
@@ -1249,6 +1504,7 @@ namespace graphene { namespace net { namespace detail {
         // first, then send them all in a batch (to avoid any fiber interruption points while
         // we're computing the messages)
         std::list<std::pair<peer_connection_ptr, item_ids_inventory_message> > inventory_messages_to_send;
+        std::list<std::pair<peer_connection_ptr, item_id> > items_to_push;
 
         for (const peer_connection_ptr& peer : _active_connections)
         {
@@ -1272,8 +1528,13 @@ namespace graphene { namespace net { namespace detail {
               if (peer->inventory_advertised_to_peer.find(item_to_advertise) == peer->inventory_advertised_to_peer.end() &&
                   peer->inventory_peer_advertised_to_us.find(item_to_advertise) == peer->inventory_peer_advertised_to_us.end())
               {
-                items_to_advertise_by_type[item_to_advertise.item_type].push_back(item_to_advertise.item_hash);
                 peer->inventory_advertised_to_peer.insert(peer_connection::timestamped_item_id(item_to_advertise, fc::time_point::now()));
+                if (_push_items && peer->supports_pushed_items)
+                {
+                  items_to_push.push_back(std::make_pair(peer, item_to_advertise));
+                  continue;
+                }
+                items_to_advertise_by_type[item_to_advertise.item_type].push_back(item_to_advertise.item_hash);
                 ++total_items_to_send_to_this_peer;
                 if (item_to_advertise.item_type == trx_message_type)
                   testnetlog("advertising transaction ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
@@ -1293,6 +1554,27 @@ namespace graphene { namespace net { namespace detail {
         for (auto iter = inventory_messages_to_send.begin(); iter != inventory_messages_to_send.end(); ++iter)
           iter->first->send_message(iter->second);
         inventory_messages_to_send.clear();
+        // transactions pushed to the same peer go out together
+        std::map<peer_connection_ptr, std::vector<std::shared_ptr<const message> > > transactions_to_push;
+        for (const auto& item_to_push : items_to_push)
+        {
+          if (item_to_push.second.item_type == trx_message_type && item_to_push.first->supports_transaction_batches)
+          {
+            try
+            {
+              transactions_to_push[item_to_push.first].push_back(_message_cache.get_message(item_to_push.second.item_hash));
+              continue;
+            }
+            catch (fc::key_not_found_exception&)
+            {
+              // push_item will advertise it instead
+            }
+          }
+          push_item(item_to_push.first.get(), item_to_push.second);
+        }
+        items_to_push.clear();
+        for (const auto& peer_and_transactions : transactions_to_push)
+          send_transactions(peer_and_transactions.first.get(), peer_and_transactions.second);
 
         if (_new_inventory.empty())
         {
@@ -1303,6 +1585,110 @@ namespace graphene { namespace net { namespace detail {
       } // while(!canceled)
     }
 
+    std::shared_ptr<const message> node_impl::get_compact_block_message(const message_hash_type& block_message_hash,
+                                                                        const message& block_message_to_compact)
+    {
+      VERIFY_CORRECT_THREAD();
+      if (!_last_compact_block_message.second || _last_compact_block_message.first != block_message_hash)
+      {
+        graphene::net::block_message block = block_message_to_compact.as<graphene::net::block_message>();
+        _last_compact_block_message = std::make_pair(block_message_hash,
+                                                     std::make_shared<message>(compact_block_message(block.block, block.block_id)));
+      }
+      return _last_compact_block_message.second;
+    }
+
+    void node_impl::send_transactions(peer_connection* peer, const std::vector<std::shared_ptr<const message> >& transactions)
+    {
+      VERIFY_CORRECT_THREAD();
+      if (!peer->supports_transaction_batches || transactions.size() < 2)
+      {
+        for (const std::shared_ptr<const message>& transaction : transactions)
+          peer->send_shared_message(transaction);
+        return;
+      }
+
+      trx_batch_message batch;
+      size_t batch_size = 0;
+      for (const std::shared_ptr<const message>& transaction : transactions)
+      {
+        if (!batch.transactions.empty() && batch_size + transaction->data.size() > GRAPHENE_NET_MAX_TRX_BATCH_SIZE)
+        {
+          peer->send_shared_message(std::make_shared<message>(batch));
+          batch.transactions.clear();
+          batch_size = 0;
+        }
+        batch.transactions.push_back(*transaction);
+        batch_size += transaction->data.size();
+      }
+      if (batch.transactions.size() == 1)
+        peer->send_shared_message(transactions.back());
+      else
+        peer->send_shared_message(std::make_shared<message>(batch));
+    }
+
+    void node_impl::on_trx_batch_message(peer_connection* originating_peer, const trx_batch_message& trx_batch_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      dlog("received a batch of ${count} transactions from peer ${endpoint}",
+           ("count", trx_batch_message_received.transactions.size())
+           ("endpoint", originating_peer->get_remote_endpoint()));
+      for (const message& transaction : trx_batch_message_received.transactions)
+      {
+        if (transaction.msg_type != trx_message_type)
+        {
+          wlog("peer ${endpoint} sent a message of type ${type} in a transaction batch, ignoring it",
+               ("endpoint", originating_peer->get_remote_endpoint())("type", transaction.msg_type));
+          continue;
+        }
+        on_message(originating_peer, transaction);
+      }
+    }
+
+    void node_impl::push_item(peer_connection* peer, const item_id& item_to_push)
+    {
+      VERIFY_CORRECT_THREAD();
+      try
+      {
+        std::shared_ptr<const message> item_message = _message_cache.get_message(item_to_push.item_hash);
+        dlog("pushing item ${id} to peer ${endpoint}", ("id", item_to_push.item_hash)("endpoint", peer->get_remote_endpoint()));
+        if (item_to_push.item_type == block_message_type && peer->supports_compact_blocks)
+          peer->send_shared_message(get_compact_block_message(item_to_push.item_hash, *item_message));
+        else
+          peer->send_shared_message(item_message);
+      }
+      catch (fc::key_not_found_exception&)
+      {
+        // it already fell out of the cache, let the peer fetch it from the delegate
+        peer->send_message(item_ids_inventory_message(item_to_push.item_type, std::vector<item_hash_t>{item_to_push.item_hash}));
+      }
+    }
+
+    bool node_impl::accept_pushed_item(peer_connection* originating_peer, const item_id& item_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      if (!originating_peer->take_pushed_item_allowance(_pushed_items_per_second))
+      {
+        wlog("peer ${endpoint} pushed more than ${rate} items per second, disconnecting",
+             ("endpoint", originating_peer->get_remote_endpoint())("rate", _pushed_items_per_second));
+        fc::exception detailed_error(FC_LOG_MESSAGE(error, "You pushed me more than ${rate} items per second",
+                                                    ("rate", _pushed_items_per_second)));
+        disconnect_from_peer(originating_peer, "You pushed me more items than I accept", true, detailed_error);
+        return false;
+      }
+      // don't offer it back to the peer, and don't fetch it from anyone else
+      originating_peer->inventory_peer_advertised_to_us.insert(peer_connection::timestamped_item_id(item_received, fc::time_point::now()));
+      _items_to_fetch.get<item_id_index>().erase(item_received);
+      if (_message_cache.has_message(item_received.item_hash) ||
+          _recently_failed_items.find(item_received) != _recently_failed_items.end())
+      {
+        dlog("peer ${endpoint} pushed item ${id} that we've already processed",
+             ("endpoint", originating_peer->get_remote_endpoint())("id", item_received.item_hash));
+        return false;
+      }
+      return true;
+    }
+
     void node_impl::trigger_advertise_inventory_loop()
     {
       VERIFY_CORRECT_THREAD();
@@ -1492,12 +1878,86 @@ namespace graphene { namespace net { namespace detail {
                            offsetof(current_time_request_message, request_sent_time));
       peers_to_send_keep_alive.clear();
 
+      adjust_connections_to_load();
+
       if (!_node_is_shutting_down && !_terminate_inactive_connections_loop_done.canceled())
          _terminate_inactive_connections_loop_done = fc::schedule( [this](){ terminate_inactive_connections_loop(); },
                                                                    fc::time_point::now() + fc::seconds(GRAPHENE_NET_PEER_HANDSHAKE_INACTIVITY_TIMEOUT / 2),
                                                                    "terminate_inactive_connections_loop" );
     }
 
+    void node_impl::adjust_connections_to_load()
+    {
+      VERIFY_CORRECT_THREAD();
+      // the load is the largest share of capacity in use: of the time since we last looked, the part the delegate
+      // spent on our calls; of the upload limit, the part being used; and of the queue each peer is allowed,
+      // the part filled on average
+      fc::time_point now = fc::time_point::now();
+      fc::microseconds delegate_execution_time = _delegate->get_total_execution_time();
+      fc::microseconds interval = now - _last_load_measurement_time;
+      uint64_t busy_percent = interval.count() > 0 ? (delegate_execution_time - _last_delegate_execution_time).count() * 100 / interval.count() : 0;
+      _last_load_measurement_time = now;
+      _last_delegate_execution_time = delegate_execution_time;
+
+      if (!_adaptive_connections)
+      {
+        _load_connection_limit = _maximum_number_of_connections;
+        return;
+      }
+
+      uint32_t upload_limit = _rate_limiter.get_upload_limit();
+      uint64_t upload_percent = upload_limit ? uint64_t(_rate_limiter.get_actual_upload_rate()) * 100 / upload_limit : 0;
+
+      uint64_t queued_bytes = 0;
+      for (const peer_connection_ptr& peer : _active_connections)
+        queued_bytes += peer->get_total_queued_messages_size();
+      uint64_t queue_percent = _active_connections.empty() ? 0 :
+                               queued_bytes * 100 / (_active_connections.size() * GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES);
+
+      uint64_t load_percent = std::max(busy_percent, std::max(upload_percent, queue_percent));
+      uint32_t previous_limit = _load_connection_limit;
+      if (load_percent > _load_high_percent)
+      {
+        // take a tenth off the connections we have, so the load comes down over a few rounds instead of all at once
+        uint32_t connections = get_number_of_connections();
+        _load_connection_limit = std::min(_load_connection_limit, connections - std::min(connections, std::max<uint32_t>(1, connections / 10)));
+      }
+      else if (load_percent < _load_low_percent)
+        _load_connection_limit += std::max<uint32_t>(1, _maximum_number_of_connections / 20);
+      _load_connection_limit = std::max(_desired_number_of_connections, std::min(_load_connection_limit, _maximum_number_of_connections));
+
+      if (_load_connection_limit != previous_limit)
+        dlog("Load is at ${load}% (delegate busy ${busy}%, upload ${upload}%, queues ${queues}%), now accepting up to ${limit} connections",
+             ("load", load_percent)("busy", busy_percent)("upload", upload_percent)("queues", queue_percent)
+             ("limit", _load_connection_limit));
+
+      if (_active_connections.size() <= _load_connection_limit)
+        return;
+
+      // a node catching up is busy because of the sync itself, shedding the peers it syncs from would only slow it
+      for (const peer_connection_ptr& peer : _active_connections)
+        if (peer->we_need_sync_items_from_peer)
+          return;
+
+      // only inbound peers are shed, the outbound ones are those we chose to keep us connected to the network;
+      // of those, the peers with the most queued for them are the ones costing us the most to keep up with
+      std::vector<peer_connection_ptr> peers_to_shed;
+      for (const peer_connection_ptr& peer : _active_connections)
+        if (peer->direction == peer_connection_direction::inbound)
+          peers_to_shed.push_back(peer);
+      std::sort(peers_to_shed.begin(), peers_to_shed.end(),
+                [](const peer_connection_ptr& a, const peer_connection_ptr& b) {
+                  return a->get_total_queued_messages_size() > b->get_total_queued_messages_size();
+                });
+      peers_to_shed.resize(std::min<size_t>(peers_to_shed.size(), _active_connections.size() - _load_connection_limit));
+      for (const peer_connection_ptr& peer : peers_to_shed)
+      {
+        wlog("Disconnecting from peer ${peer} with ${queued} bytes queued, the node is overloaded",
+             ("peer", peer->get_remote_endpoint())("queued", peer->get_total_queued_messages_size()));
+        disconnect_from_peer(peer.get(), "I am too busy to keep this connection open");
+      }
+    }
+
     void node_impl::fetch_updated_peer_lists_loop()
     {
       VERIFY_CORRECT_THREAD();
@@ -1530,7 +1990,7 @@ namespace graphene { namespace net { namespace detail {
       if (!_node_is_shutting_down && !_fetch_updated_peer_lists_loop_done.canceled() )
          _fetch_updated_peer_lists_loop_done = fc::schedule( [this](){ fetch_updated_peer_lists_loop(); },
                                                              fc::time_point::now() + fc::minutes(15),
-                                                             "fetch_updated_peer_lists_loop" );
+                                                             "fetch_updated_peer_lists_loop", fc::priority::min() );
     }
     void node_impl::update_bandwidth_data(uint32_t bytes_read_this_second, uint32_t bytes_written_this_second)
     {
@@ -1617,6 +2077,11 @@ namespace graphene { namespace net { namespace detail {
       assert(_closing_connections.find(peer_to_delete) == _closing_connections.end());
       assert(_terminating_connections.find(peer_to_delete) == _terminating_connections.end());
 
+      for (const auto& counter : peer_to_delete->traffic_received)
+        _traffic_received_from_deleted_peers[counter.first] += counter.second;
+      for (const auto& counter : peer_to_delete->traffic_sent)
+        _traffic_sent_to_deleted_peers[counter.first] += counter.second;
+
 #ifdef USE_PEERS_TO_DELETE_MUTEX
       dlog("scheduling peer for deletion: ${peer} (may block on a mutex here)", ("peer", peer_to_delete->get_remote_endpoint()));
 
@@ -1654,7 +2119,8 @@ namespace graphene { namespace net { namespace detail {
     bool node_impl::is_accepting_new_connections()
     {
       VERIFY_CORRECT_THREAD();
-      return !_p2p_network_connect_loop_done.canceled() && get_number_of_connections() <= _maximum_number_of_connections;
+      return !_p2p_network_connect_loop_done.canceled() &&
+             get_number_of_connections() <= std::min(_maximum_number_of_connections, _load_connection_limit);
     }
 
     bool node_impl::is_wanting_new_connections()
@@ -1722,13 +2188,43 @@ namespace graphene { namespace net { namespace detail {
       return new_information_received;
     }
 
+    void node_impl::queue_peer_addresses(const std::vector<address_info>& addresses)
+    {
+      VERIFY_CORRECT_THREAD();
+      // the database keeps no more than MAXIMUM_PEERDB_SIZE anyway, a peer sending more only costs us time to merge
+      for (const address_info& address : addresses)
+      {
+        if (_pending_peer_addresses.size() >= GRAPHENE_NET_MAX_PENDING_PEER_ADDRESSES)
+          break;
+        _pending_peer_addresses.push_back(address);
+      }
+      if (!_node_is_shutting_down && (!_merge_peer_addresses_done.valid() || _merge_peer_addresses_done.ready()))
+        _merge_peer_addresses_done = fc::async([this](){ merge_pending_peer_addresses(); },
+                                               "merge_pending_peer_addresses", fc::priority::min());
+    }
+
+    void node_impl::merge_pending_peer_addresses()
+    {
+      VERIFY_CORRECT_THREAD();
+      while (!_pending_peer_addresses.empty() && !_node_is_shutting_down)
+      {
+        size_t count = std::min<size_t>(_pending_peer_addresses.size(), GRAPHENE_NET_PEER_ADDRESSES_PER_MERGE);
+        std::vector<address_info> addresses(_pending_peer_addresses.begin(), _pending_peer_addresses.begin() + count);
+        _pending_peer_addresses.erase(_pending_peer_addresses.begin(), _pending_peer_addresses.begin() + count);
+        if (merge_address_info_with_potential_peer_database(addresses))
+          trigger_p2p_network_connect_loop();
+        fc::yield();
+      }
+    }
+
     void node_impl::display_current_connections()
     {
       VERIFY_CORRECT_THREAD();
-      dlog("Currently have ${current} of [${desired}/${max}] connections",
+      dlog("Currently have ${current} of [${desired}/${max}] connections, the load allows ${limit}",
            ("current", get_number_of_connections())
            ("desired", _desired_number_of_connections)
-           ("max", _maximum_number_of_connections));
+           ("max", _maximum_number_of_connections)
+           ("limit", _load_connection_limit));
       dlog("   my id is ${id}", ("id", _node_id));
 
       for (const peer_connection_ptr& active_connection : _active_connections)
@@ -1750,7 +2246,32 @@ namespace graphene { namespace net { namespace detail {
     void node_impl::on_message( peer_connection* originating_peer, const message& received_message )
     {
       VERIFY_CORRECT_THREAD();
-      message_hash_type message_hash = received_message.id();
+      message_hash_type message_hash;
+      fc::optional<graphene::net::block_message> decoded_block;
+      fc::optional<trx_message> decoded_transaction;
+      if (!_message_decode_threads.empty() &&
+          (received_message.msg_type == block_message_type || received_message.msg_type == trx_message_type))
+      {
+        // only this peer's read loop waits for the decode thread, the p2p thread goes on with the other peers' messages.
+        // The peer may be closed and dropped meanwhile, so we hold a reference to it and don't use it if it's gone
+        peer_connection_ptr originating_peer_ptr = originating_peer->shared_from_this();
+        fc::thread* decode_thread = _message_decode_threads[_next_message_decode_thread++ % _message_decode_threads.size()].get();
+        decode_thread->async([&]() {
+          message_hash = received_message.id();
+          if (received_message.msg_type == block_message_type)
+            decoded_block = received_message.as<graphene::net::block_message>();
+          else
+            decoded_transaction = received_message.as<trx_message>();
+        }, "decode p2p message").wait();
+        if (_active_connections.find(originating_peer_ptr) == _active_connections.end())
+        {
+          dlog("dropping message ${hash} from peer ${endpoint}, it was disconnected while the message was decoded",
+               ("hash", message_hash)("endpoint", originating_peer_ptr->get_remote_endpoint()));
+          return;
+        }
+      }
+      else
+        message_hash = received_message.id();
       dlog("handling message ${type} ${hash} size ${size} from peer ${endpoint}",
            ("type", graphene::net::core_message_type_enum(received_message.msg_type))("hash", message_hash)
            ("size", received_message.size)
@@ -1791,7 +2312,10 @@ namespace graphene { namespace net { namespace detail {
         on_closing_connection_message(originating_peer, received_message.as<closing_connection_message>());
         break;
       case core_message_type_enum::block_message_type:
-        process_block_message(originating_peer, received_message, message_hash);
+        if (decoded_block)
+          process_block_message(originating_peer, *decoded_block, message_hash, received_message.size);
+        else
+          process_block_message(originating_peer, received_message, message_hash);
         break;
       case core_message_type_enum::current_time_request_message_type:
         on_current_time_request_message(originating_peer, received_message.as<current_time_request_message>());
@@ -1811,13 +2335,25 @@ namespace graphene { namespace net { namespace detail {
       case core_message_type_enum::get_current_connections_reply_message_type:
         on_get_current_connections_reply_message(originating_peer, received_message.as<get_current_connections_reply_message>());
         break;
+      case core_message_type_enum::compact_block_message_type:
+        on_compact_block_message(originating_peer, received_message.as<compact_block_message>());
+        break;
+      case core_message_type_enum::fetch_block_transactions_message_type:
+        on_fetch_block_transactions_message(originating_peer, received_message.as<fetch_block_transactions_message>());
+        break;
+      case core_message_type_enum::block_transactions_message_type:
+        on_block_transactions_message(originating_peer, received_message.as<block_transactions_message>());
+        break;
+      case core_message_type_enum::trx_batch_message_type:
+        on_trx_batch_message(originating_peer, received_message.as<trx_batch_message>());
+        break;
 
       default:
         // ignore any message in between core_message_type_first and _last that we don't handle above
         // to allow us to add messages in the future
         if (received_message.msg_type < core_message_type_enum::core_message_type_first ||
             received_message.msg_type > core_message_type_enum::core_message_type_last)
-          process_ordinary_message(originating_peer, received_message, message_hash);
+          process_ordinary_message(originating_peer, received_message, message_hash, decoded_transaction.valid() ? &*decoded_transaction : nullptr);
         break;
       }
     }
@@ -1854,6 +2390,10 @@ namespace graphene { namespace net { namespace detail {
       if (!_hard_fork_block_numbers.empty())
         user_data["last_known_fork_block_number"] = _hard_fork_block_numbers.back();
 
+      user_data["compact_blocks"] = true;
+      user_data["pushed_items"] = _accept_pushed_items;
+      user_data["transaction_batches"] = true;
+
       return user_data;
     }
     void node_impl::parse_hello_user_data_for_peer(peer_connection* originating_peer, const fc::variant_object& user_data)
@@ -1876,6 +2416,12 @@ namespace graphene { namespace net { namespace detail {
         originating_peer->node_id = user_data["node_id"].as<node_id_t>();
       if (user_data.contains("last_known_fork_block_number"))
         originating_peer->last_known_fork_block_number = user_data["last_known_fork_block_number"].as<uint32_t>();
+      if (user_data.contains("compact_blocks"))
+        originating_peer->supports_compact_blocks = user_data["compact_blocks"].as<bool>();
+      if (user_data.contains("pushed_items"))
+        originating_peer->supports_pushed_items = user_data["pushed_items"].as<bool>();
+      if (user_data.contains("transaction_batches"))
+        originating_peer->supports_transaction_batches = user_data["transaction_batches"].as<bool>();
     }
 
     void node_impl::on_hello_message( peer_connection* originating_peer, const hello_message& hello_message_received )
@@ -2189,9 +2735,7 @@ namespace graphene { namespace net { namespace detail {
       std::vector<graphene::net::address_info> updated_addresses = address_message_received.addresses;
       for (address_info& address : updated_addresses)
         address.last_seen_time = fc::time_point_sec(fc::time_point::now());
-      bool new_information_received = merge_address_info_with_potential_peer_database(updated_addresses);
-      if (new_information_received)
-        trigger_p2p_network_connect_loop();
+      queue_peer_addresses(updated_addresses);
 
       if (_handshaking_connections.find(originating_peer->shared_from_this()) != _handshaking_connections.end())
       {
@@ -2702,7 +3246,7 @@ namespace graphene { namespace net { namespace detail {
       }
     }
 
-    message node_impl::get_message_for_item(const item_id& item)
+    std::shared_ptr<const message> node_impl::get_message_for_item(const item_id& item)
     {
       try
       {
@@ -2712,11 +3256,11 @@ namespace graphene { namespace net { namespace detail {
       {}
       try
       {
-        return _delegate->get_item(item);
+        return std::make_shared<message>(_delegate->get_item(item));
       }
       catch (fc::key_not_found_exception&)
       {}
-      return item_not_available_message(item);
+      return std::make_shared<message>(item_not_available_message(item));
     }
 
     void node_impl::on_fetch_items_message(peer_connection* originating_peer, const fetch_items_message& fetch_items_message_received)
@@ -2727,20 +3271,31 @@ namespace graphene { namespace net { namespace detail {
            ("type", fetch_items_message_received.item_type)
            ("endpoint", originating_peer->get_remote_endpoint()));
 
-      fc::optional<message> last_block_message_sent;
+      fc::optional<block_id_type> last_block_id_sent;
 
-      std::list<message> reply_messages;
+      // replies from the cache share its copy of the message with every other peer it goes to.  Blocks we get
+      // from the delegate are queued by id instead and fetched again when they reach the front of the queue,
+      // so that a big sync request doesn't hold all of them in memory
+      std::list<std::pair<std::shared_ptr<const message>, item_id> > reply_messages;
       for (const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch)
       {
         try
         {
-          message requested_message = _message_cache.get_message(item_hash);
+          std::shared_ptr<const message> requested_message = _message_cache.get_message(item_hash);
           dlog("received item request for item ${id} from peer ${endpoint}, returning the item from my message cache",
                ("endpoint", originating_peer->get_remote_endpoint())
-               ("id", requested_message.id()));
-          reply_messages.push_back(requested_message);
+               ("id", item_hash));
           if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
+          {
+            last_block_id_sent = requested_message->as<graphene::net::block_message>().block_id;
+            // blocks in the cache are new, the peer will most likely have seen their transactions already
+            if (originating_peer->supports_compact_blocks)
+            {
+              reply_messages.emplace_back(get_compact_block_message(item_hash, *requested_message), item_id());
+              continue;
+            }
+          }
+          reply_messages.emplace_back(requested_message, item_id());
           continue;
         }
         catch (fc::key_not_found_exception&)
@@ -2753,37 +3308,191 @@ namespace graphene { namespace net { namespace detail {
         {
           message requested_message = _delegate->get_item(item_to_fetch);
           dlog("received item request from peer ${endpoint}, returning the item from delegate with id ${id} size ${size}",
-               ("id", requested_message.id())
+               ("id", item_hash)
                ("size", requested_message.size)
                ("endpoint", originating_peer->get_remote_endpoint()));
-          reply_messages.push_back(requested_message);
           if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
+          {
+            last_block_id_sent = requested_message.as<graphene::net::block_message>().block_id;
+            reply_messages.emplace_back(std::shared_ptr<const message>(), item_id(block_message_type, *last_block_id_sent));
+          }
+          else
+            reply_messages.emplace_back(std::make_shared<message>(std::move(requested_message)), item_id());
           continue;
         }
         catch (fc::key_not_found_exception&)
         {
-          reply_messages.push_back(item_not_available_message(item_to_fetch));
+          reply_messages.emplace_back(std::make_shared<message>(item_not_available_message(item_to_fetch)), item_id());
           dlog("received item request from peer ${endpoint} but we don't have it",
                ("endpoint", originating_peer->get_remote_endpoint()));
         }
       }
 
       // if we sent them a block, update our record of the last block they've seen accordingly
-      if (last_block_message_sent)
+      if (last_block_id_sent)
       {
-        graphene::net::block_message block = last_block_message_sent->as<graphene::net::block_message>();
-        originating_peer->last_block_delegate_has_seen = block.block_id;
-        originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block.block_id);
+        originating_peer->last_block_delegate_has_seen = *last_block_id_sent;
+        originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(*last_block_id_sent);
       }
 
-      for (const message& reply : reply_messages)
+      std::vector<std::shared_ptr<const message> > transactions_to_send;
+      for (const auto& reply : reply_messages)
       {
-        if (reply.msg_type == block_message_type)
-          originating_peer->send_item(item_id(block_message_type, reply.as<graphene::net::block_message>().block_id));
+        if (reply.first && reply.first->msg_type == trx_message_type)
+          transactions_to_send.push_back(reply.first);
+        else if (reply.first)
+          originating_peer->send_shared_message(reply.first);
         else
-          originating_peer->send_message(reply);
+          originating_peer->send_item(reply.second);
+      }
+      send_transactions(originating_peer, transactions_to_send);
+    }
+
+    void node_impl::on_compact_block_message(peer_connection* originating_peer,
+                                             const compact_block_message& compact_block_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const block_id_type& block_id = compact_block_message_received.block_id;
+      size_t blocks_requested_from_peer = originating_peer->sync_items_requested_from_peer.size();
+      for (const auto& requested_item : originating_peer->items_requested_from_peer)
+        if (requested_item.first.item_type == block_message_type)
+          ++blocks_requested_from_peer;
+      if (_accept_pushed_items)
+        blocks_requested_from_peer += GRAPHENE_NET_MAX_PUSHED_COMPACT_BLOCKS_PER_PEER;
+      if (compact_block_message_received.transaction_ids.size() != compact_block_message_received.operation_results.size() ||
+          originating_peer->partial_compact_blocks.size() >= blocks_requested_from_peer)
+      {
+        wlog("received an invalid or unrequested compact block ${block_id} from peer ${endpoint}, disconnecting from peer",
+             ("endpoint", originating_peer->get_remote_endpoint())
+             ("block_id", block_id));
+        fc::exception detailed_error(FC_LOG_MESSAGE(error, "You sent me a compact block that I didn't ask for or couldn't parse, block_id: ${block_id}",
+                                                    ("block_id", block_id)));
+        disconnect_from_peer(originating_peer, "You sent me a compact block that I didn't ask for or couldn't parse", true, detailed_error);
+        return;
+      }
+
+      peer_connection::partial_compact_block partial_block;
+      static_cast<graphene::chain::signed_block_header&>(partial_block.block) = compact_block_message_received.header;
+      partial_block.block.transactions.resize(compact_block_message_received.transaction_ids.size());
+      for (uint32_t i = 0; i < compact_block_message_received.transaction_ids.size(); ++i)
+      {
+        std::shared_ptr<const message> cached_transaction = _message_cache.find_message_by_contents(trx_message_type,
+                                                                                           compact_block_message_received.transaction_ids[i]);
+        if (!cached_transaction)
+        {
+          partial_block.missing_transactions.push_back(i);
+          continue;
+        }
+        processed_transaction& trx = partial_block.block.transactions[i];
+        trx = processed_transaction(cached_transaction->as<trx_message>().trx);
+        trx.operation_results = compact_block_message_received.operation_results[i];
+      }
+
+      if (partial_block.missing_transactions.empty())
+      {
+        // the ids don't cover the signatures, so our copy of a transaction may be signed differently than the block's
+        if (partial_block.block.calculate_merkle_root() == partial_block.block.transaction_merkle_root)
+        {
+          process_reconstructed_compact_block(originating_peer, partial_block.block);
+          return;
+        }
+        for (uint32_t i = 0; i < partial_block.block.transactions.size(); ++i)
+          partial_block.missing_transactions.push_back(i);
+      }
+
+      dlog("fetching ${count} of the ${total} transactions in compact block ${block_id} from peer ${endpoint}",
+           ("count", partial_block.missing_transactions.size())
+           ("total", partial_block.block.transactions.size())
+           ("block_id", block_id)
+           ("endpoint", originating_peer->get_remote_endpoint()));
+      originating_peer->send_message(fetch_block_transactions_message(block_id, partial_block.missing_transactions));
+      originating_peer->partial_compact_blocks[block_id] = std::move(partial_block);
+    }
+
+    void node_impl::on_fetch_block_transactions_message(peer_connection* originating_peer,
+                                                        const fetch_block_transactions_message& fetch_block_transactions_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const block_id_type& block_id = fetch_block_transactions_message_received.block_id;
+      block_transactions_message reply(block_id);
+
+      std::shared_ptr<const message> block_message_to_send = _message_cache.find_message_by_contents(block_message_type, block_id);
+      if (!block_message_to_send)
+      {
+        try
+        {
+          block_message_to_send = std::make_shared<message>(_delegate->get_item(item_id(block_message_type, block_id)));
+        }
+        catch (fc::key_not_found_exception&)
+        {
+        }
       }
+
+      if (block_message_to_send)
+      {
+        graphene::net::block_message block = block_message_to_send->as<graphene::net::block_message>();
+        for (uint32_t index : fetch_block_transactions_message_received.transaction_indexes)
+        {
+          if (index >= block.block.transactions.size())
+          {
+            reply.transactions.clear();
+            break;
+          }
+          reply.transactions.push_back(block.block.transactions[index]);
+        }
+      }
+      else
+        dlog("peer ${endpoint} requested transactions of block ${block_id}, but we don't have it",
+             ("endpoint", originating_peer->get_remote_endpoint())
+             ("block_id", block_id));
+      originating_peer->send_message(reply);
+    }
+
+    void node_impl::on_block_transactions_message(peer_connection* originating_peer,
+                                                  const block_transactions_message& block_transactions_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      auto partial_iter = originating_peer->partial_compact_blocks.find(block_transactions_message_received.block_id);
+      if (partial_iter == originating_peer->partial_compact_blocks.end())
+      {
+        dlog("received transactions of block ${block_id} that we weren't waiting for from peer ${endpoint}",
+             ("block_id", block_transactions_message_received.block_id)
+             ("endpoint", originating_peer->get_remote_endpoint()));
+        return;
+      }
+      peer_connection::partial_compact_block partial_block = std::move(partial_iter->second);
+      originating_peer->partial_compact_blocks.erase(partial_iter);
+
+      if (block_transactions_message_received.transactions.size() != partial_block.missing_transactions.size())
+      {
+        // the request for the block itself stays outstanding, and will time out like any other
+        wlog("peer ${endpoint} couldn't send us the transactions of compact block ${block_id}",
+             ("endpoint", originating_peer->get_remote_endpoint())
+             ("block_id", block_transactions_message_received.block_id));
+        return;
+      }
+      for (uint32_t i = 0; i < partial_block.missing_transactions.size(); ++i)
+        partial_block.block.transactions[partial_block.missing_transactions[i]] = block_transactions_message_received.transactions[i];
+
+      if (partial_block.block.calculate_merkle_root() != partial_block.block.transaction_merkle_root)
+      {
+        wlog("the transactions of compact block ${block_id} from peer ${endpoint} don't match its merkle root, disconnecting from peer",
+             ("endpoint", originating_peer->get_remote_endpoint())
+             ("block_id", block_transactions_message_received.block_id));
+        fc::exception detailed_error(FC_LOG_MESSAGE(error, "You sent me transactions that don't match the merkle root of block ${block_id}",
+                                                    ("block_id", block_transactions_message_received.block_id)));
+        disconnect_from_peer(originating_peer, "You sent me transactions that don't match the block's merkle root", true, detailed_error);
+        return;
+      }
+      process_reconstructed_compact_block(originating_peer, partial_block.block);
+    }
+
+    void node_impl::process_reconstructed_compact_block(peer_connection* originating_peer, const signed_block& block)
+    {
+      VERIFY_CORRECT_THREAD();
+      // the block is the one the peer packed, so the message hashes to the item we requested
+      message block_message_to_process = graphene::net::block_message(block);
+      process_block_message(originating_peer, block_message_to_process, block_message_to_process.id());
     }
 
     void node_impl::on_item_not_available_message( peer_connection* originating_peer, const item_not_available_message& item_not_available_message_received )
@@ -2793,6 +3502,7 @@ namespace graphene { namespace net { namespace detail {
       auto regular_item_iter = originating_peer->items_requested_from_peer.find(requested_item);
       if (regular_item_iter != originating_peer->items_requested_from_peer.end())
       {
+        originating_peer->record_requested_item_not_available();
         originating_peer->items_requested_from_peer.erase( regular_item_iter );
         originating_peer->inventory_peer_advertised_to_us.erase( requested_item );
         if (is_item_in_any_peers_inventory(requested_item))
@@ -2805,6 +3515,7 @@ namespace graphene { namespace net { namespace detail {
       auto sync_item_iter = originating_peer->sync_items_requested_from_peer.find(requested_item);
       if (sync_item_iter != originating_peer->sync_items_requested_from_peer.end())
       {
+        originating_peer->record_requested_item_not_available();
         originating_peer->sync_items_requested_from_peer.erase(sync_item_iter);
 
         if (originating_peer->peer_needs_sync_items_from_us)
@@ -3223,58 +3934,57 @@ namespace graphene { namespace net { namespace detail {
 
       do
       {
-        std::copy(std::make_move_iterator(_new_received_sync_items.begin()),
-                  std::make_move_iterator(_new_received_sync_items.end()),
-                  std::front_inserter(_received_sync_items));
-        _new_received_sync_items.clear();
         dlog("currently ${count} sync items to consider", ("count", _received_sync_items.size()));
 
         block_processed_this_iteration = false;
-        for (auto received_block_iter = _received_sync_items.begin();
-             received_block_iter != _received_sync_items.end();
-             ++received_block_iter)
+
+        // the next block on the active chain or one of the forks is the first one some peer has yet to give us
+        auto received_block_iter = _received_sync_items.end();
+        for (const peer_connection_ptr& peer : _active_connections)
         {
+          ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
+          if (!peer->ids_of_items_to_get.empty())
+          {
+            received_block_iter = _received_sync_items.find(peer->ids_of_items_to_get.front());
+            if (received_block_iter != _received_sync_items.end())
+              break;
+          }
+        }
 
-          // find out if this block is the next block on the active chain or one of the forks
-          bool potential_first_block = false;
+        // if there is one, process it, remove it from all sync peers lists
+        if (received_block_iter != _received_sync_items.end())
+        {
+          graphene::net::block_message block_message_to_process = std::move(received_block_iter->second);
+          _received_sync_items.erase(received_block_iter);
           for (const peer_connection_ptr& peer : _active_connections)
           {
             ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
             if (!peer->ids_of_items_to_get.empty() &&
-                peer->ids_of_items_to_get.front() == received_block_iter->block_id)
+                peer->ids_of_items_to_get.front() == block_message_to_process.block_id)
             {
-              potential_first_block = true;
               peer->ids_of_items_to_get.pop_front();
-              peer->ids_of_items_being_processed.insert(received_block_iter->block_id);
+              peer->ids_of_items_being_processed.insert(block_message_to_process.block_id);
             }
           }
 
-          // if it is, process it, remove it from all sync peers lists
-          if (potential_first_block)
+          // we can get into an interesting situation near the end of synchronization.  We can be in
+          // sync with one peer who is sending us the last block on the chain via a regular inventory
+          // message, while at the same time still be synchronizing with a peer who is sending us the
+          // block through the sync mechanism.  Further, we must request both blocks because
+          // we don't know they're the same (for the peer in normal operation, it has only told us the
+          // message id, for the peer in the sync case we only known the block_id).
+          if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
+                        block_message_to_process.block_id) == _most_recent_blocks_accepted.end())
           {
-            // we can get into an interesting situation near the end of synchronization.  We can be in
-            // sync with one peer who is sending us the last block on the chain via a regular inventory
-            // message, while at the same time still be synchronizing with a peer who is sending us the
-            // block through the sync mechanism.  Further, we must request both blocks because
-            // we don't know they're the same (for the peer in normal operation, it has only told us the
-            // message id, for the peer in the sync case we only known the block_id).
-            if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
-                          received_block_iter->block_id) == _most_recent_blocks_accepted.end())
-            {
-              graphene::net::block_message block_message_to_process = *received_block_iter;
-              _received_sync_items.erase(received_block_iter);
-              _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){
-                send_sync_block_to_node_delegate(block_message_to_process);
-              }, "send_sync_block_to_node_delegate"));
-              ++blocks_processed;
-              block_processed_this_iteration = true;
-            }
-            else
-              dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
-
-            break; // start iterating _received_sync_items from the beginning
-          } // end if potential_first_block
-        } // end for each block in _received_sync_items
+            _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){
+              send_sync_block_to_node_delegate(block_message_to_process);
+            }, "send_sync_block_to_node_delegate"));
+            ++blocks_processed;
+            block_processed_this_iteration = true;
+          }
+          else
+            dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
+        }
 
         if (_handle_message_calls_in_progress.size() >= _maximum_number_of_blocks_to_handle_at_one_time)
         {
@@ -3307,9 +4017,10 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint() ) );
 
-      // add it to the front of _received_sync_items, then process _received_sync_items to try to
+      // add it to _received_sync_items, then process _received_sync_items to try to
       // pass as many messages as possible to the client.
-      _new_received_sync_items.push_front( block_message_to_process );
+      _received_sync_items.emplace( block_message_to_process.block_id, block_message_to_process );
+      _delegate->sync_block_received( block_message_to_process );
       trigger_process_backlog_of_sync_blocks();
     }
 
@@ -3388,7 +4099,9 @@ namespace graphene { namespace net { namespace detail {
           peer->clear_old_inventory();
         }
         message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
+        fc::time_point broadcast_start = fc::time_point::now();
         broadcast( block_message_to_process, propagation_data );
+        _delegate->block_broadcast( block_message_to_process, message_receive_time, broadcast_start );
         _message_cache.block_accepted();
 
         if (is_hard_fork_block(block_number))
@@ -3462,16 +4175,25 @@ namespace graphene { namespace net { namespace detail {
     void node_impl::process_block_message(peer_connection* originating_peer,
                                           const message& message_to_process,
                                           const message_hash_type& message_hash)
+    {
+      VERIFY_CORRECT_THREAD();
+      process_block_message(originating_peer, message_to_process.as<graphene::net::block_message>(), message_hash, message_to_process.size);
+    }
+
+    void node_impl::process_block_message(peer_connection* originating_peer,
+                                          const graphene::net::block_message& block_message_to_process,
+                                          const message_hash_type& message_hash,
+                                          size_t message_size)
     {
       VERIFY_CORRECT_THREAD();
       // find out whether we requested this item while we were synchronizing or during normal operation
       // (it's possible that we request an item during normal operation and then get kicked into sync
       // mode before we receive and process the item.  In that case, we should process the item as a normal
       // item to avoid confusing the sync code)
-      graphene::net::block_message block_message_to_process(message_to_process.as<graphene::net::block_message>());
       auto item_iter = originating_peer->items_requested_from_peer.find(item_id(graphene::net::block_message_type, message_hash));
       if (item_iter != originating_peer->items_requested_from_peer.end())
       {
+        originating_peer->record_requested_item_received(item_iter->second, message_size);
         originating_peer->items_requested_from_peer.erase(item_iter);
         process_block_during_normal_operation(originating_peer, block_message_to_process, message_hash);
         if (originating_peer->idle())
@@ -3485,6 +4207,7 @@ namespace graphene { namespace net { namespace detail {
                                                                                             block_message_to_process.block_id));
         if (sync_item_iter != originating_peer->sync_items_requested_from_peer.end())
         {
+          originating_peer->record_requested_item_received(sync_item_iter->second, message_size);
           originating_peer->sync_items_requested_from_peer.erase(sync_item_iter);
           _active_sync_requests.erase(block_message_to_process.block_id);
           process_block_during_sync(originating_peer, block_message_to_process, message_hash);
@@ -3502,6 +4225,13 @@ namespace graphene { namespace net { namespace detail {
         }
       }
 
+      if (_accept_pushed_items)
+      {
+        if (accept_pushed_item(originating_peer, item_id(graphene::net::block_message_type, message_hash)))
+          process_block_during_normal_operation(originating_peer, block_message_to_process, message_hash);
+        return;
+      }
+
       // if we get here, we didn't request the message, we must have a misbehaving peer
       wlog("received a block ${block_id} I didn't ask for from peer ${endpoint}, disconnecting from peer",
            ("endpoint", originating_peer->get_remote_endpoint())
@@ -3780,14 +4510,23 @@ namespace graphene { namespace net { namespace detail {
     // this just passes the message to the client, and does the bookkeeping
     // related to requesting and rebroadcasting the message.
     void node_impl::process_ordinary_message( peer_connection* originating_peer,
-                                              const message& message_to_process, const message_hash_type& message_hash )
+                                              const message& message_to_process, const message_hash_type& message_hash,
+                                              const trx_message* decoded_transaction )
     {
       VERIFY_CORRECT_THREAD();
       fc::time_point message_receive_time = fc::time_point::now();
 
-      // only process it if we asked for it
-      auto iter = originating_peer->items_requested_from_peer.find( item_id(message_to_process.msg_type, message_hash) );
-      if( iter == originating_peer->items_requested_from_peer.end() )
+      // only process it if we asked for it, or if we accept pushed items
+      item_id item_received(message_to_process.msg_type, message_hash);
+      auto iter = originating_peer->items_requested_from_peer.find( item_received );
+      if( iter != originating_peer->items_requested_from_peer.end() )
+      {
+        originating_peer->record_requested_item_received(iter->second, message_to_process.size);
+        originating_peer->items_requested_from_peer.erase( iter );
+        if (originating_peer->idle())
+          trigger_fetch_items_loop();
+      }
+      else if( !_accept_pushed_items )
       {
         wlog( "received a message I didn't ask for from peer ${endpoint}, disconnecting from peer",
              ( "endpoint", originating_peer->get_remote_endpoint() ) );
@@ -3796,42 +4535,90 @@ namespace graphene { namespace net { namespace detail {
         disconnect_from_peer( originating_peer, "You sent me a message that I didn't request", true, detailed_error );
         return;
       }
-      else
+      else if( !accept_pushed_item( originating_peer, item_received ) )
+        return;
+
+      // a peer that has used up its time for validating transactions is ignored until it has some again, without
+      // marking the transaction failed, so we still take it from the other peers
+      if( message_to_process.msg_type == trx_message_type && !originating_peer->has_transaction_validation_budget() )
       {
-        originating_peer->items_requested_from_peer.erase( iter );
-        if (originating_peer->idle())
-          trigger_fetch_items_loop();
+        dlog( "dropping transaction ${hash} from peer ${endpoint}, it has used up its validation budget",
+              ( "hash", message_hash )( "endpoint", originating_peer->get_remote_endpoint() ) );
+        return;
+      }
 
-        // Next: have the delegate process the message
-        fc::time_point message_validated_time;
-        try
+      // Next: have the delegate process the message
+      fc::time_point message_validated_time;
+      // a transaction's peer is only charged the time the delegate spent on it, not the time it waited for the
+      // delegate thread behind everything else
+      fc::microseconds validation_time;
+      fc::optional<item_hash_t> transaction_id;
+      try
+      {
+        if (message_to_process.msg_type == trx_message_type)
         {
-          if (message_to_process.msg_type == trx_message_type)
+          fc::optional<trx_message> unpacked_transaction;
+          if (!decoded_transaction)
           {
-            trx_message transaction_message_to_process = message_to_process.as<trx_message>();
-            dlog("passing message containing transaction ${trx} to client", ("trx", transaction_message_to_process.trx.id()));
-            _delegate->handle_transaction(transaction_message_to_process);
+            unpacked_transaction = message_to_process.as<trx_message>();
+            decoded_transaction = &*unpacked_transaction;
           }
-          else
-            _delegate->handle_message( message_to_process );
-          message_validated_time = fc::time_point::now();
+          transaction_id = decoded_transaction->trx.id();
+          dlog("passing message containing transaction ${trx} to client", ("trx", *transaction_id));
+          _delegate->handle_transaction(*decoded_transaction, validation_time);
         }
-        catch ( const fc::canceled_exception& )
+        else
+          _delegate->handle_message( message_to_process );
+        message_validated_time = fc::time_point::now();
+      }
+      catch ( const fc::canceled_exception& )
+      {
+        throw;
+      }
+      catch ( const fc::exception& e )
+      {
+        wlog( "client rejected message sent by peer ${peer}, ${e}", ("peer", originating_peer->get_remote_endpoint() )("e", e) );
+        // record it so we don't try to fetch this item again
+        _recently_failed_items.insert(peer_connection::timestamped_item_id(item_id(message_to_process.msg_type, message_hash ), fc::time_point::now()));
+        if( message_to_process.msg_type != trx_message_type )
+          return;
+        // a transaction we already have, say one just included in a block, is no fault of the peer's: it is charged
+        // the time it cost without the penalty and isn't counted as rejected
+        bool already_known = false;
+        if( transaction_id )
         {
-          throw;
+          try
+          {
+            already_known = _delegate->has_item( item_id( trx_message_type, *transaction_id ) );
+          }
+          catch ( const fc::canceled_exception& )
+          {
+            throw;
+          }
+          catch ( const fc::exception& )
+          {
+          }
         }
-        catch ( const fc::exception& e )
+        if( already_known )
+          originating_peer->charge_transaction_validation_time( validation_time );
+        else if( originating_peer->charge_transaction_validation( validation_time, true ) )
         {
-          wlog( "client rejected message sent by peer ${peer}, ${e}", ("peer", originating_peer->get_remote_endpoint() )("e", e) );
-          // record it so we don't try to fetch this item again
-          _recently_failed_items.insert(peer_connection::timestamped_item_id(item_id(message_to_process.msg_type, message_hash ), fc::time_point::now()));
-          return;
+          wlog( "disconnecting from peer ${peer}, it sent ${rejected} transactions we rejected and ${accepted} we accepted lately",
+                ( "peer", originating_peer->get_remote_endpoint() )
+                ( "rejected", originating_peer->transactions_rejected_in_window )
+                ( "accepted", originating_peer->transactions_accepted_in_window ) );
+          fc::exception detailed_error( FC_LOG_MESSAGE(error, "You sent me too many invalid transactions, the last one: ${e}",
+                                                      ( "e", e.to_string() ) ) );
+          disconnect_from_peer( originating_peer, "You sent me too many invalid transactions", true, detailed_error );
         }
-
-        // finally, if the delegate validated the message, broadcast it to our other peers
-        message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
-        broadcast( message_to_process, propagation_data );
+        return;
       }
+      if( message_to_process.msg_type == trx_message_type )
+        originating_peer->charge_transaction_validation( validation_time, false );
+
+      // finally, if the delegate validated the message, broadcast it to our other peers
+      message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
+      broadcast( message_to_process, propagation_data );
     }
 
     void node_impl::start_synchronizing_with_peer( const peer_connection_ptr& peer )
@@ -4129,6 +4916,21 @@ namespace graphene { namespace net { namespace detail {
         wlog( "Exception thrown while terminating Fetch updated peer lists loop, ignoring" );
       }
 
+      try
+      {
+        if (_merge_peer_addresses_done.valid())
+          _merge_peer_addresses_done.cancel_and_wait("node_impl::close()");
+        dlog("Merge peer addresses task terminated");
+      }
+      catch ( const fc::exception& e )
+      {
+        wlog( "Exception thrown while terminating Merge peer addresses task, ignoring: ${e}", ("e", e) );
+      }
+      catch (...)
+      {
+        wlog( "Exception thrown while terminating Merge peer addresses task, ignoring" );
+      }
+
       try
       {
         _bandwidth_monitor_loop_done.cancel_and_wait("node_impl::close()");
@@ -4410,7 +5212,8 @@ namespace graphene { namespace net { namespace detail {
       fc::path potential_peer_database_file_name(_node_configuration_directory / POTENTIAL_PEER_DATABASE_FILENAME);
       try
       {
-        _potential_peer_db.open(potential_peer_database_file_name);
+        _potential_peer_db.open(potential_peer_database_file_name,
+                                _node_configuration_directory / LEGACY_POTENTIAL_PEER_DATABASE_FILENAME);
 
         // push back the time on all peers loaded from the database so we will be able to retry them immediately
         for (peer_database::iterator itr = _potential_peer_db.begin(); itr != _potential_peer_db.end(); ++itr)
@@ -4541,12 +5344,13 @@ namespace graphene { namespace net { namespace detail {
              !_dump_node_status_task_done.valid());
       if (_node_configuration.accept_incoming_connections)
         _accept_loop_complete = fc::async( [=](){ accept_loop(); }, "accept_loop");
-      _p2p_network_connect_loop_done = fc::async( [=]() { p2p_network_connect_loop(); }, "p2p_network_connect_loop" );
+      // finding and connecting to peers can wait for the blocks and transactions
+      _p2p_network_connect_loop_done = fc::async( [=]() { p2p_network_connect_loop(); }, "p2p_network_connect_loop", fc::priority::min() );
       _fetch_sync_items_loop_done = fc::async( [=]() { fetch_sync_items_loop(); }, "fetch_sync_items_loop" );
       _fetch_item_loop_done = fc::async( [=]() { fetch_items_loop(); }, "fetch_items_loop" );
       _advertise_inventory_loop_done = fc::async( [=]() { advertise_inventory_loop(); }, "advertise_inventory_loop" );
       _terminate_inactive_connections_loop_done = fc::async( [=]() { terminate_inactive_connections_loop(); }, "terminate_inactive_connections_loop" );
-      _fetch_updated_peer_lists_loop_done = fc::async([=](){ fetch_updated_peer_lists_loop(); }, "fetch_updated_peer_lists_loop");
+      _fetch_updated_peer_lists_loop_done = fc::async([=](){ fetch_updated_peer_lists_loop(); }, "fetch_updated_peer_lists_loop", fc::priority::min());
       _bandwidth_monitor_loop_done = fc::async([=](){ bandwidth_monitor_loop(); }, "bandwidth_monitor_loop");
       _dump_node_status_task_done = fc::async([=](){ dump_node_status_task(); }, "dump_node_status_task");
     }
@@ -4584,7 +5388,7 @@ namespace graphene { namespace net { namespace detail {
         if (!new_peer)
           return;
         connect_to_task(new_peer, *new_peer->get_remote_endpoint());
-      }, "connect_to_task");
+      }, "connect_to_task", fc::priority::min());
     }
 
     void node_impl::connect_to_endpoint(const fc::ip::endpoint& remote_endpoint)
@@ -4678,7 +5482,6 @@ namespace graphene { namespace net { namespace detail {
       ilog( "--------- MEMORY USAGE ------------" );
       ilog( "node._active_sync_requests size: ${size}", ("size", _active_sync_requests.size() ) );
       ilog( "node._received_sync_items size: ${size}", ("size", _received_sync_items.size() ) );
-      ilog( "node._new_received_sync_items size: ${size}", ("size", _new_received_sync_items.size() ) );
       ilog( "node._items_to_fetch size: ${size}", ("size", _items_to_fetch.size() ) );
       ilog( "node._new_inventory size: ${size}", ("size", _new_inventory.size() ) );
       ilog( "node._message_cache size: ${size}", ("size", _message_cache.size() ) );
@@ -4807,6 +5610,11 @@ namespace graphene { namespace net { namespace detail {
         peer_details["startingheight"] = "";
         peer_details["banscore"] = "";
         peer_details["syncnode"] = "";
+        peer_details["request_score"] = peer->get_request_score();
+        peer_details["round_trip_delay_ms"] = peer->round_trip_delay.count() / 1000;
+        peer_details["average_item_delay_ms"] = peer->average_item_delay.count() / 1000;
+        peer_details["average_bytes_per_second"] = uint64_t(peer->average_bytes_per_second);
+        peer_details["request_failure_rate"] = peer->request_failure_rate;
 
         if (peer->fc_git_revision_sha)
         {
@@ -4924,8 +5732,35 @@ namespace graphene { namespace net { namespace detail {
         _maximum_number_of_sync_blocks_to_prefetch = params["maximum_number_of_sync_blocks_to_prefetch"].as<uint32_t>();
       if (params.contains("maximum_blocks_per_peer_during_syncing"))
         _maximum_blocks_per_peer_during_syncing = params["maximum_blocks_per_peer_during_syncing"].as<uint32_t>();
+      if (params.contains("push_items"))
+        _push_items = params["push_items"].as<bool>();
+      if (params.contains("accept_pushed_items"))
+        _accept_pushed_items = params["accept_pushed_items"].as<bool>();
+      if (params.contains("pushed_items_per_second"))
+        _pushed_items_per_second = params["pushed_items_per_second"].as<uint32_t>();
+      if (params.contains("message_cache_max_bytes"))
+        _message_cache.set_max_size_in_bytes(params["message_cache_max_bytes"].as<uint64_t>());
+      if (params.contains("relay_batch_window_ms"))
+        _relay_batch_window = fc::milliseconds(params["relay_batch_window_ms"].as<uint32_t>());
+      if (params.contains("adaptive_connections"))
+        _adaptive_connections = params["adaptive_connections"].as<bool>();
+      if (params.contains("load_high_percent"))
+        _load_high_percent = params["load_high_percent"].as<uint32_t>();
+      if (params.contains("load_low_percent"))
+        _load_low_percent = params["load_low_percent"].as<uint32_t>();
+      if (params.contains("message_decode_threads"))
+      {
+        uint32_t thread_count = params["message_decode_threads"].as<uint32_t>();
+        while (_message_decode_threads.size() > thread_count)
+          _message_decode_threads.pop_back();
+        while (_message_decode_threads.size() < thread_count)
+          _message_decode_threads.emplace_back(new fc::thread("p2p decode " + std::to_string(_message_decode_threads.size())));
+      }
 
       _desired_number_of_connections = std::min(_desired_number_of_connections, _maximum_number_of_connections);
+      _load_low_percent = std::min(_load_low_percent, _load_high_percent);
+      if (!_adaptive_connections)
+        _load_connection_limit = _maximum_number_of_connections;
 
       while (_active_connections.size() > _maximum_number_of_connections)
         disconnect_from_peer(_active_connections.begin()->get(),
@@ -4943,6 +5778,16 @@ namespace graphene { namespace net { namespace detail {
       result["maximum_number_of_blocks_to_handle_at_one_time"] = _maximum_number_of_blocks_to_handle_at_one_time;
       result["maximum_number_of_sync_blocks_to_prefetch"] = _maximum_number_of_sync_blocks_to_prefetch;
       result["maximum_blocks_per_peer_during_syncing"] = _maximum_blocks_per_peer_during_syncing;
+      result["push_items"] = _push_items;
+      result["accept_pushed_items"] = _accept_pushed_items;
+      result["pushed_items_per_second"] = _pushed_items_per_second;
+      result["message_cache_max_bytes"] = (uint64_t)_message_cache.get_max_size_in_bytes();
+      result["relay_batch_window_ms"] = _relay_batch_window.count() / 1000;
+      result["message_decode_threads"] = (uint32_t)_message_decode_threads.size();
+      result["adaptive_connections"] = _adaptive_connections;
+      result["load_high_percent"] = _load_high_percent;
+      result["load_low_percent"] = _load_low_percent;
+      result["load_connection_limit"] = _load_connection_limit;
       return result;
     }
 
@@ -5011,6 +5856,7 @@ namespace graphene { namespace net { namespace detail {
       info["node_public_key"] = _node_public_key;
       info["node_id"] = _node_id;
       info["firewalled"] = _is_firewalled;
+      info["message_cache"] = _message_cache.get_statistics();
       return info;
     }
     fc::variant_object node_impl::network_get_usage_stats() const
@@ -5044,6 +5890,70 @@ namespace graphene { namespace net { namespace detail {
       return result;
     }
 
+    static std::string message_type_name(uint32_t msg_type)
+    {
+      switch (msg_type)
+      {
+#define MESSAGE_TYPE_NAME(r, data, type) case core_message_type_enum::type: return BOOST_PP_STRINGIZE(type);
+      BOOST_PP_SEQ_FOR_EACH(MESSAGE_TYPE_NAME, unused,
+                            (trx_message_type)(block_message_type)(item_ids_inventory_message_type)
+                            (blockchain_item_ids_inventory_message_type)(fetch_blockchain_item_ids_message_type)
+                            (fetch_items_message_type)(item_not_available_message_type)(hello_message_type)
+                            (connection_accepted_message_type)(connection_rejected_message_type)
+                            (address_request_message_type)(address_message_type)(closing_connection_message_type)
+                            (current_time_request_message_type)(current_time_reply_message_type)
+                            (check_firewall_message_type)(check_firewall_reply_message_type)
+                            (get_current_connections_request_message_type)(get_current_connections_reply_message_type)
+                            (compact_block_message_type)(fetch_block_transactions_message_type)
+                            (block_transactions_message_type)(trx_batch_message_type))
+#undef MESSAGE_TYPE_NAME
+      case peer_connection::other_message_types:
+        return "other";
+      default:
+        return std::to_string(msg_type);
+      }
+    }
+
+    static void add_traffic_by_name(traffic_by_message_type& result, const std::map<uint32_t, traffic_counter>& counters)
+    {
+      for (const auto& counter : counters)
+        result[message_type_name(counter.first)] += counter.second;
+    }
+
+    traffic_statistics node_impl::get_traffic_statistics() const
+    {
+      VERIFY_CORRECT_THREAD();
+      traffic_statistics result;
+      add_traffic_by_name(result.received, _traffic_received_from_deleted_peers);
+      add_traffic_by_name(result.sent, _traffic_sent_to_deleted_peers);
+      // the ones being deleted are in neither list, for a moment they are missing from the totals
+      std::vector<peer_connection_ptr> peers;
+      peers.insert(peers.end(), _handshaking_connections.begin(), _handshaking_connections.end());
+      peers.insert(peers.end(), _active_connections.begin(), _active_connections.end());
+      peers.insert(peers.end(), _closing_connections.begin(), _closing_connections.end());
+      peers.insert(peers.end(), _terminating_connections.begin(), _terminating_connections.end());
+      for (const peer_connection_ptr& peer : peers)
+      {
+        add_traffic_by_name(result.received, peer->traffic_received);
+        add_traffic_by_name(result.sent, peer->traffic_sent);
+        if (_active_connections.find(peer) == _active_connections.end())
+          continue;
+        peer_traffic traffic;
+        traffic.endpoint = peer->get_remote_endpoint();
+        traffic.node_id = peer->node_id;
+        add_traffic_by_name(traffic.received, peer->traffic_received);
+        add_traffic_by_name(traffic.sent, peer->traffic_sent);
+        result.peers.push_back(std::move(traffic));
+      }
+      result.read_by_second.assign(_average_network_read_speed_seconds.begin(), _average_network_read_speed_seconds.end());
+      result.written_by_second.assign(_average_network_write_speed_seconds.begin(), _average_network_write_speed_seconds.end());
+      result.read_by_minute.assign(_average_network_read_speed_minutes.begin(), _average_network_read_speed_minutes.end());
+      result.written_by_minute.assign(_average_network_write_speed_minutes.begin(), _average_network_write_speed_minutes.end());
+      result.read_by_hour.assign(_average_network_read_speed_hours.begin(), _average_network_read_speed_hours.end());
+      result.written_by_hour.assign(_average_network_write_speed_hours.begin(), _average_network_write_speed_hours.end());
+      return result;
+    }
+
     bool node_impl::is_hard_fork_block(uint32_t block_number) const
     {
       return std::binary_search(_hard_fork_block_numbers.begin(), _hard_fork_block_numbers.end(), block_number);
@@ -5145,6 +6055,16 @@ namespace graphene { namespace net { namespace detail {
     INVOKE_IN_IMPL(broadcast, msg);
   }
 
+  void node::broadcast_without_waiting( const message& msg )
+  {
+#ifdef P2P_IN_DEDICATED_THREAD
+    detail::node_impl* impl = my.get();
+    impl->_thread->async([impl, msg](){ impl->broadcast(msg); }, "thread invoke for method broadcast_without_waiting");
+#else
+    my->broadcast(msg);
+#endif
+  }
+
   void node::sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers)
   {
     INVOKE_IN_IMPL(sync_from, current_head_block, hard_fork_block_numbers);
@@ -5221,6 +6141,11 @@ namespace graphene { namespace net { namespace detail {
     INVOKE_IN_IMPL(network_get_usage_stats);
   }
 
+  traffic_statistics node::get_traffic_statistics() const
+  {
+    INVOKE_IN_IMPL(get_traffic_statistics);
+  }
+
   void node::close()
   {
     INVOKE_IN_IMPL(close);
@@ -5299,11 +6224,22 @@ namespace graphene { namespace net { namespace detail {
     {}
 #undef INITIALIZE_ACCUMULATOR
 
+    fc::variant_object statistics_gathering_node_delegate_wrapper::latency_histogram::get_counts() const
+    {
+      fc::mutable_variant_object counts;
+      for (uint32_t bucket = 0; bucket < buckets.size(); ++bucket)
+        if (buckets[bucket] != 0)
+          counts[bucket + 1 < buckets.size() ? "under_" + std::to_string(uint64_t(1) << bucket)
+                                             : "at_least_" + std::to_string(uint64_t(1) << (bucket - 1))] = buckets[bucket];
+      return counts;
+    }
+
     fc::variant_object statistics_gathering_node_delegate_wrapper::get_call_statistics()
     {
       fc::mutable_variant_object statistics;
       std::ostringstream note;
-      note << "All times are in microseconds, mean is the average of the last " << ROLLING_WINDOW_SIZE << " call times";
+      note << "All times are in microseconds, mean is the average of the last " << ROLLING_WINDOW_SIZE << " call times, "
+              "the histograms count all the calls by the power of two their times are under";
       statistics["_note"] = note.str();
 
 #define ADD_STATISTICS_FOR_METHOD(r, data, method_name) \
@@ -5321,6 +6257,11 @@ namespace graphene { namespace net { namespace detail {
       BOOST_PP_CAT(method_name, _stats)["delay_after_max"] = boost::accumulators::max(BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_after_accumulator))); \
       BOOST_PP_CAT(method_name, _stats)["delay_after_sum"] = boost::accumulators::sum(BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_after_accumulator))); \
       BOOST_PP_CAT(method_name, _stats)["count"] = boost::accumulators::count(BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _execution_accumulator))); \
+      BOOST_PP_CAT(method_name, _stats)["histograms"] = fc::mutable_variant_object() \
+        ("delay_before", BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _latency_histograms)).delay_before.get_counts()) \
+        ("execution", BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _latency_histograms)).execution.get_counts()) \
+        ("delay_after", BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _latency_histograms)).delay_after.get_counts()) \
+        ("total", BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _latency_histograms)).total.get_counts()); \
       statistics[BOOST_PP_STRINGIZE(method_name)] = BOOST_PP_CAT(method_name, _stats);
 
       BOOST_PP_SEQ_FOR_EACH(ADD_STATISTICS_FOR_METHOD, unused, NODE_DELEGATE_METHOD_NAMES)
@@ -5338,7 +6279,9 @@ namespace graphene { namespace net { namespace detail {
       call_statistics_collector statistics_collector(#method_name, \
                                                      &_ ## method_name ## _execution_accumulator, \
                                                      &_ ## method_name ## _delay_before_accumulator, \
-                                                     &_ ## method_name ## _delay_after_accumulator); \
+                                                     &_ ## method_name ## _delay_after_accumulator, \
+                                                     &_ ## method_name ## _latency_histograms, \
+                                                     &_total_execution_time); \
       if (_thread->is_current()) \
       { \
         call_statistics_collector::actual_execution_measurement_helper helper(statistics_collector); \
@@ -5370,7 +6313,9 @@ namespace graphene { namespace net { namespace detail {
     call_statistics_collector statistics_collector(#method_name, \
                                                    &_ ## method_name ## _execution_accumulator, \
                                                    &_ ## method_name ## _delay_before_accumulator, \
-                                                   &_ ## method_name ## _delay_after_accumulator); \
+                                                   &_ ## method_name ## _delay_after_accumulator, \
+                                                   &_ ## method_name ## _latency_histograms, \
+                                                   &_total_execution_time); \
     if (_thread->is_current()) \
     { \
       call_statistics_collector::actual_execution_measurement_helper helper(statistics_collector); \
@@ -5398,11 +6343,56 @@ namespace graphene { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(handle_block, block_message, sync_mode, contained_transaction_message_ids);
     }
 
+    void statistics_gathering_node_delegate_wrapper::sync_block_received( const graphene::net::block_message& block_message )
+    {
+      // this function doesn't need to block,
+      ASSERT_TASK_NOT_PREEMPTED();
+      _node_delegate->sync_block_received( block_message );
+    }
+
+    void statistics_gathering_node_delegate_wrapper::block_broadcast( const graphene::net::block_message& block_message,
+                                                                      fc::time_point received,
+                                                                      fc::time_point broadcast_start )
+    {
+      // this function doesn't need to block,
+      ASSERT_TASK_NOT_PREEMPTED();
+      _node_delegate->block_broadcast( block_message, received, broadcast_start );
+    }
+
     void statistics_gathering_node_delegate_wrapper::handle_transaction( const graphene::net::trx_message& transaction_message )
     {
       INVOKE_AND_COLLECT_STATISTICS(handle_transaction, transaction_message);
     }
 
+    void statistics_gathering_node_delegate_wrapper::handle_transaction( const graphene::net::trx_message& transaction_message,
+                                                                         fc::microseconds& execution_time )
+    {
+      // destroyed before the collector, once the measurement helper has recorded when the execution completed
+      struct execution_time_reporter
+      {
+        const call_statistics_collector& collector;
+        fc::microseconds& execution_time;
+        ~execution_time_reporter() { execution_time = collector.get_execution_time(); }
+      };
+      call_statistics_collector statistics_collector("handle_transaction",
+                                                     &_handle_transaction_execution_accumulator,
+                                                     &_handle_transaction_delay_before_accumulator,
+                                                     &_handle_transaction_delay_after_accumulator,
+                                                     &_handle_transaction_latency_histograms,
+                                                     &_total_execution_time);
+      execution_time_reporter reporter{ statistics_collector, execution_time };
+      if (_thread->is_current())
+      {
+        call_statistics_collector::actual_execution_measurement_helper helper(statistics_collector);
+        _node_delegate->handle_transaction(transaction_message);
+      }
+      else
+        _thread->async([&](){
+          call_statistics_collector::actual_execution_measurement_helper helper(statistics_collector);
+          _node_delegate->handle_transaction(transaction_message);
+        }, "invoke handle_transaction").wait();
+    }
+
     std::vector<item_hash_t> statistics_gathering_node_delegate_wrapper::get_block_ids(const std::vector<item_hash_t>& blockchain_synopsis,
                                                                                        uint32_t& remaining_item_count,
                                                                                        uint32_t limit /* = 2000 */)
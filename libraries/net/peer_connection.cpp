@@ -42,24 +42,29 @@
 
 namespace graphene { namespace net
   {
-    message peer_connection::real_queued_message::get_message(peer_connection_delegate*)
+    const uint32_t peer_connection::other_message_types;
+
+    std::shared_ptr<const message> peer_connection::real_queued_message::get_message(peer_connection_delegate*)
     {
       if (message_send_time_field_offset != (size_t)-1)
       {
         // patch the current time into the message.  Since this operates on the packed version of the structure,
-        // it won't work for anything after a variable-length field
+        // it won't work for anything after a variable-length field.  These are only ever small messages sent to
+        // a single peer, so patching a copy costs next to nothing
+        std::shared_ptr<message> patched_message = std::make_shared<message>(*message_to_send);
         std::vector<char> packed_current_time = fc::raw::pack(fc::time_point::now());
-        assert(message_send_time_field_offset + packed_current_time.size() <= message_to_send.data.size());
-        memcpy(message_to_send.data.data() + message_send_time_field_offset,
+        assert(message_send_time_field_offset + packed_current_time.size() <= patched_message->data.size());
+        memcpy(patched_message->data.data() + message_send_time_field_offset,
                packed_current_time.data(), packed_current_time.size());
+        return patched_message;
       }
       return message_to_send;
     }
     size_t peer_connection::real_queued_message::get_size_in_queue()
     {
-      return message_to_send.data.size();
+      return message_to_send->data.size();
     }
-    message peer_connection::virtual_queued_message::get_message(peer_connection_delegate* node)
+    std::shared_ptr<const message> peer_connection::virtual_queued_message::get_message(peer_connection_delegate* node)
     {
       return node->get_message_for_item(item_to_send);
     }
@@ -69,6 +74,57 @@ namespace graphene { namespace net
       return sizeof(item_id);
     }
 
+    peer_connection::message_priority peer_connection::get_message_priority(const message& message_to_send)
+    {
+      switch (message_to_send.msg_type)
+      {
+      case block_message_type:
+      case compact_block_message_type:
+      case block_transactions_message_type:
+        return block_priority;
+      case item_ids_inventory_message_type:
+      case fetch_items_message_type:
+      case item_not_available_message_type:
+        // these all start with the packed item type, which tells blocks from transactions
+        if (message_to_send.data.size() >= sizeof(uint32_t))
+        {
+          uint32_t item_type;
+          memcpy(&item_type, message_to_send.data.data(), sizeof(item_type));
+          return item_type == block_message_type ? block_inventory_priority : transaction_priority;
+        }
+        return other_priority;
+      case blockchain_item_ids_inventory_message_type:
+      case fetch_blockchain_item_ids_message_type:
+      case fetch_block_transactions_message_type:
+      case hello_message_type:
+      case connection_accepted_message_type:
+      case connection_rejected_message_type:
+      case closing_connection_message_type:
+      // the time messages measure the clock offset, they shouldn't wait behind anything but blocks
+      case current_time_request_message_type:
+      case current_time_reply_message_type:
+        return block_inventory_priority;
+      case trx_message_type:
+      case trx_batch_message_type:
+        return transaction_priority;
+      default:
+        return other_priority;
+      }
+    }
+
+    peer_connection::message_priority peer_connection::get_item_priority(uint32_t item_type)
+    {
+      switch (item_type)
+      {
+      case block_message_type:
+        return block_priority;
+      case trx_message_type:
+        return transaction_priority;
+      default:
+        return other_priority;
+      }
+    }
+
     peer_connection::peer_connection(peer_connection_delegate* delegate) :
       _node(delegate),
       _message_connection(this),
@@ -85,7 +141,18 @@ namespace graphene { namespace net
       we_need_sync_items_from_peer(true),
       inhibit_fetching_sync_blocks(false),
       transaction_fetching_inhibited_until(fc::time_point::min()),
+      transaction_validation_budget(GRAPHENE_NET_TRX_VALIDATION_BURST_US),
+      transaction_validation_budget_time(fc::time_point::now()),
+      transaction_counts_window_start(fc::time_point::now()),
+      transactions_accepted_in_window(0),
+      transactions_rejected_in_window(0),
       last_known_fork_block_number(0),
+      supports_compact_blocks(false),
+      supports_pushed_items(false),
+      pushed_item_allowance(0),
+      supports_transaction_batches(false),
+      average_bytes_per_second(0),
+      request_failure_rate(0),
       firewall_check_state(nullptr)
 #ifndef NDEBUG
       ,_thread(&fc::thread::current()),
@@ -265,6 +332,10 @@ namespace graphene { namespace net
     void peer_connection::on_message( message_oriented_connection* originating_connection, const message& received_message )
     {
       VERIFY_CORRECT_THREAD();
+      const uint32_t msg_type = received_message.msg_type;
+      const bool known_type = msg_type == trx_message_type || msg_type == block_message_type ||
+                              ( msg_type > core_message_type_first && msg_type <= trx_batch_message_type );
+      traffic_received[known_type ? msg_type : other_message_types].record(received_message);
       _node->on_message( this, received_message );
     }
 
@@ -275,6 +346,30 @@ namespace graphene { namespace net
       _node->on_connection_closed( this );
     }
 
+    std::unique_ptr<peer_connection::queued_message> peer_connection::pop_next_queued_message()
+    {
+      VERIFY_CORRECT_THREAD();
+      // the highest priority queue goes first, unless a lower priority one has been waiting too long,
+      // then whichever of the overdue messages is the oldest goes
+      fc::time_point overdue_threshold = fc::time_point::now() -
+                                         fc::milliseconds(GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGE_DELAY_MS);
+      message_queue* next_queue = nullptr;
+      for (message_queue& queue : _queued_messages)
+        if (!queue.empty())
+        {
+          if (!next_queue)
+            next_queue = &queue;
+          else if (queue.front()->enqueue_time < overdue_threshold &&
+                   queue.front()->enqueue_time < next_queue->front()->enqueue_time)
+            next_queue = &queue;
+        }
+      if (!next_queue)
+        return std::unique_ptr<queued_message>();
+      std::unique_ptr<queued_message> next_message = std::move(next_queue->front());
+      next_queue->pop();
+      return next_message;
+    }
+
     void peer_connection::send_queued_messages_task()
     {
       VERIFY_CORRECT_THREAD();
@@ -285,16 +380,18 @@ namespace graphene { namespace net
         ~counter() { assert(_send_message_queue_tasks_counter == 1); --_send_message_queue_tasks_counter; /* dlog("leaving peer_connection::send_queued_messages_task()"); */ }
       } concurrent_invocation_counter(_send_message_queue_tasks_running);
 #endif
-      while (!_queued_messages.empty())
+      // the message being sent is taken off its queue first, we may yield in send_message() and messages
+      // queued meanwhile can change which queue goes next
+      while (std::unique_ptr<queued_message> next_message = pop_next_queued_message())
       {
-        _queued_messages.front()->transmission_start_time = fc::time_point::now();
-        message message_to_send = _queued_messages.front()->get_message(_node);
+        next_message->transmission_start_time = fc::time_point::now();
+        std::shared_ptr<const message> message_to_send = next_message->get_message(_node);
         try
         {
           //dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_message() "
           //     "to send message of type ${type} for peer ${endpoint}",
           //     ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-          _message_connection.send_message(message_to_send);
+          _message_connection.send_message(*message_to_send);
           //dlog("peer_connection::send_queued_messages_task()'s call to message_oriented_connection::send_message() completed normally for peer ${endpoint}",
           //     ("endpoint", get_remote_endpoint()));
         }
@@ -324,9 +421,9 @@ namespace graphene { namespace net
         {
           elog("message_oriented_exception::send_message() threw an unhandled exception");
         }
-        _queued_messages.front()->transmission_finish_time = fc::time_point::now();
-        _total_queued_messages_size -= _queued_messages.front()->get_size_in_queue();
-        _queued_messages.pop();
+        next_message->transmission_finish_time = fc::time_point::now();
+        traffic_sent[message_to_send->msg_type].record(*message_to_send);
+        _total_queued_messages_size -= next_message->get_size_in_queue();
       }
       //dlog("leaving peer_connection::send_queued_messages_task() due to queue exhaustion");
     }
@@ -335,7 +432,8 @@ namespace graphene { namespace net
     {
       VERIFY_CORRECT_THREAD();
       _total_queued_messages_size += message_to_send->get_size_in_queue();
-      _queued_messages.emplace(std::move(message_to_send));
+      message_priority priority = message_to_send->get_priority();
+      _queued_messages[priority].emplace(std::move(message_to_send));
       if (_total_queued_messages_size > GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES)
       {
         elog("send queue exceeded maximum size of ${max} bytes (current size ${current} bytes)",
@@ -368,7 +466,15 @@ namespace graphene { namespace net
       VERIFY_CORRECT_THREAD();
       //dlog("peer_connection::send_message() enqueueing message of type ${type} for peer ${endpoint}",
       //     ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-      std::unique_ptr<queued_message> message_to_enqueue(new real_queued_message(message_to_send, message_send_time_field_offset));
+      std::unique_ptr<queued_message> message_to_enqueue(new real_queued_message(std::make_shared<message>(message_to_send),
+                                                                                 message_send_time_field_offset));
+      send_queueable_message(std::move(message_to_enqueue));
+    }
+
+    void peer_connection::send_shared_message(const std::shared_ptr<const message>& message_to_send)
+    {
+      VERIFY_CORRECT_THREAD();
+      std::unique_ptr<queued_message> message_to_enqueue(new real_queued_message(message_to_send));
       send_queueable_message(std::move(message_to_enqueue));
     }
 
@@ -456,6 +562,107 @@ namespace graphene { namespace net
       return transaction_fetching_inhibited_until > fc::time_point::now();
     }
 
+    bool peer_connection::has_transaction_validation_budget()
+    {
+      VERIFY_CORRECT_THREAD();
+      fc::time_point now = fc::time_point::now();
+      int64_t refill = (now - transaction_validation_budget_time).count() * GRAPHENE_NET_TRX_VALIDATION_BUDGET_PER_SECOND_US / 1000000;
+      if (refill > 0)
+      {
+        transaction_validation_budget = std::min<int64_t>(transaction_validation_budget + refill, GRAPHENE_NET_TRX_VALIDATION_BURST_US);
+        transaction_validation_budget_time = now;
+      }
+      if (transaction_validation_budget > 0)
+        return true;
+      // don't fetch any until the budget has refilled
+      transaction_fetching_inhibited_until = now + fc::microseconds((1 - transaction_validation_budget) * 1000000 /
+                                                                    GRAPHENE_NET_TRX_VALIDATION_BUDGET_PER_SECOND_US);
+      return false;
+    }
+
+    void peer_connection::charge_transaction_validation_time(fc::microseconds validation_time)
+    {
+      VERIFY_CORRECT_THREAD();
+      transaction_validation_budget -= validation_time.count();
+    }
+
+    bool peer_connection::charge_transaction_validation(fc::microseconds validation_time, bool rejected)
+    {
+      VERIFY_CORRECT_THREAD();
+      charge_transaction_validation_time(rejected ? fc::microseconds(validation_time.count() * GRAPHENE_NET_REJECTED_TRX_PENALTY)
+                                                  : validation_time);
+      fc::time_point now = fc::time_point::now();
+      if (now - transaction_counts_window_start > fc::seconds(GRAPHENE_NET_REJECTED_TRX_WINDOW_SEC))
+      {
+        transaction_counts_window_start = now;
+        transactions_accepted_in_window = 0;
+        transactions_rejected_in_window = 0;
+      }
+      if (rejected)
+        ++transactions_rejected_in_window;
+      else
+        ++transactions_accepted_in_window;
+      return transactions_rejected_in_window > GRAPHENE_NET_MIN_REJECTED_TRX_TO_DISCONNECT &&
+             transactions_rejected_in_window > transactions_accepted_in_window;
+    }
+
+    bool peer_connection::take_pushed_item_allowance(uint32_t items_per_second)
+    {
+      VERIFY_CORRECT_THREAD();
+      // the allowance time starts out at the epoch, so a new peer starts with a full allowance
+      fc::time_point now = fc::time_point::now();
+      const double burst = double(items_per_second) * GRAPHENE_NET_PUSHED_ITEMS_BURST_SECONDS;
+      pushed_item_allowance = std::min(burst, pushed_item_allowance +
+                                              (now - pushed_item_allowance_time).count() * double(items_per_second) / 1000000);
+      pushed_item_allowance_time = now;
+      if (pushed_item_allowance < 1)
+        return false;
+      pushed_item_allowance -= 1;
+      return true;
+    }
+
+    void peer_connection::record_requested_item_received(fc::time_point request_time, size_t item_size)
+    {
+      VERIFY_CORRECT_THREAD();
+      const double weight = 1.0 / GRAPHENE_NET_REQUEST_STATISTICS_SMOOTHING;
+      fc::time_point now = fc::time_point::now();
+      // the items of a pipelined request arrive one after another, each one only took the time since the one before it to transfer
+      fc::time_point transfer_start_time = std::max(request_time, last_requested_item_received_time);
+      double bytes_per_second = item_size * 1000000.0 / std::max<int64_t>((now - transfer_start_time).count(), 1000);
+      if (average_item_delay.count() == 0)
+      {
+        average_item_delay = now - request_time;
+        average_bytes_per_second = bytes_per_second;
+      }
+      else
+      {
+        average_item_delay = fc::microseconds(average_item_delay.count() + int64_t(((now - request_time).count() - average_item_delay.count()) * weight));
+        average_bytes_per_second += (bytes_per_second - average_bytes_per_second) * weight;
+      }
+      request_failure_rate -= request_failure_rate * weight;
+      last_requested_item_received_time = now;
+    }
+
+    void peer_connection::record_requested_item_not_available()
+    {
+      VERIFY_CORRECT_THREAD();
+      request_failure_rate += (1.0 - request_failure_rate) / GRAPHENE_NET_REQUEST_STATISTICS_SMOOTHING;
+    }
+
+    double peer_connection::get_request_score() const
+    {
+      VERIFY_CORRECT_THREAD();
+      // an item takes the round trip to request it plus the time to transfer it.  Until the time requests have measured the
+      // round trip we go by the items' delays, and a peer that hasn't sent us anything yet ranks as an unremarkable one
+      int64_t latency = round_trip_delay.count() > 0 ? round_trip_delay.count() :
+                        average_item_delay.count() > 0 ? average_item_delay.count() :
+                        GRAPHENE_NET_UNMEASURED_PEER_LATENCY_MS * 1000;
+      double seconds_per_item = latency / 1000000.0;
+      if (average_bytes_per_second > 0)
+        seconds_per_item += GRAPHENE_NET_REQUEST_SCORE_ITEM_SIZE / average_bytes_per_second;
+      return (1.0 - request_failure_rate) / std::max(seconds_per_item, 0.001);
+    }
+
     fc::sha512 peer_connection::get_shared_secret() const
     {
       VERIFY_CORRECT_THREAD();
@@ -32,9 +32,14 @@
 #include <fc/io/raw_variant.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/io/json.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <graphene/net/peer_database.hpp>
 
+#include <fstream>
+#include <mutex>
+
 
 
 namespace graphene { namespace net {
@@ -42,6 +47,41 @@ namespace graphene { namespace net {
   {
     using namespace boost::multi_index;
 
+#define MAXIMUM_PEERDB_SIZE 1000
+
+    namespace
+    {
+      const uint32_t peer_database_magic   = 0x73726570; // "pers"
+      const uint8_t  peer_database_version = 1;
+
+      struct peer_database_header
+      {
+        uint32_t magic = peer_database_magic;
+        uint8_t  version = peer_database_version;
+        uint8_t  reserved[3] = {0, 0, 0};
+      };
+      static_assert(sizeof(peer_database_header) == 8, "peer_database_header is written to disk as is");
+
+      /// the file is the header followed by entries, each one the 32-bit size of the rest of the entry, its type and its payload
+      enum peer_database_entry_type : uint8_t
+      {
+        update_entry_type = 0, ///< the payload is a potential_peer_record
+        erase_entry_type  = 1  ///< the payload is the fc::ip::endpoint to erase
+      };
+
+      template<typename T>
+      void append_entry(std::vector<char>& buffer, peer_database_entry_type type, const T& payload)
+      {
+        uint32_t entry_size = (uint32_t)fc::raw::pack_size(payload) + 1;
+        size_t entry_start = buffer.size();
+        buffer.resize(entry_start + sizeof(entry_size) + entry_size);
+        memcpy(buffer.data() + entry_start, &entry_size, sizeof(entry_size));
+        buffer[entry_start + sizeof(entry_size)] = (char)type;
+        fc::datastream<char*> ds(buffer.data() + entry_start + sizeof(entry_size) + 1, entry_size - 1);
+        fc::raw::pack(ds, payload);
+      }
+    }
+
     class peer_database_impl
     {
     public:
@@ -62,8 +102,29 @@ namespace graphene { namespace net {
       potential_peer_set     _potential_peer_set;
       fc::path _peer_database_filename;
 
+      /// changes are appended to the file on this thread, so the p2p thread never waits for the disk
+      std::unique_ptr<fc::thread> _write_thread;
+      fc::future<void>            _write_done;
+      std::fstream                _file;             ///< only used on the write thread once the database is open
+      /// @{ guarded by _pending_writes_mutex
+      std::mutex                  _pending_writes_mutex;
+      std::vector<char>           _pending_writes;   ///< entries to append to the file
+      fc::optional<std::vector<char> > _pending_rewrite; ///< compacted contents to replace the file with before appending
+      bool                        _write_scheduled = false;
+      /// @}
+      uint64_t                    _entries_in_file = 0; ///< including the ones still pending, to decide when to compact
+
+      void load(const fc::path& peer_database_filename);
+      void load_legacy_json(const fc::path& legacy_json_filename);
+      void queue_entry_write(std::vector<char>&& entry);
+      void queue_compaction();
+      void schedule_write();
+      void write_pending();
+
     public:
-      void open(const fc::path& databaseFilename);
+      ~peer_database_impl();
+
+      void open(const fc::path& databaseFilename, const fc::path& legacy_json_filename);
       void close();
       void clear();
       void erase(const fc::ip::endpoint& endpointToErase);
@@ -88,63 +149,239 @@ namespace graphene { namespace net {
     peer_database_iterator::peer_database_iterator( const peer_database_iterator& c ) :
       boost::iterator_facade<peer_database_iterator, const potential_peer_record, boost::forward_traversal_tag>(c){}
 
-    void peer_database_impl::open(const fc::path& peer_database_filename)
+    peer_database_impl::~peer_database_impl()
     {
-      _peer_database_filename = peer_database_filename;
-      if (fc::exists(_peer_database_filename))
+      if (_write_thread)
+        close();
+    }
+
+    void peer_database_impl::load(const fc::path& peer_database_filename)
+    {
+      std::vector<char> contents((size_t)fc::file_size(peer_database_filename));
       {
-        try
+        std::fstream file(peer_database_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in);
+        file.read(contents.data(), contents.size());
+        FC_ASSERT(file.gcount() == (std::streamsize)contents.size(), "error reading the file");
+      }
+      peer_database_header header;
+      FC_ASSERT(contents.size() >= sizeof(header), "the file is too short to be a peer database");
+      memcpy(&header, contents.data(), sizeof(header));
+      FC_ASSERT(header.magic == peer_database_magic, "the file is not a peer database");
+      FC_ASSERT(header.version == peer_database_version, "unknown peer database version ${v}", ("v", header.version));
+
+      size_t position = sizeof(header);
+      while (position + sizeof(uint32_t) < contents.size())
+      {
+        uint32_t entry_size;
+        memcpy(&entry_size, contents.data() + position, sizeof(entry_size));
+        if (entry_size == 0 || position + sizeof(entry_size) + entry_size > contents.size())
         {
-          std::vector<potential_peer_record> peer_records = fc::json::from_file(_peer_database_filename).as<std::vector<potential_peer_record> >();
-          std::copy(peer_records.begin(), peer_records.end(), std::inserter(_potential_peer_set, _potential_peer_set.end()));
-#define MAXIMUM_PEERDB_SIZE 1000
-          if (_potential_peer_set.size() > MAXIMUM_PEERDB_SIZE)
-          {
-            // prune database to a reasonable size
-            auto iter = _potential_peer_set.begin();
-            std::advance(iter, MAXIMUM_PEERDB_SIZE);
-            _potential_peer_set.erase(iter, _potential_peer_set.end());
-          }
+          // the last write didn't complete, the compaction after opening drops it
+          wlog("ignoring a truncated entry at the end of peer database ${file}", ("file", peer_database_filename));
+          break;
         }
-        catch (const fc::exception& e)
+        const char* entry = contents.data() + position + sizeof(entry_size);
+        fc::datastream<const char*> ds(entry + 1, entry_size - 1);
+        if (entry[0] == update_entry_type)
         {
-          elog("error opening peer database file ${peer_database_filename}, starting with a clean database", 
-               ("peer_database_filename", _peer_database_filename));
+          potential_peer_record record;
+          fc::raw::unpack(ds, record);
+          update_entry(record);
         }
+        else if (entry[0] == erase_entry_type)
+        {
+          fc::ip::endpoint endpoint;
+          fc::raw::unpack(ds, endpoint);
+          erase(endpoint);
+        }
+        else
+          FC_THROW("unknown peer database entry type ${t}", ("t", (uint32_t)(uint8_t)entry[0]));
+        position += sizeof(entry_size) + entry_size;
       }
     }
 
-    void peer_database_impl::close()
+    void peer_database_impl::load_legacy_json(const fc::path& legacy_json_filename)
     {
-      std::vector<potential_peer_record> peer_records;
-      peer_records.reserve(_potential_peer_set.size());
-      std::copy(_potential_peer_set.begin(), _potential_peer_set.end(), std::back_inserter(peer_records));
+      std::vector<potential_peer_record> peer_records = fc::json::from_file(legacy_json_filename).as<std::vector<potential_peer_record> >();
+      for (const potential_peer_record& record : peer_records)
+        update_entry(record);
+    }
+
+    void peer_database_impl::open(const fc::path& peer_database_filename, const fc::path& legacy_json_filename)
+    {
+      _peer_database_filename = peer_database_filename;
+      try
+      {
+        if (fc::exists(_peer_database_filename))
+          load(_peer_database_filename);
+        else if (!legacy_json_filename.generic_string().empty() && fc::exists(legacy_json_filename))
+          load_legacy_json(legacy_json_filename);
+      }
+      catch (const fc::exception& e)
+      {
+        elog("error opening peer database file ${peer_database_filename}, starting with a clean database: ${e}", 
+             ("peer_database_filename", _peer_database_filename)("e", e.to_detail_string()));
+        _potential_peer_set.clear();
+      }
+
+      if (_potential_peer_set.size() > MAXIMUM_PEERDB_SIZE)
+      {
+        // prune database to a reasonable size, keeping the peers we've seen most recently
+        auto& by_last_seen = _potential_peer_set.get<last_seen_time_index>();
+        auto iter = by_last_seen.begin();
+        std::advance(iter, _potential_peer_set.size() - MAXIMUM_PEERDB_SIZE);
+        by_last_seen.erase(by_last_seen.begin(), iter);
+      }
+
+      // start every session from a compacted file, which also drops anything we couldn't read
+      _write_thread.reset(new fc::thread("peer database"));
+      queue_compaction();
+      if (!legacy_json_filename.generic_string().empty() && fc::exists(legacy_json_filename))
+      {
+        _write_done.wait();
+        fc::remove(legacy_json_filename);
+      }
+    }
 
+    void peer_database_impl::close()
+    {
       try
       {
-        fc::path peer_database_filename_dir = _peer_database_filename.parent_path();
-        if (!fc::exists(peer_database_filename_dir))
-          fc::create_directories(peer_database_filename_dir);
-        fc::json::save_to_file(peer_records, _peer_database_filename);
+        if (_write_done.valid())
+          _write_done.wait();
       }
       catch (const fc::exception& e)
       {
-        elog("error saving peer database to file ${peer_database_filename}", 
-             ("peer_database_filename", _peer_database_filename));
+        elog("error saving peer database to file ${peer_database_filename}: ${e}", 
+             ("peer_database_filename", _peer_database_filename)("e", e.to_detail_string()));
       }
+      _write_thread.reset();
+      if (_file.is_open())
+        _file.close();
       _potential_peer_set.clear();
     }
 
+    void peer_database_impl::queue_entry_write(std::vector<char>&& entry)
+    {
+      if (!_write_thread)
+        return;
+      ++_entries_in_file;
+      if (_entries_in_file > 2 * _potential_peer_set.size() + MAXIMUM_PEERDB_SIZE)
+      {
+        queue_compaction();
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+        _pending_writes.insert(_pending_writes.end(), entry.begin(), entry.end());
+      }
+      schedule_write();
+    }
+
+    void peer_database_impl::queue_compaction()
+    {
+      if (!_write_thread)
+        return;
+      std::vector<char> contents(sizeof(peer_database_header));
+      peer_database_header header;
+      memcpy(contents.data(), &header, sizeof(header));
+      for (const potential_peer_record& record : _potential_peer_set)
+        append_entry(contents, update_entry_type, record);
+      _entries_in_file = _potential_peer_set.size();
+      {
+        // the new contents already include everything waiting to be appended
+        std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+        _pending_writes.clear();
+        _pending_rewrite = std::move(contents);
+      }
+      schedule_write();
+    }
+
+    void peer_database_impl::schedule_write()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+        if (_write_scheduled)
+          return;
+        _write_scheduled = true;
+      }
+      _write_done = _write_thread->async([this]() { write_pending(); }, "write peer database");
+    }
+
+    void peer_database_impl::write_pending()
+    {
+      for (;;)
+      {
+        std::vector<char> entries;
+        fc::optional<std::vector<char> > rewrite;
+        {
+          std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+          if (_pending_writes.empty() && !_pending_rewrite)
+          {
+            _write_scheduled = false;
+            return;
+          }
+          entries.swap(_pending_writes);
+          rewrite.swap(_pending_rewrite);
+        }
+
+        try
+        {
+          if (rewrite)
+          {
+            // write the compacted database next to the old one, then move it over, so a crash never leaves neither
+            if (_file.is_open())
+              _file.close();
+            fc::path peer_database_filename_dir = _peer_database_filename.parent_path();
+            if (!fc::exists(peer_database_filename_dir))
+              fc::create_directories(peer_database_filename_dir);
+            fc::path temporary_filename(_peer_database_filename.generic_string() + ".tmp");
+            {
+              std::fstream new_file(temporary_filename.generic_string().c_str(),
+                                    std::fstream::binary | std::fstream::out | std::fstream::trunc);
+              new_file.write(rewrite->data(), rewrite->size());
+              new_file.flush();
+              FC_ASSERT(new_file.good(), "error writing ${file}", ("file", temporary_filename));
+            }
+            fc::rename(temporary_filename, _peer_database_filename);
+          }
+          if (!_file.is_open())
+            _file.open(_peer_database_filename.generic_string().c_str(),
+                       std::fstream::binary | std::fstream::out | std::fstream::app);
+          if (!entries.empty())
+          {
+            _file.write(entries.data(), entries.size());
+            _file.flush();
+          }
+          FC_ASSERT(_file.good(), "error writing ${file}", ("file", _peer_database_filename));
+        }
+        catch (const fc::exception& e)
+        {
+          // losing some peers isn't worth stopping the node for, the next compaction starts the file over
+          elog("error saving peer database to file ${peer_database_filename}: ${e}",
+               ("peer_database_filename", _peer_database_filename)("e", e.to_detail_string()));
+          _file.close();
+          _file.clear();
+        }
+      }
+    }
+
     void peer_database_impl::clear()
     {
       _potential_peer_set.clear();
+      queue_compaction();
     }
 
     void peer_database_impl::erase(const fc::ip::endpoint& endpointToErase)
     {
       auto iter = _potential_peer_set.get<endpoint_index>().find(endpointToErase);
       if (iter != _potential_peer_set.get<endpoint_index>().end())
+      {
         _potential_peer_set.get<endpoint_index>().erase(iter);
+        std::vector<char> entry;
+        append_entry(entry, erase_entry_type, endpointToErase);
+        queue_entry_write(std::move(entry));
+      }
     }
 
     void peer_database_impl::update_entry(const potential_peer_record& updatedRecord)
@@ -154,6 +391,9 @@ namespace graphene { namespace net {
         _potential_peer_set.get<endpoint_index>().modify(iter, [&updatedRecord](potential_peer_record& record) { record = updatedRecord; });
       else
         _potential_peer_set.get<endpoint_index>().insert(updatedRecord);
+      std::vector<char> entry;
+      append_entry(entry, update_entry_type, updatedRecord);
+      queue_entry_write(std::move(entry));
     }
 
     potential_peer_record peer_database_impl::lookup_or_create_entry_for_endpoint(const fc::ip::endpoint& endpointToLookup)
@@ -225,9 +465,9 @@ namespace graphene { namespace net {
   peer_database::~peer_database()
   {}
 
-  void peer_database::open(const fc::path& databaseFilename)
+  void peer_database::open(const fc::path& databaseFilename, const fc::path& legacy_json_filename)
   {
-    my->open(databaseFilename);
+    my->open(databaseFilename, legacy_json_filename);
   }
 
   void peer_database::close()
@@ -23,6 +23,7 @@
  */
 
 #include <graphene/account_history/account_history_plugin.hpp>
+#include <graphene/account_history/account_history_store.hpp>
 
 #include <graphene/app/impacted.hpp>
 
@@ -37,11 +38,38 @@
 #include <fc/smart_ref_impl.hpp>
 #include <fc/thread/thread.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
+
 namespace graphene { namespace account_history {
 
 namespace detail
 {
 
+/** maps the operation names as the wallet shows them, e.g. fill_order_operation, to their tags */
+struct operation_name_visitor
+{
+   typedef void result_type;
+
+   template<typename Type>
+   void operator()( const Type& )const
+   {
+      string name = fc::get_typename<Type>::name();
+      size_t p = name.rfind( ':' );
+      if( p != string::npos )
+         name = name.substr( p + 1 );
+      names[ name ] = which;
+   }
+
+   flat_map<string, int>& names;
+   int                    which;
+};
+
 
 class account_history_plugin_impl
 {
@@ -56,16 +84,413 @@ class account_history_plugin_impl
        * and will process/index all operations that were applied in the block.
        */
       void update_account_histories( const signed_block& b );
+      void update_history_on_disk( uint32_t block_num, const vector< optional< operation_history_object > >& hist,
+                                   uint32_t last_irreversible );
+
+      /** the accounts op is to be listed for, which are only the tracked ones if there are any */
+      flat_set<account_id_type> get_accounts( const operation_history_object& op )const;
+      /**
+       * get_accounts for each of the operations, none for those that failed or are filtered out.  This only reads
+       * the operations, so it is spread over _threads if there are any.
+       */
+      vector< flat_set<account_id_type> > get_block_accounts(
+         const vector< optional< operation_history_object > >& hist )const;
+
+      account_history_store& store();
+
+      /** set the operation filters from names or numeric tags of operations */
+      void set_operation_filter( const vector<string>& included, const vector<string>& excluded );
+      /** false if o is of a type that is filtered out */
+      bool is_indexed( const operation& o )const
+      {
+         if( !_included_operations.empty() && _included_operations.find( o.which() ) == _included_operations.end() )
+            return false;
+         return _excluded_operations.find( o.which() ) == _excluded_operations.end();
+      }
+
+      /** adds the operation, or an object to be removed again for a failed one, to the index it is kept in */
+      operation_history_id_type create_operation( const optional<operation_history_object>& o_op );
+      /** the operation, decoded if it is kept packed, or null if it was removed */
+      optional<operation_history_object> find_operation( operation_history_id_type id )const;
+      void remove_operation( operation_history_id_type id );
+
+      /** removes the history entry, and the operation if no other account refers to it any more */
+      void remove_entry( const account_transaction_history_object& entry );
+      /** removes the oldest entries of the account so that _max_ops_per_account remain */
+      void prune_account( account_id_type account, uint32_t sequence );
+      /** removes the operations older than _max_op_age_seconds, with their entries */
+      void prune_old_operations();
 
       graphene::chain::database& database()
       {
          return _self.database();
       }
 
+      struct operation_subscription
+      {
+         std::weak_ptr<void>                          owner;
+         account_history_plugin::operation_callback   cb;
+      };
+      typedef std::pair< std::shared_ptr<operation_subscription>, operation_history_object > operation_notification;
+      /** adds a notification for each subscription to any of accounts to out, one for each subscription */
+      void collect_notifications( const operation_history_object& op, const flat_set<account_id_type>& accounts,
+                                  vector<operation_notification>& out )const;
+      /** calls the subscriptions, without holding any lock, so that they can subscribe again */
+      static void notify( const vector<operation_notification>& notifications );
+
+      /** operations of a block that is not irreversible yet, with the accounts they are listed for */
+      struct pending_block
+      {
+         uint32_t                                                              block_num = 0;
+         vector< std::pair< operation_history_object, flat_set<account_id_type> > > operations;
+      };
+
       account_history_plugin& _self;
       flat_set<account_id_type> _tracked_accounts;
+      flat_set<account_id_type> _excluded_accounts;
+      /** operation tags to index, all if empty */
+      flat_set<int>             _included_operations;
+      flat_set<int>             _excluded_operations;
+
+      /** compute the accounts of the operations of a block, none to do it on the chain thread */
+      vector< std::unique_ptr<fc::thread> > _threads;
+
+      uint32_t                   _max_ops_per_account = 0; ///< 0 for no limit
+      uint32_t                   _max_op_age_seconds = 0;  ///< 0 for no limit
+      /** no operation before this one is older than the age limit, as all older ones were removed */
+      operation_history_id_type  _oldest_op;
+
+      bool                       _history_on_disk = false;
+      bool                       _history_packed = false;
+      /** guards _store and _pending, which the queue's thread updates while API calls read them */
+      mutable std::mutex         _store_mutex;
+      account_history_store      _store;
+      /** guards _subscriptions, which API calls add to while blocks are indexed */
+      mutable std::mutex         _subscriptions_mutex;
+      std::multimap< account_id_type, std::shared_ptr<operation_subscription> > _subscriptions;
+      /**
+       * Only irreversible operations go to the store, the later ones wait here oldest first.  Closing the database
+       * rewinds it to the last irreversible block, so these never need to be saved.
+       */
+      std::deque<pending_block>  _pending;
+      /** with history on disk, updates it on a thread of its own if set; last, so it stops before the rest goes */
+      std::unique_ptr<graphene::app::applied_block_queue> _queue;
 };
 
+flat_set<account_id_type> account_history_plugin_impl::get_accounts( const operation_history_object& op )const
+{
+   flat_set<account_id_type> impacted;
+   vector<authority> other;
+   operation_get_required_authorities( op.op, impacted, impacted, other );
+
+   if( op.op.which() == operation::tag< account_create_operation >::value )
+      impacted.insert( op.result.get<object_id_type>() );
+   else
+      graphene::app::operation_get_impacted_accounts( op.op, impacted );
+
+   for( auto& a : other )
+      for( auto& item : a.account_auths )
+         impacted.insert( item.first );
+
+   if( _tracked_accounts.size() == 0 && _excluded_accounts.size() == 0 )
+      return impacted;
+   flat_set<account_id_type> tracked;
+   for( auto account_id : impacted )
+      if( ( _tracked_accounts.size() == 0 || _tracked_accounts.find( account_id ) != _tracked_accounts.end() )
+          && _excluded_accounts.find( account_id ) == _excluded_accounts.end() )
+         tracked.insert( account_id );
+   return tracked;
+}
+
+vector< flat_set<account_id_type> > account_history_plugin_impl::get_block_accounts(
+   const vector< optional< operation_history_object > >& hist )const
+{
+   vector< flat_set<account_id_type> > result( hist.size() );
+   auto compute = [&]( size_t i ) {
+      if( hist[i].valid() && is_indexed( hist[i]->op ) )
+         result[i] = get_accounts( *hist[i] );
+   };
+
+   // most blocks hold a few operations, for which starting the threads costs more than it saves
+   const size_t workers = std::min( _threads.size(), hist.size() / 8 );
+   if( workers < 2 )
+   {
+      for( size_t i = 0; i < hist.size(); ++i )
+         compute( i );
+      return result;
+   }
+
+   // an operation that fails to be looked at is tried again here, so that its exception is thrown on this thread
+   vector<char> failed( hist.size(), 0 );
+   vector< fc::future<void> > done;
+   done.reserve( workers );
+   for( size_t w = 0; w < workers; ++w )
+      done.push_back( _threads[w]->async( [&,w]() {
+         for( size_t i = w; i < hist.size(); i += workers )
+         {
+            try
+            {
+               compute( i );
+            }
+            catch( ... )
+            {
+               failed[i] = 1;
+            }
+         }
+      }, "impacted accounts" ) );
+   for( auto& d : done )
+      d.wait();
+   for( size_t i = 0; i < hist.size(); ++i )
+      if( failed[i] )
+         compute( i );
+   return result;
+}
+
+void account_history_plugin_impl::set_operation_filter( const vector<string>& included, const vector<string>& excluded )
+{
+   flat_map<string, int> names;
+   operation o;
+   for( int t = 0; t < o.count(); ++t )
+   {
+      o.set_which( t );
+      o.visit( operation_name_visitor{ names, t } );
+   }
+
+   auto to_tag = [&]( const string& name ) -> int {
+      auto itr = names.find( name );
+      if( itr != names.end() )
+         return itr->second;
+      FC_ASSERT( !name.empty() && std::all_of( name.begin(), name.end(), ::isdigit ),
+                 "unknown operation ${n}", ("n",name) );
+      int tag = std::stoi( name );
+      FC_ASSERT( tag < o.count(), "unknown operation ${n}", ("n",name) );
+      return tag;
+   };
+   for( const string& name : included )
+      _included_operations.insert( to_tag( name ) );
+   for( const string& name : excluded )
+      _excluded_operations.insert( to_tag( name ) );
+}
+
+account_history_store& account_history_plugin_impl::store()
+{
+   // opened on first use, since it lives next to the object database which is opened after the plugin is initialized
+   if( !_store.is_open() )
+      _store.open( database().get_data_dir() / "account_history" );
+   return _store;
+}
+
+void account_history_plugin_impl::update_history_on_disk( uint32_t block_num,
+                                                          const vector< optional< operation_history_object > >& hist,
+                                                          uint32_t last_irreversible )
+{
+   // the slow part is done before taking the lock
+   vector< flat_set<account_id_type> > block_accounts = get_block_accounts( hist );
+   vector<operation_notification> notifications;
+   {
+      std::lock_guard<std::mutex> guard( _store_mutex );
+      account_history_store& s = store();
+
+      // a block number that was seen before means blocks were popped, or the database was replayed from scratch
+      while( !_pending.empty() && _pending.back().block_num >= block_num )
+         _pending.pop_back();
+      if( s.last_block_num() >= block_num )
+         s.truncate_from( block_num );
+
+      pending_block block;
+      block.block_num = block_num;
+      uint64_t next_id = _pending.empty() ? s.next_operation_id()
+                                          : _pending.back().operations.back().first.id.instance() + 1;
+      for( size_t i = 0; i < hist.size(); ++i )
+      {
+         if( block_accounts[i].empty() )
+            continue;
+         block.operations.emplace_back( *hist[i], std::move( block_accounts[i] ) );
+         block.operations.back().first.id = operation_history_id_type( next_id++ );
+      }
+      if( !block.operations.empty() )
+         _pending.push_back( std::move( block ) );
+
+      bool appended = false;
+      while( !_pending.empty() && _pending.front().block_num <= last_irreversible )
+      {
+         for( const auto& item : _pending.front().operations )
+         {
+            s.append( item.first, item.second );
+            collect_notifications( item.first, item.second, notifications );
+         }
+         _pending.pop_front();
+         appended = true;
+      }
+      if( appended )
+         s.flush();
+   }
+   notify( notifications );
+}
+
+void account_history_plugin_impl::collect_notifications( const operation_history_object& op,
+                                                         const flat_set<account_id_type>& accounts,
+                                                         vector<operation_notification>& out )const
+{
+   std::lock_guard<std::mutex> guard( _subscriptions_mutex );
+   if( _subscriptions.empty() )
+      return;
+   const size_t first = out.size();
+   for( const account_id_type& a : accounts )
+   {
+      auto range = _subscriptions.equal_range( a );
+      for( auto itr = range.first; itr != range.second; ++itr )
+      {
+         // a subscription to several of the accounts is told once
+         bool seen = false;
+         for( size_t i = first; i < out.size() && !seen; ++i )
+            seen = out[i].first == itr->second;
+         if( !seen )
+            out.emplace_back( itr->second, op );
+      }
+   }
+}
+
+void account_history_plugin_impl::notify( const vector<operation_notification>& notifications )
+{
+   for( const auto& n : notifications )
+   {
+      auto owner = n.first->owner.lock();
+      if( !owner )
+         continue;
+      try
+      {
+         n.first->cb( n.second );
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "Account operation subscription failed: ${e}", ("e", e.to_detail_string()) );
+      }
+   }
+}
+
+operation_history_id_type account_history_plugin_impl::create_operation( const optional<operation_history_object>& o_op )
+{
+   graphene::chain::database& db = database();
+   if( _history_packed )
+   {
+      const auto& packed = db.create<packed_operation_history_object>( [&]( packed_operation_history_object& h ) {
+         if( o_op.valid() )
+         {
+            auto id = h.id;
+            h = packed_operation_history_object( *o_op );
+            h.id = id;
+         }
+      } );
+      return packed.operation_id();
+   }
+   return db.create<operation_history_object>( [&]( operation_history_object& h ) {
+      if( o_op.valid() )
+         h = *o_op;
+   } ).id;
+}
+
+optional<operation_history_object> account_history_plugin_impl::find_operation( operation_history_id_type id )const
+{
+   const graphene::chain::database& db = _self.database();
+   if( _history_packed )
+   {
+      const auto* packed = db.find( packed_operation_history_id_type( id.instance.value ) );
+      if( packed == nullptr )
+         return optional<operation_history_object>();
+      return packed->unpack();
+   }
+   const operation_history_object* op = db.find( id );
+   if( op == nullptr )
+      return optional<operation_history_object>();
+   return *op;
+}
+
+void account_history_plugin_impl::remove_operation( operation_history_id_type id )
+{
+   graphene::chain::database& db = database();
+   if( _history_packed )
+   {
+      if( const auto* packed = db.find( packed_operation_history_id_type( id.instance.value ) ) )
+         db.remove( *packed );
+   }
+   else if( const operation_history_object* op = db.find( id ) )
+      db.remove( *op );
+}
+
+void account_history_plugin_impl::remove_entry( const account_transaction_history_object& entry )
+{
+   graphene::chain::database& db = database();
+   const auto& by_seq_idx = db.get_index_type<account_transaction_history_index>().indices().get<by_seq>();
+   const auto& by_op_idx = db.get_index_type<account_transaction_history_index>().indices().get<by_op>();
+   const account_id_type account = entry.account;
+   const operation_history_id_type op_id = entry.operation_id;
+
+   // the entries are removed oldest first, so only the next newer one can link to this one
+   auto newer = by_seq_idx.find( boost::make_tuple( account, entry.sequence + 1 ) );
+   if( newer != by_seq_idx.end() )
+      db.modify( *newer, []( account_transaction_history_object& obj ) {
+         obj.next = account_transaction_history_id_type();
+      } );
+   else
+      db.modify( account(db).statistics(db), []( account_statistics_object& obj ) {
+         obj.most_recent_op = account_transaction_history_id_type();
+      } );
+   db.remove( entry );
+
+   const auto op = find_operation( op_id );
+   if( !op )
+      return;
+   for( const account_id_type& a : get_accounts( *op ) )
+      if( by_op_idx.find( boost::make_tuple( a, op_id ) ) != by_op_idx.end() )
+         return;
+   remove_operation( op_id );
+}
+
+void account_history_plugin_impl::prune_account( account_id_type account, uint32_t sequence )
+{
+   const auto& by_seq_idx = database().get_index_type<account_transaction_history_index>().indices().get<by_seq>();
+   auto itr = by_seq_idx.lower_bound( boost::make_tuple( account, 0 ) );
+   while( itr != by_seq_idx.end() && itr->account == account && itr->sequence + _max_ops_per_account <= sequence )
+   {
+      const account_transaction_history_object& entry = *itr;
+      ++itr;
+      remove_entry( entry );
+   }
+}
+
+void account_history_plugin_impl::prune_old_operations()
+{
+   graphene::chain::database& db = database();
+   const auto& by_op_idx = db.get_index_type<account_transaction_history_index>().indices().get<by_op>();
+   // operations only know their block number, so the age limit is converted at the current block interval
+   const uint32_t max_age_blocks = _max_op_age_seconds / db.get_global_properties().parameters.block_interval;
+   if( db.head_block_num() <= max_age_blocks )
+      return;
+   const uint32_t cutoff = db.head_block_num() - max_age_blocks;
+
+   const uint64_t next_id = _history_packed
+                          ? db.get_index<packed_operation_history_object>().get_next_id().instance()
+                          : db.get_index<operation_history_object>().get_next_id().instance();
+   for( ; _oldest_op.instance.value < next_id; _oldest_op = _oldest_op + 1 )
+   {
+      const auto op = find_operation( _oldest_op );
+      if( !op )
+         continue;
+      if( op->block_num >= cutoff )
+         break;
+      const operation_history_id_type op_id = op->id;
+      for( const account_id_type& a : get_accounts( *op ) )
+      {
+         auto entry = by_op_idx.find( boost::make_tuple( a, op_id ) );
+         if( entry != by_op_idx.end() )
+            remove_entry( *entry );
+      }
+      // removing the last entry removed the operation too, unless it never had any
+      remove_operation( op_id );
+   }
+}
+
 account_history_plugin_impl::~account_history_plugin_impl()
 {
    return;
@@ -74,80 +499,74 @@ account_history_plugin_impl::~account_history_plugin_impl()
 void account_history_plugin_impl::update_account_histories( const signed_block& b )
 {
    graphene::chain::database& db = database();
+   if( _history_on_disk )
+   {
+      update_history_on_disk( b.block_num(), db.get_applied_operations(),
+                              db.get_dynamic_global_properties().last_irreversible_block_num );
+      return;
+   }
+   // the history objects of a block restored from its changes were restored with them
+   if( db.is_replaying_block_diff() )
+      return;
+
    const vector<optional< operation_history_object > >& hist = db.get_applied_operations();
-   for( const optional< operation_history_object >& o_op : hist )
+   const vector< flat_set<account_id_type> > block_accounts = get_block_accounts( hist );
+   vector<operation_notification> notifications;
+   for( size_t i = 0; i < hist.size(); ++i )
    {
+      const optional< operation_history_object >& o_op = hist[i];
+      // filtered operations are skipped before anything is created for them
+      if( o_op.valid() && !is_indexed( o_op->op ) )
+         continue;
+
       // add to the operation history index
-      const auto& oho = db.create<operation_history_object>( [&]( operation_history_object& h )
-      {
-         if( o_op.valid() )
-            h = *o_op;
-      } );
+      const operation_history_id_type op_id = create_operation( o_op );
 
       if( !o_op.valid() )
       {
-         ilog( "removing failed operation with ID: ${id}", ("id", oho.id) );
-         db.remove( oho );
+         ilog( "removing failed operation with ID: ${id}", ("id", op_id) );
+         remove_operation( op_id );
          continue;
       }
 
-      const operation_history_object& op = *o_op;
-
-      // get the set of accounts this operation applies to
-      flat_set<account_id_type> impacted;
-      vector<authority> other;
-      operation_get_required_authorities( op.op, impacted, impacted, other );
-
-      if( op.op.which() == operation::tag< account_create_operation >::value )
-         impacted.insert( oho.result.get<object_id_type>() );
-      else
-         graphene::app::operation_get_impacted_accounts( op.op, impacted );
-
-      for( auto& a : other )
-         for( auto& item : a.account_auths )
-            impacted.insert( item.first );
-
-      // for each operation this account applies to that is in the config link it into the history
-      if( _tracked_accounts.size() == 0 )
+      // link it into the history of each of the accounts it applies to that are tracked
+      const flat_set<account_id_type>& accounts = block_accounts[i];
+      if( accounts.empty() && ( _max_ops_per_account > 0 || _max_op_age_seconds > 0 ) )
       {
-         for( auto& account_id : impacted )
-         {
-            // we don't do index_account_keys here anymore, because
-            // that indexing now happens in observers' post_evaluate()
-
-            // add history
-            const auto& stats_obj = account_id(db).statistics(db);
-            const auto& ath = db.create<account_transaction_history_object>( [&]( account_transaction_history_object& obj ){
-                obj.operation_id = oho.id;
-                obj.account = account_id;
-                obj.sequence = stats_obj.total_ops+1;
-                obj.next = stats_obj.most_recent_op;
-            });
-            db.modify( stats_obj, [&]( account_statistics_object& obj ){
-                obj.most_recent_op = ath.id;
-                obj.total_ops = ath.sequence;
-            });
-         }
+         // nothing would ever refer to it, or prune it
+         remove_operation( op_id );
+         continue;
       }
-      else
+      for( auto& account_id : accounts )
       {
-         for( auto account_id : _tracked_accounts )
-         {
-            if( impacted.find( account_id ) != impacted.end() )
-            {
-               // add history
-               const auto& stats_obj = account_id(db).statistics(db);
-               const auto& ath = db.create<account_transaction_history_object>( [&]( account_transaction_history_object& obj ){
-                   obj.operation_id = oho.id;
-                   obj.next = stats_obj.most_recent_op;
-               });
-               db.modify( stats_obj, [&]( account_statistics_object& obj ){
-                   obj.most_recent_op = ath.id;
-               });
-            }
-         }
+         // we don't do index_account_keys here anymore, because
+         // that indexing now happens in observers' post_evaluate()
+
+         // add history
+         const auto& stats_obj = account_id(db).statistics(db);
+         const auto& ath = db.create<account_transaction_history_object>( [&]( account_transaction_history_object& obj ){
+             obj.operation_id = op_id;
+             obj.account = account_id;
+             obj.sequence = stats_obj.total_ops+1;
+             obj.next = stats_obj.most_recent_op;
+         });
+         db.modify( stats_obj, [&]( account_statistics_object& obj ){
+             obj.most_recent_op = ath.id;
+             obj.total_ops = ath.sequence;
+         });
+         if( _max_ops_per_account > 0 )
+            prune_account( account_id, ath.sequence );
+      }
+      if( !accounts.empty() )
+      {
+         operation_history_object indexed = *o_op;
+         indexed.id = op_id;
+         collect_notifications( indexed, accounts, notifications );
       }
    }
+   if( _max_op_age_seconds > 0 )
+      prune_old_operations();
+   notify( notifications );
 }
 } // end namespace detail
 
@@ -177,17 +596,66 @@ void account_history_plugin::plugin_set_program_options(
 {
    cli.add_options()
          ("track-account", boost::program_options::value<std::vector<std::string>>()->composing()->multitoken(), "Account ID to track history for (may specify multiple times)")
+         ("exclude-account", boost::program_options::value<std::vector<std::string>>()->composing()->multitoken(),
+           "Account ID not to keep history for (may specify multiple times)")
+         ("history-operations", boost::program_options::value<std::vector<std::string>>()->composing()->multitoken(),
+           "Operation to keep history of, by name (e.g. transfer_operation) or number, all if none are given (may specify multiple times)")
+         ("history-exclude-operations", boost::program_options::value<std::vector<std::string>>()->composing()->multitoken(),
+           "Operation not to keep history of, by name (e.g. fill_order_operation) or number (may specify multiple times)")
+         ("history-threads", boost::program_options::value<uint32_t>()->default_value(0),
+           "Threads to find the accounts of the operations of large blocks on, 0 to do it on the chain thread")
+         ("max-ops-per-account", boost::program_options::value<uint32_t>()->default_value(0),
+           "Keep only this many of the most recent operations of each account, 0 to keep all")
+         ("max-op-age-seconds", boost::program_options::value<uint32_t>()->default_value(0),
+           "Remove operations once they are older than this, 0 to keep all")
+         ("history-on-disk", boost::program_options::value<bool>()->default_value(false),
+           "Keep account history in files next to the object database, adding operations once they are irreversible, instead of as objects")
+         ("history-async", boost::program_options::value<bool>()->default_value(false),
+           "With history-on-disk, update the history on a thread of its own instead of the chain thread")
+         ("history-packed", boost::program_options::value<bool>()->default_value(false),
+           "Keep the operations of the history in the object database packed, decoding them when they are read, which takes a fraction of the memory")
          ;
    cfg.add(cli);
 }
 
 void account_history_plugin::plugin_initialize(const boost::program_options::variables_map& options)
 {
-   database().applied_block.connect( [&]( const signed_block& b){ my->update_account_histories(b); } );
-   database().add_index< primary_index< simple_index< operation_history_object > > >();
+   database().require_applied_operations();
+   database().add_index< primary_index< slab_index< operation_history_object > > >();
+   database().add_index< primary_index< slab_index< packed_operation_history_object > > >();
    database().add_index< primary_index< account_transaction_history_index > >();
 
-   LOAD_VALUE_SET(options, "tracked-accounts", my->_tracked_accounts, graphene::chain::account_id_type);
+   LOAD_VALUE_SET(options, "track-account", my->_tracked_accounts, graphene::chain::account_id_type);
+   LOAD_VALUE_SET(options, "exclude-account", my->_excluded_accounts, graphene::chain::account_id_type);
+   my->set_operation_filter(
+      options.count( "history-operations" ) ? options["history-operations"].as<std::vector<std::string>>()
+                                            : std::vector<std::string>(),
+      options.count( "history-exclude-operations" ) ? options["history-exclude-operations"].as<std::vector<std::string>>()
+                                                    : std::vector<std::string>() );
+   if( options.count( "history-threads" ) )
+      for( uint32_t i = 0; i < options["history-threads"].as<uint32_t>(); ++i )
+         my->_threads.emplace_back( new fc::thread( "account history " + fc::to_string( i ) ) );
+   if( options.count( "max-ops-per-account" ) )
+      my->_max_ops_per_account = options["max-ops-per-account"].as<uint32_t>();
+   if( options.count( "max-op-age-seconds" ) )
+      my->_max_op_age_seconds = options["max-op-age-seconds"].as<uint32_t>();
+   if( options.count( "history-on-disk" ) )
+      my->_history_on_disk = options["history-on-disk"].as<bool>();
+   if( options.count( "history-packed" ) )
+      my->_history_packed = options["history-packed"].as<bool>();
+   FC_ASSERT( !( my->_history_on_disk && my->_history_packed ), "history-packed only applies to the history in the object database" );
+
+   if( my->_history_on_disk && options.count( "history-async" ) && options["history-async"].as<bool>() )
+   {
+      detail::account_history_plugin_impl* impl = my.get();
+      my->_queue.reset( new graphene::app::applied_block_queue( "account history",
+         [impl]( const graphene::app::applied_block_data& d ) {
+            impl->update_history_on_disk( d.block.block_num(), *d.operations, d.last_irreversible_block_num );
+         } ) );
+      my->_queue->connect( database() );
+   }
+   else
+      connect_applied_block( [this]( const signed_block& b){ my->update_account_histories(b); } );
 }
 
 void account_history_plugin::plugin_startup()
@@ -199,4 +667,98 @@ flat_set<account_id_type> account_history_plugin::tracked_accounts() const
    return my->_tracked_accounts;
 }
 
+bool account_history_plugin::history_on_disk()const
+{
+   return my->_history_on_disk;
+}
+
+bool account_history_plugin::history_packed()const
+{
+   return my->_history_packed;
+}
+
+void account_history_plugin::subscribe_to_operations( const flat_set<account_id_type>& accounts,
+                                                      std::weak_ptr<void> owner, operation_callback cb )
+{
+   auto subscription = std::make_shared<detail::account_history_plugin_impl::operation_subscription>();
+   subscription->owner = std::move( owner );
+   subscription->cb = std::move( cb );
+
+   std::lock_guard<std::mutex> guard( my->_subscriptions_mutex );
+   // the ended subscriptions are dropped here rather than on every block
+   for( auto itr = my->_subscriptions.begin(); itr != my->_subscriptions.end(); )
+   {
+      if( itr->second->owner.expired() )
+         itr = my->_subscriptions.erase( itr );
+      else
+         ++itr;
+   }
+   for( const account_id_type& a : accounts )
+      my->_subscriptions.emplace( a, subscription );
+}
+
+operation_history_object account_history_plugin::get_operation( operation_history_id_type id )const
+{
+   FC_ASSERT( !my->_history_on_disk );
+   auto op = my->find_operation( id );
+   FC_ASSERT( op.valid(), "no operation ${id}", ("id",id) );
+   return *op;
+}
+
+vector<operation_history_object> account_history_plugin::get_account_history( account_id_type account,
+                                                                              operation_history_id_type stop,
+                                                                              unsigned limit,
+                                                                              operation_history_id_type start )const
+{
+   FC_ASSERT( my->_history_on_disk );
+   std::lock_guard<std::mutex> guard( my->_store_mutex );
+   vector<operation_history_object> result;
+   uint64_t first = start == operation_history_id_type() ? std::numeric_limits<uint64_t>::max() : start.instance();
+   const uint64_t last = stop.instance();
+
+   // the reversible operations are the newest
+   for( auto block = my->_pending.rbegin(); block != my->_pending.rend() && result.size() < limit; ++block )
+      for( auto item = block->operations.rbegin(); item != block->operations.rend() && result.size() < limit; ++item )
+      {
+         const uint64_t id = item->first.id.instance();
+         if( id <= last )
+            return result;
+         if( id <= first && item->second.find( account ) != item->second.end() )
+            result.push_back( item->first );
+      }
+   if( result.size() < limit )
+   {
+      auto stored = my->store().get_history( account, last, first, limit - result.size() );
+      std::move( stored.begin(), stored.end(), std::back_inserter( result ) );
+   }
+   return result;
+}
+
+vector<operation_history_object> account_history_plugin::get_relative_account_history( account_id_type account,
+                                                                                       uint32_t stop,
+                                                                                       unsigned limit,
+                                                                                       uint32_t start )const
+{
+   FC_ASSERT( my->_history_on_disk );
+   std::lock_guard<std::mutex> guard( my->_store_mutex );
+   const uint32_t stored = my->store().count( account );
+   vector<const operation_history_object*> pending;
+   for( const auto& block : my->_pending )
+      for( const auto& item : block.operations )
+         if( item.second.find( account ) != item.second.end() )
+            pending.push_back( &item.first );
+
+   const uint32_t total = stored + pending.size();
+   start = ( start == 0 ) ? total : std::min( total, start );
+   vector<operation_history_object> result;
+   for( ; start > stored && start > stop && result.size() < limit; --start )
+      result.push_back( *pending[ start - stored - 1 ] );
+   if( result.size() < limit && start > stop )
+   {
+      auto older = my->store().get_relative_history( account, stop, start, limit - result.size() );
+      std::move( older.begin(), older.end(), std::back_inserter( result ) );
+   }
+   return result;
+}
+
 } }
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/account_history/account_history_store.hpp>
+
+#include <fc/io/raw.hpp>
+
+namespace graphene { namespace account_history {
+
+account_history_store::~account_history_store()
+{
+   close();
+}
+
+void account_history_store::open_files( bool create )
+{
+   auto mode = std::fstream::binary | std::fstream::in | std::fstream::out;
+   if( create )
+      mode |= std::fstream::trunc;
+   _operations.open( ( _dir / "operations" ).generic_string().c_str(), mode );
+   _index.open( ( _dir / "index" ).generic_string().c_str(), mode );
+   FC_ASSERT( _operations.good() && _index.good(), "unable to open the account history in ${d}", ("d",_dir) );
+}
+
+void account_history_store::open( const fc::path& dir )
+{ try {
+   close();
+   _dir = dir;
+   fc::create_directories( _dir );
+   open_files( !fc::exists( _dir / "operations" ) || !fc::exists( _dir / "index" ) );
+
+   _operations.seekg( 0, std::fstream::end );
+   _operations_size = _operations.tellg();
+   _index.seekg( 0, std::fstream::end );
+   // a partly written entry at the end is ignored, and overwritten by the next append
+   _index_count = uint64_t( _index.tellg() ) / sizeof( index_entry );
+
+   _index.clear();
+   _index.seekg( 0 );
+   index_entry e;
+   for( uint64_t i = 0; i < _index_count; ++i )
+   {
+      _index.read( (char*)&e, sizeof( e ) );
+      _accounts[ e.account ].push_back( account_entry{ e.operation, e.position } );
+   }
+   if( _index_count > 0 )
+   {
+      _next_operation_id = e.operation + 1;
+      _last_block_num = uint32_t( e.block_num );
+      // the operation of the last entry is complete, anything after it is not
+      operation_history_object last = read( e.position );
+      _operations_size = e.position + sizeof( uint32_t ) + fc::raw::pack_size( last );
+   }
+   else
+      _operations_size = 0;
+   _open = true;
+} FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+void account_history_store::close()
+{
+   if( !_open )
+      return;
+   flush();
+   _operations.close();
+   _index.close();
+   _accounts.clear();
+   _operations_size = 0;
+   _index_count = 0;
+   _next_operation_id = 0;
+   _last_block_num = 0;
+   _open = false;
+}
+
+void account_history_store::flush()
+{
+   if( !_open )
+      return;
+   _operations.flush();
+   _index.flush();
+}
+
+account_history_store::index_entry account_history_store::read_index_entry( uint64_t n )const
+{
+   index_entry e;
+   _index.clear();
+   _index.seekg( n * sizeof( index_entry ) );
+   _index.read( (char*)&e, sizeof( e ) );
+   FC_ASSERT( _index.good(), "unable to read account history index entry ${n}", ("n",n) );
+   return e;
+}
+
+operation_history_object account_history_store::read( uint64_t position )const
+{
+   uint32_t size = 0;
+   _operations.clear();
+   _operations.seekg( position );
+   _operations.read( (char*)&size, sizeof( size ) );
+   vector<char> data( size );
+   _operations.read( data.data(), size );
+   FC_ASSERT( _operations.good(), "unable to read the account history operation at ${p}", ("p",position) );
+   return fc::raw::unpack<operation_history_object>( data );
+}
+
+void account_history_store::truncate_from( uint32_t block_num )
+{ try {
+   FC_ASSERT( _open );
+   if( _index_count == 0 || _last_block_num < block_num )
+      return;
+
+   // the entries are sorted by block number, find the first one to drop
+   uint64_t low = 0;
+   uint64_t high = _index_count;
+   while( low < high )
+   {
+      uint64_t mid = low + ( high - low ) / 2;
+      if( read_index_entry( mid ).block_num < block_num )
+         low = mid + 1;
+      else
+         high = mid;
+   }
+   const index_entry first_dropped = read_index_entry( low );
+
+   for( auto itr = _accounts.begin(); itr != _accounts.end(); )
+   {
+      vector<account_entry>& entries = itr->second;
+      while( !entries.empty() && entries.back().operation >= first_dropped.operation )
+         entries.pop_back();
+      if( entries.empty() )
+         itr = _accounts.erase( itr );
+      else
+         ++itr;
+   }
+
+   _operations.close();
+   _index.close();
+   fc::resize_file( _dir / "operations", first_dropped.position );
+   fc::resize_file( _dir / "index", low * sizeof( index_entry ) );
+   open_files( false );
+
+   _operations_size = first_dropped.position;
+   _index_count = low;
+   if( _index_count > 0 )
+   {
+      const index_entry last = read_index_entry( _index_count - 1 );
+      _next_operation_id = last.operation + 1;
+      _last_block_num = uint32_t( last.block_num );
+   }
+   else
+   {
+      _next_operation_id = 0;
+      _last_block_num = 0;
+   }
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
+void account_history_store::append( const operation_history_object& op, const flat_set<account_id_type>& accounts )
+{ try {
+   FC_ASSERT( _open );
+   FC_ASSERT( op.id.instance() >= _next_operation_id && op.block_num >= _last_block_num );
+   if( accounts.empty() )
+      return;
+
+   const vector<char> data = fc::raw::pack( op );
+   const uint32_t size = data.size();
+   _operations.clear();
+   _index.clear();
+   _operations.seekp( _operations_size );
+   _operations.write( (const char*)&size, sizeof( size ) );
+   _operations.write( data.data(), data.size() );
+
+   index_entry e;
+   e.operation = op.id.instance();
+   e.position = _operations_size;
+   e.block_num = op.block_num;
+   _index.seekp( _index_count * sizeof( index_entry ) );
+   for( const account_id_type& account : accounts )
+   {
+      e.account = account.instance.value;
+      _index.write( (const char*)&e, sizeof( e ) );
+      _accounts[ e.account ].push_back( account_entry{ e.operation, e.position } );
+   }
+   FC_ASSERT( _operations.good() && _index.good(), "unable to write the account history" );
+
+   _operations_size += sizeof( size ) + data.size();
+   _index_count += accounts.size();
+   _next_operation_id = e.operation + 1;
+   _last_block_num = op.block_num;
+} FC_CAPTURE_AND_RETHROW( (op)(accounts) ) }
+
+uint32_t account_history_store::count( account_id_type account )const
+{
+   auto itr = _accounts.find( account.instance.value );
+   return itr == _accounts.end() ? 0 : itr->second.size();
+}
+
+vector<operation_history_object> account_history_store::get_history( account_id_type account, uint64_t stop,
+                                                                     uint64_t start, uint32_t limit )const
+{
+   vector<operation_history_object> result;
+   auto itr = _accounts.find( account.instance.value );
+   if( itr == _accounts.end() )
+      return result;
+
+   const vector<account_entry>& entries = itr->second;
+   auto entry = std::upper_bound( entries.begin(), entries.end(), start,
+                                  []( uint64_t id, const account_entry& e ) { return id < e.operation; } );
+   while( entry != entries.begin() && result.size() < limit )
+   {
+      --entry;
+      if( entry->operation <= stop )
+         break;
+      result.push_back( read( entry->position ) );
+   }
+   return result;
+}
+
+vector<operation_history_object> account_history_store::get_relative_history( account_id_type account, uint32_t stop,
+                                                                              uint32_t start, uint32_t limit )const
+{
+   vector<operation_history_object> result;
+   auto itr = _accounts.find( account.instance.value );
+   if( itr == _accounts.end() )
+      return result;
+
+   const vector<account_entry>& entries = itr->second;
+   for( uint32_t seq = std::min<uint32_t>( start, entries.size() ); seq > stop && result.size() < limit; --seq )
+      result.push_back( read( entries[ seq - 1 ].position ) );
+   return result;
+}
+
+} } // graphene::account_history
@@ -28,8 +28,12 @@
 
 #include <graphene/chain/operation_history_object.hpp>
 
+#include <fc/io/raw.hpp>
 #include <fc/thread/future.hpp>
 
+#include <functional>
+#include <memory>
+
 namespace graphene { namespace account_history {
    using namespace chain;
    //using namespace graphene::db;
@@ -53,9 +57,56 @@ namespace graphene { namespace account_history {
 enum account_history_object_type
 {
    key_account_object_type = 0,
-   bucket_object_type = 1 ///< used in market_history_plugin
+   bucket_object_type = 1, ///< used in market_history_plugin, as are 2 to 4
+   packed_operation_history_object_type = 5
 };
 
+/**
+ * An operation_history_object kept with history-packed, which holds the operation and its result packed and
+ * decodes them only when the history is read.  Most operations are never read again, and the packed form of an
+ * operation is a fraction of the size of the operation static_variant, which is as big as the biggest operation.
+ *
+ * The objects are created exactly when the operation_history_objects would be, so the instance of each is the
+ * instance of the operation_history_id_type the history entries and the API refer to the operation by.
+ */
+class packed_operation_history_object : public abstract_object<packed_operation_history_object>
+{
+   public:
+      static const uint8_t space_id = ACCOUNT_HISTORY_SPACE_ID;
+      static const uint8_t type_id  = packed_operation_history_object_type;
+
+      packed_operation_history_object(){}
+      explicit packed_operation_history_object( const operation_history_object& o )
+         : packed( fc::raw::pack( std::make_pair( o.op, o.result ) ) ), block_num( o.block_num ),
+           trx_in_block( o.trx_in_block ), op_in_trx( o.op_in_trx ), virtual_op( o.virtual_op ) {}
+
+      operation_history_id_type operation_id()const { return operation_history_id_type( id.instance() ); }
+
+      operation_history_object unpack()const
+      {
+         operation_history_object result;
+         result.id = operation_id();
+         fc::datastream<const char*> ds( packed.data(), packed.size() );
+         fc::raw::unpack( ds, result.op );
+         fc::raw::unpack( ds, result.result );
+         result.block_num = block_num;
+         result.trx_in_block = trx_in_block;
+         result.op_in_trx = op_in_trx;
+         result.virtual_op = virtual_op;
+         return result;
+      }
+
+      /** the packed operation followed by its packed result */
+      vector<char> packed;
+      uint32_t     block_num = 0;
+      uint16_t     trx_in_block = 0;
+      uint16_t     op_in_trx = 0;
+      uint16_t     virtual_op = 0;
+};
+
+typedef object_id< ACCOUNT_HISTORY_SPACE_ID, packed_operation_history_object_type, packed_operation_history_object >
+   packed_operation_history_id_type;
+
 
 namespace detail
 {
@@ -77,12 +128,38 @@ class account_history_plugin : public graphene::app::plugin
 
       flat_set<account_id_type> tracked_accounts()const;
 
+      /** true if the history is kept in files by an @ref account_history_store rather than in the object database */
+      bool history_on_disk()const;
+      /** true if the operations of the history in the object database are kept as packed_operation_history_objects */
+      bool history_packed()const;
+      /** the operation a history entry in the object database refers to, decoded if it is kept packed */
+      operation_history_object get_operation( operation_history_id_type id )const;
+      /** the history_api queries, only for history on disk; those of the object database are served by the API */
+      ///@{
+      vector<operation_history_object> get_account_history( account_id_type account, operation_history_id_type stop,
+                                                            unsigned limit, operation_history_id_type start )const;
+      vector<operation_history_object> get_relative_account_history( account_id_type account, uint32_t stop,
+                                                                     unsigned limit, uint32_t start )const;
+      ///@}
+
+      typedef std::function<void(const operation_history_object&)> operation_callback;
+      /**
+       * Calls cb with each operation the history lists for any of accounts from now on, once, as it is added.  The
+       * history on disk adds the operations once they are irreversible, the one in the object database as they are
+       * applied, which may be in blocks that are popped again.  The subscription ends when owner is destroyed.
+       */
+      void subscribe_to_operations( const flat_set<account_id_type>& accounts, std::weak_ptr<void> owner,
+                                    operation_callback cb );
+
       friend class detail::account_history_plugin_impl;
       std::unique_ptr<detail::account_history_plugin_impl> my;
 };
 
 } } //graphene::account_history
 
+FC_REFLECT_DERIVED( graphene::account_history::packed_operation_history_object, (graphene::db::object),
+                    (packed)(block_num)(trx_in_block)(op_in_trx)(virtual_op) )
+
 /*struct by_id;
 struct by_seq;
 struct by_op;
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <graphene/chain/operation_history_object.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <fstream>
+#include <unordered_map>
+
+namespace graphene { namespace account_history {
+   using namespace chain;
+
+   /**
+    * @brief Keeps account history in files instead of the object database
+    *
+    * Operations are appended to the operations file once they are irreversible, each one followed by an entry per
+    * account it impacts in the index file.  The index is read into memory on open, which takes 16 bytes per entry, so
+    * the history of any account can be paged through directly; the operations themselves are only read from disk when
+    * they are requested.
+    *
+    * Operations are appended in the order they were applied, so their ids and block numbers only grow.
+    */
+   class account_history_store
+   {
+      public:
+         /** one per account and operation in the index file */
+         struct index_entry
+         {
+            uint64_t account = 0;     ///< instance of the account id
+            uint64_t operation = 0;   ///< instance of the operation id
+            uint64_t position = 0;    ///< of the operation in the operations file
+            uint64_t block_num = 0;
+         };
+
+         ~account_history_store();
+
+         void open( const fc::path& dir );
+         bool is_open()const { return _open; }
+         void close();
+         /** hands the appended operations to the OS */
+         void flush();
+
+         /** drops the operations of block_num and later blocks */
+         void truncate_from( uint32_t block_num );
+         /** appends op, whose id must be at least next_operation_id(), to the history of each of the accounts */
+         void append( const operation_history_object& op, const flat_set<account_id_type>& accounts );
+
+         /** one more than the id of the last operation stored, 0 if there is none */
+         uint64_t next_operation_id()const { return _next_operation_id; }
+         /** block of the last operation stored, 0 if there is none */
+         uint32_t last_block_num()const { return _last_block_num; }
+         /** number of operations stored for the account */
+         uint32_t count( account_id_type account )const;
+
+         /** @return up to limit of the operations of the account with ids in (stop, start], newest first */
+         vector<operation_history_object> get_history( account_id_type account, uint64_t stop, uint64_t start,
+                                                       uint32_t limit )const;
+         /**
+          * @return up to limit of the operations of the account with sequence numbers in (stop, start], newest first;
+          * the first operation of an account has sequence number 1
+          */
+         vector<operation_history_object> get_relative_history( account_id_type account, uint32_t stop, uint32_t start,
+                                                                uint32_t limit )const;
+
+      private:
+         struct account_entry
+         {
+            uint64_t operation;
+            uint64_t position;
+         };
+
+         operation_history_object read( uint64_t position )const;
+         index_entry              read_index_entry( uint64_t n )const;
+         void                     open_files( bool create );
+
+         fc::path                                             _dir;
+         bool                                                 _open = false;
+         mutable std::fstream                                 _operations;
+         mutable std::fstream                                 _index;
+         uint64_t                                             _operations_size = 0;
+         uint64_t                                             _index_count = 0;
+         uint64_t                                             _next_operation_id = 0;
+         uint32_t                                             _last_block_num = 0;
+         /** entries of each account by account id instance, oldest first */
+         std::unordered_map< uint64_t, vector<account_entry> > _accounts;
+   };
+
+} } // graphene::account_history
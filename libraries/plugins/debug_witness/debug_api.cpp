@@ -26,6 +26,10 @@ class debug_api_impl
       void debug_push_blocks( const std::string& src_filename, uint32_t count );
       void debug_generate_blocks( const std::string& debug_key, uint32_t count );
       void debug_update_object( const fc::variant_object& update );
+      void debug_update_objects( const std::vector<fc::variant_object>& updates );
+      void debug_import_objects( const std::string& filename );
+      void debug_set_apply_profiling( bool enabled );
+      graphene::chain::apply_profile debug_get_apply_profile();
       //void debug_save_db( std::string db_path );
       void debug_stream_json_objects( const std::string& filename );
       void debug_stream_json_objects_flush();
@@ -106,6 +110,33 @@ void debug_api_impl::debug_update_object( const fc::variant_object& update )
    db->debug_update( update );
 }
 
+void debug_api_impl::debug_update_objects( const std::vector<fc::variant_object>& updates )
+{
+   std::shared_ptr< graphene::chain::database > db = app.chain_database();
+   db->debug_update( updates );
+}
+
+void debug_api_impl::debug_import_objects( const std::string& filename )
+{
+   std::shared_ptr< graphene::chain::database > db = app.chain_database();
+   fc::mutable_variant_object update;
+   update("_action", "import")("file", fc::absolute( filename ).generic_string());
+   db->debug_update( update );
+}
+
+void debug_api_impl::debug_set_apply_profiling( bool enabled )
+{
+   std::shared_ptr< graphene::chain::database > db = app.chain_database();
+   db->set_apply_profiling( enabled );
+}
+
+graphene::chain::apply_profile debug_api_impl::debug_get_apply_profile()
+{
+   std::shared_ptr< graphene::chain::database > db = app.chain_database();
+   auto lock = db->lock_state_for_reading();
+   return db->get_apply_profile();
+}
+
 std::shared_ptr< graphene::debug_witness_plugin::debug_witness_plugin > debug_api_impl::get_plugin()
 {
    return app.get_plugin< graphene::debug_witness_plugin::debug_witness_plugin >( "debug_witness" );
@@ -143,6 +174,26 @@ void debug_api::debug_update_object( fc::variant_object update )
    my->debug_update_object( update );
 }
 
+void debug_api::debug_update_objects( std::vector<fc::variant_object> updates )
+{
+   my->debug_update_objects( updates );
+}
+
+void debug_api::debug_import_objects( std::string filename )
+{
+   my->debug_import_objects( filename );
+}
+
+void debug_api::debug_set_apply_profiling( bool enabled )
+{
+   my->debug_set_apply_profiling( enabled );
+}
+
+graphene::chain::apply_profile debug_api::debug_get_apply_profile()
+{
+   return my->debug_get_apply_profile();
+}
+
 void debug_api::debug_stream_json_objects( std::string filename )
 {
    my->debug_stream_json_objects( filename );
@@ -98,7 +98,7 @@ void debug_witness_plugin::plugin_startup()
 
    // connect needed signals
 
-   _applied_block_conn  = db.applied_block.connect([this](const graphene::chain::signed_block& b){ on_applied_block(b); });
+   _applied_block_conn  = connect_applied_block([this](const graphene::chain::signed_block& b){ on_applied_block(b); });
    _changed_objects_conn = db.changed_objects.connect([this](const std::vector<graphene::db::object_id_type>& ids){ on_changed_objects(ids); });
    _removed_objects_conn = db.removed_objects.connect([this](const std::vector<const graphene::db::object*>& objs){ on_removed_objects(objs); });
 
@@ -25,6 +25,9 @@
 
 #include <memory>
 #include <string>
+#include <vector>
+
+#include <graphene/chain/apply_profile.hpp>
 
 #include <fc/api.hpp>
 #include <fc/variant_object.hpp>
@@ -59,6 +62,28 @@ class debug_api
        */
       void debug_update_object( fc::variant_object update );
 
+      /**
+       * Like debug_update_object(), but the last block is re-applied only once for all of the updates.
+       */
+      void debug_update_objects( std::vector<fc::variant_object> updates );
+
+      /**
+       * Write the objects packed in a file to the database after the last block, which is re-applied once.  Each
+       * record in the file is an object_id_type followed by the packed object as a vector<char>.  The file is read
+       * again whenever that block is, so it must not be removed while the block may be popped.
+       */
+      void debug_import_objects( std::string filename );
+
+      /**
+       * Start profiling how long operations and the phases of applying blocks take, from scratch, or stop.
+       */
+      void debug_set_apply_profiling( bool enabled );
+
+      /**
+       * Get the profile collected since profiling was started.
+       */
+      graphene::chain::apply_profile debug_get_apply_profile();
+
       /**
        * Start a node with given initial path.
        */
@@ -91,6 +116,10 @@ FC_API(graphene::debug_witness::debug_api,
        (debug_push_blocks)
        (debug_generate_blocks)
        (debug_update_object)
+       (debug_update_objects)
+       (debug_import_objects)
+       (debug_set_apply_profiling)
+       (debug_get_apply_profile)
        (debug_stream_json_objects)
        (debug_stream_json_objects_flush)
      )
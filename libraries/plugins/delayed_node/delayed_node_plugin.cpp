@@ -32,6 +32,8 @@
 #include <fc/api.hpp>
 #include <fc/smart_ref_impl.hpp>
 
+#include <deque>
+
 
 namespace graphene { namespace delayed_node {
 namespace bpo = boost::program_options;
@@ -45,6 +47,19 @@ struct delayed_node_plugin_impl {
    boost::signals2::scoped_connection client_connection_closed;
    graphene::chain::block_id_type last_received_remote_head;
    graphene::chain::block_id_type last_processed_remote_head;
+   /** how many blocks to have requested from the trusted node ahead of the one being applied */
+   uint32_t fetch_window = 64;
+   /** what mainloop waits on while there is nothing to sync, set whenever the trusted node reports a new head */
+   fc::promise<void>::ptr remote_head_changed;
+   fc::future<void> mainloop_done;
+   fc::future<void> reconnect_done;
+
+   void note_remote_head( const graphene::chain::block_id_type& id )
+   {
+      last_received_remote_head = id;
+      if( remote_head_changed && !remote_head_changed->ready() )
+         remote_head_changed->set_value();
+   }
 };
 }
 
@@ -59,6 +74,8 @@ void delayed_node_plugin::plugin_set_program_options(bpo::options_description& c
 {
    cli.add_options()
          ("trusted-node", boost::program_options::value<std::string>()->required(), "RPC endpoint of a trusted validating node (required)")
+         ("trusted-node-fetch-window", boost::program_options::value<uint32_t>()->default_value(64),
+          "Number of blocks to request from the trusted node at a time while catching up")
          ;
    cfg.add(cli);
 }
@@ -70,11 +87,19 @@ void delayed_node_plugin::connect()
    my->client_connection_closed = my->client_connection->closed.connect([this] {
       connection_failed();
    });
+   // subscribe on every connection, and catch up with whatever was missed while there was none
+   my->database_api->set_block_applied_callback([this]( const fc::variant& block_id )
+   {
+      my->note_remote_head( block_id.as<graphene::chain::block_id_type>() );
+   } );
+   my->note_remote_head( my->database_api->get_dynamic_global_properties().head_block_id );
 }
 
 void delayed_node_plugin::plugin_initialize(const boost::program_options::variables_map& options)
 {
    my->remote_endpoint = "ws://" + options.at("trusted-node").as<std::string>();
+   if( options.count("trusted-node-fetch-window") )
+      my->fetch_window = std::max( options.at("trusted-node-fetch-window").as<uint32_t>(), uint32_t(1) );
 }
 
 void delayed_node_plugin::sync_with_trusted_node()
@@ -98,13 +123,49 @@ void delayed_node_plugin::sync_with_trusted_node()
          break;
       }
       pass_count++;
-      while( remote_dpo.last_irreversible_block_num > db.head_block_num() )
+
+      // Keep fetch_window requests outstanding, so that the trusted node is sending the next blocks while this one
+      // is applied rather than waiting for a round trip per block.  The replies arrive on the connection's thread.
+      const uint32_t last_block_num = remote_dpo.last_irreversible_block_num;
+      uint32_t next_block_num = db.head_block_num() + 1;
+      std::deque< fc::future< fc::optional<graphene::chain::signed_block> > > fetches;
+      auto fetch_ahead = [&]() {
+         while( next_block_num <= last_block_num && fetches.size() < my->fetch_window )
+         {
+            const uint32_t block_num = next_block_num++;
+            fetches.push_back( fc::async( [this,block_num]() { return my->database_api->get_block( block_num ); },
+                                          "delayed_node fetch block" ) );
+         }
+      };
+
+      try
       {
-         fc::optional<graphene::chain::signed_block> block = my->database_api->get_block( db.head_block_num()+1 );
-         FC_ASSERT(block, "Trusted node claims it has blocks it doesn't actually have.");
-         ilog("Pushing block #${n}", ("n", block->block_num()));
-         db.push_block(*block);
-         synced_blocks++;
+         fetch_ahead();
+         while( !fetches.empty() )
+         {
+            fc::optional<graphene::chain::signed_block> block = fetches.front().wait();
+            fetches.pop_front();
+            fetch_ahead();
+            FC_ASSERT(block, "Trusted node claims it has blocks it doesn't actually have.");
+            ilog("Pushing block #${n}", ("n", block->block_num()));
+            db.push_block(*block);
+            synced_blocks++;
+         }
+      }
+      catch( ... )
+      {
+         // the requests still in flight refer to this plugin, don't leave them running
+         for( auto& fetch : fetches )
+         {
+            try
+            {
+               fetch.cancel_and_wait( __FUNCTION__ );
+            }
+            catch( ... )
+            {
+            }
+         }
+         throw;
       }
    }
 }
@@ -115,48 +176,89 @@ void delayed_node_plugin::mainloop()
    {
       try
       {
-         fc::usleep( fc::microseconds( 296645 ) );  // wake up a little over 3Hz
-
          if( my->last_received_remote_head == my->last_processed_remote_head )
+         {
+            my->remote_head_changed = fc::promise<void>::ptr( new fc::promise<void>( "delayed_node remote head" ) );
+            my->remote_head_changed->wait();
             continue;
+         }
 
+         // heads reported while syncing are looked at again afterwards
+         const graphene::chain::block_id_type remote_head = my->last_received_remote_head;
          sync_with_trusted_node();
-         my->last_processed_remote_head = my->last_received_remote_head;
+         my->last_processed_remote_head = remote_head;
+      }
+      catch( const fc::canceled_exception& )
+      {
+         throw;
       }
       catch( const fc::exception& e )
       {
          elog("Error during connection: ${e}", ("e", e.to_detail_string()));
+         // nothing to wait on until the connection is back, don't spin in the meantime
+         fc::usleep( fc::seconds( 1 ) );
       }
    }
 }
 
 void delayed_node_plugin::plugin_startup()
 {
-   fc::async([this]()
+   my->mainloop_done = fc::async([this]()
    {
       mainloop();
-   });
+   }, "delayed_node mainloop");
 
    try
    {
       connect();
-      my->database_api->set_block_applied_callback([this]( const fc::variant& block_id )
-      {
-         fc::from_variant( block_id, my->last_received_remote_head );
-      } );
       return;
    }
    catch (const fc::exception& e)
    {
       elog("Error during connection: ${e}", ("e", e.to_detail_string()));
    }
-   fc::async([this]{connection_failed();});
+   connection_failed();
+}
+
+void delayed_node_plugin::plugin_shutdown()
+{
+   for( fc::future<void>* task : { &my->mainloop_done, &my->reconnect_done } )
+   {
+      try
+      {
+         if( task->valid() )
+            task->cancel_and_wait( __FUNCTION__ );
+      }
+      catch( const fc::canceled_exception& )
+      {
+         // expected, the task was stopped
+      }
+      catch( const fc::exception& e )
+      {
+         edump( (e.to_detail_string()) );
+      }
+   }
+   my->client_connection_closed.disconnect();
 }
 
 void delayed_node_plugin::connection_failed()
 {
    elog("Connection to trusted node failed; retrying in 5 seconds...");
-   fc::schedule([this]{connect();}, fc::time_point::now() + fc::seconds(5));
+   my->reconnect_done = fc::schedule([this]{
+      try
+      {
+         connect();
+      }
+      catch( const fc::canceled_exception& )
+      {
+         throw;
+      }
+      catch( const fc::exception& e )
+      {
+         elog("Error during connection: ${e}", ("e", e.to_detail_string()));
+         connection_failed();
+      }
+   }, fc::time_point::now() + fc::seconds(5), "delayed_node reconnect");
 }
 
 } }
@@ -40,6 +40,8 @@ public:
                                            boost::program_options::options_description& cfg) override;
    virtual void plugin_initialize(const boost::program_options::variables_map& options) override;
    virtual void plugin_startup() override;
+   /** stops the main loop, the block requests in flight and a pending reconnect, and waits for them */
+   virtual void plugin_shutdown() override;
    void mainloop();
 
 protected:
@@ -28,6 +28,8 @@
 
 #include <fc/thread/future.hpp>
 
+#include <boost/multi_index/composite_key.hpp>
+
 namespace graphene { namespace market_history {
 using namespace chain;
 
@@ -106,7 +108,90 @@ struct order_history_object : public abstract_object<order_history_object>
   fill_order_operation op;
 };
 
+/** trades of a market within one slot of a @ref market_ticker_object */
+struct ticker_slot
+{
+   fc::time_point_sec  open;
+   share_type          high_base;
+   share_type          high_quote;
+   share_type          low_base;
+   share_type          low_quote;
+   share_type          close_base;
+   share_type          close_quote;
+   share_type          base_volume;
+   share_type          quote_volume;
+};
+
+/**
+ *  Summary of the trades of one market over the last day, updated as fill orders arrive so that tickers can be served
+ *  without scanning the history.  Trades are grouped into slots of slot_seconds, and a slot is dropped once all of it
+ *  is more than a day old, so the summary covers between one day and one day plus a slot.
+ *
+ *  As with buckets, base is the asset with the lower id and the summary only counts the fill of the side that pays
+ *  in base.
+ */
+struct market_ticker_object : public abstract_object<market_ticker_object>
+{
+   static const uint8_t  space_id = ACCOUNT_HISTORY_SPACE_ID;
+   static const uint8_t  type_id  = 2;
+   static const uint32_t slot_seconds = 900;
+   static const uint32_t window_seconds = 86400;
+
+   /** drops the slots that are entirely older than the window, and recomputes the summary if any were dropped */
+   void expire( fc::time_point_sec now );
+   void add_trade( fc::time_point_sec now, share_type base_amount, share_type quote_amount );
+
+   asset_id_type        base;
+   asset_id_type        quote;
+   share_type           latest_base;     ///< the latest trade, which may be older than the window
+   share_type           latest_quote;
+   share_type           previous_base;   ///< the last trade before the window, 0 if unknown
+   share_type           previous_quote;
+   share_type           high_base;
+   share_type           high_quote;
+   share_type           low_base;
+   share_type           low_quote;
+   share_type           base_volume;
+   share_type           quote_volume;
+   vector<ticker_slot>  slots;           ///< oldest first
+   /** when the oldest slot leaves the window, maximum() if there are no slots */
+   fc::time_point_sec   expiration = fc::time_point_sec::maximum();
+};
+
+/**
+ *  Lifetime trading totals of one market, base being the asset with the lower id.  Like the buckets they only count
+ *  irreversible blocks.
+ */
+struct market_stats_object : public abstract_object<market_stats_object>
+{
+   static const uint8_t space_id = ACCOUNT_HISTORY_SPACE_ID;
+   static const uint8_t type_id  = 3;
+
+   asset_id_type        base;
+   asset_id_type        quote;
+   share_type           base_volume;
+   share_type           quote_volume;
+   share_type           base_market_fees;   ///< market fees the base issuer collected in this market
+   share_type           quote_market_fees;
+   uint64_t             trade_count = 0;    ///< matches, each of which fills two orders
+   fc::time_point_sec   last_trade;
+};
+
+/** Lifetime trading totals of one asset over all of its markets, only counting irreversible blocks */
+struct asset_market_stats_object : public abstract_object<asset_market_stats_object>
+{
+   static const uint8_t space_id = ACCOUNT_HISTORY_SPACE_ID;
+   static const uint8_t type_id  = 4;
+
+   asset_id_type        asset_id;
+   share_type           volume;        ///< amount of the asset sold
+   share_type           market_fees;   ///< market fees collected by the issuer
+};
+
 struct by_key;
+struct by_market;
+struct by_ticker_expiration;
+struct by_asset;
 typedef multi_index_container<
    bucket_object,
    indexed_by<
@@ -124,9 +209,89 @@ typedef multi_index_container<
 > order_history_multi_index_type;
 
 
+typedef multi_index_container<
+   market_ticker_object,
+   indexed_by<
+      hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
+      ordered_unique< tag<by_market>,
+         composite_key< market_ticker_object,
+            member< market_ticker_object, asset_id_type, &market_ticker_object::base >,
+            member< market_ticker_object, asset_id_type, &market_ticker_object::quote >
+         >
+      >,
+      ordered_non_unique< tag<by_ticker_expiration>, member< market_ticker_object, fc::time_point_sec, &market_ticker_object::expiration > >
+   >
+> market_ticker_multi_index_type;
+
+typedef multi_index_container<
+   market_stats_object,
+   indexed_by<
+      hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
+      ordered_unique< tag<by_market>,
+         composite_key< market_stats_object,
+            member< market_stats_object, asset_id_type, &market_stats_object::base >,
+            member< market_stats_object, asset_id_type, &market_stats_object::quote >
+         >
+      >
+   >
+> market_stats_multi_index_type;
+
+typedef multi_index_container<
+   asset_market_stats_object,
+   indexed_by<
+      hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
+      ordered_unique< tag<by_asset>, member< asset_market_stats_object, asset_id_type, &asset_market_stats_object::asset_id > >
+   >
+> asset_market_stats_multi_index_type;
+
 typedef generic_index<bucket_object, bucket_object_multi_index_type> bucket_index;
+typedef generic_index<market_stats_object, market_stats_multi_index_type> market_stats_index;
+typedef generic_index<asset_market_stats_object, asset_market_stats_multi_index_type> asset_market_stats_index;
+typedef generic_index<market_ticker_object, market_ticker_multi_index_type> market_ticker_index;
 typedef generic_index<order_history_object, order_history_multi_index_type> history_index;
 
+/**
+ *  Keeps the latest fills of every market in a fixed size ring buffer, newest first.  It is attached as a secondary
+ *  index to the @ref history_index, which no longer holds any objects, so that the fills cost no undo state and their
+ *  memory stays bounded by the number of markets.
+ *
+ *  Since nothing is undone, every fill records its block number and the fills of blocks that were popped are dropped
+ *  when a block with the same or a lower number is applied.  The fills are not saved with the object database, after
+ *  a restart the history starts out empty.
+ */
+class market_fill_history : public secondary_index
+{
+   public:
+      /** fills kept per market, each match produces two of them */
+      static const uint32_t fills_per_market = 200;
+
+      /** drops the fills of block_num and later blocks, must be called before the fills of block_num are added */
+      void start_block( uint32_t block_num );
+      void add_fill( uint32_t block_num, fc::time_point_sec time, const fill_order_operation& op );
+
+      /** @return up to limit of the latest fills of the market (a,b), newest first */
+      vector<order_history_object> get_fills( asset_id_type a, asset_id_type b, uint32_t limit )const;
+
+   private:
+      struct market_fills
+      {
+         /** grows up to fills_per_market, then the oldest fill is overwritten */
+         vector< pair<uint32_t, order_history_object> > fills;
+         /** where the next fill goes once the buffer is full */
+         uint32_t                                      head = 0;
+         int64_t                                       next_sequence = 0;
+
+         const pair<uint32_t, order_history_object>& newest( uint32_t i )const
+         {
+            return fills[ ( head + fills.size() - 1 - i ) % fills.size() ];
+         }
+         void pop_newest();
+      };
+
+      map< pair<asset_id_type,asset_id_type>, market_fills > _markets;
+      uint32_t                                              _last_block_num = 0;
+};
+
 
 namespace detail
 {
@@ -136,7 +301,8 @@ namespace detail
 /**
  *  The market history plugin can be configured to track any number of intervals via its configuration.  Once per block it
  *  will scan the virtual operations and look for fill_order_operations and then adjust the appropriate bucket objects for
- *  each fill order.
+ *  each fill order.  The buckets only take the fills of irreversible blocks, so they lag the head block by the blocks
+ *  that can still be undone.
  */
 class market_history_plugin : public graphene::app::plugin
 {
@@ -154,6 +320,7 @@ class market_history_plugin : public graphene::app::plugin
 
       uint32_t                    max_history()const;
       const flat_set<uint32_t>&   tracked_buckets()const;
+      const market_fill_history&  fill_history()const;
 
    private:
       friend class detail::market_history_plugin_impl;
@@ -172,4 +339,17 @@ FC_REFLECT_DERIVED( graphene::market_history::bucket_object, (graphene::db::obje
                     (open_base)(open_quote)
                     (close_base)(close_quote)
                     (base_volume)(quote_volume) )
-
+FC_REFLECT( graphene::market_history::ticker_slot,
+            (open)(high_base)(high_quote)(low_base)(low_quote)(close_base)(close_quote)(base_volume)(quote_volume) )
+FC_REFLECT_DERIVED( graphene::market_history::market_ticker_object, (graphene::db::object),
+                    (base)(quote)
+                    (latest_base)(latest_quote)
+                    (previous_base)(previous_quote)
+                    (high_base)(high_quote)
+                    (low_base)(low_quote)
+                    (base_volume)(quote_volume)
+                    (slots)(expiration) )
+FC_REFLECT_DERIVED( graphene::market_history::market_stats_object, (graphene::db::object),
+                    (base)(quote)(base_volume)(quote_volume)(base_market_fees)(quote_market_fees)(trade_count)(last_trade) )
+FC_REFLECT_DERIVED( graphene::market_history::asset_market_stats_object, (graphene::db::object),
+                    (asset_id)(volume)(market_fees) )
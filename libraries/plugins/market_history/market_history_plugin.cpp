@@ -38,6 +38,158 @@
 
 namespace graphene { namespace market_history {
 
+void market_ticker_object::expire( fc::time_point_sec now )
+{
+   auto first_kept = slots.begin();
+   while( first_kept != slots.end() && first_kept->open + slot_seconds + window_seconds <= now )
+   {
+      previous_base = first_kept->close_base;
+      previous_quote = first_kept->close_quote;
+      ++first_kept;
+   }
+   if( first_kept == slots.begin() )
+      return;
+   slots.erase( slots.begin(), first_kept );
+
+   base_volume = 0;
+   quote_volume = 0;
+   high_base = high_quote = low_base = low_quote = 0;
+   for( const auto& s : slots )
+   {
+      base_volume += s.base_volume;
+      quote_volume += s.quote_volume;
+      if( high_base == 0 || asset( high_base, base ) / asset( high_quote, quote ) < asset( s.high_base, base ) / asset( s.high_quote, quote ) )
+      {
+         high_base = s.high_base;
+         high_quote = s.high_quote;
+      }
+      if( low_base == 0 || asset( low_base, base ) / asset( low_quote, quote ) > asset( s.low_base, base ) / asset( s.low_quote, quote ) )
+      {
+         low_base = s.low_base;
+         low_quote = s.low_quote;
+      }
+   }
+   expiration = slots.empty() ? fc::time_point_sec::maximum() : slots.front().open + slot_seconds + window_seconds;
+}
+
+void market_ticker_object::add_trade( fc::time_point_sec now, share_type base_amount, share_type quote_amount )
+{
+   expire( now );
+   const price trade_price = asset( base_amount, base ) / asset( quote_amount, quote );
+
+   fc::time_point_sec open( ( now.sec_since_epoch() / slot_seconds ) * slot_seconds );
+   if( slots.empty() || slots.back().open != open )
+   {
+      slots.emplace_back();
+      ticker_slot& s = slots.back();
+      s.open = open;
+      s.high_base = s.low_base = base_amount;
+      s.high_quote = s.low_quote = quote_amount;
+   }
+   ticker_slot& s = slots.back();
+   s.close_base = base_amount;
+   s.close_quote = quote_amount;
+   s.base_volume += base_amount;
+   s.quote_volume += quote_amount;
+   if( asset( s.high_base, base ) / asset( s.high_quote, quote ) < trade_price )
+   {
+      s.high_base = base_amount;
+      s.high_quote = quote_amount;
+   }
+   if( asset( s.low_base, base ) / asset( s.low_quote, quote ) > trade_price )
+   {
+      s.low_base = base_amount;
+      s.low_quote = quote_amount;
+   }
+
+   latest_base = base_amount;
+   latest_quote = quote_amount;
+   base_volume += base_amount;
+   quote_volume += quote_amount;
+   if( high_base == 0 || asset( high_base, base ) / asset( high_quote, quote ) < trade_price )
+   {
+      high_base = base_amount;
+      high_quote = quote_amount;
+   }
+   if( low_base == 0 || asset( low_base, base ) / asset( low_quote, quote ) > trade_price )
+   {
+      low_base = base_amount;
+      low_quote = quote_amount;
+   }
+   expiration = slots.front().open + slot_seconds + window_seconds;
+}
+
+void market_fill_history::market_fills::pop_newest()
+{
+   // popping is rare, so a full buffer is just put back in order, oldest first, and grows again from there
+   std::rotate( fills.begin(), fills.begin() + head, fills.end() );
+   head = 0;
+   fills.pop_back();
+   ++next_sequence;
+}
+
+void market_fill_history::start_block( uint32_t block_num )
+{
+   if( block_num > _last_block_num )
+   {
+      _last_block_num = block_num;
+      return;
+   }
+
+   for( auto itr = _markets.begin(); itr != _markets.end(); )
+   {
+      market_fills& m = itr->second;
+      while( !m.fills.empty() && m.newest( 0 ).first >= block_num )
+         m.pop_newest();
+      if( m.fills.empty() )
+         itr = _markets.erase( itr );
+      else
+         ++itr;
+   }
+   _last_block_num = block_num;
+}
+
+void market_fill_history::add_fill( uint32_t block_num, fc::time_point_sec time, const fill_order_operation& op )
+{
+   auto market = op.get_market();
+   market_fills& m = _markets[ market ];
+
+   order_history_object ho;
+   ho.key.base = market.first;
+   ho.key.quote = market.second;
+   ho.key.sequence = m.next_sequence--;
+   ho.time = time;
+   ho.op = op;
+
+   if( m.fills.size() < fills_per_market )
+   {
+      if( m.fills.empty() )
+         m.fills.reserve( fills_per_market );
+      m.fills.emplace_back( block_num, std::move( ho ) );
+   }
+   else
+   {
+      m.fills[ m.head ] = std::make_pair( block_num, std::move( ho ) );
+      m.head = ( m.head + 1 ) % fills_per_market;
+   }
+}
+
+vector<order_history_object> market_fill_history::get_fills( asset_id_type a, asset_id_type b, uint32_t limit )const
+{
+   if( a > b ) std::swap( a, b );
+   vector<order_history_object> result;
+   auto itr = _markets.find( std::make_pair( a, b ) );
+   if( itr == _markets.end() )
+      return result;
+
+   const market_fills& m = itr->second;
+   const uint32_t count = std::min<uint32_t>( limit, m.fills.size() );
+   result.reserve( count );
+   for( uint32_t i = 0; i < count; ++i )
+      result.push_back( m.newest( i ).second );
+   return result;
+}
+
 namespace detail
 {
 
@@ -53,14 +205,34 @@ class market_history_plugin_impl
        */
       void update_market_histories( const signed_block& b );
 
+      /** adds the fills of the blocks that became irreversible to the statistics and buckets */
+      void update_buckets( uint32_t last_irreversible_block_num );
+      void update_buckets( fc::time_point_sec now, const fill_order_operation& o );
+      void update_stats( fc::time_point_sec now, const fill_order_operation& o );
+
       graphene::chain::database& database()
       {
          return _self.database();
       }
 
+      /** fills of a block that is not irreversible yet */
+      struct pending_fills
+      {
+         uint32_t                       block_num = 0;
+         fc::time_point_sec             time;
+         vector<fill_order_operation>   fills;
+      };
+
       market_history_plugin&     _self;
       flat_set<uint32_t>         _tracked_buckets;
       uint32_t                   _maximum_history_per_bucket_size = 1000;
+      market_fill_history*       _fill_history = nullptr;
+      /**
+       * The statistics and buckets are only updated once a block is irreversible, so they never have to be undone and
+       * their indexes are exempt from the undo history.  Until then the fills wait here, oldest block first.  Closing
+       * the database rewinds it to the last irreversible block, so nothing here needs to be saved.
+       */
+      std::deque<pending_fills>  _pending_fills;
 };
 
 
@@ -68,9 +240,16 @@ struct operation_process_fill_order
 {
    market_history_plugin&    _plugin;
    fc::time_point_sec        _now;
+   market_fill_history&      _fills;
+   /** the fills to add to the statistics and buckets once the block is irreversible */
+   vector<fill_order_operation>* _pending;
+   bool                      _track_buckets;
+   /** set for a block restored from its changes, whose tickers were restored with them */
+   bool                      _restored;
 
-   operation_process_fill_order( market_history_plugin& mhp, fc::time_point_sec n )
-   :_plugin(mhp),_now(n) {}
+   operation_process_fill_order( market_history_plugin& mhp, fc::time_point_sec n, market_fill_history& fills,
+                                 vector<fill_order_operation>* pending, bool track_buckets, bool restored )
+   :_plugin(mhp),_now(n),_fills(fills),_pending(pending),_track_buckets(track_buckets),_restored(restored) {}
 
    typedef void result_type;
 
@@ -81,150 +260,220 @@ struct operation_process_fill_order
    void operator()( const fill_order_operation& o )const 
    {
       //ilog( "processing ${o}", ("o",o) );
-      const auto& buckets = _plugin.tracked_buckets();
       auto& db         = _plugin.database();
-      const auto& bucket_idx = db.get_index_type<bucket_index>();
-      const auto& history_idx = db.get_index_type<history_index>().indices().get<by_key>();
-
-      auto time = db.head_block_time();
-
-      history_key hkey;
-      hkey.base = o.pays.asset_id;
-      hkey.quote = o.receives.asset_id;
-      if( hkey.base > hkey.quote ) 
-         std::swap( hkey.base, hkey.quote );
-      hkey.sequence = std::numeric_limits<int64_t>::min();
-
-      auto itr = history_idx.lower_bound( hkey );
-
-      if( itr->key.base == hkey.base && itr->key.quote == hkey.quote )
-         hkey.sequence = itr->key.sequence - 1;
-      else
-         hkey.sequence = 0;
 
-      db.create<order_history_object>( [&]( order_history_object& ho ) {
-         ho.key = hkey;
-         ho.time = time;
-         ho.op = o;
-      });
-
-      hkey.sequence += 200;
-      itr = history_idx.lower_bound( hkey );
-
-      while( itr != history_idx.end() )
+      if( o.pays.asset_id < o.receives.asset_id && !_restored )
       {
-         if( itr->key.base == hkey.base && itr->key.quote == hkey.quote )
-         {
-            db.remove( *itr );
-            itr = history_idx.lower_bound( hkey );
-         }
-         else break;
+         const auto& ticker_idx = db.get_index_type<market_ticker_index>().indices().get<by_market>();
+         auto ticker = ticker_idx.find( std::make_tuple( o.pays.asset_id, o.receives.asset_id ) );
+         if( ticker == ticker_idx.end() )
+            ticker = ticker_idx.iterator_to( db.create<market_ticker_object>( [&]( market_ticker_object& t ) {
+               t.base = o.pays.asset_id;
+               t.quote = o.receives.asset_id;
+            } ) );
+         db.modify( *ticker, [&]( market_ticker_object& t ) {
+            t.add_trade( _now, o.pays.amount, o.receives.amount );
+         } );
       }
 
+      _pending->push_back( o );
+      if( _track_buckets )
+         _fills.add_fill( db.head_block_num(), db.head_block_time(), o );
+   }
+};
 
-      auto max_history = _plugin.max_history();
-      for( auto bucket : buckets )
-      {
-          auto cutoff      = (fc::time_point() + fc::seconds( bucket * max_history));
-
-          bucket_key key;
-          key.base    = o.pays.asset_id;
-          key.quote   = o.receives.asset_id;
+market_history_plugin_impl::~market_history_plugin_impl()
+{}
 
+void market_history_plugin_impl::update_buckets( fc::time_point_sec now, const fill_order_operation& o )
+{
+   auto& db = database();
+   const auto& buckets = _tracked_buckets;
+   const auto& bucket_idx = db.get_index_type<bucket_index>();
 
-          /** for every matched order there are two fill order operations created, one for
-           * each side.  We can filter the duplicates by only considering the fill operations where
-           * the base > quote
-           */
-          if( key.base > key.quote ) 
+   auto max_history = _maximum_history_per_bucket_size;
+   for( auto bucket : buckets )
+   {
+       auto cutoff      = (fc::time_point() + fc::seconds( bucket * max_history));
+
+       bucket_key key;
+       key.base    = o.pays.asset_id;
+       key.quote   = o.receives.asset_id;
+
+
+       /** for every matched order there are two fill order operations created, one for
+        * each side.  We can filter the duplicates by only considering the fill operations where
+        * the base > quote
+        */
+       if( key.base > key.quote ) 
+       {
+          //ilog( "     skipping because base > quote" );
+          continue;
+       }
+
+       price trade_price = o.pays / o.receives;
+
+       key.seconds = bucket;
+       key.open    = fc::time_point() + fc::seconds((now.sec_since_epoch() / key.seconds) * key.seconds);
+
+       const auto& by_key_idx = bucket_idx.indices().get<by_key>();
+       auto itr = by_key_idx.find( key );
+       if( itr == by_key_idx.end() )
+       { // create new bucket
+         /* const auto& obj = */
+         db.create<bucket_object>( [&]( bucket_object& b ){
+              b.key = key;
+              b.quote_volume += trade_price.quote.amount;
+              b.base_volume += trade_price.base.amount;
+              b.open_base = trade_price.base.amount;
+              b.open_quote = trade_price.quote.amount;
+              b.close_base = trade_price.base.amount;
+              b.close_quote = trade_price.quote.amount;
+              b.high_base = b.close_base;
+              b.high_quote = b.close_quote;
+              b.low_base = b.close_base;
+              b.low_quote = b.close_quote;
+         });
+         //wlog( "    creating bucket ${b}", ("b",obj) );
+       }
+       else
+       { // update existing bucket
+          //wlog( "    before updating bucket ${b}", ("b",*itr) );
+          db.modify( *itr, [&]( bucket_object& b ){
+               b.base_volume += trade_price.base.amount;
+               b.quote_volume += trade_price.quote.amount;
+               b.close_base = trade_price.base.amount;
+               b.close_quote = trade_price.quote.amount;
+               if( b.high() < trade_price ) 
+               {
+                   b.high_base = b.close_base;
+                   b.high_quote = b.close_quote;
+               }
+               if( b.low() > trade_price ) 
+               {
+                   b.low_base = b.close_base;
+                   b.low_quote = b.close_quote;
+               }
+          });
+          //wlog( "    after bucket bucket ${b}", ("b",*itr) );
+       }
+
+       if( max_history != 0  )
+       {
+          key.open = fc::time_point_sec();
+          auto itr = by_key_idx.lower_bound( key );
+
+          while( itr != by_key_idx.end() && 
+                 itr->key.base == key.base && 
+                 itr->key.quote == key.quote && 
+                 itr->key.seconds == bucket && 
+                 itr->key.open < cutoff )
           {
-             //ilog( "     skipping because base > quote" );
-             continue;
+           //  elog( "    removing old bucket ${b}", ("b", *itr) );
+             auto old_itr = itr;
+             ++itr;
+             db.remove( *old_itr );
           }
+       }
+   }
+}
 
-          price trade_price = o.pays / o.receives;
-
-          key.seconds = bucket;
-          key.open    = fc::time_point() + fc::seconds((_now.sec_since_epoch() / key.seconds) * key.seconds);
-
-          const auto& by_key_idx = bucket_idx.indices().get<by_key>();
-          auto itr = by_key_idx.find( key );
-          if( itr == by_key_idx.end() )
-          { // create new bucket
-            /* const auto& obj = */
-            db.create<bucket_object>( [&]( bucket_object& b ){
-                 b.key = key;
-                 b.quote_volume += trade_price.quote.amount;
-                 b.base_volume += trade_price.base.amount;
-                 b.open_base = trade_price.base.amount;
-                 b.open_quote = trade_price.quote.amount;
-                 b.close_base = trade_price.base.amount;
-                 b.close_quote = trade_price.quote.amount;
-                 b.high_base = b.close_base;
-                 b.high_quote = b.close_quote;
-                 b.low_base = b.close_base;
-                 b.low_quote = b.close_quote;
-            });
-            //wlog( "    creating bucket ${b}", ("b",obj) );
-          }
-          else
-          { // update existing bucket
-             //wlog( "    before updating bucket ${b}", ("b",*itr) );
-             db.modify( *itr, [&]( bucket_object& b ){
-                  b.base_volume += trade_price.base.amount;
-                  b.quote_volume += trade_price.quote.amount;
-                  b.close_base = trade_price.base.amount;
-                  b.close_quote = trade_price.quote.amount;
-                  if( b.high() < trade_price ) 
-                  {
-                      b.high_base = b.close_base;
-                      b.high_quote = b.close_quote;
-                  }
-                  if( b.low() > trade_price ) 
-                  {
-                      b.low_base = b.close_base;
-                      b.low_quote = b.close_quote;
-                  }
-             });
-             //wlog( "    after bucket bucket ${b}", ("b",*itr) );
-          }
+void market_history_plugin_impl::update_stats( fc::time_point_sec now, const fill_order_operation& o )
+{
+   auto& db = database();
+
+   const auto& asset_idx = db.get_index_type<asset_market_stats_index>().indices().get<by_asset>();
+   auto add_to_asset = [&]( asset_id_type asset_id, share_type volume, share_type fees ) {
+      auto itr = asset_idx.find( asset_id );
+      if( itr == asset_idx.end() )
+         itr = asset_idx.iterator_to( db.create<asset_market_stats_object>( [&]( asset_market_stats_object& s ) {
+            s.asset_id = asset_id;
+         } ) );
+      db.modify( *itr, [&]( asset_market_stats_object& s ) {
+         s.volume += volume;
+         s.market_fees += fees;
+      } );
+   };
+   add_to_asset( o.pays.asset_id, o.pays.amount, 0 );
+   if( o.fee.amount != 0 )
+      add_to_asset( o.fee.asset_id, 0, o.fee.amount );
+
+   const auto market = o.get_market();
+   const auto& market_idx = db.get_index_type<market_stats_index>().indices().get<by_market>();
+   auto itr = market_idx.find( std::make_tuple( market.first, market.second ) );
+   if( itr == market_idx.end() )
+      itr = market_idx.iterator_to( db.create<market_stats_object>( [&]( market_stats_object& s ) {
+         s.base = market.first;
+         s.quote = market.second;
+      } ) );
+   db.modify( *itr, [&]( market_stats_object& s ) {
+      // both fills of a match carry the fee of their receiving side, the volume is counted once
+      if( o.fee.asset_id == s.base )
+         s.base_market_fees += o.fee.amount;
+      else
+         s.quote_market_fees += o.fee.amount;
+      if( o.pays.asset_id == s.base )
+      {
+         s.base_volume += o.pays.amount;
+         s.quote_volume += o.receives.amount;
+         ++s.trade_count;
+      }
+      s.last_trade = now;
+   } );
+}
 
-          if( max_history != 0  )
-          {
-             key.open = fc::time_point_sec();
-             auto itr = by_key_idx.lower_bound( key );
-
-             while( itr != by_key_idx.end() && 
-                    itr->key.base == key.base && 
-                    itr->key.quote == key.quote && 
-                    itr->key.seconds == bucket && 
-                    itr->key.open < cutoff )
-             {
-              //  elog( "    removing old bucket ${b}", ("b", *itr) );
-                auto old_itr = itr;
-                ++itr;
-                db.remove( *old_itr );
-             }
-          }
+void market_history_plugin_impl::update_buckets( uint32_t last_irreversible_block_num )
+{
+   if( _pending_fills.empty() || _pending_fills.front().block_num > last_irreversible_block_num )
+      return;
+
+   const bool track_buckets = _maximum_history_per_bucket_size != 0 && _tracked_buckets.size() != 0;
+   while( !_pending_fills.empty() && _pending_fills.front().block_num <= last_irreversible_block_num )
+   {
+      for( const fill_order_operation& o : _pending_fills.front().fills )
+      {
+         update_stats( _pending_fills.front().time, o );
+         if( track_buckets )
+            update_buckets( _pending_fills.front().time, o );
       }
+      _pending_fills.pop_front();
    }
-};
-
-market_history_plugin_impl::~market_history_plugin_impl()
-{}
+}
 
 void market_history_plugin_impl::update_market_histories( const signed_block& b )
 {
-   if( _maximum_history_per_bucket_size == 0 ) return;
-   if( _tracked_buckets.size() == 0 ) return;
-
    graphene::chain::database& db = database();
+   // the objects of a block restored from its changes were restored with them, the fills kept here are not
+   const bool restored = db.is_replaying_block_diff();
+
+   // roll the tickers of markets that haven't traded lately
+   const auto& ticker_idx = db.get_index_type<market_ticker_index>().indices().get<by_ticker_expiration>();
+   while( !restored && !ticker_idx.empty() && ticker_idx.begin()->expiration <= b.timestamp )
+      db.modify( *ticker_idx.begin(), [&]( market_ticker_object& t ) { t.expire( b.timestamp ); } );
+
+   market_fill_history& fills = *_fill_history;
+   fills.start_block( b.block_num() );
+
+   // the fills of blocks that were popped are gone for good
+   while( !_pending_fills.empty() && _pending_fills.back().block_num >= b.block_num() )
+      _pending_fills.pop_back();
+
+   // the history and buckets are only kept if configured, the tickers always are
+   const bool track_buckets = _maximum_history_per_bucket_size != 0 && _tracked_buckets.size() != 0;
+   pending_fills block_fills;
+   block_fills.block_num = b.block_num();
+   block_fills.time = b.timestamp;
    const vector<optional< operation_history_object > >& hist = db.get_applied_operations();
    for( const optional< operation_history_object >& o_op : hist )
    {
       if( o_op.valid() )
-         o_op->op.visit( operation_process_fill_order( _self, b.timestamp ) );
+         o_op->op.visit( operation_process_fill_order( _self, b.timestamp, fills, &block_fills.fills, track_buckets,
+                                                          restored ) );
    }
+   if( !block_fills.fills.empty() )
+      _pending_fills.push_back( std::move( block_fills ) );
+
+   update_buckets( db.get_dynamic_global_properties().last_irreversible_block_num );
 }
 
 } // end namespace detail
@@ -264,9 +513,19 @@ void market_history_plugin::plugin_set_program_options(
 
 void market_history_plugin::plugin_initialize(const boost::program_options::variables_map& options)
 { try {
-   database().applied_block.connect( [&]( const signed_block& b){ my->update_market_histories(b); } );
+   connect_applied_block( [this]( const signed_block& b){ my->update_market_histories(b); } );
+   database().require_applied_operations();
    database().add_index< primary_index< bucket_index  > >();
-   database().add_index< primary_index< history_index  > >();
+   auto history_idx = database().add_index< primary_index< history_index  > >();
+   history_idx->add_secondary_index< market_fill_history >();
+   my->_fill_history = &history_idx->get_secondary_index< market_fill_history >();
+   database().add_index< primary_index< market_ticker_index  > >();
+   database().add_index< primary_index< market_stats_index  > >();
+   database().add_index< primary_index< asset_market_stats_index  > >();
+   // only changed for irreversible blocks, popping a later block must leave them alone
+   database()._undo_db.exempt( bucket_object::space_id, bucket_object::type_id );
+   database()._undo_db.exempt( market_stats_object::space_id, market_stats_object::type_id );
+   database()._undo_db.exempt( asset_market_stats_object::space_id, asset_market_stats_object::type_id );
 
    if( options.count( "bucket-size" ) )
    {
@@ -286,6 +545,11 @@ const flat_set<uint32_t>& market_history_plugin::tracked_buckets() const
    return my->_tracked_buckets;
 }
 
+const market_fill_history& market_history_plugin::fill_history()const
+{
+   return *my->_fill_history;
+}
+
 uint32_t market_history_plugin::max_history()const
 {
    return my->_maximum_history_per_bucket_size;
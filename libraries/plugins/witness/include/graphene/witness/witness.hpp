@@ -27,6 +27,7 @@
 #include <graphene/chain/database.hpp>
 
 #include <fc/thread/future.hpp>
+#include <fc/variant_object.hpp>
 
 namespace graphene { namespace witness_plugin {
 
@@ -46,6 +47,17 @@ namespace block_production_condition
    };
 }
 
+/** a moving average and the maximum of one of the block production timings */
+struct production_timing
+{
+   uint64_t         samples = 0;
+   fc::microseconds average;
+   fc::microseconds max;
+
+   void record( fc::microseconds sample );
+   fc::variant_object get_statistics()const;
+};
+
 class witness_plugin : public graphene::app::plugin {
 public:
    ~witness_plugin() {
@@ -68,6 +80,12 @@ public:
 
    void set_block_production(bool allow) { _production_enabled = allow; }
 
+   /**
+    * How late the production loop woke up, how long our blocks took to build and sign, to apply after they were
+    * signed, and from starting to generate them until they were handed to the p2p node
+    */
+   fc::variant_object get_production_statistics()const;
+
    virtual void plugin_initialize( const boost::program_options::variables_map& options ) override;
    virtual void plugin_startup() override;
    virtual void plugin_shutdown() override;
@@ -76,6 +94,8 @@ private:
    void schedule_production_loop();
    block_production_condition::block_production_condition_enum block_production_loop();
    block_production_condition::block_production_condition_enum maybe_produce_block( fc::mutable_variant_object& capture );
+   /** builds the block ahead of time if the next wakeup is one of our slots */
+   void maybe_prepare_block();
 
    boost::program_options::variables_map _options;
    bool _production_enabled = false;
@@ -86,6 +106,13 @@ private:
    std::map<chain::public_key_type, fc::ecc::private_key> _private_keys;
    std::set<chain::witness_id_type> _witnesses;
    fc::future<void> _block_production_task;
+
+   /** the NTP time the production loop is scheduled to wake up at */
+   fc::time_point    _next_wakeup;
+   production_timing _wake_jitter;
+   production_timing _generation_time;
+   production_timing _apply_time;
+   production_timing _broadcast_latency;
 };
 
 } } //graphene::witness_plugin
@@ -157,16 +157,20 @@ void witness_plugin::schedule_production_loop()
        time_to_next_second += 1000000;
 
    fc::time_point next_wakeup( fc_now + fc::microseconds( time_to_next_second ) );
+   _next_wakeup = ntp_now + fc::microseconds( time_to_next_second );
 
    //wdump( (now.time_since_epoch().count())(next_wakeup.time_since_epoch().count()) );
+   // slots start on whole seconds, so this is the slot time whenever one of ours is next.  The production task
+   // goes ahead of any other task that is ready on the chain thread at that time
    _block_production_task = fc::schedule([this]{block_production_loop();},
-                                         next_wakeup, "Witness Block Production");
+                                         next_wakeup, "Witness Block Production", fc::priority::max());
 }
 
 block_production_condition::block_production_condition_enum witness_plugin::block_production_loop()
 {
    block_production_condition::block_production_condition_enum result;
    fc::mutable_variant_object capture;
+   _wake_jitter.record( graphene::time::now() - _next_wakeup );
    try
    {
       result = maybe_produce_block(capture);
@@ -185,7 +189,7 @@ block_production_condition::block_production_condition_enum witness_plugin::bloc
    switch( result )
    {
       case block_production_condition::produced:
-         ilog("Generated block #${n} with timestamp ${t} at time ${c}", (capture));
+         ilog("Generated block #${n} with timestamp ${t} at time ${c}, broadcast after ${b}ms (average ${a}ms)", (capture));
          break;
       case block_production_condition::not_synced:
          ilog("Not producing block because production is disabled until we receive a recent block (see: --enable-stale-production)");
@@ -212,6 +216,9 @@ block_production_condition::block_production_condition_enum witness_plugin::bloc
          break;
    }
 
+   if( result != block_production_condition::produced )
+      maybe_prepare_block();
+
    schedule_production_loop();
    return result;
 }
@@ -280,14 +287,87 @@ block_production_condition::block_production_condition_enum witness_plugin::mayb
       return block_production_condition::lag;
    }
 
+   // the block goes out as soon as it is signed, the plugins' applied_block handlers run after that
+   fc::time_point generation_start = fc::time_point::now();
+   fc::time_point signed_time;
+   fc::microseconds broadcast_latency;
    auto block = db.generate_block(
       scheduled_time,
       scheduled_witness,
       private_key_itr->second,
-      _production_skip_flags
+      _production_skip_flags,
+      [&]( const chain::signed_block& b ) {
+         signed_time = fc::time_point::now();
+         p2p_node().broadcast_without_waiting( net::block_message( b ) );
+         broadcast_latency = fc::time_point::now() - generation_start;
+      }
       );
-   capture("n", block.block_num())("t", block.timestamp)("c", now);
-   fc::async( [this,block](){ p2p_node().broadcast(net::block_message(block)); } );
+   _generation_time.record( signed_time - generation_start );
+   _apply_time.record( fc::time_point::now() - signed_time );
+   _broadcast_latency.record( broadcast_latency );
+   capture("n", block.block_num())("t", block.timestamp)("c", now)
+          ("b", broadcast_latency.count() / 1000)("a", _broadcast_latency.average.count() / 1000);
 
    return block_production_condition::produced;
 }
+
+void production_timing::record( fc::microseconds sample )
+{
+   ++samples;
+   max = std::max( max, sample );
+   // an exponential moving average over roughly the last 16 samples
+   if( samples == 1 )
+      average = sample;
+   else
+      average = fc::microseconds( ( average.count() * 15 + sample.count() ) / 16 );
+}
+
+fc::variant_object production_timing::get_statistics()const
+{
+   return fc::mutable_variant_object()
+      ("samples", samples)
+      ("average_us", average.count())
+      ("max_us", max.count());
+}
+
+fc::variant_object witness_plugin::get_production_statistics()const
+{
+   return fc::mutable_variant_object()
+      ("wake_jitter", _wake_jitter.get_statistics())
+      ("generation_time", _generation_time.get_statistics())
+      ("apply_time", _apply_time.get_statistics())
+      ("broadcast_latency", _broadcast_latency.get_statistics());
+}
+
+void witness_plugin::maybe_prepare_block()
+{
+   if( !_production_enabled )
+      return;
+   try
+   {
+      chain::database& db = database();
+      // the slot maybe_produce_block() will look for at the next wakeup, a second from now
+      fc::time_point_sec next_wakeup = graphene::time::now() + fc::microseconds( 1500000 );
+      uint32_t slot = db.get_slot_at_time( next_wakeup );
+      if( slot == 0 )
+         return;
+
+      graphene::chain::witness_id_type scheduled_witness = db.get_scheduled_witness( slot );
+      if( _witnesses.find( scheduled_witness ) == _witnesses.end() )
+         return;
+      auto private_key_itr = _private_keys.find( scheduled_witness( db ).signing_key );
+      if( private_key_itr == _private_keys.end() )
+         return;
+
+      // building it again is a no-op while the head and the pending transactions haven't changed
+      db.prepare_block( db.get_slot_time( slot ), scheduled_witness, private_key_itr->second, _production_skip_flags );
+   }
+   catch( const fc::canceled_exception& )
+   {
+      throw;
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Got exception while preparing block, it will be built at its slot:\n${e}", ("e", e.to_detail_string()) );
+   }
+}
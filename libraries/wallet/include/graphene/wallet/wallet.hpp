@@ -179,6 +179,12 @@ struct wallet_data
 
    /** encrypted keys */
    vector<char>              cipher_keys;
+   /**
+    * Keys added since cipher_keys was last written, each entry a plain_keys encrypted like cipher_keys with the keys
+    * of one save of the wallet, so that adding keys doesn't encrypt all of them again.  Folded into cipher_keys once
+    * there are many.
+    */
+   vector< vector<char> >    cipher_keys_journal;
 
    /** map an account to a set of extra keys that have been imported for that account */
    map<account_id_type, set<public_key_type> >  extra_keys;
@@ -194,6 +200,12 @@ struct wallet_data
    string                    ws_server = "ws://localhost:8090";
    string                    ws_user;
    string                    ws_password;
+
+   /**
+    * Operations of account histories already read, so that they are only fetched once.  For each account an unbroken
+    * run of its operations, newest first, all of them in irreversible blocks so they can't change any more.
+    */
+   map<account_id_type, vector<operation_history_object> > account_history;
 };
 
 struct exported_account_keys
@@ -252,6 +264,49 @@ struct vesting_balance_object_with_info : public vesting_balance_object
    fc::time_point_sec allowed_withdraw_time;
 };
 
+/** one of the transfers of wallet_api::transfer_batch() */
+struct batch_transfer
+{
+   string to;
+   string amount;
+   string asset_symbol;
+   string memo;
+};
+
+/** what became of one of the transfers of wallet_api::transfer_batch() */
+struct batch_transfer_result
+{
+   optional<uint32_t> transaction;       ///< the index of the transaction it is in, none if it couldn't be made
+   bool               accepted = false;  ///< whether the node accepted its transaction to broadcast
+   string             error;
+};
+
+struct transfer_batch_result
+{
+   vector<signed_transaction>    transactions;
+   /** in the order the transfers were given */
+   vector<batch_transfer_result> transfers;
+};
+
+/** what became of a transaction broadcast while broadcasting asynchronously, see wallet_api::set_async_broadcast() */
+struct broadcast_status
+{
+   enum state_type
+   {
+      sending,    ///< not accepted by the node yet
+      pending,    ///< accepted and broadcast by the node, not in a block yet
+      confirmed,  ///< included in block block_num
+      failed      ///< rejected by the node, or expired before it was included
+   };
+
+   transaction_id_type         id;
+   state_type                  state = sending;
+   uint32_t                    block_num = 0;
+   uint32_t                    trx_num = 0;
+   string                      error;
+   fc::time_point_sec          expiration;
+};
+
 namespace detail {
 class wallet_api_impl;
 }
@@ -336,6 +391,16 @@ class wallet_api
        */
       vector<operation_detail>  get_account_history(string name, int limit)const;
 
+      /** Reads memos to or from the keys of this wallet.
+       *
+       * The shared secret of each pair of keys is kept until the wallet is locked, so reading many memos
+       * between the same accounts, such as the deposits to an account, derives it only once.
+       *
+       * @param memos the memos to read, for example from the transfers of an account's history
+       * @returns the text of each memo, or null for memos the wallet has no key for or which fail to decrypt
+       */
+      vector< optional<string> > read_memos( vector<memo_data> memos )const;
+
 
       vector<bucket_object>             get_market_history(string symbol, string symbol2, uint32_t bucket)const;
       vector<limit_order_object>        get_limit_orders(string a, string b, uint32_t limit)const;
@@ -576,6 +641,14 @@ class wallet_api
        */
       brain_key_info suggest_brain_key()const;
 
+      /** Derives the keys of a brain key with sequence numbers 0 to number_of_desired_keys - 1, for instance to
+       * find the accounts it was used for.  The keys are derived in parallel.
+       * @param brain_key the brain key, normalized like create_account_with_brain_key() does
+       * @param number_of_desired_keys how many keys to derive, at least 1
+       * @returns the key of each sequence number, in order
+       */
+      vector<brain_key_info> derive_owner_keys_from_brain_key( string brain_key, int number_of_desired_keys = 1 )const;
+
       /** Converts a signed_transaction in JSON form to its binary representation.
        *
        * TODO: I don't see a broadcast_transaction() function, do we need one?
@@ -721,6 +794,35 @@ class wallet_api
       }
 
 
+      /** Transfer from one account to many.
+       *
+       * The transfers are packed into as few transactions as the maximum transaction size allows, each signed once,
+       * and the transactions are given to the node in one call.  A transfer that can't be made, or whose transaction
+       * the node rejects, doesn't stop the others, see the result of each.
+       *
+       * @param from the name or id of the account sending the funds
+       * @param transfers the recipients, amounts, assets and memos, as for transfer()
+       * @param broadcast true to broadcast the transactions on the network
+       * @returns the signed transactions, and the result of each transfer
+       */
+      transfer_batch_result transfer_batch(string from,
+                                           vector<batch_transfer> transfers,
+                                           bool broadcast = false);
+
+      /** Whether the transactions of the commands called with broadcast true are broadcast asynchronously.
+       *
+       * Asynchronous broadcasts return the signed transaction at once, before the node has even seen it, and what
+       * became of it is looked up with get_broadcast_status().  The default is to wait for the node to accept each
+       * transaction, which throws the node's error if it doesn't.
+       */
+      void set_async_broadcast( bool async );
+
+      /** What became of a transaction broadcast asynchronously.  Finished transactions are forgotten ten minutes
+       * after they are finished.
+       * @param id the id of the transaction, as returned by get_transaction_id()
+       */
+      broadcast_status get_broadcast_status( transaction_id_type id )const;
+
       /**
        *  This method is used to convert a JSON transaction to its transactin ID.
        */
@@ -1492,6 +1594,7 @@ FC_REFLECT( graphene::wallet::wallet_data,
             (chain_id)
             (my_accounts)
             (cipher_keys)
+            (cipher_keys_journal)
             (extra_keys)
             (pending_account_registrations)(pending_witness_registrations)
             (labeled_keys)
@@ -1499,6 +1602,7 @@ FC_REFLECT( graphene::wallet::wallet_data,
             (ws_server)
             (ws_user)
             (ws_password)
+            (account_history)
           )
 
 FC_REFLECT( graphene::wallet::brain_key_info,
@@ -1535,6 +1639,13 @@ FC_REFLECT_DERIVED( graphene::wallet::signed_block_with_info, (graphene::chain::
 FC_REFLECT_DERIVED( graphene::wallet::vesting_balance_object_with_info, (graphene::chain::vesting_balance_object),
    (allowed_withdraw)(allowed_withdraw_time) )
 
+FC_REFLECT( graphene::wallet::batch_transfer, (to)(amount)(asset_symbol)(memo) )
+FC_REFLECT( graphene::wallet::batch_transfer_result, (transaction)(accepted)(error) )
+FC_REFLECT( graphene::wallet::transfer_batch_result, (transactions)(transfers) )
+
+FC_REFLECT_ENUM( graphene::wallet::broadcast_status::state_type, (sending)(pending)(confirmed)(failed) )
+FC_REFLECT( graphene::wallet::broadcast_status, (id)(state)(block_num)(trx_num)(error)(expiration) )
+
 FC_REFLECT( graphene::wallet::operation_detail, 
             (memo)(description)(op) )
 
@@ -1565,6 +1676,7 @@ FC_API( graphene::wallet::wallet_api,
         (import_account_keys)
         (import_balance)
         (suggest_brain_key)
+        (derive_owner_keys_from_brain_key)
         (register_account)
         (upgrade_account)
         (create_account_with_brain_key)
@@ -1575,6 +1687,9 @@ FC_API( graphene::wallet::wallet_api,
         (cancel_order)
         (transfer)
         (transfer2)
+        (transfer_batch)
+        (set_async_broadcast)
+        (get_broadcast_status)
         (get_transaction_id)
         (create_asset)
         (update_asset)
@@ -1609,6 +1724,7 @@ FC_API( graphene::wallet::wallet_api,
         (get_block)
         (get_account_count)
         (get_account_history)
+        (read_memos)
         (get_market_history)
         (get_global_properties)
         (get_dynamic_global_properties)
@@ -29,6 +29,8 @@
 #include <sstream>
 #include <string>
 #include <list>
+#include <thread>
+#include <deque>
 
 #include <boost/version.hpp>
 #include <boost/lexical_cast.hpp>
@@ -58,9 +60,11 @@
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/hex.hpp>
 #include <fc/thread/mutex.hpp>
+#include <fc/thread/thread.hpp>
 #include <fc/thread/scoped_lock.hpp>
 
 #include <graphene/app/api.hpp>
+#include <graphene/app/impacted.hpp>
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <graphene/utilities/git_revision.hpp>
@@ -96,6 +100,21 @@ public:
    std::string operator()(const asset& a);
 };
 
+/** collects the assets an operation_printer is going to describe amounts of */
+struct operation_asset_collector
+{
+   flat_set<asset_id_type>& assets;
+   typedef void result_type;
+
+   template<typename T>
+   void operator()( const T& op )const { assets.insert( op.fee.asset_id ); }
+   void operator()( const transfer_operation& op )const
+   {
+      assets.insert( op.fee.asset_id );
+      assets.insert( op.amount.asset_id );
+   }
+};
+
 // BLOCK  TRX  OP  VOP
 struct operation_printer
 {
@@ -404,6 +423,12 @@ public:
       }
       init_prototype_ops();
 
+      // set before anything is read, so that everything read is subscribed to and the caches stay current
+      _remote_db->set_subscribe_callback( [this]( const variant& updates )
+      {
+         on_objects_changed( updates );
+      }, false );
+
       _remote_db->set_block_applied_callback( [this](const variant& block_id )
       {
          on_block_applied( block_id );
@@ -432,14 +457,60 @@ public:
 
    void encrypt_keys()
    {
-      if( !is_locked() )
+      if( is_locked() )
+         return;
+
+      plain_keys added;
+      added.checksum = _checksum;
+      for( const auto& key : _keys )
+         if( _encrypted_keys.find( key.first ) == _encrypted_keys.end() )
+            added.keys.insert( key );
+
+      // a new password, or keys that are no longer there, need everything encrypted again
+      const bool rewrite = _wallet.cipher_keys.empty() || _encrypted_with != _checksum
+                           || _encrypted_keys.size() + added.keys.size() != _keys.size()
+                           || _wallet.cipher_keys_journal.size() >= max_cipher_keys_journal;
+      if( !rewrite )
       {
-         plain_keys data;
-         data.keys = _keys;
-         data.checksum = _checksum;
-         auto plain_txt = fc::raw::pack(data);
-         _wallet.cipher_keys = fc::aes_encrypt( data.checksum, plain_txt );
+         if( added.keys.empty() )
+            return;
+         _wallet.cipher_keys_journal.push_back( fc::aes_encrypt( _checksum, fc::raw::pack( added ) ) );
+         for( const auto& key : added.keys )
+            _encrypted_keys.insert( key.first );
+         return;
       }
+
+      plain_keys data;
+      data.keys = _keys;
+      data.checksum = _checksum;
+      auto plain_txt = fc::raw::pack(data);
+      _wallet.cipher_keys = fc::aes_encrypt( data.checksum, plain_txt );
+      _wallet.cipher_keys_journal.clear();
+      _encrypted_keys.clear();
+      for( const auto& key : _keys )
+         _encrypted_keys.insert( key.first );
+      _encrypted_with = _checksum;
+   }
+
+   /** the keys of cipher_keys and its journal, or an exception if the password isn't the one they're encrypted with */
+   void decrypt_keys( const fc::sha512& pw )
+   {
+      vector<char> decrypted = fc::aes_decrypt(pw, _wallet.cipher_keys);
+      auto pk = fc::raw::unpack<plain_keys>(decrypted);
+      FC_ASSERT(pk.checksum == pw);
+      for( const vector<char>& entry : _wallet.cipher_keys_journal )
+      {
+         auto added = fc::raw::unpack<plain_keys>( fc::aes_decrypt( pw, entry ) );
+         FC_ASSERT( added.checksum == pw );
+         for( auto& key : added.keys )
+            pk.keys[key.first] = std::move( key.second );
+      }
+      _keys = std::move(pk.keys);
+      _checksum = pk.checksum;
+      _encrypted_keys.clear();
+      for( const auto& key : _keys )
+         _encrypted_keys.insert( key.first );
+      _encrypted_with = _checksum;
    }
 
    void on_block_applied( const variant& block_id )
@@ -447,6 +518,57 @@ public:
       fc::async([this]{resync();}, "Resync after block");
    }
 
+   /** updates the cached objects from a notification of the subscribe callback, which doesn't yield */
+   void on_objects_changed( const variant& updates )
+   {
+      if( !updates.is_array() )
+         return;
+      for( const variant& update : updates.get_array() )
+      {
+         const object_id_type id = update.is_object() ? update["id"].as<object_id_type>() : update.as<object_id_type>();
+         if( id.is<account_id_type>() )
+         {
+            auto itr = _account_cache.find( id );
+            if( itr != _account_cache.end() )
+            {
+               _account_ids_by_name.erase( itr->second.name );
+               _account_cache.erase( itr );
+            }
+            if( update.is_object() )
+               cache_account( update.as<account_object>() );
+         }
+         else if( id.is<asset_id_type>() )
+         {
+            auto itr = _asset_cache.find( id );
+            if( itr != _asset_cache.end() )
+            {
+               _asset_ids_by_symbol.erase( itr->second.symbol );
+               _asset_cache.erase( itr );
+            }
+            if( update.is_object() )
+               cache_asset( update.as<asset_object>() );
+         }
+         else if( id == global_property_id_type() )
+         {
+            if( update.is_object() )
+               _global_properties_cache = update.as<global_property_object>();
+            else
+               _global_properties_cache.reset();
+         }
+      }
+   }
+
+   void cache_account( const account_object& a )const
+   {
+      _account_cache[a.id] = a;
+      _account_ids_by_name[a.name] = a.id;
+   }
+   void cache_asset( const asset_object& a )const
+   {
+      _asset_cache[a.id] = a;
+      _asset_ids_by_symbol[a.symbol] = a.id;
+   }
+
    bool copy_wallet_file( string destination_filename )
    {
       fc::path src_path = get_wallet_filename();
@@ -557,7 +679,11 @@ public:
    }
    global_property_object get_global_properties() const
    {
-      return _remote_db->get_global_properties();
+      if( !_global_properties_cache )
+         // read as an object to subscribe to it
+         _global_properties_cache = _remote_db->get_objects( { global_property_id_type() } ).front()
+                                                .as<global_property_object>();
+      return *_global_properties_cache;
    }
    dynamic_global_property_object get_dynamic_global_properties() const
    {
@@ -567,9 +693,28 @@ public:
    {
       if( _wallet.my_accounts.get<by_id>().count(id) )
          return *_wallet.my_accounts.get<by_id>().find(id);
+      return find_account( id );
+   }
+   /** the account from the cache or else the node, which never caches accounts that don't exist yet */
+   const account_object& find_account( account_id_type id )const
+   {
+      auto itr = _account_cache.find( id );
+      if( itr != _account_cache.end() )
+         return itr->second;
       auto rec = _remote_db->get_accounts({id}).front();
       FC_ASSERT(rec);
-      return *rec;
+      cache_account( *rec );
+      return _account_cache[id];
+   }
+   optional<account_object> find_account( const string& name )const
+   {
+      auto itr = _account_ids_by_name.find( name );
+      if( itr != _account_ids_by_name.end() )
+         return _account_cache[itr->second];
+      auto rec = _remote_db->lookup_account_names({name}).front();
+      if( rec )
+         cache_account( *rec );
+      return rec;
    }
    account_object get_account(string account_name_or_id) const
    {
@@ -584,7 +729,7 @@ public:
          if( _wallet.my_accounts.get<by_name>().count(account_name_or_id) )
          {
             auto local_account = *_wallet.my_accounts.get<by_name>().find(account_name_or_id);
-            auto blockchain_account = _remote_db->lookup_account_names({account_name_or_id}).front();
+            auto blockchain_account = find_account( account_name_or_id );
             FC_ASSERT( blockchain_account );
             if (local_account.id != blockchain_account->id)
                elog("my account id ${id} different from blockchain id ${id2}", ("id", local_account.id)("id2", blockchain_account->id));
@@ -593,7 +738,7 @@ public:
 
             return *_wallet.my_accounts.get<by_name>().find(account_name_or_id);
          }
-         auto rec = _remote_db->lookup_account_names({account_name_or_id}).front();
+         auto rec = find_account( account_name_or_id );
          FC_ASSERT( rec && rec->name == account_name_or_id );
          return *rec;
       }
@@ -604,9 +749,12 @@ public:
    }
    optional<asset_object> find_asset(asset_id_type id)const
    {
+      auto itr = _asset_cache.find( id );
+      if( itr != _asset_cache.end() )
+         return itr->second;
       auto rec = _remote_db->get_assets({id}).front();
       if( rec )
-         _asset_cache[id] = *rec;
+         cache_asset( *rec );
       return rec;
    }
    optional<asset_object> find_asset(string asset_symbol_or_id)const
@@ -619,13 +767,16 @@ public:
          return find_asset(*id);
       } else {
          // It's a symbol
+         auto cached = _asset_ids_by_symbol.find( asset_symbol_or_id );
+         if( cached != _asset_ids_by_symbol.end() )
+            return _asset_cache[cached->second];
          auto rec = _remote_db->lookup_asset_symbols({asset_symbol_or_id}).front();
          if( rec )
          {
             if( rec->symbol != asset_symbol_or_id )
                return optional<asset_object>();
 
-            _asset_cache[rec->get_id()] = *rec;
+            cache_asset( *rec );
          }
          return rec;
       }
@@ -649,8 +800,12 @@ public:
       vector<optional<asset_object>> opt_asset;
       if( std::isdigit( asset_symbol_or_id.front() ) )
          return fc::variant(asset_symbol_or_id).as<asset_id_type>();
+      auto cached = _asset_ids_by_symbol.find( asset_symbol_or_id );
+      if( cached != _asset_ids_by_symbol.end() )
+         return cached->second;
       opt_asset = _remote_db->lookup_asset_symbols( {asset_symbol_or_id} );
       FC_ASSERT( (opt_asset.size() > 0) && (opt_asset[0].valid()) );
+      cache_asset( *opt_asset[0] );
       return opt_asset[0]->id;
    }
 
@@ -709,6 +864,68 @@ public:
 
    vector< signed_transaction > import_balance( string name_or_id, const vector<string>& wif_keys, bool broadcast );
 
+   /**
+    * Calls work(i) for every i below count, spread over a thread for each core.  Meant for deriving keys and
+    * addresses, which need nothing of the wallet; work must not touch it.  Rethrows the first exception of any.
+    */
+   template<typename Work>
+   void derive_in_parallel( size_t count, const Work& work )const
+   {
+      // not worth a switch of threads below this
+      if( count < 64 )
+      {
+         for( size_t i = 0; i < count; ++i )
+            work( i );
+         return;
+      }
+      if( _derivation_threads.empty() )
+      {
+         const size_t n = std::max( std::thread::hardware_concurrency(), 1u );
+         for( size_t t = 0; t < n; ++t )
+            _derivation_threads.emplace_back( new fc::thread( "wallet key derivation " + std::to_string( t ) ) );
+      }
+      const size_t per_thread = ( count + _derivation_threads.size() - 1 ) / _derivation_threads.size();
+      vector< fc::future<void> > done;
+      for( size_t begin = 0, t = 0; begin < count; begin += per_thread, ++t )
+      {
+         const size_t end = std::min( begin + per_thread, count );
+         done.push_back( _derivation_threads[t]->async( [&work,begin,end]() {
+            for( size_t i = begin; i < end; ++i )
+               work( i );
+         }, "derive keys" ) );
+      }
+      // the tasks use work and what it refers to, every one of them has to finish before an error is passed on
+      fc::exception_ptr error;
+      for( auto& d : done )
+      {
+         try
+         {
+            d.wait();
+         }
+         catch( const fc::exception& e )
+         {
+            if( !error )
+               error = e.dynamic_copy_exception();
+         }
+      }
+      if( error )
+         error->dynamic_rethrow_exception();
+   }
+
+   vector<brain_key_info> derive_owner_keys_from_brain_key( string brain_key, int number_of_desired_keys )const
+   {
+      FC_ASSERT( number_of_desired_keys >= 1 );
+      brain_key = normalize_brain_key( brain_key );
+      vector<brain_key_info> result( number_of_desired_keys );
+      derive_in_parallel( result.size(), [&]( size_t i ) {
+         fc::ecc::private_key priv_key = derive_private_key( brain_key, int( i ) );
+         result[i].brain_priv_key = brain_key;
+         result[i].wif_priv_key = key_to_wif( priv_key );
+         result[i].pub_key = priv_key.get_public_key();
+      } );
+      return result;
+   }
+
    bool load_wallet_file(string wallet_filename = "")
    {
       // TODO:  Merge imported wallet with existing wallet,
@@ -720,6 +937,9 @@ public:
          return false;
 
       _wallet = fc::json::from_file( wallet_filename ).as< wallet_data >();
+      // whatever this file's keys are, the next save encrypts all of them again
+      _encrypted_keys.clear();
+      _encrypted_with = fc::sha512();
       if( _wallet.chain_id != _chain_id )
          FC_THROW( "Wallet chain ID does not match",
             ("wallet.chain_id", _wallet.chain_id)
@@ -838,7 +1058,7 @@ public:
       auto fee_asset_obj = get_asset(fee_asset);
       asset total_fee = fee_asset_obj.amount(0);
 
-      auto gprops = _remote_db->get_global_properties().parameters;
+      auto gprops = get_global_properties().parameters;
       if( fee_asset_obj.get_id() != asset_id_type() )
       {
          for( auto& op : _builder_transactions[handle].operations )
@@ -880,7 +1100,7 @@ public:
       if( review_period_seconds )
          op.review_period_seconds = review_period_seconds;
       trx.operations = {op};
-      _remote_db->get_global_properties().parameters.current_fees->set_fee( trx.operations.front() );
+      get_global_properties().parameters.current_fees->set_fee( trx.operations.front() );
 
       return trx = sign_transaction(trx, broadcast);
    }
@@ -901,7 +1121,7 @@ public:
       if( review_period_seconds )
          op.review_period_seconds = review_period_seconds;
       trx.operations = {op};
-      _remote_db->get_global_properties().parameters.current_fees->set_fee( trx.operations.front() );
+      get_global_properties().parameters.current_fees->set_fee( trx.operations.front() );
 
       return trx = sign_transaction(trx, broadcast);
    }
@@ -951,7 +1171,7 @@ public:
 
       tx.operations.push_back( account_create_op );
 
-      auto current_fees = _remote_db->get_global_properties().parameters.current_fees;
+      auto current_fees = get_global_properties().parameters.current_fees;
       set_operation_fees( tx, current_fees );
 
       vector<public_key_type> paying_keys = registrar_account_object.active.get_keys();
@@ -992,7 +1212,7 @@ public:
       op.account_to_upgrade = account_obj.get_id();
       op.upgrade_to_lifetime_member = true;
       tx.operations = {op};
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees );
+      set_operation_fees( tx, get_global_properties().parameters.current_fees );
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1078,7 +1298,7 @@ public:
 
          tx.operations.push_back( account_create_op );
 
-         set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+         set_operation_fees( tx, get_global_properties().parameters.current_fees);
 
          vector<public_key_type> paying_keys = registrar_account_object.active.get_keys();
 
@@ -1143,7 +1363,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( create_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1172,7 +1392,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1193,7 +1413,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1217,7 +1437,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1239,7 +1459,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( publish_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1263,7 +1483,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( fund_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1285,7 +1505,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( reserve_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1306,7 +1526,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( settle_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1327,7 +1547,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( settle_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1345,7 +1565,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( whitelist_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1363,7 +1583,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( committee_member_create_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1459,7 +1679,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( witness_create_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       _wallet.pending_witness_registrations[owner_account] = key_to_wif(witness_private_key);
@@ -1486,7 +1706,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( witness_update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees );
+      set_operation_fees( tx, get_global_properties().parameters.current_fees );
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1537,7 +1757,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees );
+      set_operation_fees( tx, get_global_properties().parameters.current_fees );
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1602,7 +1822,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees );
+      set_operation_fees( tx, get_global_properties().parameters.current_fees );
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1660,7 +1880,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( vesting_balance_withdraw_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees );
+      set_operation_fees( tx, get_global_properties().parameters.current_fees );
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1695,7 +1915,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( account_update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1729,7 +1949,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( account_update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1760,7 +1980,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( account_update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1786,7 +2006,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back( account_update_op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1912,7 +2132,9 @@ public:
          ++expiration_time_offset;
       }
 
-      if( broadcast )
+      if( broadcast && _async_broadcast )
+         broadcast_async( tx );
+      else if( broadcast )
       {
          try
          {
@@ -1949,7 +2171,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back(op);
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction( tx, broadcast );
@@ -1970,7 +2192,7 @@ public:
 
       signed_transaction trx;
       trx.operations = {op};
-      set_operation_fees( trx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( trx, get_global_properties().parameters.current_fees);
       trx.validate();
       idump((broadcast));
 
@@ -1987,7 +2209,7 @@ public:
          op.fee_paying_account = get_object<limit_order_object>(order_id).seller;
          op.order = order_id;
          trx.operations = {op};
-         set_operation_fees( trx, _remote_db->get_global_properties().parameters.current_fees);
+         set_operation_fees( trx, get_global_properties().parameters.current_fees);
 
          trx.validate();
          return sign_transaction(trx, broadcast);
@@ -2022,12 +2244,320 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back(xfer_op);
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees( tx, get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction(tx, broadcast);
    } FC_CAPTURE_AND_RETHROW( (from)(to)(amount)(asset_symbol)(memo)(broadcast) ) }
 
+   /** gives the transaction to the node from a task of its own, and notes what becomes of it in _broadcasts */
+   void broadcast_async( const signed_transaction& tx )
+   {
+      const transaction_id_type id = tx.id();
+      // a transaction broadcast again starts over, at the end of the order
+      if( _broadcasts.find( id ) != _broadcasts.end() )
+      {
+         _broadcast_order.erase( std::remove( _broadcast_order.begin(), _broadcast_order.end(), id ),
+                                 _broadcast_order.end() );
+         _broadcast_finished.erase( id );
+      }
+      broadcast_status& status = _broadcasts[id];
+      status = broadcast_status();
+      status.id = id;
+      status.expiration = tx.expiration;
+      _broadcast_order.push_back( id );
+      forget_finished_broadcasts();
+
+      fc::async( [this,tx,id]() {
+         try
+         {
+            _remote_net_broadcast->broadcast_transaction_with_callback( [this,id]( const variant& confirmation ) {
+               auto itr = _broadcasts.find( id );
+               if( itr == _broadcasts.end() )
+                  return;
+               auto c = confirmation.as<network_broadcast_api::transaction_confirmation>();
+               itr->second.state = broadcast_status::confirmed;
+               itr->second.block_num = c.block_num;
+               itr->second.trx_num = c.trx_num;
+               _broadcast_finished[id] = fc::time_point::now();
+            }, tx );
+            auto itr = _broadcasts.find( id );
+            if( itr != _broadcasts.end() && itr->second.state == broadcast_status::sending )
+               itr->second.state = broadcast_status::pending;
+         }
+         catch( const fc::exception& e )
+         {
+            elog( "Caught exception while broadcasting tx ${id}:  ${e}", ("id", id.str())("e", e.to_detail_string()) );
+            auto itr = _broadcasts.find( id );
+            if( itr != _broadcasts.end() )
+            {
+               itr->second.state = broadcast_status::failed;
+               itr->second.error = e.to_string();
+               _broadcast_finished[id] = fc::time_point::now();
+            }
+         }
+      }, "Broadcast transaction" );
+   }
+
+   void forget_finished_broadcasts()
+   {
+      const fc::time_point forget_before = fc::time_point::now() - fc::minutes(10);
+      // the ones nobody asked about after they expired are forgotten as well
+      while( !_broadcast_order.empty() )
+      {
+         const transaction_id_type id = _broadcast_order.front();
+         auto status = _broadcasts.find( id );
+         auto finished = _broadcast_finished.find( id );
+         if( status != _broadcasts.end() )
+         {
+            const fc::time_point done = finished != _broadcast_finished.end() ? finished->second
+                                                                              : fc::time_point( status->second.expiration );
+            if( done > forget_before )
+               break;
+            _broadcasts.erase( status );
+         }
+         if( finished != _broadcast_finished.end() )
+            _broadcast_finished.erase( finished );
+         _broadcast_order.pop_front();
+      }
+   }
+
+   broadcast_status get_broadcast_status( transaction_id_type id )
+   {
+      auto itr = _broadcasts.find( id );
+      FC_ASSERT( itr != _broadcasts.end(), "Transaction ${id} was not broadcast asynchronously, or is forgotten",
+                 ("id",id) );
+      broadcast_status& status = itr->second;
+      // the node has no callback for transactions that never make it into a block, look at the chain's time
+      // once the local clock says the transaction may have expired
+      if( status.state == broadcast_status::pending && fc::time_point::now() > status.expiration
+          && get_dynamic_global_properties().time > status.expiration )
+      {
+         status.state = broadcast_status::failed;
+         status.error = "The transaction expired before it was included in a block";
+         _broadcast_finished[id] = fc::time_point::now();
+      }
+      return status;
+   }
+
+   /**
+    * Reads up to limit operations of the account's history from start down to but not including stop, newest first.
+    * @param exhausted set when there are no more operations above stop
+    */
+   vector<operation_history_object> fetch_account_history( account_id_type account, operation_history_id_type stop,
+                                                           uint32_t limit, operation_history_id_type start,
+                                                           bool& exhausted )const
+   {
+      vector<operation_history_object> result;
+      exhausted = false;
+      while( result.size() < limit )
+      {
+         const uint32_t page = std::min<uint32_t>( 100, limit - result.size() );
+         vector<operation_history_object> current = _remote_hist->get_account_history( account, stop, page, start );
+         result.insert( result.end(), current.begin(), current.end() );
+         if( current.size() < page || result.back().id.instance() <= stop.instance() + 1 )
+         {
+            exhausted = true;
+            break;
+         }
+         start = operation_history_id_type( result.back().id.instance() - 1 );
+      }
+      return result;
+   }
+
+   /** whether the node's operation with the id of o is o, at the same position in the same block */
+   bool node_has_operation( account_id_type account, const operation_history_object& o )const
+   {
+      vector<operation_history_object> found = _remote_hist->get_account_history( account, operation_history_id_type(),
+                                                                                1, o.id );
+      return !found.empty() && found.front().id == o.id && found.front().block_num == o.block_num
+          && found.front().trx_in_block == o.trx_in_block && found.front().op_in_trx == o.op_in_trx
+          && found.front().virtual_op == o.virtual_op;
+   }
+
+   /**
+    * The newest limit operations of the account's history.  Only the operations newer than the ones in the wallet's
+    * cache of the history are fetched, and the older ones beyond it; what is irreversible of them is added to it.
+    *
+    * The ids of operations are given by each node as it applies the blocks, so they differ between nodes.  The first
+    * time an account's cache is used in a session, its ends are compared with the node's operations of the same ids,
+    * and the cache is dropped if they are not the same operations.
+    */
+   vector<operation_history_object> get_account_history( account_id_type account, uint32_t limit )
+   {
+      if( _checked_history.insert( account ).second )
+      {
+         auto itr = _wallet.account_history.find( account );
+         if( itr != _wallet.account_history.end() && !itr->second.empty()
+             && !( node_has_operation( account, itr->second.front() )
+                   && node_has_operation( account, itr->second.back() ) ) )
+         {
+            _wallet.account_history.erase( itr );
+            save_wallet_file();
+         }
+      }
+
+      vector<operation_history_object>& cached = _wallet.account_history[account];
+      const uint32_t last_irreversible = get_dynamic_global_properties().last_irreversible_block_num;
+      bool reached_cache;
+      vector<operation_history_object> result =
+            fetch_account_history( account, cached.empty() ? operation_history_id_type() : cached.front().id, limit,
+                                   operation_history_id_type(), reached_cache );
+      const size_t newer = result.size();
+
+      // the operations fetched are an unbroken run, which continues the cache if they reach it
+      bool cache_changed = false;
+      vector<operation_history_object> older;
+      if( reached_cache || cached.empty() )
+      {
+         if( reached_cache )
+         {
+            for( auto itr = cached.begin(); itr != cached.end() && result.size() < limit; ++itr )
+               result.push_back( *itr );
+            if( result.size() < limit && !cached.empty() && cached.back().id.instance() > 1 )
+            {
+               bool reached_first;
+               older = fetch_account_history( account, operation_history_id_type(), limit - result.size(),
+                                              operation_history_id_type( cached.back().id.instance() - 1 ),
+                                              reached_first );
+               result.insert( result.end(), older.begin(), older.end() );
+            }
+         }
+
+         size_t first_irreversible = 0;
+         while( first_irreversible < newer && result[first_irreversible].block_num > last_irreversible )
+            ++first_irreversible;
+         if( first_irreversible < newer )
+         {
+            cached.insert( cached.begin(), result.begin() + first_irreversible, result.begin() + newer );
+            cache_changed = true;
+         }
+         for( const operation_history_object& o : older )
+         {
+            if( o.block_num > last_irreversible )
+               break;
+            cached.push_back( o );
+            cache_changed = true;
+         }
+      }
+      if( cached.empty() )
+         _wallet.account_history.erase( account );
+      if( cache_changed )
+         save_wallet_file();
+      return result;
+   }
+
+   /** reads the accounts and assets the descriptions of the operations name into the caches, one call for each */
+   void prefetch_history_objects( const vector<operation_history_object>& ops )const
+   {
+      flat_set<account_id_type> accounts;
+      flat_set<asset_id_type> assets;
+      for( const operation_history_object& o : ops )
+      {
+         graphene::app::operation_get_impacted_accounts( o.op, accounts );
+         o.op.visit( operation_asset_collector{ assets } );
+      }
+
+      vector<account_id_type> missing_accounts;
+      for( const account_id_type& a : accounts )
+         if( _account_cache.find( a ) == _account_cache.end() )
+            missing_accounts.push_back( a );
+      if( !missing_accounts.empty() )
+         for( const optional<account_object>& a : _remote_db->get_accounts( missing_accounts ) )
+            if( a )
+               cache_account( *a );
+
+      vector<asset_id_type> missing_assets;
+      for( const asset_id_type& a : assets )
+         if( _asset_cache.find( a ) == _asset_cache.end() )
+            missing_assets.push_back( a );
+      if( !missing_assets.empty() )
+         for( const optional<asset_object>& a : _remote_db->get_assets( missing_assets ) )
+            if( a )
+               cache_asset( *a );
+   }
+
+   transfer_batch_result transfer_batch( string from, const vector<batch_transfer>& transfers, bool broadcast )
+   { try {
+      FC_ASSERT( !self.is_locked() );
+      account_object from_account = get_account(from);
+      const global_property_object global_props = get_global_properties();
+      const uint32_t max_size = global_props.parameters.maximum_transaction_size;
+      // room for the header, the operation count and a signature with each key that may sign
+      const size_t overhead = fc::raw::pack_size( signed_transaction() ) + 5
+                            + from_account.active.key_auths.size() * fc::raw::pack_size( fc::ecc::compact_signature() );
+      optional<fc::ecc::private_key> memo_key;
+
+      transfer_batch_result result;
+      result.transfers.resize( transfers.size() );
+      signed_transaction tx;
+      size_t tx_size = overhead;
+      auto finish_transaction = [&]() {
+         if( tx.operations.empty() )
+            return;
+         tx.validate();
+         result.transactions.push_back( sign_transaction( tx, false ) );
+         tx = signed_transaction();
+         tx_size = overhead;
+      };
+
+      for( size_t i = 0; i < transfers.size(); ++i )
+      {
+         const batch_transfer& t = transfers[i];
+         try
+         {
+            asset_object asset_obj = get_asset( t.asset_symbol );
+            account_object to_account = get_account( t.to );
+
+            transfer_operation xfer_op;
+            xfer_op.from = from_account.id;
+            xfer_op.to = to_account.id;
+            xfer_op.amount = asset_obj.amount_from_string( t.amount );
+            if( t.memo.size() )
+            {
+               if( !memo_key )
+                  memo_key = get_private_key( from_account.options.memo_key );
+               xfer_op.memo = memo_data();
+               xfer_op.memo->from = from_account.options.memo_key;
+               xfer_op.memo->to = to_account.options.memo_key;
+               xfer_op.memo->set_message( *memo_key, to_account.options.memo_key, t.memo );
+            }
+
+            operation op = xfer_op;
+            global_props.parameters.current_fees->set_fee( op );
+            graphene::chain::operation_validate( op );
+            const size_t op_size = fc::raw::pack_size( op );
+            FC_ASSERT( overhead + op_size <= max_size, "The transfer doesn't fit in a transaction" );
+            if( tx_size + op_size > max_size )
+               finish_transaction();
+            tx.operations.push_back( std::move( op ) );
+            tx_size += op_size;
+            result.transfers[i].transaction = result.transactions.size();
+         }
+         catch( const fc::exception& e )
+         {
+            result.transfers[i].error = e.to_string();
+         }
+      }
+      finish_transaction();
+
+      if( broadcast && !result.transactions.empty() )
+      {
+         vector<network_broadcast_api::transaction_broadcast_result> broadcast_results =
+               _remote_net_broadcast->broadcast_transactions( result.transactions );
+         FC_ASSERT( broadcast_results.size() == result.transactions.size() );
+         for( batch_transfer_result& r : result.transfers )
+         {
+            if( !r.transaction )
+               continue;
+            const auto& b = broadcast_results[*r.transaction];
+            r.accepted = b.accepted;
+            r.error = b.error;
+         }
+      }
+      return result;
+   } FC_CAPTURE_AND_RETHROW( (from)(broadcast) ) }
+
    signed_transaction issue_asset(string to_account, string amount, string symbol,
                                   string memo, bool broadcast = false)
    {
@@ -2052,7 +2582,7 @@ public:
 
       signed_transaction tx;
       tx.operations.push_back(issue_op);
-      set_operation_fees(tx,_remote_db->get_global_properties().parameters.current_fees);
+      set_operation_fees(tx,get_global_properties().parameters.current_fees);
       tx.validate();
 
       return sign_transaction(tx, broadcast);
@@ -2575,6 +3105,25 @@ public:
 
    map<public_key_type,string> _keys;
    fc::sha512                  _checksum;
+   /** the keys of _keys that memos were read with, and their shared secrets; cleared when the wallet locks */
+   mutable memo_decryptor      _memo_decryptor;
+
+   /** @return the text of the memo, null if no key of the wallet can read it */
+   optional<string> read_memo( const memo_data& memo )const
+   {
+      for( const auto& k : { memo.to, memo.from } )
+      {
+         if( _memo_decryptor.has_key( k ) )
+            continue;
+         auto itr = _keys.find( k );
+         if( itr == _keys.end() )
+            continue;
+         auto key = wif_to_key( itr->second );
+         FC_ASSERT( key, "Unable to recover private key to decrypt memo. Wallet may be corrupted." );
+         _memo_decryptor.add_key( *key );
+      }
+      return _memo_decryptor.decrypt( memo );
+   }
 
    chain_id_type           _chain_id;
    fc::api<login_api>      _remote_api;
@@ -2593,7 +3142,31 @@ public:
 #endif
    const string _wallet_filename_extension = ".wallet";
 
+   /**
+    * Accounts, assets and the global properties as read from the node.  Reading them subscribes to them, and
+    * on_objects_changed() replaces them as the node reports their changes, so each is only fetched once.
+    */
    mutable map<asset_id_type, asset_object> _asset_cache;
+   mutable map<string, asset_id_type>       _asset_ids_by_symbol;
+   mutable map<account_id_type, account_object> _account_cache;
+   mutable map<string, account_id_type>     _account_ids_by_name;
+   mutable optional<global_property_object> _global_properties_cache;
+
+   /** the keys in cipher_keys and its journal, and the password they're encrypted with */
+   std::set<public_key_type>                       _encrypted_keys;
+   fc::sha512                                      _encrypted_with;
+   static const size_t                             max_cipher_keys_journal = 64;
+
+   mutable vector< std::unique_ptr<fc::thread> >   _derivation_threads;
+
+   bool                                            _async_broadcast = false;
+   /** the transactions broadcast asynchronously, in the order they were broadcast */
+   map<transaction_id_type, broadcast_status>      _broadcasts;
+   std::deque<transaction_id_type>                 _broadcast_order;
+   map<transaction_id_type, fc::time_point>        _broadcast_finished;
+
+   /** the accounts whose cached history has been checked against the node this session */
+   flat_set<account_id_type>                       _checked_history;
 };
 
 std::string operation_printer::fee(const asset& a)const {
@@ -2656,17 +3229,10 @@ string operation_printer::operator()(const transfer_operation& op) const
       } else {
          try {
             FC_ASSERT(wallet._keys.count(op.memo->to) || wallet._keys.count(op.memo->from), "Memo is encrypted to a key ${to} or ${from} not in this wallet.", ("to", op.memo->to)("from",op.memo->from));
-            if( wallet._keys.count(op.memo->to) ) {
-               auto my_key = wif_to_key(wallet._keys.at(op.memo->to));
-               FC_ASSERT(my_key, "Unable to recover private key to decrypt memo. Wallet may be corrupted.");
-               memo = op.memo->get_message(*my_key, op.memo->from);
-               out << " -- Memo: " << memo;
-            } else {
-               auto my_key = wif_to_key(wallet._keys.at(op.memo->from));
-               FC_ASSERT(my_key, "Unable to recover private key to decrypt memo. Wallet may be corrupted.");
-               memo = op.memo->get_message(*my_key, op.memo->to);
-               out << " -- Memo: " << memo;
-            }
+            auto text = wallet.read_memo( *op.memo );
+            FC_ASSERT( text, "Memo does not decrypt with the keys of this wallet" );
+            memo = *text;
+            out << " -- Memo: " << memo;
          } catch (const fc::exception& e) {
             out << " -- could not decrypt memo";
             elog("Error when decrypting memo: ${e}", ("e", e.to_detail_string()));
@@ -2772,31 +3338,29 @@ vector<operation_detail> wallet_api::get_account_history(string name, int limit)
    vector<operation_detail> result;
    auto account_id = get_account(name).get_id();
 
-   while( limit > 0 )
-   {
-      operation_history_id_type start;
-      if( result.size() )
-      {
-         start = result.back().op.id;
-         start = start + 1;
-      }
-
-
-      vector<operation_history_object> current = my->_remote_hist->get_account_history(account_id, operation_history_id_type(), std::min(100,limit), start);
-      for( auto& o : current ) {
-         std::stringstream ss;
-         auto memo = o.op.visit(detail::operation_printer(ss, *my, o.result));
-         result.push_back( operation_detail{ memo, ss.str(), o } );
-      }
-      if( current.size() < std::min(100,limit) )
-         break;
-      limit -= current.size();
+   vector<operation_history_object> ops = my->get_account_history( account_id, std::max( limit, 0 ) );
+   my->prefetch_history_objects( ops );
+   result.reserve( ops.size() );
+   for( auto& o : ops ) {
+      std::stringstream ss;
+      auto memo = o.op.visit(detail::operation_printer(ss, *my, o.result));
+      result.push_back( operation_detail{ memo, ss.str(), o } );
    }
 
    return result;
 }
 
 
+vector< optional<string> > wallet_api::read_memos( vector<memo_data> memos )const
+{
+   FC_ASSERT( !is_locked() );
+   vector< optional<string> > result;
+   result.reserve( memos.size() );
+   for( const auto& memo : memos )
+      result.push_back( my->read_memo( memo ) );
+   return result;
+}
+
 vector<bucket_object> wallet_api::get_market_history( string symbol1, string symbol2, uint32_t bucket )const
 {
    return my->_remote_hist->get_market_history( get_asset_id(symbol1), get_asset_id(symbol2), bucket, fc::time_point_sec(), fc::time_point::now() );
@@ -2847,6 +3411,11 @@ brain_key_info wallet_api::suggest_brain_key()const
    return result;
 }
 
+vector<brain_key_info> wallet_api::derive_owner_keys_from_brain_key( string brain_key, int number_of_desired_keys )const
+{
+   return my->derive_owner_keys_from_brain_key( brain_key, number_of_desired_keys );
+}
+
 string wallet_api::serialize_transaction( signed_transaction tx )const
 {
    return fc::to_hex(fc::raw::pack(tx));
@@ -3131,6 +3700,21 @@ signed_transaction wallet_api::transfer(string from, string to, string amount,
 {
    return my->transfer(from, to, amount, asset_symbol, memo, broadcast);
 }
+void wallet_api::set_async_broadcast( bool async )
+{
+   my->_async_broadcast = async;
+}
+
+broadcast_status wallet_api::get_broadcast_status( transaction_id_type id )const
+{
+   return my->get_broadcast_status( id );
+}
+
+transfer_batch_result wallet_api::transfer_batch(string from, vector<batch_transfer> transfers,
+                                                 bool broadcast /* = false */)
+{
+   return my->transfer_batch(from, transfers, broadcast);
+}
 signed_transaction wallet_api::create_asset(string issuer,
                                             string symbol,
                                             uint8_t precision,
@@ -3537,6 +4121,7 @@ void wallet_api::lock()
    for( auto key : my->_keys )
       key.second = key_to_wif(fc::ecc::private_key());
    my->_keys.clear();
+   my->_memo_decryptor.clear();
    my->_checksum = fc::sha512();
    my->self.lock_changed(true);
 } FC_CAPTURE_AND_RETHROW() }
@@ -3545,11 +4130,7 @@ void wallet_api::unlock(string password)
 { try {
    FC_ASSERT(password.size() > 0);
    auto pw = fc::sha512::hash(password.c_str(), password.size());
-   vector<char> decrypted = fc::aes_decrypt(pw, my->_wallet.cipher_keys);
-   auto pk = fc::raw::unpack<plain_keys>(decrypted);
-   FC_ASSERT(pk.checksum == pw);
-   my->_keys = std::move(pk.keys);
-   my->_checksum = pk.checksum;
+   my->decrypt_keys( pw );
    my->self.lock_changed(false);
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -3578,9 +4159,23 @@ vector< signed_transaction > wallet_api_impl::import_balance( string name_or_id,
    map< address, private_key_type > keys;  // local index of address -> private key
    vector< address > addrs;
    bool has_wildcard = false;
-   addrs.reserve( wif_keys.size() );
-   for( const string& wif_key : wif_keys )
+   addrs.reserve( wif_keys.size() * 5 );
+
+   // decoding the keys and deriving their addresses is what takes the time with many keys
+   vector< optional< private_key_type > > wif_privkeys( wif_keys.size() );
+   vector< std::array< address, 5 > > wif_addrs( wif_keys.size() );
+   derive_in_parallel( wif_keys.size(), [&]( size_t i ) {
+      if( wif_keys[i] == "*" )
+         return;
+      wif_privkeys[i] = wif_to_key( wif_keys[i] );
+      if( wif_privkeys[i] )
+         // see chain/balance_evaluator.cpp
+         wif_addrs[i] = key_addresses( public_key_type( wif_privkeys[i]->get_public_key() ) );
+   } );
+
+   for( size_t i = 0; i < wif_keys.size(); ++i )
    {
+      const string& wif_key = wif_keys[i];
       if( wif_key == "*" )
       {
          if( has_wildcard )
@@ -3604,24 +4199,26 @@ vector< signed_transaction > wallet_api_impl::import_balance( string name_or_id,
       }
       else
       {
-         optional< private_key_type > key = wif_to_key( wif_key );
+         const optional< private_key_type >& key = wif_privkeys[i];
          FC_ASSERT( key.valid(), "Invalid private key" );
-         fc::ecc::public_key pk = key->get_public_key();
-         addrs.push_back( pk );
-         keys[addrs.back()] = *key;
-         // see chain/balance_evaluator.cpp
-         addrs.push_back( pts_address( pk, false, 56 ) );
-         keys[addrs.back()] = *key;
-         addrs.push_back( pts_address( pk, true, 56 ) );
-         keys[addrs.back()] = *key;
-         addrs.push_back( pts_address( pk, false, 0 ) );
-         keys[addrs.back()] = *key;
-         addrs.push_back( pts_address( pk, true, 0 ) );
-         keys[addrs.back()] = *key;
+         for( const address& a : wif_addrs[i] )
+         {
+            addrs.push_back( a );
+            keys[a] = *key;
+         }
       }
    }
 
-   vector< balance_object > balances = _remote_db->get_balance_objects( addrs );
+   // in batches, so that a recovery of thousands of keys doesn't make one huge request and reply
+   const size_t addresses_per_request = 1000;
+   vector< balance_object > balances;
+   for( size_t begin = 0; begin < addrs.size(); begin += addresses_per_request )
+   {
+      vector< address > batch( addrs.begin() + begin,
+                               addrs.begin() + std::min( begin + addresses_per_request, addrs.size() ) );
+      vector< balance_object > found = _remote_db->get_balance_objects( batch );
+      balances.insert( balances.end(), found.begin(), found.end() );
+   }
    wdump((balances));
    addrs.clear();
 
@@ -3664,7 +4261,7 @@ vector< signed_transaction > wallet_api_impl::import_balance( string name_or_id,
       tx.operations.reserve( ctx.ops.size() );
       for( const balance_claim_operation& op : ctx.ops )
          tx.operations.emplace_back( op );
-      set_operation_fees( tx, _remote_db->get_global_properties().parameters.current_fees );
+      set_operation_fees( tx, get_global_properties().parameters.current_fees );
       tx.validate();
       signed_transaction signed_tx = sign_transaction( tx, false );
       for( const address& addr : ctx.addrs )
@@ -3859,7 +4456,7 @@ blind_confirmation wallet_api::transfer_from_blind( string from_blind_account_ke
    transfer_from_blind_operation from_blind;
 
 
-   auto fees  = my->_remote_db->get_global_properties().parameters.current_fees;
+   auto fees  = my->get_global_properties().parameters.current_fees;
    fc::optional<asset_object> asset_obj = get_asset(symbol);
    FC_ASSERT(asset_obj.valid(), "Could not find asset matching ${asset}", ("asset", symbol));
    auto amount = asset_obj->amount_from_string(amount_in);
@@ -3937,7 +4534,7 @@ blind_confirmation wallet_api::blind_transfer_help( string from_key_or_label,
    blind_transfer_operation blind_tr;
    blind_tr.outputs.resize(2);
 
-   auto fees  = my->_remote_db->get_global_properties().parameters.current_fees;
+   auto fees  = my->get_global_properties().parameters.current_fees;
 
    auto amount = asset_obj->amount_from_string(amount_in);
 
@@ -4158,7 +4755,7 @@ blind_confirmation wallet_api::transfer_to_blind( string from_account_id_or_name
               [&]( const blind_output& a, const blind_output& b ){ return a.commitment < b.commitment; } );
 
    confirm.trx.operations.push_back( bop );
-   my->set_operation_fees( confirm.trx, my->_remote_db->get_global_properties().parameters.current_fees);
+   my->set_operation_fees( confirm.trx, my->get_global_properties().parameters.current_fees);
    confirm.trx.validate();
    confirm.trx = sign_transaction(confirm.trx, broadcast);
 
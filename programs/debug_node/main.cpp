@@ -162,6 +162,13 @@ int main(int argc, char** argv) {
       node->initialize_plugins( options );
 
       node->startup();
+      if( node->exit_after_startup() )
+      {
+         node->shutdown_plugins();
+         node->shutdown();
+         delete node;
+         return 0;
+      }
       node->startup_plugins();
 
       fc::promise<int>::ptr exit_promise = new fc::promise<int>("UNIX Signal Handler");
@@ -60,6 +60,9 @@ struct size_check_type_visitor
       vo["name"] = fc::get_typename<Type>::name();
       vo["mem_size"] = sizeof( Type );
       vo["wire_size"] = get_wire_size<Type>();
+      // what an instance takes inside an operation, against its packed form with the tag
+      vo["variant_size"] = sizeof( operation );
+      vo["packed_size"] = fc::raw::pack_size( operation( Type() ) );
       g_op_types.push_back( vo );
    }
 };
@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  */
 #include <graphene/app/application.hpp>
+#include <graphene/app/light_client.hpp>
 
 #include <graphene/witness/witness.hpp>
 #include <graphene/account_history/account_history_plugin.hpp>
@@ -162,6 +163,13 @@ int main(int argc, char** argv) {
       node->initialize_plugins( options );
 
       node->startup();
+      if( node->exit_after_startup() )
+      {
+         node->shutdown_plugins();
+         node->shutdown();
+         delete node;
+         return 0;
+      }
       node->startup_plugins();
 
       fc::promise<int>::ptr exit_promise = new fc::promise<int>("UNIX Signal Handler");
@@ -176,8 +184,14 @@ int main(int argc, char** argv) {
          exit_promise->set_value(signal);
       }, SIGTERM);
 
-      ilog("Started witness node on a chain with ${h} blocks.", ("h", node->chain_database()->head_block_num()));
-      ilog("Chain ID is ${id}", ("id", node->chain_database()->get_chain_id()) );
+      if( node->get_light_client() )
+         ilog("Started witness node following block headers from block ${h}.",
+              ("h", node->get_light_client()->headers().head_block_num()));
+      else
+      {
+         ilog("Started witness node on a chain with ${h} blocks.", ("h", node->chain_database()->head_block_num()));
+         ilog("Chain ID is ${id}", ("id", node->chain_database()->get_chain_id()) );
+      }
 
       int signal = exit_promise->wait();
       ilog("Exiting from signal ${n}", ("n", signal));
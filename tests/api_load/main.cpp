@@ -0,0 +1,705 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+
+#include <fc/exception/exception.hpp>
+#include <fc/io/json.hpp>
+#include <fc/network/http/websocket.hpp>
+#include <fc/thread/future.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/variant_object.hpp>
+
+#include <boost/program_options.hpp>
+
+using namespace std;
+namespace bpo = boost::program_options;
+
+/**
+ *  One kind of call in the request mix.  The strings of params may contain ${account}, which is replaced by the id
+ *  of a random account for each call.
+ */
+struct mix_entry
+{
+   string        api = "database";
+   string        method;
+   fc::variants  params;
+   uint32_t      weight = 1;
+   /** the call fails the run if its 99th percentile latency is higher, 0 for no limit */
+   double        max_p99_ms = 0;
+};
+
+FC_REFLECT( mix_entry, (api)(method)(params)(weight)(max_p99_ms) )
+
+/** what the run reports about the calls of one mix entry, or of all of them */
+struct call_report
+{
+   string    api;
+   string    method;
+   uint64_t  calls = 0;
+   uint64_t  errors = 0;
+   double    calls_per_second = 0;
+   double    mean_ms = 0;
+   double    p50_ms = 0;
+   double    p90_ms = 0;
+   double    p99_ms = 0;
+   double    p999_ms = 0;
+   double    max_ms = 0;
+};
+
+FC_REFLECT( call_report, (api)(method)(calls)(errors)(calls_per_second)(mean_ms)(p50_ms)(p90_ms)(p99_ms)(p999_ms)(max_ms) )
+
+struct run_report
+{
+   uint32_t             connections = 0;
+   uint32_t             failed_connections = 0;
+   uint32_t             disconnects = 0;
+   uint64_t             unanswered = 0;
+   double               seconds = 0;
+   call_report          total;
+   vector<call_report>  calls;
+   vector<string>       failures;
+};
+
+FC_REFLECT( run_report, (connections)(failed_connections)(disconnects)(unanswered)(seconds)(total)(calls)(failures) )
+
+/**
+ *  Latencies in microseconds, counted in buckets of an eighth of a power of two, so that recording takes constant
+ *  time and memory and the percentiles are known to within 12.5%.
+ */
+class latency_histogram
+{
+   public:
+      void record( uint64_t us )
+      {
+         ++_buckets[ bucket_of( us ) ];
+         ++_count;
+         _total += us;
+         _max = std::max( _max, us );
+      }
+
+      void merge( const latency_histogram& h )
+      {
+         for( size_t i = 0; i < _buckets.size(); ++i )
+            _buckets[i] += h._buckets[i];
+         _count += h._count;
+         _total += h._total;
+         _max = std::max( _max, h._max );
+      }
+
+      /** @return the upper bound of the bucket holding the call at fraction p of the calls, at most the slowest */
+      uint64_t percentile( double p )const
+      {
+         if( _count == 0 ) return 0;
+         const uint64_t rank = std::max<uint64_t>( 1, std::ceil( p * _count ) );
+         uint64_t seen = 0;
+         for( size_t i = 0; i < _buckets.size(); ++i )
+         {
+            seen += _buckets[i];
+            if( seen >= rank )
+               return std::min( upper_bound_of( i ), _max );
+         }
+         return _max;
+      }
+
+      uint64_t count()const { return _count; }
+      uint64_t max()const   { return _max; }
+      uint64_t mean()const  { return _count == 0 ? 0 : _total / _count; }
+
+   private:
+      static const uint32_t sub_buckets = 8;
+
+      /** values below sub_buckets get a bucket each, each power of two above that is split in sub_buckets */
+      static size_t bucket_of( uint64_t us )
+      {
+         if( us < sub_buckets ) return us;
+         uint32_t e = 3;
+         while( ( us >> e ) > 1 ) ++e;
+         return ( e - 2 ) * sub_buckets + ( ( us >> ( e - 3 ) ) & ( sub_buckets - 1 ) );
+      }
+      static uint64_t upper_bound_of( size_t bucket )
+      {
+         if( bucket < sub_buckets ) return bucket;
+         const uint32_t e = bucket / sub_buckets + 2;
+         const uint64_t lower = uint64_t( sub_buckets + bucket % sub_buckets ) << ( e - 3 );
+         return lower + ( uint64_t(1) << ( e - 3 ) ) - 1;
+      }
+
+      std::array<uint64_t, 62 * sub_buckets>  _buckets{};
+      uint64_t                                _count = 0;
+      uint64_t                                _total = 0;
+      uint64_t                                _max = 0;
+};
+
+struct load_config
+{
+   string              server;
+   string              user;
+   string              password;
+   uint32_t            connections = 1;
+   uint32_t            threads = 1;
+   uint32_t            in_flight = 1;
+   /** calls per second over all connections, 0 to send the next call of a connection when one is answered */
+   double              rate = 0;
+   uint32_t            accounts = 1;
+   vector<mix_entry>   mix;
+};
+
+/** the results of the connections of one worker, only touched from the worker's thread */
+struct load_results
+{
+   vector<latency_histogram>  latencies;
+   vector<uint64_t>           errors;
+   uint32_t                   failed_connections = 0;
+   uint32_t                   disconnects = 0;
+   uint64_t                   unanswered = 0;
+
+   explicit load_results( size_t mix_size ) : latencies( mix_size ), errors( mix_size ) {}
+
+   void merge( const load_results& r )
+   {
+      for( size_t i = 0; i < latencies.size(); ++i )
+      {
+         latencies[i].merge( r.latencies[i] );
+         errors[i] += r.errors[i];
+      }
+      failed_connections += r.failed_connections;
+      disconnects += r.disconnects;
+      unanswered += r.unanswered;
+   }
+};
+
+/**
+ *  A websocket client calling the node with calls picked from the mix.  It logs in, looks up the ids of the APIs
+ *  of the mix with the login API, and then keeps config.in_flight calls outstanding or, with a rate, sends calls
+ *  at that rate whether they are answered or not.
+ */
+class load_connection
+{
+   public:
+      load_connection( const load_config& config, load_results& results, uint64_t seed )
+         : _config( config ), _results( results ), _random( seed )
+      {
+         vector<double> weights;
+         for( const auto& e : config.mix )
+            weights.push_back( e.weight );
+         _pick = std::discrete_distribution<size_t>( weights.begin(), weights.end() );
+      }
+
+      void open( fc::http::websocket_client& client )
+      {
+         _con = client.connect( _config.server );
+         _con->on_message_handler( [this]( const string& message ) { on_message( message ); } );
+         _closed_connection = _con->closed.connect( [this]() {
+            if( !_closed )
+               ++_results.disconnects;
+            _closed = true;
+         } );
+
+         // the database API is registered with every connection, the others are handed out by login
+         FC_ASSERT( call( 1, "login", { fc::variant( _config.user ), fc::variant( _config.password ) } ).as_bool(),
+                    "Login refused", ("user",_config.user) );
+         _api_ids["database"] = 0;
+         for( const auto& e : _config.mix )
+            if( _api_ids.find( e.api ) == _api_ids.end() )
+               _api_ids[e.api] = call( 1, e.api, fc::variants() ).as_uint64();
+      }
+
+      /** starts sending calls until end */
+      void start( fc::time_point end )
+      {
+         _end = end;
+         if( _config.rate > 0 )
+         {
+            _sender = fc::async( [this]() { send_at_rate(); }, "api_load::send" );
+            return;
+         }
+         for( uint32_t i = 0; i < _config.in_flight; ++i )
+            send_next();
+      }
+
+      size_t pending()const { return _closed ? 0 : _pending.size(); }
+
+      void close()
+      {
+         if( _sender.valid() && !_sender.ready() )
+            _sender.cancel_and_wait();
+         _results.unanswered += pending();
+         _pending.clear();
+         _closed_connection.disconnect();
+         if( _con && !_closed )
+         {
+            try
+            {
+               _con->close( 1000, "done" );
+            }
+            catch( const fc::exception& e )
+            {
+               wlog( "Error closing connection: ${e}", ("e",e.to_string()) );
+            }
+         }
+         _closed = true;
+      }
+
+   private:
+      struct pending_call
+      {
+         size_t          entry;
+         fc::time_point  sent;
+      };
+
+      void send_at_rate()
+      {
+         const fc::microseconds interval( int64_t( 1000000.0 * _config.connections / _config.rate ) );
+         // spread the connections over the interval so that they don't all send at once
+         fc::time_point next = fc::time_point::now() +
+                               fc::microseconds( std::uniform_int_distribution<int64_t>( 0, interval.count() )( _random ) );
+         while( next < _end && !_closed )
+         {
+            fc::usleep( next - fc::time_point::now() );
+            send_next();
+            next += interval;
+         }
+      }
+
+      void send_next()
+      {
+         if( _closed || fc::time_point::now() >= _end )
+            return;
+         const size_t entry = _pick( _random );
+         const mix_entry& e = _config.mix[entry];
+         const uint64_t id = _next_id++;
+         _pending[id] = pending_call{ entry, fc::time_point::now() };
+         _con->send_message( request( id, _api_ids[e.api], e.method, instantiate( fc::variant( e.params ) ) ) );
+      }
+
+      /** calls method synchronously, only while setting up the connection */
+      fc::variant call( uint64_t api, const string& method, const fc::variants& args )
+      {
+         const uint64_t id = _next_id++;
+         fc::promise<fc::variant>::ptr result( new fc::promise<fc::variant>( "api_load::call" ) );
+         _setup_calls[id] = result;
+         _con->send_message( request( id, api, method, fc::variant( args ) ) );
+         return fc::future<fc::variant>( result ).wait( fc::seconds( 30 ) );
+      }
+
+      static string request( uint64_t id, uint64_t api, const string& method, const fc::variant& args )
+      {
+         return fc::json::to_string( fc::mutable_variant_object( "id", id )( "method", "call" )
+                                        ( "params", fc::variants{ fc::variant( api ), fc::variant( method ), args } ) );
+      }
+
+      fc::variant instantiate( const fc::variant& v )
+      {
+         if( v.is_string() )
+         {
+            static const string placeholder = "${account}";
+            string s = v.get_string();
+            for( size_t pos = s.find( placeholder ); pos != string::npos; pos = s.find( placeholder, pos ) )
+            {
+               const string account = "1.2." + std::to_string( _random() % _config.accounts );
+               s.replace( pos, placeholder.size(), account );
+               pos += account.size();
+            }
+            return fc::variant( s );
+         }
+         if( v.is_array() )
+         {
+            fc::variants result;
+            for( const auto& item : v.get_array() )
+               result.push_back( instantiate( item ) );
+            return fc::variant( result );
+         }
+         if( v.is_object() )
+         {
+            fc::mutable_variant_object result;
+            for( const auto& item : v.get_object() )
+               result( item.key(), instantiate( item.value() ) );
+            return fc::variant( result );
+         }
+         return v;
+      }
+
+      void on_message( const string& message )
+      {
+         const fc::time_point received = fc::time_point::now();
+         const fc::variant_object response = fc::json::from_string( message ).get_object();
+         // notices of subscriptions have no id
+         if( !response.contains( "id" ) )
+            return;
+         const uint64_t id = response["id"].as_uint64();
+
+         auto setup = _setup_calls.find( id );
+         if( setup != _setup_calls.end() )
+         {
+            if( response.contains( "error" ) )
+               setup->second->set_exception( fc::exception_ptr( new fc::exception(
+                  FC_LOG_MESSAGE( error, "Call failed: ${e}", ("e",response["error"]) ) ) ) );
+            else
+               setup->second->set_value( response.contains( "result" ) ? response["result"] : fc::variant() );
+            _setup_calls.erase( setup );
+            return;
+         }
+
+         auto itr = _pending.find( id );
+         if( itr == _pending.end() )
+            return;
+         _results.latencies[itr->second.entry].record( ( received - itr->second.sent ).count() );
+         if( response.contains( "error" ) )
+            ++_results.errors[itr->second.entry];
+         _pending.erase( itr );
+         if( _config.rate == 0 )
+            send_next();
+      }
+
+      const load_config&                                   _config;
+      load_results&                                        _results;
+      std::mt19937_64                                      _random;
+      std::discrete_distribution<size_t>                   _pick;
+      fc::http::websocket_connection_ptr                   _con;
+      boost::signals2::scoped_connection                   _closed_connection;
+      bool                                                 _closed = false;
+      fc::time_point                                       _end;
+      fc::future<void>                                     _sender;
+      uint64_t                                             _next_id = 1;
+      std::map<string, uint64_t>                           _api_ids;
+      std::map<uint64_t, pending_call>                     _pending;
+      std::map<uint64_t, fc::promise<fc::variant>::ptr>    _setup_calls;
+};
+
+/**
+ *  A thread with its own websocket client and connections.  The client delivers the messages of its connections on
+ *  the thread which created it, so everything here happens on the worker's thread.
+ */
+class load_worker
+{
+   public:
+      load_worker( const load_config& config, uint32_t index )
+         : _config( config ), _results( config.mix.size() ), _index( index ),
+           _thread( "api_load " + std::to_string( index ) ) {}
+
+      /** opens the connections the worker is responsible for, the ones whose number modulo threads is index */
+      void open( uint64_t seed )
+      {
+         _thread.async( [this,seed]() {
+            _client.reset( new fc::http::websocket_client );
+            for( uint32_t i = _index; i < _config.connections; i += _config.threads )
+            {
+               std::unique_ptr<load_connection> c( new load_connection( _config, _results, seed + i ) );
+               try
+               {
+                  c->open( *_client );
+                  _connections.push_back( std::move( c ) );
+               }
+               catch( const fc::exception& e )
+               {
+                  ++_results.failed_connections;
+                  if( _results.failed_connections == 1 )
+                     std::cerr << "api_load:  connection " << i << " failed: " << e.to_string() << "\n";
+               }
+            }
+         }, "api_load::open" ).wait();
+      }
+
+      void start( fc::time_point end )
+      {
+         _thread.async( [this,end]() {
+            for( const auto& c : _connections )
+               c->start( end );
+         }, "api_load::start" ).wait();
+      }
+
+      size_t pending()
+      {
+         return _thread.async( [this]() {
+            size_t result = 0;
+            for( const auto& c : _connections )
+               result += c->pending();
+            return result;
+         }, "api_load::pending" ).wait();
+      }
+
+      /** closes the connections, counting the calls still unanswered, and returns the results */
+      load_results finish()
+      {
+         return _thread.async( [this]() {
+            for( const auto& c : _connections )
+               c->close();
+            _connections.clear();
+            _client.reset();
+            return _results;
+         }, "api_load::finish" ).wait();
+      }
+
+   private:
+      const load_config&                               _config;
+      load_results                                     _results;
+      uint32_t                                         _index;
+      fc::thread                                       _thread;
+      std::unique_ptr<fc::http::websocket_client>      _client;
+      vector< std::unique_ptr<load_connection> >       _connections;
+};
+
+static vector<mix_entry> default_mix()
+{
+   // roughly what the wallets and web clients ask a public node for
+   vector<mix_entry> mix( 5 );
+   mix[0].method = "get_dynamic_global_properties";
+   mix[0].weight = 10;
+   mix[1].method = "get_objects";
+   mix[1].params = { fc::variant( fc::variants{ fc::variant( "2.0.0" ) } ) };
+   mix[1].weight = 10;
+   mix[2].method = "get_objects";
+   mix[2].params = { fc::variant( fc::variants{ fc::variant( "${account}" ) } ) };
+   mix[2].weight = 40;
+   mix[3].method = "get_full_accounts";
+   mix[3].params = { fc::variant( fc::variants{ fc::variant( "${account}" ) } ), fc::variant( false ) };
+   mix[3].weight = 20;
+   mix[4].api = "history";
+   mix[4].method = "get_account_history";
+   mix[4].params = { fc::variant( "${account}" ), fc::variant( "1.11.0" ), fc::variant( 100 ), fc::variant( "1.11.0" ) };
+   mix[4].weight = 20;
+   return mix;
+}
+
+/**
+ *  Weighs the entries of the mix with the numbers of calls in the output of call_stats_api::get_call_stats() of a
+ *  node serving real clients.  The statistics name the API classes, e.g. database_api for the database API.
+ */
+static void weigh_by_call_stats( vector<mix_entry>& mix, const fc::variants& stats )
+{
+   std::map< std::pair<string, string>, uint64_t > calls;
+   for( const auto& s : stats )
+   {
+      const auto& o = s.get_object();
+      calls[ std::make_pair( o["api"].as_string(), o["method"].as_string() ) ] += o["calls"].as_uint64();
+   }
+   for( auto& e : mix )
+   {
+      auto itr = calls.find( std::make_pair( e.api + "_api", e.method ) );
+      if( itr == calls.end() )
+         itr = calls.find( std::make_pair( e.api, e.method ) );
+      if( itr == calls.end() )
+      {
+         std::cerr << "api_load:  " << e.api << "." << e.method << " was never called, leaving it out\n";
+         e.weight = 0;
+         continue;
+      }
+      e.weight = uint32_t( std::min<uint64_t>( itr->second, std::numeric_limits<uint32_t>::max() ) );
+      calls.erase( itr );
+   }
+   for( const auto& c : calls )
+      std::cerr << "api_load:  " << c.first.first << "." << c.first.second << " was called " << c.second
+                << " times but is not in the mix\n";
+}
+
+static call_report make_report( const string& api, const string& method, const latency_histogram& latencies,
+                                uint64_t errors, double seconds )
+{
+   call_report r;
+   r.api = api;
+   r.method = method;
+   r.calls = latencies.count();
+   r.errors = errors;
+   r.calls_per_second = seconds > 0 ? r.calls / seconds : 0;
+   r.mean_ms = latencies.mean() / 1000.0;
+   r.p50_ms = latencies.percentile( 0.5 ) / 1000.0;
+   r.p90_ms = latencies.percentile( 0.9 ) / 1000.0;
+   r.p99_ms = latencies.percentile( 0.99 ) / 1000.0;
+   r.p999_ms = latencies.percentile( 0.999 ) / 1000.0;
+   r.max_ms = latencies.max() / 1000.0;
+   return r;
+}
+
+static void print_report( const run_report& report )
+{
+   std::cout << report.connections - report.failed_connections << " of " << report.connections
+             << " connections, " << report.disconnects << " disconnected, " << report.unanswered
+             << " calls unanswered, " << std::fixed << std::setprecision(1) << report.seconds << " s\n\n";
+   std::cout << std::left << std::setw(40) << "call" << std::right << std::setw(10) << "calls" << std::setw(8) << "errors"
+             << std::setw(10) << "calls/s" << std::setw(10) << "mean ms" << std::setw(10) << "p50" << std::setw(10) << "p90"
+             << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max" << "\n";
+   auto row = []( const call_report& r ) {
+      std::cout << std::left << std::setw(40) << ( r.api + "." + r.method ) << std::right << std::setw(10) << r.calls
+                << std::setw(8) << r.errors << std::setprecision(1) << std::setw(10) << r.calls_per_second
+                << std::setprecision(2) << std::setw(10) << r.mean_ms << std::setw(10) << r.p50_ms << std::setw(10) << r.p90_ms
+                << std::setw(10) << r.p99_ms << std::setw(10) << r.p999_ms << std::setw(10) << r.max_ms << "\n";
+   };
+   for( const auto& r : report.calls )
+      row( r );
+   row( report.total );
+   for( const auto& f : report.failures )
+      std::cout << "FAILED: " << f << "\n";
+}
+
+int main( int argc, char** argv )
+{
+   try
+   {
+      bpo::options_description cli_options("Graphene API load test");
+      cli_options.add_options()
+            ("help,h", "Print this help message and exit.")
+            ("server,s", bpo::value<string>()->default_value("ws://localhost:8090"), "Websocket endpoint of the node")
+            ("user,u", bpo::value<string>()->default_value(""), "Username to log in with")
+            ("password,p", bpo::value<string>()->default_value(""), "Password to log in with")
+            ("connections,c", bpo::value<uint32_t>()->default_value(100), "Number of websocket connections")
+            ("threads,t", bpo::value<uint32_t>()->default_value(4), "Number of threads to run the connections on")
+            ("duration,d", bpo::value<uint32_t>()->default_value(60), "Seconds to send calls for")
+            ("in-flight", bpo::value<uint32_t>()->default_value(1), "Calls each connection keeps unanswered, unless rate is given")
+            ("rate,r", bpo::value<double>()->default_value(0), "Calls per second over all connections, sent whether the previous ones were answered or not")
+            ("timeout", bpo::value<uint32_t>()->default_value(10), "Seconds to wait for the answers of the last calls")
+            ("mix,m", bpo::value<string>(), "JSON file with an array of calls to pick from, each {api, method, params, weight, max_p99_ms}")
+            ("call-stats", bpo::value<string>(), "JSON file with the output of call_stats_api.get_call_stats on a real node, to weigh the mix with")
+            ("accounts,a", bpo::value<uint32_t>()->default_value(90000), "Number of accounts to pick ${account} from")
+            ("seed", bpo::value<uint64_t>()->default_value(0), "Seed of the random choices")
+            ("max-p50-ms", bpo::value<double>()->default_value(0), "Fail if the median latency of all calls is higher, 0 for no limit")
+            ("max-p99-ms", bpo::value<double>()->default_value(0), "Fail if the 99th percentile latency of all calls is higher, 0 for no limit")
+            ("max-error-rate", bpo::value<double>()->default_value(0.01), "Fail if a larger fraction of the calls returns an error or is not answered")
+            ("min-calls-per-second", bpo::value<double>()->default_value(0), "Fail if fewer calls per second are answered")
+            ("report", bpo::value<string>(), "File to write the results to as JSON")
+            ;
+
+      bpo::variables_map options;
+      try
+      {
+         boost::program_options::store( boost::program_options::parse_command_line(argc, argv, cli_options), options );
+      }
+      catch (const boost::program_options::error& e)
+      {
+         std::cerr << "api_load:  error parsing command line: " << e.what() << "\n";
+         return 1;
+      }
+
+      if( options.count("help") )
+      {
+         std::cout << cli_options << "\n";
+         return 0;
+      }
+
+      load_config config;
+      config.server = options["server"].as<string>();
+      config.user = options["user"].as<string>();
+      config.password = options["password"].as<string>();
+      config.connections = std::max<uint32_t>( options["connections"].as<uint32_t>(), 1 );
+      config.threads = std::min( std::max<uint32_t>( options["threads"].as<uint32_t>(), 1 ), config.connections );
+      config.in_flight = std::max<uint32_t>( options["in-flight"].as<uint32_t>(), 1 );
+      config.rate = options["rate"].as<double>();
+      config.accounts = std::max<uint32_t>( options["accounts"].as<uint32_t>(), 1 );
+      if( options.count("mix") )
+         config.mix = fc::json::from_file( options["mix"].as<string>() ).as< vector<mix_entry> >();
+      else
+         config.mix = default_mix();
+      if( options.count("call-stats") )
+         weigh_by_call_stats( config.mix, fc::json::from_file( options["call-stats"].as<string>() ).get_array() );
+      FC_ASSERT( std::any_of( config.mix.begin(), config.mix.end(), []( const mix_entry& e ) { return e.weight > 0; } ),
+                 "The request mix is empty" );
+
+      std::cerr << "api_load:  opening " << config.connections << " connections to " << config.server << "\n";
+      const uint64_t seed = options["seed"].as<uint64_t>();
+      vector< std::unique_ptr<load_worker> > workers;
+      for( uint32_t i = 0; i < config.threads; ++i )
+         workers.emplace_back( new load_worker( config, i ) );
+      for( const auto& w : workers )
+         w->open( seed );
+
+      std::cerr << "api_load:  sending calls for " << options["duration"].as<uint32_t>() << " s\n";
+      const fc::time_point start = fc::time_point::now();
+      const fc::time_point end = start + fc::seconds( options["duration"].as<uint32_t>() );
+      for( const auto& w : workers )
+         w->start( end );
+      fc::usleep( end - fc::time_point::now() );
+
+      const fc::time_point give_up = fc::time_point::now() + fc::seconds( options["timeout"].as<uint32_t>() );
+      while( fc::time_point::now() < give_up )
+      {
+         size_t pending = 0;
+         for( const auto& w : workers )
+            pending += w->pending();
+         if( pending == 0 )
+            break;
+         fc::usleep( fc::milliseconds( 100 ) );
+      }
+
+      load_results results( config.mix.size() );
+      for( const auto& w : workers )
+         results.merge( w->finish() );
+      workers.clear();
+
+      run_report report;
+      report.connections = config.connections;
+      report.failed_connections = results.failed_connections;
+      report.disconnects = results.disconnects;
+      report.unanswered = results.unanswered;
+      report.seconds = ( end - start ).count() / 1000000.0;
+      latency_histogram all;
+      uint64_t all_errors = 0;
+      for( size_t i = 0; i < config.mix.size(); ++i )
+      {
+         const mix_entry& e = config.mix[i];
+         if( e.weight == 0 ) continue;
+         report.calls.push_back( make_report( e.api, e.method, results.latencies[i], results.errors[i], report.seconds ) );
+         all.merge( results.latencies[i] );
+         all_errors += results.errors[i];
+         if( e.max_p99_ms > 0 && report.calls.back().p99_ms > e.max_p99_ms )
+            report.failures.push_back( e.api + "." + e.method + " p99 of " + std::to_string( report.calls.back().p99_ms ) +
+                                       " ms is above " + std::to_string( e.max_p99_ms ) + " ms" );
+      }
+      report.total = make_report( "all", "calls", all, all_errors, report.seconds );
+
+      const double max_p50 = options["max-p50-ms"].as<double>();
+      const double max_p99 = options["max-p99-ms"].as<double>();
+      const double max_error_rate = options["max-error-rate"].as<double>();
+      const double min_rate = options["min-calls-per-second"].as<double>();
+      const uint64_t sent = all.count() + results.unanswered;
+      const double error_rate = sent == 0 ? 1 : double( all_errors + results.unanswered ) / sent;
+      if( results.failed_connections > 0 )
+         report.failures.push_back( std::to_string( results.failed_connections ) + " connections failed" );
+      if( max_p50 > 0 && report.total.p50_ms > max_p50 )
+         report.failures.push_back( "p50 of " + std::to_string( report.total.p50_ms ) + " ms is above " + std::to_string( max_p50 ) + " ms" );
+      if( max_p99 > 0 && report.total.p99_ms > max_p99 )
+         report.failures.push_back( "p99 of " + std::to_string( report.total.p99_ms ) + " ms is above " + std::to_string( max_p99 ) + " ms" );
+      if( error_rate > max_error_rate )
+         report.failures.push_back( "error rate of " + std::to_string( error_rate ) + " is above " + std::to_string( max_error_rate ) );
+      if( min_rate > 0 && report.total.calls_per_second < min_rate )
+         report.failures.push_back( std::to_string( report.total.calls_per_second ) + " calls per second is below " +
+                                    std::to_string( min_rate ) );
+
+      print_report( report );
+      if( options.count("report") )
+         fc::json::save_to_file( report, fc::path( options["report"].as<string>() ) );
+      return report.failures.empty() ? 0 : 2;
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << "api_load:  " << e.to_detail_string() << "\n";
+      return 1;
+   }
+}
@@ -21,17 +21,23 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <graphene/app/api_access.hpp>
 #include <graphene/app/application.hpp>
+#include <graphene/app/light_client.hpp>
 #include <graphene/app/plugin.hpp>
 
 #include <graphene/chain/balance_object.hpp>
 
+#include <graphene/net/config.hpp>
+
 #include <graphene/time/time.hpp>
 
 #include <graphene/utilities/tempdir.hpp>
 
 #include <graphene/account_history/account_history_plugin.hpp>
 
+#include <fc/io/json.hpp>
+#include <fc/network/http/connection.hpp>
 #include <fc/thread/thread.hpp>
 #include <fc/smart_ref_impl.hpp>
 
@@ -42,6 +48,39 @@
 
 using namespace graphene;
 
+namespace {
+
+/** claims the genesis balance of nathan and pays amount of it to the null account */
+graphene::chain::signed_transaction make_nathan_transfer( const graphene::chain::database& db, int64_t amount )
+{
+   using namespace graphene::chain;
+   account_id_type nathan_id = db.get_index_type<account_index>().indices().get<by_name>().find( "nathan" )->id;
+   fc::ecc::private_key nathan_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("nathan")));
+
+   signed_transaction trx;
+   balance_claim_operation claim_op;
+   balance_id_type bid = balance_id_type();
+   claim_op.deposit_to_account = nathan_id;
+   claim_op.balance_to_claim = bid;
+   claim_op.balance_owner_key = nathan_key.get_public_key();
+   claim_op.total_claimed = bid(db).balance;
+   trx.operations.push_back( claim_op );
+   db.current_fee_schedule().set_fee( trx.operations.back() );
+
+   transfer_operation xfer_op;
+   xfer_op.from = nathan_id;
+   xfer_op.to = GRAPHENE_NULL_ACCOUNT;
+   xfer_op.amount = asset( amount );
+   trx.operations.push_back( xfer_op );
+   db.current_fee_schedule().set_fee( trx.operations.back() );
+
+   trx.set_expiration( db.get_slot_time( 10 ) );
+   trx.sign( nathan_key, db.get_chain_id() );
+   return trx;
+}
+
+}
+
 BOOST_AUTO_TEST_CASE( two_node_network )
 {
    using namespace graphene::chain;
@@ -152,3 +191,452 @@ BOOST_AUTO_TEST_CASE( two_node_network )
       throw;
    }
 }
+
+BOOST_AUTO_TEST_CASE( transaction_check_threads )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+
+      graphene::app::application app;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3941"), false));
+      cfg.emplace("transaction-check-threads", boost::program_options::variable_value(uint32_t(2), false));
+      app.initialize(app_dir.path(), cfg);
+      app.startup();
+      std::shared_ptr<chain::database> db = app.chain_database();
+
+      signed_transaction trx = make_nathan_transfer( *db, 1000000 );
+      signed_transaction unsigned_trx = trx;
+      unsigned_trx.signatures.clear();
+
+      // refused by validate() on a check thread
+      BOOST_CHECK_THROW( app.push_transaction( signed_transaction() ), fc::exception );
+      // passes the checks, the authority check with the keys they recovered refuses it
+      BOOST_CHECK_THROW( app.push_transaction( unsigned_trx ), fc::exception );
+      BOOST_CHECK_EQUAL( db->get_balance( GRAPHENE_NULL_ACCOUNT, asset_id_type() ).amount.value, 0 );
+
+      trx.seal( db->get_chain_id() );
+      app.push_transaction( trx );
+      BOOST_CHECK_EQUAL( db->get_balance( GRAPHENE_NULL_ACCOUNT, asset_id_type() ).amount.value, 1000000 );
+      // the second push is a duplicate
+      BOOST_CHECK_THROW( app.push_transaction( trx ), fc::exception );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( compact_block_relay )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory app2_dir( graphene::utilities::temp_directory_path() );
+
+      graphene::app::application app1;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3943"), false));
+      app1.initialize(app_dir.path(), cfg);
+
+      graphene::app::application app2;
+      boost::program_options::variables_map cfg2;
+      cfg2.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3944"), false));
+      cfg2.emplace("seed-node", boost::program_options::variable_value(vector<string>{"127.0.0.1:3943"}, false));
+      app2.initialize(app2_dir.path(), cfg2);
+
+      app1.startup();
+      fc::usleep(fc::milliseconds(500));
+      app2.startup();
+      fc::usleep(fc::milliseconds(500));
+      BOOST_REQUIRE_EQUAL(app1.p2p_node()->get_connection_count(), 1);
+
+      std::shared_ptr<chain::database> db1 = app1.chain_database();
+      std::shared_ptr<chain::database> db2 = app2.chain_database();
+      fc::ecc::private_key nathan_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("nathan")));
+      auto received = [&app1]( const std::string& type ) {
+         const auto counters = app1.p2p_node()->get_traffic_statistics().received;
+         auto itr = counters.find( type );
+         return itr == counters.end() ? uint64_t(0) : itr->second.messages;
+      };
+      auto sent = [&app1]( const std::string& type ) {
+         const auto counters = app1.p2p_node()->get_traffic_statistics().sent;
+         auto itr = counters.find( type );
+         return itr == counters.end() ? uint64_t(0) : itr->second.messages;
+      };
+
+      // app1 broadcast the transaction itself, so it rebuilds the block from the compact block alone
+      signed_transaction trx = make_nathan_transfer( *db1, 1000000 );
+      db1->push_transaction( trx );
+      app1.p2p_node()->broadcast(graphene::net::trx_message(trx));
+      fc::usleep(fc::milliseconds(500));
+      BOOST_REQUIRE_EQUAL( db2->get_balance( GRAPHENE_NULL_ACCOUNT, asset_id_type() ).amount.value, 1000000 );
+
+      auto block_1 = db2->generate_block( db2->get_slot_time(1), db2->get_scheduled_witness(1), nathan_key,
+                                          database::skip_nothing );
+      app2.p2p_node()->broadcast(graphene::net::block_message( block_1 ));
+      fc::usleep(fc::milliseconds(500));
+      BOOST_CHECK_EQUAL( db1->head_block_num(), 1u );
+      BOOST_CHECK_EQUAL( received( "compact_block_message_type" ), 1u );
+      BOOST_CHECK_EQUAL( received( "block_message_type" ), 0u );
+      BOOST_CHECK_EQUAL( sent( "fetch_block_transactions_message_type" ), 0u );
+
+      // app1 never saw this transaction, it fetches it from app2 to complete the block
+      signed_transaction trx2;
+      {
+         transfer_operation xfer_op;
+         xfer_op.from = db2->get_index_type<account_index>().indices().get<by_name>().find( "nathan" )->id;
+         xfer_op.to = GRAPHENE_NULL_ACCOUNT;
+         xfer_op.amount = asset( 1000 );
+         trx2.operations.push_back( xfer_op );
+         db2->current_fee_schedule().set_fee( trx2.operations.back() );
+         trx2.set_expiration( db2->get_slot_time( 10 ) );
+         trx2.sign( nathan_key, db2->get_chain_id() );
+      }
+      db2->push_transaction( trx2 );
+      auto block_2 = db2->generate_block( db2->get_slot_time(1), db2->get_scheduled_witness(1), nathan_key,
+                                          database::skip_nothing );
+      BOOST_REQUIRE_EQUAL( block_2.transactions.size(), 1u );
+      app2.p2p_node()->broadcast(graphene::net::block_message( block_2 ));
+      fc::usleep(fc::milliseconds(500));
+      BOOST_CHECK_EQUAL( db1->head_block_num(), 2u );
+      BOOST_CHECK_EQUAL( received( "compact_block_message_type" ), 2u );
+      BOOST_CHECK_EQUAL( sent( "fetch_block_transactions_message_type" ), 1u );
+      BOOST_CHECK_EQUAL( received( "block_transactions_message_type" ), 1u );
+      BOOST_CHECK_EQUAL( db1->get_balance( GRAPHENE_NULL_ACCOUNT, asset_id_type() ).amount.value, 1001000 );
+      BOOST_CHECK_EQUAL( app1.p2p_node()->get_connection_count(), 1u );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( pushed_items_need_opt_in )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory app2_dir( graphene::utilities::temp_directory_path() );
+
+      graphene::app::application app1;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3945"), false));
+      app1.initialize(app_dir.path(), cfg);
+
+      graphene::app::application app2;
+      boost::program_options::variables_map cfg2;
+      cfg2.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3946"), false));
+      cfg2.emplace("seed-node", boost::program_options::variable_value(vector<string>{"127.0.0.1:3945"}, false));
+      cfg2.emplace("p2p-relay-mode", boost::program_options::variable_value(string("push"), false));
+      app2.initialize(app2_dir.path(), cfg2);
+
+      app1.startup();
+      fc::usleep(fc::milliseconds(500));
+      app2.startup();
+      fc::usleep(fc::milliseconds(500));
+      BOOST_REQUIRE_EQUAL(app1.p2p_node()->get_connection_count(), 1);
+
+      // app1 doesn't accept pushed items, so app2 advertises the transaction and app1 fetches it
+      std::shared_ptr<chain::database> db1 = app1.chain_database();
+      std::shared_ptr<chain::database> db2 = app2.chain_database();
+      signed_transaction trx = make_nathan_transfer( *db2, 1000000 );
+      db2->push_transaction( trx );
+      app2.p2p_node()->broadcast(graphene::net::trx_message(trx));
+      fc::usleep(fc::milliseconds(500));
+      BOOST_CHECK_EQUAL( db1->get_balance( GRAPHENE_NULL_ACCOUNT, asset_id_type() ).amount.value, 1000000 );
+      const auto sent = app1.p2p_node()->get_traffic_statistics().sent;
+      BOOST_REQUIRE( sent.find( "fetch_items_message_type" ) != sent.end() );
+      BOOST_CHECK_EQUAL( sent.find( "fetch_items_message_type" )->second.messages, 1u );
+      BOOST_CHECK_EQUAL( app1.p2p_node()->get_connection_count(), 1u );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( pushed_items_are_rate_limited )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory app2_dir( graphene::utilities::temp_directory_path() );
+
+      graphene::app::application app1;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3947"), false));
+      cfg.emplace("p2p-accept-pushed-items", boost::program_options::variable_value(true, false));
+      cfg.emplace("p2p-pushed-items-per-second", boost::program_options::variable_value(uint32_t(1), false));
+      app1.initialize(app_dir.path(), cfg);
+
+      graphene::app::application app2;
+      boost::program_options::variables_map cfg2;
+      cfg2.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3948"), false));
+      cfg2.emplace("seed-node", boost::program_options::variable_value(vector<string>{"127.0.0.1:3947"}, false));
+      cfg2.emplace("p2p-relay-mode", boost::program_options::variable_value(string("push"), false));
+      app2.initialize(app2_dir.path(), cfg2);
+
+      app1.startup();
+      fc::usleep(fc::milliseconds(500));
+      app2.startup();
+      fc::usleep(fc::milliseconds(500));
+      BOOST_REQUIRE_EQUAL(app1.p2p_node()->get_connection_count(), 1);
+
+      // app1 accepts pushed items, so it gets the transaction without asking for it
+      std::shared_ptr<chain::database> db1 = app1.chain_database();
+      std::shared_ptr<chain::database> db2 = app2.chain_database();
+      signed_transaction trx = make_nathan_transfer( *db2, 1000000 );
+      db2->push_transaction( trx );
+      app2.p2p_node()->broadcast(graphene::net::trx_message(trx));
+      fc::usleep(fc::milliseconds(500));
+      BOOST_CHECK_EQUAL( db1->get_balance( GRAPHENE_NULL_ACCOUNT, asset_id_type() ).amount.value, 1000000 );
+      const auto sent = app1.p2p_node()->get_traffic_statistics().sent;
+      BOOST_CHECK( sent.find( "fetch_items_message_type" ) == sent.end() );
+      BOOST_CHECK_EQUAL( app1.p2p_node()->get_connection_count(), 1u );
+
+      // pushing far more than its burst of one item per second for ten seconds gets app2 disconnected
+      for( int64_t amount = 1; amount <= 20; ++amount )
+         app2.p2p_node()->broadcast(graphene::net::trx_message( make_nathan_transfer( *db2, amount ) ));
+      fc::usleep(fc::milliseconds(500));
+      BOOST_CHECK_EQUAL( app1.p2p_node()->get_connection_count(), 0u );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( replication_follows_and_reconnects )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory app2_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory access_dir( graphene::utilities::temp_directory_path() );
+      fc::ecc::private_key committee_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("nathan")));
+
+      api_access access;
+      api_access_info wild_access;
+      wild_access.password_hash_b64 = "*";
+      wild_access.password_salt_b64 = "*";
+      wild_access.allowed_apis = { "database_api", "packed_api", "replication_api" };
+      access.permission_map["*"] = wild_access;
+      const fc::path access_file = access_dir.path() / "api-access.json";
+      fc::json::save_to_file( access, access_file );
+
+      // the standby starts before its primary listens, so its first try fails and it tries again
+      graphene::app::application standby;
+      boost::program_options::variables_map cfg2;
+      cfg2.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3951"), false));
+      cfg2.emplace("replicate-from", boost::program_options::variable_value(string("ws://127.0.0.1:3950"), false));
+      standby.initialize(app2_dir.path(), cfg2);
+      standby.startup();
+      std::shared_ptr<chain::database> db2 = standby.chain_database();
+      BOOST_CHECK_EQUAL( db2->head_block_num(), 0u );
+
+      graphene::app::application primary;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3949"), false));
+      cfg.emplace("rpc-endpoint", boost::program_options::variable_value(string("127.0.0.1:3950"), false));
+      cfg.emplace("api-access", boost::program_options::variable_value(boost::filesystem::path(access_file.string()), false));
+      primary.initialize(app_dir.path(), cfg);
+      primary.startup();
+      std::shared_ptr<chain::database> db1 = primary.chain_database();
+
+      auto generate = [&committee_key]( database& db ) {
+         db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), committee_key, database::skip_nothing );
+      };
+      for( int i = 0; i < 3; ++i )
+         generate( *db1 );
+      fc::usleep(fc::milliseconds(500));
+      BOOST_CHECK_EQUAL( db2->head_block_num(), 0u );
+
+      // once connected the standby catches up with the blocks the primary has, then follows the ones it applies
+      fc::usleep(fc::seconds(6));
+      BOOST_CHECK_EQUAL( db2->head_block_num(), 3u );
+      generate( *db1 );
+      fc::usleep(fc::milliseconds(500));
+      BOOST_CHECK_EQUAL( db2->head_block_num(), 4u );
+      BOOST_CHECK( db2->head_block_id() == db1->head_block_id() );
+
+      // replicate-trusted is off by default, so the standby checks the signatures of this one in full
+      signed_transaction trx = make_nathan_transfer( *db1, 1000000 );
+      db1->push_transaction( trx );
+      generate( *db1 );
+      fc::usleep(fc::milliseconds(500));
+      BOOST_CHECK_EQUAL( db2->head_block_num(), 5u );
+      BOOST_CHECK_EQUAL( db2->get_balance( GRAPHENE_NULL_ACCOUNT, asset_id_type() ).amount.value, 1000000 );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( http_batches_are_capped_and_charged_in_full )
+{
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+
+      graphene::app::application app1;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3952"), false));
+      cfg.emplace("rpc-http-endpoint", boost::program_options::variable_value(string("127.0.0.1:3953"), false));
+      cfg.emplace("rpc-http-max-batch-size", boost::program_options::variable_value(uint32_t(3), false));
+      cfg.emplace("rpc-http-batch-concurrency", boost::program_options::variable_value(uint32_t(2), false));
+      cfg.emplace("api-address-rate-limit", boost::program_options::variable_value(uint32_t(1), false));
+      cfg.emplace("api-address-rate-burst", boost::program_options::variable_value(uint32_t(5), false));
+      app1.initialize(app_dir.path(), cfg);
+      app1.startup();
+      fc::usleep(fc::milliseconds(500));
+
+      auto post = []( const string& body ) {
+         fc::http::connection conn;
+         conn.connect_to( fc::ip::endpoint::from_string( "127.0.0.1:3953" ) );
+         return conn.request( "POST", "http://127.0.0.1:3953/", body );
+      };
+      auto call = []( int id, const string& method ) {
+         return "{\"jsonrpc\":\"2.0\",\"id\":" + fc::to_string( int64_t( id ) ) + ",\"method\":\"" + method + "\",\"params\":[]}";
+      };
+
+      // a batch over the size limit is refused before anything is charged for it
+      fc::http::reply reply = post( "[" + call( 1, "get_chain_properties" ) + "," + call( 2, "get_chain_properties" ) + ","
+                                    + call( 3, "get_chain_properties" ) + "," + call( 4, "get_chain_properties" ) + "]" );
+      BOOST_CHECK_EQUAL( reply.status, int( fc::http::reply::BadRequest ) );
+
+      // every call gets its reply in order, one that fails too
+      reply = post( "[" + call( 1, "get_chain_properties" ) + "," + call( 2, "no_such_method" ) + ","
+                    + call( 3, "get_chain_properties" ) + "]" );
+      BOOST_REQUIRE_EQUAL( reply.status, int( fc::http::reply::OK ) );
+      fc::variants replies = fc::json::from_string( string( reply.body.begin(), reply.body.end() ) ).as<fc::variants>();
+      BOOST_REQUIRE_EQUAL( replies.size(), 3u );
+      BOOST_CHECK_EQUAL( replies[0]["id"].as_int64(), 1 );
+      BOOST_CHECK( replies[0].get_object().contains( "result" ) );
+      BOOST_CHECK_EQUAL( replies[1]["id"].as_int64(), 2 );
+      BOOST_CHECK( replies[1].get_object().contains( "error" ) );
+      BOOST_CHECK_EQUAL( replies[2]["id"].as_int64(), 3 );
+      BOOST_CHECK( replies[2].get_object().contains( "result" ) );
+
+      // two of the five units are left, so a batch costing three is refused as a whole
+      reply = post( "[" + call( 1, "get_chain_properties" ) + "," + call( 2, "get_chain_properties" ) + ","
+                    + call( 3, "get_chain_properties" ) + "]" );
+      replies = fc::json::from_string( string( reply.body.begin(), reply.body.end() ) ).as<fc::variants>();
+      BOOST_REQUIRE_EQUAL( replies.size(), 3u );
+      for( const fc::variant& r : replies )
+         BOOST_CHECK_EQUAL( r["error"]["code"].as_int64(), 429 );
+
+      // while a single call still fits
+      reply = post( call( 1, "get_chain_properties" ) );
+      BOOST_CHECK( fc::json::from_string( string( reply.body.begin(), reply.body.end() ) ).get_object().contains( "result" ) );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( adaptive_connections_are_opt_in_and_keep_outbound_peers )
+{
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory app2_dir( graphene::utilities::temp_directory_path() );
+
+      graphene::app::application app1;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3954"), false));
+      app1.initialize(app_dir.path(), cfg);
+
+      graphene::app::application app2;
+      boost::program_options::variables_map cfg2;
+      cfg2.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3955"), false));
+      cfg2.emplace("seed-node", boost::program_options::variable_value(vector<string>{"127.0.0.1:3954"}, false));
+      cfg2.emplace("p2p-adaptive-connections", boost::program_options::variable_value(true, false));
+      app2.initialize(app2_dir.path(), cfg2);
+
+      app1.startup();
+      fc::usleep(fc::milliseconds(500));
+      app2.startup();
+      fc::usleep(fc::milliseconds(500));
+      BOOST_REQUIRE_EQUAL(app1.p2p_node()->get_connection_count(), 1);
+
+      BOOST_CHECK( !app1.p2p_node()->get_advanced_node_parameters()["adaptive_connections"].as<bool>() );
+      BOOST_CHECK( app2.p2p_node()->get_advanced_node_parameters()["adaptive_connections"].as<bool>() );
+
+      // app2 counts any load as overload, so its limit may drop to nothing, but its only peer is one it connected to
+      app2.p2p_node()->set_advanced_node_parameters( fc::mutable_variant_object()
+         ( "desired_number_of_connections", 0 )( "maximum_number_of_connections", 1 )
+         ( "load_high_percent", 0 )( "load_low_percent", 0 ) );
+      fc::usleep(fc::seconds(GRAPHENE_NET_PEER_HANDSHAKE_INACTIVITY_TIMEOUT + 1));
+      BOOST_CHECK_EQUAL( app2.p2p_node()->get_connection_count(), 1u );
+      BOOST_CHECK_EQUAL( app1.p2p_node()->get_connection_count(), 1u );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( light_client_follows_forks_and_maintenance )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir( graphene::utilities::temp_directory_path() );
+      fc::ecc::private_key committee_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("nathan")));
+
+      graphene::app::application server;
+      boost::program_options::variables_map cfg;
+      cfg.emplace("p2p-endpoint", boost::program_options::variable_value(string("127.0.0.1:3956"), false));
+      cfg.emplace("rpc-endpoint", boost::program_options::variable_value(string("127.0.0.1:3957"), false));
+      server.initialize(app_dir.path(), cfg);
+      server.startup();
+      std::shared_ptr<chain::database> db = server.chain_database();
+
+      auto generate = [&committee_key]( database& db, uint32_t slot ) {
+         db.generate_block( db.get_slot_time(slot), db.get_scheduled_witness(slot), committee_key, database::skip_nothing );
+      };
+      const uint32_t witnesses = db->get_global_properties().active_witnesses.size();
+      for( uint32_t i = 0; i < 3 * witnesses; ++i )
+         generate( *db, 1 );
+      const uint32_t anchor = db->get_dynamic_global_properties().last_irreversible_block_num;
+      BOOST_REQUIRE_GT( anchor, 0u );
+      const fc::microseconds poll_wait = fc::seconds( db->get_global_properties().parameters.block_interval + 1 );
+
+      // the client starts from the server's last irreversible block and syncs the headers after it
+      light_client::config light;
+      light.server = "ws://127.0.0.1:3957";
+      light_client client( light );
+      uint32_t applied = 0;
+      client.applied_header.connect( [&applied]( const signed_block_header& ) { ++applied; } );
+      client.start();
+      BOOST_CHECK( client.headers().head_block_id() == db->head_block_id() );
+      BOOST_CHECK_EQUAL( applied, db->head_block_num() - anchor );
+      BOOST_CHECK_GE( client.headers().last_irreversible_block_num(), anchor );
+      BOOST_CHECK_EQUAL( client.headers().active_witnesses().size(), witnesses );
+
+      // the server switches to a fork, the client goes back to where they meet and follows the fork
+      const block_id_type replaced = db->head_block_id();
+      db->pop_block();
+      generate( *db, 2 );
+      generate( *db, 1 );
+      BOOST_REQUIRE( db->get_block_id_for_num( block_header::num_from_id( replaced ) ) != replaced );
+      fc::usleep( poll_wait );
+      BOOST_CHECK( client.headers().head_block_id() == db->head_block_id() );
+      BOOST_CHECK( *client.headers().get_block_id( block_header::num_from_id( replaced ) ) ==
+                   db->get_block_id_for_num( block_header::num_from_id( replaced ) ) );
+
+      // the active witnesses are fetched again after a maintenance, and the headers after it still check
+      const fc::time_point_sec maintenance = db->get_dynamic_global_properties().next_maintenance_time;
+      generate( *db, db->get_slot_at_time( maintenance ) );
+      generate( *db, 1 );
+      BOOST_REQUIRE_GT( db->get_dynamic_global_properties().next_maintenance_time, maintenance );
+      fc::usleep( poll_wait );
+      BOOST_CHECK( client.headers().head_block_id() == db->head_block_id() );
+      BOOST_CHECK_EQUAL( client.headers().active_witnesses().size(), db->get_global_properties().active_witnesses.size() );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
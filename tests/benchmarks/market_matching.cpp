@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/market_object.hpp>
+
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cstdlib>
+
+#include "../common/database_fixture.hpp"
+
+using namespace graphene::chain;
+using namespace graphene::chain::test;
+
+namespace {
+
+uint32_t env_or( const char* name, uint32_t fallback )
+{
+   const char* value = std::getenv( name );
+   if( value == nullptr || std::atoi( value ) <= 0 )
+      return fallback;
+   return uint32_t( std::atoi( value ) );
+}
+
+uint64_t per_second( uint64_t count, const fc::microseconds& elapsed )
+{
+   return uint64_t( double( count ) * 1000000 / std::max<int64_t>( elapsed.count(), 1 ) );
+}
+
+}
+
+/**
+ * Measures the order books of many markets at once: how fast the best order of each market is found through the
+ * by_price index and through the per market books, and how many orders per second are matched in a steady state
+ * where a taker fills the best order of a market and a maker replaces it.
+ *
+ * GRAPHENE_BENCHMARK_MARKETS sets the number of markets, GRAPHENE_BENCHMARK_LEVELS the price levels of each and
+ * GRAPHENE_BENCHMARK_LEVEL_ORDERS the orders of each level, GRAPHENE_BENCHMARK_OPERATIONS the number of fills.
+ */
+BOOST_FIXTURE_TEST_CASE( market_matching, database_fixture )
+{
+   try {
+      const uint32_t market_count = env_or( "GRAPHENE_BENCHMARK_MARKETS", 50 );
+      const uint32_t levels       = env_or( "GRAPHENE_BENCHMARK_LEVELS", 20 );
+      const uint32_t level_orders = env_or( "GRAPHENE_BENCHMARK_LEVEL_ORDERS", 5 );
+      const uint32_t operations   = env_or( "GRAPHENE_BENCHMARK_OPERATIONS", 20000 );
+
+      ACTORS( (maker)(taker) );
+      fund( maker, asset( 100000000 ) );
+      fund( taker, asset( 1000000000 ) );
+
+      auto place = [&]( account_id_type seller, const asset& sell, const asset& receive ) {
+         limit_order_create_operation op;
+         op.seller = seller;
+         op.amount_to_sell = sell;
+         op.min_to_receive = receive;
+         trx.operations.push_back( op );
+         for( auto& o : trx.operations ) db.current_fee_schedule().set_fee( o );
+         db.push_transaction( trx, ~0 );
+         trx.operations.clear();
+      };
+      // each level sells 100 of the asset for a little more core than the one before
+      auto ask = [&]( asset_id_type market, uint32_t level ) {
+         place( maker_id, asset( 100, market ), asset( 100 * ( 100 + level ) ) );
+      };
+
+      vector<asset_id_type> markets;
+      for( uint32_t m = 0; m < market_count; ++m )
+      {
+         const string symbol = string( "BENCH" ) + char( 'A' + m / 26 % 26 ) + char( 'A' + m % 26 );
+         markets.push_back( create_user_issued_asset( symbol ).id );
+         issue_uia( maker, asset( 1000000000, markets.back() ) );
+      }
+      for( uint32_t l = 0; l < levels; ++l )
+         for( uint32_t o = 0; o < level_orders; ++o )
+            for( const asset_id_type& m : markets )
+               ask( m, l );
+
+      const auto& price_index = db.get_index_type<limit_order_index>().indices().get<by_price>();
+      const auto& books = db.limit_order_books();
+      const uint32_t rounds = std::max<uint32_t>( 1, 10000000 / market_count );
+      int64_t for_sale = 0;
+      auto start = fc::time_point::now();
+      for( uint32_t r = 0; r < rounds; ++r )
+         for( const asset_id_type& m : markets )
+            for_sale += price_index.lower_bound( price::max( m, asset_id_type() ) )->for_sale.value;
+      const uint64_t indexed = per_second( uint64_t( rounds ) * market_count, fc::time_point::now() - start );
+      start = fc::time_point::now();
+      for( uint32_t r = 0; r < rounds; ++r )
+         for( const asset_id_type& m : markets )
+            for_sale -= books.first( m, asset_id_type() )->for_sale.value;
+      const uint64_t booked = per_second( uint64_t( rounds ) * market_count, fc::time_point::now() - start );
+      BOOST_CHECK_EQUAL( for_sale, 0 );
+      ilog( "Best order of ${m} markets with ${o} orders: ${i} lookups per second in by_price, ${b} in the books",
+            ("m",market_count)("o",price_index.size())("i",indexed)("b",booked) );
+
+      // the fills of each session are undone, so every session starts from the same books
+      const uint32_t per_session = 100;
+      start = fc::time_point::now();
+      for( uint32_t i = 0; i < operations; )
+      {
+         auto session = db._undo_db.start_undo_session();
+         for( uint32_t j = 0; j < per_session && i < operations; ++j, ++i )
+         {
+            const asset_id_type m = markets[ i % markets.size() ];
+            const limit_order_object* best = books.first( m, asset_id_type() );
+            place( taker_id, best->amount_to_receive(), best->amount_for_sale() );
+            ask( m, i % levels );
+         }
+      }
+      const auto elapsed = fc::time_point::now() - start;
+      ilog( "Matching on ${m} markets of ${l} levels with ${o} orders each: ${f} fills and placements per second",
+            ("m",market_count)("l",levels)("o",level_orders)("f",per_second( operations, elapsed )) );
+      BOOST_CHECK_EQUAL( price_index.size(), uint64_t( market_count ) * levels * level_orders );
+   } catch( fc::exception& e ) {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/market_object.hpp>
+
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cstdlib>
+#include <deque>
+
+using namespace graphene::chain;
+
+namespace {
+
+uint32_t env_or( const char* name, uint32_t fallback )
+{
+   const char* value = std::getenv( name );
+   if( value == nullptr || std::atoi( value ) <= 0 )
+      return fallback;
+   return uint32_t( std::atoi( value ) );
+}
+
+/** the limit order container with the heap allocator, as it was before it got a pool */
+typedef multi_index_container<
+   limit_order_object,
+   limit_order_multi_index_type::index_specifier_type_list
+> heap_limit_order_multi_index_type;
+
+void fill_order( limit_order_object& order, uint64_t n )
+{
+   order.seller = account_id_type( 100 + n % 1000 );
+   order.for_sale = 1000 + n % 97;
+   order.sell_price = price( asset( 1000 + n % 997 ), asset( 1000, asset_id_type(1) ) );
+   order.expiration = fc::time_point_sec( 1500000000 + n % 86400 );
+}
+
+limit_order_object make_order( uint64_t n )
+{
+   limit_order_object order;
+   order.id = limit_order_id_type( n );
+   fill_order( order, n );
+   return order;
+}
+
+/**
+ * Keeps book_size orders in the container, replacing the oldest with a new one operations times, the way
+ * orders are placed and cancelled on a busy market.
+ * @return the operations per second
+ */
+template< typename MultiIndexType >
+uint64_t churn_container( uint32_t book_size, uint32_t operations )
+{
+   MultiIndexType orders;
+   std::deque<object_id_type> ids;
+   uint64_t next = 0;
+   for( ; next < book_size; ++next )
+   {
+      orders.insert( make_order( next ) );
+      ids.push_back( limit_order_id_type( next ) );
+   }
+
+   auto start = fc::time_point::now();
+   for( uint32_t i = 0; i < operations; ++i, ++next )
+   {
+      orders.erase( ids.front() );
+      ids.pop_front();
+      orders.insert( make_order( next ) );
+      ids.push_back( limit_order_id_type( next ) );
+   }
+   auto elapsed = fc::time_point::now() - start;
+   BOOST_CHECK_EQUAL( orders.size(), book_size );
+   return uint64_t( double( operations ) * 1000000 / std::max<int64_t>( elapsed.count(), 1 ) );
+}
+
+}
+
+/**
+ * Measures how many limit orders per second can be created and cancelled on a book of a given size, in the bare
+ * container with the pooled and with the heap allocator, and through the object database with undo sessions
+ * like blocks apply them.
+ *
+ * GRAPHENE_BENCHMARK_BOOK_SIZE sets the orders kept on the book, GRAPHENE_BENCHMARK_OPERATIONS the number of
+ * orders created and cancelled.
+ */
+BOOST_AUTO_TEST_CASE( order_churn )
+{
+   try {
+      const uint32_t book_size  = env_or( "GRAPHENE_BENCHMARK_BOOK_SIZE", 10000 );
+      const uint32_t operations = env_or( "GRAPHENE_BENCHMARK_OPERATIONS", 1000000 );
+
+      const uint64_t pooled = churn_container<limit_order_multi_index_type>( book_size, operations );
+      const uint64_t heap = churn_container<heap_limit_order_multi_index_type>( book_size, operations );
+      ilog( "Limit order container with ${b} orders: ${p} create and cancel per second pooled, ${h} on the heap",
+            ("b",book_size)("p",pooled)("h",heap) );
+
+      database db;
+      db._undo_db.enable();
+      std::deque<limit_order_id_type> ids;
+      uint64_t n = 0;
+      for( ; n < book_size; ++n )
+         ids.push_back( db.create<limit_order_object>( [n]( limit_order_object& o ) {
+            fill_order( o, n );
+         } ).id );
+
+      const uint32_t per_session = 100;
+      auto start = fc::time_point::now();
+      for( uint32_t i = 0; i < operations; )
+      {
+         auto session = db._undo_db.start_undo_session();
+         for( uint32_t j = 0; j < per_session && i < operations; ++j, ++i, ++n )
+         {
+            db.remove( ids.front()( db ) );
+            ids.pop_front();
+            ids.push_back( db.create<limit_order_object>( [n]( limit_order_object& o ) {
+               fill_order( o, n );
+            } ).id );
+         }
+         session.commit();
+      }
+      auto elapsed = fc::time_point::now() - start;
+      const auto usage = db.get_index( limit_order_object::space_id, limit_order_object::type_id ).get_memory_usage();
+      ilog( "Limit order index with ${b} orders: ${o} create and cancel per second in undo sessions of ${s}, "
+            "${i} index bytes",
+            ("b",book_size)("o",uint64_t( double( operations ) * 1000000 / std::max<int64_t>( elapsed.count(), 1 ) ))
+            ("s",per_session)("i",usage.index_bytes) );
+      BOOST_CHECK_EQUAL( usage.object_count, book_size );
+   } catch( fc::exception& e ) {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
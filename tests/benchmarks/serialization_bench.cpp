@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/block_database.hpp>
+#include <graphene/chain/protocol/fee_schedule.hpp>
+#include <graphene/utilities/tempdir.hpp>
+
+#include <fc/crypto/digest.hpp>
+#include <fc/io/json.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cstdlib>
+#include <map>
+
+using namespace graphene::chain;
+
+namespace {
+
+uint32_t env_or( const char* name, uint32_t fallback )
+{
+   const char* value = std::getenv( name );
+   if( value == nullptr || std::atoi( value ) <= 0 )
+      return fallback;
+   return uint32_t( std::atoi( value ) );
+}
+
+struct operation_name_visitor
+{
+   typedef string result_type;
+
+   template<typename Type>
+   result_type operator()( const Type& )const { return fc::get_typename<Type>::name(); }
+};
+
+/** how long each step took for all of the items of one type */
+struct timings
+{
+   uint64_t         count = 0;
+   uint64_t         bytes = 0;
+   fc::microseconds unpack;
+   fc::microseconds pack;
+   fc::microseconds to_variant;
+   fc::microseconds from_variant;
+   fc::microseconds to_json;
+   fc::microseconds from_json;
+};
+
+template< typename Func >
+fc::microseconds time_it( Func&& f )
+{
+   auto start = fc::time_point::now();
+   f();
+   return fc::time_point::now() - start;
+}
+
+/** runs every step over all of the items, checking that each round trip gives back the same bytes */
+template< typename T >
+timings measure( const vector<T>& items )
+{
+   timings t;
+   t.count = items.size();
+
+   vector< vector<char> > packed( items.size() );
+   t.pack = time_it( [&] {
+      for( size_t i = 0; i < items.size(); ++i )
+         packed[i] = fc::raw::pack( items[i] );
+   } );
+   for( const auto& p : packed )
+      t.bytes += p.size();
+
+   vector<T> unpacked( items.size() );
+   t.unpack = time_it( [&] {
+      for( size_t i = 0; i < items.size(); ++i )
+         fc::raw::unpack( packed[i], unpacked[i] );
+   } );
+
+   vector<fc::variant> variants( items.size() );
+   t.to_variant = time_it( [&] {
+      for( size_t i = 0; i < items.size(); ++i )
+         fc::to_variant( unpacked[i], variants[i] );
+   } );
+
+   vector<T> from_variants( items.size() );
+   t.from_variant = time_it( [&] {
+      for( size_t i = 0; i < items.size(); ++i )
+         fc::from_variant( variants[i], from_variants[i] );
+   } );
+
+   vector<string> json( items.size() );
+   t.to_json = time_it( [&] {
+      for( size_t i = 0; i < items.size(); ++i )
+         json[i] = fc::json::to_string( variants[i] );
+   } );
+
+   t.from_json = time_it( [&] {
+      for( size_t i = 0; i < items.size(); ++i )
+         variants[i] = fc::json::from_string( json[i] );
+   } );
+
+   for( size_t i = 0; i < items.size(); ++i )
+   {
+      BOOST_CHECK( fc::raw::pack( from_variants[i] ) == packed[i] );
+      BOOST_CHECK( fc::raw::pack( variants[i].template as<T>() ) == packed[i] );
+   }
+   return t;
+}
+
+void report( const string& name, const timings& t )
+{
+   auto per_second = [&]( fc::microseconds us ) {
+      return uint64_t( double(t.count) * 1000000 / std::max<int64_t>( us.count(), 1 ) );
+   };
+   ilog( "${name}: ${count} items, ${bytes} bytes packed; per second: unpack ${u}, pack ${p}, to_variant ${tv}, "
+         "from_variant ${fv}, to_json ${tj}, from_json ${fj}",
+         ("name",name)("count",t.count)("bytes",t.bytes)("u",per_second(t.unpack))("p",per_second(t.pack))
+         ("tv",per_second(t.to_variant))("fv",per_second(t.from_variant))
+         ("tj",per_second(t.to_json))("fj",per_second(t.from_json)) );
+}
+
+/** writes a short chain of transfers to data_dir, for when there is no real block log to read */
+void produce_blocks( const fc::path& data_dir, uint32_t block_count )
+{
+   const int account_count = 100;
+   const int transfers_per_block = 10;
+   genesis_state_type genesis_state;
+   for( int i = 0; i < account_count; ++i )
+      genesis_state.initial_accounts.emplace_back( "target"+fc::to_string(i),
+            public_key_type(fc::ecc::private_key::regenerate(fc::digest(i)).get_public_key()) );
+   auto witness_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+
+   database db;
+   db.open( data_dir, [&]{return genesis_state;} );
+   for( uint32_t b = 0; b < block_count; ++b )
+   {
+      for( int t = 0; t < transfers_per_block; ++t )
+      {
+         int n = b * transfers_per_block + t;
+         transfer_operation op;
+         op.from = account_id_type( 11 + n % account_count );
+         op.to = account_id_type( 11 + (n + 1) % account_count );
+         op.amount = asset(1);
+
+         signed_transaction trx;
+         trx.operations.push_back( op );
+         db.current_fee_schedule().set_fee( trx.operations.back() );
+         trx.set_expiration( db.head_block_time() + fc::minutes(1) );
+         trx.set_reference_block( db.head_block_id() );
+         db.push_transaction( trx, ~0 );
+      }
+      db.generate_block( db.get_slot_time( 1 ), db.get_scheduled_witness( 1 ), witness_priv_key, ~0 );
+   }
+   db.close();
+}
+
+}
+
+/**
+ * Measures the serialization of blocks and of each operation type over the blocks of a block log.
+ *
+ * GRAPHENE_BENCHMARK_DATA_DIR names the blockchain directory of a node to read the blocks from, which should
+ * be a copy or belong to a node that is not running.  Without it the benchmark writes a short chain of
+ * transfers to read instead.  GRAPHENE_BENCHMARK_BLOCKS limits the number of blocks read, starting at the
+ * first one.
+ */
+BOOST_AUTO_TEST_CASE( serialization_bench )
+{
+   try {
+      fc::temp_directory temp_dir( graphene::utilities::temp_directory_path() );
+      fc::path data_dir;
+      if( const char* dir = std::getenv( "GRAPHENE_BENCHMARK_DATA_DIR" ) )
+         data_dir = fc::path( dir );
+      else
+      {
+         data_dir = temp_dir.path();
+#ifdef NDEBUG
+         produce_blocks( data_dir, 2000 );
+#else
+         produce_blocks( data_dir, 200 );
+#endif
+      }
+      const uint32_t max_blocks = env_or( "GRAPHENE_BENCHMARK_BLOCKS", 100000 );
+
+      vector< std::shared_ptr<const vector<char>> > packed_blocks;
+      {
+         block_database bdb;
+         bdb.open( data_dir / "database" / "block_num_to_block" );
+         auto last = bdb.last_id();
+         BOOST_REQUIRE( last.valid() );
+         uint32_t last_num = std::min( block_header::num_from_id( *last ), max_blocks );
+         packed_blocks.reserve( last_num );
+         for( uint32_t num = 1; num <= last_num; ++num )
+         {
+            auto id = bdb.fetch_block_id( num );
+            auto packed = bdb.fetch_packed( id );
+            if( packed )
+               packed_blocks.push_back( packed );
+         }
+         bdb.close();
+      }
+      BOOST_REQUIRE( !packed_blocks.empty() );
+
+      vector<signed_block> blocks( packed_blocks.size() );
+      auto unpack_elapsed = time_it( [&] {
+         for( size_t i = 0; i < blocks.size(); ++i )
+            fc::raw::unpack( *packed_blocks[i], blocks[i] );
+      } );
+      uint64_t sum = 0;
+      auto id_elapsed = time_it( [&] {
+         for( const auto& b : blocks )
+            sum += b.id()._hash[1];
+      } );
+      auto digest_elapsed = time_it( [&] {
+         for( const auto& b : blocks )
+            sum += b.digest()._hash[0];
+      } );
+      auto trx_digest_elapsed = time_it( [&] {
+         for( const auto& b : blocks )
+            for( const auto& trx : b.transactions )
+               sum += trx.digest()._hash[0];
+      } );
+      uint64_t trx_count = 0;
+      for( const auto& b : blocks )
+         trx_count += b.transactions.size();
+      ilog( "Read ${n} blocks with ${t} transactions: unpack ${u}, id() ${i}, digest() ${d}, transaction digest() ${td}, "
+            "checksum ${s}", ("n",blocks.size())("t",trx_count)("u",unpack_elapsed)("i",id_elapsed)
+            ("d",digest_elapsed)("td",trx_digest_elapsed)("s",sum) );
+
+      report( "signed_block", measure( blocks ) );
+
+      std::map< int, vector<operation> > operations;
+      for( const auto& b : blocks )
+         for( const auto& trx : b.transactions )
+            for( const auto& op : trx.operations )
+               operations[op.which()].push_back( op );
+      blocks.clear();
+      for( const auto& ops : operations )
+         report( ops.second.front().visit( operation_name_visitor() ), measure( ops.second ) );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
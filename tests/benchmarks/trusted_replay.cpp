@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/protocol/fee_schedule.hpp>
+#include <graphene/utilities/tempdir.hpp>
+
+#include <fc/crypto/digest.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace graphene::chain;
+
+namespace {
+
+/** names of the flags set in skip but not in base */
+vector<string> skipped_steps( uint32_t skip, uint32_t base )
+{
+   static const std::pair<uint32_t, const char*> names[] = {
+      { database::skip_witness_signature,      "witness_signature" },
+      { database::skip_transaction_signatures, "transaction_signatures" },
+      { database::skip_transaction_dupe_check, "transaction_dupe_check" },
+      { database::skip_fork_db,                "fork_db" },
+      { database::skip_block_size_check,       "block_size_check" },
+      { database::skip_tapos_check,            "tapos_check" },
+      { database::skip_authority_check,        "authority_check" },
+      { database::skip_merkle_check,           "merkle_check" },
+      { database::skip_assert_evaluation,      "assert_evaluation" },
+      { database::skip_undo_history_check,     "undo_history_check" },
+      { database::skip_witness_schedule_check, "witness_schedule_check" },
+      { database::skip_validate,               "validate" },
+      { database::skip_operation_history,      "operation_history" }
+   };
+   vector<string> result;
+   for( const auto& n : names )
+      if( (skip & n.first) && !(base & n.first) )
+         result.push_back( n.second );
+   return result;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( trusted_replay_bench )
+{
+   try {
+      genesis_state_type genesis_state;
+
+#ifdef NDEBUG
+      const int account_count = 1000;
+      const int blocks_to_produce = 20000;
+#else
+      const int account_count = 100;
+      const int blocks_to_produce = 500;
+#endif
+      const int transfers_per_block = 10;
+
+      for( int i = 0; i < account_count; ++i )
+         genesis_state.initial_accounts.emplace_back("target"+fc::to_string(i),
+                                                     public_key_type(fc::ecc::private_key::regenerate(fc::digest(i)).get_public_key()));
+
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto witness_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+
+      uint32_t      last_num;
+      block_id_type last_id;
+      {
+         database db;
+         db.open(data_dir.path(), [&]{return genesis_state;});
+
+         for( int b = 0; b < blocks_to_produce; ++b )
+         {
+            for( int t = 0; t < transfers_per_block; ++t )
+            {
+               int n = b * transfers_per_block + t;
+               transfer_operation op;
+               op.from = account_id_type( 11 + n % account_count );
+               op.to = account_id_type( 11 + (n + 1) % account_count );
+               op.amount = asset(1);
+
+               signed_transaction trx;
+               trx.operations.push_back( op );
+               db.current_fee_schedule().set_fee( trx.operations.back() );
+               trx.set_expiration( db.head_block_time() + fc::minutes(1) );
+               trx.set_reference_block( db.head_block_id() );
+               db.push_transaction( trx, ~0 );
+            }
+            db.generate_block( db.get_slot_time( 1 ), db.get_scheduled_witness( 1 ), witness_priv_key, ~0 );
+         }
+         last_num = db.head_block_num();
+         last_id = db.head_block_id();
+         db.close();
+      }
+
+      auto replay = [&]( bool trusted ) -> int64_t
+      {
+         database db;
+         if( trusted )
+            db.add_checkpoints( { { last_num, last_id } } );
+         auto start_time = fc::time_point::now();
+         db.reindex( data_dir.path(), genesis_state );
+         int64_t elapsed = (fc::time_point::now() - start_time).count() / 1000;
+         BOOST_CHECK( db.head_block_id() == last_id );
+         db.close();
+         return elapsed;
+      };
+
+      const uint32_t reindex_skip = database::skip_witness_signature |
+                                    database::skip_transaction_signatures |
+                                    database::skip_transaction_dupe_check |
+                                    database::skip_tapos_check |
+                                    database::skip_witness_schedule_check |
+                                    database::skip_authority_check;
+      database probe;
+      ilog( "Trusted replay additionally skips: ${s}", ("s",skipped_steps( probe.trusted_skip_flags(), reindex_skip )) );
+
+      int64_t full_ms = replay( false );
+      int64_t trusted_ms = replay( true );
+      ilog( "Replayed ${c} blocks with ${t} transfers each: ${f} ms normally, ${r} ms trusted (${x}x)",
+            ("c",blocks_to_produce)("t",transfers_per_block)("f",full_ms)("r",trusted_ms)
+            ("x",double(full_ms) / std::max<int64_t>( trusted_ms, 1 )) );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -57,7 +57,7 @@ namespace graphene { namespace chain {
 using std::cout;
 using std::cerr;
 
-database_fixture::database_fixture()
+database_fixture::database_fixture( boost::program_options::variables_map options )
    : app(), db( *app.chain_database() )
 {
    try {
@@ -75,7 +75,9 @@ database_fixture::database_fixture()
    auto mhplugin = app.register_plugin<graphene::market_history::market_history_plugin>();
    init_account_pub_key = init_account_priv_key.get_public_key();
 
-   boost::program_options::variables_map options;
+   // the market history tracks no buckets unless told to, track the default ones
+   options.insert( std::make_pair( "bucket-size",
+                   boost::program_options::variable_value( string( "[15,60,300,3600,86400]" ), false ) ) );
 
    genesis_state.initial_timestamp = time_point_sec( GRAPHENE_TESTING_GENESIS_TIMESTAMP );
 
@@ -151,7 +153,7 @@ void database_fixture::verify_asset_supplies( const database& db )
    const asset_dynamic_data_object& core_asset_data = db.get_core_asset().dynamic_asset_data_id(db);
    BOOST_CHECK(core_asset_data.fee_pool == 0);
 
-   const simple_index<account_statistics_object>& statistics_index = db.get_index_type<simple_index<account_statistics_object>>();
+   const slab_index<account_statistics_object>& statistics_index = db.get_index_type<slab_index<account_statistics_object>>();
    const auto& balance_index = db.get_index_type<account_balance_index>().indices();
    const auto& settle_index = db.get_index_type<force_settlement_index>().indices();
    map<asset_id_type,share_type> total_balances;
@@ -208,6 +210,8 @@ void database_fixture::verify_asset_supplies( const database& db )
 
    BOOST_CHECK_EQUAL( core_in_orders.value , reported_core_in_orders.value );
    BOOST_CHECK_EQUAL( total_balances[asset_id_type()].value , core_asset_data.current_supply.value - core_asset_data.confidential_supply.value);
+   // the running totals agree with the count
+   BOOST_CHECK_NO_THROW( db.verify_supply_totals() );
 //   wlog("***  End  asset supply verification ***");
 }
 
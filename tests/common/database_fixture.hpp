@@ -161,7 +161,9 @@ struct database_fixture {
    bool skip_key_index_test = false;
    uint32_t anon_acct_count;
 
-   database_fixture();
+   /** plugin_options are given to the account and market history plugins */
+   explicit database_fixture( boost::program_options::variables_map plugin_options =
+                                 boost::program_options::variables_map() );
    ~database_fixture();
 
    static fc::ecc::private_key generate_private_key(string seed);
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <iostream>
+#include <random>
+
+#include <fc/io/fstream.hpp>
+#include <fc/io/json.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/protocol/protocol.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+using namespace graphene::chain;
+using namespace std;
+namespace bpo = boost::program_options;
+
+// hack:  import create_example_genesis() even though it's a way, way
+// specific internal detail
+namespace graphene { namespace app { namespace detail {
+genesis_state_type create_example_genesis();
+} } } // graphene::app::detail
+
+/**
+ *  Fills blocks with a mix of transfers, limit orders, account registrations and proposals between accounts it
+ *  registers itself, each one signed by the key of the account paying for it.  Every account gets some core and
+ *  some of the LOAD asset on registration, and the orders trade between the two at prices close enough to fill
+ *  some of the time.
+ */
+class load_generator
+{
+   public:
+      struct operation_mix
+      {
+         uint32_t transfers = 60;
+         uint32_t orders = 25;
+         uint32_t accounts = 10;
+         uint32_t proposals = 5;
+
+         uint32_t total()const { return transfers + orders + accounts + proposals; }
+      };
+
+      load_generator( database& db, const fc::ecc::private_key& nathan_key, const operation_mix& mix, uint64_t seed )
+         : _db( db ), _mix( mix ), _random( seed )
+      {
+         FC_ASSERT( mix.total() > 0, "The operation mix is empty" );
+         const auto& by_name = db.get_index_type<account_index>().indices().get<by_name>();
+         auto nathan = by_name.find( "nathan" );
+         FC_ASSERT( nathan != by_name.end(), "The genesis state has no nathan account" );
+         _accounts.push_back( nathan->id );
+         _keys.push_back( nathan_key );
+      }
+
+      /** claims nathan's genesis balance, makes it a lifetime member and creates the LOAD asset */
+      void setup()
+      {
+         const account_id_type nathan = _accounts.front();
+         const public_key_type nathan_key = _keys.front().get_public_key();
+
+         balance_claim_operation claim;
+         claim.deposit_to_account = nathan;
+         claim.balance_to_claim = balance_id_type();
+         claim.balance_owner_key = nathan_key;
+         claim.total_claimed = balance_id_type()( _db ).balance;
+
+         account_upgrade_operation upgrade;
+         upgrade.account_to_upgrade = nathan;
+         upgrade.upgrade_to_lifetime_member = true;
+
+         asset_create_operation create;
+         create.issuer = nathan;
+         create.symbol = "LOAD";
+         create.precision = GRAPHENE_BLOCKCHAIN_PRECISION_DIGITS;
+         create.common_options.max_supply = GRAPHENE_MAX_SHARE_SUPPLY;
+         create.common_options.core_exchange_rate = price( asset( 1, asset_id_type(1) ), asset( 1 ) );
+
+         FC_ASSERT( push( 0, { claim, upgrade, create } ) );
+         _load_asset = _db.get_index_type<asset_index>().indices().get<by_symbol>().find( "LOAD" )->id;
+      }
+
+      /** registers count accounts */
+      uint32_t add_accounts( uint32_t count )
+      {
+         uint32_t pushed = 0;
+         for( uint32_t i = 0; i < count; ++i )
+            pushed += add_account();
+         return pushed;
+      }
+
+      /** pushes count transactions of one operation each, picked by the mix */
+      uint32_t add_transactions( uint32_t count )
+      {
+         uint32_t pushed = 0;
+         for( uint32_t i = 0; i < count; ++i )
+         {
+            uint32_t pick = _random() % _mix.total();
+            if( pick < _mix.transfers || _accounts.size() < 2 )
+               pushed += add_transfer();
+            else if( (pick -= _mix.transfers) < _mix.orders )
+               pushed += add_order();
+            else if( (pick -= _mix.orders) < _mix.accounts )
+               pushed += add_account();
+            else
+               pushed += add_proposal();
+         }
+         return pushed;
+      }
+
+      size_t   account_count()const { return _accounts.size(); }
+      uint64_t failed()const        { return _failed; }
+
+   private:
+      /** @return whether the transaction, signed by the key of the account at index signer, was accepted */
+      bool push( size_t signer, vector<operation> ops, processed_transaction* result = nullptr )
+      {
+         signed_transaction trx;
+         trx.operations = std::move( ops );
+         for( auto& op : trx.operations )
+            _db.current_fee_schedule().set_fee( op );
+         const chain_parameters& params = _db.get_global_properties().parameters;
+         trx.set_reference_block( _db.head_block_id() );
+         // a different expiration for every transaction keeps identical operations from being duplicates
+         trx.set_expiration( _db.head_block_time() + fc::seconds( params.maximum_time_until_expiration / 2 )
+                             + fc::seconds( _pushed++ % ( params.maximum_time_until_expiration / 2 ) ) );
+         trx.sign( _keys[signer], _db.get_chain_id() );
+         try
+         {
+            processed_transaction ptx = _db.push_transaction( trx, database::skip_nothing );
+            if( result != nullptr )
+               *result = std::move( ptx );
+            return true;
+         }
+         catch( const fc::exception& e )
+         {
+            ++_failed;
+            dlog( "Generated transaction was rejected: ${e}", ("e",e.to_detail_string()) );
+            return false;
+         }
+      }
+
+      size_t random_account() { return _random() % _accounts.size(); }
+
+      /** an amount of 1 to max whole units */
+      share_type random_amount( uint32_t max )
+      {
+         return int64_t( 1 + _random() % max ) * int64_t( GRAPHENE_BLOCKCHAIN_PRECISION );
+      }
+
+      uint32_t add_account()
+      {
+         const string name = "load-" + fc::to_string( _next_account++ );
+         const fc::ecc::private_key key = fc::ecc::private_key::regenerate( fc::sha256::hash( name ) );
+         const account_id_type nathan = _accounts.front();
+
+         account_create_operation create;
+         create.registrar = nathan;
+         create.referrer = nathan;
+         create.name = name;
+         create.owner = authority( 1, public_key_type( key.get_public_key() ), 1 );
+         create.active = create.owner;
+         create.options.memo_key = key.get_public_key();
+         create.options.voting_account = GRAPHENE_PROXY_TO_SELF_ACCOUNT;
+
+         processed_transaction ptx;
+         if( !push( 0, { create }, &ptx ) )
+            return 0;
+         const account_id_type id = ptx.operation_results[0].get<object_id_type>();
+
+         transfer_operation fund;
+         fund.from = nathan;
+         fund.to = id;
+         fund.amount = asset( 10000 * GRAPHENE_BLOCKCHAIN_PRECISION );
+
+         asset_issue_operation issue;
+         issue.issuer = nathan;
+         issue.asset_to_issue = asset( 10000 * GRAPHENE_BLOCKCHAIN_PRECISION, _load_asset );
+         issue.issue_to_account = id;
+
+         if( !push( 0, { fund, issue } ) )
+            return 1;
+         _accounts.push_back( id );
+         _keys.push_back( key );
+         return 2;
+      }
+
+      uint32_t add_transfer()
+      {
+         const size_t from = random_account();
+         size_t to = random_account();
+         if( to == from )
+            to = ( to + 1 ) % _accounts.size();
+
+         transfer_operation transfer;
+         transfer.from = _accounts[from];
+         transfer.to = _accounts[to];
+         transfer.amount = asset( random_amount( 100 ) );
+         return push( from, { transfer } );
+      }
+
+      uint32_t add_order()
+      {
+         const size_t seller = random_account();
+         const share_type amount = random_amount( 100 );
+         // within 10% either side of one to one, so that buy and sell orders fill each other now and then
+         const share_type wanted = amount.value * int64_t( 90 + _random() % 21 ) / 100;
+         asset_id_type sell_asset;
+         asset_id_type receive_asset = _load_asset;
+         if( _random() % 2 )
+            std::swap( sell_asset, receive_asset );
+
+         limit_order_create_operation order;
+         order.seller = _accounts[seller];
+         order.amount_to_sell = asset( amount, sell_asset );
+         order.min_to_receive = asset( wanted, receive_asset );
+         order.expiration = _db.head_block_time() + fc::days( 1 );
+         return push( seller, { order } );
+      }
+
+      uint32_t add_proposal()
+      {
+         const size_t proposer = random_account();
+         const size_t to = random_account();
+
+         transfer_operation transfer;
+         transfer.from = _accounts[proposer];
+         transfer.to = _accounts[to];
+         transfer.amount = asset( random_amount( 100 ) );
+         _db.current_fee_schedule().set_fee( transfer );
+
+         proposal_create_operation propose;
+         propose.fee_paying_account = _accounts[proposer];
+         propose.proposed_ops.emplace_back( transfer );
+         propose.expiration_time = _db.head_block_time() + fc::hours( 1 );
+         return push( proposer, { propose } );
+      }
+
+      database&                       _db;
+      operation_mix                   _mix;
+      std::mt19937_64                 _random;
+      asset_id_type                   _load_asset;
+      /** the accounts transactions are made for, and the key each one is controlled by */
+      vector<account_id_type>         _accounts;
+      vector<fc::ecc::private_key>    _keys;
+      uint64_t                        _next_account = 0;
+      uint64_t                        _pushed = 0;
+      uint64_t                        _failed = 0;
+};
+
+int main( int argc, char** argv )
+{
+   try
+   {
+      bpo::options_description cli_options("Graphene load blocks");
+      cli_options.add_options()
+            ("help,h", "Print this help message and exit.")
+            ("data-dir", bpo::value<boost::filesystem::path>()->default_value("load_blocks_data_dir"), "Directory containing generator database, the blocks are written to its db/blocks")
+            ("genesis-json,g", bpo::value<boost::filesystem::path>(), "File to read genesis state from, which must give nathan the example genesis key and balance")
+            ("genesis-time,t", bpo::value<uint32_t>()->default_value(0), "Timestamp for genesis state (0=use value from file/example)")
+            ("num-blocks,n", bpo::value<uint32_t>()->default_value(10000), "Number of blocks to generate")
+            ("transactions-per-block,x", bpo::value<uint32_t>()->default_value(100), "Number of transactions to generate for each block")
+            ("initial-accounts,a", bpo::value<uint32_t>()->default_value(1000), "Number of accounts to register before generating load")
+            ("transfer-weight", bpo::value<uint32_t>()->default_value(60), "Relative number of transfers")
+            ("order-weight", bpo::value<uint32_t>()->default_value(25), "Relative number of limit orders")
+            ("account-weight", bpo::value<uint32_t>()->default_value(10), "Relative number of account registrations")
+            ("proposal-weight", bpo::value<uint32_t>()->default_value(5), "Relative number of proposed transfers")
+            ("seed", bpo::value<uint64_t>()->default_value(0), "Seed of the random choices, the same seed and genesis give the same blocks")
+            ("verbose,v", "Enter verbose mode")
+            ;
+
+      bpo::variables_map options;
+      try
+      {
+         boost::program_options::store( boost::program_options::parse_command_line(argc, argv, cli_options), options );
+      }
+      catch (const boost::program_options::error& e)
+      {
+         std::cerr << "load_blocks:  error parsing command line: " << e.what() << "\n";
+         return 1;
+      }
+
+      if( options.count("help") )
+      {
+         std::cout << cli_options << "\n";
+         return 0;
+      }
+
+      fc::path data_dir = options["data-dir"].as<boost::filesystem::path>();
+      if( data_dir.is_relative() )
+         data_dir = fc::current_path() / data_dir;
+
+      genesis_state_type genesis;
+      if( options.count("genesis-json") )
+      {
+         fc::path genesis_json_filename = options["genesis-json"].as<boost::filesystem::path>();
+         std::cerr << "load_blocks:  Reading genesis from file " << genesis_json_filename.preferred_string() << "\n";
+         std::string genesis_json;
+         read_file_contents( genesis_json_filename, genesis_json );
+         genesis = fc::json::from_string( genesis_json ).as< genesis_state_type >();
+      }
+      else
+         genesis = graphene::app::detail::create_example_genesis();
+      uint32_t timestamp = options["genesis-time"].as<uint32_t>();
+      if( timestamp != 0 )
+         genesis.initial_timestamp = fc::time_point_sec( timestamp );
+      std::cerr << "load_blocks:  Genesis timestamp is " << genesis.initial_timestamp.sec_since_epoch() << "\n";
+      bool verbose = (options.count("verbose") != 0);
+
+      uint32_t num_blocks = options["num-blocks"].as<uint32_t>();
+      uint32_t transactions_per_block = options["transactions-per-block"].as<uint32_t>();
+      uint32_t initial_accounts = options["initial-accounts"].as<uint32_t>();
+
+      load_generator::operation_mix mix;
+      mix.transfers = options["transfer-weight"].as<uint32_t>();
+      mix.orders = options["order-weight"].as<uint32_t>();
+      mix.accounts = options["account-weight"].as<uint32_t>();
+      mix.proposals = options["proposal-weight"].as<uint32_t>();
+
+      fc::ecc::private_key nathan_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("nathan")));
+
+      database db;
+      fc::path db_path = data_dir / "db";
+      db.open(db_path, [&]() { return genesis; } );
+      FC_ASSERT( db.head_block_num() == 0, "The generator database already has blocks", ("dir",db_path) );
+
+      load_generator gen( db, nathan_priv_key, mix, options["seed"].as<uint64_t>() );
+      auto next_block = [&]()
+      {
+         signed_block b = db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), nathan_priv_key,
+                                             database::skip_nothing );
+         if( verbose )
+            wdump( (b.block_num())(b.transactions.size()) );
+         return b;
+      };
+
+      gen.setup();
+      next_block();
+      // the registrations take two transactions each
+      while( gen.account_count() <= initial_accounts )
+      {
+         const size_t before = gen.account_count();
+         gen.add_accounts( std::min<uint32_t>( initial_accounts + 1 - before,
+                                               std::max<uint32_t>( transactions_per_block / 2, 1 ) ) );
+         FC_ASSERT( gen.account_count() > before, "Cannot register any accounts" );
+         next_block();
+      }
+
+      uint64_t transactions = 0;
+      for( uint32_t i = 1; i <= num_blocks; ++i )
+      {
+         gen.add_transactions( transactions_per_block );
+         transactions += next_block().transactions.size();
+         if( !verbose && (i%1000) == 0 )
+            std::cerr << "\rblock #" << i << "   transactions " << transactions << "   rejected " << gen.failed();
+      }
+      std::cerr << "\nload_blocks:  Generated " << num_blocks << " blocks with " << transactions << " transactions, "
+                << gen.account_count() << " accounts, head block #" << db.head_block_num() << "\n";
+      db.close();
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cout << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -29,6 +29,7 @@
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
+#include <graphene/chain/transfer_evaluator.hpp>
 
 #include <graphene/db/simple_index.hpp>
 
@@ -51,23 +52,255 @@ BOOST_AUTO_TEST_CASE( sigcheck_benchmark )
    auto elapsed = end-start;
    wdump( ((100000.0*1000000.0) / elapsed.count()) );
 }
-/*
-BOOST_AUTO_TEST_CASE( transfer_benchmark )
+BOOST_AUTO_TEST_CASE( block_sigcheck_benchmark )
 {
-   fc::ecc::private_key nathan_key = fc::ecc::private_key::generate();
-   const key_object& key = register_key(nathan_key.get_public_key());
-   const auto& committee_account = account_id_type()(db);
+   const uint32_t trx_count = 2000;
+   const chain_id_type chain_id = fc::sha256::hash("chain");
+   signed_block b;
+   for( uint32_t i = 0; i < trx_count; ++i )
+   {
+      auto key = fc::ecc::private_key::regenerate( fc::sha256::hash( fc::to_string(i) ) );
+      signed_transaction trx;
+      transfer_operation op;
+      op.from = account_id_type( i );
+      op.amount = asset( i + 1 );
+      trx.operations.push_back( op );
+      trx.sign( key, chain_id );
+      b.transactions.push_back( processed_transaction( trx ) );
+   }
+
+   // measure the recovery itself, not the cache
+   set_signature_cache_size( 0 );
    auto start = fc::time_point::now();
-   for( uint32_t i = 0; i < 1000*1000; ++i )
+   for( const auto& trx : b.transactions )
+      trx.get_signature_keys( chain_id );
+   auto sequential_elapsed = fc::time_point::now() - start;
+   wdump( (trx_count)(sequential_elapsed) );
+
+   for( uint32_t threads : { 1, 2, 4, 8 } )
    {
-      const auto& a = create_account("a"+fc::to_string(i), key.id);
-      transfer( committee_account, a, asset(1000) );
+      database db;
+      db.set_signature_threads( threads );
+      start = fc::time_point::now();
+      auto keys = db.recover_signature_keys( b, chain_id );
+      auto elapsed = fc::time_point::now() - start;
+      BOOST_REQUIRE_EQUAL( keys.size(), b.transactions.size() );
+      for( const auto& k : keys )
+         BOOST_CHECK( k.valid() && k->size() == 1 );
+      wdump( (threads)(elapsed) );
    }
-   auto end = fc::time_point::now();
-   auto elapsed = end - start;
-   wdump( (elapsed) );
+
+   set_signature_cache_size( trx_count );
+   for( const auto& trx : b.transactions )
+      trx.get_signature_keys( chain_id );
+   start = fc::time_point::now();
+   for( const auto& trx : b.transactions )
+      trx.get_signature_keys( chain_id );
+   auto cached_elapsed = fc::time_point::now() - start;
+   wdump( (cached_elapsed) );
+   set_signature_cache_size( 100000 );
+}
+BOOST_AUTO_TEST_CASE( blind_transfer_benchmark )
+{
+   const uint32_t trx_count = 200;
+   vector<signed_transaction> trxs;
+   for( uint32_t i = 0; i < trx_count; ++i )
+   {
+      auto in_blind = fc::sha256::hash( "in" + fc::to_string(i) );
+      auto out1_blind = fc::sha256::hash( "out" + fc::to_string(i) );
+      auto out2_blind = fc::ecc::blind_sum( { in_blind, out1_blind }, 1 );
+      auto nonce = fc::sha256::hash( "nonce" + fc::to_string(i) );
+
+      blind_transfer_operation op;
+      op.fee = asset( 10 );
+      authority owner( 1, public_key_type( fc::ecc::private_key::regenerate( nonce ).get_public_key() ), 1 );
+      op.inputs.push_back( { fc::ecc::blind( in_blind, 1000 ), owner } );
+      blind_output out1, out2;
+      out1.owner = owner;
+      out2.owner = owner;
+      out1.commitment = fc::ecc::blind( out1_blind, 400 );
+      out1.range_proof = fc::ecc::range_proof_sign( 0, out1.commitment, out1_blind, nonce, 0, 0, 400 );
+      out2.commitment = fc::ecc::blind( out2_blind, 1000 - 400 - 10 );
+      out2.range_proof = fc::ecc::range_proof_sign( 0, out2.commitment, out2_blind, nonce, 0, 0, 1000 - 400 - 10 );
+      if( out2.commitment < out1.commitment )
+         std::swap( out1, out2 );
+      op.outputs = { out1, out2 };
+
+      signed_transaction trx;
+      trx.operations.push_back( op );
+      trxs.push_back( trx );
+   }
+
+   // measure the verification itself, not the cache
+   set_validation_cache_size( 0 );
+   auto start = fc::time_point::now();
+   for( const auto& trx : trxs )
+      trx.validate();
+   auto uncached_elapsed = fc::time_point::now() - start;
+
+   // what the chain thread pays for a transaction it has already seen on the way into its block
+   set_validation_cache_size( trx_count );
+   for( const auto& trx : trxs )
+      trx.validate();
+   start = fc::time_point::now();
+   for( const auto& trx : trxs )
+      trx.validate();
+   auto cached_elapsed = fc::time_point::now() - start;
+   wdump( (trx_count)(uncached_elapsed)(cached_elapsed) );
+   set_validation_cache_size( 10000 );
 }
-*/
+
+BOOST_AUTO_TEST_CASE( multisig_authority_benchmark )
+{
+   // account 1 needs 3 of its 5 member accounts, each of which needs 2 of its 3 keys
+   const uint32_t members = 5;
+   const uint32_t rounds = 10000;
+   map< account_id_type, authority > active;
+   flat_set< public_key_type > sigs;
+   authority& top = active[ account_id_type(1) ];
+   top.weight_threshold = 3;
+   for( uint32_t m = 0; m < members; ++m )
+   {
+      account_id_type member( 10 + m );
+      top.account_auths[ member ] = 1;
+      authority& a = active[ member ];
+      a.weight_threshold = 2;
+      for( uint32_t k = 0; k < 3; ++k )
+      {
+         public_key_type key = fc::ecc::private_key::regenerate( fc::sha256::hash( fc::to_string( m * 3 + k ) ) ).get_public_key();
+         a.key_auths[ key ] = 1;
+         if( m < 3 && k < 2 )
+            sigs.insert( key );
+      }
+   }
+   auto get_active = [&]( account_id_type id ) -> const authority* {
+      auto itr = active.find( id );
+      return itr == active.end() ? nullptr : &itr->second;
+   };
+
+   vector< operation > ops;
+   for( uint32_t i = 0; i < 20; ++i )
+   {
+      transfer_operation op;
+      op.from = account_id_type(1);
+      op.to = account_id_type(2);
+      op.amount = asset( i + 1 );
+      ops.push_back( op );
+   }
+
+   auto start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      verify_authority( ops, sigs, get_active, get_active );
+   auto elapsed = fc::time_point::now() - start;
+   wdump( (rounds)(elapsed)( (rounds * 1000000.0) / elapsed.count() ) );
+}
+BOOST_FIXTURE_TEST_CASE( transfer_evaluator_benchmark, database_fixture )
+{ try {
+   const uint32_t op_count = 200000;
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 2 * op_count ) );
+
+   transfer_operation op;
+   op.from = alice_id;
+   op.to = bob_id;
+   op.amount = asset(1);
+   const operation wrapped = op;
+   transaction_evaluation_state eval_state( &db );
+   eval_state.skip_fee_schedule_check = true;
+
+   // the way the database used to dispatch, through the virtual evaluator interface
+   auto start = fc::time_point::now();
+   for( uint32_t i = 0; i < op_count; ++i )
+   {
+      transfer_evaluator eval;
+      generic_evaluator& generic = eval;
+      generic.start_evaluate( eval_state, wrapped, true );
+   }
+   auto virtual_elapsed = fc::time_point::now() - start;
+
+   start = fc::time_point::now();
+   for( uint32_t i = 0; i < op_count; ++i )
+      evaluate_operation<transfer_evaluator>( eval_state, wrapped, true );
+   auto direct_elapsed = fc::time_point::now() - start;
+
+   BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ), int64_t( 2 * op_count ) );
+   double virtual_ops_per_second = ( op_count * 1000000.0 ) / virtual_elapsed.count();
+   double direct_ops_per_second = ( op_count * 1000000.0 ) / direct_elapsed.count();
+   wdump( (op_count)(virtual_ops_per_second)(direct_ops_per_second) );
+} FC_LOG_AND_RETHROW() }
+BOOST_AUTO_TEST_CASE( modify_benchmark )
+{
+   const uint32_t object_count = 100000;
+   const uint32_t rounds = 10;
+   database db;
+   vector< const account_balance_object* > balances;
+   balances.reserve( object_count );
+   for( uint32_t i = 0; i < object_count; ++i )
+      balances.push_back( &db.create<account_balance_object>( [&]( account_balance_object& b ) {
+         b.owner = account_id_type( i );
+      }) );
+
+   // account_balance_object has a primary index declared, so this uses primary_index::modify_object()
+   auto start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      for( const auto* b : balances )
+         db.modify( *b, []( account_balance_object& o ){ o.balance += 1; } );
+   auto typed_elapsed = fc::time_point::now() - start;
+
+   // going through the base type falls back to the virtual index::modify()
+   start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      for( const auto* b : balances )
+         db.modify( static_cast<const object&>(*b), []( object& o ){ static_cast<account_balance_object&>(o).balance += 1; } );
+   auto virtual_elapsed = fc::time_point::now() - start;
+
+   for( const auto* b : balances )
+      BOOST_CHECK_EQUAL( b->balance.value, int64_t( 2 * rounds ) );
+   wdump( (object_count*rounds)(typed_elapsed)(virtual_elapsed) );
+}
+
+BOOST_AUTO_TEST_CASE( balance_lookup_benchmark )
+{
+   const uint32_t account_count = 100000;
+   const uint32_t rounds = 10;
+   database db;
+   vector< const account_balance_object* > balances;
+   balances.reserve( account_count );
+   for( uint32_t i = 0; i < account_count; ++i )
+      balances.push_back( &db.create<account_balance_object>( [&]( account_balance_object& b ) {
+         b.owner = account_id_type( i );
+         b.balance = i;
+      }) );
+
+   const auto& by_account_asset_idx = db.get_index_type<account_balance_index>().indices().get<by_account_asset>();
+   uint64_t found = 0;
+   auto start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      for( uint32_t i = 0; i < account_count; ++i )
+         found += by_account_asset_idx.find( boost::make_tuple( account_id_type( i ), asset_id_type() ) ) != by_account_asset_idx.end();
+   auto ordered_elapsed = fc::time_point::now() - start;
+
+   start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      for( uint32_t i = 0; i < account_count; ++i )
+         found += db.balances_by_account().find( account_id_type( i ), asset_id_type() ) != nullptr;
+   auto table_elapsed = fc::time_point::now() - start;
+   BOOST_CHECK_EQUAL( found, uint64_t( 2 * rounds * account_count ) );
+
+   // what maintenance pays to read the holders in order after a share of the balances changed
+   db.balances_by_account().get_asset_holders( asset_id_type() );
+   start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+   {
+      for( uint32_t i = r; i < account_count; i += 100 )
+         db.modify( *balances[i], [&]( account_balance_object& b ) { b.balance += account_count; } );
+      BOOST_CHECK( db.balances_by_account().get_asset_holders( asset_id_type() ).front()->balance >= account_count );
+   }
+   auto holders_elapsed = fc::time_point::now() - start;
+
+   wdump( (account_count*rounds)(ordered_elapsed)(table_elapsed)(holders_elapsed) );
+}
+
 
 //BOOST_AUTO_TEST_SUITE_END()
 
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <boost/test/unit_test.hpp>
+
+#include <graphene/chain/protocol/protocol.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+using namespace graphene::chain;
+
+namespace {
+
+/** pack, pack_size and unpack every operation type, default constructed, enumerated like size_checker does */
+struct serialization_type_visitor
+{
+   typedef void result_type;
+
+   uint32_t iterations;
+   serialization_type_visitor( uint32_t i ):iterations(i){}
+
+   template<typename Type>
+   result_type operator()( const Type& op )const
+   {
+      operation wrapped = op;
+      auto packed = fc::raw::pack( wrapped );
+      BOOST_CHECK_EQUAL( packed.size(), fc::raw::pack_size( wrapped ) );
+      BOOST_CHECK( hash_packed<digest_type>( wrapped ) == digest_type::hash( wrapped ) );
+
+      auto start = fc::time_point::now();
+      size_t total = 0;
+      for( uint32_t i = 0; i < iterations; ++i )
+         total += fc::raw::pack( wrapped ).size();
+      auto pack_elapsed = fc::time_point::now() - start;
+
+      start = fc::time_point::now();
+      for( uint32_t i = 0; i < iterations; ++i )
+         total += fc::raw::pack_size( wrapped );
+      auto pack_size_elapsed = fc::time_point::now() - start;
+
+      start = fc::time_point::now();
+      for( uint32_t i = 0; i < iterations; ++i )
+         total += fc::raw::unpack<operation>( packed ).which();
+      auto unpack_elapsed = fc::time_point::now() - start;
+
+      BOOST_CHECK( fc::raw::pack( fc::raw::unpack<operation>( packed ) ) == packed );
+      std::string name = fc::get_typename<Type>::name();
+      auto wire_size = packed.size();
+      wdump( (name)(wire_size)(pack_elapsed)(pack_size_elapsed)(unpack_elapsed)(total) );
+   }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( operation_serialization_benchmark )
+{
+   operation op;
+   for( int32_t i = 0; i < op.count(); ++i )
+   {
+      op.set_which( i );
+      op.visit( serialization_type_visitor( 10000 ) );
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_serialization_benchmark )
+{
+   const uint32_t trx_count = 2000;
+   const uint32_t iterations = 20;
+   const chain_id_type chain_id = fc::sha256::hash( "chain" );
+   signed_block b;
+   for( uint32_t i = 0; i < trx_count; ++i )
+   {
+      auto key = fc::ecc::private_key::regenerate( fc::sha256::hash( fc::to_string(i) ) );
+      signed_transaction trx;
+      transfer_operation op;
+      op.from = account_id_type( i );
+      op.to = account_id_type( i + 1 );
+      op.amount = asset( i + 1 );
+      trx.operations.push_back( op );
+      trx.sign( key, chain_id );
+      b.transactions.push_back( processed_transaction( trx ) );
+   }
+   b.transaction_merkle_root = b.calculate_merkle_root();
+
+   // the buffered hashes must be the ones the encoder computes from the same fields
+   for( const auto& trx : b.transactions )
+   {
+      digest_type::encoder enc;
+      fc::raw::pack( enc, static_cast<const transaction&>( trx ) );
+      BOOST_CHECK( trx.digest() == enc.result() );
+      digest_type::encoder sig_enc;
+      fc::raw::pack( sig_enc, chain_id );
+      fc::raw::pack( sig_enc, static_cast<const transaction&>( trx ) );
+      BOOST_CHECK( trx.sig_digest( chain_id ) == sig_enc.result() );
+      BOOST_CHECK( trx.merkle_digest() == digest_type::hash( trx ) );
+   }
+   BOOST_CHECK( b.digest() == digest_type::hash( static_cast<const block_header&>( b ) ) );
+
+   auto packed = fc::raw::pack( b );
+   BOOST_CHECK_EQUAL( packed.size(), fc::raw::pack_size( b ) );
+   BOOST_CHECK( fc::raw::pack( fc::raw::unpack<signed_block>( packed ) ) == packed );
+
+   size_t total = 0;
+   auto start = fc::time_point::now();
+   for( uint32_t i = 0; i < iterations; ++i )
+      total += fc::raw::pack( b ).size();
+   auto pack_elapsed = fc::time_point::now() - start;
+
+   start = fc::time_point::now();
+   for( uint32_t i = 0; i < iterations; ++i )
+      total += fc::raw::unpack<signed_block>( packed ).transactions.size();
+   auto unpack_elapsed = fc::time_point::now() - start;
+
+   start = fc::time_point::now();
+   for( uint32_t i = 0; i < iterations; ++i )
+      for( const auto& trx : b.transactions )
+      {
+         digest_type::encoder enc;
+         fc::raw::pack( enc, trx );
+         total += enc.result()._hash[0];
+      }
+   auto encoder_elapsed = fc::time_point::now() - start;
+
+   start = fc::time_point::now();
+   for( uint32_t i = 0; i < iterations; ++i )
+      for( const auto& trx : b.transactions )
+         total += hash_packed<digest_type>( trx )._hash[0];
+   auto buffered_elapsed = fc::time_point::now() - start;
+
+   auto block_size = packed.size();
+   wdump( (trx_count)(block_size)(pack_elapsed)(unpack_elapsed)(encoder_elapsed)(buffered_elapsed)(total) );
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <boost/test/unit_test.hpp>
+
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/market_object.hpp>
+#include <graphene/chain/proposal_object.hpp>
+
+#include "../common/database_fixture.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace graphene::chain;
+using namespace graphene::chain::test;
+
+namespace {
+
+uint32_t env_or( const char* name, uint32_t fallback )
+{
+   const char* value = std::getenv( name );
+   if( value == nullptr || std::atoi( value ) <= 0 )
+      return fallback;
+   return uint32_t( std::atoi( value ) );
+}
+
+/**
+ * Sets up accounts for the throughput benchmarks, which push fully signed transactions one at a time with
+ * the default skip flags and produce a block every transactions_per_block of them.
+ *
+ * GRAPHENE_BENCHMARK_ACCOUNTS sets the number of accounts the load is spread over and
+ * GRAPHENE_BENCHMARK_TRANSACTIONS the number of transactions each benchmark pushes.
+ */
+struct throughput_fixture : database_fixture
+{
+   const uint32_t transactions_per_block = 100;
+   uint32_t       transaction_count;
+
+   vector<account_id_type>      accounts;
+   vector<fc::ecc::private_key> keys;
+   asset_id_type                bench_asset;
+
+   throughput_fixture()
+   {
+#ifdef NDEBUG
+      uint32_t account_count = env_or( "GRAPHENE_BENCHMARK_ACCOUNTS", 1000 );
+      transaction_count = env_or( "GRAPHENE_BENCHMARK_TRANSACTIONS", 20000 );
+#else
+      uint32_t account_count = env_or( "GRAPHENE_BENCHMARK_ACCOUNTS", 100 );
+      transaction_count = env_or( "GRAPHENE_BENCHMARK_TRANSACTIONS", 1000 );
+#endif
+      // even, so the limit order benchmark alternates buyers and sellers
+      account_count = std::max<uint32_t>( account_count + account_count % 2, 2 );
+
+      bench_asset = create_user_issued_asset( "BENCH" ).id;
+      accounts.reserve( account_count );
+      keys.reserve( account_count );
+      for( uint32_t i = 0; i < account_count; ++i )
+      {
+         string name = "bench" + fc::to_string( i );
+         keys.push_back( generate_private_key( name ) );
+         const account_object& account = create_account( name, keys.back().get_public_key() );
+         accounts.push_back( account.id );
+         fund( account, asset( 10000000 ) );
+         issue_uia( account, asset( 10000000, bench_asset ) );
+         upgrade_to_lifetime_member( account );
+      }
+      generate_block();
+      set_expiration( db, trx );
+   }
+
+   /**
+    * Pushes transaction_count transactions, the i-th holding make_op(i) and signed by account i % accounts.size(),
+    * and logs the sustained rate, block production included, and the percentiles of the push latency.
+    */
+   template<typename MakeOp>
+   void run( const string& name, MakeOp make_op )
+   {
+      vector<int64_t>  latencies;
+      latencies.reserve( transaction_count );
+      fc::microseconds total;
+      for( uint32_t first = 0; first < transaction_count; first += transactions_per_block )
+      {
+         const uint32_t end = std::min( transaction_count, first + transactions_per_block );
+         vector<signed_transaction> batch;
+         batch.reserve( end - first );
+         for( uint32_t i = first; i < end; ++i )
+         {
+            signed_transaction t;
+            t.operations.push_back( make_op( i ) );
+            for( auto& op : t.operations )
+               db.current_fee_schedule().set_fee( op );
+            set_expiration( db, t );
+            t.sign( keys[ i % keys.size() ], db.get_chain_id() );
+            batch.push_back( std::move( t ) );
+         }
+
+         auto batch_start = fc::time_point::now();
+         for( const auto& t : batch )
+         {
+            auto start = fc::time_point::now();
+            db.push_transaction( t );
+            latencies.push_back( ( fc::time_point::now() - start ).count() );
+         }
+         generate_block();
+         total += fc::time_point::now() - batch_start;
+      }
+
+      std::sort( latencies.begin(), latencies.end() );
+      auto percentile = [&]( uint32_t p ) {
+         return latencies[ std::min<size_t>( latencies.size() - 1, latencies.size() * p / 100 ) ];
+      };
+      const double tx_per_second = ( transaction_count * 1000000.0 ) / total.count();
+      ilog( "${name}: ${n} transactions over ${a} accounts, ${r} tx/s, push latency p50 ${p50} us, p99 ${p99} us",
+            ("name",name)("n",transaction_count)("a",accounts.size())("r",tx_per_second)
+            ("p50",percentile( 50 ))("p99",percentile( 99 )) );
+   }
+
+   account_id_type account( uint32_t i )const { return accounts[ i % accounts.size() ]; }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE( throughput_benchmarks, throughput_fixture )
+
+BOOST_AUTO_TEST_CASE( transfer_throughput )
+{ try {
+   run( "transfer", [&]( uint32_t i ) {
+      transfer_operation op;
+      op.from = account( i );
+      op.to = account( i + 1 );
+      // distinct amounts, so no two transactions are the same
+      op.amount = asset( 1 + i / accounts.size() );
+      return operation( op );
+   } );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( limit_order_throughput )
+{ try {
+   // even accounts buy BENCH, odd ones sell it at the same price, so every other order fills the one before it
+   run( "limit order", [&]( uint32_t i ) {
+      limit_order_create_operation op;
+      op.seller = account( i );
+      const share_type amount = 10 + i / accounts.size();
+      if( i % 2 == 0 )
+      {
+         op.amount_to_sell = asset( amount );
+         op.min_to_receive = asset( amount, bench_asset );
+      }
+      else
+      {
+         op.amount_to_sell = asset( amount, bench_asset );
+         op.min_to_receive = asset( amount );
+      }
+      op.expiration = db.head_block_time() + fc::days( 1 );
+      return operation( op );
+   } );
+   BOOST_CHECK( db.get_index_type<limit_order_index>().indices().empty() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( account_create_throughput )
+{ try {
+   run( "account create", [&]( uint32_t i ) {
+      const account_object& registrar = account( i )( db );
+      return operation( make_account( "created" + fc::to_string( i ), registrar, registrar, 100,
+                                      keys[ i % keys.size() ].get_public_key() ) );
+   } );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( proposal_throughput )
+{ try {
+   run( "proposal create", [&]( uint32_t i ) {
+      transfer_operation transfer;
+      transfer.from = account( i );
+      transfer.to = account( i + 1 );
+      transfer.amount = asset( 1 + i / accounts.size() );
+
+      proposal_create_operation op;
+      op.fee_paying_account = account( i );
+      op.proposed_ops.emplace_back( transfer );
+      op.expiration_time = db.head_block_time() + fc::days( 1 );
+      return operation( op );
+   } );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <boost/test/unit_test.hpp>
+
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+
+#include <memory>
+
+using namespace graphene::chain;
+
+namespace {
+   /** allocator counting what the containers using it take from the heap */
+   struct allocation_stats
+   {
+      uint64_t count = 0;
+      uint64_t bytes = 0;
+   };
+
+   template<typename T>
+   struct counting_allocator
+   {
+      typedef T value_type;
+
+      explicit counting_allocator( allocation_stats& s ) : stats( &s ) {}
+      template<typename U> counting_allocator( const counting_allocator<U>& o ) : stats( o.stats ) {}
+
+      T* allocate( std::size_t n )
+      {
+         ++stats->count;
+         stats->bytes += n * sizeof(T) + graphene::db::heap_allocation_overhead;
+         return std::allocator<T>().allocate( n );
+      }
+      void deallocate( T* p, std::size_t n ) { std::allocator<T>().deallocate( p, n ); }
+
+      template<typename U> bool operator == ( const counting_allocator<U>& o )const { return stats == o.stats; }
+      template<typename U> bool operator != ( const counting_allocator<U>& o )const { return stats != o.stats; }
+
+      allocation_stats* stats;
+   };
+}
+
+BOOST_AUTO_TEST_CASE( undo_allocation_benchmark )
+{
+   const uint32_t object_count = 100000;
+   database db;
+   // the database is not opened, undo has to be enabled for the sessions below to record anything
+   db._undo_db.enable();
+   vector< const account_balance_object* > balances;
+   balances.reserve( object_count );
+   {
+      auto ses = db._undo_db.start_undo_session();
+      for( uint32_t i = 0; i < object_count; ++i )
+         balances.push_back( &db.create<account_balance_object>( [&]( account_balance_object& b ) {
+            b.owner = account_id_type( i );
+            b.balance = i;
+         }) );
+      ses.commit();
+   }
+
+   // the former undo_state representation, one clone per modified object
+   allocation_stats clone_stats;
+   auto start = fc::time_point::now();
+   {
+      typedef std::pair< const object_id_type, unique_ptr<object> > value_type;
+      std::unordered_map< object_id_type, unique_ptr<object>, std::hash<object_id_type>,
+                          std::equal_to<object_id_type>, counting_allocator<value_type> >
+         old_values( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(),
+                     counting_allocator<value_type>( clone_stats ) );
+      for( const auto* b : balances )
+      {
+         old_values[b->id] = b->clone();
+         // account_balance_object owns no heap data, cloning it is a single allocation
+         ++clone_stats.count;
+         clone_stats.bytes += sizeof(account_balance_object) + graphene::db::heap_allocation_overhead;
+      }
+   }
+   auto clone_elapsed = fc::time_point::now() - start;
+
+   start = fc::time_point::now();
+   uint64_t packed_bytes = 0;
+   {
+      auto ses = db._undo_db.start_undo_session();
+      for( const auto* b : balances )
+         db._undo_db.on_modify( *b );
+      BOOST_REQUIRE_EQUAL( db._undo_db.head().old_values.size(), object_count );
+      const auto usage = db._undo_db.get_memory_usage();
+      BOOST_REQUIRE( !usage.states.empty() );
+      packed_bytes = usage.states.back().total_bytes;
+      ses.merge();
+   }
+   auto packed_elapsed = fc::time_point::now() - start;
+
+   wdump( (object_count)(clone_stats.count)(clone_stats.bytes)(clone_elapsed)(packed_bytes)(packed_elapsed) );
+   BOOST_CHECK_LT( packed_bytes, clone_stats.bytes );
+}
@@ -646,6 +646,144 @@ BOOST_FIXTURE_TEST_CASE( proposal_two_accounts, database_fixture )
    }
 } FC_LOG_AND_RETHROW() }
 
+BOOST_FIXTURE_TEST_CASE( proposals_by_approver, database_fixture )
+{ try {
+   generate_block();
+
+   auto nathan_key = generate_private_key("nathan");
+   const account_object& nathan = create_account("nathan", nathan_key.get_public_key() );
+   const account_object& dan = create_account("dan");
+   transfer(account_id_type()(db), nathan, asset(100000));
+
+   {
+      transfer_operation top;
+      top.from = dan.get_id();
+      top.to = nathan.get_id();
+      top.amount = asset(500);
+
+      proposal_create_operation pop;
+      pop.proposed_ops.emplace_back(top);
+      pop.fee_paying_account = nathan.get_id();
+      pop.expiration_time = db.head_block_time() + fc::days(1);
+      trx.operations.push_back(pop);
+      sign( trx, nathan_key );
+      PUSH_TX( db, trx );
+      trx.clear();
+   }
+
+   const auto& pidx = dynamic_cast<const primary_index<proposal_index>&>( db.get_index_type<proposal_index>() );
+   const auto& by_approver = pidx.get_secondary_index<required_approval_index>()._account_to_proposals;
+   const proposal_object& prop = *db.get_index_type<proposal_index>().indices().begin();
+   const proposal_id_type pid = prop.id;
+   auto proposals_of = [&]( account_id_type a ) {
+      auto itr = by_approver.find( a );
+      return itr == by_approver.end() ? set<proposal_id_type>() : itr->second;
+   };
+
+   BOOST_CHECK( proposals_of( dan.id ) == set<proposal_id_type>{ pid } );
+   BOOST_CHECK( proposals_of( nathan.id ).empty() );
+
+   // accounts approving later on are tracked as well
+   db.modify( prop, [&]( proposal_object& p ) { p.available_active_approvals.insert( nathan.id ); } );
+   BOOST_CHECK( proposals_of( nathan.id ) == set<proposal_id_type>{ pid } );
+   db.modify( prop, [&]( proposal_object& p ) { p.available_active_approvals.erase( nathan.id ); } );
+   BOOST_CHECK( proposals_of( nathan.id ).empty() );
+   BOOST_CHECK( proposals_of( dan.id ) == set<proposal_id_type>{ pid } );
+
+   db.remove( prop );
+   BOOST_CHECK( by_approver.find( dan.id ) == by_approver.end() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( proposal_authorization_cache, database_fixture )
+{ try {
+   generate_block();
+
+   auto nathan_key = generate_private_key("nathan");
+   const account_object& nathan = create_account("nathan", nathan_key.get_public_key() );
+   const account_object& dan = create_account("dan");
+   transfer(account_id_type()(db), nathan, asset(100000));
+
+   {
+      transfer_operation top;
+      top.from = dan.get_id();
+      top.to = nathan.get_id();
+      top.amount = asset(500);
+
+      proposal_create_operation pop;
+      pop.proposed_ops.emplace_back(top);
+      pop.fee_paying_account = nathan.get_id();
+      pop.expiration_time = db.head_block_time() + fc::days(1);
+      trx.operations.push_back(pop);
+      sign( trx, nathan_key );
+      PUSH_TX( db, trx );
+      trx.clear();
+   }
+
+   const proposal_object& prop = *db.get_index_type<proposal_index>().indices().begin();
+   const proposal_id_type pid = prop.id;
+   const uint8_t depth = db.get_global_properties().parameters.max_authority_depth;
+   BOOST_CHECK( !db.proposal_authorizations().find( pid, depth ).valid() );
+   BOOST_CHECK( !prop.is_authorized_to_execute(db) );
+   BOOST_REQUIRE( db.proposal_authorizations().find( pid, depth ).valid() );
+   BOOST_CHECK( !*db.proposal_authorizations().find( pid, depth ) );
+
+   // nathan's approval doesn't satisfy dan's authority, until dan delegates it to nathan
+   db.modify( prop, [&]( proposal_object& p ) { p.available_active_approvals.insert( nathan.id ); } );
+   BOOST_CHECK( !db.proposal_authorizations().find( pid, depth ).valid() );
+   BOOST_CHECK( !prop.is_authorized_to_execute(db) );
+   db.modify( dan, [&]( account_object& a ) {
+      a.active = authority( 1, nathan.get_id(), 1 );
+   } );
+   BOOST_CHECK( !db.proposal_authorizations().find( pid, depth ).valid() );
+   BOOST_CHECK( prop.is_authorized_to_execute(db) );
+   BOOST_CHECK( *db.proposal_authorizations().find( pid, depth ) );
+
+   // modifying anything but the approvals keeps the result
+   db.modify( prop, [&]( proposal_object& p ) { p.expiration_time += 1; } );
+   BOOST_CHECK( db.proposal_authorizations().find( pid, depth ).valid() );
+
+   db.remove( prop );
+   BOOST_CHECK( !db.proposal_authorizations().find( pid, depth ).valid() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( authority_account_cache, database_fixture )
+{ try {
+   ACTORS( (alice)(bob) );
+   transfer( account_id_type()(db), alice, asset(100000) );
+   generate_block();
+
+   BOOST_CHECK( &db.authority_account( alice_id ) == &alice_id(db) );
+   BOOST_CHECK( db.authority_account( alice_id ).active == authority( 1, alice_private_key.get_public_key(), 1 ) );
+
+   // an account update shows up in the next authority check of the same block
+   {
+      account_update_operation op;
+      op.account = alice_id;
+      op.active = authority( 1, bob_id, 1 );
+      trx.operations.push_back( op );
+      sign( trx, alice_private_key );
+      PUSH_TX( db, trx );
+      trx.clear();
+   }
+   BOOST_CHECK( db.authority_account( alice_id ).active == authority( 1, bob_id, 1 ) );
+
+   // bob may now transfer for alice
+   transfer_operation top;
+   top.from = alice_id;
+   top.to = bob_id;
+   top.amount = asset( 500 );
+   trx.operations.push_back( top );
+   sign( trx, bob_private_key );
+   PUSH_TX( db, trx );
+   trx.clear();
+   BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ), 500 );
+
+   // undoing the update puts the old authority back
+   generate_block();
+   db.pop_block();
+   BOOST_CHECK( db.authority_account( alice_id ).active == authority( 1, alice_private_key.get_public_key(), 1 ) );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_FIXTURE_TEST_CASE( proposal_delete, database_fixture )
 { try {
    generate_block();
@@ -1313,4 +1451,88 @@ BOOST_FIXTURE_TEST_CASE( nonminimal_sig_test, database_fixture )
    }
 }
 
+BOOST_AUTO_TEST_CASE( signature_key_cache )
+{
+   try
+   {
+      fc::ecc::private_key alice_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "alice" ) ) );
+      fc::ecc::private_key bob_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "bob" ) ) );
+      const chain_id_type& chain_id = db.get_chain_id();
+
+      signed_transaction tx;
+      transfer_operation op;
+      op.amount = asset(1);
+      tx.operations.push_back( op );
+      tx.sign( alice_key, chain_id );
+
+      flat_set<public_key_type> expected{ alice_key.get_public_key() };
+      BOOST_CHECK( tx.get_signature_keys( chain_id ) == expected );
+      // served from the cache this time
+      BOOST_CHECK( tx.get_signature_keys( chain_id ) == expected );
+
+      // the same signature over a different digest recovers a different key
+      signed_transaction other = tx;
+      other.operations.front().get<transfer_operation>().amount = asset(2);
+      BOOST_CHECK( other.get_signature_keys( chain_id ) != expected );
+
+      // a cached signature is still counted once per occurrence
+      tx.signatures.push_back( tx.signatures.front() );
+      GRAPHENE_REQUIRE_THROW( tx.get_signature_keys( chain_id ), tx_duplicate_sig );
+
+      set_signature_cache_size( 0 );
+      // sign() appends, drop the duplicate first
+      tx.signatures.pop_back();
+      tx.sign( bob_key, chain_id );
+      BOOST_CHECK_EQUAL( tx.get_signature_keys( chain_id ).size(), 2u );
+      set_signature_cache_size( 100000 );
+   }
+   catch(fc::exception& e)
+   {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( address_authorities )
+{
+   try
+   {
+      fc::ecc::private_key alice_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "alice" ) ) );
+      fc::ecc::private_key bob_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "bob" ) ) );
+      public_key_type alice_public_key = alice_key.get_public_key();
+      public_key_type bob_public_key = bob_key.get_public_key();
+
+      map< account_id_type, authority > active;
+      // account 1 is controlled by one of alice's legacy addresses, account 2 by an address nobody signs with
+      active[ account_id_type(1) ].weight_threshold = 1;
+      active[ account_id_type(1) ].address_auths[ address( pts_address( alice_public_key, true, 56 ) ) ] = 1;
+      active[ account_id_type(2) ].weight_threshold = 1;
+      active[ account_id_type(2) ].address_auths[ address( pts_address( bob_public_key, false, 0 ) ) ] = 1;
+      auto get_active = [&]( account_id_type id ) -> const authority* {
+         auto itr = active.find( id );
+         return itr == active.end() ? nullptr : &itr->second;
+      };
+
+      auto ops_from = []( account_id_type from ) {
+         transfer_operation op;
+         op.from = from;
+         op.amount = asset(1);
+         return vector<operation>{ op, op };
+      };
+
+      verify_authority( ops_from( account_id_type(1) ), { alice_public_key }, get_active, get_active );
+      GRAPHENE_REQUIRE_THROW( verify_authority( ops_from( account_id_type(2) ), { alice_public_key }, get_active, get_active ),
+                              tx_missing_active_auth );
+      verify_authority( ops_from( account_id_type(2) ), { bob_public_key }, get_active, get_active );
+      GRAPHENE_REQUIRE_THROW( verify_authority( ops_from( account_id_type(1) ), { alice_public_key, bob_public_key },
+                                                get_active, get_active ),
+                              tx_irrelevant_sig );
+   }
+   catch(fc::exception& e)
+   {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -24,8 +24,13 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <graphene/app/api_stats.hpp>
+#include <graphene/app/block_trace.hpp>
+#include <graphene/app/rate_limit.hpp>
+
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/protocol/protocol.hpp>
+#include <graphene/chain/protocol/digest_batch.hpp>
 
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
@@ -33,8 +38,15 @@
 
 #include <graphene/db/simple_index.hpp>
 
+#include <graphene/net/config.hpp>
+#include <graphene/net/peer_connection.hpp>
+#include <graphene/net/peer_database.hpp>
+
+#include <graphene/utilities/tempdir.hpp>
+
 #include <fc/crypto/digest.hpp>
 #include <fc/crypto/hex.hpp>
+#include <fc/io/fstream.hpp>
 #include "../common/database_fixture.hpp"
 
 #include <algorithm>
@@ -197,6 +209,58 @@ BOOST_AUTO_TEST_CASE( memo_test )
    BOOST_CHECK_EQUAL(m.get_message(receiver, sender.get_public_key()), "Hello, world!");
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( memo_decryptor_test )
+{ try {
+   auto sender = generate_private_key("1");
+   auto receiver = generate_private_key("2");
+   auto stranger = generate_private_key("3");
+
+   vector<memo_data> memos;
+   for( uint32_t i = 0; i < 4; ++i )
+   {
+      memo_data m;
+      m.set_message( sender, receiver.get_public_key(), "memo " + fc::to_string(i), i + 1 );
+      memos.push_back( m );
+   }
+   memo_data from_stranger;
+   from_stranger.set_message( stranger, sender.get_public_key(), "not for the receiver", 1 );
+   memos.push_back( from_stranger );
+   memo_data tampered = memos[0];
+   tampered.nonce = 99;
+   memos.push_back( tampered );
+   memo_data plain;
+   plain.set_message( fc::ecc::private_key(), receiver.get_public_key(), "public" );
+   memos.push_back( plain );
+
+   memo_decryptor decryptor( 2 );
+   decryptor.add_key( receiver );
+   BOOST_CHECK( decryptor.has_key( receiver.get_public_key() ) );
+   BOOST_CHECK( !decryptor.has_key( sender.get_public_key() ) );
+   for( uint32_t pass = 0; pass < 2; ++pass )
+   {
+      auto texts = decryptor.decrypt( memos );
+      BOOST_REQUIRE_EQUAL( texts.size(), memos.size() );
+      for( uint32_t i = 0; i < 4; ++i )
+      {
+         BOOST_REQUIRE( texts[i].valid() );
+         BOOST_CHECK_EQUAL( *texts[i], "memo " + fc::to_string(i) );
+      }
+      BOOST_CHECK( !texts[4].valid() );
+      BOOST_CHECK( !texts[5].valid() );
+      BOOST_REQUIRE( texts[6].valid() );
+      BOOST_CHECK_EQUAL( *texts[6], "public" );
+   }
+
+   // the sender reads its own memos with the same secret
+   memo_decryptor sender_decryptor;
+   sender_decryptor.add_key( sender );
+   BOOST_CHECK_EQUAL( *sender_decryptor.decrypt( memos[1] ), "memo 1" );
+   BOOST_CHECK_EQUAL( *sender_decryptor.decrypt( from_stranger ), "not for the receiver" );
+
+   decryptor.clear();
+   BOOST_CHECK( !decryptor.decrypt( memos[0] ).valid() );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( exceptions )
 {
    GRAPHENE_CHECK_THROW(FC_THROW_EXCEPTION(balance_claim_invalid_claim_amount, "Etc"), balance_claim_invalid_claim_amount);
@@ -410,4 +474,343 @@ BOOST_AUTO_TEST_CASE( merkle_root )
    BOOST_CHECK( block.calculate_merkle_root() == c(dO) );
 }
 
+/** hashes a merkle level in place, as calculate_merkle_root() does, and into a separate output */
+BOOST_AUTO_TEST_CASE( digest_pairs )
+{
+   vector<digest_type> level;
+   for( uint32_t i = 0; i < 19; ++i )
+      level.push_back( digest_type::hash( fc::to_string( i ) ) );
+
+   vector<digest_type> expected;
+   for( size_t i = 0; i + 1 < level.size(); i += 2 )
+      expected.push_back( hash_packed<digest_type>( level[i], level[i+1] ) );
+
+   hash_digest_pairs( level.data(), expected.size(), level.data() );
+   for( size_t i = 0; i < expected.size(); ++i )
+      BOOST_CHECK( level[i] == expected[i] );
+
+   digest_type pair[2] = { expected[0], expected[1] };
+   digest_type out;
+   hash_digest_pairs( pair, 1, &out );
+   BOOST_CHECK( out == hash_packed<digest_type>( pair[0], pair[1] ) );
+   BOOST_CHECK( out == digest_type::hash( pair[0].data(), sizeof( pair ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( sealed_transaction_digests )
+{
+   const chain_id_type& chain_id = db.get_chain_id();
+   fc::ecc::private_key key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "key" ) ) );
+
+   signed_transaction trx;
+   trx.set_expiration( fc::time_point_sec( 1000 ) );
+   transfer_operation op;
+   op.amount = asset(1);
+   trx.operations.push_back( op );
+   trx.sign( key, chain_id );
+
+   const auto id = trx.id();
+   const auto digest = trx.digest();
+   const auto sig_digest = trx.sig_digest( chain_id );
+   trx.seal( chain_id );
+   BOOST_CHECK( trx.is_sealed() );
+   BOOST_CHECK( trx.id() == id );
+   BOOST_CHECK( trx.digest() == digest );
+   BOOST_CHECK( trx.sig_digest( chain_id ) == sig_digest );
+   BOOST_CHECK( trx.sig_digest( chain_id_type() ) != sig_digest );
+
+   // copies keep the stored digests, except for the merkle digest of a processed_transaction
+   processed_transaction ptrx( trx );
+   BOOST_CHECK( ptrx.is_sealed() );
+   BOOST_CHECK( ptrx.id() == id );
+   ptrx.operation_results.push_back( void_result() );
+   const auto merkle = ptrx.merkle_digest();
+   ptrx.seal( chain_id );
+   BOOST_CHECK( ptrx.merkle_digest() == merkle );
+
+   // changing the transaction through its helpers drops them
+   trx.set_expiration( fc::time_point_sec( 2000 ) );
+   BOOST_CHECK( !trx.is_sealed() );
+   BOOST_CHECK( trx.id() != id );
+   ptrx.sign( key, chain_id_type() );
+   BOOST_CHECK( !ptrx.is_sealed() );
+   BOOST_CHECK( ptrx.merkle_digest() != merkle );
+}
+
+BOOST_AUTO_TEST_CASE( key_cache )
+{
+   auto check = [&]() {
+      for( uint32_t i = 0; i < 3; ++i )
+      {
+         fc::ecc::public_key pub = fc::ecc::private_key::regenerate( fc::sha256::hash( fc::to_string(i) ) ).get_public_key();
+         public_key_type key( pub );
+         for( uint32_t pass = 0; pass < 2; ++pass )
+         {
+            auto addrs = key_addresses( key );
+            BOOST_CHECK( addrs[0] == address( pts_address( pub, false, 56 ) ) );
+            BOOST_CHECK( addrs[1] == address( pts_address( pub, true, 56 ) ) );
+            BOOST_CHECK( addrs[2] == address( pts_address( pub, false, 0 ) ) );
+            BOOST_CHECK( addrs[3] == address( pts_address( pub, true, 0 ) ) );
+            BOOST_CHECK( addrs[4] == address( key ) );
+
+            std::string str( key );
+            BOOST_CHECK( public_key_type( str ) == key );
+            BOOST_CHECK( std::string( public_key_type( str ) ) == str );
+         }
+      }
+      // a string that failed to decode must fail again, not find anything in the cache
+      std::string bad( public_key_type( fc::ecc::private_key::regenerate( fc::sha256::hash( "bad" ) ).get_public_key() ) );
+      bad.back() = ( bad.back() == '1' ? '2' : '1' );
+      GRAPHENE_REQUIRE_THROW( public_key_type bad_key( bad ), fc::exception );
+      GRAPHENE_REQUIRE_THROW( public_key_type bad_key( bad ), fc::exception );
+   };
+   check();
+   set_key_cache_size( 1 );
+   check();
+   set_key_cache_size( 0 );
+   check();
+   set_key_cache_size( 10000 );
+}
+
+BOOST_AUTO_TEST_CASE( transaction_lanes )
+{
+   auto transfer = []( uint64_t from, uint64_t to, uint64_t asset_instance ) {
+      processed_transaction trx;
+      transfer_operation op;
+      op.from = account_id_type( from );
+      op.to = account_id_type( to );
+      op.amount = asset( 1, asset_id_type( asset_instance ) );
+      trx.operations.push_back( op );
+      return trx;
+   };
+
+   vector<processed_transaction> trxs;
+   trxs.push_back( transfer( 10, 11, 0 ) );
+   trxs.push_back( transfer( 12, 13, 0 ) ); // only reads the core asset, like the first one
+   trxs.push_back( transfer( 11, 14, 1 ) ); // shares an account with the first one
+   trxs.push_back( transfer( 15, 16, 1 ) );
+   BOOST_CHECK( get_transaction_lanes( trxs ) == vector<uint32_t>( { 0, 1, 0, 2 } ) );
+
+   // issuing asset 1 changes it, so it conflicts with the transfers of asset 1
+   processed_transaction issue;
+   asset_issue_operation iop;
+   iop.issuer = account_id_type( 17 );
+   iop.asset_to_issue = asset( 1, asset_id_type( 1 ) );
+   iop.issue_to_account = account_id_type( 18 );
+   issue.operations.push_back( iop );
+   trxs.push_back( issue );
+   BOOST_CHECK( get_transaction_lanes( trxs ) == vector<uint32_t>( { 0, 1, 0, 0, 0 } ) );
+
+   // what executing a proposal changes isn't known from its fields
+   processed_transaction update;
+   update.operations.push_back( proposal_update_operation() );
+   trxs.push_back( update );
+   BOOST_CHECK( get_transaction_lanes( trxs ) == vector<uint32_t>( trxs.size(), 0 ) );
+}
+
+BOOST_AUTO_TEST_CASE( api_call_stats )
+{
+   graphene::app::api_call_stats stats;
+   const char* api = "database_api";
+   const char* method = "get_objects";
+
+   // 98 fast calls, one slow one and one failing slow one
+   for( int i = 0; i < 98; ++i )
+      stats.record( api, method, 100, false, 10 );
+   stats.record( api, method, 5000, false, 10 );
+   stats.record( api, method, 3000, true, 0 );
+
+   auto result = stats.get();
+   BOOST_REQUIRE_EQUAL( result.size(), 1u );
+   BOOST_CHECK_EQUAL( result[0].api, "database_api" );
+   BOOST_CHECK_EQUAL( result[0].method, "get_objects" );
+   BOOST_CHECK_EQUAL( result[0].calls, 100u );
+   BOOST_CHECK_EQUAL( result[0].errors, 1u );
+   BOOST_CHECK_EQUAL( result[0].total_us, 98u * 100 + 5000 + 3000 );
+   BOOST_CHECK_EQUAL( result[0].max_us, 5000u );
+   BOOST_CHECK_EQUAL( result[0].response_bytes, 990u );
+   BOOST_CHECK_EQUAL( result[0].p50_us, 128u );
+   BOOST_CHECK_EQUAL( result[0].p99_us, 4096u );
+
+   stats.reset();
+   BOOST_CHECK( stats.get().empty() );
+}
+
+BOOST_AUTO_TEST_CASE( api_rate_limits )
+{
+   using graphene::app::api_rate_limits;
+   using graphene::app::token_bucket;
+
+   const auto cost = api_rate_limits::parse_method_cost( "get_account_history=10" );
+   BOOST_CHECK_EQUAL( cost.first, "get_account_history" );
+   BOOST_CHECK_EQUAL( cost.second, 10u );
+   GRAPHENE_CHECK_THROW( api_rate_limits::parse_method_cost( "get_account_history" ), fc::exception );
+   GRAPHENE_CHECK_THROW( api_rate_limits::parse_method_cost( "get_account_history=ten" ), fc::exception );
+
+   api_rate_limits::limits l;
+   l.connection_rate = 10;
+   l.connection_burst = 20;
+   l.address_rate = 15;
+   l.address_burst = 30;
+   l.method_costs.insert( cost );
+   api_rate_limits limits( l );
+   BOOST_CHECK( limits.enabled() );
+   BOOST_CHECK_EQUAL( limits.cost_of( "get_account_history" ), 10u );
+   BOOST_CHECK_EQUAL( limits.cost_of( "get_objects" ), 1u );
+
+   const fc::time_point start = fc::time_point::now();
+   token_bucket first = limits.connection_bucket();
+   token_bucket second = limits.connection_bucket();
+   // the burst of one connection
+   BOOST_CHECK( limits.take( first, "10.0.0.1", 10, start ) );
+   BOOST_CHECK( limits.take( first, "10.0.0.1", 10, start ) );
+   BOOST_CHECK( !limits.take( first, "10.0.0.1", 1, start ) );
+   // the other connection from the address only finds what is left of the address' burst
+   BOOST_CHECK( limits.take( second, "10.0.0.1", 10, start ) );
+   BOOST_CHECK( !limits.take( second, "10.0.0.1", 1, start ) );
+   // a rejected call costs nothing, of the connection or the address
+   BOOST_CHECK( limits.take( second, "10.0.0.2", 10, start ) );
+
+   // a second refills the connection by 10, the address by 15
+   const fc::time_point later = start + fc::seconds( 1 );
+   BOOST_CHECK( limits.take( first, "10.0.0.1", 10, later ) );
+   BOOST_CHECK( !limits.take( second, "10.0.0.1", 10, later ) );
+   BOOST_CHECK( limits.take( second, "10.0.0.1", 5, later ) );
+
+   // without limits everything passes
+   api_rate_limits none( api_rate_limits::limits{} );
+   BOOST_CHECK( !none.enabled() );
+   token_bucket unlimited = none.connection_bucket();
+   for( int i = 0; i < 100; ++i )
+      BOOST_CHECK( none.take( unlimited, "10.0.0.1", 1000, start ) );
+}
+
+BOOST_AUTO_TEST_CASE( block_tracer )
+{
+   fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+   const fc::path trace_file = dir.path() / "trace.json";
+   graphene::app::block_tracer tracer( 2, trace_file );
+
+   auto trace_block = [&]( uint32_t num ) {
+      const block_id_type id = fc::ripemd160::hash( fc::to_string( num ) );
+      tracer.start( num, id, false );
+      BOOST_CHECK( tracer.tracing() );
+      tracer.add_plugin_time( "account_history", 10 );
+      tracer.add_plugin_time( "market_history", 20 );
+      tracer.add_plugin_time( "account_history", 5 );
+      block_apply_profile apply;
+      apply.block_num = num;
+      tracer.finish( apply );
+      BOOST_CHECK( !tracer.tracing() );
+      return id;
+   };
+   trace_block( 1 );
+   const block_id_type id2 = trace_block( 2 );
+   const block_id_type id3 = trace_block( 3 );
+
+   // handlers run outside of a trace are not counted
+   tracer.add_plugin_time( "account_history", 1000 );
+   fc::time_point now = fc::time_point::now();
+   tracer.note_broadcast( id2, now - fc::milliseconds(5), now, now + fc::microseconds(300) );
+
+   auto traces = tracer.get( 10 );
+   BOOST_REQUIRE_EQUAL( traces.size(), 2u );
+   BOOST_CHECK( traces[0].block_id == id3 );
+   BOOST_CHECK( traces[1].block_id == id2 );
+   BOOST_REQUIRE_EQUAL( traces[0].plugin_times.size(), 2u );
+   BOOST_CHECK_EQUAL( traces[0].plugin_times[0].plugin, "account_history" );
+   BOOST_CHECK_EQUAL( traces[0].plugin_times[0].time, 15u );
+   BOOST_CHECK( traces[0].apply.valid() );
+   BOOST_CHECK_EQUAL( traces[1].broadcast_time, 300u );
+   BOOST_CHECK( traces[1].received == now - fc::milliseconds(5) );
+   BOOST_CHECK_EQUAL( tracer.get( 1 ).size(), 1u );
+
+   // the profile of another block is not taken for this one's
+   tracer.start( 4, block_id_type(), true );
+   block_apply_profile other;
+   other.block_num = 3;
+   tracer.finish( other );
+   BOOST_CHECK( !tracer.get( 1 )[0].apply.valid() );
+
+   std::string contents;
+   fc::read_file_contents( trace_file, contents );
+   BOOST_CHECK_EQUAL( contents.substr( 0, 2 ), "[\n" );
+   BOOST_CHECK( contents.find( "\"name\":\"market_history\"" ) != std::string::npos );
+   BOOST_CHECK( contents.find( "\"name\":\"broadcast\"" ) != std::string::npos );
+}
+
+
+BOOST_AUTO_TEST_CASE( peer_database_reopen )
+{
+   try
+   {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      fc::path db_file = data_dir.path() / "peers.dat";
+      fc::ip::endpoint first( fc::ip::address( "10.0.0.1" ), 1776 );
+      fc::ip::endpoint second( fc::ip::address( "10.0.0.2" ), 1776 );
+      {
+         graphene::net::peer_database db;
+         db.open( db_file );
+         for( uint32_t i = 0; i < 3000; ++i )
+         {
+            graphene::net::potential_peer_record record( i % 2 ? first : second, fc::time_point_sec( 1000 + i ) );
+            record.number_of_successful_connection_attempts = i;
+            db.update_entry( record );
+         }
+         db.erase( second );
+         db.close();
+      }
+
+      // appended entries and the compactions between them leave only the latest state
+      graphene::net::peer_database db;
+      db.open( db_file );
+      BOOST_REQUIRE_EQUAL( db.size(), 1u );
+      BOOST_CHECK( !db.lookup_entry_for_endpoint( second ) );
+      fc::optional<graphene::net::potential_peer_record> record = db.lookup_entry_for_endpoint( first );
+      BOOST_REQUIRE( record );
+      BOOST_CHECK_EQUAL( record->number_of_successful_connection_attempts, 2999u );
+      BOOST_CHECK( record->last_seen_time == fc::time_point_sec( 3999 ) );
+      db.close();
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( peer_transaction_validation_budget )
+{
+   try
+   {
+      // a peer starts with the whole burst, and accepted transactions spend it at the time they took
+      graphene::net::peer_connection_ptr peer = graphene::net::peer_connection::make_shared( nullptr );
+      BOOST_CHECK( peer->has_transaction_validation_budget() );
+      BOOST_CHECK( !peer->charge_transaction_validation( fc::microseconds( GRAPHENE_NET_TRX_VALIDATION_BURST_US / 2 ), false ) );
+      BOOST_CHECK( peer->has_transaction_validation_budget() );
+      // a second more than the rest, so what refills while the test runs doesn't matter
+      BOOST_CHECK( !peer->charge_transaction_validation( fc::microseconds( GRAPHENE_NET_TRX_VALIDATION_BURST_US / 2
+                                                                           + GRAPHENE_NET_TRX_VALIDATION_BUDGET_PER_SECOND_US ),
+                                                         false ) );
+      BOOST_CHECK( !peer->has_transaction_validation_budget() );
+      BOOST_CHECK( peer->is_transaction_fetching_inhibited() );
+
+      // a rejected transaction costs the penalty times its time, one we already had costs only its time
+      graphene::net::peer_connection_ptr rejecting = graphene::net::peer_connection::make_shared( nullptr );
+      const fc::microseconds tenth( GRAPHENE_NET_TRX_VALIDATION_BURST_US / GRAPHENE_NET_REJECTED_TRX_PENALTY );
+      rejecting->charge_transaction_validation_time( tenth );
+      BOOST_CHECK( rejecting->has_transaction_validation_budget() );
+      BOOST_CHECK_EQUAL( rejecting->transactions_rejected_in_window, 0u );
+      BOOST_CHECK_EQUAL( rejecting->transactions_accepted_in_window, 0u );
+      BOOST_CHECK( !rejecting->charge_transaction_validation( tenth, true ) );
+      BOOST_CHECK( !rejecting->has_transaction_validation_budget() );
+
+      // a peer is disconnected once more than the minimum of its transactions were rejected, and most of them
+      graphene::net::peer_connection_ptr spamming = graphene::net::peer_connection::make_shared( nullptr );
+      for( uint32_t i = 0; i < GRAPHENE_NET_MIN_REJECTED_TRX_TO_DISCONNECT; ++i )
+         BOOST_CHECK( !spamming->charge_transaction_validation( fc::microseconds( 1 ), true ) );
+      BOOST_CHECK( spamming->charge_transaction_validation( fc::microseconds( 1 ), true ) );
+
+      graphene::net::peer_connection_ptr mostly_good = graphene::net::peer_connection::make_shared( nullptr );
+      for( uint32_t i = 0; i < 2 * GRAPHENE_NET_MIN_REJECTED_TRX_TO_DISCONNECT; ++i )
+         mostly_good->charge_transaction_validation( fc::microseconds( 1 ), false );
+      for( uint32_t i = 0; i <= GRAPHENE_NET_MIN_REJECTED_TRX_TO_DISCONNECT; ++i )
+         BOOST_CHECK( !mostly_good->charge_transaction_validation( fc::microseconds( 1 ), true ) );
+   } FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -23,6 +23,7 @@
  */
 
 #include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
 
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/exceptions.hpp>
@@ -32,11 +33,26 @@
 #include <graphene/chain/committee_member_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
 #include <graphene/chain/market_object.hpp>
+#include <graphene/chain/operation_history_object.hpp>
+#include <graphene/chain/vote_tally_object.hpp>
+#include <graphene/chain/witness_object.hpp>
+#include <graphene/chain/worker_object.hpp>
+
+#include <graphene/account_history/account_history_store.hpp>
+#include <graphene/app/confirmation_registry.hpp>
+#include <graphene/app/light_client.hpp>
+#include <graphene/app/shared_state.hpp>
+#include <graphene/app/state_replica.hpp>
+
+#include <graphene/net/core_messages.hpp>
+#include <graphene/net/message.hpp>
 
 #include <graphene/utilities/tempdir.hpp>
 
 #include <fc/crypto/digest.hpp>
 
+#include <tuple>
+
 #include "../common/database_fixture.hpp"
 
 using namespace graphene::chain;
@@ -125,6 +141,327 @@ BOOST_AUTO_TEST_CASE( block_database_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( block_database_segments )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.set_segment_format( 4, block_database::zlib_compression );
+      bdb.open( data_dir.path() );
+
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         if( i == 6 )
+         {
+            // later segments may use a different format
+            bdb.set_segment_format( 3, block_database::no_compression );
+         }
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         blocks.push_back( b );
+      }
+      BOOST_CHECK( fc::exists( data_dir.path() / "segment-0000000000.blocks" ) );
+      BOOST_CHECK( fc::exists( data_dir.path() / "segment-0000000004.blocks" ) );
+      BOOST_CHECK( fc::exists( data_dir.path() / "segment-0000000008.blocks" ) );
+
+      bdb.remove( blocks.back().id() );
+      BOOST_CHECK( !bdb.contains( blocks.back().id() ) );
+      BOOST_REQUIRE( bdb.last_id().valid() );
+      BOOST_CHECK( *bdb.last_id() == blocks[8].id() );
+
+      bdb.close();
+      bdb.open( data_dir.path() );
+      for( uint32_t i = 0; i < 9; ++i )
+      {
+         auto blk = bdb.fetch_by_number( i+1 );
+         BOOST_REQUIRE( blk.valid() );
+         BOOST_CHECK( blk->id() == blocks[i].id() );
+         BOOST_CHECK( bdb.fetch_block_id( i+1 ) == blocks[i].id() );
+         BOOST_CHECK( bdb.fetch_optional( blocks[i].id() ).valid() );
+      }
+      BOOST_CHECK( !bdb.fetch_by_number( 10 ).valid() );
+      BOOST_CHECK( !bdb.fetch_by_number( 1000 ).valid() );
+      BOOST_REQUIRE( bdb.last().valid() );
+      BOOST_CHECK( bdb.last()->id() == blocks[8].id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_packed_reads )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.set_cache_size( 2 );
+      bdb.open( data_dir.path() );
+
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < 6; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         blocks.push_back( b );
+      }
+
+      // the first blocks have been evicted from the cache and are read through the mapping
+      for( const signed_block& blk : blocks )
+      {
+         auto packed = bdb.fetch_packed( blk.id() );
+         BOOST_REQUIRE( packed );
+         BOOST_CHECK( *packed == fc::raw::pack( blk ) );
+      }
+      BOOST_CHECK( !bdb.fetch_packed( block_id_type() ) );
+
+      bdb.set_cache_size( 0 );
+      bdb.remove( blocks.back().id() );
+      BOOST_CHECK( !bdb.fetch_packed( blocks.back().id() ) );
+      BOOST_REQUIRE( bdb.fetch_by_number( 5 ).valid() );
+      BOOST_CHECK( bdb.fetch_by_number( 5 )->id() == blocks[4].id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_write_behind )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      fc::path blocks_file = data_dir.path() / "segment-0000000000.blocks";
+
+      block_database bdb;
+      block_database::flush_policy policy;
+      policy.max_pending_blocks = 3;
+      bdb.set_flush_policy( policy );
+      bdb.set_cache_size( 0 );
+      bdb.open( data_dir.path() );
+
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < 5; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         blocks.push_back( b );
+      }
+
+      // the first three blocks were written as one group, the last two are still buffered but readable
+      uint64_t written = fc::file_size( blocks_file );
+      BOOST_CHECK( written > 0 );
+      for( const signed_block& blk : blocks )
+      {
+         auto packed = bdb.fetch_packed( blk.id() );
+         BOOST_REQUIRE( packed );
+         BOOST_CHECK( *packed == fc::raw::pack( blk ) );
+      }
+      BOOST_CHECK_EQUAL( fc::file_size( blocks_file ), written );
+
+      bdb.flush();
+      BOOST_CHECK( fc::file_size( blocks_file ) > written );
+
+      // a removed block is gone from the files right away, without waiting for the next flush
+      bdb.remove( blocks.back().id() );
+      {
+         block_database other;
+         other.open( data_dir.path() );
+         BOOST_REQUIRE( other.last_id().valid() );
+         BOOST_CHECK( *other.last_id() == blocks[3].id() );
+         other.close();
+      }
+      bdb.store( blocks.back().id(), blocks.back() );
+
+      // buffered blocks are written on close
+      b.previous = b.id();
+      b.witness = witness_id_type(6);
+      bdb.store( b.id(), b );
+      bdb.close();
+      bdb.open( data_dir.path() );
+      BOOST_REQUIRE( bdb.last_id().valid() );
+      BOOST_CHECK( *bdb.last_id() == b.id() );
+      BOOST_REQUIRE( bdb.fetch_by_number( 3 ).valid() );
+      BOOST_CHECK( bdb.fetch_by_number( 3 )->id() == blocks[2].id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_prune )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.set_segment_format( 3, block_database::no_compression );
+      bdb.open( data_dir.path() );
+
+      signed_block b;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+      }
+      BOOST_CHECK_EQUAL( bdb.first_retained_block_num(), 0u );
+
+      // segments 0-2 and 3-5 only hold blocks below 7
+      BOOST_CHECK_EQUAL( bdb.prune_below( 7 ), 2u );
+      BOOST_CHECK_EQUAL( bdb.first_retained_block_num(), 6u );
+      BOOST_CHECK( !bdb.fetch_by_number( 5 ).valid() );
+      BOOST_CHECK( bdb.fetch_by_number( 6 ).valid() );
+      BOOST_CHECK( !fc::exists( data_dir.path() / "segment-0000000003.blocks" ) );
+
+      // the segment holding the head is kept
+      BOOST_CHECK_EQUAL( bdb.prune_below( 1000 ), 1u );
+      BOOST_CHECK_EQUAL( bdb.first_retained_block_num(), 9u );
+      BOOST_REQUIRE( bdb.last().valid() );
+      BOOST_CHECK( bdb.last()->id() == b.id() );
+
+      bdb.close();
+      bdb.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( bdb.first_retained_block_num(), 9u );
+      BOOST_CHECK( bdb.fetch_by_number( 10 ).valid() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( account_history_store_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      using graphene::account_history::account_history_store;
+
+      const account_id_type alice( 10 ), bob( 11 );
+      account_history_store store;
+      store.open( data_dir.path() );
+
+      // operation i is in block i/2+1, alice is in all of them and bob in the odd ones
+      for( uint64_t i = 1; i <= 10; ++i )
+      {
+         operation_history_object op;
+         op.id = operation_history_id_type( i );
+         op.block_num = i / 2 + 1;
+         flat_set<account_id_type> accounts{ alice };
+         if( i % 2 )
+            accounts.insert( bob );
+         store.append( op, accounts );
+      }
+      BOOST_CHECK_EQUAL( store.next_operation_id(), 11u );
+      BOOST_CHECK_EQUAL( store.last_block_num(), 6u );
+      BOOST_CHECK_EQUAL( store.count( alice ), 10u );
+      BOOST_CHECK_EQUAL( store.count( bob ), 5u );
+
+      auto hist = store.get_history( bob, 3, 9, 100 );
+      BOOST_REQUIRE_EQUAL( hist.size(), 3u );
+      BOOST_CHECK( hist[0].id == operation_history_id_type( 9 ) );
+      BOOST_CHECK( hist[2].id == operation_history_id_type( 5 ) );
+
+      hist = store.get_relative_history( alice, 0, 100, 2 );
+      BOOST_REQUIRE_EQUAL( hist.size(), 2u );
+      BOOST_CHECK( hist[0].id == operation_history_id_type( 10 ) );
+      BOOST_CHECK( hist[1].id == operation_history_id_type( 9 ) );
+
+      // the index is rebuilt on open
+      store.close();
+      store.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( store.count( bob ), 5u );
+
+      // blocks 4 and later hold operations 6 to 10
+      store.truncate_from( 4 );
+      BOOST_CHECK_EQUAL( store.next_operation_id(), 6u );
+      BOOST_CHECK_EQUAL( store.last_block_num(), 3u );
+      BOOST_CHECK_EQUAL( store.count( alice ), 5u );
+      BOOST_CHECK_EQUAL( store.count( bob ), 3u );
+
+      operation_history_object op;
+      op.id = operation_history_id_type( 6 );
+      op.block_num = 4;
+      store.append( op, { bob } );
+      store.close();
+      store.open( data_dir.path() );
+      hist = store.get_relative_history( bob, 0, 0xffffffff, 100 );
+      BOOST_REQUIRE_EQUAL( hist.size(), 4u );
+      BOOST_CHECK( hist[0].id == operation_history_id_type( 6 ) );
+      BOOST_CHECK( hist[3].id == operation_history_id_type( 1 ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( fork_database_branches )
+{
+   try {
+      fork_database fdb;
+      vector<signed_block> main_chain;
+      signed_block b;
+      b.witness = witness_id_type(1);
+      fdb.start_block( b );
+      main_chain.push_back( b );
+      for( uint32_t i = 1; i < 20; ++i )
+      {
+         b.previous = b.id();
+         b.witness = witness_id_type(1);
+         BOOST_CHECK( fdb.push_block( b )->id == b.id() );
+         main_chain.push_back( b );
+      }
+
+      // a short fork off block 10
+      vector<signed_block> fork;
+      signed_block f = main_chain[9];
+      for( uint32_t i = 0; i < 2; ++i )
+      {
+         f.previous = f.id();
+         f.witness = witness_id_type(2);
+         BOOST_CHECK( fdb.push_block( f )->id == b.id() );
+         fork.push_back( f );
+      }
+      BOOST_CHECK_EQUAL( fdb.fetch_block_by_number( 11 ).size(), 2u );
+
+      auto branches = fdb.fetch_branch_from( b.id(), f.id() );
+      BOOST_CHECK_EQUAL( branches.first.size(), 10u );
+      BOOST_CHECK_EQUAL( branches.second.size(), 2u );
+      BOOST_CHECK( branches.first.back()->previous_id() == main_chain[9].id() );
+      BOOST_CHECK( branches.second.back()->previous_id() == main_chain[9].id() );
+
+      fdb.pop_block();
+      BOOST_CHECK( fdb.head()->id == main_chain[18].id() );
+      fdb.set_head( fdb.fetch_block( b.id() ) );
+
+      // removing the head leaves it on the previous block
+      fdb.remove( b.id() );
+      BOOST_CHECK( !fdb.is_known_block( b.id() ) );
+      BOOST_CHECK( fdb.head()->id == main_chain[18].id() );
+      BOOST_CHECK( fdb.push_block( b )->id == b.id() );
+
+      // shrinking the window drops the fork and the old blocks, and their slots are reused
+      fdb.set_max_size( 5 );
+      BOOST_CHECK( !fdb.is_known_block( fork.back().id() ) );
+      BOOST_CHECK( !fdb.is_known_block( main_chain[13].id() ) );
+      BOOST_CHECK( fdb.is_known_block( main_chain[15].id() ) );
+      b.previous = b.id();
+      BOOST_CHECK( fdb.push_block( b )->id == b.id() );
+      BOOST_CHECK( !fdb.is_known_block( main_chain[14].id() ) );
+      BOOST_CHECK( fdb.is_known_block( main_chain[15].id() ) );
+      BOOST_CHECK_EQUAL( fdb.fetch_branch_from( b.id(), main_chain[17].id() ).first.size(), 4u );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( generate_empty_blocks )
 {
    try {
@@ -180,47 +517,38 @@ BOOST_AUTO_TEST_CASE( generate_empty_blocks )
    }
 }
 
-BOOST_AUTO_TEST_CASE( undo_block )
+BOOST_AUTO_TEST_CASE( replay_from_snapshot )
 {
    try {
       fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory snapshot_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      uint32_t      head_num = 0;
       {
          database db;
-         db.open(data_dir.path(), make_genesis);
-         fc::time_point_sec now( GRAPHENE_TESTING_GENESIS_TIMESTAMP );
-         std::vector< time_point_sec > time_stack;
-
-         auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
-         for( uint32_t i = 0; i < 5; ++i )
-         {
-            now = db.get_slot_time(1);
-            time_stack.push_back( now );
-            auto b = db.generate_block( now, db.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
-         }
-         BOOST_CHECK( db.head_block_num() == 5 );
-         BOOST_CHECK( db.head_block_time() == now );
-         db.pop_block();
-         time_stack.pop_back();
-         now = time_stack.back();
-         BOOST_CHECK( db.head_block_num() == 4 );
-         BOOST_CHECK( db.head_block_time() == now );
-         db.pop_block();
-         time_stack.pop_back();
-         now = time_stack.back();
-         BOOST_CHECK( db.head_block_num() == 3 );
-         BOOST_CHECK( db.head_block_time() == now );
-         db.pop_block();
-         time_stack.pop_back();
-         now = time_stack.back();
-         BOOST_CHECK( db.head_block_num() == 2 );
-         BOOST_CHECK( db.head_block_time() == now );
-         for( uint32_t i = 0; i < 5; ++i )
-         {
-            now = db.get_slot_time(1);
-            time_stack.push_back( now );
-            auto b = db.generate_block( now, db.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
-         }
-         BOOST_CHECK( db.head_block_num() == 7 );
+         db.set_snapshot_at_block( 10, snapshot_dir.path() );
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 60; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         BOOST_REQUIRE( fc::exists( snapshot_dir.path() / "snapshot.json" ) );
+         db.close();
+      }
+      {
+         database db;
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         head_id  = db.head_block_id();
+         head_num = db.head_block_num();
+         BOOST_REQUIRE_GT( head_num, 10u );
+         db.close();
+      }
+      {
+         database db;
+         db.reindex_from_snapshot( data_dir.path(), snapshot_dir.path() );
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num + 1 );
       }
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
@@ -228,71 +556,891 @@ BOOST_AUTO_TEST_CASE( undo_block )
    }
 }
 
-BOOST_AUTO_TEST_CASE( fork_blocks )
+BOOST_AUTO_TEST_CASE( replay_from_state_checkpoint )
 {
    try {
-      fc::temp_directory data_dir1( graphene::utilities::temp_directory_path() );
-      fc::temp_directory data_dir2( graphene::utilities::temp_directory_path() );
-
-      database db1;
-      db1.open(data_dir1.path(), make_genesis);
-      database db2;
-      db2.open(data_dir2.path(), make_genesis);
-      BOOST_CHECK( db1.get_chain_id() == db2.get_chain_id() );
-
-      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
-      for( uint32_t i = 0; i < 10; ++i )
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory checkpoint_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      uint32_t      head_num = 0;
+      uint32_t      checkpoint_num = 0;
       {
-         auto b = db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
-         try {
-            PUSH_BLOCK( db2, b );
-         } FC_CAPTURE_AND_RETHROW( ("db2") );
+         database db;
+         db.set_state_checkpoints( 10, checkpoint_dir.path() );
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 60; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+
+         fc::optional<fc::path> checkpoint = database::find_state_checkpoint( checkpoint_dir.path() );
+         BOOST_REQUIRE( checkpoint.valid() );
+         checkpoint_num = std::stoul( checkpoint->filename().string() );
+         BOOST_CHECK_EQUAL( checkpoint_num % 10, 0u );
+         BOOST_CHECK_LE( checkpoint_num, db.get_dynamic_global_properties().last_irreversible_block_num );
+         // the older checkpoints are gone once a newer one is complete
+         uint32_t complete = 0;
+         for( fc::directory_iterator itr( checkpoint_dir.path() ); itr != fc::directory_iterator(); ++itr )
+            if( fc::exists( fc::path(*itr) / "snapshot.json" ) )
+               ++complete;
+         BOOST_CHECK_EQUAL( complete, 1u );
+         db.close();
       }
-      for( uint32_t i = 10; i < 13; ++i )
       {
-         auto b =  db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         database db;
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         head_id  = db.head_block_id();
+         head_num = db.head_block_num();
+         BOOST_REQUIRE_GE( head_num, checkpoint_num );
+         db.close();
       }
-      string db1_tip = db1.head_block_id().str();
-      uint32_t next_slot = 3;
-      for( uint32_t i = 13; i < 16; ++i )
       {
-         auto b =  db2.generate_block(db2.get_slot_time(next_slot), db2.get_scheduled_witness(next_slot), init_account_priv_key, database::skip_nothing);
-         next_slot = 1;
-         // notify both databases of the new block.
-         // only db2 should switch to the new fork, db1 should not
-         PUSH_BLOCK( db1, b );
-         BOOST_CHECK_EQUAL(db1.head_block_id().str(), db1_tip);
-         BOOST_CHECK_EQUAL(db2.head_block_id().str(), b.id().str());
+         database db;
+         db.reindex_from_snapshot( data_dir.path(), *database::find_state_checkpoint( checkpoint_dir.path() ) );
+         BOOST_CHECK_EQUAL( db.get_replay_statistics().first_block, checkpoint_num + 1 );
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num + 1 );
       }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
 
-      //The two databases are on distinct forks now, but at the same height. Make a block on db2, make it invalid, then
-      //pass it to db1 and assert that db1 doesn't switch to the new fork.
-      signed_block good_block;
-      BOOST_CHECK_EQUAL(db1.head_block_num(), 13);
-      BOOST_CHECK_EQUAL(db2.head_block_num(), 13);
+BOOST_AUTO_TEST_CASE( replay_from_flushed_state )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      uint32_t head_num = 0;
       {
-         auto b = db2.generate_block(db2.get_slot_time(1), db2.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
-         good_block = b;
-         b.transactions.emplace_back(signed_transaction());
-         b.transactions.back().operations.emplace_back(transfer_operation());
-         b.sign( init_account_priv_key );
-         BOOST_CHECK_EQUAL(b.block_num(), 14);
-         GRAPHENE_CHECK_THROW(PUSH_BLOCK( db1, b ), fc::exception);
+         database db;
+         db.set_flush_interval( 10 );
+         db.open(data_dir.path(), make_genesis );
+         bool flushed = false;
+         for( uint32_t i = 0; i < 60; ++i )
+         {
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+            // the flushed state stays complete while the next flush is written
+            if( flushed )
+               BOOST_CHECK( database::has_flushed_state( data_dir.path() ) );
+            flushed = database::has_flushed_state( data_dir.path() );
+         }
+         head_num = db.head_block_num();
+         BOOST_REQUIRE( flushed );
+         // no close(), as if the node crashed
       }
-      BOOST_CHECK_EQUAL(db1.head_block_num(), 13);
-      BOOST_CHECK_EQUAL(db1.head_block_id().str(), db1_tip);
+      {
+         database db;
+         db.reindex_from_flushed_state( data_dir.path() );
+         const replay_statistics& stats = db.get_replay_statistics();
+         BOOST_CHECK_GT( stats.first_block, 10u );
+         BOOST_CHECK_EQUAL( (stats.first_block - 1) % 10, 0u );
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num );
+         db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num + 1 );
+         db.close();
+         BOOST_CHECK( !database::has_flushed_state( data_dir.path() ) );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( deferred_index_loading )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      typedef graphene::db::primary_index< graphene::db::simple_index< operation_history_object > > history_index;
+      {
+         database db;
+         db.add_index< history_index >();
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 3; ++i )
+            db.create<operation_history_object>( [i]( operation_history_object& o ) { o.block_num = i + 1; } );
+         db.close();
+      }
+      {
+         database db;
+         db.defer_opening_new_indexes( true );
+         db.add_index< history_index >();
+         db.defer_opening_new_indexes( false );
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         // the chain state is there before the deferred index may be
+         BOOST_CHECK( db.find( global_property_id_type() ) != nullptr );
+         db.wait_for_deferred_indexes();
+         BOOST_CHECK( !db.deferred_indexes_pending() );
+         uint32_t count = 0;
+         db.get_index_type<history_index>().inspect_all_objects( [&count]( const graphene::db::object& ) { ++count; } );
+         BOOST_CHECK_EQUAL( count, 3u );
+         db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         BOOST_CHECK_EQUAL( db.head_block_num(), 1u );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( replay_block_range )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 30; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         db.close();
+      }
+      {
+         database db;
+         db.set_replay_last_block( 20 );
+         db.set_replay_skip_flags( database::skip_nothing );
+         db.reindex( data_dir.path(), make_genesis() );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 20u );
+         const replay_statistics& stats = db.get_replay_statistics();
+         BOOST_CHECK_EQUAL( stats.first_block, 1u );
+         BOOST_CHECK_EQUAL( stats.last_block, 20u );
+         BOOST_CHECK_EQUAL( stats.blocks, 20u );
+         BOOST_CHECK_EQUAL( stats.transactions, 0u );
+         BOOST_CHECK_GT( stats.elapsed_time, 0u );
+         db.close();
+      }
+      {
+         // the state of the stopped replay was not saved, so it isn't taken for the head of the block log
+         database db;
+         db.open( data_dir.path(), make_genesis );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 0u );
+         db.close();
+      }
+      {
+         database db;
+         db.reindex( data_dir.path(), make_genesis() );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 30u );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( incremental_flush )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      uint32_t cutoff_height = 0;
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         cutoff_height = db.get_dynamic_global_properties().last_irreversible_block_num;
+         db.close();
+      }
+      // the second and third sessions start from a valid snapshot, so their flush only appends a delta
+      for( uint32_t session = 0; session < 2; ++session )
+      {
+         database db;
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         BOOST_CHECK_EQUAL( db.head_block_num(), cutoff_height );
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         cutoff_height = db.get_dynamic_global_properties().last_irreversible_block_num;
+         db.close();
+      }
+      {
+         database db;
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         BOOST_CHECK_EQUAL( db.head_block_num(), cutoff_height );
+         BOOST_CHECK( db.fetch_block_by_number( cutoff_height )->id() == db.head_block_id() );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( stale_delta_segment )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      fc::temp_directory saved_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      const fc::path index_dir = data_dir.path() / "object_database";
+      auto generate = [&]( database& db ) {
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         return db.get_dynamic_global_properties().last_irreversible_block_num;
+      };
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis );
+         generate( db );
+         db.close();
+      }
+      // the second session appends delta segments, keep a copy of them
+      {
+         database db;
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         generate( db );
+         db.close();
+      }
+      vector< std::pair<fc::path,fc::path> > deltas;
+      for( boost::filesystem::recursive_directory_iterator itr( index_dir.string() );
+           itr != boost::filesystem::recursive_directory_iterator(); ++itr )
+      {
+         const fc::path file( itr->path() );
+         if( file.extension().generic_string() != ".delta" )
+            continue;
+         const fc::path copy = saved_dir.path() / fc::to_string( deltas.size() );
+         fc::copy( file, copy );
+         deltas.emplace_back( file, copy );
+      }
+      BOOST_REQUIRE( !deltas.empty() );
+
+      // the third session folds everything into new base snapshots, then the old segments reappear
+      // as if a crash had happened between writing the base snapshots and removing the segments
+      uint32_t cutoff_height = 0;
+      {
+         database db;
+         db.open(data_dir.path(), []{return genesis_state_type();});
+         cutoff_height = generate( db );
+         db.discard_flushed();
+         db.close();
+      }
+      for( const auto& d : deltas )
+      {
+         BOOST_CHECK( !fc::exists( d.first ) );
+         fc::copy( d.second, d.first );
+      }
+
+      database db;
+      db.open(data_dir.path(), []{return genesis_state_type();});
+      BOOST_CHECK_EQUAL( db.head_block_num(), cutoff_height );
+      BOOST_CHECK( db.fetch_block_by_number( cutoff_height )->id() == db.head_block_id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_block )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis);
+         fc::time_point_sec now( GRAPHENE_TESTING_GENESIS_TIMESTAMP );
+         std::vector< time_point_sec > time_stack;
+
+         auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+         for( uint32_t i = 0; i < 5; ++i )
+         {
+            now = db.get_slot_time(1);
+            time_stack.push_back( now );
+            auto b = db.generate_block( now, db.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
+         }
+         BOOST_CHECK( db.head_block_num() == 5 );
+         BOOST_CHECK( db.head_block_time() == now );
+         db.pop_block();
+         time_stack.pop_back();
+         now = time_stack.back();
+         BOOST_CHECK( db.head_block_num() == 4 );
+         BOOST_CHECK( db.head_block_time() == now );
+         db.pop_block();
+         time_stack.pop_back();
+         now = time_stack.back();
+         BOOST_CHECK( db.head_block_num() == 3 );
+         BOOST_CHECK( db.head_block_time() == now );
+         db.pop_block();
+         time_stack.pop_back();
+         now = time_stack.back();
+         BOOST_CHECK( db.head_block_num() == 2 );
+         BOOST_CHECK( db.head_block_time() == now );
+         for( uint32_t i = 0; i < 5; ++i )
+         {
+            now = db.get_slot_time(1);
+            time_stack.push_back( now );
+            auto b = db.generate_block( now, db.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
+         }
+         BOOST_CHECK( db.head_block_num() == 7 );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( fork_blocks )
+{
+   try {
+      fc::temp_directory data_dir1( graphene::utilities::temp_directory_path() );
+      fc::temp_directory data_dir2( graphene::utilities::temp_directory_path() );
+
+      database db1;
+      db1.open(data_dir1.path(), make_genesis);
+      database db2;
+      db2.open(data_dir2.path(), make_genesis);
+      BOOST_CHECK( db1.get_chain_id() == db2.get_chain_id() );
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         auto b = db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         try {
+            PUSH_BLOCK( db2, b );
+         } FC_CAPTURE_AND_RETHROW( ("db2") );
+      }
+      for( uint32_t i = 10; i < 13; ++i )
+      {
+         auto b =  db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+      }
+      string db1_tip = db1.head_block_id().str();
+      uint32_t next_slot = 3;
+      for( uint32_t i = 13; i < 16; ++i )
+      {
+         auto b =  db2.generate_block(db2.get_slot_time(next_slot), db2.get_scheduled_witness(next_slot), init_account_priv_key, database::skip_nothing);
+         next_slot = 1;
+         // notify both databases of the new block.
+         // only db2 should switch to the new fork, db1 should not
+         PUSH_BLOCK( db1, b );
+         BOOST_CHECK_EQUAL(db1.head_block_id().str(), db1_tip);
+         BOOST_CHECK_EQUAL(db2.head_block_id().str(), b.id().str());
+      }
+
+      //The two databases are on distinct forks now, but at the same height. Make a block on db2, make it invalid, then
+      //pass it to db1 and assert that db1 doesn't switch to the new fork.
+      signed_block good_block;
+      BOOST_CHECK_EQUAL(db1.head_block_num(), 13);
+      BOOST_CHECK_EQUAL(db2.head_block_num(), 13);
+      {
+         auto b = db2.generate_block(db2.get_slot_time(1), db2.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         good_block = b;
+         b.transactions.emplace_back(signed_transaction());
+         b.transactions.back().operations.emplace_back(transfer_operation());
+         b.sign( init_account_priv_key );
+         BOOST_CHECK_EQUAL(b.block_num(), 14);
+         GRAPHENE_CHECK_THROW(PUSH_BLOCK( db1, b ), fc::exception);
+      }
+      BOOST_CHECK_EQUAL(db1.head_block_num(), 13);
+      BOOST_CHECK_EQUAL(db1.head_block_id().str(), db1_tip);
+      BOOST_CHECK_EQUAL(db1.get_block_id_for_num(13).str(), db1_tip);
+      BOOST_CHECK( db1.fetch_block_by_number(13)->id() == db1.head_block_id() );
+
+      // assert that db1 switches to new fork with good block
+      BOOST_CHECK_EQUAL(db2.head_block_num(), 14);
+      PUSH_BLOCK( db1, good_block );
+      BOOST_CHECK_EQUAL(db1.head_block_id().str(), db2.head_block_id().str());
+      for( uint32_t num = 1; num <= 14; ++num )
+         BOOST_CHECK( db1.get_block_id_for_num(num) == db2.get_block_id_for_num(num) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+
+BOOST_AUTO_TEST_CASE( replay_popped_block_diffs )
+{
+   try {
+      fc::temp_directory data_dir1( graphene::utilities::temp_directory_path() );
+      fc::temp_directory data_dir2( graphene::utilities::temp_directory_path() );
+
+      uint32_t applied = 0;
+      uint32_t restored = 0;
+      std::map< uint32_t, size_t > applied_ops;
+      database db1;
+      db1.open(data_dir1.path(), make_genesis);
+      database db2;
+      db2.open(data_dir2.path(), make_genesis);
+      db2.set_fork_diff_replay( true );
+      db2.applied_block.connect( [&]( const signed_block& b ) {
+         if( db2.is_replaying_block_diff() )
+         {
+            ++restored;
+            // a restored block hands its observers the operations it applied before
+            BOOST_CHECK_EQUAL( db2.get_applied_operations().size(), applied_ops[b.block_num()] );
+         }
+         else
+         {
+            ++applied;
+            applied_ops[b.block_num()] = db2.get_applied_operations().size();
+         }
+      } );
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      vector<signed_block> blocks;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         blocks.push_back( db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing) );
+         PUSH_BLOCK( db2, blocks.back() );
+      }
+      BOOST_CHECK_EQUAL( applied, 10u );
+
+      for( uint32_t i = 0; i < 3; ++i )
+         db2.pop_block();
+      BOOST_CHECK_EQUAL( db2.head_block_num(), 7u );
+
+      // the popped blocks are restored from their changes, without being applied again
+      for( uint32_t i = 7; i < 10; ++i )
+      {
+         PUSH_BLOCK( db2, blocks[i] );
+         BOOST_CHECK( db2.head_block_id() == blocks[i].id() );
+      }
+      BOOST_CHECK_EQUAL( applied, 10u );
+      BOOST_CHECK_EQUAL( restored, 3u );
+      BOOST_CHECK( fc::raw::pack( db2.get_dynamic_global_properties() ) == fc::raw::pack( db1.get_dynamic_global_properties() ) );
+      witness_id_type witness = db1.get_scheduled_witness(1);
+      BOOST_CHECK( fc::raw::pack( witness(db2) ) == fc::raw::pack( witness(db1) ) );
+
+      // and the chain goes on from the restored state
+      auto b = db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+      PUSH_BLOCK( db2, b );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+      BOOST_CHECK_EQUAL( applied, 11u );
+
+      // a replayed block can be popped again, and without its changes it is applied again
+      db2.set_fork_diff_replay( false );
+      db2.pop_block();
+      db2.pop_block();
+      PUSH_BLOCK( db2, blocks[9] );
+      PUSH_BLOCK( db2, b );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+      BOOST_CHECK_EQUAL( applied, 13u );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( prevalidate_fork_blocks )
+{
+   try {
+      fc::temp_directory data_dir1( graphene::utilities::temp_directory_path() );
+      fc::temp_directory data_dir2( graphene::utilities::temp_directory_path() );
+
+      uint32_t applied = 0;
+      database db1;
+      db1.open(data_dir1.path(), make_genesis);
+      database db2;
+      db2.open(data_dir2.path(), make_genesis);
+      db1.set_fork_prevalidation( true );
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         auto b = db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         PUSH_BLOCK( db2, b );
+      }
+      for( uint32_t i = 10; i < 13; ++i )
+         db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+      const block_id_type db1_tip = db1.head_block_id();
+
+      // db1 checks the blocks of db2's fork in the background as they come in
+      uint32_t next_slot = 3;
+      signed_block fork_13;
+      for( uint32_t i = 10; i < 13; ++i )
+      {
+         fork_13 = db2.generate_block(db2.get_slot_time(next_slot), db2.get_scheduled_witness(next_slot), init_account_priv_key, database::skip_nothing);
+         next_slot = 1;
+         PUSH_BLOCK( db1, fork_13 );
+         BOOST_CHECK( db1.head_block_id() == db1_tip );
+      }
+      signed_block bad_13 = fork_13;
+      bad_13.transactions.emplace_back( signed_transaction() );
+      bad_13.transactions.back().operations.emplace_back( transfer_operation() );
+      bad_13.sign( init_account_priv_key );
+      PUSH_BLOCK( db1, bad_13 );
+      BOOST_CHECK( db1.head_block_id() == db1_tip );
+
+      auto good_14 = db2.generate_block(db2.get_slot_time(1), db2.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+      signed_block bad_14 = good_14;
+      bad_14.previous = bad_13.id();
+      bad_14.sign( init_account_priv_key );
+
+      // the branch with the block whose merkle root is wrong is dropped without popping any blocks for it
+      db1.applied_block.connect( [&applied]( const signed_block& ) { ++applied; } );
+      GRAPHENE_CHECK_THROW( PUSH_BLOCK( db1, bad_14 ), fc::exception );
+      BOOST_CHECK( db1.head_block_id() == db1_tip );
+      BOOST_CHECK_EQUAL( applied, 0u );
+      BOOST_CHECK( !db1.is_known_block( bad_14.id() ) );
+
+      PUSH_BLOCK( db1, good_14 );
+      BOOST_CHECK( db1.head_block_id() == db2.head_block_id() );
+      BOOST_CHECK_EQUAL( applied, 4u );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( push_precomputed_blocks )
+{
+   try {
+      fc::temp_directory data_dir1( graphene::utilities::temp_directory_path() );
+      fc::temp_directory data_dir2( graphene::utilities::temp_directory_path() );
+
+      database db1;
+      db1.open(data_dir1.path(), make_genesis);
+      database db2;
+      db2.open(data_dir2.path(), make_genesis);
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      for( uint32_t i = 0; i < 5; ++i )
+      {
+         auto b = db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         precomputed_block pre = database::precompute_block( b );
+         BOOST_CHECK( pre.id == b.id() );
+         BOOST_REQUIRE( pre.signee.valid() );
+         BOOST_CHECK( public_key_type( *pre.signee ) == init_account_priv_key.get_public_key() );
+         db2.push_block( b, database::skip_nothing, pre );
+         BOOST_CHECK( db2.head_block_id() == b.id() );
+      }
+
+      // the precomputed merkle root is what gets checked, so a tampered one is rejected
+      auto b = db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+      precomputed_block pre = database::precompute_block( b );
+      pre.merkle_root = checksum_type::hash( string("tampered") );
+      GRAPHENE_CHECK_THROW( db2.push_block( b, database::skip_nothing, pre ), fc::exception );
+      BOOST_CHECK_EQUAL( db2.head_block_num(), 5u );
+      db2.push_block( b, database::skip_nothing, database::precompute_block( b ) );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( push_trusted_sync_blocks )
+{
+   try {
+      fc::temp_directory data_dir1( graphene::utilities::temp_directory_path() );
+      fc::temp_directory data_dir2( graphene::utilities::temp_directory_path() );
+
+      database db1;
+      db1.open(data_dir1.path(), make_genesis);
+      database db2;
+      db2.open(data_dir2.path(), make_genesis);
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      vector<signed_block> blocks;
+      for( uint32_t i = 0; i < 6; ++i )
+         blocks.push_back( db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing) );
+
+      BOOST_CHECK( !db2.is_trusted_block( 1 ) );
+      db2.add_checkpoints( { { 5, blocks[4].id() } } );
+      BOOST_CHECK( db2.is_trusted_block( 5 ) );
+      BOOST_CHECK( !db2.is_trusted_block( 6 ) );
+
+      // only the ids of trusted blocks are computed, the signee and merkle root aren't looked at
+      for( uint32_t i = 0; i < 5; ++i )
+      {
+         precomputed_block pre = database::precompute_block( blocks[i], true );
+         BOOST_CHECK( pre.id == blocks[i].id() );
+         BOOST_CHECK( !pre.signee.valid() );
+         db2.push_block( blocks[i], database::skip_nothing, pre );
+         BOOST_CHECK( db2.head_block_id() == blocks[i].id() );
+      }
+
+      // past the checkpoint the block is checked again
+      db2.push_block( blocks[5], database::skip_nothing, database::precompute_block( blocks[5] ) );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( parallel_signature_recovery )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() );
+      database db1,
+               db2;
+      db1.open(dir1.path(), make_genesis);
+      db2.open(dir2.path(), make_genesis);
+      db2.set_signature_threads( 2 );
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      auto other_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("other_key")) );
+      public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
+
+      signed_transaction trx;
+      set_expiration( db1, trx );
+      account_id_type nathan_id = account_idx.get_next_id();
+      account_create_operation cop;
+      cop.name = "nathan";
+      cop.owner = authority(1, init_account_pub_key, 1);
+      cop.active = cop.owner;
+      trx.operations.push_back(cop);
+      PUSH_TX( db1, trx, skip_sigs );
+
+      trx = decltype(trx)();
+      set_expiration( db1, trx );
+      transfer_operation t;
+      t.to = nathan_id;
+      t.amount = asset(500);
+      trx.operations.push_back(t);
+      PUSH_TX( db1, trx, skip_sigs );
+
+      auto b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      PUSH_BLOCK( db2, b, skip_sigs );
+
+      auto make_transfer = [&]( int64_t amount, const fc::ecc::private_key& key ) {
+         signed_transaction trx;
+         set_expiration( db1, trx );
+         transfer_operation t;
+         t.from = nathan_id;
+         t.amount = asset(amount);
+         trx.operations.push_back(t);
+         trx.sign( key, db1.get_chain_id() );
+         return trx;
+      };
+
+      // the keys of every transaction are recovered up front and then checked in order
+      for( int64_t amount = 1; amount <= 4; ++amount )
+         PUSH_TX( db1, make_transfer( amount, init_account_priv_key ), skip_sigs );
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      BOOST_REQUIRE_EQUAL( db2.recover_signature_keys( b, db2.get_chain_id() ).size(), b.transactions.size() );
+      PUSH_BLOCK( db2, b, database::skip_nothing );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+
+      // a transaction signed with the wrong key still fails its authority check
+      PUSH_TX( db1, make_transfer( 5, init_account_priv_key ), skip_sigs );
+      PUSH_TX( db1, make_transfer( 6, other_priv_key ), skip_sigs );
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      GRAPHENE_CHECK_THROW( PUSH_BLOCK( db2, b, database::skip_nothing ), fc::exception );
+      BOOST_CHECK_EQUAL( db2.head_block_num(), db1.head_block_num() - 1 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( generate_block_from_pending_state )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() );
+      database db1,
+               db2;
+      db1.open(dir1.path(), make_genesis);
+      db2.open(dir2.path(), make_genesis);
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
+
+      signed_transaction trx;
+      set_expiration( db1, trx );
+      account_id_type nathan_id = account_idx.get_next_id();
+      account_create_operation cop;
+      cop.name = "nathan";
+      cop.owner = authority(1, init_account_pub_key, 1);
+      cop.active = cop.owner;
+      trx.operations.push_back(cop);
+      PUSH_TX( db1, trx, skip_sigs );
+
+      auto make_transfer = [&]( int64_t amount ) {
+         signed_transaction trx;
+         set_expiration( db1, trx );
+         transfer_operation t;
+         t.to = nathan_id;
+         t.amount = asset(amount);
+         trx.operations.push_back(t);
+         return trx;
+      };
+      for( int64_t amount = 1; amount <= 3; ++amount )
+         PUSH_TX( db1, make_transfer( amount ), skip_sigs );
+
+      // the head hasn't moved, so the block is built from the pending state as it is
+      vector<operation_history_object> block_ops;
+      auto connection = db1.applied_block.connect( [&]( const signed_block& ) {
+         block_ops.clear();
+         for( const auto& op : db1.get_applied_operations() )
+            if( op.valid() )
+               block_ops.push_back( *op );
+      } );
+      auto b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 4u );
+      BOOST_CHECK_EQUAL( db1.get_balance( nathan_id, asset_id_type() ).amount.value, 6 );
+      BOOST_REQUIRE_EQUAL( block_ops.size(), 4u );
+      for( uint32_t i = 0; i < block_ops.size(); ++i )
+      {
+         BOOST_CHECK_EQUAL( block_ops[i].block_num, b.block_num() );
+         BOOST_CHECK_EQUAL( block_ops[i].trx_in_block, i );
+      }
+
+      PUSH_BLOCK( db2, b, skip_sigs );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+      BOOST_CHECK_EQUAL( db2.get_balance( nathan_id, asset_id_type() ).amount.value, 6 );
+
+      // a pending transaction applied with fewer checks than the block makes is applied again, and fails here
+      PUSH_TX( db1, make_transfer( 4 ), skip_sigs );
+      BOOST_CHECK_EQUAL( db1.get_balance( nathan_id, asset_id_type() ).amount.value, 10 );
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 0u );
+      BOOST_CHECK_EQUAL( db1.get_balance( nathan_id, asset_id_type() ).amount.value, 6 );
+      PUSH_BLOCK( db2, b, skip_sigs );
+
+      // pending transactions pushed again on top of a block received from elsewhere are used as well
+      PUSH_TX( db1, make_transfer( 5 ), skip_sigs );
+      b = db2.generate_block( db2.get_slot_time(1), db2.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      PUSH_BLOCK( db1, b, skip_sigs );
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 1u );
+      BOOST_CHECK_EQUAL( db1.get_balance( nathan_id, asset_id_type() ).amount.value, 11 );
+      PUSH_BLOCK( db2, b, skip_sigs );
+      BOOST_CHECK_EQUAL( db2.get_balance( nathan_id, asset_id_type() ).amount.value, 11 );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+
+      // popping the block undoes it as usual
+      db1.pop_block();
+      BOOST_CHECK_EQUAL( db1.get_balance( nathan_id, asset_id_type() ).amount.value, 6 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( pending_transaction_limits )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      database db;
+      db.open(data_dir.path(), make_genesis);
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto make_transfer = [&]( int64_t amount, int64_t fee ) {
+         signed_transaction trx;
+         set_expiration( db, trx );
+         transfer_operation t;
+         t.to = account_id_type(1);
+         t.amount = asset(amount);
+         t.fee = asset(fee);
+         trx.operations.push_back(t);
+         return trx;
+      };
+
+      pending_transaction_pool::limits limits;
+      limits.max_per_account = 2;
+      db.set_pending_transaction_limits( limits );
+      PUSH_TX( db, make_transfer( 1, 0 ), skip_sigs );
+      PUSH_TX( db, make_transfer( 2, 0 ), skip_sigs );
+      GRAPHENE_REQUIRE_THROW( PUSH_TX( db, make_transfer( 3, 0 ), skip_sigs ), tx_pending_account_limit );
+      BOOST_CHECK_EQUAL( db.get_pending_transaction_pool().count_paid_by( account_id_type() ), 2u );
+      db.clear_pending();
+      BOOST_CHECK_EQUAL( db.get_pending_transaction_pool().size(), 0u );
+
+      // room for two and a half transactions
+      const auto low1 = make_transfer( 1, 0 );
+      const auto low2 = make_transfer( 2, 0 );
+      const auto high = make_transfer( 3, 1000 );
+      limits.max_per_account = 0;
+      limits.max_bytes = fc::raw::pack_size( low1 ) * 5 / 2;
+      db.set_pending_transaction_limits( limits );
+      PUSH_TX( db, low1, skip_sigs );
+      PUSH_TX( db, low2, skip_sigs );
+      GRAPHENE_REQUIRE_THROW( PUSH_TX( db, make_transfer( 4, 0 ), skip_sigs ), tx_pending_pool_full );
+
+      // a better paying transaction evicts the most recent of the lowest paying ones
+      PUSH_TX( db, high, skip_sigs );
+      const auto& pool = db.get_pending_transaction_pool();
+      BOOST_CHECK_EQUAL( pool.size(), 2u );
+      BOOST_CHECK( pool.contains( low1.id() ) );
+      BOOST_CHECK( !pool.contains( low2.id() ) );
+      BOOST_CHECK( pool.contains( high.id() ) );
+      BOOST_CHECK( db.is_known_transaction( high.id() ) );
+      BOOST_CHECK( !db.is_known_transaction( low2.id() ) );
+      BOOST_CHECK( pool.positions_by_priority().front() == 1 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( push_transaction_batch )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      database db;
+      db.open(data_dir.path(), make_genesis);
+      db.set_signature_threads( 2 );
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      auto other_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("other_key")) );
+      public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+      const graphene::db::index& account_idx = db.get_index(protocol_ids, account_object_type);
+
+      signed_transaction trx;
+      set_expiration( db, trx );
+      account_id_type nathan_id = account_idx.get_next_id();
+      account_create_operation cop;
+      cop.name = "nathan";
+      cop.owner = authority(1, init_account_pub_key, 1);
+      cop.active = cop.owner;
+      trx.operations.push_back(cop);
+      PUSH_TX( db, trx, skip_sigs );
+      trx = decltype(trx)();
+      set_expiration( db, trx );
+      transfer_operation t;
+      t.to = nathan_id;
+      t.amount = asset(500);
+      trx.operations.push_back(t);
+      PUSH_TX( db, trx, skip_sigs );
+      db.generate_block( db.get_slot_time(1), db.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
 
-      // assert that db1 switches to new fork with good block
-      BOOST_CHECK_EQUAL(db2.head_block_num(), 14);
-      PUSH_BLOCK( db1, good_block );
-      BOOST_CHECK_EQUAL(db1.head_block_id().str(), db2.head_block_id().str());
+      auto make_transfer = [&]( int64_t amount, const fc::ecc::private_key& key ) {
+         signed_transaction trx;
+         set_expiration( db, trx );
+         transfer_operation t;
+         t.from = nathan_id;
+         t.amount = asset(amount);
+         trx.operations.push_back(t);
+         trx.sign( key, db.get_chain_id() );
+         return trx;
+      };
+
+      vector<signed_transaction> batch;
+      batch.push_back( make_transfer( 1, init_account_priv_key ) );
+      batch.push_back( signed_transaction() );                        // fails validate()
+      batch.push_back( make_transfer( 2, other_priv_key ) );          // fails the authority check
+      batch.push_back( batch.front() );                               // duplicate
+      batch.push_back( make_transfer( 5000, init_account_priv_key ) ); // insufficient balance
+      batch.push_back( make_transfer( 3, init_account_priv_key ) );
+
+      auto results = db.push_transactions( batch );
+      BOOST_REQUIRE_EQUAL( results.size(), batch.size() );
+      for( size_t i = 0; i < results.size(); ++i )
+         BOOST_CHECK( results[i].trx.valid() != results[i].error.valid() );
+      BOOST_CHECK( results[0].trx.valid() );
+      BOOST_CHECK( results[1].error.valid() );
+      BOOST_CHECK( results[2].error.valid() );
+      BOOST_CHECK( results[3].error.valid() );
+      BOOST_CHECK( results[4].error.valid() );
+      BOOST_CHECK( results[5].trx.valid() );
+      BOOST_CHECK_EQUAL( db.get_balance( nathan_id, asset_id_type() ).amount.value, 496 );
+
+      auto b = db.generate_block( db.get_slot_time(1), db.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 2u );
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
       throw;
    }
 }
 
-
 /**
  *  These test has been disabled, out of order blocks should result in the node getting disconnected.
  *  
@@ -549,6 +1697,46 @@ BOOST_AUTO_TEST_CASE( duplicate_transactions )
    }
 }
 
+BOOST_FIXTURE_TEST_CASE( recent_transactions_undo, database_fixture )
+{
+   try
+   {
+      ACTORS( (alice) );
+      generate_block();
+
+      signed_transaction trx;
+      set_expiration( db, trx );
+      transfer_operation t;
+      t.from = account_id_type();
+      t.to = alice_id;
+      t.amount = asset(500);
+      trx.operations.push_back(t);
+      PUSH_TX( db, trx, ~0 );
+      BOOST_CHECK( db.is_known_transaction( trx.id() ) );
+
+      // the pending state is undone, and the transaction with it
+      db.clear_pending();
+      BOOST_CHECK( !db.is_known_transaction( trx.id() ) );
+
+      PUSH_TX( db, trx, ~0 );
+      generate_block();
+      BOOST_CHECK( db.is_known_transaction( trx.id() ) );
+      BOOST_CHECK( db.get_recent_transaction( trx.id() ).operations.size() == 1 );
+      // kept packed, and unpacked to the same transaction
+      BOOST_CHECK( db.get_recent_transaction( trx.id() ).id() == trx.id() );
+      GRAPHENE_CHECK_THROW( PUSH_TX( db, trx, ~0 ), fc::exception );
+
+      // forgotten by the first block after it expires, and remembered again when that block is popped
+      generate_blocks( trx.expiration + db.get_global_properties().parameters.block_interval );
+      BOOST_CHECK( !db.is_known_transaction( trx.id() ) );
+      db.pop_block();
+      BOOST_CHECK( db.is_known_transaction( trx.id() ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( tapos )
 {
    try {
@@ -598,6 +1786,84 @@ BOOST_AUTO_TEST_CASE( tapos )
    }
 }
 
+BOOST_FIXTURE_TEST_CASE( tapos_block_ids_undo, database_fixture )
+{
+   try
+   {
+      generate_block();
+      const uint32_t num = db.head_block_num();
+      const block_id_type previous = db.get_tapos_block_id( ( num - 1 ) & 0xffff );
+      BOOST_CHECK( db.get_tapos_block_id( num & 0xffff ) == db.head_block_id() );
+
+      // the id of a popped block stops being a valid reference
+      db.pop_block();
+      BOOST_CHECK( db.get_tapos_block_id( num & 0xffff ) == block_id_type() );
+      BOOST_CHECK( db.get_tapos_block_id( ( num - 1 ) & 0xffff ) == previous );
+
+      generate_block();
+      BOOST_CHECK( db.get_tapos_block_id( num & 0xffff ) == db.head_block_id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( shared_applied_operations, database_fixture )
+{ try {
+   ACTORS( (alice) );
+   generate_block();
+
+   std::shared_ptr< const vector< optional< operation_history_object > > > shared;
+   auto connection = db.applied_block.connect( [&]( const signed_block& ) {
+      if( !shared )
+         shared = db.share_applied_operations();
+   } );
+
+   transfer( account_id_type(), alice_id, asset( 100 ) );
+   const uint32_t block_num = generate_block().block_num();
+   BOOST_REQUIRE( shared );
+   const size_t count = shared->size();
+   BOOST_CHECK_GT( count, 0u );
+
+   // the list handed out stays as it was while the database records the next blocks' operations
+   transfer( account_id_type(), alice_id, asset( 100 ) );
+   generate_block();
+   BOOST_CHECK_EQUAL( shared->size(), count );
+   for( const auto& op : *shared )
+      if( op.valid() )
+         BOOST_CHECK_EQUAL( op->block_num, block_num );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( precheck_transaction, database_fixture )
+{ try {
+   ACTORS( (alice) );
+   generate_block();
+
+   signed_transaction trx;
+   transfer_operation t;
+   t.from = account_id_type();
+   t.to = alice_id;
+   t.amount = asset( 100 );
+   trx.operations.push_back( t );
+   set_expiration( db, trx );
+   // the signatures are left to push_transaction
+   db.precheck_transaction( trx );
+
+   const uint32_t max_until_expiration = db.get_global_properties().parameters.maximum_time_until_expiration;
+   signed_transaction bad = trx;
+   bad.expiration = fc::time_point_sec( db.head_block_time().sec_since_epoch() - 1 );
+   BOOST_CHECK_THROW( db.precheck_transaction( bad ), fc::exception );
+   bad.expiration = db.head_block_time() + fc::seconds( max_until_expiration + 1 );
+   BOOST_CHECK_THROW( db.precheck_transaction( bad ), fc::exception );
+   bad = trx;
+   bad.ref_block_prefix ^= 1;
+   BOOST_CHECK_THROW( db.precheck_transaction( bad ), fc::exception );
+
+   trx.sign( init_account_priv_key, db.get_chain_id() );
+   PUSH_TX( db, trx );
+   BOOST_CHECK_THROW( db.precheck_transaction( trx ), fc::exception );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_FIXTURE_TEST_CASE( optional_tapos, database_fixture )
 {
    try
@@ -713,6 +1979,321 @@ BOOST_FIXTURE_TEST_CASE( maintenance_interval, database_fixture )
 }
 
 
+BOOST_FIXTURE_TEST_CASE( incremental_vote_tally, database_fixture )
+{
+   try {
+      generate_block();
+
+      const account_object& nathan = create_account("nathan");
+      upgrade_to_lifetime_member(nathan);
+      const committee_member_id_type committee_member_id = create_committee_member(nathan).id;
+      const vote_id_type vote_id = committee_member_id(db).vote_id;
+      const account_id_type alice_id = create_account("alice").id;
+      const account_id_type bob_id = create_account("bob").id;
+      transfer(account_id_type(), alice_id, asset(5000));
+      transfer(account_id_type(), bob_id, asset(3000));
+
+      auto update_options = [&]( account_id_type account, std::function<void(account_options&)> f ) {
+         account_update_operation op;
+         op.account = account;
+         op.new_options = account(db).options;
+         f( *op.new_options );
+         trx.operations.push_back(op);
+         PUSH_TX( db, trx, ~0 );
+         trx.clear();
+      };
+      auto next_maintenance = [&]() {
+         generate_blocks(db.get_dynamic_global_properties().next_maintenance_time);
+         generate_block();
+      };
+
+      update_options( alice_id, [&]( account_options& o ) { o.votes.insert(vote_id); } );
+      update_options( bob_id, [&]( account_options& o ) { o.voting_account = alice_id; } );
+      next_maintenance();
+      BOOST_CHECK_EQUAL( committee_member_id(db).total_votes, 8000 );
+
+      // only the accounts that changed are tallied again, the others keep what they voted with
+      transfer(alice_id, account_id_type(), asset(2000));
+      transfer(account_id_type(), bob_id, asset(1000));
+      next_maintenance();
+      BOOST_CHECK_EQUAL( committee_member_id(db).total_votes, 7000 );
+      next_maintenance();
+      BOOST_CHECK_EQUAL( committee_member_id(db).total_votes, 7000 );
+
+      update_options( bob_id, [&]( account_options& o ) { o.voting_account = GRAPHENE_PROXY_TO_SELF_ACCOUNT; } );
+      next_maintenance();
+      BOOST_CHECK_EQUAL( committee_member_id(db).total_votes, 3000 );
+
+      // the opinion account changing its votes moves the stake of everyone voting with it
+      update_options( bob_id, [&]( account_options& o ) { o.voting_account = alice_id; } );
+      update_options( alice_id, [&]( account_options& o ) { o.votes.erase(vote_id); } );
+      next_maintenance();
+      BOOST_CHECK_EQUAL( committee_member_id(db).total_votes, 0 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( incremental_vote_tally_matches_recount, database_fixture )
+{
+   try {
+      generate_block();
+
+      // counts every account's stake from scratch, the way maintenance did before the totals were kept
+      auto check_recount = [&]() {
+         const global_property_object& props = db.get_global_properties();
+         vector<uint64_t> votes( props.next_available_vote_id );
+         vector<uint64_t> witness_counts( props.parameters.maximum_witness_count / 2 + 1 );
+         vector<uint64_t> committee_counts( props.parameters.maximum_committee_count / 2 + 1 );
+         uint64_t total_voting_stake = 0;
+         for( const account_object& stake_account : db.get_index_type<account_index>().indices() )
+         {
+            if( !props.parameters.count_non_member_votes && !stake_account.is_member( db.head_block_time() ) )
+               continue;
+            const account_object& opinion_account =
+                  stake_account.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT ? stake_account
+                                                                                         : stake_account.options.voting_account(db);
+            const uint64_t stake = stake_account.statistics(db).total_core_in_orders.value
+                  + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(db).balance.amount.value : 0)
+                  + db.get_balance( stake_account.get_id(), asset_id_type() ).amount.value;
+            if( stake == 0 )
+               continue;
+            for( vote_id_type id : opinion_account.options.votes )
+               if( id.instance() < votes.size() )
+                  votes[id.instance()] += stake;
+            if( opinion_account.options.num_witness <= props.parameters.maximum_witness_count )
+               witness_counts[ std::min( size_t(opinion_account.options.num_witness/2), witness_counts.size() - 1 ) ] += stake;
+            if( opinion_account.options.num_committee <= props.parameters.maximum_committee_count )
+               committee_counts[ std::min( size_t(opinion_account.options.num_committee/2), committee_counts.size() - 1 ) ] += stake;
+            total_voting_stake += stake;
+         }
+         const vote_tally_object& tally = vote_tally_id_type()(db);
+         BOOST_CHECK( tally.votes == votes );
+         BOOST_CHECK( tally.witness_counts == witness_counts );
+         BOOST_CHECK( tally.committee_counts == committee_counts );
+         BOOST_CHECK_EQUAL( tally.total_voting_stake, total_voting_stake );
+      };
+      auto update_options = [&]( account_id_type account, std::function<void(account_options&)> f ) {
+         account_update_operation op;
+         op.account = account;
+         op.new_options = account(db).options;
+         f( *op.new_options );
+         trx.operations.push_back(op);
+         PUSH_TX( db, trx, ~0 );
+         trx.clear();
+      };
+      auto next_maintenance = [&]() {
+         generate_blocks(db.get_dynamic_global_properties().next_maintenance_time);
+         generate_block();
+      };
+
+      const account_object& nathan = create_account("nathan");
+      upgrade_to_lifetime_member(nathan);
+      const vote_id_type committee_vote = create_committee_member(nathan).vote_id;
+      const vote_id_type witness_vote = create_witness(nathan).vote_id;
+      const account_id_type alice_id = create_account("alice").id;
+      const account_id_type bob_id = create_account("bob").id;
+      const account_id_type carol_id = create_account("carol").id;
+      transfer(account_id_type(), alice_id, asset(5000));
+      transfer(account_id_type(), bob_id, asset(3000));
+      transfer(account_id_type(), carol_id, asset(2000));
+      update_options( alice_id, [&]( account_options& o ) {
+         o.votes.insert(committee_vote);
+         o.votes.insert(witness_vote);
+         o.num_witness = 1;
+         o.num_committee = 1;
+      } );
+      update_options( bob_id, [&]( account_options& o ) { o.voting_account = alice_id; } );
+      update_options( carol_id, [&]( account_options& o ) { o.votes.insert(witness_vote); } );
+      next_maintenance();
+      check_recount();
+
+      // stake moving into orders and between accounts
+      const asset_object& test_asset = create_user_issued_asset("TESTA");
+      create_sell_order( carol_id, asset(500), asset(100, test_asset.id) );
+      transfer(alice_id, bob_id, asset(1500));
+      next_maintenance();
+      check_recount();
+
+      // a maintenance block that is popped again, with the chain then going on with other changes
+      const uint32_t fork_head = db.head_block_num();
+      transfer(bob_id, carol_id, asset(1000));
+      update_options( carol_id, [&]( account_options& o ) { o.voting_account = alice_id; } );
+      next_maintenance();
+      check_recount();
+      while( db.head_block_num() > fork_head )
+         db.pop_block();
+      db.clear_pending();
+      update_options( alice_id, [&]( account_options& o ) { o.votes.erase(witness_vote); } );
+      transfer(carol_id, alice_id, asset(700));
+      next_maintenance();
+      check_recount();
+
+      // changes that are undone before they reach a block
+      {
+         auto session = db._undo_db.start_undo_session();
+         transfer(alice_id, carol_id, asset(1000));
+         update_options( bob_id, [&]( account_options& o ) { o.voting_account = GRAPHENE_PROXY_TO_SELF_ACCOUNT; } );
+      }
+      db.clear_pending();
+      next_maintenance();
+      check_recount();
+
+      // and nothing changing at all
+      next_maintenance();
+      check_recount();
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+namespace {
+   /** every candidate in Index in the order maintenance used to sort them: most tallied votes first, ties to the lower vote id */
+   template< typename Index >
+   vector<const typename Index::object_type*> sorted_by_tallied_votes( const database& db )
+   {
+      const vote_tally_object& tally = vote_tally_id_type()(db);
+      auto votes_of = [&]( vote_id_type id ) -> uint64_t {
+         return id.instance() < tally.votes.size() ? tally.votes[id.instance()] : 0;
+      };
+      vector<const typename Index::object_type*> candidates;
+      for( const auto& o : db.get_index_type<Index>().indices() )
+         candidates.push_back( &o );
+      std::sort( candidates.begin(), candidates.end(),
+                 [&]( const typename Index::object_type* a, const typename Index::object_type* b ) {
+         if( votes_of( a->vote_id ) != votes_of( b->vote_id ) )
+            return votes_of( a->vote_id ) > votes_of( b->vote_id );
+         return a->vote_id < b->vote_id;
+      } );
+      return candidates;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( elections_match_full_sort, database_fixture )
+{
+   try {
+      generate_block();
+
+      // twelve candidates, each voted for by one of six voters, so candidates i and i+6 tie, as do voters 2k and 2k+1
+      vector<vote_id_type> witness_votes;
+      vector<vote_id_type> committee_votes;
+      vector<vote_id_type> worker_votes;
+      for( int i = 0; i < 12; ++i )
+      {
+         const account_object& candidate = create_account( "candidate" + fc::to_string(i) );
+         upgrade_to_lifetime_member( candidate );
+         witness_votes.push_back( create_witness( candidate ).vote_id );
+         committee_votes.push_back( create_committee_member( candidate ).vote_id );
+
+         worker_create_operation op;
+         op.owner = candidate.id;
+         op.daily_pay = 1000 + i;
+         op.initializer = vesting_balance_worker_initializer(1);
+         op.work_begin_date = db.head_block_time() + 10;
+         op.work_end_date = op.work_begin_date + fc::days(30);
+         trx.operations.push_back(op);
+         worker_votes.push_back( db.get<worker_object>( PUSH_TX( db, trx, ~0 ).operation_results.back().get<object_id_type>() ).vote_for );
+         trx.clear();
+      }
+      vector<account_id_type> voters;
+      for( int j = 0; j < 6; ++j )
+      {
+         const account_id_type voter_id = create_account( "voter" + fc::to_string(j) ).id;
+         transfer( account_id_type(), voter_id, asset( 1000 * (j / 2 + 1) ) );
+         account_update_operation op;
+         op.account = voter_id;
+         op.new_options = voter_id(db).options;
+         op.new_options->votes = { witness_votes[j], witness_votes[j+6], committee_votes[j], committee_votes[j+6],
+                                   worker_votes[j], worker_votes[j+6] };
+         op.new_options->num_witness = 2 * j + 1;
+         op.new_options->num_committee = 2 * j + 1;
+         trx.operations.push_back(op);
+         PUSH_TX( db, trx, ~0 );
+         trx.clear();
+         voters.push_back( voter_id );
+      }
+
+      // the elected candidates must be the first ones of the full sort maintenance used to do
+      auto check_elections = [&]() {
+         const vote_tally_object& tally = vote_tally_id_type()(db);
+         auto votes_of = [&]( vote_id_type id ) -> uint64_t {
+            return id.instance() < tally.votes.size() ? tally.votes[id.instance()] : 0;
+         };
+
+         const vector<const witness_object*> witnesses = sorted_by_tallied_votes<witness_index>( db );
+         const auto& active_witnesses = db.get_global_properties().active_witnesses;
+         BOOST_REQUIRE_LE( active_witnesses.size(), witnesses.size() );
+         for( size_t i = 0; i < witnesses.size(); ++i )
+         {
+            BOOST_CHECK_EQUAL( witnesses[i]->total_votes, votes_of( witnesses[i]->vote_id ) );
+            BOOST_CHECK_EQUAL( active_witnesses.count( witnesses[i]->id ), i < active_witnesses.size() ? 1u : 0u );
+         }
+
+         const vector<const committee_member_object*> committee_members = sorted_by_tallied_votes<committee_member_index>( db );
+         const auto& active_committee = db.get_global_properties().active_committee_members;
+         BOOST_REQUIRE_LE( active_committee.size(), committee_members.size() );
+         for( size_t i = 0; i < committee_members.size(); ++i )
+         {
+            const bool elected = std::find( active_committee.begin(), active_committee.end(), committee_members[i]->id )
+                                 != active_committee.end();
+            BOOST_CHECK_EQUAL( elected, i < active_committee.size() );
+         }
+
+         // and the workers in the order pay_workers used to pay them
+         vector<const worker_object*> old_order;
+         for( const worker_object& w : db.get_index_type<worker_index>().indices() )
+         {
+            BOOST_CHECK_EQUAL( w.total_votes_for, votes_of( w.vote_for ) );
+            if( w.is_active( db.head_block_time() ) && w.approving_stake() > 0 )
+               old_order.push_back( &w );
+         }
+         std::sort( old_order.begin(), old_order.end(), []( const worker_object* a, const worker_object* b ) {
+            if( a->approving_stake() != b->approving_stake() )
+               return a->approving_stake() > b->approving_stake();
+            return a->id < b->id;
+         } );
+         vector<const worker_object*> new_order;
+         const auto& by_stake_idx = db.get_index_type<worker_index>().indices().get<by_approving_stake>();
+         for( auto itr = by_stake_idx.begin(); itr != by_stake_idx.end() && itr->approving_stake() > 0; ++itr )
+            if( itr->is_active( db.head_block_time() ) )
+               new_order.push_back( &*itr );
+         BOOST_CHECK( new_order == old_order );
+         BOOST_CHECK( !new_order.empty() );
+      };
+      auto next_maintenance = [&]() {
+         generate_blocks(db.get_dynamic_global_properties().next_maintenance_time);
+         generate_block();
+      };
+
+      next_maintenance();
+      check_elections();
+
+      // stake moving between voters reorders the candidates, and breaks some of the ties
+      transfer( voters[5], voters[0], asset(2500) );
+      transfer( voters[3], voters[2], asset(100) );
+      next_maintenance();
+      check_elections();
+
+      // a voter dropping its votes leaves candidates with none at all
+      {
+         account_update_operation op;
+         op.account = voters[4];
+         op.new_options = voters[4](db).options;
+         op.new_options->votes.clear();
+         trx.operations.push_back(op);
+         PUSH_TX( db, trx, ~0 );
+         trx.clear();
+      }
+      next_maintenance();
+      check_elections();
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_FIXTURE_TEST_CASE( limit_order_expiration, database_fixture )
 { try {
    //Get a sane head block time
@@ -916,6 +2497,245 @@ BOOST_FIXTURE_TEST_CASE( pop_block_twice, database_fixture )
    }
 }
 
+BOOST_FIXTURE_TEST_CASE( state_replica_versions, database_fixture )
+{
+   try
+   {
+      using graphene::app::state_replica;
+      const object_id_type dgp_id = dynamic_global_property_id_type();
+      state_replica replica( db, { state_replica::object_type( protocol_ids, account_object_type ),
+                                   state_replica::object_type( implementation_ids, impl_dynamic_global_property_object_type ) } );
+      BOOST_REQUIRE( replica.current() );
+      BOOST_CHECK_EQUAL( replica.current()->block_num(), db.head_block_num() );
+
+      generate_block();
+      auto before = replica.current();
+      BOOST_CHECK_EQUAL( before->block_num(), db.head_block_num() );
+
+      const account_id_type alice_id = create_account( "alice" ).id;
+      // pending transactions are not published
+      BOOST_CHECK( replica.current()->find( alice_id ) == nullptr );
+      generate_block();
+
+      auto after = replica.current();
+      BOOST_CHECK_EQUAL( after->block_num(), before->block_num() + 1 );
+      BOOST_REQUIRE( after->find( alice_id ) != nullptr );
+      BOOST_CHECK_EQUAL( static_cast<const account_object*>( after->find( alice_id ) )->name, "alice" );
+      BOOST_CHECK_EQUAL( static_cast<const dynamic_global_property_object*>( after->find( dgp_id ) )->head_block_number,
+                         after->block_num() );
+      BOOST_CHECK( after->find( asset_id_type() ) == nullptr );
+
+      // a held version is not changed by later blocks
+      BOOST_CHECK( before->find( alice_id ) == nullptr );
+      BOOST_CHECK_EQUAL( static_cast<const dynamic_global_property_object*>( before->find( dgp_id ) )->head_block_number,
+                         before->block_num() );
+
+      // the block after a pop is published in full
+      db.pop_block();
+      generate_block();
+      BOOST_CHECK_EQUAL( replica.current()->block_num(), db.head_block_num() );
+      BOOST_CHECK_EQUAL( replica.current()->find( alice_id ) != nullptr, db.find_object( alice_id ) != nullptr );
+      BOOST_CHECK( replica.current()->find( account_id_type() ) != nullptr );
+   } catch(const fc::exception& e) {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( shared_state_follower, database_fixture )
+{
+   try
+   {
+      using graphene::app::shared_state_writer;
+      fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+      const fc::path file = dir.path() / "shared_state";
+      shared_state_writer writer( db, file, shared_state_writer::min_ring_size,
+                                  { shared_state_writer::object_type( protocol_ids, account_object_type ) } );
+
+      database follower_db;
+      graphene::app::shared_state_follower follower( follower_db, file );
+      BOOST_CHECK_EQUAL( follower.block_num(), db.head_block_num() );
+      BOOST_CHECK_EQUAL( follower_db.head_block_num(), db.head_block_num() );
+      BOOST_CHECK( follower_db.find_object( account_id_type() ) != nullptr );
+      // only the shared types
+      BOOST_CHECK( follower_db.find_object( asset_id_type() ) == nullptr );
+      BOOST_CHECK( !follower.poll() );
+
+      const account_id_type alice_id = create_account( "alice" ).id;
+      generate_block();
+      BOOST_CHECK( follower.poll() );
+      BOOST_CHECK_EQUAL( follower.block_num(), db.head_block_num() );
+      BOOST_CHECK_EQUAL( follower_db.head_block_num(), db.head_block_num() );
+      BOOST_REQUIRE( follower_db.find( alice_id ) != nullptr );
+      BOOST_CHECK_EQUAL( alice_id( follower_db ).name, "alice" );
+
+      // the block after a pop goes out as a new base
+      db.pop_block();
+      generate_block();
+      BOOST_CHECK( follower.poll() );
+      BOOST_CHECK_EQUAL( follower_db.head_block_num(), db.head_block_num() );
+      BOOST_CHECK_EQUAL( follower_db.find( alice_id ) != nullptr, db.find( alice_id ) != nullptr );
+
+      // a follower which starts late loads the newest base and the frames after it
+      const account_id_type bob_id = create_account( "bob" ).id;
+      generate_block();
+      database late_db;
+      graphene::app::shared_state_follower late( late_db, file );
+      BOOST_CHECK( late_db.find( bob_id ) != nullptr );
+      BOOST_CHECK_EQUAL( late_db.head_block_num(), db.head_block_num() );
+   } catch(const fc::exception& e) {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( transaction_confirmations, database_fixture )
+{
+   try
+   {
+      graphene::app::confirmation_registry registry( db );
+      auto session = std::make_shared<int>( 0 );
+      auto closed_session = std::make_shared<int>( 0 );
+
+      signed_transaction included;
+      included.operations.push_back( make_account( "alice" ) );
+      set_expiration( db, included );
+      signed_transaction expiring;
+      expiring.operations.push_back( make_account( "bob" ) );
+      expiring.set_expiration( db.head_block_time() + 1 );
+
+      vector<std::tuple<transaction_id_type, uint32_t, uint32_t>> confirmed;
+      bool closed_called = false;
+      registry.add( included, session, [&confirmed]( const transaction_id_type& id, uint32_t block_num,
+                                                     uint32_t trx_num, const processed_transaction& ) {
+         confirmed.emplace_back( id, block_num, trx_num );
+      } );
+      registry.add( included, closed_session, [&closed_called]( const transaction_id_type&, uint32_t, uint32_t,
+                                                                const processed_transaction& ) {
+         closed_called = true;
+      } );
+      registry.add( expiring, session, [&confirmed]( const transaction_id_type& id, uint32_t block_num,
+                                                     uint32_t trx_num, const processed_transaction& ) {
+         confirmed.emplace_back( id, block_num, trx_num );
+      } );
+      BOOST_CHECK_EQUAL( registry.size(), 3 );
+      closed_session.reset();
+
+      PUSH_TX( db, included, ~0 );
+      generate_block();
+
+      // the included transaction was confirmed once, for the open session; the other one can't be included any more
+      BOOST_REQUIRE_EQUAL( confirmed.size(), 1 );
+      BOOST_CHECK( std::get<0>( confirmed[0] ) == included.id() );
+      BOOST_CHECK_EQUAL( std::get<1>( confirmed[0] ), db.head_block_num() );
+      BOOST_CHECK_EQUAL( std::get<2>( confirmed[0] ), 0 );
+      BOOST_CHECK( !closed_called );
+      BOOST_CHECK_EQUAL( registry.size(), 0 );
+   } catch(const fc::exception& e) {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( irreversible_confirmations, database_fixture )
+{
+   try
+   {
+      graphene::app::confirmation_registry registry( db );
+      auto session = std::make_shared<int>( 0 );
+
+      const account_id_type carol_id = db.get_index( protocol_ids, account_object_type ).get_next_id();
+      signed_transaction trx;
+      trx.operations.push_back( make_account( "carol" ) );
+      set_expiration( db, trx );
+
+      vector<uint32_t> confirmed;
+      vector<operation_history_object> operations;
+      registry.add( trx, session, [&confirmed]( const transaction_id_type&, uint32_t block_num, uint32_t,
+                                                const processed_transaction& ) {
+         confirmed.push_back( block_num );
+      }, true );
+      registry.watch_accounts( { carol_id }, session, [&operations]( const operation_history_object& op ) {
+         operations.push_back( op );
+      } );
+
+      PUSH_TX( db, trx, ~0 );
+      generate_block();
+      const uint32_t included = db.head_block_num();
+      for( uint32_t i = 0; i < 50 && db.get_dynamic_global_properties().last_irreversible_block_num < included; ++i )
+      {
+         BOOST_CHECK( confirmed.empty() );
+         BOOST_CHECK( operations.empty() );
+         generate_block();
+      }
+      BOOST_REQUIRE_GE( db.get_dynamic_global_properties().last_irreversible_block_num, included );
+
+      BOOST_REQUIRE_EQUAL( confirmed.size(), 1 );
+      BOOST_CHECK_EQUAL( confirmed[0], included );
+      BOOST_CHECK_EQUAL( registry.size(), 0 );
+      BOOST_REQUIRE_EQUAL( operations.size(), 1 );
+      BOOST_CHECK_EQUAL( operations[0].block_num, included );
+      BOOST_CHECK_EQUAL( operations[0].op.which(), operation::tag<account_create_operation>::value );
+   } catch(const fc::exception& e) {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( trx_batch_keeps_message_ids, database_fixture )
+{
+   try
+   {
+      create_account( "alice" );
+      create_account( "bob" );
+      signed_block block = generate_block();
+      BOOST_REQUIRE_EQUAL( block.transactions.size(), 2 );
+
+      graphene::net::trx_batch_message batch;
+      for( const processed_transaction& trx : block.transactions )
+         batch.transactions.push_back( graphene::net::trx_message( trx ) );
+
+      // the receiver matches each transaction to its fetch request by the id of its own message
+      graphene::net::trx_batch_message received = graphene::net::message( batch ).as<graphene::net::trx_batch_message>();
+      BOOST_REQUIRE_EQUAL( received.transactions.size(), 2 );
+      for( size_t i = 0; i < received.transactions.size(); ++i )
+      {
+         BOOST_CHECK( received.transactions[i].id() == batch.transactions[i].id() );
+         BOOST_CHECK( received.transactions[i].as<graphene::net::trx_message>().trx.id() == block.transactions[i].id() );
+      }
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( prepared_block_candidate, database_fixture )
+{
+   try
+   {
+      const uint32_t skip = ~0;
+      create_account( "alice" );
+      db.prepare_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip );
+
+      // transactions pushed after the block was prepared are added to it
+      create_account( "bob" );
+      signed_block block = db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip );
+      BOOST_REQUIRE_EQUAL( block.transactions.size(), 2 );
+      BOOST_CHECK( block.transaction_merkle_root == block.calculate_merkle_root() );
+      BOOST_CHECK( db.head_block_id() == block.id() );
+      BOOST_CHECK( db.fetch_block_by_id( block.id() ).valid() );
+      get_account( "alice" );
+      get_account( "bob" );
+
+      // clearing the pending transactions drops the candidate, the block is built again
+      create_account( "carol" );
+      db.prepare_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip );
+      db.clear_pending();
+      create_account( "dave" );
+      block = db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip );
+      BOOST_REQUIRE_EQUAL( block.transactions.size(), 1 );
+      BOOST_CHECK( db.get_index_type<account_index>().indices().get<by_name>().count( "carol" ) == 0 );
+      get_account( "dave" );
+   } FC_LOG_AND_RETHROW()
+}
+
 BOOST_FIXTURE_TEST_CASE( rsf_missed_blocks, database_fixture )
 {
    try
@@ -1040,6 +2860,115 @@ BOOST_FIXTURE_TEST_CASE( rsf_missed_blocks, database_fixture )
    FC_LOG_AND_RETHROW()
 }
 
+BOOST_FIXTURE_TEST_CASE( missed_blocks_are_counted_per_witness, database_fixture )
+{
+   try
+   {
+      generate_block();
+
+      const auto total_missed = [&]() -> std::map<witness_id_type, int64_t>
+      {
+         std::map<witness_id_type, int64_t> result;
+         for( const witness_id_type& wid : db.get_global_properties().active_witnesses )
+            result[wid] = wid(db).total_missed;
+         return result;
+      };
+
+      // several rounds of missed slots, counted slot by slot as the schedule assigns them
+      const uint32_t miss = 3 * db.get_global_properties().active_witnesses.size() + 4;
+      std::map<witness_id_type, int64_t> expected = total_missed();
+      const witness_id_type producer = db.get_scheduled_witness( miss + 1 );
+      for( uint32_t i = 1; i <= miss; ++i )
+         if( db.get_scheduled_witness( i ) != producer )
+            ++expected[ db.get_scheduled_witness( i ) ];
+
+      generate_block( ~0, init_account_priv_key, miss );
+      BOOST_CHECK( total_missed() == expected );
+
+      // the cached witness objects still follow the last confirmed blocks
+      const uint32_t lib = db.get_dynamic_global_properties().last_irreversible_block_num;
+      generate_blocks( db.get_global_properties().active_witnesses.size() );
+      BOOST_CHECK_GT( db.get_dynamic_global_properties().last_irreversible_block_num, lib );
+   }
+   FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( light_header_chain, database_fixture )
+{
+   try
+   {
+      auto active_keys = [&]() {
+         graphene::app::header_chain::witness_keys keys;
+         for( const witness_id_type& w : db.get_global_properties().active_witnesses )
+            keys[w] = w(db).signing_key;
+         return keys;
+      };
+      auto header_of = [&]( uint32_t block_num ) -> signed_block_header {
+         return *db.fetch_block_by_number( block_num );
+      };
+
+      generate_block( database::skip_nothing );
+      graphene::app::header_chain chain;
+      chain.reset( header_of( db.head_block_num() ), active_keys() );
+      const uint32_t start = db.head_block_num();
+
+      // the headers of a stored block are the start of its packed form, which get_block_headers sends
+      const signed_block first = *db.fetch_block_by_number( start );
+      const vector<char> packed_block = fc::raw::pack( first );
+      const vector<char> packed_header = fc::raw::pack( signed_block_header( first ) );
+      BOOST_REQUIRE_LE( packed_header.size(), packed_block.size() );
+      BOOST_CHECK( std::equal( packed_header.begin(), packed_header.end(), packed_block.begin() ) );
+
+      // the irreversible block follows the chain's once every active witness signed a header
+      const uint32_t rounds = 3 * db.get_global_properties().active_witnesses.size();
+      for( uint32_t i = 0; i < rounds; ++i )
+      {
+         generate_block( database::skip_nothing );
+         chain.push( header_of( db.head_block_num() ) );
+      }
+      BOOST_CHECK_EQUAL( chain.head_block_num(), db.head_block_num() );
+      BOOST_CHECK( chain.head_block_id() == db.head_block_id() );
+      BOOST_CHECK_GT( chain.last_irreversible_block_num(), start );
+      BOOST_CHECK_EQUAL( chain.last_irreversible_block_num(), db.get_dynamic_global_properties().last_irreversible_block_num );
+      BOOST_CHECK( *chain.get_block_id( chain.last_irreversible_block_num() ) ==
+                   db.get_block_id_for_num( chain.last_irreversible_block_num() ) );
+      BOOST_CHECK( !chain.get_block_id( chain.last_irreversible_block_num() - 1 ).valid() );
+
+      generate_block( database::skip_nothing );
+      const signed_block_header next = header_of( db.head_block_num() );
+
+      // a header signed with another key, by a witness that isn't active, or not following the head is rejected
+      signed_block_header forged = next;
+      forged.sign( generate_private_key( "forger" ) );
+      GRAPHENE_REQUIRE_THROW( chain.push( forged ), fc::exception );
+      signed_block_header unknown = next;
+      unknown.witness = witness_id_type( 1000 );
+      unknown.sign( init_account_priv_key );
+      GRAPHENE_REQUIRE_THROW( chain.push( unknown ), fc::exception );
+      GRAPHENE_REQUIRE_THROW( chain.push( header_of( db.head_block_num() - 1 ) ), fc::exception );
+      BOOST_CHECK( chain.head_block_id() == db.get_block_id_for_num( db.head_block_num() - 1 ) );
+
+      // a witness with a new key is rejected until the caller sets the new one
+      auto keys = active_keys();
+      keys[next.witness] = generate_private_key( "forger" ).get_public_key();
+      chain.set_active_witnesses( keys );
+      GRAPHENE_REQUIRE_THROW( chain.push( next ), fc::exception );
+      chain.set_active_witnesses( active_keys() );
+      chain.push( next );
+
+      // popping the reversible headers counts the witnesses' confirmations from the remaining ones
+      const uint32_t last_irreversible = chain.last_irreversible_block_num();
+      GRAPHENE_REQUIRE_THROW( chain.pop_to( last_irreversible - 1 ), fc::exception );
+      chain.pop_to( last_irreversible );
+      BOOST_CHECK_EQUAL( chain.head_block_num(), last_irreversible );
+      for( uint32_t n = last_irreversible + 1; n <= db.head_block_num(); ++n )
+         chain.push( header_of( n ) );
+      BOOST_CHECK( chain.head_block_id() == db.head_block_id() );
+      BOOST_CHECK_EQUAL( chain.last_irreversible_block_num(), db.get_dynamic_global_properties().last_irreversible_block_num );
+   }
+   FC_LOG_AND_RETHROW()
+}
+
 BOOST_FIXTURE_TEST_CASE( transaction_invalidated_in_cache, database_fixture )
 {
    try
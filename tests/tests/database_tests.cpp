@@ -27,8 +27,17 @@
 #include <graphene/chain/database.hpp>
 
 #include <graphene/chain/account_object.hpp>
+#include <graphene/chain/operation_history_object.hpp>
+
+#include <graphene/db/slab_index.hpp>
+
+#include <graphene/utilities/tempdir.hpp>
 
 #include <fc/crypto/digest.hpp>
+#include <fc/io/raw.hpp>
+
+#include <algorithm>
+#include <fstream>
 
 #include "../common/database_fixture.hpp"
 
@@ -59,3 +68,531 @@ BOOST_AUTO_TEST_CASE( undo_test )
       throw;
    }
 }
+
+BOOST_AUTO_TEST_CASE( undo_squash_test )
+{
+   try {
+      database db;
+      db._undo_db.enable();
+      db._undo_db.set_max_size( 100 );
+      db._undo_db.set_squash_depth( 3 );
+
+      account_balance_id_type id;
+      {
+         auto session = db._undo_db.start_undo_session();
+         id = db.create<account_balance_object>( []( account_balance_object& ){} ).id;
+         session.commit();
+      }
+      for( int64_t i = 1; i <= 10; ++i )
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.modify( id(db), [i]( account_balance_object& obj ){ obj.balance = i; } );
+         session.commit();
+      }
+
+      // the sessions before the newest three were squashed into the oldest state as they went past them
+      BOOST_CHECK_EQUAL( db._undo_db.size(), 11u );
+      const auto usage = db._undo_db.get_memory_usage();
+      BOOST_REQUIRE_EQUAL( usage.states.size(), 5u );
+      BOOST_CHECK_EQUAL( usage.states[0].sessions, 7u );
+      BOOST_CHECK_EQUAL( usage.states[0].created_count, 1u );
+      BOOST_CHECK_EQUAL( usage.states[0].modified_count, 0u );
+      BOOST_CHECK_EQUAL( db._undo_db.unsquashed_size(), 4u );
+
+      for( int64_t i = 10; i > 6; --i )
+      {
+         BOOST_CHECK_EQUAL( id(db).balance.value, i );
+         db._undo_db.pop_commit();
+      }
+      BOOST_CHECK_EQUAL( id(db).balance.value, 6 );
+      BOOST_CHECK( db._undo_db.head_is_squashed() );
+      BOOST_CHECK_THROW( db._undo_db.pop_commit(), fc::exception );
+      BOOST_CHECK_EQUAL( id(db).balance.value, 6 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( balances_by_account, database_fixture )
+{
+   try {
+      const account_id_type alice_id = create_account("alice").id;
+      const account_id_type bob_id = create_account("bob").id;
+      const asset_id_type core_id;
+      const auto& balances = db.balances_by_account();
+
+      BOOST_CHECK( balances.find( alice_id, core_id ) == nullptr );
+      transfer( account_id_type(), alice_id, asset(100) );
+      transfer( account_id_type(), bob_id, asset(300) );
+      BOOST_REQUIRE( balances.find( alice_id, core_id ) != nullptr );
+      BOOST_CHECK_EQUAL( balances.find( alice_id, core_id )->balance.value, 100 );
+      BOOST_CHECK_EQUAL( balances.get_account_balances( bob_id ).size(), 1 );
+
+      auto holder_position = [&]( account_id_type account ) {
+         const auto& holders = balances.get_asset_holders( core_id );
+         for( size_t i = 0; i < holders.size(); ++i )
+            if( holders[i]->owner == account )
+               return i;
+         return holders.size();
+      };
+      BOOST_CHECK_LT( holder_position( bob_id ), holder_position( alice_id ) );
+
+      // the holders are sorted again after a balance changes
+      transfer( account_id_type(), alice_id, asset(400) );
+      BOOST_CHECK_LT( holder_position( alice_id ), holder_position( bob_id ) );
+
+      // the top holders are read without sorting the changed balances back in, and agree with the sorted order
+      transfer( account_id_type(), bob_id, asset(500) );
+      const auto top = balances.get_top_holders( core_id, 2 );
+      const auto& holders = balances.get_asset_holders( core_id );
+      BOOST_REQUIRE_EQUAL( top.size(), 2 );
+      BOOST_CHECK( top[0] == holders[0] );
+      BOOST_CHECK( top[1] == holders[1] );
+      BOOST_CHECK_EQUAL( balances.get_top_holders( core_id, holders.size() + 5 ).size(), holders.size() );
+
+      // a balance created in an undone session is forgotten
+      const account_id_type carol_id = create_account("carol").id;
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.adjust_balance( carol_id, asset(50) );
+         BOOST_CHECK( balances.find( carol_id, core_id ) != nullptr );
+      }
+      BOOST_CHECK( balances.find( carol_id, core_id ) == nullptr );
+      BOOST_CHECK_EQUAL( holder_position( carol_id ), balances.get_asset_holders( core_id ).size() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( asset_lookups, database_fixture )
+{
+   try {
+      const asset_object& usd = create_bitasset( "USDBIT" );
+      const asset_id_type usd_id = usd.id;
+
+      BOOST_CHECK( &db.get_asset( usd_id ) == &usd_id(db) );
+      BOOST_CHECK( &db.get_dynamic_data( usd ) == &usd.dynamic_asset_data_id(db) );
+      BOOST_CHECK( &db.get_bitasset_data( usd ) == &usd.bitasset_data(db) );
+      BOOST_CHECK( &db.get_dynamic_data( db.get_asset( asset_id_type() ) ) == &asset_id_type()(db).dynamic_asset_data_id(db) );
+      GRAPHENE_REQUIRE_THROW( db.get_bitasset_data( db.get_asset( asset_id_type() ) ), fc::exception );
+      BOOST_CHECK( db.asset_symbols().find( "USDBIT" ) == &usd );
+      BOOST_CHECK( db.asset_symbols().find( "USD" ) == nullptr );
+
+      // an asset created in an undone session can't be looked up any more
+      asset_id_type undone_id;
+      {
+         auto session = db._undo_db.start_undo_session();
+         undone_id = db.create<asset_object>( [&]( asset_object& a ) {
+            a.symbol = "UNDONE";
+            a.dynamic_asset_data_id = usd.dynamic_asset_data_id;
+         } ).id;
+         BOOST_CHECK( db.get_asset( undone_id ).symbol == "UNDONE" );
+         BOOST_CHECK( db.asset_symbols().find( "UNDONE" ) == &db.get_asset( undone_id ) );
+      }
+      GRAPHENE_REQUIRE_THROW( db.get_asset( undone_id ), fc::exception );
+      BOOST_CHECK( db.asset_symbols().find( "UNDONE" ) == nullptr );
+      BOOST_CHECK( db.get_asset( usd_id ).symbol == "USDBIT" );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( account_name_lookups, database_fixture )
+{
+   try {
+      const account_object& alice = create_account("alice");
+      const auto& names = db.account_names();
+      BOOST_CHECK( names.find( "alice" ) == &alice );
+      BOOST_CHECK( names.find( "alic" ) == nullptr );
+      BOOST_CHECK( names.find( GRAPHENE_TEMP_ACCOUNT(db).name ) == &GRAPHENE_TEMP_ACCOUNT(db) );
+      BOOST_CHECK_EQUAL( names.size(), db.get_index_type<account_index>().indices().size() );
+
+      // the lookup follows a rename, and the undo of it
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.modify( alice, []( account_object& a ) { a.name = "alice-renamed"; } );
+         BOOST_CHECK( names.find( "alice" ) == nullptr );
+         BOOST_CHECK( names.find( "alice-renamed" ) == &alice );
+      }
+      BOOST_CHECK( names.find( "alice" ) == &alice );
+      BOOST_CHECK( names.find( "alice-renamed" ) == nullptr );
+
+      // an account can't be created with a name taken
+      GRAPHENE_REQUIRE_THROW( create_account("alice"), fc::exception );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( supply_totals, database_fixture )
+{
+   try {
+      ACTORS( (alice) );
+      transfer( account_id_type(), alice_id, asset(10000) );
+      db.verify_supply_totals();
+
+      // core in an order, and in fees not paid out yet
+      const asset_id_type test_id = create_user_issued_asset( "TEST" ).id;
+      BOOST_REQUIRE( create_sell_order( alice_id, asset(500), asset(500, test_id) ) != nullptr );
+      db.verify_supply_totals();
+
+      // a balance changed without the supply is found, and undoing the change puts the totals back
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.adjust_balance( alice_id, asset(1) );
+         GRAPHENE_REQUIRE_THROW( db.verify_supply_totals(), fc::exception );
+      }
+      db.verify_supply_totals();
+
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.modify( alice.statistics(db), []( account_statistics_object& s ) { s.total_core_in_orders += 1; } );
+         GRAPHENE_REQUIRE_THROW( db.verify_supply_totals(), fc::exception );
+      }
+      db.verify_supply_totals();
+
+      db.set_supply_checks( true );
+      generate_block();
+      db.verify_supply_totals();
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( object_versions, database_fixture )
+{
+   try {
+      const account_object& alice = create_account( "alice" );
+      const account_object& bob = create_account( "bob" );
+      const uint64_t created = alice.id(db).version;
+      BOOST_CHECK_NE( created, 0u );
+      BOOST_CHECK_NE( created, bob.version );
+
+      // only the modified object changes version
+      const uint64_t bob_version = bob.version;
+      db.modify( alice, [&]( account_object& a ) { a.name = "alice2"; } );
+      const uint64_t modified = alice.version;
+      BOOST_CHECK_GT( modified, created );
+      BOOST_CHECK_EQUAL( bob.version, bob_version );
+
+      // undoing a change is a change too
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.modify( alice, [&]( account_object& a ) { a.name = "alice3"; } );
+         BOOST_CHECK_GT( alice.version, modified );
+      }
+      BOOST_CHECK_EQUAL( alice.name, "alice2" );
+      BOOST_CHECK_NE( alice.version, modified );
+
+      // copies keep the version of the value they copied
+      BOOST_CHECK_EQUAL( alice.clone()->version, alice.version );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( object_changes_without_undo )
+{
+   try {
+      database db;
+      db._undo_db.disable();
+      db.take_object_changes();
+
+      auto has = []( const vector<object_id_type>& ids, object_id_type id ) {
+         return std::find( ids.begin(), ids.end(), id ) != ids.end();
+      };
+
+      const auto& kept = db.create<account_object>( [&]( account_object& obj ) { obj.name = "kept"; } );
+      const auto& gone = db.create<account_object>( [&]( account_object& obj ) { obj.name = "gone"; } );
+      const object_id_type kept_id = kept.id;
+      const object_id_type gone_id = gone.id;
+      db.remove( gone );
+      auto changes = db.take_object_changes();
+      BOOST_CHECK( has( changes.created, kept_id ) );
+      BOOST_CHECK( !has( changes.created, gone_id ) );
+      BOOST_CHECK( changes.removed.empty() );
+
+      db.modify( kept, [&]( account_object& obj ) { obj.name = "modified"; } );
+      changes = db.take_object_changes();
+      BOOST_CHECK( changes.created.empty() );
+      BOOST_CHECK( has( changes.modified, kept_id ) );
+
+      // a removed object is reported with its last value
+      db.remove( kept );
+      changes = db.take_object_changes();
+      BOOST_CHECK( changes.modified.empty() );
+      BOOST_REQUIRE_EQUAL( changes.removed.size(), 1u );
+      BOOST_CHECK_EQUAL( static_cast<const account_object&>( *changes.removed[kept_id] ).name, "modified" );
+
+      // nothing changed since
+      changes = db.take_object_changes();
+      BOOST_CHECK( changes.created.empty() && changes.modified.empty() && changes.removed.empty() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( state_digest, database_fixture )
+{
+   try {
+      db.set_state_digest_blocks( 3 );
+      // a maintained digest always equals the digest hashed from scratch
+      auto check_digest = [&]() {
+         const auto maintained = db.get_digest();
+         db.set_maintain_digests( false );
+         const auto hashed = db.get_digest();
+         db.set_maintain_digests( true );
+         BOOST_REQUIRE_EQUAL( maintained.indexes.size(), hashed.indexes.size() );
+         for( size_t i = 0; i < hashed.indexes.size(); ++i )
+            BOOST_CHECK( maintained.indexes[i].digest == hashed.indexes[i].digest );
+         BOOST_CHECK( maintained.digest == hashed.digest );
+      };
+
+      const auto before = db.get_digest();
+      const account_id_type alice_id = create_account("alice").id;
+      transfer( account_id_type(), alice_id, asset(100) );
+      check_digest();
+      BOOST_CHECK( db.get_digest().digest != before.digest );
+
+      generate_block();
+      const uint32_t first = db.head_block_num();
+      transfer( account_id_type(), alice_id, asset(50) );
+      generate_block();
+      check_digest();
+      auto recorded = db.get_state_digest( first + 1 );
+      BOOST_REQUIRE( recorded.valid() );
+      BOOST_CHECK( recorded->block_id == db.head_block_id() );
+      BOOST_CHECK( recorded->state.digest == db.get_digest().digest );
+
+      // undoing the block restores the digest recorded for the one before
+      const auto first_digest = db.get_state_digest( first );
+      BOOST_REQUIRE( first_digest.valid() );
+      db.pop_block();
+      db.clear_pending();
+      check_digest();
+      BOOST_CHECK( db.get_digest().digest == first_digest->state.digest );
+      BOOST_CHECK( !db.get_state_digest( first + 1 ).valid() );
+
+      // only the last three blocks are kept
+      generate_blocks( 4 );
+      BOOST_CHECK( !db.get_state_digest( first ).valid() );
+      BOOST_CHECK( db.get_state_digest( db.head_block_num() - 2 ).valid() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( debug_import_objects, database_fixture )
+{
+   try {
+      const account_id_type alice_id = create_account("alice").id;
+      const account_id_type bob_id = create_account("bob").id;
+      transfer( account_id_type(), alice_id, asset(100) );
+      generate_block();
+      // the import goes into this block
+      generate_block();
+
+      const auto& balance_idx = db.get_index( account_balance_object::space_id, account_balance_object::type_id );
+      const object_id_type next_id = balance_idx.get_next_id();
+      const auto& balances = db.balances_by_account();
+
+      // one record replaces alice's balance, the other creates one for bob past the next id
+      account_balance_object alice_balance = *balances.find( alice_id, asset_id_type() );
+      alice_balance.balance = 777;
+      account_balance_object bob_balance;
+      bob_balance.id = next_id + 5;
+      bob_balance.owner = bob_id;
+      bob_balance.balance = 50;
+
+      fc::temp_directory dir( graphene::utilities::temp_directory_path() );
+      const fc::path file = dir.path() / "objects";
+      {
+         std::ofstream out( file.generic_string(), std::ios::out | std::ios::binary );
+         for( const account_balance_object* b : { &alice_balance, &bob_balance } )
+         {
+            fc::raw::pack( out, b->id );
+            fc::raw::pack( out, fc::raw::pack( *b ) );
+         }
+      }
+
+      const uint32_t head_num = db.head_block_num();
+      db.debug_update( fc::mutable_variant_object( "_action", "import" )( "file", file.generic_string() ) );
+      BOOST_CHECK_EQUAL( db.head_block_num(), head_num );
+      BOOST_CHECK_EQUAL( balances.find( alice_id, asset_id_type() )->balance.value, 777 );
+      BOOST_REQUIRE( balances.find( bob_id, asset_id_type() ) != nullptr );
+      BOOST_CHECK( balances.find( bob_id, asset_id_type() )->id == bob_balance.id );
+      BOOST_CHECK( balance_idx.get_next_id() == bob_balance.id + 1 );
+
+      // the import is part of the head block, popping it undoes the import along with everything else
+      db.pop_block();
+      BOOST_CHECK_EQUAL( balances.find( alice_id, asset_id_type() )->balance.value, 100 );
+      BOOST_CHECK( balances.find( bob_id, asset_id_type() ) == nullptr );
+      BOOST_CHECK( balance_idx.get_next_id() == next_id );
+   }
+   catch( fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( apply_profiling, database_fixture )
+{
+   try {
+      BOOST_CHECK( db.get_apply_profile().operations.empty() );
+      db.set_apply_profiling( true );
+
+      const account_id_type alice_id = create_account("alice").id;
+      transfer( account_id_type(), alice_id, asset(100) );
+      generate_block();
+
+      const apply_profile profile = db.get_apply_profile();
+      BOOST_REQUIRE_EQUAL( profile.operations.size(), operation::count() );
+      const operation_profile& transfers = profile.operations[ operation::tag<transfer_operation>::value ];
+      const operation_profile& creations = profile.operations[ operation::tag<account_create_operation>::value ];
+      // pushed as pending transactions, and applied again in the block unless it was built on top of them
+      BOOST_CHECK_GE( transfers.count, 1 );
+      BOOST_CHECK_GE( creations.count, 1 );
+      // the account and its statistics
+      BOOST_CHECK_GE( creations.objects_created, 2 * creations.count );
+      BOOST_CHECK_GT( transfers.objects_modified, 0 );
+      BOOST_CHECK_LE( transfers.max_apply_time, transfers.apply_time );
+
+      BOOST_REQUIRE_EQUAL( profile.recent_blocks.size(), 1 );
+      BOOST_CHECK_EQUAL( profile.recent_blocks[0].block_num, db.head_block_num() );
+      BOOST_CHECK_EQUAL( profile.recent_blocks[0].transaction_count, 2 );
+      BOOST_CHECK_EQUAL( profile.block_totals.block_num, 1 );
+      BOOST_CHECK_GE( profile.block_totals.total_time, profile.block_totals.transaction_time );
+
+      db.set_apply_profiling( false );
+      generate_block();
+      BOOST_CHECK( db.get_apply_profile().recent_blocks.empty() );
+   }
+   catch( fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( memory_usage, database_fixture )
+{
+   try {
+      auto accounts_of = []( const graphene::db::object_database_memory_usage& usage ) -> graphene::db::index_memory_usage {
+         for( const auto& idx : usage.indexes )
+            if( idx.space_id == protocol_ids && idx.type_id == account_object_type )
+               return idx;
+         FC_THROW( "No account index" );
+      };
+
+      const auto before = db.get_memory_usage();
+      const auto accounts_before = accounts_of( before );
+      BOOST_CHECK_EQUAL( accounts_before.object_count, db.get_index_type<account_index>().indices().size() );
+
+      create_account( "alice" );
+
+      const auto after = db.get_memory_usage();
+      const auto accounts_after = accounts_of( after );
+      BOOST_CHECK_EQUAL( accounts_after.object_count, accounts_before.object_count + 1 );
+      BOOST_CHECK_EQUAL( accounts_after.object_bytes, accounts_after.object_count * sizeof(account_object) );
+      BOOST_CHECK_GT( accounts_after.index_bytes, 0 );
+      BOOST_CHECK_EQUAL( accounts_after.secondary_index_count, 3 );
+      BOOST_CHECK_EQUAL( accounts_after.total_bytes,
+                         accounts_after.object_bytes + accounts_after.index_bytes + accounts_after.tracking_bytes );
+
+      // the account and its statistics are undone with the pending transactions
+      BOOST_REQUIRE_EQUAL( after.undo.states.size(), db._undo_db.size() );
+      uint64_t created = 0;
+      uint64_t undo_bytes = after.undo.spare_arena_bytes;
+      for( const auto& state : after.undo.states )
+      {
+         created += state.created_count;
+         undo_bytes += state.total_bytes;
+      }
+      BOOST_CHECK_GE( created, 2 );
+      BOOST_CHECK_EQUAL( after.undo.total_bytes, undo_bytes );
+
+      uint64_t total = after.undo.total_bytes;
+      for( const auto& idx : after.indexes )
+         total += idx.total_bytes;
+      BOOST_CHECK_EQUAL( after.total_bytes, total );
+   }
+   catch( fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( slab_index_frees_empty_chunks )
+{
+   try {
+      database db;
+      auto& idx = *db.add_index< primary_index< slab_index< operation_history_object, 4 > > >();
+      auto insert = [&idx]( uint64_t instance ) -> const operation_history_object& {
+         operation_history_object op;
+         op.id = operation_history_id_type( instance );
+         op.block_num = uint32_t( instance );
+         return static_cast<const operation_history_object&>( idx.insert( std::move( op ) ) );
+      };
+      auto instances = [&idx]() {
+         vector<uint64_t> result;
+         for( const operation_history_object& op : idx )
+            result.push_back( op.id.instance() );
+         return result;
+      };
+
+      for( uint64_t i = 0; i < 12; ++i )
+         insert( i );
+      const index_memory_usage full = idx.get_memory_usage();
+      BOOST_CHECK_EQUAL( full.object_count, 12u );
+
+      // emptying the first chunk frees it, a partly used chunk stays
+      for( uint64_t i = 0; i < 4; ++i )
+         idx.remove( *idx.find( operation_history_id_type( i ) ) );
+      idx.remove( *idx.find( operation_history_id_type( 5 ) ) );
+      const index_memory_usage pruned = idx.get_memory_usage();
+      BOOST_CHECK_EQUAL( pruned.object_count, 7u );
+      BOOST_CHECK_LT( pruned.object_bytes + pruned.index_bytes, full.object_bytes + full.index_bytes );
+      BOOST_CHECK( idx.find( operation_history_id_type( 2 ) ) == nullptr );
+      BOOST_CHECK( idx.find( operation_history_id_type( 5 ) ) == nullptr );
+      BOOST_CHECK( idx.find( operation_history_id_type( 4 ) ) != nullptr );
+      BOOST_CHECK( instances() == vector<uint64_t>( { 4, 6, 7, 8, 9, 10, 11 } ) );
+      BOOST_CHECK_EQUAL( idx.size(), 12u );
+
+      // a freed chunk is allocated again when one of its instances comes back
+      BOOST_CHECK_EQUAL( insert( 1 ).block_num, 1u );
+      BOOST_CHECK( idx.find( operation_history_id_type( 1 ) ) != nullptr );
+      BOOST_CHECK( idx.find( operation_history_id_type( 0 ) ) == nullptr );
+      BOOST_CHECK( instances() == vector<uint64_t>( { 1, 4, 6, 7, 8, 9, 10, 11 } ) );
+
+      // removing the highest objects shrinks the index past the freed chunks
+      for( uint64_t i = 4; i < 12; ++i )
+         if( idx.find( operation_history_id_type( i ) ) != nullptr )
+            idx.remove( *idx.find( operation_history_id_type( i ) ) );
+      BOOST_CHECK_EQUAL( idx.size(), 2u );
+      BOOST_CHECK( instances() == vector<uint64_t>( { 1 } ) );
+      BOOST_CHECK_EQUAL( idx.get_memory_usage().object_count, 1u );
+   }
+   catch( fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
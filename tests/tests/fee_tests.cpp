@@ -78,6 +78,31 @@ BOOST_AUTO_TEST_CASE( nonzero_fee_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( fee_schedule_lookup )
+{
+   fee_schedule schedule = fee_schedule::get_default();
+   const int transfer_tag = operation::tag<transfer_operation>::value;
+   const int order_tag = operation::tag<limit_order_create_operation>::value;
+   BOOST_REQUIRE( schedule.find_parameters( order_tag ) != nullptr );
+   BOOST_CHECK_EQUAL( schedule.find_parameters( order_tag )->which(), order_tag );
+   BOOST_CHECK( schedule.find_parameters( fee_parameters().count() ) == nullptr );
+
+   // with a tag missing the others are no longer at their positions, and are still found
+   fee_parameters transfer_params; transfer_params.set_which( transfer_tag );
+   schedule.parameters.erase( transfer_params );
+   BOOST_CHECK( schedule.find_parameters( transfer_tag ) == nullptr );
+   BOOST_REQUIRE( schedule.find_parameters( order_tag ) != nullptr );
+   BOOST_CHECK_EQUAL( schedule.find_parameters( order_tag )->which(), order_tag );
+   BOOST_CHECK_EQUAL( schedule.get<limit_order_create_operation>().fee,
+                      limit_order_create_operation::fee_parameters_type().fee );
+   GRAPHENE_REQUIRE_THROW( schedule.get<transfer_operation>(), fc::exception );
+
+   // operations without parameters are charged the default fee
+   transfer_operation top;
+   BOOST_CHECK_EQUAL( schedule.calculate_fee( top ).amount.value,
+                      fee_schedule::get_default().calculate_fee( top ).amount.value );
+}
+
 BOOST_AUTO_TEST_CASE(asset_claim_fees_test)
 {
    try
@@ -572,6 +597,144 @@ REG : net' ltm' ref'
 
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( batched_cashback_matches_single_deposits )
+{ try {
+   ACTOR(life);
+   ACTOR(rog);
+   transfer(account_id_type(), life_id, asset(100000000));
+   transfer(account_id_type(), rog_id, asset(100000000));
+   upgrade_to_lifetime_member(life_id);
+   upgrade_to_lifetime_member(rog_id);
+   generate_block();
+
+   // what the fee payout of a maintenance reads, taken before it
+   struct payout_inputs
+   {
+      vector< std::pair< account_object, account_statistics_object > > accounts;
+      std::map< account_id_type, vesting_balance_object >                cashback;
+   };
+   auto take_inputs = [&]() {
+      payout_inputs in;
+      for( const account_object& a : db.get_index_type<account_index>().indices().get<by_name>() )
+      {
+         in.accounts.emplace_back( a, a.statistics(db) );
+         if( a.cashback_vb.valid() )
+            in.cashback.emplace( a.id, (*a.cashback_vb)(db) );
+      }
+      return in;
+   };
+
+   // the payout the way it was done before it was batched: each cut goes straight into the recipient's vesting
+   // balance, which the first cut creates, in the order of the payers' names
+   struct payout
+   {
+      std::map< account_id_type, vesting_balance_object > cashback;
+      vector< account_id_type >                           created;
+   };
+   auto old_payout = [&]( const payout_inputs& in ) {
+      payout out;
+      out.cashback = in.cashback;
+      const fc::time_point_sec now = db.head_block_time();
+      const uint32_t vesting_seconds = db.get_global_properties().parameters.cashback_vesting_period_seconds;
+      auto deposit = [&]( account_id_type to, share_type amount, bool require_vesting ) {
+         if( amount == 0 || to == GRAPHENE_COMMITTEE_ACCOUNT || to == GRAPHENE_WITNESS_ACCOUNT ||
+             to == GRAPHENE_RELAXED_COMMITTEE_ACCOUNT || to == GRAPHENE_NULL_ACCOUNT || to == GRAPHENE_TEMP_ACCOUNT )
+            return;
+         auto itr = out.cashback.find( to );
+         if( itr != out.cashback.end() )
+         {
+            if( require_vesting )
+               itr->second.deposit( now, amount );
+            else
+               itr->second.deposit_vested( now, amount );
+            return;
+         }
+         vesting_balance_object vbo;
+         vbo.owner = to;
+         vbo.balance = amount;
+         cdd_vesting_policy policy;
+         policy.vesting_seconds = vesting_seconds;
+         policy.coin_seconds_earned = require_vesting ? 0 : amount.value * policy.vesting_seconds;
+         policy.coin_seconds_earned_last_update = now;
+         vbo.policy = policy;
+         out.cashback.emplace( to, vbo );
+         out.created.push_back( to );
+      };
+      auto pay_out_fees = [&]( const account_object& account, share_type core_fee_total, bool require_vesting ) {
+         share_type network_cut = pct( account.network_fee_percentage, core_fee_total.value );
+         share_type lifetime_cut = pct( account.lifetime_referrer_fee_percentage, core_fee_total.value );
+         share_type referral = core_fee_total - network_cut - lifetime_cut;
+         share_type referrer_cut = pct( account.referrer_rewards_percentage, referral.value );
+         deposit( account.lifetime_referrer, lifetime_cut, require_vesting );
+         deposit( account.referrer, referrer_cut, require_vesting );
+         deposit( account.registrar, referral - referrer_cut, require_vesting );
+      };
+      for( const auto& a : in.accounts )
+      {
+         pay_out_fees( a.first, a.second.pending_fees, true );
+         pay_out_fees( a.first, a.second.pending_vested_fees, false );
+      }
+      return out;
+   };
+
+   auto check_payout = [&]( const payout& expected ) {
+      for( const auto& e : expected.cashback )
+      {
+         const account_object& a = e.first(db);
+         BOOST_REQUIRE( a.cashback_vb.valid() );
+         const vesting_balance_object& actual = (*a.cashback_vb)(db);
+         BOOST_CHECK( actual.owner == e.second.owner );
+         BOOST_CHECK_EQUAL( actual.balance.amount.value, e.second.balance.amount.value );
+         const cdd_vesting_policy& actual_policy = actual.policy.get<cdd_vesting_policy>();
+         const cdd_vesting_policy& expected_policy = e.second.policy.get<cdd_vesting_policy>();
+         BOOST_CHECK_EQUAL( actual_policy.vesting_seconds, expected_policy.vesting_seconds );
+         BOOST_CHECK( actual_policy.coin_seconds_earned == expected_policy.coin_seconds_earned );
+         BOOST_CHECK( actual_policy.coin_seconds_earned_last_update == expected_policy.coin_seconds_earned_last_update );
+      }
+      // new vesting balances get their ids in the order the recipients first got cashback
+      for( size_t i = 1; i < expected.created.size(); ++i )
+         BOOST_CHECK( *expected.created[i-1](db).cashback_vb < *expected.created[i](db).cashback_vb );
+   };
+   auto pay_out_at_maintenance = [&]() {
+      generate_block();
+      const payout_inputs in = take_inputs();
+      const fc::time_point_sec maintenance_time = db.get_dynamic_global_properties().next_maintenance_time;
+      generate_blocks( maintenance_time );
+      BOOST_REQUIRE( db.get_dynamic_global_properties().next_maintenance_time > maintenance_time );
+      check_payout( old_payout( in ) );
+   };
+
+   // the fees of each account are cut between its registrar, referrer and lifetime referrer
+   enable_fees();
+   auto register_account = [&]( const string& name, const account_object& registrar, const account_object& referrer ) {
+      account_create_operation op = make_account( name, registrar, referrer );
+      op.referrer_percent = 60 * GRAPHENE_1_PERCENT;
+      op.fee = db.current_fee_schedule().calculate_fee( op );
+      set_expiration( db, trx );
+      trx.operations = { op };
+      const account_id_type id = PUSH_TX( db, trx, ~0 ).operation_results.front().get<object_id_type>();
+      trx.clear();
+      transfer( account_id_type(), id, asset(10000000) );
+      return id;
+   };
+   const account_id_type ann_id = register_account( "ann", life_id(db), life_id(db) );
+   const account_id_type dumy_id = register_account( "dumy", rog_id(db), life_id(db) );
+   upgrade_to_annual_member( ann_id );
+   const account_id_type stud_id = register_account( "stud", rog_id(db), ann_id(db) );
+   transfer( dumy_id, stud_id, asset(1000) );
+   transfer( stud_id, ann_id, asset(1000) );
+   transfer( life_id, dumy_id, asset(1000) );
+   pay_out_at_maintenance();
+
+   // this time into the vesting balances the last payout created
+   enable_fees();
+   transfer( ann_id, rog_id, asset(1000) );
+   transfer( stud_id, dumy_id, asset(1000) );
+   transfer( dumy_id, life_id, asset(1000) );
+   upgrade_to_lifetime_member( stud_id );
+   pay_out_at_maintenance();
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( account_create_fee_scaling )
 { try {
    auto accounts_per_scale = db.get_global_properties().parameters.accounts_per_fee_scale;
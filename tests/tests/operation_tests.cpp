@@ -24,6 +24,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <graphene/app/api.hpp>
+
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/exceptions.hpp>
 #include <graphene/chain/hardfork.hpp>
@@ -36,6 +38,8 @@
 #include <graphene/chain/withdraw_permission_object.hpp>
 #include <graphene/chain/witness_object.hpp>
 
+#include <graphene/market_history/market_history_plugin.hpp>
+
 #include <fc/crypto/digest.hpp>
 
 #include "../common/database_fixture.hpp"
@@ -75,6 +79,39 @@ BOOST_AUTO_TEST_CASE( feed_limit_logic_test )
       throw;
    }
 }
+BOOST_AUTO_TEST_CASE( feed_expiration_schedule )
+{
+   try {
+      ACTORS((sam));
+      const auto& bitusd = create_bitasset("USDBIT", sam.id);
+      const auto& core   = asset_id_type()(db);
+      update_feed_producers( bitusd, {sam.id} );
+      generate_block();
+
+      price_feed current_feed;
+      current_feed.settlement_price = bitusd.amount( 100 ) / core.amount( 100 );
+      current_feed.core_exchange_rate = bitusd.amount( 1 ) / core.amount( 2 );
+      publish_feed( bitusd, sam, current_feed );
+      BOOST_CHECK( bitusd.options.core_exchange_rate != current_feed.core_exchange_rate );
+
+      // the rate is copied by the next block, as the bitasset changed
+      generate_block();
+      BOOST_CHECK( bitusd.options.core_exchange_rate == current_feed.core_exchange_rate );
+      BOOST_CHECK( bitusd.bitasset_data(db).current_feed.settlement_price == current_feed.settlement_price );
+
+      // and the feed is dropped by the first block after it expires
+      const fc::time_point_sec expiration = bitusd.bitasset_data(db).feed_expiration_time();
+      const uint8_t block_interval = db.get_global_properties().parameters.block_interval;
+      generate_blocks( expiration - block_interval );
+      BOOST_CHECK( !bitusd.bitasset_data(db).current_feed.settlement_price.is_null() );
+      generate_blocks( expiration + block_interval );
+      BOOST_CHECK( bitusd.bitasset_data(db).current_feed.settlement_price.is_null() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( call_order_update_test )
 {
    try {
@@ -1815,6 +1852,440 @@ BOOST_AUTO_TEST_CASE( vesting_balance_withdraw_test )
    // TODO:  Test with non-core asset and Bob account
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( vesting_balance_batch_test )
+{ try {
+   generate_block();
+   const fc::time_point_sec now = db.head_block_time();
+
+   vector<const vesting_balance_object*> balances;
+   for( uint32_t i = 0; i < 20; ++i )
+   {
+      balances.push_back( &db.create<vesting_balance_object>( [&]( vesting_balance_object& vbo ) {
+         vbo.owner = account_id_type();
+         vbo.balance = asset( 1000 + i );
+         if( i % 3 == 0 )
+         {
+            linear_vesting_policy policy;
+            policy.begin_timestamp = now - 10 * i;
+            policy.vesting_cliff_seconds = 20;
+            policy.vesting_duration_seconds = 100;
+            policy.begin_balance = 1000 + i;
+            vbo.policy = policy;
+         }
+         else
+         {
+            cdd_vesting_policy policy;
+            policy.vesting_seconds = 100;
+            policy.start_claim = now - 1;
+            policy.coin_seconds_earned_last_update = now - 7 * i;
+            vbo.policy = policy;
+         }
+      } ) );
+   }
+
+   const vector<asset> allowed = get_allowed_withdraws( balances, now );
+   const vector<fc::uint128_t> coin_seconds = get_coin_seconds_earned( balances, now );
+   BOOST_REQUIRE_EQUAL( allowed.size(), balances.size() );
+   BOOST_REQUIRE_EQUAL( coin_seconds.size(), balances.size() );
+   for( uint32_t i = 0; i < balances.size(); ++i )
+   {
+      BOOST_CHECK( allowed[i] == balances[i]->get_allowed_withdraw( now ) );
+      if( i % 3 == 0 )
+         BOOST_CHECK( coin_seconds[i] == 0 );
+      else
+         // capped at the balance times vesting_seconds, which the older ones have earned
+         BOOST_CHECK( coin_seconds[i] == fc::uint128_t( 1000 + i ) * std::min<uint32_t>( 7 * i, 100 ) );
+   }
+   BOOST_CHECK( get_allowed_withdraws( vector<const vesting_balance_object*>(), now ).empty() );
+} FC_LOG_AND_RETHROW() }
+
 // TODO:  Write linear VBO tests
 
+BOOST_AUTO_TEST_CASE( market_ticker )
+{ try {
+   using namespace graphene::market_history;
+   ACTORS( (buyer)(seller) );
+   const asset_object& tick = create_user_issued_asset( "TICK" );
+   const asset_id_type tick_id = tick.id;
+   fund( buyer, asset( 10000 ) );
+   issue_uia( seller, asset( 10000, tick_id ) );
+
+   auto get_ticker = [&]() {
+      const auto& idx = db.get_index_type<market_ticker_index>().indices().get<graphene::market_history::by_market>();
+      auto itr = idx.find( std::make_tuple( asset_id_type(), tick_id ) );
+      BOOST_REQUIRE( itr != idx.end() );
+      return *itr;
+   };
+
+   create_sell_order( seller_id, asset( 100, tick_id ), asset( 200 ) );
+   create_sell_order( buyer_id, asset( 200 ), asset( 100, tick_id ) );
+   generate_block();
+   create_sell_order( seller_id, asset( 100, tick_id ), asset( 300 ) );
+   create_sell_order( buyer_id, asset( 300 ), asset( 100, tick_id ) );
+   generate_block();
+
+   market_ticker_object t = get_ticker();
+   BOOST_CHECK_EQUAL( t.base_volume.value, 500 );
+   BOOST_CHECK_EQUAL( t.quote_volume.value, 200 );
+   BOOST_CHECK_EQUAL( t.latest_base.value, 300 );
+   BOOST_CHECK_EQUAL( t.latest_quote.value, 100 );
+   BOOST_CHECK_EQUAL( t.high_base.value, 300 );
+   BOOST_CHECK_EQUAL( t.low_base.value, 200 );
+   BOOST_CHECK_EQUAL( t.previous_base.value, 0 );
+   BOOST_CHECK( t.expiration != fc::time_point_sec::maximum() );
+
+   // a day later, without further trades, the volume has rolled out of the window
+   generate_blocks( db.head_block_time() + market_ticker_object::window_seconds + market_ticker_object::slot_seconds );
+   t = get_ticker();
+   BOOST_CHECK_EQUAL( t.base_volume.value, 0 );
+   BOOST_CHECK_EQUAL( t.quote_volume.value, 0 );
+   BOOST_CHECK( t.slots.empty() );
+   BOOST_CHECK_EQUAL( t.latest_base.value, 300 );
+   BOOST_CHECK_EQUAL( t.previous_base.value, 300 );
+   BOOST_CHECK( t.expiration == fc::time_point_sec::maximum() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( order_book_levels )
+{ try {
+   ACTORS( (buyer)(seller) );
+   const asset_object& book = create_user_issued_asset( "BOOK" );
+   const asset_id_type book_id = book.id;
+   fund( buyer, asset( 10000 ) );
+   issue_uia( seller, asset( 10000, book_id ) );
+
+   // fetched each time, which delivers the modifications the index defers
+   auto levels = [&]() -> const limit_order_book_index::level_map& {
+      return dynamic_cast<const primary_index<limit_order_index>&>( db.get_index_type<limit_order_index>() )
+         .get_secondary_index<limit_order_book_index>().levels();
+   };
+   auto level_at = [&]( const price& p ) -> const order_book_level* {
+      auto itr = levels().find( p );
+      return itr == levels().end() ? nullptr : &itr->second;
+   };
+
+   // 2:1 and 4:2 are the same level
+   create_sell_order( seller_id, asset( 100, book_id ), asset( 200 ) );
+   const limit_order_object* second = create_sell_order( seller_id, asset( 200, book_id ), asset( 400 ) );
+   create_sell_order( seller_id, asset( 100, book_id ), asset( 300 ) );
+   BOOST_CHECK_EQUAL( levels().size(), 2u );
+   const order_book_level* best = level_at( asset( 1, book_id ) / asset( 2 ) );
+   BOOST_REQUIRE( best != nullptr );
+   BOOST_CHECK_EQUAL( best->for_sale.value, 300 );
+   BOOST_CHECK_EQUAL( best->order_count, 2u );
+
+   // undoing a removal puts the order back in its level
+   {
+      auto session = db._undo_db.start_undo_session();
+      db.remove( *second );
+      BOOST_CHECK_EQUAL( level_at( asset( 1, book_id ) / asset( 2 ) )->for_sale.value, 100 );
+   }
+   best = level_at( asset( 1, book_id ) / asset( 2 ) );
+   BOOST_REQUIRE( best != nullptr );
+   BOOST_CHECK_EQUAL( best->for_sale.value, 300 );
+
+   // a partial fill shrinks the level, a full one removes it
+   create_sell_order( buyer_id, asset( 100 ), asset( 50, book_id ) );
+   best = level_at( asset( 1, book_id ) / asset( 2 ) );
+   BOOST_REQUIRE( best != nullptr );
+   BOOST_CHECK_EQUAL( best->for_sale.value, 250 );
+   create_sell_order( buyer_id, asset( 500 ), asset( 250, book_id ) );
+   BOOST_CHECK( level_at( asset( 1, book_id ) / asset( 2 ) ) == nullptr );
+   BOOST_CHECK_EQUAL( levels().size(), 1u );
+
+   // any change to the market bumps its revision, which is what market data subscriptions poll
+   auto revision = [&]() {
+      levels();
+      return dynamic_cast<const primary_index<limit_order_index>&>( db.get_index_type<limit_order_index>() )
+         .get_secondary_index<limit_order_book_index>().market_revision( std::make_pair( asset_id_type(), book_id ) );
+   };
+   const uint64_t before = revision();
+   BOOST_CHECK( before > 0 );
+   create_sell_order( buyer_id, asset( 10 ), asset( 1, book_id ) );
+   BOOST_CHECK( revision() > before );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( order_book_matching_sides )
+{ try {
+   ACTORS( (buyer)(seller) );
+   const asset_id_type book_id = create_user_issued_asset( "BOOK" ).id;
+   const asset_id_type other_id = create_user_issued_asset( "OTHER" ).id;
+   fund( buyer, asset( 100000 ) );
+   issue_uia( seller, asset( 100000, book_id ) );
+   issue_uia( seller, asset( 100000, other_id ) );
+
+   // walking a side of the books gives the orders in the by_price order
+   auto check_side = [&]( asset_id_type sell, asset_id_type receive ) {
+      const auto& price_index = db.get_index_type<limit_order_index>().indices().get<by_price>();
+      vector<limit_order_id_type> expected;
+      for( auto itr = price_index.lower_bound( price::max( sell, receive ) ); itr != price_index.end() &&
+           itr->sell_price.base.asset_id == sell && itr->sell_price.quote.asset_id == receive; ++itr )
+         expected.push_back( itr->id );
+      vector<limit_order_id_type> walked;
+      for( const limit_order_object* o = db.limit_order_books().first( sell, receive ); o != nullptr;
+           o = db.limit_order_books().next( *o ) )
+         walked.push_back( o->id );
+      BOOST_CHECK( walked == expected );
+      return walked.size();
+   };
+
+   // several levels, 2:1 and 4:2 the same one, and an unrelated market in between
+   create_sell_order( seller_id, asset( 100, book_id ), asset( 300 ) );
+   const limit_order_object* second = create_sell_order( seller_id, asset( 100, book_id ), asset( 200 ) );
+   const limit_order_id_type second_id = second->id;
+   create_sell_order( seller_id, asset( 100, other_id ), asset( 200 ) );
+   create_sell_order( seller_id, asset( 200, book_id ), asset( 400 ) );
+   create_sell_order( seller_id, asset( 100, book_id ), asset( 250 ) );
+   create_sell_order( buyer_id, asset( 100 ), asset( 100, book_id ) );
+   BOOST_CHECK_EQUAL( check_side( book_id, asset_id_type() ), 4u );
+   BOOST_CHECK_EQUAL( check_side( asset_id_type(), book_id ), 1u );
+   BOOST_CHECK_EQUAL( check_side( other_id, asset_id_type() ), 1u );
+   BOOST_CHECK( db.limit_order_books().first( book_id, other_id ) == nullptr );
+   BOOST_CHECK( db.limit_order_books().first( book_id, asset_id_type() )->id == second_id );
+   const auto* levels = db.limit_order_books().find_side( book_id, asset_id_type() );
+   BOOST_REQUIRE( levels != nullptr );
+   BOOST_CHECK_EQUAL( levels->size(), 3u );
+   BOOST_CHECK_EQUAL( levels->back().orders.size(), 2u );
+
+   // undoing a removal puts the order back ahead of the younger one at its price
+   {
+      auto session = db._undo_db.start_undo_session();
+      db.remove( second_id( db ) );
+      BOOST_CHECK_EQUAL( check_side( book_id, asset_id_type() ), 3u );
+   }
+   BOOST_CHECK( db.limit_order_books().first( book_id, asset_id_type() )->id == second_id );
+   BOOST_CHECK_EQUAL( check_side( book_id, asset_id_type() ), 4u );
+
+   // a buy crossing the best level fills its oldest order first, and leaves the rest in order
+   create_sell_order( buyer_id, asset( 500 ), asset( 230, book_id ) );
+   BOOST_CHECK( db.find( second_id ) == nullptr );
+   BOOST_CHECK_EQUAL( check_side( book_id, asset_id_type() ), 3u );
+   BOOST_CHECK_EQUAL( db.limit_order_books().first( book_id, asset_id_type() )->for_sale.value, 50 );
+
+   // and one emptying the side removes it
+   create_sell_order( buyer_id, asset( 10000 ), asset( 170, book_id ) );
+   BOOST_CHECK( db.limit_order_books().find_side( book_id, asset_id_type() ) == nullptr );
+   BOOST_CHECK_EQUAL( check_side( asset_id_type(), book_id ), 2u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( market_fill_history_ring )
+{ try {
+   using graphene::market_history::market_fill_history;
+   market_fill_history history;
+   const asset_id_type other( 1 );
+   auto fill = [&]( uint32_t block_num, share_type amount ) {
+      fill_order_operation op;
+      op.pays = asset( amount );
+      op.receives = asset( amount, other );
+      history.start_block( block_num );
+      history.add_fill( block_num, fc::time_point_sec( block_num ), op );
+   };
+
+   const uint32_t n = market_fill_history::fills_per_market;
+   for( uint32_t i = 1; i <= n + 10; ++i )
+      fill( i, i );
+
+   // only the newest fills are kept, newest first, either way round
+   auto fills = history.get_fills( other, asset_id_type(), n + 10 );
+   BOOST_REQUIRE_EQUAL( fills.size(), n );
+   BOOST_CHECK_EQUAL( fills.front().op.pays.amount.value, n + 10 );
+   BOOST_CHECK_EQUAL( fills.back().op.pays.amount.value, 11 );
+   BOOST_CHECK_EQUAL( history.get_fills( asset_id_type(), other, 5 ).size(), 5u );
+
+   // a block applied again after a pop replaces the fills of the popped blocks
+   fill( n + 5, 1000 );
+   fills = history.get_fills( asset_id_type(), other, n );
+   BOOST_REQUIRE_EQUAL( fills.size(), n - 5 );
+   BOOST_CHECK_EQUAL( fills[0].op.pays.amount.value, 1000 );
+   BOOST_CHECK_EQUAL( fills[1].op.pays.amount.value, n + 4 );
+   BOOST_CHECK( fills[0].key.sequence < fills[1].key.sequence );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( taker_sweeps_several_makers )
+{ try {
+   ACTORS( (buyer)(maker1)(maker2) );
+   const asset_object& book = create_user_issued_asset( "SWEEP", maker1, charge_market_fee );
+   const asset_id_type book_id = book.id;
+   db.modify( book, [&]( asset_object& a ) { a.options.market_fee_percent = GRAPHENE_1_PERCENT; } );
+   fund( buyer, asset( 10000 ) );
+   issue_uia( maker1, asset( 200, book_id ) );
+   issue_uia( maker2, asset( 100, book_id ) );
+
+   create_sell_order( maker1_id, asset( 100, book_id ), asset( 200 ) );
+   create_sell_order( maker2_id, asset( 100, book_id ), asset( 200 ) );
+   create_sell_order( maker1_id, asset( 100, book_id ), asset( 200 ) );
+
+   // the balance and fee changes of all three fills are applied together once the taker is done
+   BOOST_CHECK( create_sell_order( buyer_id, asset( 600 ), asset( 300, book_id ) ) == nullptr );
+   BOOST_CHECK_EQUAL( get_balance( buyer_id, book_id ), 297 );
+   BOOST_CHECK_EQUAL( get_balance( buyer_id, asset_id_type() ), 9400 );
+   BOOST_CHECK_EQUAL( get_balance( maker1_id, asset_id_type() ), 400 );
+   BOOST_CHECK_EQUAL( get_balance( maker2_id, asset_id_type() ), 200 );
+   BOOST_CHECK_EQUAL( book_id(db).dynamic_asset_data_id(db).accumulated_fees.value, 3 );
+   BOOST_CHECK_EQUAL( buyer_id(db).statistics(db).total_core_in_orders.value, 0 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( market_stats )
+{ try {
+   using namespace graphene::market_history;
+   ACTORS( (buyer)(seller) );
+   const asset_object& stat = create_user_issued_asset( "STAT", seller, charge_market_fee );
+   const asset_id_type stat_id = stat.id;
+   db.modify( stat, [&]( asset_object& a ) { a.options.market_fee_percent = GRAPHENE_1_PERCENT; } );
+   fund( buyer, asset( 10000 ) );
+   issue_uia( seller, asset( 10000, stat_id ) );
+
+   create_sell_order( seller_id, asset( 100, stat_id ), asset( 200 ) );
+   create_sell_order( buyer_id, asset( 200 ), asset( 100, stat_id ) );
+   generate_block();
+   const uint32_t trade_block = db.head_block_num();
+
+   const auto& market_idx = db.get_index_type<market_stats_index>().indices().get<graphene::market_history::by_market>();
+   // nothing is counted until the block is irreversible
+   BOOST_CHECK( market_idx.find( std::make_tuple( asset_id_type(), stat_id ) ) == market_idx.end() );
+   for( int i = 0; i < 100 && db.get_dynamic_global_properties().last_irreversible_block_num < trade_block; ++i )
+      generate_block();
+   BOOST_REQUIRE( db.get_dynamic_global_properties().last_irreversible_block_num >= trade_block );
+
+   auto itr = market_idx.find( std::make_tuple( asset_id_type(), stat_id ) );
+   BOOST_REQUIRE( itr != market_idx.end() );
+   BOOST_CHECK_EQUAL( itr->base_volume.value, 200 );
+   BOOST_CHECK_EQUAL( itr->quote_volume.value, 100 );
+   BOOST_CHECK_EQUAL( itr->quote_market_fees.value, 1 );
+   BOOST_CHECK_EQUAL( itr->base_market_fees.value, 0 );
+   BOOST_CHECK_EQUAL( itr->trade_count, 1u );
+
+   const auto& asset_idx = db.get_index_type<asset_market_stats_index>().indices().get<by_asset>();
+   auto stat_itr = asset_idx.find( stat_id );
+   BOOST_REQUIRE( stat_itr != asset_idx.end() );
+   BOOST_CHECK_EQUAL( stat_itr->volume.value, 100 );
+   BOOST_CHECK_EQUAL( stat_itr->market_fees.value, 1 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( market_stats_pop_block )
+{ try {
+   using namespace graphene::market_history;
+   ACTORS( (buyer)(seller) );
+   const asset_object& stat = create_user_issued_asset( "STAT" );
+   const asset_id_type stat_id = stat.id;
+   fund( buyer, asset( 10000 ) );
+   issue_uia( seller, asset( 10000, stat_id ) );
+   generate_block();
+
+   const auto& market_idx = db.get_index_type<market_stats_index>().indices().get<graphene::market_history::by_market>();
+   const auto& bucket_idx = db.get_index_type<bucket_index>().indices().get<by_key>();
+   auto make_irreversible = [&]( uint32_t block_num ) {
+      for( int i = 0; i < 100 && db.get_dynamic_global_properties().last_irreversible_block_num < block_num; ++i )
+         generate_block();
+      BOOST_REQUIRE( db.get_dynamic_global_properties().last_irreversible_block_num >= block_num );
+   };
+   auto base_volume = [&]() -> int64_t {
+      auto itr = market_idx.find( std::make_tuple( asset_id_type(), stat_id ) );
+      return itr == market_idx.end() ? 0 : itr->base_volume.value;
+   };
+   auto bucket_volume = [&]() -> int64_t {
+      int64_t volume = 0;
+      for( auto itr = bucket_idx.lower_bound( bucket_key( asset_id_type(), stat_id, 15, fc::time_point_sec() ) );
+           itr != bucket_idx.end() && itr->key.base == asset_id_type() && itr->key.quote == stat_id
+              && itr->key.seconds == 15;
+           ++itr )
+         volume += itr->base_volume.value;
+      return volume;
+   };
+
+   // a block with a fill which is popped again is never counted
+   create_sell_order( seller_id, asset( 100, stat_id ), asset( 200 ) );
+   create_sell_order( buyer_id, asset( 200 ), asset( 100, stat_id ) );
+   generate_block();
+   db.pop_block();
+   db.clear_pending();
+   make_irreversible( db.head_block_num() + 1 );
+   BOOST_CHECK_EQUAL( base_volume(), 0 );
+   BOOST_CHECK_EQUAL( bucket_volume(), 0 );
+
+   // a fill from an irreversible block stays when a later block is popped
+   create_sell_order( seller_id, asset( 100, stat_id ), asset( 300 ) );
+   create_sell_order( buyer_id, asset( 300 ), asset( 100, stat_id ) );
+   generate_block();
+   const uint32_t trade_block = db.head_block_num();
+   make_irreversible( trade_block );
+   BOOST_CHECK_EQUAL( base_volume(), 300 );
+   BOOST_CHECK_EQUAL( bucket_volume(), 300 );
+   db.pop_block();
+   BOOST_CHECK_EQUAL( base_volume(), 300 );
+   BOOST_CHECK_EQUAL( bucket_volume(), 300 );
+   generate_block();
+   BOOST_CHECK_EQUAL( base_volume(), 300 );
+   BOOST_CHECK_EQUAL( bucket_volume(), 300 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( aggregated_market_history )
+{ try {
+   using namespace graphene::market_history;
+   ACTORS( (buyer)(seller) );
+   const asset_object& agg = create_user_issued_asset( "AGG" );
+   const asset_id_type agg_id = agg.id;
+   fund( buyer, asset( 100000 ) );
+   issue_uia( seller, asset( 100000, agg_id ) );
+   generate_block();
+
+   // one fill in each of a run of blocks, so they spread over several 15 second buckets
+   int64_t total = 0;
+   for( int i = 1; i <= 12; ++i )
+   {
+      create_sell_order( seller_id, asset( 10, agg_id ), asset( 10 * i ) );
+      create_sell_order( buyer_id, asset( 10 * i ), asset( 10, agg_id ) );
+      total += 10 * i;
+      generate_block();
+   }
+   const fc::time_point_sec last_trade = db.head_block_time();
+   for( int i = 0; i < 100 && db.get_dynamic_global_properties().last_irreversible_block_num < db.head_block_num(); ++i )
+      generate_block();
+
+   graphene::app::history_api hist( app );
+   const fc::time_point_sec start = last_trade - 3600;
+   auto sum = []( const vector<bucket_object>& buckets ) {
+      int64_t volume = 0;
+      for( const auto& b : buckets )
+         volume += b.base_volume.value;
+      return volume;
+   };
+
+   // a size that is tracked gives the stored buckets
+   const auto stored = hist.get_market_history( asset_id_type(), agg_id, 60, start, last_trade );
+   const auto same = hist.get_aggregated_market_history( asset_id_type(), agg_id, 60, start, last_trade, 200 );
+   BOOST_REQUIRE_EQUAL( stored.size(), same.size() );
+   for( size_t i = 0; i < stored.size(); ++i )
+   {
+      BOOST_CHECK( stored[i].key.open == same[i].key.open );
+      BOOST_CHECK_EQUAL( stored[i].base_volume.value, same[i].base_volume.value );
+      BOOST_CHECK_EQUAL( stored[i].quote_volume.value, same[i].quote_volume.value );
+   }
+   BOOST_CHECK_EQUAL( sum( same ), total );
+
+   // 45 seconds is only a multiple of 15, every volume ends up in exactly one aligned bucket
+   const auto merged = hist.get_aggregated_market_history( asset_id_type(), agg_id, 45, start, last_trade, 200 );
+   BOOST_REQUIRE( !merged.empty() );
+   BOOST_CHECK_EQUAL( sum( merged ), total );
+   for( size_t i = 0; i < merged.size(); ++i )
+   {
+      BOOST_CHECK_EQUAL( merged[i].key.seconds, 45u );
+      BOOST_CHECK_EQUAL( merged[i].key.open.sec_since_epoch() % 45, 0u );
+      if( i > 0 )
+         BOOST_CHECK( merged[i-1].key.open < merged[i].key.open );
+      BOOST_CHECK( merged[i].low() <= merged[i].high() );
+   }
+
+   // the limit counts buckets of the requested size
+   const auto limited = hist.get_aggregated_market_history( asset_id_type(), agg_id, 45, start, last_trade, 1 );
+   BOOST_REQUIRE_EQUAL( limited.size(), 1u );
+   BOOST_CHECK( limited.front().key.open == merged.front().key.open );
+   BOOST_CHECK_EQUAL( limited.front().base_volume.value, merged.front().base_volume.value );
+
+   // a size no tracked bucket divides, and too large a limit, are refused
+   GRAPHENE_REQUIRE_THROW( hist.get_aggregated_market_history( asset_id_type(), agg_id, 7, start, last_trade, 10 ),
+                           fc::exception );
+   GRAPHENE_REQUIRE_THROW( hist.get_aggregated_market_history( asset_id_type(), agg_id, 60, start, last_trade, 201 ),
+                           fc::exception );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -24,6 +24,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <graphene/app/api.hpp>
+
+#include <graphene/account_history/account_history_plugin.hpp>
+
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/exceptions.hpp>
 #include <graphene/chain/hardfork.hpp>
@@ -39,6 +43,8 @@
 #include <graphene/chain/witness_object.hpp>
 #include <graphene/chain/worker_object.hpp>
 
+#include <graphene/db/slab_index.hpp>
+
 #include <graphene/utilities/tempdir.hpp>
 
 #include <fc/crypto/digest.hpp>
@@ -48,6 +54,62 @@
 using namespace graphene::chain;
 using namespace graphene::chain::test;
 
+namespace {
+
+template<typename T>
+boost::program_options::variables_map history_options( const std::string& name, const T& value )
+{
+   boost::program_options::variables_map options;
+   options.insert( std::make_pair( name, boost::program_options::variable_value( value, false ) ) );
+   return options;
+}
+
+struct max_ops_fixture : database_fixture
+{
+   max_ops_fixture() : database_fixture( history_options( "max-ops-per-account", uint32_t( 3 ) ) ) {}
+};
+
+struct max_age_fixture : database_fixture
+{
+   max_age_fixture()
+      : database_fixture( history_options( "max-op-age-seconds", uint32_t( 10 * GRAPHENE_DEFAULT_BLOCK_INTERVAL ) ) ) {}
+};
+
+/** only transfers are indexed, and never for the committee account */
+struct transfer_history_fixture : database_fixture
+{
+   static boost::program_options::variables_map options()
+   {
+      auto options = history_options( "history-operations", vector<string>{ "transfer_operation" } );
+      options.insert( std::make_pair( "exclude-account",
+                      boost::program_options::variable_value( vector<string>{ "\"1.2.0\"" }, false ) ) );
+      return options;
+   }
+   transfer_history_fixture() : database_fixture( options() ) {}
+};
+
+/** operations are kept packed, and only the last three of each account */
+struct packed_history_fixture : database_fixture
+{
+   static boost::program_options::variables_map options()
+   {
+      auto options = history_options( "history-packed", true );
+      options.insert( std::make_pair( "max-ops-per-account", boost::program_options::variable_value( uint32_t( 3 ), false ) ) );
+      return options;
+   }
+   packed_history_fixture() : database_fixture( options() ) {}
+};
+
+/** transfers, given by their tag, are not indexed */
+struct no_transfer_history_fixture : database_fixture
+{
+   no_transfer_history_fixture()
+      : database_fixture( history_options( "history-exclude-operations",
+                                           vector<string>{ fc::to_string( operation::tag<transfer_operation>::value ) } ) ) {}
+};
+
+}
+
 BOOST_FIXTURE_TEST_SUITE( operation_tests, database_fixture )
 
 BOOST_AUTO_TEST_CASE( withdraw_permission_create )
@@ -1622,4 +1684,386 @@ BOOST_AUTO_TEST_CASE( buyback )
    } FC_LOG_AND_RETHROW()
 }
 
+BOOST_AUTO_TEST_CASE( sweep_book )
+{ try {
+   ACTORS( (alice)(bob)(izzy) );
+   generate_blocks( HARDFORK_555_TIME );
+   generate_block();
+   set_expiration( db, trx );
+
+   asset_id_type buyme_id = create_user_issued_asset( "BUYME", izzy_id(db), 0 ).id;
+   issue_uia( alice_id, asset( 1000, buyme_id ) );
+   fund( bob_id(db), asset( 1000 ) );
+   limit_order_id_type low_id = create_sell_order( alice_id, asset( 10, buyme_id ), asset( 50 ) )->id;
+   limit_order_id_type mid_id = create_sell_order( alice_id, asset( 100, buyme_id ), asset( 1000 ) )->id;
+   const auto& limit_idx = db.get_index_type<limit_order_index>();
+   const uint64_t next_instance = limit_idx.get_next_id().instance();
+
+   {
+      auto session = db._undo_db.start_undo_session();
+      BOOST_REQUIRE( db.sweep_book( bob_id(db), asset( 250 ), buyme_id(db) ) );
+      // 50 CORE buys the low order's 10, 200 CORE buys 20 of the mid order
+      BOOST_CHECK( db.find( low_id ) == nullptr );
+      BOOST_CHECK_EQUAL( mid_id(db).for_sale.value, 80 );
+      BOOST_CHECK_EQUAL( get_balance( bob_id, buyme_id ), 30 );
+      BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ), 750 );
+      BOOST_CHECK_EQUAL( get_balance( alice_id, asset_id_type() ), 250 );
+      // the order that was never created still used up its id
+      BOOST_CHECK_EQUAL( limit_idx.get_next_id().instance(), next_instance + 1 );
+   }
+
+   BOOST_CHECK_EQUAL( limit_idx.get_next_id().instance(), next_instance );
+   BOOST_CHECK_EQUAL( low_id(db).for_sale.value, 10 );
+   BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ), 1000 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( account_history_paging )
+{ try {
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 1000000 ) );
+   generate_block();
+
+   vector<operation_history_id_type> transfers;
+   for( int i = 0; i < 30; ++i )
+   {
+      transfer( alice_id, bob_id, asset( 1 + i ) );
+      generate_block();
+      const auto& stats = bob_id(db).statistics(db);
+      transfers.push_back( stats.most_recent_op(db).operation_id );
+   }
+
+   graphene::app::history_api hist( app );
+   // ten transfers back from the 20th, newest first
+   auto page = hist.get_account_history( bob_id, transfers[9], 100, transfers[19] );
+   BOOST_REQUIRE_EQUAL( page.size(), 10u );
+   BOOST_CHECK( page.front().id == transfers[19] );
+   BOOST_CHECK( page.back().id == transfers[10] );
+
+   page = hist.get_account_history( bob_id, operation_history_id_type(), 5, operation_history_id_type() );
+   BOOST_REQUIRE_EQUAL( page.size(), 5u );
+   BOOST_CHECK( page.front().id == transfers.back() );
+
+   // bob was created, then received the transfers
+   const uint32_t total = bob_id(db).statistics(db).total_ops;
+   BOOST_CHECK_EQUAL( total, transfers.size() + 1 );
+   page = hist.get_relative_account_history( bob_id, 0, 100, 0 );
+   BOOST_CHECK_EQUAL( page.size(), total );
+   page = hist.get_relative_account_history( bob_id, 5, 3, 11 );
+   BOOST_REQUIRE_EQUAL( page.size(), 3u );
+   BOOST_CHECK( page[0].id == transfers[9] );
+   BOOST_CHECK( page[2].id == transfers[7] );
+
+   // history-packed keeps the same operations, which decode to what was stored
+   for( const auto& id : transfers )
+   {
+      const operation_history_object& op = id(db);
+      graphene::account_history::packed_operation_history_object packed( op );
+      packed.id = graphene::account_history::packed_operation_history_id_type( id.instance.value );
+      BOOST_CHECK( packed.operation_id() == id );
+      BOOST_CHECK( fc::raw::pack( packed.unpack() ) == fc::raw::pack( op ) );
+      BOOST_CHECK_LT( packed.packed.size(), sizeof( op.op ) );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( account_history_max_ops_per_account, max_ops_fixture )
+{ try {
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 1000000 ) );
+   generate_block();
+
+   vector<operation_history_id_type> transfers;
+   for( int i = 0; i < 10; ++i )
+   {
+      transfer( alice_id, bob_id, asset( 1 + i ) );
+      generate_block();
+      transfers.push_back( bob_id(db).statistics(db).most_recent_op(db).operation_id );
+   }
+
+   // only the newest three entries of bob remain, the count goes on
+   const auto& by_seq_idx = db.get_index_type<account_transaction_history_index>().indices().get<by_seq>();
+   vector<operation_history_id_type> kept;
+   for( auto itr = by_seq_idx.lower_bound( boost::make_tuple( bob_id, 0 ) );
+        itr != by_seq_idx.end() && itr->account == bob_id; ++itr )
+      kept.push_back( itr->operation_id );
+   BOOST_CHECK( kept == vector<operation_history_id_type>( transfers.end() - 3, transfers.end() ) );
+   BOOST_CHECK_EQUAL( bob_id(db).statistics(db).total_ops, transfers.size() + 1 );
+
+   graphene::app::history_api hist( app );
+   auto page = hist.get_account_history( bob_id, operation_history_id_type(), 100, operation_history_id_type() );
+   BOOST_REQUIRE_EQUAL( page.size(), 3u );
+   BOOST_CHECK( page.front().id == transfers.back() );
+
+   // alice keeps the same three, so the older transfers lost their last entry and are gone
+   for( size_t i = 0; i < transfers.size(); ++i )
+      BOOST_CHECK_EQUAL( db.find( transfers[i] ) != nullptr, i + 3 >= transfers.size() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( account_history_packed, packed_history_fixture )
+{ try {
+   const auto plugin = app.get_plugin<graphene::account_history::account_history_plugin>( "account_history" );
+   BOOST_REQUIRE( plugin->history_packed() );
+
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 1000000 ) );
+   generate_block();
+
+   vector<operation_history_id_type> transfers;
+   for( int i = 0; i < 6; ++i )
+   {
+      transfer( alice_id, bob_id, asset( 1 + i ) );
+      generate_block();
+      transfers.push_back( bob_id(db).statistics(db).most_recent_op(db).operation_id );
+   }
+
+   // the operations are only in the packed form, under the same instances, and pruning removes them too
+   for( size_t i = 0; i < transfers.size(); ++i )
+   {
+      const graphene::account_history::packed_operation_history_id_type packed_id( transfers[i].instance.value );
+      BOOST_CHECK( db.find( transfers[i] ) == nullptr );
+      BOOST_CHECK_EQUAL( db.find( packed_id ) != nullptr, i + 3 >= transfers.size() );
+   }
+
+   // and they decode to the transfers that were made
+   for( size_t i = transfers.size() - 3; i < transfers.size(); ++i )
+   {
+      const operation_history_object op = plugin->get_operation( transfers[i] );
+      BOOST_CHECK( op.id == transfers[i] );
+      BOOST_REQUIRE( op.op.which() == operation::tag<transfer_operation>::value );
+      BOOST_CHECK_EQUAL( op.op.get<transfer_operation>().amount.amount.value, int64_t( 1 + i ) );
+   }
+
+   graphene::app::history_api hist( app );
+   auto page = hist.get_account_history( bob_id, operation_history_id_type(), 100, operation_history_id_type() );
+   BOOST_REQUIRE_EQUAL( page.size(), 3u );
+   for( size_t i = 0; i < page.size(); ++i )
+   {
+      BOOST_CHECK( page[i].id == transfers[transfers.size() - 1 - i] );
+      BOOST_CHECK_EQUAL( page[i].op.get<transfer_operation>().amount.amount.value, int64_t( transfers.size() - i ) );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( account_history_max_op_age, max_age_fixture )
+{ try {
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 1000000 ) );
+   generate_block();
+   transfer( alice_id, bob_id, asset( 1 ) );
+   generate_block();
+   const operation_history_id_type old_op = bob_id(db).statistics(db).most_recent_op(db).operation_id;
+
+   for( int i = 0; i < 11; ++i )
+      generate_block();
+   transfer( alice_id, bob_id, asset( 2 ) );
+   generate_block();
+   const operation_history_id_type new_op = bob_id(db).statistics(db).most_recent_op(db).operation_id;
+
+   BOOST_CHECK( db.find( old_op ) == nullptr );
+   BOOST_CHECK( db.find( new_op ) != nullptr );
+
+   // every operation left is younger than ten blocks, and every entry left refers to one
+   const uint32_t cutoff = db.head_block_num() - 10;
+   for( const operation_history_object& op : db.get_index_type< slab_index<operation_history_object> >() )
+      BOOST_CHECK_GE( op.block_num, cutoff );
+   for( const account_transaction_history_object& entry :
+        db.get_index_type<account_transaction_history_index>().indices() )
+      BOOST_CHECK( db.find( entry.operation_id ) != nullptr );
+
+   graphene::app::history_api hist( app );
+   auto page = hist.get_account_history( bob_id, operation_history_id_type(), 100, operation_history_id_type() );
+   BOOST_REQUIRE_EQUAL( page.size(), 1u );
+   BOOST_CHECK( page.front().id == new_op );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( account_history_operation_filter, transfer_history_fixture )
+{ try {
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 1000000 ) );
+   transfer( alice_id, bob_id, asset( 10 ) );
+   generate_block();
+
+   const int transfer_tag = operation::tag<transfer_operation>::value;
+   for( const operation_history_object& op : db.get_index_type< slab_index<operation_history_object> >() )
+      BOOST_CHECK_EQUAL( op.op.which(), transfer_tag );
+
+   // the account creations are left out, as is everything of the excluded committee account
+   graphene::app::history_api hist( app );
+   auto page = hist.get_account_history( alice_id, operation_history_id_type(), 100, operation_history_id_type() );
+   BOOST_CHECK_EQUAL( page.size(), 2u );
+   page = hist.get_account_history( bob_id, operation_history_id_type(), 100, operation_history_id_type() );
+   BOOST_REQUIRE_EQUAL( page.size(), 1u );
+   BOOST_CHECK( page.front().op.get<transfer_operation>().from == alice_id );
+   page = hist.get_account_history( account_id_type(), operation_history_id_type(), 100, operation_history_id_type() );
+   BOOST_CHECK( page.empty() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( account_history_excluded_operations, no_transfer_history_fixture )
+{ try {
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 1000000 ) );
+   transfer( alice_id, bob_id, asset( 10 ) );
+   generate_block();
+
+   const int transfer_tag = operation::tag<transfer_operation>::value;
+   for( const operation_history_object& op : db.get_index_type< slab_index<operation_history_object> >() )
+      BOOST_CHECK_NE( op.op.which(), transfer_tag );
+
+   // only the creation of bob is left in its history
+   graphene::app::history_api hist( app );
+   auto page = hist.get_account_history( bob_id, operation_history_id_type(), 100, operation_history_id_type() );
+   BOOST_REQUIRE_EQUAL( page.size(), 1u );
+   BOOST_CHECK_EQUAL( page.front().op.which(), operation::tag<account_create_operation>::value );
+   BOOST_CHECK_EQUAL( bob_id(db).statistics(db).total_ops, 1u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( key_subscriptions )
+{ try {
+   ACTORS( (alice) );
+   generate_block();
+
+   graphene::app::database_api db_api( db );
+   vector<variant> updates;
+   db_api.set_subscribe_callback( [&updates]( const variant& v ) {
+      for( const variant& u : v.get_array() )
+         updates.push_back( u );
+   }, false );
+   auto reported = [&updates]( object_id_type id ) {
+      return std::any_of( updates.begin(), updates.end(), [id]( const variant& u ) {
+         return u.is_object() && u.get_object().contains( "id" ) && u["id"].as<object_id_type>() == id;
+      } );
+   };
+
+   auto refs = db_api.get_key_references( { alice_public_key } );
+   BOOST_REQUIRE_EQUAL( refs.size(), 1u );
+   BOOST_CHECK( refs.front() == vector<account_id_type>{ alice_id } );
+
+   // an account created later with the key is reported, one with another key is not
+   const account_id_type carol_id = create_account( "carol", alice_public_key ).id;
+   const account_id_type dave_id = create_account( "dave", generate_private_key( "dave" ).get_public_key() ).id;
+   generate_block();
+   fc::usleep( fc::milliseconds( 100 ) );
+   BOOST_CHECK( reported( carol_id ) );
+   BOOST_CHECK( !reported( dave_id ) );
+
+   // clearing the subscriptions stops them
+   db_api.set_subscribe_callback( [&updates]( const variant& v ) {
+      for( const variant& u : v.get_array() )
+         updates.push_back( u );
+   }, true );
+   updates.clear();
+   create_account( "erin", alice_public_key );
+   generate_block();
+   fc::usleep( fc::milliseconds( 100 ) );
+   BOOST_CHECK( updates.empty() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( packed_api_results )
+{ try {
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 100000 ) );
+   transfer( alice_id, bob_id, asset( 100 ) );
+   for( int i = 0; i < 5; ++i )
+      generate_block();
+
+   graphene::app::packed_api packed( app );
+   const uint32_t head = db.head_block_num();
+   const uint32_t first = head - 4;
+
+   // blocks are sent as they are stored, and unpack to what the database holds
+   auto block = fc::raw::unpack< optional<signed_block> >( packed.get_block( first ) );
+   BOOST_REQUIRE( block.valid() );
+   BOOST_CHECK( block->id() == db.get_block_id_for_num( first ) );
+   BOOST_CHECK( !fc::raw::unpack< optional<signed_block> >( packed.get_block( head + 1 ) ).valid() );
+
+   // the range stops at the head block
+   auto blocks = fc::raw::unpack< vector<signed_block> >( packed.get_blocks( first, 10 ) );
+   BOOST_REQUIRE_EQUAL( blocks.size(), 5u );
+   for( uint32_t i = 0; i < blocks.size(); ++i )
+      BOOST_CHECK( blocks[i].id() == db.get_block_id_for_num( first + i ) );
+   BOOST_CHECK_EQUAL( fc::raw::unpack< vector<signed_block> >( packed.get_blocks( first, 2 ) ).size(), 2u );
+   GRAPHENE_REQUIRE_THROW( packed.get_blocks( first, 1001 ), fc::exception );
+
+   // the headers are cut from the same blocks, signature included
+   auto headers = fc::raw::unpack< vector<signed_block_header> >( packed.get_block_headers( first, 10 ) );
+   BOOST_REQUIRE_EQUAL( headers.size(), blocks.size() );
+   for( uint32_t i = 0; i < headers.size(); ++i )
+   {
+      BOOST_CHECK( headers[i].id() == blocks[i].id() );
+      BOOST_CHECK( headers[i].witness_signature == blocks[i].witness_signature );
+      BOOST_CHECK( headers[i].transaction_merkle_root == blocks[i].transaction_merkle_root );
+   }
+   BOOST_CHECK( fc::raw::unpack< vector<signed_block_header> >( packed.get_block_headers( 0, 10 ) ).empty() );
+   GRAPHENE_REQUIRE_THROW( packed.get_block_headers( first, 1001 ), fc::exception );
+
+   // the objects are packed as the other apis return them
+   graphene::app::database_api db_api( db );
+   graphene::app::history_api hist( app );
+   BOOST_CHECK( packed.get_global_properties() == fc::raw::pack( db_api.get_global_properties() ) );
+   BOOST_CHECK( packed.get_chain_properties() == fc::raw::pack( db_api.get_chain_properties() ) );
+   BOOST_CHECK_EQUAL( fc::raw::unpack<dynamic_global_property_object>( packed.get_dynamic_global_properties() )
+                         .head_block_number, head );
+   auto accounts = fc::raw::unpack< std::map<string,full_account> >( packed.get_full_accounts( { "alice" } ) );
+   BOOST_REQUIRE_EQUAL( accounts.size(), 1u );
+   BOOST_CHECK( accounts["alice"].account.id == alice_id );
+   BOOST_CHECK( packed.get_account_history( bob_id )
+                == fc::raw::pack( hist.get_account_history( bob_id, operation_history_id_type(), 100,
+                                                            operation_history_id_type() ) ) );
+
+   // cached results follow the head block
+   generate_block();
+   BOOST_CHECK_EQUAL( fc::raw::unpack<dynamic_global_property_object>( packed.get_dynamic_global_properties() )
+                         .head_block_number, head + 1 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( account_operation_subscriptions )
+{ try {
+   ACTORS( (alice)(bob) );
+   fund( alice, asset( 1000000 ) );
+   generate_block();
+
+   auto plugin = app.get_plugin<graphene::account_history::account_history_plugin>( "account_history" );
+   auto session = std::make_shared<int>( 0 );
+   vector<operation_history_object> received;
+   // a transfer between the two is told once
+   plugin->subscribe_to_operations( { alice_id, bob_id }, session, [&received]( const operation_history_object& op ) {
+      received.push_back( op );
+   } );
+
+   transfer( alice_id, bob_id, asset( 100 ) );
+   generate_block();
+   BOOST_REQUIRE_EQUAL( received.size(), 1u );
+   BOOST_CHECK( received[0].id == bob_id(db).statistics(db).most_recent_op(db).operation_id );
+   BOOST_CHECK_EQUAL( received[0].op.which(), operation::tag<transfer_operation>::value );
+
+   // the subscription ends with its session
+   session.reset();
+   transfer( alice_id, bob_id, asset( 100 ) );
+   generate_block();
+   BOOST_CHECK_EQUAL( received.size(), 1u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( prefix_lookups )
+{ try {
+   ACTORS( (alice)(alicia)(bob) );
+   create_user_issued_asset( "ALPHA" );
+   create_user_issued_asset( "ALPS" );
+   create_user_issued_asset( "BETA" );
+   generate_block();
+
+   graphene::app::database_api api( db );
+   auto accounts = api.lookup_accounts_by_prefix( "ali", 1000 );
+   BOOST_REQUIRE_EQUAL( accounts.size(), 2u );
+   BOOST_CHECK( accounts["alice"] == alice_id );
+   BOOST_CHECK( accounts["alicia"] == alicia_id );
+   BOOST_CHECK_EQUAL( api.lookup_accounts_by_prefix( "ali", 1 ).size(), 1u );
+   BOOST_CHECK( api.lookup_accounts_by_prefix( "alicex", 1000 ).empty() );
+   BOOST_CHECK_EQUAL( api.lookup_accounts_by_prefix( "bob", 1000 ).size(), 1u );
+
+   auto assets = api.list_assets_by_prefix( "AL", 100 );
+   BOOST_REQUIRE_EQUAL( assets.size(), 2u );
+   BOOST_CHECK_EQUAL( assets[0].symbol, "ALPHA" );
+   BOOST_CHECK_EQUAL( assets[1].symbol, "ALPS" );
+   BOOST_CHECK( api.list_assets_by_prefix( "ALX", 100 ).empty() );
+   GRAPHENE_REQUIRE_THROW( api.list_assets_by_prefix( "AL", 101 ), fc::exception );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()